@@ -0,0 +1,289 @@
+// BasicFrame.h : Frame logic of the basic rendering, written against the rendering interface of RenderBackend.h.
+//
+// The application runs it on the Direct3D 12 backend, and HeadlessFrame.cpp on the null backend.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <iterator>
+
+#include "RenderBackend.h"
+#include "BundleCache.h"
+#include "DrawPacketQueue.h"
+#include "HiZOcclusion.h"
+
+struct BasicVertex
+{
+    float position[4];
+    float color[4];
+};
+
+static constexpr BasicVertex BASIC_SQUARE_VERTICES[]{
+    // Direct3D是以左手作为前面背面顶点排列的依据
+    {.position { -0.75f, 0.75f, 0.0f, 1.0f }, .color { 0.9f, 0.1f, 0.1f, 1.0f } },     // top left
+    {.position { 0.75f, 0.75f, 0.0f, 1.0f }, .color { 0.9f, 0.9f, 0.1f, 1.0f } },      // top right
+    {.position { -0.75f, -0.75f, 0.0f, 1.0f }, .color { 0.1f, 0.9f, 0.1f, 1.0f } },    // bottom left
+    {.position { 0.75f, -0.75f, 0.0f, 1.0f }, .color { 0.1f, 0.1f, 0.9f, 1.0f } }      // bottom right
+};
+
+static constexpr float BASIC_SQUARE_HALF_EXTENT = 0.75f;
+
+static constexpr uint32_t BASIC_ROOT_SIGNATURE_ID = 0;
+static constexpr float BASIC_CLEAR_COLOR[] = { 0.5f, 0.6f, 0.5f, 1.0f };
+static constexpr float BASIC_CLEAR_DEPTH = HIZ_FAR_DEPTH;
+
+// Pipeline ID of the depth-only variant of a shader permutation, used by the depth prepass
+static constexpr uint32_t BASIC_DEPTH_ONLY_PIPELINE_FLAG = 1U << 16;
+
+// Passes of the draw packet sort keys
+static constexpr uint32_t BASIC_DRAW_PASS_DEPTH_PREPASS = 0;
+static constexpr uint32_t BASIC_DRAW_PASS_COLOR = 1;
+
+// The scene has a single material.
+static constexpr uint32_t BASIC_MATERIAL_ID = 0;
+
+// Placement of a copy of the square, in root constants 1 to 4 after the rotation angle: the offset in NDC,
+// the depth in [0, 1] and the scale
+struct BasicObject
+{
+    float offsetX;
+    float offsetY;
+    float depth;
+    float scale;
+};
+
+static constexpr uint32_t BASIC_OBJECT_CONSTANT_OFFSET = 1;
+static constexpr uint32_t BASIC_OBJECT_CONSTANT_COUNT = uint32_t(sizeof(BasicObject) / sizeof(uint32_t));
+static constexpr uint32_t BASIC_ROOT_CONSTANT_COUNT = BASIC_OBJECT_CONSTANT_OFFSET + BASIC_OBJECT_CONSTANT_COUNT;
+
+// Sorted front to back. The four small squares near the center are always hidden by the big one, whatever the rotation.
+static constexpr BasicObject BASIC_SCENE_OBJECTS[]{
+    { .offsetX = 0.0f, .offsetY = 0.0f, .depth = 0.1f, .scale = 0.2f },
+    { .offsetX = 0.0f, .offsetY = 0.0f, .depth = 0.25f, .scale = 1.0f },
+    { .offsetX = -0.15f, .offsetY = 0.15f, .depth = 0.6f, .scale = 0.1f },
+    { .offsetX = 0.15f, .offsetY = 0.15f, .depth = 0.6f, .scale = 0.1f },
+    { .offsetX = -0.15f, .offsetY = -0.15f, .depth = 0.6f, .scale = 0.1f },
+    { .offsetX = 0.15f, .offsetY = -0.15f, .depth = 0.6f, .scale = 0.1f },
+    { .offsetX = -0.8f, .offsetY = 0.8f, .depth = 0.6f, .scale = 0.15f },
+    { .offsetX = 0.8f, .offsetY = 0.8f, .depth = 0.6f, .scale = 0.15f },
+    { .offsetX = -0.8f, .offsetY = -0.8f, .depth = 0.6f, .scale = 0.15f },
+    { .offsetX = 0.8f, .offsetY = -0.8f, .depth = 0.6f, .scale = 0.15f }
+};
+
+static constexpr uint32_t BASIC_SCENE_OBJECT_COUNT = uint32_t(std::size(BASIC_SCENE_OBJECTS));
+
+// The objects are culled on the CPU with the first Hi-Z level that fits in this size, read back from the GPU.
+static constexpr uint32_t BASIC_HIZ_READBACK_SIZE = 64;
+
+// Screen bounds of the object in a viewport of `width` x `height` pixels, whatever its rotation: the square of its circumcircle
+static inline auto GetBasicObjectHiZBounds(const BasicObject& object, float width, float height) -> HiZBounds
+{
+    const float radius = BASIC_SQUARE_HALF_EXTENT * object.scale * std::sqrt(2.0f);
+    return HiZBounds{
+        .left = (object.offsetX - radius + 1.0f) * 0.5f * width,
+        .top = (1.0f - (object.offsetY + radius)) * 0.5f * height,
+        .right = (object.offsetX + radius + 1.0f) * 0.5f * width,
+        .bottom = (1.0f - (object.offsetY - radius)) * 0.5f * height,
+        .minDepth = object.depth
+    };
+}
+
+struct BasicBundleDesc
+{
+    uint32_t pipelineId;
+    RenderResourceId vertexBuffer;
+    uint32_t vertexBufferSize;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+};
+
+struct BasicFrameDesc
+{
+    uint32_t pipelineId;
+    RenderResourceId sceneTarget;       // the back buffer, or the scene target in the dynamic resolution mode
+    uint32_t sceneTargetState;          // state of the scene target outside the scene pass
+    RenderResourceId backBuffer;
+    RenderViewport viewport;
+    RenderRect scissorRect;
+    bool clearScissorRectOnly;          // in the multi-adapter mode, each adapter only renders its own band
+    float rotateAngle;
+    RenderResourceId depthTarget;       // in DEPTH_WRITE state
+    uint32_t depthStoreOp;              // RENDER_STORE_OP_PRESERVE when the depth is read after the scene pass, e.g. for the Hi-Z pyramid
+    const BasicObject* objects;         // those not culled, front to back
+    uint32_t objectCount;
+    const DrawPacketQueue* drawPackets; // sorted, drawn instead of the bundles when not null; `userData` is the object index
+    DrawStateFilter* drawStateFilter;   // used with `drawPackets`
+};
+
+// Passes recorded around the basic scene pass that only some backends have, e.g. the GPU timestamps
+class BasicFrameExtension
+{
+public:
+    virtual ~BasicFrameExtension() = default;
+
+    virtual auto OnFrameBegin(RenderCommandList& commandList) -> void { (void)commandList; }
+    // After the scene render pass. The scene target is still in RENDER_TARGET state, and the back buffer is in RENDER_TARGET state on return.
+    // The depth target is in DEPTH_WRITE state, and must be in that state on return.
+    virtual auto OnScenePassEnd(RenderCommandList& commandList) -> void { (void)commandList; }
+    // Just before the command list is closed
+    virtual auto OnFrameEnd(RenderCommandList& commandList) -> void { (void)commandList; }
+};
+
+static inline auto GetBasicBundleDrawKey(const BasicBundleDesc& desc) -> BundleDrawKey
+{
+    return BundleDrawKey{
+        .pipelineId = desc.pipelineId,
+        .topology = RENDER_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP,
+        .vertexBuffer = desc.vertexBuffer,
+        .vertexBufferOffset = 0,
+        .vertexBufferSize = desc.vertexBufferSize,
+        .vertexStride = desc.vertexStride,
+        .indexBuffer = RENDER_INVALID_RESOURCE,
+        .indexBufferOffset = 0,
+        .indexBufferSize = 0,
+        .indexFormat = 0,
+        .count = desc.vertexCount,
+        .instanceCount = 1,
+        .start = 0,
+        .baseVertex = 0,
+        .startInstance = 0
+    };
+}
+
+// The bundle does not inherit the PSO from the command list, so it is recorded again whenever the PSO changes.
+// Without a capture, the application gets the bundle from its BundleCache, which records it in the same way.
+static inline auto RecordBasicBundle(RenderCommandList& bundle, const BasicBundleDesc& desc) -> bool
+{
+    return RecordBundleDraw(bundle, GetBasicBundleDrawKey(desc));
+}
+
+static inline auto SetBasicObjectConstants(RenderCommandList& commandList, const BasicObject& object) -> void
+{
+    uint32_t constants[BASIC_OBJECT_CONSTANT_COUNT]{ };
+    memcpy(constants, &object, sizeof(constants));
+    for (uint32_t i = 0; i < BASIC_OBJECT_CONSTANT_COUNT; ++i) {
+        commandList.SetGraphicsRoot32BitConstant(0, constants[i], BASIC_OBJECT_CONSTANT_OFFSET + i);
+    }
+}
+
+// Fill `queue` with a color packet of each object, and a depth-only packet of each object before them with `depthPrepass`,
+// then sort it on the calling thread.
+static inline auto BuildBasicDrawPackets(DrawPacketQueue& queue, const BasicBundleDesc& desc, const BasicObject objects[], uint32_t objectCount,
+    bool depthPrepass) -> void
+{
+    queue.Clear();
+    for (uint32_t pass = depthPrepass ? BASIC_DRAW_PASS_DEPTH_PREPASS : BASIC_DRAW_PASS_COLOR; pass <= BASIC_DRAW_PASS_COLOR; ++pass)
+    {
+        BasicBundleDesc passDesc = desc;
+        if (pass == BASIC_DRAW_PASS_DEPTH_PREPASS) {
+            passDesc.pipelineId |= BASIC_DEPTH_ONLY_PIPELINE_FLAG;
+        }
+        const BundleDrawKey draw = GetBasicBundleDrawKey(passDesc);
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            const uint64_t sortKey = MakeDrawSortKey(pass, passDesc.pipelineId, BASIC_MATERIAL_ID, GetDrawDepthBucket(objects[i].depth, false));
+            queue.Push(DrawPacket{ .sortKey = sortKey, .draw = draw, .userData = i });
+        }
+    }
+    queue.Sort(1);
+}
+
+// `bundle` draws the square, or is null when the frame is drawn from `desc.drawPackets`.
+// `prepassBundle` draws the square with the depth-only variant of the PSO, or is null to skip the depth prepass.
+// With the prepass, the color pass only shades the nearest fragment of each pixel, whatever the draw order.
+static inline auto RecordBasicFrame(RenderCommandList& commandList, RenderCommandList* bundle, RenderCommandList* prepassBundle,
+    const BasicFrameDesc& desc, BasicFrameExtension* extension) -> bool
+{
+    if (!commandList.Reset(desc.pipelineId)) return false;
+
+    if (extension != nullptr) {
+        extension->OnFrameBegin(commandList);
+    }
+
+    commandList.SetViewport(desc.viewport);
+    commandList.SetScissorRect(desc.scissorRect);
+
+    // Indicate that the scene target will be used as a render target.
+    commandList.ResourceBarrier(desc.sceneTarget, desc.sceneTargetState, RENDER_RESOURCE_STATE_RENDER_TARGET);
+
+    // The previous contents are never loaded, and the result is stored for the present or the upscale.
+    // The depth is only stored when something reads it after the pass.
+    const RenderPassDesc scenePass{
+        .renderTarget = desc.sceneTarget,
+        .loadOp = RENDER_LOAD_OP_CLEAR,
+        .storeOp = RENDER_STORE_OP_PRESERVE,
+        .clearColor { BASIC_CLEAR_COLOR[0], BASIC_CLEAR_COLOR[1], BASIC_CLEAR_COLOR[2], BASIC_CLEAR_COLOR[3] },
+        .clearRect = desc.clearScissorRectOnly ? &desc.scissorRect : nullptr,
+        .depthTarget = desc.depthTarget,
+        .depthLoadOp = RENDER_LOAD_OP_CLEAR,
+        .depthStoreOp = desc.depthStoreOp,
+        .clearDepth = BASIC_CLEAR_DEPTH
+    };
+    commandList.BeginRenderPass(scenePass);
+
+    // This can also be set into a command bundle.
+    // Set it to this command list for update per frame
+    commandList.SetGraphicsRootSignature(BASIC_ROOT_SIGNATURE_ID);
+
+    uint32_t rotateAngleConstant = 0;
+    memcpy(&rotateAngleConstant, &desc.rotateAngle, sizeof(rotateAngleConstant));
+    commandList.SetGraphicsRoot32BitConstant(0, rotateAngleConstant, 0);
+
+    if (desc.drawPackets != nullptr)
+    {
+        // The packets are sorted by pass, pipeline and depth, so the state only changes between the passes.
+        desc.drawStateFilter->Reset(desc.pipelineId);
+        for (size_t i = 0; i < desc.drawPackets->GetCount(); ++i)
+        {
+            const DrawPacket& packet = desc.drawPackets->GetSorted(i);
+            SetBasicObjectConstants(commandList, desc.objects[packet.userData]);
+            desc.drawStateFilter->Draw(commandList, packet.draw);
+        }
+    }
+    else
+    {
+        if (prepassBundle != nullptr)
+        {
+            for (uint32_t i = 0; i < desc.objectCount; ++i)
+            {
+                SetBasicObjectConstants(commandList, desc.objects[i]);
+                commandList.ExecuteBundle(*prepassBundle);
+            }
+        }
+
+        // Execute the bundle to the command list
+        for (uint32_t i = 0; i < desc.objectCount; ++i)
+        {
+            SetBasicObjectConstants(commandList, desc.objects[i]);
+            commandList.ExecuteBundle(*bundle);
+        }
+    }
+
+    commandList.EndRenderPass();
+
+    if (extension != nullptr) {
+        extension->OnScenePassEnd(commandList);
+    }
+
+    // Indicate that the back buffer will now be used to present.
+    commandList.ResourceBarrier(desc.backBuffer, RENDER_RESOURCE_STATE_RENDER_TARGET, RENDER_RESOURCE_STATE_PRESENT);
+
+    if (extension != nullptr) {
+        extension->OnFrameEnd(commandList);
+    }
+
+    // End of the record
+    return commandList.Close();
+}
+
+// Execute the frame, present it and wait for the GPU to finish it.
+static inline auto SubmitBasicFrame(RenderCommandQueue& commandQueue, RenderCommandList& commandList, RenderFence& fence, uint64_t fenceValue) -> bool
+{
+    if (!commandQueue.ExecuteCommandList(commandList)) return false;
+    if (!commandQueue.Present()) return false;
+    if (!commandQueue.Signal(fence, fenceValue)) return false;
+
+    return fence.Wait(fenceValue);
+}
@@ -0,0 +1,154 @@
+// BufferMemoryPolicy.h : Choose how CPU-written buffer data reaches the GPU from the device memory architecture.
+//
+// The chosen policy is translated to `D3D12_HEAP_PROPERTIES` in Direct3D12_BasicRendering.cpp.
+
+#pragma once
+
+#include <cstdint>
+
+// The answer of `D3D12_FEATURE_ARCHITECTURE1` that matters to buffer placement
+struct DeviceMemoryCaps
+{
+    bool uma;                   // the GPU and the CPU share the same physical memory
+    bool cacheCoherentUMA;      // ... and the GPU snoops the CPU caches
+};
+
+enum class BufferMemoryPath : uint32_t
+{
+    STAGED,         // the CPU writes into an UPLOAD heap and the GPU copies the data into a DEFAULT heap
+    ZERO_COPY,      // the CPU writes into a CUSTOM heap in L0 and the GPU consumes the data in place
+    COUNT
+};
+
+enum class BufferCpuPageProperty : uint32_t
+{
+    NOT_AVAILABLE,
+    WRITE_COMBINE,
+    WRITE_BACK
+};
+
+enum class BufferMemoryPool : uint32_t
+{
+    L0,     // system memory
+    L1      // video memory of a discrete GPU
+};
+
+struct BufferHeapPolicy
+{
+    BufferMemoryPath path;
+    BufferCpuPageProperty cpuPageProperty;  // of the heap written by the CPU
+    BufferMemoryPool memoryPool;            // of the heap read by the GPU
+};
+
+enum class BufferHeapType : uint32_t
+{
+    UPLOAD,
+    DEFAULT,
+    CUSTOM
+};
+
+// The heap properties of a buffer. UPLOAD and DEFAULT heaps leave the page property and the pool to the driver, and only
+// CUSTOM heaps pass them on.
+struct BufferHeapDesc
+{
+    BufferHeapType type;
+    BufferCpuPageProperty cpuPageProperty;
+    BufferMemoryPool memoryPool;
+    bool genericReadOnly;                   // the buffer must be created in, and stay in, the GENERIC_READ state
+};
+
+static constexpr auto IsBufferMemoryPathSupported(const DeviceMemoryCaps& caps, BufferMemoryPath path) -> bool
+{
+    switch (path)
+    {
+    case BufferMemoryPath::STAGED:
+        return true;
+
+    case BufferMemoryPath::ZERO_COPY:
+        // On a discrete GPU, L0 is only reachable over PCIe, so reading it in place is not worth it.
+        return caps.uma;
+
+    default:
+        return false;
+    }
+}
+
+// Heap properties of the specified path. `path` must be supported by `caps`.
+static constexpr auto GetBufferHeapPolicy(const DeviceMemoryCaps& caps, BufferMemoryPath path) -> BufferHeapPolicy
+{
+    if (path == BufferMemoryPath::ZERO_COPY)
+    {
+        // Write-back pages are only allowed to be GPU visible when the GPU snoops the CPU caches.
+        // Otherwise, write-combined pages keep the CPU writes out of the caches.
+        return BufferHeapPolicy{
+            .path = BufferMemoryPath::ZERO_COPY,
+            .cpuPageProperty = caps.cacheCoherentUMA ? BufferCpuPageProperty::WRITE_BACK : BufferCpuPageProperty::WRITE_COMBINE,
+            .memoryPool = BufferMemoryPool::L0
+        };
+    }
+
+    return BufferHeapPolicy{
+        .path = BufferMemoryPath::STAGED,
+        .cpuPageProperty = BufferCpuPageProperty::WRITE_COMBINE,
+        .memoryPool = caps.uma ? BufferMemoryPool::L0 : BufferMemoryPool::L1
+    };
+}
+
+// UMA devices consume CPU-written data in place; discrete GPUs keep the staged path into video memory.
+static constexpr auto ChooseBufferHeapPolicy(const DeviceMemoryCaps& caps) -> BufferHeapPolicy
+{
+    return GetBufferHeapPolicy(caps, caps.uma ? BufferMemoryPath::ZERO_COPY : BufferMemoryPath::STAGED);
+}
+
+// The heap of the buffer the CPU writes into: the CUSTOM heap consumed in place, or the UPLOAD heap of the staging buffer.
+static constexpr auto GetCpuWrittenHeapDesc(const BufferHeapPolicy& policy) -> BufferHeapDesc
+{
+    if (policy.path == BufferMemoryPath::ZERO_COPY)
+    {
+        return BufferHeapDesc{
+            .type = BufferHeapType::CUSTOM,
+            .cpuPageProperty = policy.cpuPageProperty,
+            .memoryPool = policy.memoryPool,
+            .genericReadOnly = false
+        };
+    }
+
+    return BufferHeapDesc{
+        .type = BufferHeapType::UPLOAD,
+        .cpuPageProperty = policy.cpuPageProperty,
+        .memoryPool = BufferMemoryPool::L0,
+        .genericReadOnly = true
+    };
+}
+
+// Whether the device accepts a CUSTOM heap with these properties: L1 only exists on discrete GPUs and is never CPU
+// visible, and write-back pages are only GPU visible when the GPU snoops the CPU caches.
+static constexpr auto IsCustomBufferHeapValid(const DeviceMemoryCaps& caps, const BufferHeapDesc& desc) -> bool
+{
+    if (desc.type != BufferHeapType::CUSTOM) return true;
+
+    if (desc.memoryPool == BufferMemoryPool::L1) {
+        return !caps.uma && desc.cpuPageProperty == BufferCpuPageProperty::NOT_AVAILABLE;
+    }
+    return desc.cpuPageProperty != BufferCpuPageProperty::WRITE_BACK || (caps.uma && caps.cacheCoherentUMA);
+}
+
+static constexpr auto GetBufferMemoryPathName(BufferMemoryPath path) -> const char*
+{
+    switch (path)
+    {
+    case BufferMemoryPath::STAGED:
+        return "staged";
+
+    case BufferMemoryPath::ZERO_COPY:
+        return "zero-copy";
+
+    default:
+        return "unknown";
+    }
+}
+
+static_assert(ChooseBufferHeapPolicy(DeviceMemoryCaps{ .uma = false, .cacheCoherentUMA = false }).path == BufferMemoryPath::STAGED,
+    "Discrete GPUs must keep the staged path");
+static_assert(ChooseBufferHeapPolicy(DeviceMemoryCaps{ .uma = true, .cacheCoherentUMA = true }).cpuPageProperty == BufferCpuPageProperty::WRITE_BACK,
+    "Cache-coherent UMA must use write-back pages");
@@ -0,0 +1,219 @@
+// BundleCache.h : LRU cache of bundles recorded for static draw sequences, keyed by everything recorded into them.
+//
+// The bundles of an evicted entry are only recorded again after the GPU has passed the last frame that executed them.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <chrono>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "RenderBackend.h"
+
+struct BundleDrawKey
+{
+    uint32_t pipelineId;
+    uint32_t topology;
+    RenderResourceId vertexBuffer;
+    uint32_t vertexBufferOffset;
+    uint32_t vertexBufferSize;
+    uint32_t vertexStride;
+    RenderResourceId indexBuffer;       // RENDER_INVALID_RESOURCE for a non-indexed draw
+    uint32_t indexBufferOffset;
+    uint32_t indexBufferSize;
+    uint32_t indexFormat;
+    uint32_t count;                     // vertices or indices per instance
+    uint32_t instanceCount;
+    uint32_t start;                     // start vertex or start index
+    int32_t baseVertex;                 // only for indexed draws
+    uint32_t startInstance;
+
+    auto operator == (const BundleDrawKey& other) const -> bool = default;
+};
+
+static_assert(sizeof(BundleDrawKey) == 15 * sizeof(uint32_t), "BundleDrawKey must not have padding, because it is hashed as raw bytes");
+
+struct BundleDrawKeyHash
+{
+    // FNV-1a
+    auto operator () (const BundleDrawKey& key) const -> size_t
+    {
+        uint8_t bytes[sizeof(key)];
+        memcpy(bytes, &key, sizeof(key));
+
+        uint64_t hash = 14695981039346656037ULL;
+        for (auto const byte : bytes)
+        {
+            hash ^= byte;
+            hash *= 1099511628211ULL;
+        }
+        return size_t(hash);
+    }
+};
+
+static inline auto RecordBundleDraw(RenderCommandList& bundle, const BundleDrawKey& key) -> bool
+{
+    if (!bundle.Reset(key.pipelineId)) return false;
+
+    bundle.SetPrimitiveTopology(key.topology);
+    bundle.SetVertexBuffer(0, key.vertexBuffer, key.vertexBufferOffset, key.vertexBufferSize, key.vertexStride);
+    if (key.indexBuffer != RENDER_INVALID_RESOURCE)
+    {
+        bundle.SetIndexBuffer(key.indexBuffer, key.indexBufferOffset, key.indexBufferSize, key.indexFormat);
+        bundle.DrawIndexedInstanced(key.count, key.instanceCount, key.start, key.baseVertex, key.startInstance);
+    }
+    else {
+        bundle.DrawInstanced(key.count, key.instanceCount, key.start, key.startInstance);
+    }
+
+    return bundle.Close();
+}
+
+struct BundleCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t invalidations;
+    double recordTime;                  // in milliseconds, spent recording the missed bundles
+
+    // Estimated from the average recording time of a bundle
+    auto GetSavedRecordTime() const -> double { return misses > 0 ? recordTime * double(hits) / double(misses) : 0.0; }
+
+    auto GetHitRate() const -> double { return hits + misses > 0 ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+class BundleCache
+{
+public:
+    // At most `capacity` bundles are cached, besides the ones waiting for the GPU to be recorded again.
+    BundleCache(RenderDevice& device, size_t capacity) : m_device(device), m_capacity(capacity > 0 ? capacity : 1) { }
+
+    BundleCache(const BundleCache&) = delete;
+    auto operator = (const BundleCache&) -> BundleCache& = delete;
+
+    // Return the bundle of `key`, recording it if it is not cached, or null if it cannot be recorded.
+    // The GPU has completed the frames signaled up to `completedValue`, and the bundle will be executed
+    // by the frame that signals `fenceValue`.
+    auto GetBundle(const BundleDrawKey& key, uint64_t completedValue, uint64_t fenceValue) -> RenderCommandList*
+    {
+        auto const found = m_entryMap.find(key);
+        if (found != m_entryMap.end())
+        {
+            ++m_stats.hits;
+            m_entries.splice(m_entries.begin(), m_entries, found->second);
+            found->second->fenceValue = fenceValue;
+            return found->second->bundle;
+        }
+
+        ++m_stats.misses;
+        if (m_entries.size() == m_capacity)
+        {
+            ++m_stats.evictions;
+            Retire(std::prev(m_entries.end()));
+        }
+
+        RenderCommandList* const bundle = AcquireBundle(completedValue);
+        if (bundle == nullptr) return nullptr;
+
+        const auto beginTime = std::chrono::steady_clock::now();
+        const bool recorded = RecordBundleDraw(*bundle, key);
+        m_stats.recordTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+        // A bundle that failed to be recorded may be left open, so it is not used again.
+        if (!recorded) return nullptr;
+
+        m_entries.push_front(Entry{ .key = key, .bundle = bundle, .fenceValue = fenceValue });
+        m_entryMap.emplace(key, m_entries.begin());
+        return bundle;
+    }
+
+    // Drop the bundles that refer to `resource`, e.g. after its contents or its native object changed.
+    auto InvalidateResource(RenderResourceId resource) -> void
+    {
+        InvalidateIf([resource](const BundleDrawKey& key) { return key.vertexBuffer == resource || key.indexBuffer == resource; });
+    }
+
+    // Drop the bundles recorded with `pipelineId`, e.g. after its pipeline state object was created again.
+    auto InvalidatePipeline(uint32_t pipelineId) -> void
+    {
+        InvalidateIf([pipelineId](const BundleDrawKey& key) { return key.pipelineId == pipelineId; });
+    }
+
+    auto InvalidateAll() -> void
+    {
+        InvalidateIf([](const BundleDrawKey&) { return true; });
+    }
+
+    auto GetStats() const -> const BundleCacheStats& { return m_stats; }
+
+    auto GetCachedCount() const -> size_t { return m_entries.size(); }
+
+    // Including the retired bundles
+    auto GetBundleCount() const -> size_t { return m_entries.size() + m_retiredBundles.size(); }
+
+private:
+    struct Entry
+    {
+        BundleDrawKey key;
+        RenderCommandList* bundle;
+        uint64_t fenceValue;            // signaled by the last frame that executed the bundle
+    };
+
+    struct RetiredBundle
+    {
+        RenderCommandList* bundle;
+        uint64_t fenceValue;
+    };
+
+    using EntryIterator = std::list<Entry>::iterator;
+
+    auto Retire(EntryIterator entry) -> void
+    {
+        m_retiredBundles.push_back(RetiredBundle{ .bundle = entry->bundle, .fenceValue = entry->fenceValue });
+        m_entryMap.erase(entry->key);
+        m_entries.erase(entry);
+    }
+
+    template <typename Predicate>
+    auto InvalidateIf(Predicate predicate) -> void
+    {
+        for (auto entry = m_entries.begin(); entry != m_entries.end();)
+        {
+            const auto next = std::next(entry);
+            if (predicate(entry->key))
+            {
+                ++m_stats.invalidations;
+                Retire(entry);
+            }
+            entry = next;
+        }
+    }
+
+    // The bundles are owned by the device, so the retired ones are recorded again rather than destroyed.
+    auto AcquireBundle(uint64_t completedValue) -> RenderCommandList*
+    {
+        for (size_t i = 0; i < m_retiredBundles.size(); ++i)
+        {
+            if (m_retiredBundles[i].fenceValue <= completedValue)
+            {
+                RenderCommandList* const bundle = m_retiredBundles[i].bundle;
+                m_retiredBundles[i] = m_retiredBundles.back();
+                m_retiredBundles.pop_back();
+                return bundle;
+            }
+        }
+        return m_device.CreateCommandList(RenderCommandListType::BUNDLE);
+    }
+
+    RenderDevice& m_device;
+    size_t m_capacity;
+    std::list<Entry> m_entries;         // the most recently used first
+    std::unordered_map<BundleDrawKey, EntryIterator, BundleDrawKeyHash> m_entryMap;
+    std::vector<RetiredBundle> m_retiredBundles;
+    BundleCacheStats m_stats{ };
+};
@@ -0,0 +1,656 @@
+// CommandCapture.h : Binary capture of the recorded commands and their replay.
+//
+// Enumerations and resource states are stored as the raw values of the Direct3D 12 API.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+// ==== Capture file ====
+// [CommandCaptureHeader][CaptureResourceDesc * resourceCount][resource data][command words]
+// Each command is one word of `opcode | (argumentCount << 16)` followed by its 32-bit arguments.
+
+static constexpr uint32_t COMMAND_CAPTURE_MAGIC = 0x50414344U;    // 'DCAP'
+static constexpr uint32_t COMMAND_CAPTURE_VERSION = 2;
+static constexpr uint32_t CAPTURE_INVALID_ID = UINT32_MAX;
+
+// Resource states the replayers need to know about, with the same values as D3D12_RESOURCE_STATES
+static constexpr uint32_t CAPTURE_RESOURCE_STATE_COMMON = 0;
+static constexpr uint32_t CAPTURE_RESOURCE_STATE_RENDER_TARGET = 0x4;
+static constexpr uint32_t CAPTURE_RESOURCE_STATE_DEPTH_WRITE = 0x10;
+
+// Index buffer and depth formats, with the same values as DXGI_FORMAT
+static constexpr uint32_t CAPTURE_FORMAT_D32_FLOAT = 40;
+static constexpr uint32_t CAPTURE_FORMAT_R32_UINT = 42;
+static constexpr uint32_t CAPTURE_FORMAT_R16_UINT = 57;
+
+// Render pass load and store ops, with the same values as D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE and D3D12_RENDER_PASS_ENDING_ACCESS_TYPE
+static constexpr uint32_t CAPTURE_LOAD_OP_DISCARD = 0;
+static constexpr uint32_t CAPTURE_LOAD_OP_PRESERVE = 1;
+static constexpr uint32_t CAPTURE_LOAD_OP_CLEAR = 2;
+static constexpr uint32_t CAPTURE_STORE_OP_DISCARD = 0;
+static constexpr uint32_t CAPTURE_STORE_OP_PRESERVE = 1;
+
+enum class CaptureResourceKind : uint32_t
+{
+    BUFFER,
+    RENDER_TARGET,
+    DEPTH_STENCIL
+};
+
+enum class CaptureOpcode : uint32_t
+{
+    BEGIN_FRAME,
+    END_FRAME,
+    BEGIN_BUNDLE,                       // bundleId; the following commands up to END_BUNDLE (re)define the bundle
+    END_BUNDLE,
+    EXECUTE_BUNDLE,                     // bundleId
+    SET_PIPELINE_STATE,                 // pipelineId
+    SET_GRAPHICS_ROOT_SIGNATURE,        // rootSignatureId
+    SET_GRAPHICS_ROOT_32BIT_CONSTANT,   // rootParameterIndex, value, destOffset
+    SET_VIEWPORT,                       // topLeftX, topLeftY, width, height, minDepth, maxDepth as floats
+    SET_SCISSOR_RECT,                   // left, top, right, bottom
+    SET_RENDER_TARGET,                  // resourceId
+    CLEAR_RENDER_TARGET,                // resourceId, r, g, b, a, hasRect, left, top, right, bottom
+    SET_PRIMITIVE_TOPOLOGY,             // D3D_PRIMITIVE_TOPOLOGY
+    SET_VERTEX_BUFFER,                  // slot, resourceId, offset, size, stride
+    DRAW_INSTANCED,                     // vertexCountPerInstance, instanceCount, startVertex, startInstance
+    RESOURCE_BARRIER,                   // resourceId, stateBefore, stateAfter
+    SET_INDEX_BUFFER,                   // resourceId, offset, size, DXGI_FORMAT
+    DRAW_INDEXED_INSTANCED,             // indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance
+    BEGIN_RENDER_PASS,                  // resourceId, loadOp, storeOp, r, g, b, a, hasClearRect, left, top, right, bottom,
+                                        // depthResourceId, depthLoadOp, depthStoreOp, clearDepth
+    END_RENDER_PASS,
+    COUNT
+};
+
+static constexpr uint32_t CAPTURE_OPCODE_ARGUMENT_COUNTS[] = { 0, 0, 1, 0, 1, 1, 1, 3, 6, 4, 1, 10, 1, 5, 4, 3, 4, 5, 16, 0 };
+
+static constexpr const char* CAPTURE_OPCODE_NAMES[] = {
+    "BeginFrame",
+    "EndFrame",
+    "BeginBundle",
+    "EndBundle",
+    "ExecuteBundle",
+    "SetPipelineState",
+    "SetGraphicsRootSignature",
+    "SetGraphicsRoot32BitConstant",
+    "SetViewport",
+    "SetScissorRect",
+    "SetRenderTarget",
+    "ClearRenderTarget",
+    "SetPrimitiveTopology",
+    "SetVertexBuffer",
+    "DrawInstanced",
+    "ResourceBarrier",
+    "SetIndexBuffer",
+    "DrawIndexedInstanced",
+    "BeginRenderPass",
+    "EndRenderPass"
+};
+
+static_assert(sizeof(CAPTURE_OPCODE_ARGUMENT_COUNTS) / sizeof(CAPTURE_OPCODE_ARGUMENT_COUNTS[0]) == size_t(CaptureOpcode::COUNT), "Missing argument count of a capture opcode");
+static_assert(sizeof(CAPTURE_OPCODE_NAMES) / sizeof(CAPTURE_OPCODE_NAMES[0]) == size_t(CaptureOpcode::COUNT), "Missing name of a capture opcode");
+
+struct CommandCaptureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t resourceCount;
+    uint32_t frameCount;
+    uint64_t resourceDataSize;
+    uint64_t commandWordCount;
+};
+
+struct CaptureResourceDesc
+{
+    CaptureResourceKind kind;
+    uint32_t format;            // DXGI_FORMAT of render targets and depth stencils
+    uint32_t width;             // in bytes for buffers
+    uint32_t height;
+    uint32_t initialState;
+    uint32_t reserved;
+    uint64_t dataOffset;        // initial contents of buffers, from the beginning of the resource data
+    uint64_t dataSize;
+};
+
+struct CommandCapture
+{
+    std::vector<CaptureResourceDesc> resources;
+    std::vector<uint8_t> resourceData;
+    std::vector<uint32_t> commandWords;
+    uint32_t frameCount;
+};
+
+static inline auto CaptureFloatToWord(float value) -> uint32_t
+{
+    uint32_t word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+static inline auto CaptureWordToFloat(uint32_t word) -> float
+{
+    float value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+static inline auto PackCommandCapture(const CommandCapture& capture) -> std::vector<uint8_t>
+{
+    const size_t resourceDescSize = sizeof(CaptureResourceDesc) * capture.resources.size();
+    const size_t commandSize = sizeof(uint32_t) * capture.commandWords.size();
+    std::vector<uint8_t> packed(sizeof(CommandCaptureHeader) + resourceDescSize + capture.resourceData.size() + commandSize, 0);
+
+    const CommandCaptureHeader header{
+        .magic = COMMAND_CAPTURE_MAGIC,
+        .version = COMMAND_CAPTURE_VERSION,
+        .resourceCount = uint32_t(capture.resources.size()),
+        .frameCount = capture.frameCount,
+        .resourceDataSize = uint64_t(capture.resourceData.size()),
+        .commandWordCount = uint64_t(capture.commandWords.size())
+    };
+
+    uint8_t* dst = packed.data();
+    memcpy(dst, &header, sizeof(header));
+    dst += sizeof(header);
+    if (resourceDescSize > 0) {
+        memcpy(dst, capture.resources.data(), resourceDescSize);
+    }
+    dst += resourceDescSize;
+    if (!capture.resourceData.empty()) {
+        memcpy(dst, capture.resourceData.data(), capture.resourceData.size());
+    }
+    dst += capture.resourceData.size();
+    if (commandSize > 0) {
+        memcpy(dst, capture.commandWords.data(), commandSize);
+    }
+
+    return packed;
+}
+
+// Validate the whole capture up front, so that replaying it needs no further checks of the stream layout.
+static inline auto ParseCommandCapture(const uint8_t* data, size_t size, CommandCapture& capture) -> bool
+{
+    capture = { };
+    if (data == nullptr || size < sizeof(CommandCaptureHeader)) return false;
+
+    CommandCaptureHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != COMMAND_CAPTURE_MAGIC || header.version != COMMAND_CAPTURE_VERSION) return false;
+
+    const uint64_t resourceDescSize = uint64_t(sizeof(CaptureResourceDesc)) * header.resourceCount;
+    if (header.resourceDataSize > size || header.commandWordCount > size / sizeof(uint32_t)) return false;
+    if (sizeof(header) + resourceDescSize + header.resourceDataSize + header.commandWordCount * sizeof(uint32_t) != size) return false;
+
+    const uint8_t* src = data + sizeof(header);
+    capture.resources.resize(header.resourceCount);
+    if (resourceDescSize > 0) {
+        memcpy(capture.resources.data(), src, size_t(resourceDescSize));
+    }
+    src += resourceDescSize;
+    capture.resourceData.assign(src, src + header.resourceDataSize);
+    src += header.resourceDataSize;
+    capture.commandWords.resize(size_t(header.commandWordCount));
+    if (header.commandWordCount > 0) {
+        memcpy(capture.commandWords.data(), src, size_t(header.commandWordCount) * sizeof(uint32_t));
+    }
+    capture.frameCount = header.frameCount;
+
+    for (auto const& resource : capture.resources)
+    {
+        if (resource.kind != CaptureResourceKind::BUFFER && resource.kind != CaptureResourceKind::RENDER_TARGET &&
+            resource.kind != CaptureResourceKind::DEPTH_STENCIL) return false;
+        if (resource.dataOffset > header.resourceDataSize || resource.dataSize > header.resourceDataSize - resource.dataOffset) return false;
+        if (resource.kind == CaptureResourceKind::BUFFER && resource.dataSize > resource.width) return false;
+    }
+
+    uint32_t frameCount = 0;
+    for (size_t i = 0; i < capture.commandWords.size(); )
+    {
+        const uint32_t opcode = capture.commandWords[i] & 0xffffU;
+        const uint32_t argumentCount = capture.commandWords[i] >> 16;
+        if (opcode >= uint32_t(CaptureOpcode::COUNT) || argumentCount != CAPTURE_OPCODE_ARGUMENT_COUNTS[opcode]) return false;
+        if (capture.commandWords.size() - i - 1 < argumentCount) return false;
+
+        frameCount += opcode == uint32_t(CaptureOpcode::END_FRAME) ? 1 : 0;
+        i += 1 + argumentCount;
+    }
+
+    return frameCount == capture.frameCount;
+}
+
+// Feed every command of the capture to `backend.Execute(CaptureOpcode, const uint32_t arguments[]) -> bool`.
+// Stops at the first command the backend fails.
+template <typename Backend>
+static inline auto ReplayCommandCapture(const CommandCapture& capture, Backend& backend) -> bool
+{
+    const uint32_t* words = capture.commandWords.data();
+    const size_t wordCount = capture.commandWords.size();
+    for (size_t i = 0; i < wordCount; )
+    {
+        const CaptureOpcode opcode = CaptureOpcode(words[i] & 0xffffU);
+        const uint32_t argumentCount = words[i] >> 16;
+        if (!backend.Execute(opcode, &words[i + 1])) return false;
+
+        i += 1 + argumentCount;
+    }
+
+    return true;
+}
+
+// ==== Capture writer ====
+
+class CommandCaptureWriter
+{
+public:
+    // Resources are identified by an opaque key, usually the address of the API object.
+    auto AddBuffer(const void* key, const void* data, size_t size, uint32_t initialState) -> uint32_t
+    {
+        const uint64_t dataOffset = uint64_t(m_capture.resourceData.size());
+        m_capture.resourceData.insert(m_capture.resourceData.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+
+        return AddResource(key, CaptureResourceDesc{
+            .kind = CaptureResourceKind::BUFFER,
+            .format = 0,
+            .width = uint32_t(size),
+            .height = 1,
+            .initialState = initialState,
+            .reserved = 0,
+            .dataOffset = dataOffset,
+            .dataSize = uint64_t(size)
+        });
+    }
+
+    auto AddRenderTarget(const void* key, uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> uint32_t
+    {
+        return AddResource(key, CaptureResourceDesc{
+            .kind = CaptureResourceKind::RENDER_TARGET,
+            .format = format,
+            .width = width,
+            .height = height,
+            .initialState = initialState,
+            .reserved = 0,
+            .dataOffset = 0,
+            .dataSize = 0
+        });
+    }
+
+    auto AddDepthStencil(const void* key, uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> uint32_t
+    {
+        return AddResource(key, CaptureResourceDesc{
+            .kind = CaptureResourceKind::DEPTH_STENCIL,
+            .format = format,
+            .width = width,
+            .height = height,
+            .initialState = initialState,
+            .reserved = 0,
+            .dataOffset = 0,
+            .dataSize = 0
+        });
+    }
+
+    auto GetResourceId(const void* key) const -> uint32_t
+    {
+        for (size_t i = 0; i < m_resourceKeys.size(); ++i)
+        {
+            if (m_resourceKeys[i] == key) return uint32_t(i);
+        }
+        return CAPTURE_INVALID_ID;
+    }
+
+    auto BeginFrame() -> void { Append(CaptureOpcode::BEGIN_FRAME, { }); }
+
+    auto EndFrame() -> void
+    {
+        Append(CaptureOpcode::END_FRAME, { });
+        ++m_capture.frameCount;
+    }
+
+    auto BeginBundle(uint32_t bundleId) -> void { Append(CaptureOpcode::BEGIN_BUNDLE, { bundleId }); }
+    auto EndBundle() -> void { Append(CaptureOpcode::END_BUNDLE, { }); }
+    auto ExecuteBundle(uint32_t bundleId) -> void { Append(CaptureOpcode::EXECUTE_BUNDLE, { bundleId }); }
+    auto SetPipelineState(uint32_t pipelineId) -> void { Append(CaptureOpcode::SET_PIPELINE_STATE, { pipelineId }); }
+    auto SetGraphicsRootSignature(uint32_t rootSignatureId) -> void { Append(CaptureOpcode::SET_GRAPHICS_ROOT_SIGNATURE, { rootSignatureId }); }
+
+    auto SetGraphicsRoot32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t destOffset) -> void
+    {
+        Append(CaptureOpcode::SET_GRAPHICS_ROOT_32BIT_CONSTANT, { rootParameterIndex, value, destOffset });
+    }
+
+    auto SetViewport(float topLeftX, float topLeftY, float width, float height, float minDepth, float maxDepth) -> void
+    {
+        Append(CaptureOpcode::SET_VIEWPORT, { CaptureFloatToWord(topLeftX), CaptureFloatToWord(topLeftY), CaptureFloatToWord(width),
+            CaptureFloatToWord(height), CaptureFloatToWord(minDepth), CaptureFloatToWord(maxDepth) });
+    }
+
+    auto SetScissorRect(int32_t left, int32_t top, int32_t right, int32_t bottom) -> void
+    {
+        Append(CaptureOpcode::SET_SCISSOR_RECT, { uint32_t(left), uint32_t(top), uint32_t(right), uint32_t(bottom) });
+    }
+
+    auto SetRenderTarget(uint32_t resourceId) -> void { Append(CaptureOpcode::SET_RENDER_TARGET, { resourceId }); }
+
+    // `rect` is left, top, right and bottom, or null to clear the whole target.
+    auto ClearRenderTarget(uint32_t resourceId, const float color[4], const int32_t rect[4]) -> void
+    {
+        Append(CaptureOpcode::CLEAR_RENDER_TARGET, { resourceId,
+            CaptureFloatToWord(color[0]), CaptureFloatToWord(color[1]), CaptureFloatToWord(color[2]), CaptureFloatToWord(color[3]),
+            rect != nullptr ? 1U : 0U,
+            rect != nullptr ? uint32_t(rect[0]) : 0U, rect != nullptr ? uint32_t(rect[1]) : 0U,
+            rect != nullptr ? uint32_t(rect[2]) : 0U, rect != nullptr ? uint32_t(rect[3]) : 0U });
+    }
+
+    auto SetPrimitiveTopology(uint32_t topology) -> void { Append(CaptureOpcode::SET_PRIMITIVE_TOPOLOGY, { topology }); }
+
+    auto SetVertexBuffer(uint32_t slot, uint32_t resourceId, uint32_t offset, uint32_t size, uint32_t stride) -> void
+    {
+        Append(CaptureOpcode::SET_VERTEX_BUFFER, { slot, resourceId, offset, size, stride });
+    }
+
+    auto DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance) -> void
+    {
+        Append(CaptureOpcode::DRAW_INSTANCED, { vertexCountPerInstance, instanceCount, startVertex, startInstance });
+    }
+
+    auto ResourceBarrier(uint32_t resourceId, uint32_t stateBefore, uint32_t stateAfter) -> void
+    {
+        Append(CaptureOpcode::RESOURCE_BARRIER, { resourceId, stateBefore, stateAfter });
+    }
+
+    auto SetIndexBuffer(uint32_t resourceId, uint32_t offset, uint32_t size, uint32_t format) -> void
+    {
+        Append(CaptureOpcode::SET_INDEX_BUFFER, { resourceId, offset, size, format });
+    }
+
+    auto DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) -> void
+    {
+        Append(CaptureOpcode::DRAW_INDEXED_INSTANCED, { indexCountPerInstance, instanceCount, startIndex, uint32_t(baseVertex), startInstance });
+    }
+
+    // `clearRect` is left, top, right and bottom, or null to clear the whole target with CAPTURE_LOAD_OP_CLEAR.
+    // `depthResourceId` is CAPTURE_INVALID_ID for a pass without depth. The depth is always cleared as a whole.
+    auto BeginRenderPass(uint32_t resourceId, uint32_t loadOp, uint32_t storeOp, const float clearColor[4], const int32_t clearRect[4],
+        uint32_t depthResourceId, uint32_t depthLoadOp, uint32_t depthStoreOp, float clearDepth) -> void
+    {
+        Append(CaptureOpcode::BEGIN_RENDER_PASS, { resourceId, loadOp, storeOp,
+            CaptureFloatToWord(clearColor[0]), CaptureFloatToWord(clearColor[1]), CaptureFloatToWord(clearColor[2]), CaptureFloatToWord(clearColor[3]),
+            clearRect != nullptr ? 1U : 0U,
+            clearRect != nullptr ? uint32_t(clearRect[0]) : 0U, clearRect != nullptr ? uint32_t(clearRect[1]) : 0U,
+            clearRect != nullptr ? uint32_t(clearRect[2]) : 0U, clearRect != nullptr ? uint32_t(clearRect[3]) : 0U,
+            depthResourceId, depthLoadOp, depthStoreOp, CaptureFloatToWord(clearDepth) });
+    }
+
+    auto EndRenderPass() -> void { Append(CaptureOpcode::END_RENDER_PASS, { }); }
+
+    auto GetFrameCount() const -> uint32_t { return m_capture.frameCount; }
+    auto GetCapture() const -> const CommandCapture& { return m_capture; }
+
+private:
+    auto AddResource(const void* key, const CaptureResourceDesc& desc) -> uint32_t
+    {
+        m_resourceKeys.push_back(key);
+        m_capture.resources.push_back(desc);
+        return uint32_t(m_capture.resources.size() - 1);
+    }
+
+    auto Append(CaptureOpcode opcode, std::initializer_list<uint32_t> arguments) -> void
+    {
+        m_capture.commandWords.push_back(uint32_t(opcode) | (uint32_t(arguments.size()) << 16));
+        m_capture.commandWords.insert(m_capture.commandWords.end(), arguments.begin(), arguments.end());
+    }
+
+    CommandCapture m_capture{ };
+    std::vector<const void*> m_resourceKeys;
+};
+
+// ==== Null replay backend ====
+
+// Checks the commands against the state they need and counts them, without any GPU work.
+// It measures the CPU overhead of walking a capture, and catches captures that would be invalid on a real device.
+class NullCommandReplayBackend
+{
+public:
+    explicit NullCommandReplayBackend(const CommandCapture& capture) :
+        m_capture(capture), m_resourceStates(capture.resources.size(), 0)
+    {
+        Reset();
+    }
+
+    // Restore the initial resource states before replaying the capture again.
+    auto Reset() -> void
+    {
+        for (size_t i = 0; i < m_capture.resources.size(); ++i) {
+            m_resourceStates[i] = m_capture.resources[i].initialState;
+        }
+        m_bundleDrawCounts.clear();
+        m_frameState = { };
+        m_bundleState = { };
+        m_inFrame = false;
+        m_recordingBundleId = CAPTURE_INVALID_ID;
+    }
+
+    // Track the resources appended to the capture after the backend was created.
+    auto SyncResources() -> void
+    {
+        for (size_t i = m_resourceStates.size(); i < m_capture.resources.size(); ++i) {
+            m_resourceStates.push_back(m_capture.resources[i].initialState);
+        }
+    }
+
+    auto Execute(CaptureOpcode opcode, const uint32_t arguments[]) -> bool
+    {
+        ++m_commandCounts[size_t(opcode)];
+
+        ListState& state = m_recordingBundleId != CAPTURE_INVALID_ID ? m_bundleState : m_frameState;
+        switch (opcode)
+        {
+        case CaptureOpcode::BEGIN_FRAME:
+            if (m_inFrame || m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "a frame or a bundle is still open");
+            m_inFrame = true;
+            m_frameState = { };
+            return true;
+
+        case CaptureOpcode::END_FRAME:
+            if (!m_inFrame || m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "no frame is open");
+            if (m_frameState.inRenderPass) return Fail(opcode, "a render pass is still open");
+            m_inFrame = false;
+            return true;
+
+        case CaptureOpcode::BEGIN_BUNDLE:
+            if (m_recordingBundleId != CAPTURE_INVALID_ID || arguments[0] == CAPTURE_INVALID_ID) return Fail(opcode, "invalid bundle");
+            m_recordingBundleId = arguments[0];
+            m_bundleState = { };
+            return true;
+
+        case CaptureOpcode::END_BUNDLE:
+            if (m_recordingBundleId == CAPTURE_INVALID_ID) return Fail(opcode, "no bundle is open");
+            if (m_recordingBundleId >= m_bundleDrawCounts.size()) {
+                m_bundleDrawCounts.resize(size_t(m_recordingBundleId) + 1, UINT32_MAX);
+            }
+            m_bundleDrawCounts[m_recordingBundleId] = m_bundleState.drawCount;
+            m_recordingBundleId = CAPTURE_INVALID_ID;
+            return true;
+
+        case CaptureOpcode::EXECUTE_BUNDLE:
+            if (!m_inFrame || m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "bundles are executed in frames only");
+            if (arguments[0] >= m_bundleDrawCounts.size() || m_bundleDrawCounts[arguments[0]] == UINT32_MAX) return Fail(opcode, "undefined bundle");
+            if (m_bundleDrawCounts[arguments[0]] > 0 && (m_frameState.renderTarget == CAPTURE_INVALID_ID || !m_frameState.rootSignatureSet)) {
+                return Fail(opcode, "the bundle draws without a render target or a root signature");
+            }
+            m_drawCount += m_bundleDrawCounts[arguments[0]];
+            return true;
+
+        case CaptureOpcode::SET_PIPELINE_STATE:
+            state.pipelineSet = true;
+            return true;
+
+        case CaptureOpcode::SET_GRAPHICS_ROOT_SIGNATURE:
+            if (m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "bundles inherit the root signature");
+            state.rootSignatureSet = true;
+            return true;
+
+        case CaptureOpcode::SET_GRAPHICS_ROOT_32BIT_CONSTANT:
+            // Bundles use the root signature of the command list executing them.
+            if (m_recordingBundleId == CAPTURE_INVALID_ID && !m_frameState.rootSignatureSet) return Fail(opcode, "no root signature is set");
+            return true;
+
+        case CaptureOpcode::SET_VIEWPORT:
+        case CaptureOpcode::SET_SCISSOR_RECT:
+            if (m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "not allowed in bundles");
+            return true;
+
+        case CaptureOpcode::SET_RENDER_TARGET:
+            if (m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "not allowed in bundles");
+            if (m_frameState.inRenderPass) return Fail(opcode, "the render pass binds the render target");
+            if (!IsRenderTargetReady(arguments[0])) return Fail(opcode, "the resource is not a render target in RENDER_TARGET state");
+            state.renderTarget = arguments[0];
+            return true;
+
+        case CaptureOpcode::CLEAR_RENDER_TARGET:
+            if (m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "not allowed in bundles");
+            if (m_frameState.inRenderPass) return Fail(opcode, "the render pass clears with its load op");
+            if (!IsRenderTargetReady(arguments[0])) return Fail(opcode, "the resource is not a render target in RENDER_TARGET state");
+            return true;
+
+        case CaptureOpcode::SET_PRIMITIVE_TOPOLOGY:
+            state.topologySet = true;
+            return true;
+
+        case CaptureOpcode::SET_VERTEX_BUFFER:
+        {
+            const uint32_t resourceId = arguments[1];
+            if (resourceId >= m_capture.resources.size() || m_capture.resources[resourceId].kind != CaptureResourceKind::BUFFER) return Fail(opcode, "not a buffer");
+            if (uint64_t(arguments[2]) + arguments[3] > m_capture.resources[resourceId].width || arguments[4] == 0) return Fail(opcode, "out of the buffer range");
+            state.vertexCapacity = arguments[3] / arguments[4];
+            return true;
+        }
+
+        case CaptureOpcode::DRAW_INSTANCED:
+            if (!state.pipelineSet || !state.topologySet) return Fail(opcode, "no pipeline state or primitive topology is set");
+            if (uint64_t(arguments[2]) + arguments[0] > state.vertexCapacity) return Fail(opcode, "vertices out of the vertex buffer");
+            return CountDraw(opcode, state);
+
+        case CaptureOpcode::SET_INDEX_BUFFER:
+        {
+            const uint32_t resourceId = arguments[0];
+            if (resourceId >= m_capture.resources.size() || m_capture.resources[resourceId].kind != CaptureResourceKind::BUFFER) return Fail(opcode, "not a buffer");
+            if (uint64_t(arguments[1]) + arguments[2] > m_capture.resources[resourceId].width) return Fail(opcode, "out of the buffer range");
+            if (arguments[3] != CAPTURE_FORMAT_R16_UINT && arguments[3] != CAPTURE_FORMAT_R32_UINT) return Fail(opcode, "not an index format");
+            state.indexCapacity = arguments[2] / (arguments[3] == CAPTURE_FORMAT_R16_UINT ? 2 : 4);
+            return true;
+        }
+
+        case CaptureOpcode::DRAW_INDEXED_INSTANCED:
+            // The indices are not read, so only the index range is checked.
+            if (!state.pipelineSet || !state.topologySet) return Fail(opcode, "no pipeline state or primitive topology is set");
+            if (uint64_t(arguments[2]) + arguments[0] > state.indexCapacity) return Fail(opcode, "indices out of the index buffer");
+            return CountDraw(opcode, state);
+
+        case CaptureOpcode::RESOURCE_BARRIER:
+            if (m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "not allowed in bundles");
+            if (m_frameState.inRenderPass) return Fail(opcode, "not allowed in render passes");
+            if (arguments[0] >= m_resourceStates.size() || m_resourceStates[arguments[0]] != arguments[1]) return Fail(opcode, "the state before does not match");
+            m_resourceStates[arguments[0]] = arguments[2];
+            return true;
+
+        case CaptureOpcode::BEGIN_RENDER_PASS:
+            if (!m_inFrame || m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "render passes are recorded in frames only");
+            if (m_frameState.inRenderPass) return Fail(opcode, "a render pass is already open");
+            if (!IsRenderTargetReady(arguments[0])) return Fail(opcode, "the resource is not a render target in RENDER_TARGET state");
+            if (arguments[1] > CAPTURE_LOAD_OP_CLEAR || arguments[2] > CAPTURE_STORE_OP_PRESERVE) return Fail(opcode, "invalid load or store op");
+            if (arguments[7] != 0 && arguments[1] != CAPTURE_LOAD_OP_CLEAR) return Fail(opcode, "a clear rect needs the CLEAR load op");
+            if (arguments[12] != CAPTURE_INVALID_ID)
+            {
+                if (!IsDepthStencilReady(arguments[12])) return Fail(opcode, "the resource is not a depth stencil in DEPTH_WRITE state");
+                if (arguments[13] > CAPTURE_LOAD_OP_CLEAR || arguments[14] > CAPTURE_STORE_OP_PRESERVE) return Fail(opcode, "invalid depth load or store op");
+            }
+            m_frameState.renderTarget = arguments[0];
+            m_frameState.inRenderPass = true;
+            return true;
+
+        case CaptureOpcode::END_RENDER_PASS:
+            if (!m_frameState.inRenderPass || m_recordingBundleId != CAPTURE_INVALID_ID) return Fail(opcode, "no render pass is open");
+            // The render target is only bound within the pass.
+            m_frameState.renderTarget = CAPTURE_INVALID_ID;
+            m_frameState.inRenderPass = false;
+            return true;
+
+        default:
+            return Fail(opcode, "unknown opcode");
+        }
+    }
+
+    auto GetCommandCount(CaptureOpcode opcode) const -> uint64_t { return m_commandCounts[size_t(opcode)]; }
+
+    auto GetTotalCommandCount() const -> uint64_t
+    {
+        uint64_t count = 0;
+        for (auto const commandCount : m_commandCounts) {
+            count += commandCount;
+        }
+        return count;
+    }
+
+    // Draws executed in frames, including those in the executed bundles
+    auto GetDrawCount() const -> uint64_t { return m_drawCount; }
+    auto GetErrorMessage() const -> const char* { return m_errorMessage; }
+
+private:
+    struct ListState
+    {
+        bool pipelineSet;
+        bool rootSignatureSet;
+        bool topologySet;
+        uint32_t renderTarget = CAPTURE_INVALID_ID;
+        bool inRenderPass;
+        uint32_t vertexCapacity;
+        uint32_t indexCapacity;
+        uint32_t drawCount;
+    };
+
+    auto CountDraw(CaptureOpcode opcode, ListState& state) -> bool
+    {
+        if (m_recordingBundleId == CAPTURE_INVALID_ID)
+        {
+            if (!m_inFrame || m_frameState.renderTarget == CAPTURE_INVALID_ID || !m_frameState.rootSignatureSet) return Fail(opcode, "no render target or root signature is set");
+            ++m_drawCount;
+        }
+        ++state.drawCount;
+        return true;
+    }
+
+    auto IsRenderTargetReady(uint32_t resourceId) const -> bool
+    {
+        return resourceId < m_capture.resources.size() && m_capture.resources[resourceId].kind == CaptureResourceKind::RENDER_TARGET &&
+            m_resourceStates[resourceId] == CAPTURE_RESOURCE_STATE_RENDER_TARGET;
+    }
+
+    auto IsDepthStencilReady(uint32_t resourceId) const -> bool
+    {
+        return resourceId < m_capture.resources.size() && m_capture.resources[resourceId].kind == CaptureResourceKind::DEPTH_STENCIL &&
+            m_resourceStates[resourceId] == CAPTURE_RESOURCE_STATE_DEPTH_WRITE;
+    }
+
+    auto Fail(CaptureOpcode opcode, const char* reason) -> bool
+    {
+        snprintf(m_errorMessage, sizeof(m_errorMessage), "%s: %s", CAPTURE_OPCODE_NAMES[size_t(opcode)], reason);
+        return false;
+    }
+
+    const CommandCapture& m_capture;
+    std::vector<uint32_t> m_resourceStates;
+    std::vector<uint32_t> m_bundleDrawCounts;       // UINT32_MAX for undefined bundles
+    ListState m_frameState{ };
+    ListState m_bundleState{ };
+    bool m_inFrame = false;
+    uint32_t m_recordingBundleId = CAPTURE_INVALID_ID;
+    uint64_t m_commandCounts[size_t(CaptureOpcode::COUNT)]{ };
+    uint64_t m_drawCount = 0;
+    char m_errorMessage[128]{ };
+};
@@ -0,0 +1,178 @@
+// CommandListPool.h : Pool of command allocator and command list pairs, recycled by fence value.
+//
+// A pair is only handed out again once the GPU has passed the fence value it was released with.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+enum class CommandQueueKind : uint32_t
+{
+    DIRECT,
+    COMPUTE,
+    COPY,
+    COUNT
+};
+
+// `Device` creates and destroys the native objects:
+//   using Allocator = ...;     // e.g. ID3D12CommandAllocator*
+//   using CommandList = ...;   // e.g. ID3D12GraphicsCommandList*
+//   auto CreatePair(CommandQueueKind kind, Allocator& allocator, CommandList& commandList) -> bool;   // the command list is created closed
+//   auto DestroyPair(Allocator allocator, CommandList commandList) -> void;
+template <typename Device>
+class CommandListPool
+{
+public:
+    using Allocator = typename Device::Allocator;
+    using CommandList = typename Device::CommandList;
+
+    struct Pair
+    {
+        Allocator allocator;
+        CommandList commandList;
+        CommandQueueKind kind;
+        uint64_t fenceValue;        // signaled after the last submission of the command list
+        uint64_t lastUsedFrame;
+    };
+
+    // Idle pairs not acquired for `idleFrameLimit` frames are destroyed.
+    CommandListPool(Device& device, uint64_t idleFrameLimit) : m_device(device), m_idleFrameLimit(idleFrameLimit) { }
+
+    CommandListPool(const CommandListPool&) = delete;
+    auto operator = (const CommandListPool&) -> CommandListPool& = delete;
+
+    ~CommandListPool()
+    {
+        Clear();
+    }
+
+    // Return a pair whose previous work has completed by `completedValue`, or null if a new pair cannot be created.
+    // The caller resets the allocator and the command list before recording.
+    auto Acquire(CommandQueueKind kind, uint64_t completedValue) -> Pair*
+    {
+        ++m_acquiredCount;
+
+        // The available pairs are kept in fence value order. Take the most recently used one that has completed,
+        // so that the pairs left over from a spike stay idle and are trimmed.
+        auto& available = m_availablePairs[size_t(kind)];
+        for (size_t i = available.size(); i > 0; --i)
+        {
+            Pair* const pair = available[i - 1];
+            if (pair->fenceValue <= completedValue)
+            {
+                available.erase(available.begin() + ptrdiff_t(i - 1));
+                pair->lastUsedFrame = m_frameIndex;
+                return pair;
+            }
+        }
+
+        auto pair = std::make_unique<Pair>(Pair{ .allocator { }, .commandList { }, .kind = kind, .fenceValue = 0, .lastUsedFrame = m_frameIndex });
+        if (!m_device.CreatePair(kind, pair->allocator, pair->commandList)) return nullptr;
+
+        ++m_createdCount;
+        m_pairs.push_back(std::move(pair));
+        // Every pair may be available at once, so this keeps `Release` from allocating.
+        available.reserve(m_pairs.size());
+        return m_pairs.back().get();
+    }
+
+    // `Fence` is anything with `GetCompletedValue()`, e.g. `ID3D12Fence`.
+    template <typename Fence>
+    auto AcquireCompleted(CommandQueueKind kind, Fence* fence) -> Pair*
+    {
+        return Acquire(kind, uint64_t(fence->GetCompletedValue()));
+    }
+
+    // Hand back a pair after its command list has been submitted. `fenceValue` is signaled after the submission;
+    // zero if the command list was never submitted.
+    auto Release(Pair* pair, uint64_t fenceValue) -> void
+    {
+        pair->fenceValue = fenceValue;
+
+        // Fence values are usually released in increasing order, so search from the back.
+        auto& available = m_availablePairs[size_t(pair->kind)];
+        auto pos = available.end();
+        while (pos != available.begin() && (*(pos - 1))->fenceValue > fenceValue) {
+            --pos;
+        }
+        available.insert(pos, pair);
+    }
+
+    // Mark the end of a frame, and destroy the available pairs whose work has completed by `completedValue`
+    // and that were not acquired for `idleFrameLimit` frames. Returns the number of destroyed pairs.
+    auto EndFrame(uint64_t completedValue) -> size_t
+    {
+        ++m_frameIndex;
+
+        size_t destroyedCount = 0;
+        for (auto& available : m_availablePairs)
+        {
+            for (size_t i = 0; i < available.size();)
+            {
+                Pair* const pair = available[i];
+                if (pair->fenceValue <= completedValue && m_frameIndex - pair->lastUsedFrame > m_idleFrameLimit)
+                {
+                    available.erase(available.begin() + ptrdiff_t(i));
+                    Destroy(pair);
+                    ++destroyedCount;
+                }
+                else {
+                    ++i;
+                }
+            }
+        }
+        return destroyedCount;
+    }
+
+    // Destroy all the pairs. The caller must make sure the GPU is idle and no pair is acquired.
+    auto Clear() -> void
+    {
+        for (auto& pair : m_pairs) {
+            m_device.DestroyPair(pair->allocator, pair->commandList);
+        }
+        m_destroyedCount += m_pairs.size();
+        m_pairs.clear();
+        for (auto& available : m_availablePairs) {
+            available.clear();
+        }
+    }
+
+    auto GetPairCount() const -> size_t { return m_pairs.size(); }
+
+    auto GetAvailableCount(CommandQueueKind kind) const -> size_t { return m_availablePairs[size_t(kind)].size(); }
+
+    auto GetCreatedCount() const -> uint64_t { return m_createdCount; }
+
+    auto GetDestroyedCount() const -> uint64_t { return m_destroyedCount; }
+
+    auto GetAcquiredCount() const -> uint64_t { return m_acquiredCount; }
+
+private:
+    auto Destroy(Pair* pair) -> void
+    {
+        m_device.DestroyPair(pair->allocator, pair->commandList);
+        ++m_destroyedCount;
+
+        for (auto& ownedPair : m_pairs)
+        {
+            if (ownedPair.get() == pair)
+            {
+                ownedPair = std::move(m_pairs.back());
+                m_pairs.pop_back();
+                break;
+            }
+        }
+    }
+
+    Device& m_device;
+    uint64_t m_idleFrameLimit;
+    uint64_t m_frameIndex = 0;
+    std::vector<std::unique_ptr<Pair>> m_pairs;
+    std::vector<Pair*> m_availablePairs[size_t(CommandQueueKind::COUNT)];    // in fence value order
+    uint64_t m_createdCount = 0;
+    uint64_t m_destroyedCount = 0;
+    uint64_t m_acquiredCount = 0;
+};
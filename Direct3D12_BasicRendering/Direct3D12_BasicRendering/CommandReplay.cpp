@@ -0,0 +1,107 @@
+// CommandReplay.cpp : Replays a command capture with the null backend to measure the parsing and CPU replay overhead.
+//
+// It does not depend on Direct3D 12 and builds on any platform, e.g.
+//   g++ -std=c++20 -O2 CommandReplay.cpp -o CommandReplay
+// Usage: CommandReplay <capture file> [iteration count]
+// The Direct3D 12 replay is done by the main program with `--replay-capture=<capture file>`.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+#include "CommandCapture.h"
+
+static constexpr uint32_t DEFAULT_REPLAY_ITERATION_COUNT = 1000;
+
+static auto LoadFile(const char path[], std::vector<uint8_t>& data) -> bool
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == nullptr) return false;
+
+    fseek(fp, 0, SEEK_END);
+    const long fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    bool done = false;
+    if (fileSize >= 0)
+    {
+        data.resize(size_t(fileSize));
+        done = fread(data.data(), 1, data.size(), fp) == data.size();
+    }
+    fclose(fp);
+
+    return done;
+}
+
+auto main(int argc, const char* argv[]) -> int
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <capture file> [iteration count]\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t iterationCount = DEFAULT_REPLAY_ITERATION_COUNT;
+    if (argc > 2)
+    {
+        iterationCount = uint32_t(std::strtoul(argv[2], nullptr, 10));
+        if (iterationCount == 0) {
+            iterationCount = DEFAULT_REPLAY_ITERATION_COUNT;
+        }
+    }
+
+    std::vector<uint8_t> fileData;
+    if (!LoadFile(argv[1], fileData))
+    {
+        fprintf(stderr, "Failed to read `%s`\n", argv[1]);
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto const toMilliseconds = [](Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+
+    CommandCapture capture{ };
+    auto beginTime = Clock::now();
+    const bool parsed = ParseCommandCapture(fileData.data(), fileData.size(), capture);
+    const double parseTime = toMilliseconds(Clock::now() - beginTime);
+    if (!parsed)
+    {
+        fprintf(stderr, "`%s` is not a valid command capture\n", argv[1]);
+        return 1;
+    }
+
+    printf("Capture `%s`: %zu bytes, %u frames, %zu resources (%zu bytes of contents), %zu command words\n", argv[1], fileData.size(),
+        capture.frameCount, capture.resources.size(), capture.resourceData.size(), capture.commandWords.size());
+    printf("Parse time: %.3f ms\n", parseTime);
+
+    NullCommandReplayBackend backend(capture);
+    beginTime = Clock::now();
+    for (uint32_t i = 0; i < iterationCount; ++i)
+    {
+        backend.Reset();
+        if (!ReplayCommandCapture(capture, backend))
+        {
+            fprintf(stderr, "Replay failed at iteration %u: %s\n", i, backend.GetErrorMessage());
+            return 1;
+        }
+    }
+    const double replayTime = toMilliseconds(Clock::now() - beginTime);
+
+    const uint64_t commandCount = backend.GetTotalCommandCount();
+    printf("Replayed %u times: %.3f ms in all, %.3f us per iteration, %.3f us per frame, %.2f ns per command\n", iterationCount, replayTime,
+        replayTime * 1000.0 / double(iterationCount), capture.frameCount > 0 ? replayTime * 1000.0 / (double(iterationCount) * capture.frameCount) : 0.0,
+        commandCount > 0 ? replayTime * 1000000.0 / double(commandCount) : 0.0);
+
+    for (uint32_t opcode = 0; opcode < uint32_t(CaptureOpcode::COUNT); ++opcode)
+    {
+        const uint64_t count = backend.GetCommandCount(CaptureOpcode(opcode));
+        if (count > 0) {
+            printf("  %-30s %llu per iteration\n", CAPTURE_OPCODE_NAMES[opcode], (unsigned long long)(count / iterationCount));
+        }
+    }
+    printf("  %-30s %llu per iteration\n", "Draws (including bundles)", (unsigned long long)(backend.GetDrawCount() / iterationCount));
+
+    return 0;
+}
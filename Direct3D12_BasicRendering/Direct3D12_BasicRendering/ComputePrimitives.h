@@ -0,0 +1,277 @@
+// ComputePrimitives.h : Wave-size specialization of the GPU compute primitives and their multithreaded CPU references.
+//
+// The GPU kernels are in shaders/compute_primitives.hlsl. Additions wrap around, so the references are bit-exact.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t COMPUTE_PRIMITIVE_TARGET_GROUP_SIZE = 256;
+static constexpr uint32_t COMPUTE_PRIMITIVE_MAX_GROUP_SIZE = 1024;
+
+// Radix sort of the GPU processes 4 bits per pass, so the per-group digit histograms stay small.
+static constexpr uint32_t RADIX_SORT_BITS_PER_PASS = 4;
+static constexpr uint32_t RADIX_SORT_DIGIT_COUNT = 1U << RADIX_SORT_BITS_PER_PASS;
+static constexpr uint32_t RADIX_SORT_PASS_COUNT = 32 / RADIX_SORT_BITS_PER_PASS;
+
+enum class ComputePrimitiveKernel : uint32_t
+{
+    REDUCE_PARTIAL,         // grid-stride sums of each group
+    REDUCE_FINAL,           // one group sums the partials
+    SCAN_GROUP,             // scan within each group and output the group totals
+    SCAN_GROUP_TOTALS,      // one group scans the group totals in place (exclusive)
+    SCAN_ADD,               // add the scanned group totals back
+    COMPACT_FLAGS,          // 1 for elements to keep, 0 otherwise
+    COMPACT_SCATTER,        // write the kept elements to their scanned offsets
+    RADIX_HISTOGRAM,        // digit histogram of each group, stored digit-major
+    RADIX_SCATTER,          // stable scatter by the scanned histograms
+    COUNT
+};
+
+static constexpr const char* COMPUTE_PRIMITIVE_ENTRY_POINTS[] = {
+    "ReducePartialCS",
+    "ReduceFinalCS",
+    "ScanGroupCS",
+    "ScanGroupTotalsCS",
+    "ScanAddCS",
+    "CompactFlagsCS",
+    "CompactScatterCS",
+    "RadixHistogramCS",
+    "RadixScatterCS"
+};
+
+static_assert(std::size(COMPUTE_PRIMITIVE_ENTRY_POINTS) == size_t(ComputePrimitiveKernel::COUNT), "Missing compute primitive entry point");
+
+// Kernel variant chosen at PSO creation time
+struct ComputePrimitiveConfig
+{
+    uint32_t waveSize;          // the minimum wave lane count reported by the device
+    uint32_t groupSize;         // threads per group, a multiple of `waveSize`
+    bool useWaveIntrinsics;     // otherwise, group shared memory is used for the in-group steps
+};
+
+// The wave intrinsic variant combines the wave totals of a group within one wave,
+// so a group can hold at most `waveSize` waves.
+static constexpr auto ChooseComputePrimitiveConfig(uint32_t waveLaneCount, bool waveOpsSupported) -> ComputePrimitiveConfig
+{
+    // Wave lane counts are at least 4, and a group of 4 x 4 threads still covers the radix digits.
+    if (!waveOpsSupported || waveLaneCount < 4)
+    {
+        return ComputePrimitiveConfig{
+            .waveSize = 1,
+            .groupSize = COMPUTE_PRIMITIVE_TARGET_GROUP_SIZE,
+            .useWaveIntrinsics = false
+        };
+    }
+
+    // Round down to a power of two, since the lane count is a power of two on all known hardware.
+    uint32_t waveSize = 1;
+    while (waveSize * 2 <= waveLaneCount && waveSize < COMPUTE_PRIMITIVE_MAX_GROUP_SIZE) {
+        waveSize *= 2;
+    }
+
+    uint32_t groupSize = COMPUTE_PRIMITIVE_TARGET_GROUP_SIZE;
+    if (groupSize > waveSize * waveSize) {
+        groupSize = waveSize * waveSize;
+    }
+    if (groupSize < waveSize) {
+        groupSize = waveSize;
+    }
+
+    return ComputePrimitiveConfig{
+        .waveSize = waveSize,
+        .groupSize = groupSize,
+        .useWaveIntrinsics = true
+    };
+}
+
+static constexpr auto GetComputeGroupCount(size_t elementCount, uint32_t groupSize) -> uint32_t
+{
+    return uint32_t((elementCount + groupSize - 1) / groupSize);
+}
+
+// The partial pass of the reduction strides over the input, so that the final pass fits in one group.
+static constexpr auto GetReducePartialGroupCount(size_t elementCount, uint32_t groupSize) -> uint32_t
+{
+    const uint32_t groupCount = GetComputeGroupCount(elementCount, groupSize);
+    return groupCount < groupSize ? groupCount : groupSize;
+}
+
+// Elements of the per-group scratch buffer needed by the primitives on `elementCount` elements
+static constexpr auto GetComputePrimitiveScratchCount(size_t elementCount, uint32_t groupSize) -> size_t
+{
+    return size_t(GetComputeGroupCount(elementCount, groupSize)) * RADIX_SORT_DIGIT_COUNT;
+}
+
+static constexpr auto IsCompactedElement(uint32_t value) -> bool
+{
+    return value != 0;
+}
+
+// ==== Multithreaded CPU references ====
+
+static inline auto GetComputeReferenceThreadCount() -> uint32_t
+{
+    const uint32_t threadCount = std::thread::hardware_concurrency();
+    return threadCount == 0 ? 1 : threadCount;
+}
+
+// Split [0, count) into `chunkCount` contiguous chunks and run `func(chunkIndex, begin, end)` for each on its own thread.
+template <typename Func>
+static inline auto ParallelForChunks(size_t count, uint32_t chunkCount, Func&& func) -> void
+{
+    if (chunkCount <= 1 || count < chunkCount)
+    {
+        func(0U, size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunkCount - 1);
+    for (uint32_t chunk = 1; chunk < chunkCount; ++chunk) {
+        threads.emplace_back(func, chunk, count * chunk / chunkCount, count * (chunk + 1) / chunkCount);
+    }
+    func(0U, size_t(0), count / chunkCount);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+static inline auto ReduceSumReference(const uint32_t input[], size_t count, uint32_t threadCount) -> uint32_t
+{
+    std::vector<uint32_t> partials(threadCount, 0);
+    ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+        uint32_t sum = 0;
+        for (size_t i = begin; i < end; ++i) {
+            sum += input[i];
+        }
+        partials[chunk] = sum;
+    });
+
+    uint32_t sum = 0;
+    for (auto const partial : partials) {
+        sum += partial;
+    }
+    return sum;
+}
+
+// Returns the total of all the elements.
+static inline auto PrefixSumReference(const uint32_t input[], uint32_t output[], size_t count, bool exclusive, uint32_t threadCount) -> uint32_t
+{
+    std::vector<uint32_t> chunkTotals(threadCount, 0);
+    ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+        uint32_t sum = 0;
+        for (size_t i = begin; i < end; ++i) {
+            sum += input[i];
+        }
+        chunkTotals[chunk] = sum;
+    });
+
+    uint32_t total = 0;
+    for (auto& chunkTotal : chunkTotals)
+    {
+        const uint32_t sum = chunkTotal;
+        chunkTotal = total;
+        total += sum;
+    }
+
+    ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+        uint32_t sum = chunkTotals[chunk];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t value = input[i];
+            output[i] = exclusive ? sum : sum + value;
+            sum += value;
+        }
+    });
+
+    return total;
+}
+
+// Keep the elements satisfying `IsCompactedElement` in their original order. Returns the number of kept elements.
+static inline auto CompactReference(const uint32_t input[], uint32_t output[], size_t count, uint32_t threadCount) -> size_t
+{
+    std::vector<size_t> chunkOffsets(threadCount, 0);
+    ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+        size_t keptCount = 0;
+        for (size_t i = begin; i < end; ++i) {
+            keptCount += IsCompactedElement(input[i]) ? 1 : 0;
+        }
+        chunkOffsets[chunk] = keptCount;
+    });
+
+    size_t totalCount = 0;
+    for (auto& chunkOffset : chunkOffsets)
+    {
+        const size_t keptCount = chunkOffset;
+        chunkOffset = totalCount;
+        totalCount += keptCount;
+    }
+
+    ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+        size_t offset = chunkOffsets[chunk];
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (IsCompactedElement(input[i])) {
+                output[offset++] = input[i];
+            }
+        }
+    });
+
+    return totalCount;
+}
+
+// Stable LSD radix sort of 32-bit keys, with the same digit width as the GPU.
+static inline auto RadixSortReference(uint32_t keys[], size_t count, uint32_t threadCount) -> void
+{
+    std::vector<uint32_t> temp(count);
+    std::vector<size_t> histograms(size_t(threadCount) * RADIX_SORT_DIGIT_COUNT);
+
+    uint32_t* src = keys;
+    uint32_t* dst = temp.data();
+    for (uint32_t pass = 0; pass < RADIX_SORT_PASS_COUNT; ++pass)
+    {
+        const uint32_t shift = pass * RADIX_SORT_BITS_PER_PASS;
+        std::fill(histograms.begin(), histograms.end(), size_t(0));
+
+        ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+            size_t* histogram = &histograms[size_t(chunk) * RADIX_SORT_DIGIT_COUNT];
+            for (size_t i = begin; i < end; ++i) {
+                ++histogram[(src[i] >> shift) & (RADIX_SORT_DIGIT_COUNT - 1)];
+            }
+        });
+
+        // Digit-major exclusive scan, the same order as the GPU scans the per-group histograms.
+        size_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX_SORT_DIGIT_COUNT; ++digit)
+        {
+            for (uint32_t chunk = 0; chunk < threadCount; ++chunk)
+            {
+                size_t& entry = histograms[size_t(chunk) * RADIX_SORT_DIGIT_COUNT + digit];
+                const size_t digitCount = entry;
+                entry = offset;
+                offset += digitCount;
+            }
+        }
+
+        ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+            size_t* offsets = &histograms[size_t(chunk) * RADIX_SORT_DIGIT_COUNT];
+            for (size_t i = begin; i < end; ++i) {
+                dst[offsets[(src[i] >> shift) & (RADIX_SORT_DIGIT_COUNT - 1)]++] = src[i];
+            }
+        });
+
+        uint32_t* const swapped = src;
+        src = dst;
+        dst = swapped;
+    }
+
+    // An even number of passes leaves the result in `keys`.
+    static_assert(RADIX_SORT_PASS_COUNT % 2 == 0, "The sorted keys must end up in the input array");
+}
@@ -0,0 +1,157 @@
+// DeferredRelease.h : RAII COM handle and the fence-tracked deferred release queue.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <utility>
+
+template <typename T>
+class ComHandle
+{
+public:
+    ComHandle() = default;
+
+    // Takes over one reference of `ptr`.
+    explicit ComHandle(T* ptr) : m_ptr(ptr) { }
+
+    ComHandle(const ComHandle& other) : m_ptr(other.m_ptr)
+    {
+        if (m_ptr != nullptr) {
+            m_ptr->AddRef();
+        }
+    }
+
+    ComHandle(ComHandle&& other) noexcept : m_ptr(other.m_ptr)
+    {
+        other.m_ptr = nullptr;
+    }
+
+    // Move from a handle of a derived interface, e.g. `ComHandle<ID3D12PipelineState>` to `ComHandle<IUnknown>`.
+    template <typename U>
+    ComHandle(ComHandle<U>&& other) noexcept : m_ptr(other.Detach()) { }
+
+    ~ComHandle()
+    {
+        Reset();
+    }
+
+    auto operator = (const ComHandle& other) -> ComHandle&
+    {
+        if (this != &other)
+        {
+            if (other.m_ptr != nullptr) {
+                other.m_ptr->AddRef();
+            }
+            Reset(other.m_ptr);
+        }
+        return *this;
+    }
+
+    auto operator = (ComHandle&& other) noexcept -> ComHandle&
+    {
+        if (this != &other) {
+            Reset(other.Detach());
+        }
+        return *this;
+    }
+
+    auto operator -> () const -> T* { return m_ptr; }
+
+    explicit operator bool() const { return m_ptr != nullptr; }
+
+    auto Get() const -> T* { return m_ptr; }
+
+    // Release the held object and return the address to receive a new one, e.g. for `IID_PPV_ARGS`.
+    auto ReleaseAndGetAddressOf() -> T**
+    {
+        Reset();
+        return &m_ptr;
+    }
+
+    // Give up the ownership without releasing.
+    auto Detach() -> T*
+    {
+        T* ptr = m_ptr;
+        m_ptr = nullptr;
+        return ptr;
+    }
+
+    // Release the held object and take over one reference of `ptr`.
+    auto Reset(T* ptr = nullptr) -> void
+    {
+        T* oldPtr = m_ptr;
+        m_ptr = ptr;
+        if (oldPtr != nullptr) {
+            oldPtr->Release();
+        }
+    }
+
+private:
+    T* m_ptr = nullptr;
+};
+
+// Holds handles until the GPU has passed the fence value of the last frame that used them.
+// Entries are kept in fence value order, so draining stops at the first entry still in flight.
+template <typename Handle>
+class DeferredReleaseQueue
+{
+public:
+    // `fenceValue` is the value signaled after the last submitted GPU work that uses `handle`.
+    auto Enqueue(Handle handle, uint64_t fenceValue) -> void
+    {
+        // Fence values are usually enqueued in increasing order, so search from the back.
+        auto pos = m_entries.end();
+        while (pos != m_entries.begin() && std::prev(pos)->fenceValue > fenceValue) {
+            --pos;
+        }
+        m_entries.insert(pos, Entry{ fenceValue, std::move(handle) });
+    }
+
+    // Release at most `maxReleaseCount` handles whose fence values have been reached by `completedValue`,
+    // so that a burst of retired objects is spread over several frames. Returns the number of released handles.
+    auto Drain(uint64_t completedValue, size_t maxReleaseCount = SIZE_MAX) -> size_t
+    {
+        size_t releasedCount = 0;
+        while (releasedCount < maxReleaseCount && !m_entries.empty() && m_entries.front().fenceValue <= completedValue)
+        {
+            m_entries.pop_front();
+            ++releasedCount;
+        }
+        m_totalReleasedCount += releasedCount;
+        return releasedCount;
+    }
+
+    // `Fence` is anything with `GetCompletedValue()`, e.g. `ID3D12Fence`.
+    template <typename Fence>
+    auto DrainCompleted(Fence* fence, size_t maxReleaseCount = SIZE_MAX) -> size_t
+    {
+        return Drain(uint64_t(fence->GetCompletedValue()), maxReleaseCount);
+    }
+
+    // Release everything. The caller must make sure the GPU is idle.
+    auto Flush() -> size_t
+    {
+        const size_t releasedCount = m_entries.size();
+        m_entries.clear();
+        m_totalReleasedCount += releasedCount;
+        return releasedCount;
+    }
+
+    auto GetPendingCount() const -> size_t { return m_entries.size(); }
+
+    auto GetTotalReleasedCount() const -> size_t { return m_totalReleasedCount; }
+
+private:
+    struct Entry
+    {
+        uint64_t fenceValue;
+        Handle handle;
+    };
+
+    std::deque<Entry> m_entries;
+    size_t m_totalReleasedCount = 0;
+};
@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include <cstdarg>
 #include <cerrno>
+#include <cwchar>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -13,31 +14,364 @@
 #include <limits>
 #include <algorithm>
 #include <utility>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
 
 #include <Windows.h>
 #include <d3d12.h>
 #include <dxgi1_4.h>
 #include <d3dcompiler.h>
+#include <dxcapi.h>
+
+#include "ShaderPermutation.h"
+#include "RootSignatureLayout.h"
+#include "DeferredRelease.h"
+#include "DynamicResolution.h"
+#include "BufferMemoryPolicy.h"
+#include "ComputePrimitives.h"
+#include "MultiAdapter.h"
+#include "CommandCapture.h"
+#include "RenderBackend.h"
+#include "BasicFrame.h"
+#include "CommandListPool.h"
+#include "StartupTaskGraph.h"
+#include "ResidencyManager.h"
+#include "GpuProfiler.h"
+#include "HiZOcclusion.h"
+#include "ParticleSystem.h"
+#include "FrameReadback.h"
+#include "MeshletBuilder.h"
+#include "TextureStreaming.h"
+#include "MipGenerator.h"
+#include "FenceReactor.h"
 
 static constexpr UINT MAX_HARDWARE_ADAPTER_COUNT = 16;
 static constexpr UINT TOTAL_FRAME_COUNT = 5;
 static constexpr int WINDOW_WIDTH = 640;
 static constexpr int WINDOW_HEIGHT = 640;
+static constexpr uint32_t ROOT_SIGNATURE_DWORD_BUDGET = 16;     // keep the root signature small for lower tier hardware
+static constexpr char ROOT_SIGNATURE_CACHE_DIRECTORY[] = "cache";
+static constexpr uint32_t FENCE_REACTOR_WORKER_COUNT = 2;          // run the callbacks on GPU progress, e.g. the deferred releases
+static constexpr size_t DEFERRED_RELEASE_COUNT_PER_FRAME = 64;     // bounds the release cost spent in one frame
+static constexpr UINT SCENE_RTV_INDEX = TOTAL_FRAME_COUNT;         // RTV of the dynamic resolution scene target follows the back buffers
+static constexpr double DEFAULT_GPU_FRAME_BUDGET = 1000.0 / 60.0;  // in milliseconds
+static constexpr UINT64 DYNAMIC_RESOLUTION_REPORT_INTERVAL = 120;   // in frames
+static constexpr size_t UPLOAD_BENCHMARK_BUFFER_SIZE = 64 * 1024 * 1024;
+static constexpr UINT UPLOAD_BENCHMARK_ITERATION_COUNT = 16;
+static constexpr size_t COMPUTE_BENCHMARK_ELEMENT_COUNT = 4 * 1024 * 1024;
+static constexpr UINT COMPUTE_BENCHMARK_ITERATION_COUNT = 8;
+static constexpr uint32_t MULTI_ADAPTER_ROW_ALIGNMENT = 8;
+static constexpr UINT64 MULTI_ADAPTER_REPORT_INTERVAL = 120;        // in frames
+static constexpr uint32_t COMMAND_CAPTURE_FRAME_COUNT = 60;
+static constexpr UINT COMMAND_REPLAY_ITERATION_COUNT = 100;
+static constexpr uint32_t BASIC_BUNDLE_CAPTURE_ID = 0;
+static constexpr UINT RENDER_BACKEND_RTV_CAPACITY = 8;              // render targets created through the rendering interface
+static constexpr UINT RENDER_BACKEND_DSV_CAPACITY = 2;              // depth targets created through the rendering interface
+static constexpr UINT64 RENDER_STATS_REPORT_INTERVAL = 120;         // in frames
+static constexpr uint64_t COMMAND_LIST_POOL_IDLE_FRAME_LIMIT = 120;  // pooled command lists idle for longer are destroyed
+static constexpr size_t BUNDLE_CACHE_CAPACITY = 64;
+static constexpr uint32_t STARTUP_MAX_WORKER_COUNT = 8;
+static constexpr double RESIDENCY_TARGET_BUDGET_FRACTION = 0.9;     // trimming leaves this much of the budget in use at most
+static constexpr DWORD RESIDENCY_POLL_INTERVAL = 200;               // in milliseconds
+static constexpr uint32_t GPU_PROFILER_FRAME_SLOT_COUNT = TOTAL_FRAME_COUNT;   // frames in flight with their queries
+static constexpr uint32_t GPU_PROFILER_MAX_SCOPE_COUNT = 16;        // per frame
+static constexpr UINT64 GPU_PROFILER_REPORT_INTERVAL = 120;         // in frames
+static constexpr UINT GPU_PROFILER_MARKER_METADATA = 1;             // the marker data is an ANSI string, as PIX expects
+static constexpr UINT64 DEPTH_STATS_REPORT_INTERVAL = 120;          // in frames
+static constexpr UINT HIZ_GROUP_SIZE = 8;                           // matches HIZ_GROUP_SIZE in shaders/hiz.hlsl
+static constexpr UINT PARTICLE_UAV_TABLE_SIZE = 6;                  // u0 to u5 of the particle update
+static constexpr UINT PARTICLE_SRV_TABLE_SIZE = 2;                  // t1 and t2 of the particle draw
+static constexpr UINT PARTICLE_GPU_SRV_TABLE_OFFSET = 2 * PARTICLE_UAV_TABLE_SIZE;     // a UAV table and an SRV table per frame parity
+static constexpr UINT PARTICLE_CPU_SRV_TABLE_OFFSET = PARTICLE_GPU_SRV_TABLE_OFFSET + 2 * PARTICLE_SRV_TABLE_SIZE;
+static constexpr UINT PARTICLE_DESCRIPTOR_COUNT = PARTICLE_CPU_SRV_TABLE_OFFSET + PARTICLE_SRV_TABLE_SIZE;
+static constexpr UINT64 PARTICLE_DEAD_COUNTER_OFFSET = 0;           // followed by the counter of each alive list
+static constexpr UINT64 PARTICLE_COUNTER_BUFFER_SIZE = 3 * D3D12_UAV_COUNTER_PLACEMENT_ALIGNMENT;
+static constexpr UINT64 PARTICLE_DEAD_COUNT_OFFSET = 0;             // matches PARTICLE_DEAD_COUNT_OFFSET in shaders/particles.hlsl
+static constexpr UINT64 PARTICLE_ALIVE_COUNT_OFFSET = 4;            // matches PARTICLE_ALIVE_COUNT_OFFSET in shaders/particles.hlsl
+static constexpr UINT64 PARTICLE_STATS_REPORT_INTERVAL = 120;       // in frames
+static constexpr uint32_t PARTICLE_BENCHMARK_FRAME_COUNT = 600;
+static constexpr uint32_t PARTICLE_BENCHMARK_TOLERANCE_DIVISOR = 100;   // the GPU and CPU alive counts may differ by 1%
+static constexpr uint32_t MESHLET_TORUS_RING_SEGMENT_COUNT = 512;   // 128K triangles
+static constexpr uint32_t MESHLET_TORUS_TUBE_SEGMENT_COUNT = 128;
+static constexpr float MESHLET_TORUS_RING_RADIUS = 1.0f;
+static constexpr float MESHLET_TORUS_TUBE_RADIUS = 0.35f;
+static constexpr float MESHLET_CAMERA_DISTANCE = 4.0f;
+static constexpr float MESHLET_VERTICAL_FOV = 0.8f;                 // in radians
+static constexpr float MESHLET_NEAR_Z = 2.5f;                       // the torus spans most of the depth range
+static constexpr float MESHLET_FAR_Z = 5.5f;
+static constexpr UINT MESHLET_AS_GROUP_SIZE = 32;                   // matches MESHLET_AS_GROUP_SIZE in shaders/meshlets.hlsl
+static constexpr UINT MESHLET_BUFFER_COUNT = 5;                     // t0 to t4 of shaders/meshlets.hlsl
+static constexpr UINT64 MESHLET_STATS_REPORT_INTERVAL = 120;        // in frames
+static constexpr uint32_t TEXTURE_STREAMING_MAX_TEXTURE_COUNT = 16;
+static constexpr uint64_t TEXTURE_STREAMING_DEFAULT_BUDGET = 8 * 1024 * 1024;
+static constexpr uint32_t TEXTURE_STREAMING_MAX_PENDING_COUNT = 4;  // uploads queued on the worker
+static constexpr uint64_t TEXTURE_STREAMING_DROP_DELAY = 60;        // in frames, before the mips no longer wanted are dropped
+static constexpr uint64_t TEXTURE_STREAMING_ANIMATION_PERIOD = 600; // in frames, for the quads to grow and shrink
+static constexpr uint32_t TEXTURE_STREAMING_SYNTHETIC_COUNT = 8;    // checkerboards written when the texture directory has no DDS file
+static constexpr uint32_t TEXTURE_STREAMING_SYNTHETIC_SIZE = 2048;  // 2.7 MB of BC1 with the mips
+static constexpr uint32_t TEXTURE_STREAMING_SYNTHETIC_CELL_SIZE = 128;
+static constexpr UINT64 TEXTURE_STREAMING_REPORT_INTERVAL = 300;    // in frames
+static constexpr size_t FRAME_READBACK_SLOT_COUNT = 4;             // frames whose copy or encoding may be in flight
+static constexpr uint32_t FRAME_CAPTURE_THREAD_COUNT = 2;
+static constexpr UINT64 FRAME_CAPTURE_MAX_FRAME_COUNT = 600;        // then the capture stops, about 700 MB of frames
+static constexpr UINT64 FRAME_CAPTURE_REPORT_INTERVAL = 120;        // in frames
+static constexpr UINT MIP_BENCHMARK_ITERATION_COUNT = 8;
+static constexpr UINT MIP_DESCRIPTOR_COUNT_PER_DISPATCH = 1 + MIP_MAX_LEVELS_PER_DISPATCH;     // the source mip and the mips written
+
+// Odd and even sizes, in linear and sRGB space
+static constexpr struct { uint32_t width; uint32_t height; bool srgb; } MIP_BENCHMARK_SIZES[]{
+    { 2048, 2048, true }, { 1920, 1080, true }, { 1000, 600, false }, { 777, 333, true }, { 513, 1, false }, { 4096, 4096, false }
+};
 
 static IDXGIFactory4* s_factory = nullptr;
+static IDXGIAdapter3* s_adapter = nullptr;         // for the video memory budget, null if not supported
 static ID3D12Device* s_device = nullptr;
 static ID3D12CommandQueue* s_commandQueue = nullptr;
-static ID3D12CommandAllocator* s_commandAllocator = nullptr;
 static ID3D12CommandAllocator* s_commandBundleAllocator = nullptr;
 static IDXGISwapChain3* s_swapChain = nullptr;
 static ID3D12DescriptorHeap* s_rtvDescriptorHeap = nullptr;
 static UINT s_rtvDescriptorSize = 0;
 static ID3D12RootSignature* s_rootSignature = nullptr;
-static ID3D12PipelineState* s_basicPipelineState = nullptr;
-static ID3D12GraphicsCommandList* s_basicCommandList = nullptr;
+static ID3D12PipelineState* s_basicPipelineState = nullptr;      // PSO of the current permutation, owned by `s_basicPipelineStateSet`
+static ID3D12GraphicsCommandList* s_basicCommandList = nullptr;    // being recorded for `s_commandQueue`, acquired from `s_commandListPool`
 static ID3D12GraphicsCommandList* s_basicCommandBundle = nullptr;
 static ID3D12Resource* s_renderTargets[TOTAL_FRAME_COUNT]{ };
 static ID3D12Resource* s_vertexBuffer = nullptr;
+static UINT64 s_frameCount = 0;
+
+// Memory architecture of the current device and how buffers written by the CPU are placed accordingly
+static DeviceMemoryCaps s_deviceMemoryCaps{ };
+static bool s_tileBasedRenderer = false;
+// Whether render passes are recorded with ID3D12GraphicsCommandList4::BeginRenderPass, or by binding and clearing the target
+static bool s_renderPassesEnabled = false;
+static BufferHeapPolicy s_bufferHeapPolicy = ChooseBufferHeapPolicy(DeviceMemoryCaps{ });
+static bool s_uploadBenchmarkEnabled = false;
+
+// DXC is loaded on demand. Without it, the compute primitives fall back to the Shader Model 5.1 variant compiled by FXC.
+static HMODULE s_hDxcModule = nullptr;
+static DxcCreateInstanceProc s_dxcCreateInstance = nullptr;
+
+// Compute primitive PSOs specialized for the wave lane count of the current device
+struct ComputePrimitivePipelines
+{
+    ComputePrimitiveConfig config;
+    ID3D12RootSignature* rootSignature;
+    ID3D12PipelineState* pipelineStates[size_t(ComputePrimitiveKernel::COUNT)];
+};
+
+// Matches `cbPrimitive` in shaders/compute_primitives.hlsl
+struct ComputePrimitiveConstants
+{
+    UINT elementCount;
+    UINT groupCount;
+    UINT radixShift;
+    UINT exclusiveScan;
+};
+
+static ComputePrimitivePipelines s_computePrimitives{ };
+static bool s_computeBenchmarkEnabled = false;
+static bool s_mipBenchmarkEnabled = false;
+static ID3D12RootSignature* s_mipRootSignature = nullptr;
+static ID3D12PipelineState* s_mipPipelineState = nullptr;
+static D3D12_VERTEX_BUFFER_VIEW s_vertexBufferView{ };
+static UINT s_vertexCount = 0;
+
+// Basic PSOs of all the shader permutations in use, indexed by the permutation key
+struct BasicPipelineStateSet
+{
+    ID3D12PipelineState* pipelineStates[BASIC_SHADER_PERMUTATION_KEY_COUNT];
+    ID3D12PipelineState* depthOnlyPipelineStates[BASIC_SHADER_PERMUTATION_KEY_COUNT];     // only with the depth prepass
+};
+
+static BasicPipelineStateSet s_basicPipelineStateSet{ };
+static uint32_t s_basicShaderPermutation = BASIC_SHADER_PERMUTATION_DEFAULT;
+static uint32_t s_requestedShaderPermutation = BASIC_SHADER_PERMUTATION_DEFAULT;
+
+// Shader hot-reload objects.
+static std::thread s_shaderWatcherThread;
+static HANDLE s_hShaderWatcherStopEvent = nullptr;
+static std::atomic<BasicPipelineStateSet*> s_pendingPipelineStateSet{ nullptr };
+static std::atomic<LONGLONG> s_shaderChangeDetectedTime{ 0 };
+static LARGE_INTEGER s_performanceFrequency{ };
+static double s_averageFrameTime = 0.0;     // in milliseconds
+
+// Dynamic resolution objects. The scene is rendered into `s_sceneRenderTarget` at `s_renderScale`,
+// and then upscaled to the back buffer.
+static bool s_dynamicResolutionEnabled = false;
+static DynamicResolutionController s_dynamicResolutionController{ GetDefaultDynamicResolutionSettings(DEFAULT_GPU_FRAME_BUDGET) };
+static double s_renderScale = 1.0;
+static ID3D12Resource* s_sceneRenderTarget = nullptr;
+static ID3D12DescriptorHeap* s_srvDescriptorHeap = nullptr;
+static ID3D12RootSignature* s_upscaleRootSignature = nullptr;
+static ID3D12PipelineState* s_upscalePipelineState = nullptr;
+static ID3D12QueryHeap* s_timestampQueryHeap = nullptr;
+static ID3D12Resource* s_timestampReadbackBuffer = nullptr;
+static UINT64 s_timestampFrequency = 0;
+
+// Depth prepass and Hi-Z occlusion culling. After the scene pass, `s_hiZPipelineState` reduces the scene depth into the mips
+// of `s_hiZTexture`, which are the Hi-Z levels 1 to `s_hiZReadbackLevel`. The last one is copied to `s_hiZReadbackBuffer`,
+// and the objects of the next frames are culled on the CPU against the pyramid built from it.
+static bool s_depthPrepassEnabled = false;
+static bool s_occlusionCullingEnabled = false;
+static ID3D12Resource* s_depthTarget = nullptr;                 // owned by `s_renderDevice`
+static RenderResourceId s_depthTargetId = RENDER_INVALID_RESOURCE;
+static ID3D12RootSignature* s_hiZRootSignature = nullptr;
+static ID3D12PipelineState* s_hiZPipelineState = nullptr;
+static ID3D12Resource* s_hiZTexture = nullptr;
+static ID3D12DescriptorHeap* s_hiZDescriptorHeap = nullptr;     // the depth SRV, then the SRV and the UAV of each mip
+static ID3D12Resource* s_hiZReadbackBuffer = nullptr;
+static D3D12_PLACED_SUBRESOURCE_FOOTPRINT s_hiZReadbackFootprint{ };
+static uint32_t s_hiZReadbackLevel = 0;
+static UINT64 s_hiZReadbackFenceValue = 0;      // of the frame that wrote `s_hiZReadbackBuffer`, 0 if none is pending
+static UINT s_hiZPendingSceneWidth = 0;         // scene size of that frame
+static UINT s_hiZPendingSceneHeight = 0;
+static HiZPyramid s_hiZPyramid{ };              // empty until a frame has been read back
+static UINT s_hiZSceneWidth = 0;                // scene size of the frame `s_hiZPyramid` comes from
+static UINT s_hiZSceneHeight = 0;
+static std::vector<BasicObject> s_visibleObjects;   // of the frame being recorded
+static HiZCullStats s_hiZCullStats{ };          // since the last report
+
+// Particles. In the GPU mode, EmitCS and SimulateCS update `s_particleBuffer` through the dead list and the alive list of each
+// frame parity, whose counters are in `s_particleCounterBuffer`, and the draw takes its instance count from `s_particleDrawArgumentBuffer`.
+// In the CPU mode, `s_particleSimulation` steps the particles and the alive ones are written to `s_particleUploadBuffer` every frame.
+enum class ParticleMode
+{
+    NONE,
+    GPU,
+    CPU
+};
+
+static ParticleMode s_particleMode = ParticleMode::NONE;
+static bool s_particleBenchmarkEnabled = false;
+static ParticleSettings s_particleSettings = PARTICLE_DEFAULT_SETTINGS;
+static ID3D12RootSignature* s_particleRootSignature = nullptr;
+static ID3D12PipelineState* s_particleEmitPipelineState = nullptr;
+static ID3D12PipelineState* s_particleSimulatePipelineState = nullptr;
+static ID3D12PipelineState* s_particleDrawPipelineState = nullptr;
+static ID3D12CommandSignature* s_particleCommandSignature = nullptr;
+static ID3D12DescriptorHeap* s_particleDescriptorHeap = nullptr;
+static ID3D12Resource* s_particleBuffer = nullptr;
+static ID3D12Resource* s_particleDeadListBuffer = nullptr;
+static ID3D12Resource* s_particleAliveListBuffers[2]{ };
+static ID3D12Resource* s_particleCounterBuffer = nullptr;
+static ID3D12Resource* s_particleCountBuffer = nullptr;         // copies of the counters read by the dispatches
+static ID3D12Resource* s_particleDrawArgumentBuffer = nullptr;
+static ID3D12Resource* s_particleReadbackBuffer = nullptr;      // alive count of the last frame
+static ID3D12Resource* s_particleUploadBuffer = nullptr;        // CPU mode
+static ID3D12Resource* s_particleIndexBuffer = nullptr;         // CPU mode, the slots in order
+static std::unique_ptr<ParticleSimulation> s_particleSimulation;   // CPU mode
+static uint32_t s_particleFrameIndex = 0;
+static uint32_t s_particleAliveCount = 0;
+static double s_particleStepTime = 0.0;                         // CPU mode, since the last report
+static uint64_t s_particleSimulatedCount = 0;
+
+// Meshlets. A torus is built into `s_meshletMesh` at startup, and drawn with an amplification shader that culls the
+// meshlets and a mesh shader that writes their triangles. It needs mesh shader support.
+static bool s_meshletsEnabled = false;
+static MeshletMesh s_meshletMesh;
+static ID3D12RootSignature* s_meshletRootSignature = nullptr;
+static ID3D12PipelineState* s_meshletPipelineState = nullptr;
+static ID3D12Resource* s_meshletBuffers[MESHLET_BUFFER_COUNT]{ };     // meshlets, bounds, vertices, vertex indices and primitives
+
+// Streamed textures. Each DDS file of `s_textureDirectory` stays mapped, and `s_textureStreamer` decides which of its mips
+// are resident. An upload creates a texture with the new range of mips and copies them from the file on a copy queue owned
+// by `s_textureUploadWorker`; the render thread swaps it in once the upload has completed.
+struct StreamedTexture
+{
+    HANDLE hFile;
+    HANDLE hMapping;
+    const uint8_t* fileData;
+    size_t fileSize;
+    DdsTexture dds;
+    ID3D12Resource* resource;           // the mips from `firstMip`, null until the mip tail is loaded
+    uint32_t firstMip;
+};
+
+struct TextureUploadResult
+{
+    uint32_t texture;
+    uint32_t firstMip;
+    ID3D12Resource* resource;           // null if the upload failed
+    double uploadTime;                  // in milliseconds
+};
+
+static bool s_textureStreamingEnabled = false;
+static const char* s_textureDirectory = "textures";
+static uint64_t s_textureStreamingBudget = TEXTURE_STREAMING_DEFAULT_BUDGET;
+static std::vector<StreamedTexture> s_streamedTextures;
+static std::unique_ptr<TextureStreamer> s_textureStreamer;
+static std::unique_ptr<TextureUploadWorker<TextureUploadResult>> s_textureUploadWorker;
+static std::vector<TextureStreamingRequest> s_textureStreamingRequests;
+static ID3D12RootSignature* s_textureRootSignature = nullptr;
+static ID3D12PipelineState* s_texturePipelineState = nullptr;
+static ID3D12DescriptorHeap* s_textureDescriptorHeap = nullptr;    // an SRV per texture
+static double s_textureUploadTime = 0.0;                        // of all the uploads, in milliseconds
+static uint64_t s_textureUploadCount = 0;
+// Only used by the upload worker
+static ID3D12CommandQueue* s_textureCopyQueue = nullptr;
+static ID3D12CommandAllocator* s_textureCopyAllocator = nullptr;
+static ID3D12GraphicsCommandList* s_textureCopyCommandList = nullptr;
+static ID3D12Fence* s_textureCopyFence = nullptr;
+static UINT64 s_textureCopyFenceValue = 0;
+
+// Frame captures. The back buffer of each frame is copied to the readback buffer of a slot of `s_frameReadbackRing`, and once
+// the frame has completed, a reactor worker hands the persistently mapped slot to `s_frameCaptureWorkers`, which release it when done.
+static const char* s_frameCaptureDirectory = nullptr;
+static const char* s_frameCompareDirectory = nullptr;
+static FrameImageFormat s_frameCaptureFormat = FrameImageFormat::PNG;
+static bool s_frameCaptureEnabled = false;
+static ID3D12Resource* s_frameReadbackBuffers[FRAME_READBACK_SLOT_COUNT]{ };
+static const uint8_t* s_frameReadbackData[FRAME_READBACK_SLOT_COUNT]{ };
+static D3D12_PLACED_SUBRESOURCE_FOOTPRINT s_frameReadbackFootprint{ };
+static std::unique_ptr<FrameReadbackRing> s_frameReadbackRing;
+static std::unique_ptr<FrameCaptureWorkers> s_frameCaptureWorkers;
+
+// Serialized root signature, shared by the devices of all the adapters
+static std::vector<uint8_t> s_rootSignatureBlob;
+
+// Objects of an adapter other than the presenting one in the multi-adapter mode.
+// It renders its band of the frame into `renderTarget`, which is copied into `crossAdapterBuffer` and
+// read by the primary device through `sharedBuffer`.
+struct SecondaryAdapter
+{
+    ID3D12Device* device;
+    ID3D12CommandQueue* commandQueue;
+    ID3D12CommandAllocator* commandAllocator;
+    ID3D12GraphicsCommandList* commandList;
+    ID3D12RootSignature* rootSignature;
+    ID3D12PipelineState* pipelineState;
+    ID3D12Resource* vertexBuffer;
+    D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+    ID3D12DescriptorHeap* rtvDescriptorHeap;
+    ID3D12Resource* renderTarget;
+    ID3D12Resource* crossAdapterBuffer;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+    ID3D12Resource* sharedBuffer;
+    ID3D12Fence* fence;
+    ID3D12Fence* sharedFence;
+    UINT64 fenceValue;
+    ID3D12QueryHeap* timestampQueryHeap;
+    ID3D12Resource* timestampReadbackBuffer;
+    UINT64 timestampFrequency;
+};
+
+static bool s_multiAdapterEnabled = false;
+static SecondaryAdapter s_secondaryAdapters[MULTI_ADAPTER_MAX_COUNT - 1]{ };
+static UINT s_secondaryAdapterCount = 0;
+static MultiAdapterLoadBalancer s_multiAdapterLoadBalancer{ 1 };
+static uint32_t s_multiAdapterRowBegins[MULTI_ADAPTER_MAX_COUNT + 1]{ 0, uint32_t(WINDOW_HEIGHT) };   // rows of each adapter in the current frame
+
+// Command capture. While capturing, the commands recorded into the basic command list and bundle are also written to
+// `s_commandCaptureWriter`, from startup until `COMMAND_CAPTURE_FRAME_COUNT` frames have been captured.
+static const char* s_commandCapturePath = nullptr;
+static bool s_commandCaptureActive = false;
+static CommandCaptureWriter s_commandCaptureWriter;
+static const char* s_commandReplayPath = nullptr;
+
+static_assert(CAPTURE_RESOURCE_STATE_COMMON == D3D12_RESOURCE_STATE_COMMON && CAPTURE_RESOURCE_STATE_RENDER_TARGET == D3D12_RESOURCE_STATE_RENDER_TARGET,
+    "Capture resource states must have the values of D3D12_RESOURCE_STATES");
 
 // Synchronization objects.
 static UINT s_currFrameIndex = 0;
@@ -45,10 +379,23 @@ static HANDLE s_hFenceEvent = nullptr;
 static ID3D12Fence* s_fence = nullptr;
 static UINT64 s_fenceValue = 0;
 
+// Runs callbacks once a fence reaches a value, see StartFenceReactor
+static constexpr size_t FENCE_REACTOR_FRAME_FENCE = 0;
+static constexpr size_t FENCE_REACTOR_TEXTURE_COPY_FENCE = 1;      // only with texture streaming
+static std::unique_ptr<FenceWaitSet> s_fenceWaitSet;
+static std::unique_ptr<FenceCompletionReactor> s_fenceReactor;
+
+// Objects retired while the GPU may still use them. Each one is released by a reactor worker once `s_fence` reaches the
+// fence value of the last frame that used it, see DrainDeferredReleases.
+static std::mutex s_deferredReleaseMutex;
+static DeferredReleaseQueue<ComHandle<IUnknown>> s_deferredReleaseQueue;
+
 static D3D_FEATURE_LEVEL s_maxFeatureLevel = D3D_FEATURE_LEVEL_1_0_CORE;
 static D3D_SHADER_MODEL s_highestShaderModel = D3D_SHADER_MODEL_5_1;
+static D3D_ROOT_SIGNATURE_VERSION s_rootSignatureVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
 static UINT s_waveSize = 0;
 static UINT s_maxSIMDSize = 0;
+static bool s_meshShadersSupported = false;
 
 static POINT s_wndMinsize{ };       // minimum window size
 static const char s_appName[] = "Direct3D 12 Basic Rendering";
@@ -98,6 +445,38 @@ static auto CreateCompiledShaderObjectFromPath(const char csoPath[]) -> D3D12_SH
     return result;
 }
 
+// Compile the HLSL source file at runtime. `defines` must be terminated with a null entry.
+static auto CompileShaderObjectFromPath(const WCHAR hlslPath[], const char entryPoint[], const char target[], const D3D_SHADER_MACRO defines[]) -> ID3DBlob*
+{
+#if defined(DEBUG) || defined(_DEBUG)
+    const UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+    const UINT compileFlags = D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#endif // DEBUG
+
+    ID3DBlob* code = nullptr;
+    ID3DBlob* error = nullptr;
+    HRESULT hRes = D3DCompileFromFile(hlslPath, defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, entryPoint, target, compileFlags, 0, &code, &error);
+    if (FAILED(hRes))
+    {
+        char pathBuf[MAX_PATH * 4]{ };
+        TransWStrToString(pathBuf, hlslPath);
+        fprintf(stderr, "Compile shader `%s` failed: %ld\n%s\n", pathBuf, hRes,
+            error != nullptr ? (const char*)error->GetBufferPointer() : "");
+
+        if (code != nullptr)
+        {
+            code->Release();
+            code = nullptr;
+        }
+    }
+    if (error != nullptr) {
+        error->Release();
+    }
+
+    return code;
+}
+
 static auto QueryDeviceSupportedMaxFeatureLevel() -> bool
 {
     const D3D_FEATURE_LEVEL requestedLevels[] = {
@@ -203,6 +582,7 @@ static auto QueryRootSignatureVersion() -> bool
     }
 
     const char* signatureVersion = "1.0";
+    s_rootSignatureVersion = rootSignature.HighestVersion;
 
     switch (rootSignature.HighestVersion)
     {
@@ -234,6 +614,14 @@ static auto QueryDeviceArchitecture(const UINT& selectedAdapterIndex) -> bool
     printf("Current device supports Cache-Coherent Unified Memory Access? %s\n", architecture.CacheCoherentUMA ? "YES" : "NO");
     printf("Current device supports Isolated Memory Management Unit? %s\n", architecture.IsolatedMMU ? "YES" : "NO");
 
+    s_tileBasedRenderer = architecture.TileBasedRenderer != FALSE;
+    s_deviceMemoryCaps = {
+        .uma = architecture.UMA != FALSE,
+        .cacheCoherentUMA = architecture.CacheCoherentUMA != FALSE
+    };
+    s_bufferHeapPolicy = ChooseBufferHeapPolicy(s_deviceMemoryCaps);
+    printf("Buffers written by the CPU will use the %s path\n", GetBufferMemoryPathName(s_bufferHeapPolicy.path));
+
     D3D12_FEATURE_DATA_GPU_VIRTUAL_ADDRESS_SUPPORT gpuVAS{ };
     hRes = s_device->CheckFeatureSupport(D3D12_FEATURE_GPU_VIRTUAL_ADDRESS_SUPPORT, &gpuVAS, sizeof(gpuVAS));
     if (FAILED(hRes))
@@ -318,6 +706,46 @@ static auto QueryDeviceWaveOps() -> bool
     return true;
 }
 
+// The load and store ops of render passes save the attachment traffic of tile-based GPUs. Elsewhere, the runtime emulates
+// tier 0 render passes with the same calls as the legacy path, so they are only used from tier 1 on.
+static auto QueryDeviceRenderPasses() -> bool
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS5 options5{ };
+    auto const hRes = s_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &options5, sizeof(options5));
+    if (FAILED(hRes))
+    {
+        puts("Current device does not support render passes.");
+        s_renderPassesEnabled = false;
+    }
+    else
+    {
+        printf("Current device supports render passes tier: %d\n", options5.RenderPassesTier);
+        s_renderPassesEnabled = s_tileBasedRenderer || options5.RenderPassesTier >= D3D12_RENDER_PASS_TIER_1;
+    }
+
+    printf("Render passes will use %s\n", s_renderPassesEnabled ? "native load and store ops" : "the legacy render target path");
+    return true;
+}
+
+// Mesh and amplification shaders need mesh shader tier 1 and Shader Model 6.5.
+static auto QueryDeviceMeshShaders() -> bool
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS7 options7{ };
+    auto const hRes = s_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS7, &options7, sizeof(options7));
+    if (FAILED(hRes))
+    {
+        puts("Current device does not support mesh shaders.");
+        s_meshShadersSupported = false;
+    }
+    else
+    {
+        printf("Current device supports mesh shader tier: %d\n", options7.MeshShaderTier);
+        s_meshShadersSupported = options7.MeshShaderTier >= D3D12_MESH_SHADER_TIER_1 && s_highestShaderModel >= D3D_SHADER_MODEL_6_5;
+    }
+
+    return true;
+}
+
 static auto CreateD3D12Device() -> bool
 {
     HRESULT hRes = S_OK;
@@ -407,6 +835,43 @@ static auto CreateD3D12Device() -> bool
     if (!QueryDeviceArchitecture(UINT(selectedAdapterIndex))) return false;
     if (!QueryDeviceBasicFeatures()) return false;
     if (!QueryDeviceWaveOps()) return false;
+    if (!QueryDeviceRenderPasses()) return false;
+    if (!QueryDeviceMeshShaders()) return false;
+
+    hRes = hardwareAdapters[selectedAdapterIndex]->QueryInterface(IID_PPV_ARGS(&s_adapter));
+    if (FAILED(hRes))
+    {
+        printf("WARNING: IDXGIAdapter3 is not available: %ld. Residency management will be disabled!\n", hRes);
+        s_adapter = nullptr;
+    }
+
+    // In the multi-adapter mode, every other hardware adapter gets its own device.
+    if (s_multiAdapterEnabled)
+    {
+        for (UINT i = 0; i < foundAdapterCount && s_secondaryAdapterCount < std::size(s_secondaryAdapters); ++i)
+        {
+            if (i == UINT(selectedAdapterIndex)) continue;
+
+            hardwareAdapters[i]->GetDesc1(&adapterDesc);
+            if ((adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) != 0) continue;
+
+            ID3D12Device* device = nullptr;
+            hRes = D3D12CreateDevice(hardwareAdapters[i], D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&device));
+            if (FAILED(hRes))
+            {
+                printf("WARNING: D3D12CreateDevice for adapter[%u] failed: %ld. It will not be used in the multi-adapter mode.\n", i, hRes);
+                continue;
+            }
+
+            TransWStrToString(strBuf, adapterDesc.Description);
+            printf("Secondary adapter[%u]: %s\n", i, strBuf);
+            s_secondaryAdapters[s_secondaryAdapterCount++].device = device;
+        }
+    }
+
+    for (UINT i = 0; i < foundAdapterCount; ++i) {
+        hardwareAdapters[i]->Release();
+    }
 
     return true;
 }
@@ -427,13 +892,6 @@ static auto CreateCommandQueue() -> bool
         return false;
     }
 
-    hRes = s_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&s_commandAllocator));
-    if (FAILED(hRes))
-    {
-        fprintf(stderr, "CreateCommandAllocator for command list failed: %ld\n", hRes);
-        return false;
-    }
-
     hRes = s_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_BUNDLE, IID_PPV_ARGS(&s_commandBundleAllocator));
     if (FAILED(hRes))
     {
@@ -480,7 +938,7 @@ static auto CreateRenderTargetViews() -> bool
     // Describe and create a render target view (RTV) descriptor heap.
     const D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{
         .Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
-        .NumDescriptors = TOTAL_FRAME_COUNT,
+        .NumDescriptors = TOTAL_FRAME_COUNT + 1,     // back buffers and the dynamic resolution scene target
         .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
         .NodeMask = 0
     };
@@ -514,59 +972,331 @@ static auto CreateRenderTargetViews() -> bool
     return true;
 }
 
-static auto CreateRootSignature() -> bool
+static auto ToD3D12ShaderVisibility(RootShaderVisibility visibility) -> D3D12_SHADER_VISIBILITY
 {
-    const D3D12_ROOT_PARAMETER rootParameter{
-        // Use constants directly in the root signature
-        .ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS,
-        .Constants {
-            .ShaderRegister = 0,
-            .RegisterSpace = 0,
-            .Num32BitValues = 1
-        },
-        // This constant buffer will just be accessed in a vertex shader
-        .ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX
-    };
+    switch (visibility)
+    {
+    case RootShaderVisibility::VERTEX:
+        return D3D12_SHADER_VISIBILITY_VERTEX;
 
-    // Create an empty root signature.
-    const D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {
-        .NumParameters = 1,
-        .pParameters = &rootParameter,
-        .NumStaticSamplers = 0,
-        .pStaticSamplers = nullptr,
-        .Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT
-    };
+    case RootShaderVisibility::PIXEL:
+        return D3D12_SHADER_VISIBILITY_PIXEL;
+
+    case RootShaderVisibility::ALL:
+    default:
+        return D3D12_SHADER_VISIBILITY_ALL;
+    }
+}
+
+// The flags decided by `GetRootParameterFlags()` have the values of the Direct3D 12 ones.
+static_assert(ROOT_FLAG_DESCRIPTORS_VOLATILE == D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
+static_assert(ROOT_FLAG_DATA_VOLATILE == D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE && ROOT_FLAG_DATA_VOLATILE == D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE);
+static_assert(ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE == D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE &&
+    ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE == D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+static_assert(ROOT_FLAG_DATA_STATIC == D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC && ROOT_FLAG_DATA_STATIC == D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC);
+
+static auto ToD3D12DescriptorRangeType(RootDescriptorRangeType type) -> D3D12_DESCRIPTOR_RANGE_TYPE
+{
+    switch (type)
+    {
+    case RootDescriptorRangeType::UAV:
+        return D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+
+    case RootDescriptorRangeType::CBV:
+        return D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
+
+    case RootDescriptorRangeType::SRV:
+    default:
+        return D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    }
+}
+
+static auto ToD3D12RootParameterType(RootParameterKind kind) -> D3D12_ROOT_PARAMETER_TYPE
+{
+    switch (kind)
+    {
+    case RootParameterKind::ROOT_CONSTANTS:
+        return D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+
+    case RootParameterKind::ROOT_CBV:
+        return D3D12_ROOT_PARAMETER_TYPE_CBV;
+
+    case RootParameterKind::ROOT_SRV:
+        return D3D12_ROOT_PARAMETER_TYPE_SRV;
+
+    case RootParameterKind::ROOT_UAV:
+        return D3D12_ROOT_PARAMETER_TYPE_UAV;
+
+    case RootParameterKind::DESCRIPTOR_TABLE:
+    default:
+        return D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    }
+}
+
+// Translate a fixed layout to a root signature description of `s_rootSignatureVersion` and serialize it.
+// Version 1.0 descriptions simply have no data and descriptor volatility flags.
+static auto SerializeRootSignatureLayout(const RootParameterDesc parameters[], uint32_t parameterCount,
+    const D3D12_STATIC_SAMPLER_DESC staticSamplers[], uint32_t staticSamplerCount, D3D12_ROOT_SIGNATURE_FLAGS flags,
+    ID3DBlob** ppSignature) -> HRESULT
+{
+    D3D12_ROOT_PARAMETER1 rootParameters1[ROOT_SIGNATURE_MAX_DWORD_COUNT]{ };
+    D3D12_DESCRIPTOR_RANGE1 descriptorRanges1[ROOT_SIGNATURE_MAX_DESCRIPTOR_RANGE_COUNT]{ };
+    D3D12_ROOT_PARAMETER rootParameters[ROOT_SIGNATURE_MAX_DWORD_COUNT]{ };
+    D3D12_DESCRIPTOR_RANGE descriptorRanges[ROOT_SIGNATURE_MAX_DESCRIPTOR_RANGE_COUNT]{ };
+
+    if (parameterCount > ROOT_SIGNATURE_MAX_DWORD_COUNT)
+    {
+        fprintf(stderr, "A root signature cannot have %u root parameters!\n", parameterCount);
+        return E_INVALIDARG;
+    }
+
+    uint32_t rangeCount = 0;
+    for (uint32_t i = 0; i < parameterCount; ++i)
+    {
+        auto const& desc = parameters[i];
+        auto& parameter1 = rootParameters1[i];
+        auto& parameter = rootParameters[i];
+        parameter1.ParameterType = ToD3D12RootParameterType(desc.kind);
+        parameter1.ShaderVisibility = ToD3D12ShaderVisibility(desc.visibility);
+        parameter.ParameterType = parameter1.ParameterType;
+        parameter.ShaderVisibility = parameter1.ShaderVisibility;
+
+        switch (desc.kind)
+        {
+        case RootParameterKind::ROOT_CONSTANTS:
+            parameter1.Constants = { .ShaderRegister = desc.shaderRegister, .RegisterSpace = desc.registerSpace, .Num32BitValues = desc.sizeInDwords };
+            parameter.Constants = parameter1.Constants;
+            break;
+
+        case RootParameterKind::ROOT_CBV:
+        case RootParameterKind::ROOT_SRV:
+        case RootParameterKind::ROOT_UAV:
+            parameter1.Descriptor = {
+                .ShaderRegister = desc.shaderRegister,
+                .RegisterSpace = desc.registerSpace,
+                .Flags = D3D12_ROOT_DESCRIPTOR_FLAGS(GetRootParameterDescFlags(desc))
+            };
+            parameter.Descriptor = { .ShaderRegister = desc.shaderRegister, .RegisterSpace = desc.registerSpace };
+            break;
+
+        case RootParameterKind::DESCRIPTOR_TABLE:
+        default:
+            if (desc.rangeCount > ROOT_SIGNATURE_MAX_DESCRIPTOR_RANGE_COUNT - rangeCount)
+            {
+                fprintf(stderr, "A root signature cannot have more than %u descriptor ranges!\n", ROOT_SIGNATURE_MAX_DESCRIPTOR_RANGE_COUNT);
+                return E_INVALIDARG;
+            }
+
+            for (uint32_t j = 0; j < desc.rangeCount; ++j)
+            {
+                auto const& range = desc.ranges[j];
+                descriptorRanges1[rangeCount + j] = {
+                    .RangeType = ToD3D12DescriptorRangeType(range.type),
+                    .NumDescriptors = range.descriptorCount,
+                    .BaseShaderRegister = range.baseShaderRegister,
+                    .RegisterSpace = range.registerSpace,
+                    .Flags = D3D12_DESCRIPTOR_RANGE_FLAGS(GetDescriptorRangeFlags(range.volatility, range.descriptorsVolatile)),
+                    .OffsetInDescriptorsFromTableStart = range.offsetInDescriptorsFromTableStart
+                };
+                descriptorRanges[rangeCount + j] = {
+                    .RangeType = ToD3D12DescriptorRangeType(range.type),
+                    .NumDescriptors = range.descriptorCount,
+                    .BaseShaderRegister = range.baseShaderRegister,
+                    .RegisterSpace = range.registerSpace,
+                    .OffsetInDescriptorsFromTableStart = range.offsetInDescriptorsFromTableStart
+                };
+            }
+            parameter1.DescriptorTable = { .NumDescriptorRanges = desc.rangeCount, .pDescriptorRanges = &descriptorRanges1[rangeCount] };
+            parameter.DescriptorTable = { .NumDescriptorRanges = desc.rangeCount, .pDescriptorRanges = &descriptorRanges[rangeCount] };
+            rangeCount += desc.rangeCount;
+            break;
+        }
+    }
+
+    D3D12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc{ .Version = s_rootSignatureVersion };
+    if (s_rootSignatureVersion == D3D_ROOT_SIGNATURE_VERSION_1_1)
+    {
+        rootSignatureDesc.Desc_1_1 = {
+            .NumParameters = parameterCount,
+            .pParameters = rootParameters1,
+            .NumStaticSamplers = staticSamplerCount,
+            .pStaticSamplers = staticSamplers,
+            .Flags = flags
+        };
+    }
+    else
+    {
+        rootSignatureDesc.Version = D3D_ROOT_SIGNATURE_VERSION_1_0;
+        rootSignatureDesc.Desc_1_0 = {
+            .NumParameters = parameterCount,
+            .pParameters = rootParameters,
+            .NumStaticSamplers = staticSamplerCount,
+            .pStaticSamplers = staticSamplers,
+            .Flags = flags
+        };
+    }
 
-    ID3DBlob* signature = nullptr;
     ID3DBlob* error = nullptr;
-    HRESULT hRes = D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &signature, &error);
+    const HRESULT hRes = D3D12SerializeVersionedRootSignature(&rootSignatureDesc, ppSignature, &error);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "D3D12SerializeVersionedRootSignature failed: %ld\n%s\n", hRes,
+            error != nullptr ? (const char*)error->GetBufferPointer() : "");
+    }
+    if (error != nullptr) {
+        error->Release();
+    }
+
+    return hRes;
+}
+
+// Read a cached serialized root signature blob. Returns nullptr if it is not cached yet.
+static auto LoadCachedRootSignatureBlob(const char cachePath[], size_t& blobSize) -> void*
+{
+    blobSize = 0;
+
+    FILE* fp = nullptr;
+    if (fopen_s(&fp, cachePath, "rb") != 0 || fp == nullptr) return nullptr;
+
+    fseek(fp, 0, SEEK_END);
+    const size_t fileSize = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    void* blob = fileSize > 0 ? malloc(fileSize) : nullptr;
+    if (blob != nullptr && fread(blob, 1, fileSize, fp) != fileSize)
+    {
+        free(blob);
+        blob = nullptr;
+    }
+    fclose(fp);
+
+    if (blob != nullptr) {
+        blobSize = fileSize;
+    }
+    return blob;
+}
+
+static auto StoreCachedRootSignatureBlob(const char cachePath[], ID3DBlob* signature) -> void
+{
+    if (!CreateDirectoryA(ROOT_SIGNATURE_CACHE_DIRECTORY, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        printf("WARNING: Create root signature cache directory `%s` failed: %lu\n", ROOT_SIGNATURE_CACHE_DIRECTORY, GetLastError());
+        return;
+    }
+
+    FILE* fp = nullptr;
+    if (fopen_s(&fp, cachePath, "wb") != 0 || fp == nullptr)
+    {
+        printf("WARNING: Open root signature cache file `%s` for writing failed!\n", cachePath);
+        return;
+    }
+
+    if (fwrite(signature->GetBufferPointer(), 1, signature->GetBufferSize(), fp) != signature->GetBufferSize()) {
+        printf("WARNING: Write root signature cache file `%s` failed!\n", cachePath);
+    }
+    fclose(fp);
+}
+
+// Create a root signature from its cached serialized blob, or serialize it and cache the blob.
+// The cache key covers the root signature version, so a blob of another version is never loaded. The blob is copied to `pBlob` if given.
+static auto CreateCachedRootSignature(const char name[], const RootParameterDesc parameters[], uint32_t parameterCount,
+    const D3D12_STATIC_SAMPLER_DESC staticSamplers[], uint32_t staticSamplerCount, D3D12_ROOT_SIGNATURE_FLAGS flags,
+    ID3D12RootSignature** ppRootSignature, std::vector<uint8_t>* pBlob = nullptr) -> bool
+{
+    uint64_t descHash = HashRootParameterDescs(uint32_t(s_rootSignatureVersion), uint32_t(flags), parameters, parameterCount);
+    descHash = HashFNV1a64(staticSamplers, sizeof(D3D12_STATIC_SAMPLER_DESC) * staticSamplerCount, descHash);
+    const uint32_t dwordCount = GetRootParameterDescDwordCount(parameters, parameterCount);
+
+    char cachePath[MAX_PATH]{ };
+    sprintf_s(cachePath, "%s/root_signature_%016llx.bin", ROOT_SIGNATURE_CACHE_DIRECTORY, (unsigned long long)descHash);
+
+    // Try the cached serialized blob first.
+    size_t cachedBlobSize = 0;
+    void* cachedBlob = LoadCachedRootSignatureBlob(cachePath, cachedBlobSize);
+    if (cachedBlob != nullptr)
+    {
+        HRESULT hRes = s_device->CreateRootSignature(0, cachedBlob, cachedBlobSize, IID_PPV_ARGS(ppRootSignature));
+        if (SUCCEEDED(hRes) && pBlob != nullptr) {
+            pBlob->assign((const uint8_t*)cachedBlob, (const uint8_t*)cachedBlob + cachedBlobSize);
+        }
+        free(cachedBlob);
+
+        if (SUCCEEDED(hRes))
+        {
+            printf("Root signature for %s (%u DWORDs) is created from cache `%s`\n", name, dwordCount, cachePath);
+            return true;
+        }
+
+        printf("WARNING: CreateRootSignature for %s from cache `%s` failed: %ld. It will be serialized again.\n", name, cachePath, hRes);
+        *ppRootSignature = nullptr;
+    }
+
+    ID3DBlob* signature = nullptr;
+    HRESULT hRes = SerializeRootSignatureLayout(parameters, parameterCount, staticSamplers, staticSamplerCount, flags, &signature);
     do
     {
         if (FAILED(hRes))
         {
-            fprintf(stderr, "D3D12SerializeRootSignature failed: %ld\n", hRes);
+            fprintf(stderr, "Serialize root signature for %s failed!\n", name);
             break;
         }
 
-        hRes = s_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&s_rootSignature));
+        hRes = s_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(ppRootSignature));
         if (FAILED(hRes))
         {
-            fprintf(stderr, "CreateRootSignature failed: %ld\n", hRes);
+            fprintf(stderr, "CreateRootSignature for %s failed: %ld\n", name, hRes);
             break;
         }
-    } 
+
+        if (pBlob != nullptr) {
+            pBlob->assign((const uint8_t*)signature->GetBufferPointer(), (const uint8_t*)signature->GetBufferPointer() + signature->GetBufferSize());
+        }
+        StoreCachedRootSignatureBlob(cachePath, signature);
+        printf("Root signature for %s (%u DWORDs) is serialized and cached to `%s`\n", name, dwordCount, cachePath);
+    }
     while (false);
 
     if (signature != nullptr) {
         signature->Release();
     }
-    if (error != nullptr) {
-        error->Release();
+
+    return SUCCEEDED(hRes);
+}
+
+static auto CreateRootSignature() -> bool
+{
+    // The rotation angle is updated every frame and the object placement every draw; both are just accessed in the vertex shader.
+    const RootConstantBufferBinding bindings[]{
+        {
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = BASIC_ROOT_CONSTANT_COUNT,
+            .visibility = RootShaderVisibility::VERTEX,
+            .volatility = RootDataVolatility::VOLATILE,
+            .descriptorsVolatile = false
+        }
+    };
+    const D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
+
+    RootParameterLayout layout{ };
+    if (!DecideRootParameterLayout(bindings, (uint32_t)std::size(bindings), ROOT_SIGNATURE_DWORD_BUDGET, layout))
+    {
+        fprintf(stderr, "The root parameters cannot fit in the root signature budget of %u DWORDs!\n", ROOT_SIGNATURE_DWORD_BUDGET);
+        return false;
+    }
+    // `PopulateCommandList()` sets the rotation angle with `SetGraphicsRoot32BitConstant`.
+    if (layout.kinds[0] != RootParameterKind::ROOT_CONSTANTS)
+    {
+        fprintf(stderr, "The rotation angle is expected to be root constants!\n");
+        return false;
     }
-    
-    if (FAILED(hRes)) return false;
 
-    return true;
+    RootParameterDesc parameters[std::size(bindings)]{ };
+    RootDescriptorRange ranges[std::size(bindings)]{ };
+    GetRootParameterDescs(bindings, layout, parameters, ranges);
+
+    // The secondary adapter creates its root signature from the same blob.
+    return CreateCachedRootSignature("basic rendering", parameters, layout.parameterCount, nullptr, 0, flags, &s_rootSignature, &s_rootSignatureBlob);
 }
 
 static auto CreateFenceAndEvent() -> bool
@@ -616,338 +1346,7461 @@ static auto WaitForPreviousFrame(void) -> bool
     return true;
 }
 
-static auto CreateBasicPipelineStateObject() -> bool
+// ==== Fence completion reactor (FenceReactor.h) ====
+
+// The fences of the reactor: the frame fence of `s_commandQueue`, then the texture copy fence with texture streaming. Each
+// fence has its own auto-reset event, and the reactor thread waits on all of them and on the wake event at once.
+class D3D12FenceWaitSet final : public FenceWaitSet
 {
-    D3D12_SHADER_BYTECODE vertexShaderObj = CreateCompiledShaderObjectFromPath("shaders/basic.vert.cso");
-    D3D12_SHADER_BYTECODE pixelShaderObj = CreateCompiledShaderObjectFromPath("shaders/basic.frag.cso");
+public:
+    // Holds a reference to each fence, and takes over the events, the wake event last.
+    D3D12FenceWaitSet(const std::vector<ID3D12Fence*>& fences, std::vector<HANDLE> hEvents) : m_hEvents(std::move(hEvents))
+    {
+        for (ID3D12Fence* fence : fences)
+        {
+            fence->AddRef();
+            m_fences.emplace_back(fence);
+        }
+    }
 
-    bool done = false;
-    do
+    ~D3D12FenceWaitSet() override
     {
-        if (vertexShaderObj.pShaderBytecode == nullptr || vertexShaderObj.BytecodeLength == 0) break;
-        if (pixelShaderObj.pShaderBytecode == nullptr || pixelShaderObj.BytecodeLength == 0) break;
+        for (HANDLE hEvent : m_hEvents) {
+            CloseHandle(hEvent);
+        }
+    }
 
-        // Define the vertex input layout.
-        const D3D12_INPUT_ELEMENT_DESC inputElementDescs[]{
-            { "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-        };
+    auto GetFenceCount() const -> size_t override { return m_fences.size(); }
 
-        // Describe and create the graphics pipeline state object (PSO).
-        const D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{
-            .pRootSignature = s_rootSignature,
-            .VS = vertexShaderObj,
-            .PS = pixelShaderObj,
-            .BlendState {
-                .AlphaToCoverageEnable = FALSE,
-                .IndependentBlendEnable = FALSE,
-                .RenderTarget {
-                // RenderTarget[0]
-                {
-                    .BlendEnable = FALSE,
-                    .LogicOpEnable = FALSE,
-                    .SrcBlend = D3D12_BLEND_SRC_ALPHA,
-                    .DestBlend = D3D12_BLEND_INV_SRC_ALPHA,
-                    .BlendOp = D3D12_BLEND_OP_ADD,
-                    .SrcBlendAlpha = D3D12_BLEND_ONE,
-                    .DestBlendAlpha = D3D12_BLEND_ZERO,
-                    .BlendOpAlpha = D3D12_BLEND_OP_ADD,
-                    .LogicOp = D3D12_LOGIC_OP_NOOP,
-                    .RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL
-                }
-            }
-        },
-        .SampleMask = UINT32_MAX,
-            // Use the default rasterizer state
-            .RasterizerState {
-                .FillMode = D3D12_FILL_MODE_SOLID,
-                .CullMode = D3D12_CULL_MODE_BACK,
-                .FrontCounterClockwise = FALSE,
-                .DepthBias = 0,
-                .DepthBiasClamp = 0.0f,
-                .SlopeScaledDepthBias = 0.0f,
-                .DepthClipEnable = TRUE,
-                .MultisampleEnable = FALSE,
-                .AntialiasedLineEnable = FALSE,
-                .ForcedSampleCount = 0,
-                .ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
-            },
-            .DepthStencilState {
-                .DepthEnable = FALSE,
-                .DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO,
-                .DepthFunc = D3D12_COMPARISON_FUNC_NEVER,
-                .StencilEnable = FALSE,
-                .StencilReadMask = 0,
-                .StencilWriteMask = 0,
-                .FrontFace {},
-                .BackFace { }
-            },
-            .InputLayout {
-                .pInputElementDescs = inputElementDescs,
-                .NumElements = (UINT)std::size(inputElementDescs)
-            },
-            .IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED,
-            .PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE,
-            .NumRenderTargets = 1,
-            .RTVFormats {
-                // RTVFormats[0]
-                { DXGI_FORMAT_R8G8B8A8_UNORM }
-            },
-            .DSVFormat = DXGI_FORMAT_UNKNOWN,
-            .SampleDesc {
-                .Count = 1,
-                .Quality = 0
-            },
-            .NodeMask = 0,
-            .CachedPSO { },
-            .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
-        };
+    auto GetCompletedValue(size_t fence) const -> uint64_t override { return m_fences[fence]->GetCompletedValue(); }
 
-        HRESULT hRes = s_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&s_basicPipelineState));
+    auto Arm(size_t fence, uint64_t value) -> bool override
+    {
+        const HRESULT hRes = m_fences[fence]->SetEventOnCompletion(value, m_hEvents[fence]);
         if (FAILED(hRes))
         {
-            fprintf(stderr, "CreateGraphicsPipelineState for basic PSO failed: %ld\n", hRes);
-            break;
+            fprintf(stderr, "SetEventOnCompletion for fence reactor failed: %ld\n", hRes);
+            return false;
         }
+        return true;
+    }
 
-        hRes = s_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, s_commandAllocator, s_basicPipelineState, IID_PPV_ARGS(&s_basicCommandList));
-        if (FAILED(hRes))
-        {
-            fprintf(stderr, "CreateCommandList for basic PSO failed: %ld\n", hRes);
+    auto Wait() -> void override { WaitForMultipleObjects((DWORD)m_hEvents.size(), m_hEvents.data(), FALSE, INFINITE); }
+
+    auto Wake() -> void override { SetEvent(m_hEvents.back()); }
+
+private:
+    std::vector<ComHandle<ID3D12Fence>> m_fences;
+    std::vector<HANDLE> m_hEvents;
+};
+
+static auto StartFenceReactor() -> bool
+{
+    std::vector<ID3D12Fence*> fences{ s_fence };
+    if (s_textureCopyFence != nullptr) {
+        fences.push_back(s_textureCopyFence);
+    }
+
+    std::vector<HANDLE> hEvents;
+    for (size_t i = 0; i <= fences.size(); ++i)
+    {
+        const HANDLE hEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+        if (hEvent == nullptr)
+        {
+            fprintf(stderr, "CreateEvent for fence reactor failed: %lu\n", GetLastError());
+            for (HANDLE hCreatedEvent : hEvents) {
+                CloseHandle(hCreatedEvent);
+            }
+            return false;
+        }
+        hEvents.push_back(hEvent);
+    }
+
+    s_fenceWaitSet = std::make_unique<D3D12FenceWaitSet>(fences, std::move(hEvents));
+    s_fenceReactor = std::make_unique<FenceCompletionReactor>(*s_fenceWaitSet, FENCE_REACTOR_WORKER_COUNT);
+    return true;
+}
+
+// Release `handle` once `s_fence` reaches `fenceValue`, the value of the last frame that used it.
+static auto ReleaseAfterFrameFence(ComHandle<IUnknown> handle, UINT64 fenceValue) -> void
+{
+    std::lock_guard<std::mutex> lock(s_deferredReleaseMutex);
+    s_deferredReleaseQueue.Enqueue(std::move(handle), fenceValue);
+}
+
+// Called once a frame, after the frame has completed. A reactor worker releases at most DEFERRED_RELEASE_COUNT_PER_FRAME of
+// the completed objects, so that neither the release cost nor a burst of retired objects, e.g. the PSOs replaced by a shader
+// reload, falls on the render thread.
+static auto DrainDeferredReleases() -> void
+{
+    {
+        std::lock_guard<std::mutex> lock(s_deferredReleaseMutex);
+        if (s_deferredReleaseQueue.GetPendingCount() == 0) return;
+    }
+    // The value is captured rather than read from `s_fence`, which is released before the last callbacks are drained.
+    s_fenceReactor->OnCompletion(FENCE_REACTOR_FRAME_FENCE, s_fenceValue, [completedValue = s_fenceValue] {
+        std::lock_guard<std::mutex> lock(s_deferredReleaseMutex);
+        s_deferredReleaseQueue.Drain(completedValue, DEFERRED_RELEASE_COUNT_PER_FRAME);
+    });
+}
+
+static auto ReportFenceReactorStats() -> void
+{
+    const FenceReactorStats stats = s_fenceReactor->GetStats();
+    printf("Fence reactor: %llu callbacks registered, %llu on completed values, %llu run, %zu pending, %llu wakeups\n",
+        (unsigned long long)stats.registeredCount, (unsigned long long)stats.immediateCount, (unsigned long long)stats.completedCount,
+        s_fenceReactor->GetPendingCount(), (unsigned long long)stats.wakeCount);
+}
+
+// The GPU is idle by now, so draining runs every callback left, and the retired objects the per-frame bound has left are
+// released at once.
+static auto ReleaseFenceReactor() -> void
+{
+    if (s_fenceReactor != nullptr)
+    {
+        s_fenceReactor->Drain();
+        s_fenceReactor.reset();
+    }
+    s_fenceWaitSet.reset();
+
+    std::lock_guard<std::mutex> lock(s_deferredReleaseMutex);
+    s_deferredReleaseQueue.Flush();
+}
+
+enum class BasicDepthMode
+{
+    NONE,               // no depth target, e.g. on the secondary adapters
+    TEST_AND_WRITE,     // LESS_EQUAL, so that the color pass after a depth prepass shades the fragments it left
+    DEPTH_ONLY          // the depth prepass: no pixel shader and no color writes
+};
+
+// Create the basic PSO from the given vertex and pixel shader bytecode. It may be called from a background thread.
+static auto CreateBasicPipelineState(ID3D12Device* device, ID3D12RootSignature* rootSignature,
+    const D3D12_SHADER_BYTECODE& vertexShaderObj, const D3D12_SHADER_BYTECODE& pixelShaderObj, BasicDepthMode depthMode,
+    ID3D12PipelineState** ppPipelineState) -> HRESULT
+{
+    const bool depthEnabled = depthMode != BasicDepthMode::NONE;
+    const bool depthOnly = depthMode == BasicDepthMode::DEPTH_ONLY;
+
+    // Define the vertex input layout.
+    const D3D12_INPUT_ELEMENT_DESC inputElementDescs[]{
+        { "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+
+    // Describe and create the graphics pipeline state object (PSO).
+    const D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{
+        .pRootSignature = rootSignature,
+        .VS = vertexShaderObj,
+        .PS = depthOnly ? D3D12_SHADER_BYTECODE{ } : pixelShaderObj,
+        .BlendState {
+            .AlphaToCoverageEnable = FALSE,
+            .IndependentBlendEnable = FALSE,
+            .RenderTarget {
+            // RenderTarget[0]
+            {
+                .BlendEnable = FALSE,
+                .LogicOpEnable = FALSE,
+                .SrcBlend = D3D12_BLEND_SRC_ALPHA,
+                .DestBlend = D3D12_BLEND_INV_SRC_ALPHA,
+                .BlendOp = D3D12_BLEND_OP_ADD,
+                .SrcBlendAlpha = D3D12_BLEND_ONE,
+                .DestBlendAlpha = D3D12_BLEND_ZERO,
+                .BlendOpAlpha = D3D12_BLEND_OP_ADD,
+                .LogicOp = D3D12_LOGIC_OP_NOOP,
+                .RenderTargetWriteMask = UINT8(depthOnly ? 0 : D3D12_COLOR_WRITE_ENABLE_ALL)
+            }
+        }
+    },
+    .SampleMask = UINT32_MAX,
+        // Use the default rasterizer state
+        .RasterizerState {
+            .FillMode = D3D12_FILL_MODE_SOLID,
+            .CullMode = D3D12_CULL_MODE_BACK,
+            .FrontCounterClockwise = FALSE,
+            .DepthBias = 0,
+            .DepthBiasClamp = 0.0f,
+            .SlopeScaledDepthBias = 0.0f,
+            .DepthClipEnable = TRUE,
+            .MultisampleEnable = FALSE,
+            .AntialiasedLineEnable = FALSE,
+            .ForcedSampleCount = 0,
+            .ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
+        },
+        .DepthStencilState {
+            .DepthEnable = depthEnabled ? TRUE : FALSE,
+            .DepthWriteMask = depthEnabled ? D3D12_DEPTH_WRITE_MASK_ALL : D3D12_DEPTH_WRITE_MASK_ZERO,
+            .DepthFunc = depthEnabled ? D3D12_COMPARISON_FUNC_LESS_EQUAL : D3D12_COMPARISON_FUNC_NEVER,
+            .StencilEnable = FALSE,
+            .StencilReadMask = 0,
+            .StencilWriteMask = 0,
+            .FrontFace {},
+            .BackFace { }
+        },
+        .InputLayout {
+            .pInputElementDescs = inputElementDescs,
+            .NumElements = (UINT)std::size(inputElementDescs)
+        },
+        .IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED,
+        .PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE,
+        .NumRenderTargets = 1,
+        .RTVFormats {
+            // RTVFormats[0]
+            { DXGI_FORMAT_R8G8B8A8_UNORM }
+        },
+        .DSVFormat = depthEnabled ? DXGI_FORMAT_D32_FLOAT : DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {
+            .Count = 1,
+            .Quality = 0
+        },
+        .NodeMask = 0,
+        .CachedPSO { },
+        .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+    };
+
+    return device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(ppPipelineState));
+}
+
+struct BasicShaderSource
+{
+    const WCHAR* hlslPath;
+    const char* entryPoint;
+    const char* target;
+};
+
+// Indexed by `ShaderStage`
+static constexpr BasicShaderSource BASIC_SHADER_SOURCES[size_t(ShaderStage::COUNT)] = {
+    { L"shaders/basic.vert.hlsl", "VSMain", "vs_5_1" },
+    { L"shaders/basic.frag.hlsl", "PSMain", "ps_5_1" }
+};
+
+static constexpr char BASIC_SHADER_ARCHIVE_PATH[] = "shaders/basic.permutations.bin";
+
+static auto CompileBasicShaderPermutation(ShaderStage stage, uint32_t stageKey) -> ID3DBlob*
+{
+    // The last element stays zero as the terminator.
+    D3D_SHADER_MACRO defines[std::size(BASIC_SHADER_FEATURE_DEFINES) + 1]{ };
+    size_t defineCount = 0;
+    for (auto const& featureDefine : BASIC_SHADER_FEATURE_DEFINES)
+    {
+        if (featureDefine.stage == stage && (stageKey & featureDefine.featureBit) != 0) {
+            defines[defineCount++] = { .Name = featureDefine.defineName, .Definition = "1" };
+        }
+    }
+
+    auto const& source = BASIC_SHADER_SOURCES[size_t(stage)];
+    return CompileShaderObjectFromPath(source.hlslPath, source.entryPoint, source.target, defines);
+}
+
+// Release the PSOs once the frame signaling `fenceValue`, which may still use them, has completed.
+static auto RetireBasicPipelineStateSet(BasicPipelineStateSet& stateSet, UINT64 fenceValue) -> void
+{
+    for (auto pipelineStates : { stateSet.pipelineStates, stateSet.depthOnlyPipelineStates })
+    {
+        for (size_t i = 0; i < BASIC_SHADER_PERMUTATION_KEY_COUNT; ++i)
+        {
+            if (pipelineStates[i] != nullptr)
+            {
+                ReleaseAfterFrameFence(ComHandle<IUnknown>(pipelineStates[i]), fenceValue);
+                pipelineStates[i] = nullptr;
+            }
+        }
+    }
+}
+
+static auto ReleaseBasicPipelineStateSet(BasicPipelineStateSet& stateSet) -> void
+{
+    for (auto pipelineStates : { stateSet.pipelineStates, stateSet.depthOnlyPipelineStates })
+    {
+        for (size_t i = 0; i < BASIC_SHADER_PERMUTATION_KEY_COUNT; ++i)
+        {
+            if (pipelineStates[i] != nullptr)
+            {
+                pipelineStates[i]->Release();
+                pipelineStates[i] = nullptr;
+            }
+        }
+    }
+}
+
+// Create the PSOs of all the permutations in use for the shader hot-reload. The HLSL sources are compiled,
+// each stage permutation only once.
+static auto CreateBasicPipelineStateSet(BasicPipelineStateSet& stateSet) -> bool
+{
+    ID3DBlob* compiledShaders[size_t(ShaderStage::COUNT)][BASIC_SHADER_PERMUTATION_KEY_COUNT]{ };
+
+    bool done = true;
+    for (auto const permutationKey : BASIC_SHADER_PERMUTATIONS_IN_USE)
+    {
+        D3D12_SHADER_BYTECODE shaderObjs[size_t(ShaderStage::COUNT)]{ };
+        for (size_t stage = 0; stage < size_t(ShaderStage::COUNT); ++stage)
+        {
+            const uint32_t stageKey = GetShaderStageKey(ShaderStage(stage), permutationKey);
+            ID3DBlob*& compiledShader = compiledShaders[stage][stageKey];
+            if (compiledShader == nullptr) {
+                compiledShader = CompileBasicShaderPermutation(ShaderStage(stage), stageKey);
+            }
+            if (compiledShader != nullptr) {
+                shaderObjs[stage] = { .pShaderBytecode = compiledShader->GetBufferPointer(), .BytecodeLength = compiledShader->GetBufferSize() };
+            }
+
+            if (shaderObjs[stage].pShaderBytecode == nullptr)
+            {
+                fprintf(stderr, "Bytecode of shader stage %zu permutation 0x%x is not available!\n", stage, stageKey);
+                done = false;
+            }
+        }
+        if (!done) break;
+
+        HRESULT hRes = CreateBasicPipelineState(s_device, s_rootSignature, shaderObjs[size_t(ShaderStage::VERTEX)], shaderObjs[size_t(ShaderStage::PIXEL)],
+            BasicDepthMode::TEST_AND_WRITE, &stateSet.pipelineStates[permutationKey]);
+        if (SUCCEEDED(hRes) && s_depthPrepassEnabled)
+        {
+            hRes = CreateBasicPipelineState(s_device, s_rootSignature, shaderObjs[size_t(ShaderStage::VERTEX)], shaderObjs[size_t(ShaderStage::PIXEL)],
+                BasicDepthMode::DEPTH_ONLY, &stateSet.depthOnlyPipelineStates[permutationKey]);
+        }
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateGraphicsPipelineState for basic PSO permutation 0x%x failed: %ld\n", permutationKey, hRes);
+            done = false;
             break;
         }
-
-        hRes = s_basicCommandList->Close();
-        if (FAILED(hRes))
+    }
+
+    for (auto& stageShaders : compiledShaders)
+    {
+        for (auto compiledShader : stageShaders)
+        {
+            if (compiledShader != nullptr) {
+                compiledShader->Release();
+            }
+        }
+    }
+
+    if (!done) {
+        ReleaseBasicPipelineStateSet(stateSet);
+    }
+
+    return done;
+}
+
+// Offline step (`--build-shader-archive`): compile every stage permutation in use and pack them into one archive.
+static auto BuildBasicShaderArchive() -> bool
+{
+    ID3DBlob* compiledShaders[size_t(ShaderStage::COUNT) * BASIC_SHADER_PERMUTATION_KEY_COUNT]{ };
+    ShaderArchiveBlob blobs[size_t(ShaderStage::COUNT) * BASIC_SHADER_PERMUTATION_KEY_COUNT]{ };
+    uint32_t blobCount = 0;
+
+    bool done = true;
+    for (size_t stage = 0; done && stage < size_t(ShaderStage::COUNT); ++stage)
+    {
+        for (uint32_t stageKey = 0; stageKey < BASIC_SHADER_PERMUTATION_KEY_COUNT; ++stageKey)
+        {
+            bool inUse = false;
+            for (auto const permutationKey : BASIC_SHADER_PERMUTATIONS_IN_USE) {
+                inUse = inUse || GetShaderStageKey(ShaderStage(stage), permutationKey) == stageKey;
+            }
+            if (!inUse) continue;
+
+            ID3DBlob* compiledShader = CompileBasicShaderPermutation(ShaderStage(stage), stageKey);
+            if (compiledShader == nullptr)
+            {
+                done = false;
+                break;
+            }
+
+            compiledShaders[blobCount] = compiledShader;
+            blobs[blobCount++] = {
+                .stage = ShaderStage(stage),
+                .stageKey = stageKey,
+                .bytecode = compiledShader->GetBufferPointer(),
+                .size = compiledShader->GetBufferSize()
+            };
+        }
+    }
+
+    if (done)
+    {
+        auto const archive = PackShaderArchive(blobs, blobCount);
+
+        FILE* fp = nullptr;
+        auto const err = fopen_s(&fp, BASIC_SHADER_ARCHIVE_PATH, "wb");
+        if (err != 0 || fp == nullptr)
+        {
+            fprintf(stderr, "Open shader archive file: `%s` for writing failed: %d\n", BASIC_SHADER_ARCHIVE_PATH, err);
+            done = false;
+        }
+        else
+        {
+            done = fwrite(archive.data(), 1, archive.size(), fp) == archive.size();
+            fclose(fp);
+
+            if (done) {
+                printf("Packed %u shader permutations (%zu bytes) into `%s`\n", blobCount, archive.size(), BASIC_SHADER_ARCHIVE_PATH);
+            }
+            else {
+                fprintf(stderr, "Write shader archive file: `%s` failed!\n", BASIC_SHADER_ARCHIVE_PATH);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < blobCount; ++i) {
+        compiledShaders[i]->Release();
+    }
+
+    return done;
+}
+
+// Bytecode of the basic shader stage permutations in use at startup: taken from the shader archive, or compiled
+// from the HLSL sources if the archive is not available. The startup tasks compile the stage permutations and create
+// the PSO of each permutation in parallel.
+struct BasicShaderLibrary
+{
+    D3D12_SHADER_BYTECODE archiveObj;       // contents of the archive file
+    ShaderArchive archive;
+    bool archiveValid;
+    ID3DBlob* compiledShaders[size_t(ShaderStage::COUNT)][BASIC_SHADER_PERMUTATION_KEY_COUNT];
+    LARGE_INTEGER beginTime;
+};
+
+static BasicShaderLibrary s_basicShaderLibrary{ };
+
+static auto LoadBasicShaderArchive() -> bool
+{
+    QueryPerformanceCounter(&s_basicShaderLibrary.beginTime);
+
+    // The archive file is read into a 4-byte aligned buffer.
+    s_basicShaderLibrary.archiveObj = CreateCompiledShaderObjectFromPath(BASIC_SHADER_ARCHIVE_PATH);
+    s_basicShaderLibrary.archiveValid = ParseShaderArchive((const uint8_t*)s_basicShaderLibrary.archiveObj.pShaderBytecode,
+        s_basicShaderLibrary.archiveObj.BytecodeLength, s_basicShaderLibrary.archive);
+    if (!s_basicShaderLibrary.archiveValid) {
+        printf("WARNING: Shader archive `%s` is not available. Run with `--build-shader-archive` to build it. The shader permutations in use will be compiled at runtime.\n", BASIC_SHADER_ARCHIVE_PATH);
+    }
+
+    return true;
+}
+
+// Nothing to do if the archive is available. Each stage permutation is compiled by one task.
+static auto CompileBasicShaderLibraryPermutation(ShaderStage stage, uint32_t stageKey) -> bool
+{
+    if (s_basicShaderLibrary.archiveValid) return true;
+
+    s_basicShaderLibrary.compiledShaders[size_t(stage)][stageKey] = CompileBasicShaderPermutation(stage, stageKey);
+    return s_basicShaderLibrary.compiledShaders[size_t(stage)][stageKey] != nullptr;
+}
+
+static auto GetBasicShaderLibraryBytecode(ShaderStage stage, uint32_t stageKey) -> D3D12_SHADER_BYTECODE
+{
+    if (s_basicShaderLibrary.archiveValid)
+    {
+        size_t bytecodeSize = 0;
+        const void* bytecode = FindShaderInArchive(s_basicShaderLibrary.archive, stage, stageKey, bytecodeSize);
+        return D3D12_SHADER_BYTECODE{ .pShaderBytecode = bytecode, .BytecodeLength = bytecodeSize };
+    }
+
+    ID3DBlob* const compiledShader = s_basicShaderLibrary.compiledShaders[size_t(stage)][stageKey];
+    if (compiledShader == nullptr) return D3D12_SHADER_BYTECODE{ };
+    return D3D12_SHADER_BYTECODE{ .pShaderBytecode = compiledShader->GetBufferPointer(), .BytecodeLength = compiledShader->GetBufferSize() };
+}
+
+static auto ReleaseBasicShaderLibrary() -> void
+{
+    if (s_basicShaderLibrary.archiveObj.pShaderBytecode != nullptr) {
+        free((void*)s_basicShaderLibrary.archiveObj.pShaderBytecode);
+    }
+    for (auto& stageShaders : s_basicShaderLibrary.compiledShaders)
+    {
+        for (auto compiledShader : stageShaders)
+        {
+            if (compiledShader != nullptr) {
+                compiledShader->Release();
+            }
+        }
+    }
+    s_basicShaderLibrary = BasicShaderLibrary{ };
+}
+
+// Each permutation is created by one task, into its own slot of `s_basicPipelineStateSet`.
+static auto CreateBasicPipelineStatePermutation(uint32_t permutationKey) -> bool
+{
+    D3D12_SHADER_BYTECODE shaderObjs[size_t(ShaderStage::COUNT)]{ };
+    for (size_t stage = 0; stage < size_t(ShaderStage::COUNT); ++stage)
+    {
+        const uint32_t stageKey = GetShaderStageKey(ShaderStage(stage), permutationKey);
+        shaderObjs[stage] = GetBasicShaderLibraryBytecode(ShaderStage(stage), stageKey);
+        if (shaderObjs[stage].pShaderBytecode == nullptr)
+        {
+            fprintf(stderr, "Bytecode of shader stage %zu permutation 0x%x is not available!\n", stage, stageKey);
+            return false;
+        }
+    }
+
+    HRESULT hRes = CreateBasicPipelineState(s_device, s_rootSignature, shaderObjs[size_t(ShaderStage::VERTEX)], shaderObjs[size_t(ShaderStage::PIXEL)],
+        BasicDepthMode::TEST_AND_WRITE, &s_basicPipelineStateSet.pipelineStates[permutationKey]);
+    if (SUCCEEDED(hRes) && s_depthPrepassEnabled)
+    {
+        hRes = CreateBasicPipelineState(s_device, s_rootSignature, shaderObjs[size_t(ShaderStage::VERTEX)], shaderObjs[size_t(ShaderStage::PIXEL)],
+            BasicDepthMode::DEPTH_ONLY, &s_basicPipelineStateSet.depthOnlyPipelineStates[permutationKey]);
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateGraphicsPipelineState for basic PSO permutation 0x%x failed: %ld\n", permutationKey, hRes);
+        return false;
+    }
+
+    return true;
+}
+
+// All the PSO permutations in use must have been created.
+static auto CreateBasicPipelineStateObject() -> bool
+{
+    const LARGE_INTEGER beginTime = s_basicShaderLibrary.beginTime;
+    ReleaseBasicShaderLibrary();
+
+    s_basicPipelineState = s_basicPipelineStateSet.pipelineStates[s_basicShaderPermutation];
+
+    LARGE_INTEGER endTime{ };
+    QueryPerformanceCounter(&endTime);
+    printf("Created %zu basic PSO permutations in %.2f ms\n", std::size(BASIC_SHADER_PERMUTATIONS_IN_USE),
+        double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart));
+
+    HRESULT hRes = s_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_BUNDLE, s_commandBundleAllocator, s_basicPipelineState, IID_PPV_ARGS(&s_basicCommandBundle));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandList for command bundle failed: %ld\n", hRes);
+        return false;
+    }
+
+    // The bundle is recorded once the vertex buffer is created.
+    hRes = s_basicCommandBundle->Close();
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Close basic command bundle failed: %ld\n", hRes);
+        return false;
+    }
+
+    return true;
+}
+
+static auto ToD3D12CPUPageProperty(BufferCpuPageProperty cpuPageProperty) -> D3D12_CPU_PAGE_PROPERTY
+{
+    switch (cpuPageProperty)
+    {
+    case BufferCpuPageProperty::WRITE_COMBINE:
+        return D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE;
+
+    case BufferCpuPageProperty::WRITE_BACK:
+        return D3D12_CPU_PAGE_PROPERTY_WRITE_BACK;
+
+    case BufferCpuPageProperty::NOT_AVAILABLE:
+    default:
+        return D3D12_CPU_PAGE_PROPERTY_NOT_AVAILABLE;
+    }
+}
+
+static auto ToD3D12MemoryPool(BufferMemoryPool memoryPool) -> D3D12_MEMORY_POOL
+{
+    return memoryPool == BufferMemoryPool::L1 ? D3D12_MEMORY_POOL_L1 : D3D12_MEMORY_POOL_L0;
+}
+
+// Create the buffer the CPU writes into: a CUSTOM heap buffer for the zero-copy path, or the UPLOAD heap staging buffer.
+static auto CreateCpuWrittenBuffer(const BufferHeapPolicy& policy, UINT64 size, D3D12_RESOURCE_STATES initialState, ID3D12Resource** ppBuffer) -> HRESULT
+{
+    const BufferHeapDesc heapDesc = GetCpuWrittenHeapDesc(policy);
+    D3D12_HEAP_PROPERTIES heapProperties{
+        .Type = D3D12_HEAP_TYPE_UPLOAD,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    if (heapDesc.type == BufferHeapType::CUSTOM)
+    {
+        heapProperties.Type = D3D12_HEAP_TYPE_CUSTOM;
+        heapProperties.CPUPageProperty = ToD3D12CPUPageProperty(heapDesc.cpuPageProperty);
+        heapProperties.MemoryPoolPreference = ToD3D12MemoryPool(heapDesc.memoryPool);
+    }
+    if (heapDesc.genericReadOnly) {
+        initialState = D3D12_RESOURCE_STATE_GENERIC_READ;
+    }
+
+    const D3D12_RESOURCE_DESC bufferDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = size,
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+
+    return s_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc, initialState, nullptr, IID_PPV_ARGS(ppBuffer));
+}
+
+// Create a DEFAULT heap buffer, e.g. the destination of the staged path.
+static auto CreateGpuLocalBuffer(UINT64 size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState, ID3D12Resource** ppBuffer) -> HRESULT
+{
+    const D3D12_HEAP_PROPERTIES heapProperties{
+        .Type = D3D12_HEAP_TYPE_DEFAULT,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC bufferDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = size,
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = flags
+    };
+
+    return s_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc, initialState, nullptr, IID_PPV_ARGS(ppBuffer));
+}
+
+static auto WriteBufferData(ID3D12Resource* buffer, const void* data, size_t size) -> bool
+{
+    void* pDataBegin = nullptr;
+    const D3D12_RANGE readRange{ 0, 0 };    // We do not intend to read from this resource on the CPU.
+    const HRESULT hRes = buffer->Map(0, &readRange, &pDataBegin);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    memcpy(pDataBegin, data, size);
+
+    const D3D12_RANGE writtenRange{ 0, size };
+    buffer->Unmap(0, &writtenRange);
+    return true;
+}
+
+// Creates the command allocator and command list pairs of `s_commandListPool`
+struct D3D12CommandListPoolDevice
+{
+    using Allocator = ID3D12CommandAllocator*;
+    using CommandList = ID3D12GraphicsCommandList*;
+
+    auto CreatePair(CommandQueueKind kind, Allocator& allocator, CommandList& commandList) -> bool
+    {
+        const D3D12_COMMAND_LIST_TYPE type = kind == CommandQueueKind::COMPUTE ? D3D12_COMMAND_LIST_TYPE_COMPUTE :
+            kind == CommandQueueKind::COPY ? D3D12_COMMAND_LIST_TYPE_COPY : D3D12_COMMAND_LIST_TYPE_DIRECT;
+
+        HRESULT hRes = s_device->CreateCommandAllocator(type, IID_PPV_ARGS(&allocator));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommandAllocator for command list pool failed: %ld\n", hRes);
+            return false;
+        }
+
+        hRes = s_device->CreateCommandList(0, type, allocator, nullptr, IID_PPV_ARGS(&commandList));
+        if (SUCCEEDED(hRes)) {
+            hRes = commandList->Close();
+        }
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommandList for command list pool failed: %ld\n", hRes);
+            if (commandList != nullptr)
+            {
+                commandList->Release();
+                commandList = nullptr;
+            }
+            allocator->Release();
+            allocator = nullptr;
+            return false;
+        }
+
+        return true;
+    }
+
+    auto DestroyPair(Allocator allocator, CommandList commandList) -> void
+    {
+        commandList->Release();
+        allocator->Release();
+    }
+};
+
+static D3D12CommandListPoolDevice s_commandListPoolDevice;
+static CommandListPool<D3D12CommandListPoolDevice> s_commandListPool{ s_commandListPoolDevice, COMMAND_LIST_POOL_IDLE_FRAME_LIMIT };
+static CommandListPool<D3D12CommandListPoolDevice>::Pair* s_basicCommandListPair = nullptr;   // holds `s_basicCommandList`
+
+// Take a direct command list whose previous work has completed from the pool, as `s_basicCommandList`.
+// The caller resets its allocator and the command list before recording.
+static auto AcquireBasicCommandList() -> bool
+{
+    s_basicCommandListPair = s_commandListPool.AcquireCompleted(CommandQueueKind::DIRECT, s_fence);
+    if (s_basicCommandListPair == nullptr)
+    {
+        fprintf(stderr, "Acquire command list from the pool failed\n");
+        return false;
+    }
+
+    s_basicCommandList = s_basicCommandListPair->commandList;
+    return true;
+}
+
+// Hand `s_basicCommandList` back to the pool. `fenceValue` is signaled after its submission, or zero if it was not submitted.
+static auto ReleaseBasicCommandList(UINT64 fenceValue) -> void
+{
+    if (s_basicCommandListPair == nullptr) return;
+
+    s_commandListPool.Release(s_basicCommandListPair, fenceValue);
+    s_basicCommandListPair = nullptr;
+    s_basicCommandList = nullptr;
+}
+
+// Start recording one-off commands into `s_basicCommandList`.
+static auto BeginImmediateCommands() -> bool
+{
+    if (!AcquireBasicCommandList()) return false;
+
+    HRESULT hRes = s_basicCommandListPair->allocator->Reset();
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Reset command allocator for immediate commands failed: %ld\n", hRes);
+        ReleaseBasicCommandList(0);
+        return false;
+    }
+
+    hRes = s_basicCommandList->Reset(s_basicCommandListPair->allocator, nullptr);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Reset command list for immediate commands failed: %ld\n", hRes);
+        ReleaseBasicCommandList(0);
+        return false;
+    }
+
+    return true;
+}
+
+// Execute the commands recorded since `BeginImmediateCommands` and wait for them to complete.
+static auto SubmitImmediateCommands() -> bool
+{
+    const HRESULT hRes = s_basicCommandList->Close();
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Close command list for immediate commands failed: %ld\n", hRes);
+        ReleaseBasicCommandList(0);
+        return false;
+    }
+
+    ID3D12CommandList* const commandLists[] = { s_basicCommandList };
+    s_commandQueue->ExecuteCommandLists((UINT)std::size(commandLists), commandLists);
+
+    const bool done = WaitForPreviousFrame();
+    ReleaseBasicCommandList(s_fenceValue);
+    return done;
+}
+
+// Copy `srcBuffer` into `dstBuffer` on the GPU and wait for the copy to complete.
+// `dstBuffer` is transitioned from `stateBefore` to `COPY_DEST` and then to `stateAfter`.
+static auto SubmitBufferCopy(ID3D12Resource* dstBuffer, ID3D12Resource* srcBuffer, UINT64 size,
+    D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter) -> bool
+{
+    if (!BeginImmediateCommands()) return false;
+
+    D3D12_RESOURCE_BARRIER barrier{
+        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        .Transition {
+            .pResource = dstBuffer,
+            .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+            .StateBefore = stateBefore,
+            .StateAfter = D3D12_RESOURCE_STATE_COPY_DEST
+        }
+    };
+    if (stateBefore != D3D12_RESOURCE_STATE_COPY_DEST) {
+        s_basicCommandList->ResourceBarrier(1, &barrier);
+    }
+
+    s_basicCommandList->CopyBufferRegion(dstBuffer, 0, srcBuffer, 0, size);
+
+    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+    barrier.Transition.StateAfter = stateAfter;
+    if (stateAfter != D3D12_RESOURCE_STATE_COPY_DEST) {
+        s_basicCommandList->ResourceBarrier(1, &barrier);
+    }
+
+    return SubmitImmediateCommands();
+}
+
+// Create a buffer initialized with `data` along the path of `policy`, and leave it in `finalState`.
+static auto CreateBufferWithData(const BufferHeapPolicy& policy, const void* data, size_t size, D3D12_RESOURCE_STATES finalState, ID3D12Resource** ppBuffer) -> bool
+{
+    *ppBuffer = nullptr;
+
+    if (policy.path == BufferMemoryPath::ZERO_COPY)
+    {
+        // The GPU reads the CPU-written pages in place, so there is no staging copy.
+        const HRESULT hRes = CreateCpuWrittenBuffer(policy, UINT64(size), finalState, ppBuffer);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for zero-copy buffer failed: %ld\n", hRes);
+            return false;
+        }
+
+        return WriteBufferData(*ppBuffer, data, size);
+    }
+
+    ComHandle<ID3D12Resource> stagingBuffer;
+    HRESULT hRes = CreateCpuWrittenBuffer(policy, UINT64(size), D3D12_RESOURCE_STATE_GENERIC_READ, stagingBuffer.ReleaseAndGetAddressOf());
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for staging buffer failed: %ld\n", hRes);
+        return false;
+    }
+    if (!WriteBufferData(stagingBuffer.Get(), data, size)) return false;
+
+    ComHandle<ID3D12Resource> buffer;
+    hRes = CreateGpuLocalBuffer(UINT64(size), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, buffer.ReleaseAndGetAddressOf());
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for GPU local buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    // The copy has completed when this returns, so the staging buffer can be released right away.
+    if (!SubmitBufferCopy(buffer.Get(), stagingBuffer.Get(), UINT64(size), D3D12_RESOURCE_STATE_COPY_DEST, finalState)) return false;
+
+    *ppBuffer = buffer.Detach();
+    return true;
+}
+
+// ==== Residency management (ResidencyManager.h) ====
+// The render thread marks the resources of each frame, and the residency thread trims them against the budget.
+
+struct D3D12ResidencyDevice
+{
+    using Resource = ID3D12Pageable*;
+
+    auto MakeResident(const Resource resources[], uint32_t count) -> bool
+    {
+        const HRESULT hRes = s_device->MakeResident(UINT(count), resources);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "MakeResident failed: %ld\n", hRes);
+            return false;
+        }
+        return true;
+    }
+
+    auto Evict(const Resource resources[], uint32_t count) -> bool
+    {
+        const HRESULT hRes = s_device->Evict(UINT(count), resources);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Evict failed: %ld\n", hRes);
+            return false;
+        }
+        return true;
+    }
+};
+
+static D3D12ResidencyDevice s_residencyDevice;
+static ResidencyManager<D3D12ResidencyDevice> s_residencyManager{ s_residencyDevice, RESIDENCY_TARGET_BUDGET_FRACTION };
+static UINT64 s_residencyBudgetLimit = 0;          // in bytes, set by `--residency-budget` to simulate a smaller budget; 0 for the budget of the OS
+static std::thread s_residencyThread;
+static HANDLE s_hResidencyStopEvent = nullptr;
+static HANDLE s_hBudgetChangeEvent = nullptr;
+static DWORD s_budgetChangeCookie = 0;
+static ResidencyHandle s_vertexBufferResidency = RESIDENCY_INVALID_HANDLE;
+static ResidencyHandle s_sceneRenderTargetResidency = RESIDENCY_INVALID_HANDLE;
+static ResidencyHandle s_depthTargetResidency = RESIDENCY_INVALID_HANDLE;
+static ResidencyHandle s_hiZTextureResidency = RESIDENCY_INVALID_HANDLE;
+
+static auto QueryResidencyBudget(ResidencyBudget& budget) -> bool
+{
+    DXGI_QUERY_VIDEO_MEMORY_INFO memoryInfo{ };
+    const HRESULT hRes = s_adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &memoryInfo);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "QueryVideoMemoryInfo failed: %ld\n", hRes);
+        return false;
+    }
+
+    budget = {
+        .budget = s_residencyBudgetLimit != 0 && s_residencyBudgetLimit < memoryInfo.Budget ? s_residencyBudgetLimit : memoryInfo.Budget,
+        .currentUsage = memoryInfo.CurrentUsage
+    };
+    return true;
+}
+
+static auto RegisterResidentResource(ID3D12Resource* resource) -> ResidencyHandle
+{
+    const D3D12_RESOURCE_DESC resourceDesc = resource->GetDesc();
+    const D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = s_device->GetResourceAllocationInfo(0, 1, &resourceDesc);
+    return s_residencyManager.Register(resource, allocationInfo.SizeInBytes);
+}
+
+// Polls the budget, and also wakes up when the OS changes it, so that the render thread never waits for evictions.
+static auto ResidencyThreadProc() -> void
+{
+    const HANDLE waitHandles[] = { s_hResidencyStopEvent, s_hBudgetChangeEvent };
+    while (true)
+    {
+        const DWORD waitResult = WaitForMultipleObjects((DWORD)std::size(waitHandles), waitHandles, FALSE, RESIDENCY_POLL_INTERVAL);
+        if (waitResult != WAIT_TIMEOUT && waitResult != WAIT_OBJECT_0 + 1) break;
+
+        ResidencyBudget budget{ };
+        if (!QueryResidencyBudget(budget)) break;
+
+        // The resources used by the frames in flight are not evicted.
+        s_residencyManager.Trim(budget, s_fence->GetCompletedValue());
+    }
+}
+
+static auto StartResidencyThread() -> bool
+{
+    if (s_adapter == nullptr) return true;
+
+    ResidencyBudget budget{ };
+    if (!QueryResidencyBudget(budget)) return false;
+    printf("Video memory budget: %.1f MB, current usage: %.1f MB\n", double(budget.budget) / (1024.0 * 1024.0), double(budget.currentUsage) / (1024.0 * 1024.0));
+
+    s_hResidencyStopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    s_hBudgetChangeEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (s_hResidencyStopEvent == nullptr || s_hBudgetChangeEvent == nullptr)
+    {
+        fprintf(stderr, "Create residency events failed: %lu\n", GetLastError());
+        return false;
+    }
+
+    const HRESULT hRes = s_adapter->RegisterVideoMemoryBudgetChangeNotificationEvent(s_hBudgetChangeEvent, &s_budgetChangeCookie);
+    if (FAILED(hRes))
+    {
+        printf("WARNING: RegisterVideoMemoryBudgetChangeNotificationEvent failed: %ld. The budget will only be polled.\n", hRes);
+        s_budgetChangeCookie = 0;
+    }
+
+    s_residencyThread = std::thread(ResidencyThreadProc);
+    return true;
+}
+
+static auto StopResidencyThread() -> void
+{
+    if (s_residencyThread.joinable())
+    {
+        SetEvent(s_hResidencyStopEvent);
+        s_residencyThread.join();
+    }
+    if (s_budgetChangeCookie != 0)
+    {
+        s_adapter->UnregisterVideoMemoryBudgetChangeNotification(s_budgetChangeCookie);
+        s_budgetChangeCookie = 0;
+    }
+    if (s_hBudgetChangeEvent != nullptr)
+    {
+        CloseHandle(s_hBudgetChangeEvent);
+        s_hBudgetChangeEvent = nullptr;
+    }
+    if (s_hResidencyStopEvent != nullptr)
+    {
+        CloseHandle(s_hResidencyStopEvent);
+        s_hResidencyStopEvent = nullptr;
+    }
+}
+
+// Page in whatever the basic frame uses and has been evicted, before the frame is recorded. It signals `s_fenceValue + 1`.
+static auto MakeBasicFrameResident() -> bool
+{
+    const UINT64 fenceValue = s_fenceValue + 1;
+    if (s_vertexBufferResidency != RESIDENCY_INVALID_HANDLE) {
+        s_residencyManager.MarkUsed(s_vertexBufferResidency, fenceValue);
+    }
+    if (s_dynamicResolutionEnabled && s_sceneRenderTargetResidency != RESIDENCY_INVALID_HANDLE) {
+        s_residencyManager.MarkUsed(s_sceneRenderTargetResidency, fenceValue);
+    }
+    if (s_depthTargetResidency != RESIDENCY_INVALID_HANDLE) {
+        s_residencyManager.MarkUsed(s_depthTargetResidency, fenceValue);
+    }
+    if (s_occlusionCullingEnabled && s_hiZTextureResidency != RESIDENCY_INVALID_HANDLE) {
+        s_residencyManager.MarkUsed(s_hiZTextureResidency, fenceValue);
+    }
+
+    return s_residencyManager.MakeUsedResident();
+}
+
+// ==== GPU profiling (GpuProfiler.h) ====
+// The queries of all the frame slots live in one timestamp heap and one pipeline statistics heap. They are resolved into
+// one readback buffer at the same indices: the timestamps first, and then the pipeline statistics.
+
+static_assert(sizeof(GpuPipelineStatistics) == sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS), "GpuPipelineStatistics must have the layout of D3D12_QUERY_DATA_PIPELINE_STATISTICS");
+
+struct D3D12GpuProfilerDevice
+{
+    using CommandList = ID3D12GraphicsCommandList*;
+
+    ID3D12QueryHeap* timestampQueryHeap;
+    ID3D12QueryHeap* statisticsQueryHeap;
+    ID3D12Resource* readbackBuffer;
+    UINT64 statisticsOffset;        // of the pipeline statistics in the readback buffer
+
+    auto WriteTimestamp(CommandList commandList, uint32_t queryIndex) -> void
+    {
+        commandList->EndQuery(timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, queryIndex);
+    }
+
+    auto BeginPipelineStatistics(CommandList commandList, uint32_t queryIndex) -> void
+    {
+        commandList->BeginQuery(statisticsQueryHeap, D3D12_QUERY_TYPE_PIPELINE_STATISTICS, queryIndex);
+    }
+
+    auto EndPipelineStatistics(CommandList commandList, uint32_t queryIndex) -> void
+    {
+        commandList->EndQuery(statisticsQueryHeap, D3D12_QUERY_TYPE_PIPELINE_STATISTICS, queryIndex);
+    }
+
+    auto BeginMarker(CommandList commandList, const char* name) -> void
+    {
+        commandList->BeginEvent(GPU_PROFILER_MARKER_METADATA, name, UINT(strlen(name) + 1));
+    }
+
+    auto EndMarker(CommandList commandList) -> void
+    {
+        commandList->EndEvent();
+    }
+
+    auto ResolveQueries(CommandList commandList, uint32_t firstTimestamp, uint32_t timestampCount, uint32_t firstStatistics, uint32_t statisticsCount) -> void
+    {
+        commandList->ResolveQueryData(timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, firstTimestamp, timestampCount,
+            readbackBuffer, UINT64(firstTimestamp) * sizeof(UINT64));
+        if (statisticsCount > 0)
+        {
+            commandList->ResolveQueryData(statisticsQueryHeap, D3D12_QUERY_TYPE_PIPELINE_STATISTICS, firstStatistics, statisticsCount,
+                readbackBuffer, statisticsOffset + UINT64(firstStatistics) * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS));
+        }
+    }
+
+    // Only the ranges of the slot are mapped, which the GPU has finished writing.
+    auto ReadQueries(uint32_t firstTimestamp, uint32_t timestampCount, uint64_t timestamps[],
+        uint32_t firstStatistics, uint32_t statisticsCount, GpuPipelineStatistics statistics[]) -> bool
+    {
+        const D3D12_RANGE writeRange{ 0, 0 };
+        const D3D12_RANGE timestampRange{ size_t(firstTimestamp) * sizeof(UINT64), size_t(firstTimestamp + timestampCount) * sizeof(UINT64) };
+        uint8_t* data = nullptr;
+        if (FAILED(readbackBuffer->Map(0, &timestampRange, (void**)&data))) return false;
+        memcpy(timestamps, data + timestampRange.Begin, timestampRange.End - timestampRange.Begin);
+        readbackBuffer->Unmap(0, &writeRange);
+
+        if (statisticsCount == 0) return true;
+
+        const D3D12_RANGE statisticsRange{ size_t(statisticsOffset) + size_t(firstStatistics) * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS),
+            size_t(statisticsOffset) + size_t(firstStatistics + statisticsCount) * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS) };
+        if (FAILED(readbackBuffer->Map(0, &statisticsRange, (void**)&data))) return false;
+        memcpy(statistics, data + statisticsRange.Begin, statisticsRange.End - statisticsRange.Begin);
+        readbackBuffer->Unmap(0, &writeRange);
+
+        return true;
+    }
+};
+
+static bool s_gpuProfilerEnabled = false;
+static D3D12GpuProfilerDevice s_gpuProfilerDevice{ };
+static GpuProfiler<D3D12GpuProfilerDevice>* s_gpuProfiler = nullptr;      // null unless `s_gpuProfilerEnabled`
+
+static auto CreateGpuProfiler() -> bool
+{
+    if (!s_gpuProfilerEnabled) return true;
+
+    UINT64 frequency = 0;
+    HRESULT hRes = s_commandQueue->GetTimestampFrequency(&frequency);
+    if (FAILED(hRes))
+    {
+        puts("WARNING: The command queue does not support timestamps. GPU profiling will be disabled!");
+        s_gpuProfilerEnabled = false;
+        return true;
+    }
+
+    const uint32_t timestampCount = GpuProfiler<D3D12GpuProfilerDevice>::GetTimestampQueryCount(GPU_PROFILER_FRAME_SLOT_COUNT, GPU_PROFILER_MAX_SCOPE_COUNT);
+    const uint32_t statisticsCount = GpuProfiler<D3D12GpuProfilerDevice>::GetStatisticsQueryCount(GPU_PROFILER_FRAME_SLOT_COUNT, GPU_PROFILER_MAX_SCOPE_COUNT);
+
+    const D3D12_QUERY_HEAP_DESC timestampHeapDesc{
+        .Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP,
+        .Count = timestampCount,
+        .NodeMask = 0
+    };
+    hRes = s_device->CreateQueryHeap(&timestampHeapDesc, IID_PPV_ARGS(&s_gpuProfilerDevice.timestampQueryHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateQueryHeap for the GPU profiler timestamps failed: %ld\n", hRes);
+        return false;
+    }
+
+    const D3D12_QUERY_HEAP_DESC statisticsHeapDesc{
+        .Type = D3D12_QUERY_HEAP_TYPE_PIPELINE_STATISTICS,
+        .Count = statisticsCount,
+        .NodeMask = 0
+    };
+    hRes = s_device->CreateQueryHeap(&statisticsHeapDesc, IID_PPV_ARGS(&s_gpuProfilerDevice.statisticsQueryHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateQueryHeap for the GPU profiler pipeline statistics failed: %ld\n", hRes);
+        return false;
+    }
+
+    s_gpuProfilerDevice.statisticsOffset = UINT64(timestampCount) * sizeof(UINT64);
+    const D3D12_HEAP_PROPERTIES readbackHeapProperties{
+        .Type = D3D12_HEAP_TYPE_READBACK,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC readbackDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = s_gpuProfilerDevice.statisticsOffset + UINT64(statisticsCount) * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS),
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    hRes = s_device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&s_gpuProfilerDevice.readbackBuffer));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for the GPU profiler readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    s_gpuProfiler = new GpuProfiler<D3D12GpuProfilerDevice>(s_gpuProfilerDevice, GPU_PROFILER_FRAME_SLOT_COUNT, GPU_PROFILER_MAX_SCOPE_COUNT, uint64_t(frequency));
+    return true;
+}
+
+static auto ReleaseGpuProfiler() -> void
+{
+    if (s_gpuProfiler != nullptr)
+    {
+        delete s_gpuProfiler;
+        s_gpuProfiler = nullptr;
+    }
+    if (s_gpuProfilerDevice.readbackBuffer != nullptr)
+    {
+        s_gpuProfilerDevice.readbackBuffer->Release();
+        s_gpuProfilerDevice.readbackBuffer = nullptr;
+    }
+    if (s_gpuProfilerDevice.statisticsQueryHeap != nullptr)
+    {
+        s_gpuProfilerDevice.statisticsQueryHeap->Release();
+        s_gpuProfilerDevice.statisticsQueryHeap = nullptr;
+    }
+    if (s_gpuProfilerDevice.timestampQueryHeap != nullptr)
+    {
+        s_gpuProfilerDevice.timestampQueryHeap->Release();
+        s_gpuProfilerDevice.timestampQueryHeap = nullptr;
+    }
+}
+
+static auto BeginGpuProfileScope(const char* name) -> void
+{
+    if (s_gpuProfiler != nullptr) {
+        s_gpuProfiler->BeginScope(s_basicCommandList, name);
+    }
+}
+
+static auto EndGpuProfileScope() -> void
+{
+    if (s_gpuProfiler != nullptr) {
+        s_gpuProfiler->EndScope(s_basicCommandList);
+    }
+}
+
+// Print the scope tree averaged over the frames read back since the last report.
+static auto ReportGpuProfile() -> void
+{
+    const GpuProfilerStats& stats = s_gpuProfiler->GetStats();
+    printf("GPU profile of %llu frames: %.3f ms per frame, %llu frames profiled, %llu dropped, %llu scopes over the capacity in all\n",
+        (unsigned long long)s_gpuProfiler->GetSummaryFrameCount(), s_gpuProfiler->GetSummaryFrameTime(), (unsigned long long)stats.profiledFrameCount,
+        (unsigned long long)stats.droppedFrameCount, (unsigned long long)stats.overflowScopeCount);
+    for (auto const& entry : s_gpuProfiler->GetSummary())
+    {
+        const double sampleCount = double(entry.sampleCount);
+        printf("  %*s%-*s %8.3f ms (%.3f - %.3f), %.0f vertices, %.0f primitives, %.0f pixel shader invocations\n", int(entry.depth * 2), "",
+            int(24 - entry.depth * 2), entry.name, entry.GetAverageTime(), entry.minTime, entry.maxTime, double(entry.totalStatistics.iaVertices) / sampleCount,
+            double(entry.totalStatistics.cPrimitives) / sampleCount, double(entry.totalStatistics.psInvocations) / sampleCount);
+    }
+    s_gpuProfiler->ResetSummary();
+}
+
+// ==== Direct3D 12 implementation of the rendering interface (RenderBackend.h) ====
+// Pipeline IDs are the basic shader permutation keys, and BASIC_ROOT_SIGNATURE_ID is `s_rootSignature`.
+
+static_assert(RENDER_RESOURCE_STATE_PRESENT == D3D12_RESOURCE_STATE_PRESENT && RENDER_RESOURCE_STATE_RENDER_TARGET == D3D12_RESOURCE_STATE_RENDER_TARGET &&
+    RENDER_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER == D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER &&
+    RENDER_RESOURCE_STATE_DEPTH_WRITE == D3D12_RESOURCE_STATE_DEPTH_WRITE &&
+    RENDER_RESOURCE_STATE_PIXEL_SHADER_RESOURCE == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, "Render resource states must have the values of D3D12_RESOURCE_STATES");
+static_assert(RENDER_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP == D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP && RENDER_FORMAT_R8G8B8A8_UNORM == DXGI_FORMAT_R8G8B8A8_UNORM &&
+    RENDER_FORMAT_R16_UINT == DXGI_FORMAT_R16_UINT && RENDER_FORMAT_R32_UINT == DXGI_FORMAT_R32_UINT && RENDER_FORMAT_D32_FLOAT == DXGI_FORMAT_D32_FLOAT,
+    "Render topologies and formats must have the values of Direct3D 12");
+
+static_assert(RENDER_LOAD_OP_DISCARD == D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_DISCARD && RENDER_LOAD_OP_PRESERVE == D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE &&
+    RENDER_LOAD_OP_CLEAR == D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR && RENDER_STORE_OP_DISCARD == D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_DISCARD &&
+    RENDER_STORE_OP_PRESERVE == D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE, "Render pass load and store ops must have the values of Direct3D 12");
+
+// Render pass being recorded into a command list
+struct D3D12RenderPass
+{
+    ComHandle<ID3D12GraphicsCommandList4> commandList4;     // null on the legacy path
+    ID3D12Resource* renderTarget;
+    uint32_t storeOp;
+    ID3D12Resource* depthTarget;                            // null for a pass without depth
+    uint32_t depthStoreOp;
+};
+
+// Begin the render pass with native load and store ops if `s_renderPassesEnabled`. Otherwise, bind the targets and apply
+// the load ops with clears or discards. Returns the attachment traffic the native pass avoids on a tile-based GPU.
+// A partial clear cannot be expressed by a load op, so the target is cleared before the pass and preserved.
+// `depthTarget` is null for a pass without depth; it has no stencil.
+static auto BeginD3D12RenderPass(ID3D12GraphicsCommandList* commandList, ID3D12Resource* renderTarget, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle,
+    ID3D12Resource* depthTarget, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle, const RenderPassDesc& desc, D3D12RenderPass& pass) -> UINT64
+{
+    pass.renderTarget = renderTarget;
+    pass.storeOp = desc.storeOp;
+    pass.depthTarget = depthTarget;
+    pass.depthStoreOp = desc.depthStoreOp;
+    pass.commandList4.Reset();
+
+    const D3D12_RECT clearRect = desc.clearRect != nullptr ?
+        D3D12_RECT{ LONG(desc.clearRect->left), LONG(desc.clearRect->top), LONG(desc.clearRect->right), LONG(desc.clearRect->bottom) } : D3D12_RECT{ };
+    const bool partialClear = desc.loadOp == RENDER_LOAD_OP_CLEAR && desc.clearRect != nullptr;
+
+    if (s_renderPassesEnabled && SUCCEEDED(commandList->QueryInterface(IID_PPV_ARGS(pass.commandList4.ReleaseAndGetAddressOf()))))
+    {
+        if (partialClear) {
+            commandList->ClearRenderTargetView(rtvHandle, desc.clearColor, 1, &clearRect);
+        }
+
+        const D3D12_RESOURCE_DESC targetDesc = renderTarget->GetDesc();
+        D3D12_RENDER_PASS_BEGINNING_ACCESS beginningAccess{
+            .Type = partialClear ? D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE : D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE(desc.loadOp),
+            .Clear { .ClearValue { .Format = targetDesc.Format } }
+        };
+        memcpy(beginningAccess.Clear.ClearValue.Color, desc.clearColor, sizeof(beginningAccess.Clear.ClearValue.Color));
+        const D3D12_RENDER_PASS_RENDER_TARGET_DESC renderTargetDesc{
+            .cpuDescriptor = rtvHandle,
+            .BeginningAccess = beginningAccess,
+            .EndingAccess { .Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE(desc.storeOp) }
+        };
+        D3D12_RENDER_PASS_DEPTH_STENCIL_DESC depthStencilDesc{ };
+        UINT64 depthSize = 0;
+        if (depthTarget != nullptr)
+        {
+            depthStencilDesc = D3D12_RENDER_PASS_DEPTH_STENCIL_DESC{
+                .cpuDescriptor = dsvHandle,
+                .DepthBeginningAccess {
+                    .Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE(desc.depthLoadOp),
+                    .Clear { .ClearValue { .Format = DXGI_FORMAT_D32_FLOAT, .DepthStencil { .Depth = desc.clearDepth, .Stencil = 0 } } }
+                },
+                .StencilBeginningAccess { .Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_NO_ACCESS },
+                .DepthEndingAccess { .Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE(desc.depthStoreOp) },
+                .StencilEndingAccess { .Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_NO_ACCESS }
+            };
+            const D3D12_RESOURCE_DESC depthDesc = depthTarget->GetDesc();
+            depthSize = depthDesc.Width * depthDesc.Height * 4;
+        }
+        pass.commandList4->BeginRenderPass(1, &renderTargetDesc, depthTarget != nullptr ? &depthStencilDesc : nullptr, D3D12_RENDER_PASS_FLAG_NONE);
+
+        // All the render and depth targets have 32 bits per pixel.
+        return GetRenderPassAvoidedBytes(desc, targetDesc.Width * targetDesc.Height * 4, depthSize);
+    }
+
+    commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, depthTarget != nullptr ? &dsvHandle : nullptr);
+    if (desc.loadOp == RENDER_LOAD_OP_CLEAR) {
+        commandList->ClearRenderTargetView(rtvHandle, desc.clearColor, partialClear ? 1 : 0, partialClear ? &clearRect : nullptr);
+    }
+    else if (desc.loadOp == RENDER_LOAD_OP_DISCARD) {
+        commandList->DiscardResource(renderTarget, nullptr);
+    }
+    if (depthTarget != nullptr && desc.depthLoadOp == RENDER_LOAD_OP_CLEAR) {
+        commandList->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, desc.clearDepth, 0, 0, nullptr);
+    }
+    else if (depthTarget != nullptr && desc.depthLoadOp == RENDER_LOAD_OP_DISCARD) {
+        commandList->DiscardResource(depthTarget, nullptr);
+    }
+    return 0;
+}
+
+static auto EndD3D12RenderPass(ID3D12GraphicsCommandList* commandList, D3D12RenderPass& pass) -> void
+{
+    if (pass.commandList4)
+    {
+        pass.commandList4->EndRenderPass();
+        pass.commandList4.Reset();
+    }
+    else
+    {
+        if (pass.storeOp == RENDER_STORE_OP_DISCARD) {
+            commandList->DiscardResource(pass.renderTarget, nullptr);
+        }
+        if (pass.depthTarget != nullptr && pass.depthStoreOp == RENDER_STORE_OP_DISCARD) {
+            commandList->DiscardResource(pass.depthTarget, nullptr);
+        }
+    }
+}
+
+// The depth-only PSOs are selected with BASIC_DEPTH_ONLY_PIPELINE_FLAG.
+static auto GetBasicPipelineState(uint32_t pipelineId) -> ID3D12PipelineState*
+{
+    const uint32_t permutationKey = pipelineId & ~BASIC_DEPTH_ONLY_PIPELINE_FLAG;
+    if (permutationKey >= BASIC_SHADER_PERMUTATION_KEY_COUNT) return nullptr;
+
+    return (pipelineId & BASIC_DEPTH_ONLY_PIPELINE_FLAG) != 0 ? s_basicPipelineStateSet.depthOnlyPipelineStates[permutationKey] :
+        s_basicPipelineStateSet.pipelineStates[permutationKey];
+}
+
+struct D3D12RenderResource
+{
+    ID3D12Resource* resource;
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle;     // null for buffers and depth targets
+    D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle;     // null except for depth targets
+    bool owned;                                 // created by the render device rather than registered
+};
+
+// The native objects are released with the wrapper if it owns them.
+class D3D12RenderCommandList final : public RenderCommandList
+{
+public:
+    D3D12RenderCommandList(RenderCallStats& stats, const std::vector<D3D12RenderResource>& resources, ID3D12CommandAllocator* commandAllocator,
+        ID3D12GraphicsCommandList* commandList, RenderCommandListType type, bool owned) :
+        m_stats(stats), m_resources(resources), m_commandAllocator(commandAllocator), m_commandList(commandList), m_type(type), m_owned(owned)
+    {
+    }
+
+    ~D3D12RenderCommandList() override
+    {
+        if (m_owned)
+        {
+            m_commandList->Release();
+            m_commandAllocator->Release();
+        }
+    }
+
+    auto GetNative() const -> ID3D12GraphicsCommandList* { return m_commandList; }
+
+    // Switch to another pair of native objects, e.g. a command list from `s_commandListPool`. The wrapper must not own them.
+    auto Bind(ID3D12CommandAllocator* commandAllocator, ID3D12GraphicsCommandList* commandList) -> void
+    {
+        m_commandAllocator = commandAllocator;
+        m_commandList = commandList;
+    }
+
+    auto GetType() const -> RenderCommandListType override { return m_type; }
+
+    // The GPU must have finished with the command list, because the allocator is reset as well.
+    auto Reset(uint32_t pipelineId) -> bool override
+    {
+        m_stats.Add(RenderCall::RESET);
+
+        HRESULT hRes = m_commandAllocator->Reset();
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Reset command allocator failed: %ld\n", hRes);
+            return false;
+        }
+
+        hRes = m_commandList->Reset(m_commandAllocator, GetBasicPipelineState(pipelineId));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Reset command list failed: %ld\n", hRes);
+            return false;
+        }
+        return true;
+    }
+
+    auto Close() -> bool override
+    {
+        m_stats.Add(RenderCall::CLOSE);
+
+        const HRESULT hRes = m_commandList->Close();
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Close command list failed: %ld\n", hRes);
+            return false;
+        }
+        return true;
+    }
+
+    auto SetPipelineState(uint32_t pipelineId) -> void override
+    {
+        m_stats.Add(RenderCall::SET_PIPELINE_STATE);
+        m_commandList->SetPipelineState(GetBasicPipelineState(pipelineId));
+    }
+
+    auto SetGraphicsRootSignature(uint32_t rootSignatureId) -> void override
+    {
+        m_stats.Add(RenderCall::SET_GRAPHICS_ROOT_SIGNATURE);
+        (void)rootSignatureId;
+        m_commandList->SetGraphicsRootSignature(s_rootSignature);
+    }
+
+    auto SetGraphicsRoot32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t destOffset) -> void override
+    {
+        m_stats.Add(RenderCall::SET_GRAPHICS_ROOT_32BIT_CONSTANT);
+        m_commandList->SetGraphicsRoot32BitConstant(rootParameterIndex, value, destOffset);
+    }
+
+    auto SetViewport(const RenderViewport& viewport) -> void override
+    {
+        m_stats.Add(RenderCall::SET_VIEWPORT);
+
+        const D3D12_VIEWPORT viewPort{
+            .TopLeftX = viewport.topLeftX,
+            .TopLeftY = viewport.topLeftY,
+            .Width = viewport.width,
+            .Height = viewport.height,
+            .MinDepth = viewport.minDepth,
+            .MaxDepth = viewport.maxDepth
+        };
+        m_commandList->RSSetViewports(1, &viewPort);
+    }
+
+    auto SetScissorRect(const RenderRect& rect) -> void override
+    {
+        m_stats.Add(RenderCall::SET_SCISSOR_RECT);
+
+        const D3D12_RECT scissorRect{ LONG(rect.left), LONG(rect.top), LONG(rect.right), LONG(rect.bottom) };
+        m_commandList->RSSetScissorRects(1, &scissorRect);
+    }
+
+    auto SetRenderTarget(RenderResourceId renderTarget) -> void override
+    {
+        m_stats.Add(RenderCall::SET_RENDER_TARGET);
+        m_commandList->OMSetRenderTargets(1, &m_resources[renderTarget].rtvHandle, FALSE, nullptr);
+    }
+
+    auto ClearRenderTarget(RenderResourceId renderTarget, const float color[4], const RenderRect* rect) -> void override
+    {
+        m_stats.Add(RenderCall::CLEAR_RENDER_TARGET);
+
+        const D3D12_RECT clearRect = rect != nullptr ? D3D12_RECT{ LONG(rect->left), LONG(rect->top), LONG(rect->right), LONG(rect->bottom) } : D3D12_RECT{ };
+        m_commandList->ClearRenderTargetView(m_resources[renderTarget].rtvHandle, color, rect != nullptr ? 1 : 0, rect != nullptr ? &clearRect : nullptr);
+    }
+
+    auto SetPrimitiveTopology(uint32_t topology) -> void override
+    {
+        m_stats.Add(RenderCall::SET_PRIMITIVE_TOPOLOGY);
+        m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY(topology));
+    }
+
+    auto SetVertexBuffer(uint32_t slot, RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t stride) -> void override
+    {
+        m_stats.Add(RenderCall::SET_VERTEX_BUFFER);
+
+        const D3D12_VERTEX_BUFFER_VIEW vertexBufferView{
+            .BufferLocation = m_resources[buffer].resource->GetGPUVirtualAddress() + offset,
+            .SizeInBytes = size,
+            .StrideInBytes = stride
+        };
+        m_commandList->IASetVertexBuffers(slot, 1, &vertexBufferView);
+    }
+
+    auto DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance) -> void override
+    {
+        m_stats.Add(RenderCall::DRAW_INSTANCED);
+        m_commandList->DrawInstanced(vertexCountPerInstance, instanceCount, startVertex, startInstance);
+    }
+
+    auto ResourceBarrier(RenderResourceId resource, uint32_t stateBefore, uint32_t stateAfter) -> void override
+    {
+        m_stats.Add(RenderCall::RESOURCE_BARRIER);
+
+        const D3D12_RESOURCE_BARRIER barrier{
+            .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+            .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+            .Transition {
+                .pResource = m_resources[resource].resource,
+                .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+                .StateBefore = D3D12_RESOURCE_STATES(stateBefore),
+                .StateAfter = D3D12_RESOURCE_STATES(stateAfter)
+            }
+        };
+        m_commandList->ResourceBarrier(1, &barrier);
+    }
+
+    auto SetIndexBuffer(RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t format) -> void override
+    {
+        m_stats.Add(RenderCall::SET_INDEX_BUFFER);
+
+        const D3D12_INDEX_BUFFER_VIEW indexBufferView{
+            .BufferLocation = m_resources[buffer].resource->GetGPUVirtualAddress() + offset,
+            .SizeInBytes = size,
+            .Format = DXGI_FORMAT(format)
+        };
+        m_commandList->IASetIndexBuffer(&indexBufferView);
+    }
+
+    auto DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) -> void override
+    {
+        m_stats.Add(RenderCall::DRAW_INDEXED_INSTANCED);
+        m_commandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+    }
+
+    auto ExecuteBundle(RenderCommandList& bundle) -> void override
+    {
+        m_stats.Add(RenderCall::EXECUTE_BUNDLE);
+        m_commandList->ExecuteBundle(static_cast<D3D12RenderCommandList&>(bundle).m_commandList);
+    }
+
+    auto BeginRenderPass(const RenderPassDesc& desc) -> void override
+    {
+        m_stats.Add(RenderCall::BEGIN_RENDER_PASS);
+
+        const D3D12RenderResource& renderTarget = m_resources[desc.renderTarget];
+        const D3D12RenderResource* depthTarget = desc.depthTarget != RENDER_INVALID_RESOURCE ? &m_resources[desc.depthTarget] : nullptr;
+        m_stats.renderPassAvoidedBytes += BeginD3D12RenderPass(m_commandList, renderTarget.resource, renderTarget.rtvHandle,
+            depthTarget != nullptr ? depthTarget->resource : nullptr, depthTarget != nullptr ? depthTarget->dsvHandle : D3D12_CPU_DESCRIPTOR_HANDLE{ },
+            desc, m_renderPass);
+    }
+
+    auto EndRenderPass() -> void override
+    {
+        m_stats.Add(RenderCall::END_RENDER_PASS);
+        EndD3D12RenderPass(m_commandList, m_renderPass);
+    }
+
+private:
+    RenderCallStats& m_stats;
+    const std::vector<D3D12RenderResource>& m_resources;
+    ID3D12CommandAllocator* m_commandAllocator;
+    ID3D12GraphicsCommandList* m_commandList;
+    RenderCommandListType m_type;
+    bool m_owned;
+    D3D12RenderPass m_renderPass{ };
+};
+
+class D3D12RenderFence final : public RenderFence
+{
+public:
+    D3D12RenderFence(RenderCallStats& stats, ID3D12Fence* fence, HANDLE hEvent, bool owned) :
+        m_stats(stats), m_fence(fence), m_hEvent(hEvent), m_owned(owned)
+    {
+    }
+
+    ~D3D12RenderFence() override
+    {
+        if (m_owned)
+        {
+            CloseHandle(m_hEvent);
+            m_fence->Release();
+        }
+    }
+
+    auto GetNative() const -> ID3D12Fence* { return m_fence; }
+
+    auto GetCompletedValue() const -> uint64_t override { return m_fence->GetCompletedValue(); }
+
+    auto Wait(uint64_t value) -> bool override
+    {
+        m_stats.Add(RenderCall::WAIT_FOR_FENCE);
+
+        if (m_fence->GetCompletedValue() < value)
+        {
+            const HRESULT hRes = m_fence->SetEventOnCompletion(value, m_hEvent);
+            if (FAILED(hRes))
+            {
+                fprintf(stderr, "SetEventOnCompletion failed: %ld\n", hRes);
+                return false;
+            }
+
+            WaitForSingleObject(m_hEvent, INFINITE);
+        }
+        return true;
+    }
+
+private:
+    RenderCallStats& m_stats;
+    ID3D12Fence* m_fence;
+    HANDLE m_hEvent;
+    bool m_owned;
+};
+
+class D3D12RenderCommandQueue final : public RenderCommandQueue
+{
+public:
+    // `swapChain` is null for queues that do not present.
+    D3D12RenderCommandQueue(RenderCallStats& stats, ID3D12CommandQueue* commandQueue, IDXGISwapChain3* swapChain, bool owned) :
+        m_stats(stats), m_commandQueue(commandQueue), m_swapChain(swapChain), m_owned(owned)
+    {
+    }
+
+    ~D3D12RenderCommandQueue() override
+    {
+        if (m_owned) {
+            m_commandQueue->Release();
+        }
+    }
+
+    auto ExecuteCommandList(RenderCommandList& commandList) -> bool override
+    {
+        m_stats.Add(RenderCall::EXECUTE_COMMAND_LIST);
+
+        ID3D12CommandList* const ppCommandLists[] = { static_cast<D3D12RenderCommandList&>(commandList).GetNative() };
+        m_commandQueue->ExecuteCommandLists((UINT)std::size(ppCommandLists), ppCommandLists);
+        return true;
+    }
+
+    auto Signal(RenderFence& fence, uint64_t value) -> bool override
+    {
+        m_stats.Add(RenderCall::SIGNAL);
+
+        const HRESULT hRes = m_commandQueue->Signal(static_cast<D3D12RenderFence&>(fence).GetNative(), value);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Signal failed: %ld\n", hRes);
+            return false;
+        }
+        return true;
+    }
+
+    auto Present() -> bool override
+    {
+        m_stats.Add(RenderCall::PRESENT);
+
+        if (m_swapChain == nullptr)
+        {
+            fprintf(stderr, "Present failed: no swap chain is attached to the command queue\n");
+            return false;
+        }
+
+        const HRESULT hRes = m_swapChain->Present(1, 0);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Present failed: %ld\n", hRes);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    RenderCallStats& m_stats;
+    ID3D12CommandQueue* m_commandQueue;
+    IDXGISwapChain3* m_swapChain;
+    bool m_owned;
+};
+
+// The application creates its objects directly and wraps them with the `Register` and `Wrap` methods;
+// those stay owned by the application. The objects created through the interface are owned by the device.
+class D3D12RenderDevice final : public RenderDevice
+{
+public:
+    ~D3D12RenderDevice() override { Release(); }
+
+    auto RegisterResource(ID3D12Resource* resource, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle) -> RenderResourceId
+    {
+        m_resources.push_back(D3D12RenderResource{ .resource = resource, .rtvHandle = rtvHandle, .dsvHandle { }, .owned = false });
+        return RenderResourceId(m_resources.size() - 1);
+    }
+
+    auto GetResource(RenderResourceId resource) const -> ID3D12Resource* { return m_resources[resource].resource; }
+    auto GetRtvHandle(RenderResourceId resource) const -> D3D12_CPU_DESCRIPTOR_HANDLE { return m_resources[resource].rtvHandle; }
+    auto GetDsvHandle(RenderResourceId resource) const -> D3D12_CPU_DESCRIPTOR_HANDLE { return m_resources[resource].dsvHandle; }
+
+    auto WrapCommandQueue(ID3D12CommandQueue* commandQueue, IDXGISwapChain3* swapChain) -> RenderCommandQueue*
+    {
+        m_commandQueues.push_back(std::make_unique<D3D12RenderCommandQueue>(m_stats, commandQueue, swapChain, false));
+        return m_commandQueues.back().get();
+    }
+
+    // The command list must be closed.
+    auto WrapCommandList(ID3D12CommandAllocator* commandAllocator, ID3D12GraphicsCommandList* commandList, RenderCommandListType type) -> D3D12RenderCommandList*
+    {
+        m_commandLists.push_back(std::make_unique<D3D12RenderCommandList>(m_stats, m_resources, commandAllocator, commandList, type, false));
+        return m_commandLists.back().get();
+    }
+
+    auto WrapFence(ID3D12Fence* fence, HANDLE hEvent) -> RenderFence*
+    {
+        m_fences.push_back(std::make_unique<D3D12RenderFence>(m_stats, fence, hEvent, false));
+        return m_fences.back().get();
+    }
+
+    auto CreateBuffer(const void* data, size_t size, uint32_t initialState) -> RenderResourceId override
+    {
+        m_stats.Add(RenderCall::CREATE_BUFFER);
+
+        ID3D12Resource* buffer = nullptr;
+        if (!CreateBufferWithData(s_bufferHeapPolicy, data, size, D3D12_RESOURCE_STATES(initialState), &buffer)) return RENDER_INVALID_RESOURCE;
+
+        m_resources.push_back(D3D12RenderResource{ .resource = buffer, .rtvHandle { }, .dsvHandle { }, .owned = true });
+        return RenderResourceId(m_resources.size() - 1);
+    }
+
+    auto CreateRenderTarget(uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> RenderResourceId override
+    {
+        m_stats.Add(RenderCall::CREATE_RENDER_TARGET);
+
+        if (m_rtvDescriptorHeap == nullptr)
+        {
+            const D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{
+                .Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
+                .NumDescriptors = RENDER_BACKEND_RTV_CAPACITY,
+                .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+                .NodeMask = 0
+            };
+            const HRESULT hRes = s_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&m_rtvDescriptorHeap));
+            if (FAILED(hRes))
+            {
+                fprintf(stderr, "CreateDescriptorHeap for render backend failed: %ld\n", hRes);
+                return RENDER_INVALID_RESOURCE;
+            }
+        }
+        if (m_rtvCount == RENDER_BACKEND_RTV_CAPACITY)
+        {
+            fprintf(stderr, "Render backend is out of render target views\n");
+            return RENDER_INVALID_RESOURCE;
+        }
+
+        const D3D12_HEAP_PROPERTIES heapProperties{
+            .Type = D3D12_HEAP_TYPE_DEFAULT,
+            .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+            .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+            .CreationNodeMask = 1,
+            .VisibleNodeMask = 1
+        };
+        const D3D12_RESOURCE_DESC resourceDesc{
+            .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+            .Alignment = 0,
+            .Width = UINT64(width),
+            .Height = UINT(height),
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT(format),
+            .SampleDesc { .Count = 1, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+            .Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+        };
+        D3D12_CLEAR_VALUE clearValue{ .Format = DXGI_FORMAT(format) };
+        memcpy(clearValue.Color, BASIC_CLEAR_COLOR, sizeof(clearValue.Color));
+
+        ID3D12Resource* renderTarget = nullptr;
+        const HRESULT hRes = s_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATES(initialState),
+            &clearValue, IID_PPV_ARGS(&renderTarget));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for render backend render target failed: %ld\n", hRes);
+            return RENDER_INVALID_RESOURCE;
+        }
+
+        D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+        rtvHandle.ptr += size_t(m_rtvCount++) * s_rtvDescriptorSize;
+        s_device->CreateRenderTargetView(renderTarget, nullptr, rtvHandle);
+
+        m_resources.push_back(D3D12RenderResource{ .resource = renderTarget, .rtvHandle = rtvHandle, .dsvHandle { }, .owned = true });
+        return RenderResourceId(m_resources.size() - 1);
+    }
+
+    // The resource is typeless, so that the depth can also be read through an R32_FLOAT SRV, e.g. to build the Hi-Z pyramid.
+    auto CreateDepthTarget(uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> RenderResourceId override
+    {
+        m_stats.Add(RenderCall::CREATE_DEPTH_TARGET);
+
+        if (format != RENDER_FORMAT_D32_FLOAT)
+        {
+            fprintf(stderr, "Render backend does not support depth format %u\n", format);
+            return RENDER_INVALID_RESOURCE;
+        }
+        if (m_dsvDescriptorHeap == nullptr)
+        {
+            const D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc{
+                .Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV,
+                .NumDescriptors = RENDER_BACKEND_DSV_CAPACITY,
+                .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+                .NodeMask = 0
+            };
+            const HRESULT hRes = s_device->CreateDescriptorHeap(&dsvHeapDesc, IID_PPV_ARGS(&m_dsvDescriptorHeap));
+            if (FAILED(hRes))
+            {
+                fprintf(stderr, "CreateDescriptorHeap for render backend depth targets failed: %ld\n", hRes);
+                return RENDER_INVALID_RESOURCE;
+            }
+        }
+        if (m_dsvCount == RENDER_BACKEND_DSV_CAPACITY)
+        {
+            fprintf(stderr, "Render backend is out of depth stencil views\n");
+            return RENDER_INVALID_RESOURCE;
+        }
+
+        const D3D12_HEAP_PROPERTIES heapProperties{
+            .Type = D3D12_HEAP_TYPE_DEFAULT,
+            .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+            .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+            .CreationNodeMask = 1,
+            .VisibleNodeMask = 1
+        };
+        const D3D12_RESOURCE_DESC resourceDesc{
+            .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+            .Alignment = 0,
+            .Width = UINT64(width),
+            .Height = UINT(height),
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT_R32_TYPELESS,
+            .SampleDesc { .Count = 1, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+            .Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL
+        };
+        const D3D12_CLEAR_VALUE clearValue{ .Format = DXGI_FORMAT_D32_FLOAT, .DepthStencil { .Depth = BASIC_CLEAR_DEPTH, .Stencil = 0 } };
+
+        ID3D12Resource* depthTarget = nullptr;
+        const HRESULT hRes = s_device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATES(initialState),
+            &clearValue, IID_PPV_ARGS(&depthTarget));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for render backend depth target failed: %ld\n", hRes);
+            return RENDER_INVALID_RESOURCE;
+        }
+
+        const D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc{
+            .Format = DXGI_FORMAT_D32_FLOAT,
+            .ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D,
+            .Flags = D3D12_DSV_FLAG_NONE,
+            .Texture2D { .MipSlice = 0 }
+        };
+        D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+        dsvHandle.ptr += size_t(m_dsvCount++) * s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
+        s_device->CreateDepthStencilView(depthTarget, &dsvDesc, dsvHandle);
+
+        m_resources.push_back(D3D12RenderResource{ .resource = depthTarget, .rtvHandle { }, .dsvHandle = dsvHandle, .owned = true });
+        return RenderResourceId(m_resources.size() - 1);
+    }
+
+    auto CreateCommandQueue() -> RenderCommandQueue* override
+    {
+        m_stats.Add(RenderCall::CREATE_COMMAND_QUEUE);
+
+        const D3D12_COMMAND_QUEUE_DESC queueDesc{
+            .Type = D3D12_COMMAND_LIST_TYPE_DIRECT,
+            .Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL,
+            .Flags = D3D12_COMMAND_QUEUE_FLAG_NONE,
+            .NodeMask = 0
+        };
+        ID3D12CommandQueue* commandQueue = nullptr;
+        const HRESULT hRes = s_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommandQueue for render backend failed: %ld\n", hRes);
+            return nullptr;
+        }
+
+        m_commandQueues.push_back(std::make_unique<D3D12RenderCommandQueue>(m_stats, commandQueue, nullptr, true));
+        return m_commandQueues.back().get();
+    }
+
+    auto CreateCommandList(RenderCommandListType type) -> RenderCommandList* override
+    {
+        m_stats.Add(RenderCall::CREATE_COMMAND_LIST);
+
+        const D3D12_COMMAND_LIST_TYPE listType = type == RenderCommandListType::BUNDLE ? D3D12_COMMAND_LIST_TYPE_BUNDLE : D3D12_COMMAND_LIST_TYPE_DIRECT;
+        ID3D12CommandAllocator* commandAllocator = nullptr;
+        ID3D12GraphicsCommandList* commandList = nullptr;
+
+        HRESULT hRes = s_device->CreateCommandAllocator(listType, IID_PPV_ARGS(&commandAllocator));
+        if (SUCCEEDED(hRes)) {
+            hRes = s_device->CreateCommandList(0, listType, commandAllocator, nullptr, IID_PPV_ARGS(&commandList));
+        }
+        if (SUCCEEDED(hRes)) {
+            hRes = commandList->Close();
+        }
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Create command list for render backend failed: %ld\n", hRes);
+            if (commandList != nullptr) {
+                commandList->Release();
+            }
+            if (commandAllocator != nullptr) {
+                commandAllocator->Release();
+            }
+            return nullptr;
+        }
+
+        m_commandLists.push_back(std::make_unique<D3D12RenderCommandList>(m_stats, m_resources, commandAllocator, commandList, type, true));
+        return m_commandLists.back().get();
+    }
+
+    auto CreateFence(uint64_t initialValue) -> RenderFence* override
+    {
+        m_stats.Add(RenderCall::CREATE_FENCE);
+
+        ID3D12Fence* fence = nullptr;
+        const HRESULT hRes = s_device->CreateFence(initialValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateFence for render backend failed: %ld\n", hRes);
+            return nullptr;
+        }
+
+        const HANDLE hEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+        if (hEvent == nullptr)
+        {
+            fprintf(stderr, "CreateEvent for render backend failed: %lu\n", GetLastError());
+            fence->Release();
+            return nullptr;
+        }
+
+        m_fences.push_back(std::make_unique<D3D12RenderFence>(m_stats, fence, hEvent, true));
+        return m_fences.back().get();
+    }
+
+    // The GPU must be idle.
+    auto Release() -> void
+    {
+        m_commandLists.clear();
+        m_commandQueues.clear();
+        m_fences.clear();
+
+        for (auto& resource : m_resources)
+        {
+            if (resource.owned) {
+                resource.resource->Release();
+            }
+        }
+        m_resources.clear();
+
+        if (m_rtvDescriptorHeap != nullptr)
+        {
+            m_rtvDescriptorHeap->Release();
+            m_rtvDescriptorHeap = nullptr;
+        }
+        m_rtvCount = 0;
+
+        if (m_dsvDescriptorHeap != nullptr)
+        {
+            m_dsvDescriptorHeap->Release();
+            m_dsvDescriptorHeap = nullptr;
+        }
+        m_dsvCount = 0;
+    }
+
+private:
+    std::vector<D3D12RenderResource> m_resources;
+    std::vector<std::unique_ptr<D3D12RenderCommandQueue>> m_commandQueues;
+    std::vector<std::unique_ptr<D3D12RenderCommandList>> m_commandLists;
+    std::vector<std::unique_ptr<D3D12RenderFence>> m_fences;
+    ID3D12DescriptorHeap* m_rtvDescriptorHeap = nullptr;   // for the render targets created through the interface
+    UINT m_rtvCount = 0;
+    ID3D12DescriptorHeap* m_dsvDescriptorHeap = nullptr;   // for the depth targets created through the interface
+    UINT m_dsvCount = 0;
+};
+
+// The basic frame is recorded and submitted through these wrappers of `s_commandQueue`, `s_basicCommandList`,
+// `s_basicCommandBundle` and `s_fence`. `s_basicRenderCommandList` is bound to the command list acquired for each frame.
+// The bundle executed by the frame comes from `s_bundleCache`; `s_basicRenderBundle` is only recorded while capturing.
+static D3D12RenderDevice s_renderDevice;
+static RenderCommandQueue* s_renderCommandQueue = nullptr;
+static D3D12RenderCommandList* s_basicRenderCommandList = nullptr;
+static RenderCommandList* s_basicRenderBundle = nullptr;
+static RenderFence* s_renderFence = nullptr;
+static BundleCache* s_bundleCache = nullptr;
+static RenderResourceId s_backBufferIds[TOTAL_FRAME_COUNT]{ };
+static RenderResourceId s_vertexBufferId = RENDER_INVALID_RESOURCE;
+static RenderResourceId s_sceneRenderTargetId = RENDER_INVALID_RESOURCE;
+
+// While capturing, the basic command list and bundle are recorded through these, which also write to `s_commandCaptureWriter`.
+static std::vector<uint32_t> s_captureResourceIds;      // capture resource ID of each render resource ID
+static CaptureRenderCommandList* s_captureCommandList = nullptr;
+static CaptureRenderCommandList* s_captureBundle = nullptr;
+
+// Per-frame CPU cost of recording the basic frame and the calls made through the rendering interface, reported with `--backend-stats`
+static bool s_renderStatsEnabled = false;
+static double s_renderStatsRecordTime = 0.0;     // in milliseconds, since the last report
+static RenderCallStats s_renderStatsLastReport{ };
+static BundleCacheStats s_bundleCacheStatsLastReport{ };
+
+// With `--draw-packets`, the squares are drawn from sort keyed packets with the redundant state calls filtered out, instead of the bundles.
+static bool s_drawPacketsEnabled = false;
+static DrawPacketQueue s_drawPacketQueue;
+static DrawStateFilter s_drawStateFilter;
+
+static auto GetBasicRenderCommandList() -> RenderCommandList&
+{
+    return s_captureCommandList != nullptr && s_commandCaptureActive ? *s_captureCommandList : *s_basicRenderCommandList;
+}
+
+static auto GetBasicBundleDesc() -> BasicBundleDesc
+{
+    return BasicBundleDesc{
+        .pipelineId = s_basicShaderPermutation,
+        .vertexBuffer = s_vertexBufferId,
+        .vertexBufferSize = s_vertexBufferView.SizeInBytes,
+        .vertexStride = s_vertexBufferView.StrideInBytes,
+        .vertexCount = s_vertexCount
+    };
+}
+
+// Return the bundle for the frame being recorded, which will signal `s_fenceValue + 1`, or null if it cannot be recorded.
+static auto GetBasicRenderBundle() -> RenderCommandList*
+{
+    if (s_captureBundle != nullptr && s_commandCaptureActive) return s_captureBundle;
+
+    return s_bundleCache->GetBundle(GetBasicBundleDrawKey(GetBasicBundleDesc()), s_renderFence->GetCompletedValue(), s_fenceValue + 1);
+}
+
+// The depth-only bundle of the depth prepass, which is never captured
+static auto GetBasicPrepassBundle() -> RenderCommandList*
+{
+    BasicBundleDesc desc = GetBasicBundleDesc();
+    desc.pipelineId |= BASIC_DEPTH_ONLY_PIPELINE_FLAG;
+    return s_bundleCache->GetBundle(GetBasicBundleDrawKey(desc), s_renderFence->GetCompletedValue(), s_fenceValue + 1);
+}
+
+static auto SetCaptureResourceId(RenderResourceId renderId, uint32_t captureId) -> void
+{
+    if (renderId >= s_captureResourceIds.size()) {
+        s_captureResourceIds.resize(size_t(renderId) + 1, CAPTURE_INVALID_ID);
+    }
+    s_captureResourceIds[renderId] = captureId;
+}
+
+// Wrap the objects of the basic frame, which must have been created.
+static auto CreateRenderBackend() -> bool
+{
+    s_renderCommandQueue = s_renderDevice.WrapCommandQueue(s_commandQueue, s_swapChain);
+    s_basicRenderCommandList = s_renderDevice.WrapCommandList(nullptr, nullptr, RenderCommandListType::DIRECT);
+    s_basicRenderBundle = s_renderDevice.WrapCommandList(s_commandBundleAllocator, s_basicCommandBundle, RenderCommandListType::BUNDLE);
+    s_renderFence = s_renderDevice.WrapFence(s_fence, s_hFenceEvent);
+    s_bundleCache = new BundleCache(s_renderDevice, BUNDLE_CACHE_CAPACITY);
+
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = s_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    for (UINT i = 0; i < TOTAL_FRAME_COUNT; ++i)
+    {
+        s_backBufferIds[i] = s_renderDevice.RegisterResource(s_renderTargets[i], rtvHandle);
+        rtvHandle.ptr += s_rtvDescriptorSize;
+
+        if (s_commandCaptureActive)
+        {
+            SetCaptureResourceId(s_backBufferIds[i], s_commandCaptureWriter.AddRenderTarget(s_renderTargets[i], UINT(WINDOW_WIDTH), UINT(WINDOW_HEIGHT),
+                DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_STATE_PRESENT));
+        }
+    }
+
+    // The depth target has the full window size, as the scene target.
+    s_depthTargetId = s_renderDevice.CreateDepthTarget(UINT(WINDOW_WIDTH), UINT(WINDOW_HEIGHT), RENDER_FORMAT_D32_FLOAT, RENDER_RESOURCE_STATE_DEPTH_WRITE);
+    if (s_depthTargetId == RENDER_INVALID_RESOURCE) return false;
+    s_depthTarget = s_renderDevice.GetResource(s_depthTargetId);
+    s_depthTargetResidency = RegisterResidentResource(s_depthTarget);
+    if (s_commandCaptureActive)
+    {
+        SetCaptureResourceId(s_depthTargetId, s_commandCaptureWriter.AddDepthStencil(s_depthTarget, UINT(WINDOW_WIDTH), UINT(WINDOW_HEIGHT),
+            DXGI_FORMAT_D32_FLOAT, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+    }
+
+    if (s_commandCaptureActive)
+    {
+        s_captureCommandList = new CaptureRenderCommandList(*s_basicRenderCommandList, s_commandCaptureWriter, s_captureResourceIds, CAPTURE_INVALID_ID);
+        s_captureBundle = new CaptureRenderCommandList(*s_basicRenderBundle, s_commandCaptureWriter, s_captureResourceIds, BASIC_BUNDLE_CAPTURE_ID);
+    }
+
+    return true;
+}
+
+static auto ReleaseRenderBackend() -> void
+{
+    delete s_captureCommandList;
+    s_captureCommandList = nullptr;
+    delete s_captureBundle;
+    s_captureBundle = nullptr;
+    // The bundles themselves are owned by the render device.
+    delete s_bundleCache;
+    s_bundleCache = nullptr;
+
+    s_renderDevice.Release();
+    s_depthTarget = nullptr;
+    s_depthTargetId = RENDER_INVALID_RESOURCE;
+    s_renderCommandQueue = nullptr;
+    s_basicRenderCommandList = nullptr;
+    s_basicRenderBundle = nullptr;
+    s_renderFence = nullptr;
+}
+
+// Without a capture, the bundle is recorded by `s_bundleCache` when a frame first uses it.
+static auto RecordBasicCommandBundle() -> bool
+{
+    if (s_captureBundle == nullptr || !s_commandCaptureActive) return true;
+
+    if (!RecordBasicBundle(*s_captureBundle, GetBasicBundleDesc()))
+    {
+        fprintf(stderr, "Record basic command bundle failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Print the per-frame averages since the last report.
+static auto ReportRenderStats(UINT64 frameCount) -> void
+{
+    const RenderCallStats& stats = s_renderDevice.GetStats();
+    printf("Render backend: %.3f ms to record the basic frame, %.1f calls per frame:", s_renderStatsRecordTime / double(frameCount),
+        double(stats.GetTotal() - s_renderStatsLastReport.GetTotal()) / double(frameCount));
+    for (uint32_t call = 0; call < uint32_t(RenderCall::COUNT); ++call)
+    {
+        const uint64_t count = stats.counts[call] - s_renderStatsLastReport.counts[call];
+        if (count > 0) {
+            printf(" %s %.1f", RENDER_CALL_NAMES[call], double(count) / double(frameCount));
+        }
+    }
+    puts("");
+
+    printf("Render passes: %s, about %.1f KB of attachment traffic avoided per frame on a tile-based GPU\n",
+        s_renderPassesEnabled ? "native" : "legacy", double(stats.renderPassAvoidedBytes - s_renderStatsLastReport.renderPassAvoidedBytes) / 1024.0 / double(frameCount));
+
+    printf("Command list pool: %zu pairs, %llu created, %llu destroyed, %llu acquired in all\n", s_commandListPool.GetPairCount(),
+        (unsigned long long)s_commandListPool.GetCreatedCount(), (unsigned long long)s_commandListPool.GetDestroyedCount(),
+        (unsigned long long)s_commandListPool.GetAcquiredCount());
+
+    const BundleCacheStats& cacheStats = s_bundleCache->GetStats();
+    const BundleCacheStats intervalStats{
+        .hits = cacheStats.hits - s_bundleCacheStatsLastReport.hits,
+        .misses = cacheStats.misses - s_bundleCacheStatsLastReport.misses,
+        .evictions = cacheStats.evictions - s_bundleCacheStatsLastReport.evictions,
+        .invalidations = cacheStats.invalidations - s_bundleCacheStatsLastReport.invalidations,
+        .recordTime = cacheStats.recordTime - s_bundleCacheStatsLastReport.recordTime
+    };
+    printf("Bundle cache: %zu bundles, %.1f%% hits, %llu misses, %llu evictions, %llu invalidations, %.3f ms recording, about %.3f ms of recording saved\n",
+        s_bundleCache->GetCachedCount(), intervalStats.GetHitRate() * 100.0, (unsigned long long)intervalStats.misses, (unsigned long long)intervalStats.evictions,
+        (unsigned long long)intervalStats.invalidations, intervalStats.recordTime,
+        intervalStats.hits * (cacheStats.misses > 0 ? cacheStats.recordTime / double(cacheStats.misses) : 0.0));
+
+    const ResidencyStats residencyStats = s_residencyManager.GetStats();
+    auto const toMegabytes = [](uint64_t size) { return double(size) / (1024.0 * 1024.0); };
+    printf("Residency: %.1f of %.1f MB resident, %.1f MB in use of a %.1f MB budget, %llu evictions (%.1f MB), %llu page-ins (%.1f MB), %llu page-in stalls (%.3f ms) in all\n",
+        toMegabytes(residencyStats.residentBytes), toMegabytes(residencyStats.managedBytes), toMegabytes(residencyStats.lastBudget.currentUsage),
+        toMegabytes(residencyStats.lastBudget.budget), (unsigned long long)residencyStats.evictionCount, toMegabytes(residencyStats.evictedBytes),
+        (unsigned long long)residencyStats.pageInCount, toMegabytes(residencyStats.pagedInBytes), (unsigned long long)residencyStats.pageInStallCount,
+        residencyStats.pageInStallTime);
+
+    if (s_fenceReactor != nullptr) {
+        ReportFenceReactorStats();
+    }
+
+    if (s_drawPacketsEnabled)
+    {
+        const DrawStateStats& drawStats = s_drawStateFilter.GetStats();
+        printf("Draw packets: %.1f draws and %.1f state calls per frame, %.1f redundant ones avoided\n", double(drawStats.drawCount) / double(frameCount),
+            double(drawStats.stateCallCount) / double(frameCount), double(drawStats.GetSkipCount()) / double(frameCount));
+        s_drawStateFilter.ResetStats();
+    }
+
+    s_renderStatsLastReport = stats;
+    s_bundleCacheStatsLastReport = cacheStats;
+    s_renderStatsRecordTime = 0.0;
+}
+
+// Measure the bandwidth of getting CPU-written data consumed by the GPU, for each path the device supports.
+// Each iteration writes the buffer on the CPU, then the GPU reads all of it with a copy into a DEFAULT heap sink, and the CPU
+// waits for that. The staged path also copies the data into the DEFAULT heap first, in the same submission; the zero-copy path
+// reads the CUSTOM heap in place, so its cost of reading system memory is measured too.
+static auto RunUploadBandwidthBenchmark() -> bool
+{
+    std::vector<uint8_t> sourceData(UPLOAD_BENCHMARK_BUFFER_SIZE);
+    for (size_t i = 0; i < sourceData.size(); ++i) {
+        sourceData[i] = uint8_t(i * 31U);
+    }
+
+    for (uint32_t pathIndex = 0; pathIndex < uint32_t(BufferMemoryPath::COUNT); ++pathIndex)
+    {
+        const auto path = BufferMemoryPath(pathIndex);
+        if (!IsBufferMemoryPathSupported(s_deviceMemoryCaps, path))
+        {
+            printf("Upload bandwidth [%s]: not supported on this device\n", GetBufferMemoryPathName(path));
+            continue;
+        }
+
+        const BufferHeapPolicy policy = GetBufferHeapPolicy(s_deviceMemoryCaps, path);
+
+        // GENERIC_READ includes COPY_SOURCE, for the copy that consumes the data.
+        ComHandle<ID3D12Resource> cpuWrittenBuffer;
+        HRESULT hRes = CreateCpuWrittenBuffer(policy, UINT64(UPLOAD_BENCHMARK_BUFFER_SIZE), D3D12_RESOURCE_STATE_GENERIC_READ,
+            cpuWrittenBuffer.ReleaseAndGetAddressOf());
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for %s benchmark buffer failed: %ld\n", GetBufferMemoryPathName(path), hRes);
+            return false;
+        }
+
+        ComHandle<ID3D12Resource> gpuLocalBuffer;
+        if (path == BufferMemoryPath::STAGED)
+        {
+            hRes = CreateGpuLocalBuffer(UINT64(UPLOAD_BENCHMARK_BUFFER_SIZE), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST,
+                gpuLocalBuffer.ReleaseAndGetAddressOf());
+            if (FAILED(hRes))
+            {
+                fprintf(stderr, "CreateCommittedResource for GPU local benchmark buffer failed: %ld\n", hRes);
+                return false;
+            }
+        }
+
+        ComHandle<ID3D12Resource> sinkBuffer;
+        hRes = CreateGpuLocalBuffer(UINT64(UPLOAD_BENCHMARK_BUFFER_SIZE), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST,
+            sinkBuffer.ReleaseAndGetAddressOf());
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for benchmark sink buffer failed: %ld\n", hRes);
+            return false;
+        }
+
+        // Warm up, so that page faults of the first touch are not measured.
+        if (!WriteBufferData(cpuWrittenBuffer.Get(), sourceData.data(), sourceData.size())) return false;
+
+        LARGE_INTEGER beginTime{ }, endTime{ }, writeBeginTime{ }, writeEndTime{ };
+        LONGLONG writeTicks = 0;
+        QueryPerformanceCounter(&beginTime);
+
+        D3D12_RESOURCE_STATES gpuLocalState = D3D12_RESOURCE_STATE_COPY_DEST;
+        for (UINT i = 0; i < UPLOAD_BENCHMARK_ITERATION_COUNT; ++i)
+        {
+            QueryPerformanceCounter(&writeBeginTime);
+            if (!WriteBufferData(cpuWrittenBuffer.Get(), sourceData.data(), sourceData.size())) return false;
+            QueryPerformanceCounter(&writeEndTime);
+            writeTicks += writeEndTime.QuadPart - writeBeginTime.QuadPart;
+
+            if (!BeginImmediateCommands()) return false;
+
+            ID3D12Resource* consumedBuffer = cpuWrittenBuffer.Get();
+            if (gpuLocalBuffer)
+            {
+                D3D12_RESOURCE_BARRIER barrier{
+                    .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+                    .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+                    .Transition {
+                        .pResource = gpuLocalBuffer.Get(),
+                        .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+                        .StateBefore = gpuLocalState,
+                        .StateAfter = D3D12_RESOURCE_STATE_COPY_DEST
+                    }
+                };
+                if (gpuLocalState != D3D12_RESOURCE_STATE_COPY_DEST) {
+                    s_basicCommandList->ResourceBarrier(1, &barrier);
+                }
+                s_basicCommandList->CopyBufferRegion(gpuLocalBuffer.Get(), 0, cpuWrittenBuffer.Get(), 0, UINT64(UPLOAD_BENCHMARK_BUFFER_SIZE));
+
+                barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+                barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+                s_basicCommandList->ResourceBarrier(1, &barrier);
+                gpuLocalState = D3D12_RESOURCE_STATE_COPY_SOURCE;
+                consumedBuffer = gpuLocalBuffer.Get();
+            }
+            s_basicCommandList->CopyBufferRegion(sinkBuffer.Get(), 0, consumedBuffer, 0, UINT64(UPLOAD_BENCHMARK_BUFFER_SIZE));
+
+            if (!SubmitImmediateCommands()) return false;
+        }
+
+        QueryPerformanceCounter(&endTime);
+
+        const double elapsedSeconds = double(endTime.QuadPart - beginTime.QuadPart) / double(s_performanceFrequency.QuadPart);
+        const double writeSeconds = double(writeTicks) / double(s_performanceFrequency.QuadPart);
+        const double totalMegabytes = double(UPLOAD_BENCHMARK_BUFFER_SIZE) * double(UPLOAD_BENCHMARK_ITERATION_COUNT) / (1024.0 * 1024.0);
+        printf("Upload bandwidth [%s]: %.1f MB/s up to GPU consumption (%.3f ms per %zu MB, of which %.3f ms of CPU writes)\n",
+            GetBufferMemoryPathName(path), totalMegabytes / elapsedSeconds, elapsedSeconds * 1000.0 / double(UPLOAD_BENCHMARK_ITERATION_COUNT),
+            UPLOAD_BENCHMARK_BUFFER_SIZE / (1024 * 1024), writeSeconds * 1000.0 / double(UPLOAD_BENCHMARK_ITERATION_COUNT));
+    }
+
+    return true;
+}
+
+static auto LoadDxcCompiler() -> bool
+{
+    if (s_dxcCreateInstance != nullptr) return true;
+
+    s_hDxcModule = LoadLibraryA("dxcompiler.dll");
+    if (s_hDxcModule == nullptr)
+    {
+        printf("WARNING: dxcompiler.dll is not available, so Shader Model 6 shaders will not be compiled!\n");
+        return false;
+    }
+
+    s_dxcCreateInstance = (DxcCreateInstanceProc)GetProcAddress(s_hDxcModule, "DxcCreateInstance");
+    return s_dxcCreateInstance != nullptr;
+}
+
+// Compile a Shader Model 6 shader with DXC. `defines` are in the form of `NAME=VALUE`.
+static auto CompileShaderObjectWithDxc(const WCHAR hlslPath[], const WCHAR entryPoint[], const WCHAR target[],
+    const WCHAR* const defines[], UINT defineCount) -> ID3DBlob*
+{
+    if (!LoadDxcCompiler()) return nullptr;
+
+    IDxcUtils* utils = nullptr;
+    IDxcCompiler3* compiler = nullptr;
+    IDxcBlobEncoding* source = nullptr;
+    IDxcIncludeHandler* includeHandler = nullptr;
+    IDxcResult* result = nullptr;
+    ID3DBlob* shaderObject = nullptr;
+
+    do
+    {
+        HRESULT hRes = s_dxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&utils));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "DxcCreateInstance for IDxcUtils failed: %ld\n", hRes);
+            break;
+        }
+
+        hRes = s_dxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "DxcCreateInstance for IDxcCompiler3 failed: %ld\n", hRes);
+            break;
+        }
+
+        hRes = utils->LoadFile(hlslPath, nullptr, &source);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Load shader source %ls failed: %ld\n", hlslPath, hRes);
+            break;
+        }
+
+        hRes = utils->CreateDefaultIncludeHandler(&includeHandler);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateDefaultIncludeHandler failed: %ld\n", hRes);
+            break;
+        }
+
+        std::vector<LPCWSTR> arguments{ hlslPath, L"-E", entryPoint, L"-T", target };
+        for (UINT i = 0; i < defineCount; ++i)
+        {
+            arguments.push_back(L"-D");
+            arguments.push_back(defines[i]);
+        }
+
+        const DxcBuffer sourceBuffer{
+            .Ptr = source->GetBufferPointer(),
+            .Size = source->GetBufferSize(),
+            .Encoding = DXC_CP_ACP
+        };
+        hRes = compiler->Compile(&sourceBuffer, arguments.data(), UINT32(arguments.size()), includeHandler, IID_PPV_ARGS(&result));
+        if (SUCCEEDED(hRes)) {
+            result->GetStatus(&hRes);
+        }
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Compile %ls (%ls) with DXC failed: %ld\n", hlslPath, entryPoint, hRes);
+
+            IDxcBlobUtf8* errors = nullptr;
+            if (result != nullptr && SUCCEEDED(result->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&errors), nullptr)) && errors != nullptr)
+            {
+                if (errors->GetStringLength() > 0) {
+                    fprintf(stderr, "%s\n", errors->GetStringPointer());
+                }
+                errors->Release();
+            }
+            break;
+        }
+
+        // IDxcBlob shares its IID with ID3DBlob, so the object can be handed to the rest of the code as is.
+        hRes = result->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&shaderObject), nullptr);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Get DXC shader object failed: %ld\n", hRes);
+            shaderObject = nullptr;
+        }
+    }
+    while (false);
+
+    if (result != nullptr) {
+        result->Release();
+    }
+    if (includeHandler != nullptr) {
+        includeHandler->Release();
+    }
+    if (source != nullptr) {
+        source->Release();
+    }
+    if (compiler != nullptr) {
+        compiler->Release();
+    }
+    if (utils != nullptr) {
+        utils->Release();
+    }
+
+    return shaderObject;
+}
+
+static auto ReleaseComputePrimitivePipelines() -> void
+{
+    for (auto& pipelineState : s_computePrimitives.pipelineStates)
+    {
+        if (pipelineState != nullptr)
+        {
+            pipelineState->Release();
+            pipelineState = nullptr;
+        }
+    }
+    if (s_computePrimitives.rootSignature != nullptr)
+    {
+        s_computePrimitives.rootSignature->Release();
+        s_computePrimitives.rootSignature = nullptr;
+    }
+}
+
+// Root constants at b0 and root UAVs at u0 to u3 shared by all the compute primitive kernels
+static auto CreateComputePrimitiveRootSignature() -> bool
+{
+    RootParameterDesc rootParameters[5]{ };
+    rootParameters[0] = {
+        .kind = RootParameterKind::ROOT_CONSTANTS,
+        .visibility = RootShaderVisibility::ALL,
+        .shaderRegister = 0,
+        .registerSpace = 0,
+        .sizeInDwords = sizeof(ComputePrimitiveConstants) / sizeof(UINT),
+        .volatility = RootDataVolatility::VOLATILE,
+        .ranges = nullptr,
+        .rangeCount = 0
+    };
+    // The kernels write their buffers while they read them, e.g. the partial sums of a scan.
+    for (uint32_t i = 1; i < (uint32_t)std::size(rootParameters); ++i)
+    {
+        rootParameters[i] = {
+            .kind = RootParameterKind::ROOT_UAV,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = i - 1,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        };
+    }
+
+    return CreateCachedRootSignature("compute primitives", rootParameters, (uint32_t)std::size(rootParameters), nullptr, 0,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE, &s_computePrimitives.rootSignature);
+}
+
+// Compile every kernel for `config` and create the PSOs.
+static auto CreateComputePrimitivePipelineStates(const ComputePrimitiveConfig& config) -> bool
+{
+    char groupSizeDefine[32]{ };
+    char waveSizeDefine[32]{ };
+    sprintf_s(groupSizeDefine, "%u", config.groupSize);
+    sprintf_s(waveSizeDefine, "%u", config.waveSize);
+
+    WCHAR groupSizeArgument[48]{ };
+    WCHAR waveSizeArgument[48]{ };
+    swprintf_s(groupSizeArgument, L"GROUP_SIZE=%u", config.groupSize);
+    swprintf_s(waveSizeArgument, L"WAVE_SIZE=%u", config.waveSize);
+    const WCHAR* const dxcDefines[] = { groupSizeArgument, waveSizeArgument, L"USE_WAVE_INTRINSICS=1" };
+
+    const D3D_SHADER_MACRO fxcDefines[] = {
+        { "GROUP_SIZE", groupSizeDefine },
+        { "WAVE_SIZE", waveSizeDefine },
+        { "USE_WAVE_INTRINSICS", "0" },
+        { nullptr, nullptr }
+    };
+
+    for (size_t i = 0; i < size_t(ComputePrimitiveKernel::COUNT); ++i)
+    {
+        ID3DBlob* shaderObject = nullptr;
+        if (config.useWaveIntrinsics)
+        {
+            WCHAR entryPoint[64]{ };
+            swprintf_s(entryPoint, L"%hs", COMPUTE_PRIMITIVE_ENTRY_POINTS[i]);
+            shaderObject = CompileShaderObjectWithDxc(L"shaders/compute_primitives.hlsl", entryPoint, L"cs_6_0", dxcDefines, (UINT)std::size(dxcDefines));
+        }
+        else {
+            shaderObject = CompileShaderObjectFromPath(L"shaders/compute_primitives.hlsl", COMPUTE_PRIMITIVE_ENTRY_POINTS[i], "cs_5_1", fxcDefines);
+        }
+        if (shaderObject == nullptr) return false;
+
+        const D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc{
+            .pRootSignature = s_computePrimitives.rootSignature,
+            .CS = { .pShaderBytecode = shaderObject->GetBufferPointer(), .BytecodeLength = shaderObject->GetBufferSize() },
+            .NodeMask = 0,
+            .CachedPSO { },
+            .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+        };
+        const HRESULT hRes = s_device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&s_computePrimitives.pipelineStates[i]));
+        shaderObject->Release();
+
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateComputePipelineState for %s failed: %ld\n", COMPUTE_PRIMITIVE_ENTRY_POINTS[i], hRes);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Specialize the compute primitives for the wave lane count detected by `QueryDeviceWaveOps`.
+// Wave intrinsics need Shader Model 6.0 and DXC; otherwise the group shared memory variant is used.
+static auto CreateComputePrimitivePipelines() -> bool
+{
+    if (s_computePrimitives.rootSignature != nullptr) return true;
+
+    if (!CreateComputePrimitiveRootSignature()) return false;
+
+    const bool waveIntrinsicsAvailable = s_waveSize > 0 && s_highestShaderModel >= D3D_SHADER_MODEL_6_0;
+    ComputePrimitiveConfig config = ChooseComputePrimitiveConfig(s_waveSize, waveIntrinsicsAvailable);
+    if (!CreateComputePrimitivePipelineStates(config))
+    {
+        if (!config.useWaveIntrinsics) return false;
+
+        printf("WARNING: Wave intrinsic variant of the compute primitives is not available. Falling back to group shared memory.\n");
+        for (auto& pipelineState : s_computePrimitives.pipelineStates)
+        {
+            if (pipelineState != nullptr)
+            {
+                pipelineState->Release();
+                pipelineState = nullptr;
+            }
+        }
+
+        config = ChooseComputePrimitiveConfig(0, false);
+        if (!CreateComputePrimitivePipelineStates(config)) return false;
+    }
+
+    s_computePrimitives.config = config;
+    printf("Compute primitives use group size %u, wave size %u, %s\n", config.groupSize, config.waveSize,
+        config.useWaveIntrinsics ? "with wave intrinsics" : "with group shared memory");
+
+    return true;
+}
+
+// Record one kernel dispatch followed by a UAV barrier. Zero addresses in `buffers` are bound to `buffers[0]`,
+// since every root UAV must be valid even if the kernel does not access it.
+static auto DispatchComputePrimitive(ID3D12GraphicsCommandList* commandList, ComputePrimitiveKernel kernel, const ComputePrimitiveConstants& constants,
+    const D3D12_GPU_VIRTUAL_ADDRESS (&buffers)[4], UINT dispatchGroupCount) -> void
+{
+    commandList->SetPipelineState(s_computePrimitives.pipelineStates[size_t(kernel)]);
+    commandList->SetComputeRoot32BitConstants(0, sizeof(constants) / sizeof(UINT), &constants, 0);
+    for (UINT i = 0; i < (UINT)std::size(buffers); ++i) {
+        commandList->SetComputeRootUnorderedAccessView(1 + i, buffers[i] != 0 ? buffers[i] : buffers[0]);
+    }
+
+    if (dispatchGroupCount > 0) {
+        commandList->Dispatch(dispatchGroupCount, 1, 1);
+    }
+
+    const D3D12_RESOURCE_BARRIER uavBarrier{
+        .Type = D3D12_RESOURCE_BARRIER_TYPE_UAV,
+        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        .UAV { .pResource = nullptr }
+    };
+    commandList->ResourceBarrier(1, &uavBarrier);
+}
+
+// The following record functions expect all the buffers in the UNORDERED_ACCESS state.
+// `partials` and `groupTotals` need `GetComputeGroupCount(count, groupSize)` elements at least,
+// and `histograms` needs `GetComputePrimitiveScratchCount(count, groupSize)` elements.
+
+// output[0] = sum of input[0, count)
+static auto RecordReduce(ID3D12GraphicsCommandList* commandList, D3D12_GPU_VIRTUAL_ADDRESS input, D3D12_GPU_VIRTUAL_ADDRESS output,
+    D3D12_GPU_VIRTUAL_ADDRESS partials, UINT count) -> void
+{
+    commandList->SetComputeRootSignature(s_computePrimitives.rootSignature);
+
+    const UINT partialGroupCount = GetReducePartialGroupCount(count, s_computePrimitives.config.groupSize);
+    const ComputePrimitiveConstants constants{ .elementCount = count, .groupCount = partialGroupCount, .radixShift = 0, .exclusiveScan = 0 };
+    DispatchComputePrimitive(commandList, ComputePrimitiveKernel::REDUCE_PARTIAL, constants, { input, output, partials, 0 }, partialGroupCount);
+    DispatchComputePrimitive(commandList, ComputePrimitiveKernel::REDUCE_FINAL, constants, { input, output, partials, 0 }, 1);
+}
+
+// Inclusive or exclusive prefix sum of input[0, count). `output` may be the same buffer as `input`.
+static auto RecordPrefixSum(ID3D12GraphicsCommandList* commandList, D3D12_GPU_VIRTUAL_ADDRESS input, D3D12_GPU_VIRTUAL_ADDRESS output,
+    D3D12_GPU_VIRTUAL_ADDRESS groupTotals, UINT count, bool exclusive) -> void
+{
+    commandList->SetComputeRootSignature(s_computePrimitives.rootSignature);
+
+    const UINT groupCount = GetComputeGroupCount(count, s_computePrimitives.config.groupSize);
+    const ComputePrimitiveConstants constants{ .elementCount = count, .groupCount = groupCount, .radixShift = 0, .exclusiveScan = exclusive ? 1U : 0U };
+    DispatchComputePrimitive(commandList, ComputePrimitiveKernel::SCAN_GROUP, constants, { input, output, groupTotals, 0 }, groupCount);
+    DispatchComputePrimitive(commandList, ComputePrimitiveKernel::SCAN_GROUP_TOTALS, constants, { input, output, groupTotals, 0 }, 1);
+    DispatchComputePrimitive(commandList, ComputePrimitiveKernel::SCAN_ADD, constants, { input, output, groupTotals, 0 }, groupCount);
+}
+
+// Write the elements of input[0, count) satisfying `IsCompactedElement` to `output` in order,
+// and their number to keptCount[0]. `flags` needs `count` elements. `count` must not be 0.
+static auto RecordCompact(ID3D12GraphicsCommandList* commandList, D3D12_GPU_VIRTUAL_ADDRESS input, D3D12_GPU_VIRTUAL_ADDRESS output,
+    D3D12_GPU_VIRTUAL_ADDRESS flags, D3D12_GPU_VIRTUAL_ADDRESS groupTotals, D3D12_GPU_VIRTUAL_ADDRESS keptCount, UINT count) -> void
+{
+    commandList->SetComputeRootSignature(s_computePrimitives.rootSignature);
+
+    const UINT groupCount = GetComputeGroupCount(count, s_computePrimitives.config.groupSize);
+    const ComputePrimitiveConstants constants{ .elementCount = count, .groupCount = groupCount, .radixShift = 0, .exclusiveScan = 0 };
+    DispatchComputePrimitive(commandList, ComputePrimitiveKernel::COMPACT_FLAGS, constants, { input, flags, 0, 0 }, groupCount);
+
+    RecordPrefixSum(commandList, flags, flags, groupTotals, count, true);
+
+    DispatchComputePrimitive(commandList, ComputePrimitiveKernel::COMPACT_SCATTER, constants, { input, output, flags, keptCount }, groupCount);
+}
+
+// Stable sort of keysIn[0, count) into `keysOut`. `keysIn` is left unchanged, and `temp` needs `count` elements.
+static auto RecordRadixSort(ID3D12GraphicsCommandList* commandList, D3D12_GPU_VIRTUAL_ADDRESS keysIn, D3D12_GPU_VIRTUAL_ADDRESS keysOut,
+    D3D12_GPU_VIRTUAL_ADDRESS temp, D3D12_GPU_VIRTUAL_ADDRESS histograms, D3D12_GPU_VIRTUAL_ADDRESS groupTotals, UINT count) -> void
+{
+    const UINT groupCount = GetComputeGroupCount(count, s_computePrimitives.config.groupSize);
+    for (UINT pass = 0; pass < RADIX_SORT_PASS_COUNT; ++pass)
+    {
+        // keysIn -> temp -> keysOut -> temp -> ... -> keysOut
+        const D3D12_GPU_VIRTUAL_ADDRESS src = pass == 0 ? keysIn : (pass % 2 == 1 ? temp : keysOut);
+        const D3D12_GPU_VIRTUAL_ADDRESS dst = pass % 2 == 0 ? temp : keysOut;
+        const ComputePrimitiveConstants constants{
+            .elementCount = count,
+            .groupCount = groupCount,
+            .radixShift = pass * RADIX_SORT_BITS_PER_PASS,
+            .exclusiveScan = 0
+        };
+
+        commandList->SetComputeRootSignature(s_computePrimitives.rootSignature);
+        DispatchComputePrimitive(commandList, ComputePrimitiveKernel::RADIX_HISTOGRAM, constants, { src, dst, histograms, 0 }, groupCount);
+
+        RecordPrefixSum(commandList, histograms, histograms, groupTotals, groupCount * RADIX_SORT_DIGIT_COUNT, true);
+
+        DispatchComputePrimitive(commandList, ComputePrimitiveKernel::RADIX_SCATTER, constants, { src, dst, histograms, 0 }, groupCount);
+    }
+}
+
+// Copy `size` bytes of `buffer` in `state` back to `data` and wait for the copy to complete.
+static auto ReadbackBufferData(ID3D12Resource* buffer, D3D12_RESOURCE_STATES state, size_t size, void* data) -> bool
+{
+    const D3D12_HEAP_PROPERTIES readbackHeapProperties{
+        .Type = D3D12_HEAP_TYPE_READBACK,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC readbackDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = UINT64(size),
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+
+    ComHandle<ID3D12Resource> readbackBuffer;
+    HRESULT hRes = s_device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(readbackBuffer.ReleaseAndGetAddressOf()));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    if (!BeginImmediateCommands()) return false;
+
+    D3D12_RESOURCE_BARRIER barrier{
+        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        .Transition {
+            .pResource = buffer,
+            .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+            .StateBefore = state,
+            .StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE
+        }
+    };
+    s_basicCommandList->ResourceBarrier(1, &barrier);
+    s_basicCommandList->CopyBufferRegion(readbackBuffer.Get(), 0, buffer, 0, UINT64(size));
+    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
+    barrier.Transition.StateAfter = state;
+    s_basicCommandList->ResourceBarrier(1, &barrier);
+
+    if (!SubmitImmediateCommands()) return false;
+
+    void* pDataBegin = nullptr;
+    const D3D12_RANGE readRange{ 0, size };
+    hRes = readbackBuffer->Map(0, &readRange, &pDataBegin);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    memcpy(data, pDataBegin, size);
+
+    const D3D12_RANGE writtenRange{ 0, 0 };
+    readbackBuffer->Unmap(0, &writtenRange);
+    return true;
+}
+
+// Run `runCpu` and `recordGpu` COMPUTE_BENCHMARK_ITERATION_COUNT times each and print the throughput of both.
+// The GPU time includes the submission and the wait for completion.
+template <typename RunCpu, typename RecordGpu>
+static auto MeasureComputePrimitive(const char* name, size_t elementCount, RunCpu&& runCpu, RecordGpu&& recordGpu) -> bool
+{
+    LARGE_INTEGER beginTime{ }, endTime{ };
+    QueryPerformanceCounter(&beginTime);
+    for (UINT i = 0; i < COMPUTE_BENCHMARK_ITERATION_COUNT; ++i) {
+        runCpu();
+    }
+    QueryPerformanceCounter(&endTime);
+    const double cpuSeconds = double(endTime.QuadPart - beginTime.QuadPart) / double(s_performanceFrequency.QuadPart);
+
+    QueryPerformanceCounter(&beginTime);
+    for (UINT i = 0; i < COMPUTE_BENCHMARK_ITERATION_COUNT; ++i)
+    {
+        if (!BeginImmediateCommands()) return false;
+        recordGpu(s_basicCommandList);
+        if (!SubmitImmediateCommands()) return false;
+    }
+    QueryPerformanceCounter(&endTime);
+    const double gpuSeconds = double(endTime.QuadPart - beginTime.QuadPart) / double(s_performanceFrequency.QuadPart);
+
+    const double totalMegaElements = double(elementCount) * double(COMPUTE_BENCHMARK_ITERATION_COUNT) / 1.0e6;
+    printf("Compute primitive [%s]: CPU reference %.1f M elements/s, GPU %.1f M elements/s\n", name,
+        totalMegaElements / cpuSeconds, totalMegaElements / gpuSeconds);
+    return true;
+}
+
+static auto VerifyComputePrimitive(const char* name, ID3D12Resource* buffer, const uint32_t expected[], size_t count) -> bool
+{
+    std::vector<uint32_t> actual(count);
+    if (!ReadbackBufferData(buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, count * sizeof(uint32_t), actual.data())) return false;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (actual[i] != expected[i])
+        {
+            fprintf(stderr, "Compute primitive [%s] mismatches the CPU reference at %zu: %u vs %u\n", name, i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check every compute primitive bit-exactly against its CPU reference and compare their throughput.
+static auto RunComputePrimitiveBenchmark() -> bool
+{
+    if (!CreateComputePrimitivePipelines()) return false;
+
+    const UINT count = UINT(COMPUTE_BENCHMARK_ELEMENT_COUNT);
+    const uint32_t threadCount = GetComputeReferenceThreadCount();
+    const UINT groupCount = GetComputeGroupCount(count, s_computePrimitives.config.groupSize);
+
+    // About a quarter of the elements are zero, which are dropped by the compaction.
+    std::vector<uint32_t> input(count);
+    uint32_t seed = 0x12345678U;
+    for (auto& value : input)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        value = (seed & 3) == 0 ? 0 : seed;
+    }
+
+    struct
+    {
+        ComHandle<ID3D12Resource> input;
+        ComHandle<ID3D12Resource> output;
+        ComHandle<ID3D12Resource> temp;
+        ComHandle<ID3D12Resource> histograms;
+        ComHandle<ID3D12Resource> groupTotals;
+        ComHandle<ID3D12Resource> keptCount;
+    } buffers;
+
+    const struct
+    {
+        ComHandle<ID3D12Resource>* buffer;
+        size_t elementCount;
+    } bufferSizes[] = {
+        { &buffers.output, count },
+        { &buffers.temp, count },
+        { &buffers.histograms, GetComputePrimitiveScratchCount(count, s_computePrimitives.config.groupSize) },
+        { &buffers.groupTotals, size_t(groupCount) },
+        { &buffers.keptCount, 1 }
+    };
+    for (auto const& bufferSize : bufferSizes)
+    {
+        const HRESULT hRes = CreateGpuLocalBuffer(UINT64(bufferSize.elementCount * sizeof(uint32_t)), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, bufferSize.buffer->ReleaseAndGetAddressOf());
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for compute primitive buffer failed: %ld\n", hRes);
+            return false;
+        }
+    }
+
+    HRESULT hRes = CreateGpuLocalBuffer(UINT64(count * sizeof(uint32_t)), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+        D3D12_RESOURCE_STATE_COPY_DEST, buffers.input.ReleaseAndGetAddressOf());
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for compute primitive input failed: %ld\n", hRes);
+        return false;
+    }
+
+    ComHandle<ID3D12Resource> stagingBuffer;
+    hRes = CreateCpuWrittenBuffer(GetBufferHeapPolicy(s_deviceMemoryCaps, BufferMemoryPath::STAGED), UINT64(count * sizeof(uint32_t)),
+        D3D12_RESOURCE_STATE_GENERIC_READ, stagingBuffer.ReleaseAndGetAddressOf());
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for compute primitive staging buffer failed: %ld\n", hRes);
+        return false;
+    }
+    if (!WriteBufferData(stagingBuffer.Get(), input.data(), count * sizeof(uint32_t))) return false;
+    if (!SubmitBufferCopy(buffers.input.Get(), stagingBuffer.Get(), UINT64(count * sizeof(uint32_t)),
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)) return false;
+
+    const D3D12_GPU_VIRTUAL_ADDRESS inputAddress = buffers.input->GetGPUVirtualAddress();
+    const D3D12_GPU_VIRTUAL_ADDRESS outputAddress = buffers.output->GetGPUVirtualAddress();
+    const D3D12_GPU_VIRTUAL_ADDRESS tempAddress = buffers.temp->GetGPUVirtualAddress();
+    const D3D12_GPU_VIRTUAL_ADDRESS histogramsAddress = buffers.histograms->GetGPUVirtualAddress();
+    const D3D12_GPU_VIRTUAL_ADDRESS groupTotalsAddress = buffers.groupTotals->GetGPUVirtualAddress();
+    const D3D12_GPU_VIRTUAL_ADDRESS keptCountAddress = buffers.keptCount->GetGPUVirtualAddress();
+
+    std::vector<uint32_t> expected(count);
+
+    // Reduction
+    uint32_t expectedSum = 0;
+    if (!MeasureComputePrimitive("reduce", count,
+        [&]() { expectedSum = ReduceSumReference(input.data(), count, threadCount); },
+        [&](ID3D12GraphicsCommandList* commandList) { RecordReduce(commandList, inputAddress, outputAddress, groupTotalsAddress, count); })) return false;
+    if (!VerifyComputePrimitive("reduce", buffers.output.Get(), &expectedSum, 1)) return false;
+
+    // Prefix sums
+    for (const bool exclusive : { false, true })
+    {
+        const char* name = exclusive ? "exclusive scan" : "inclusive scan";
+        if (!MeasureComputePrimitive(name, count,
+            [&]() { PrefixSumReference(input.data(), expected.data(), count, exclusive, threadCount); },
+            [&](ID3D12GraphicsCommandList* commandList) { RecordPrefixSum(commandList, inputAddress, outputAddress, groupTotalsAddress, count, exclusive); })) return false;
+        if (!VerifyComputePrimitive(name, buffers.output.Get(), expected.data(), count)) return false;
+    }
+
+    // Stream compaction
+    size_t expectedKeptCount = 0;
+    if (!MeasureComputePrimitive("compact", count,
+        [&]() { expectedKeptCount = CompactReference(input.data(), expected.data(), count, threadCount); },
+        [&](ID3D12GraphicsCommandList* commandList) { RecordCompact(commandList, inputAddress, outputAddress, tempAddress, groupTotalsAddress, keptCountAddress, count); })) return false;
+    const uint32_t expectedKeptCount32 = uint32_t(expectedKeptCount);
+    if (!VerifyComputePrimitive("compact count", buffers.keptCount.Get(), &expectedKeptCount32, 1)) return false;
+    if (!VerifyComputePrimitive("compact", buffers.output.Get(), expected.data(), expectedKeptCount)) return false;
+
+    // Radix sort. The CPU reference sorts in place, so it starts from a fresh copy each time.
+    if (!MeasureComputePrimitive("radix sort", count,
+        [&]() {
+            expected = input;
+            RadixSortReference(expected.data(), count, threadCount);
+        },
+        [&](ID3D12GraphicsCommandList* commandList) { RecordRadixSort(commandList, inputAddress, outputAddress, tempAddress, histogramsAddress, groupTotalsAddress, count); })) return false;
+    if (!VerifyComputePrimitive("radix sort", buffers.output.Get(), expected.data(), count)) return false;
+
+    printf("All compute primitives match their CPU references\n");
+    return true;
+}
+
+static auto CreateVertexBuffer() -> bool
+{
+    const auto& squareVertices = BASIC_SQUARE_VERTICES;
+
+    // On UMA devices, the vertex data is consumed in place from a CUSTOM heap in L0;
+    // on discrete GPUs, it is copied into video memory through an UPLOAD heap staging buffer.
+    if (!CreateBufferWithData(s_bufferHeapPolicy, squareVertices, sizeof(squareVertices), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, &s_vertexBuffer))
+    {
+        fprintf(stderr, "Create vertex buffer failed\n");
+        return false;
+    }
+
+    s_vertexBufferId = s_renderDevice.RegisterResource(s_vertexBuffer, D3D12_CPU_DESCRIPTOR_HANDLE{ });
+    s_vertexBufferResidency = RegisterResidentResource(s_vertexBuffer);
+    if (s_commandCaptureActive) {
+        SetCaptureResourceId(s_vertexBufferId, s_commandCaptureWriter.AddBuffer(s_vertexBuffer, squareVertices, sizeof(squareVertices), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER));
+    }
+
+    // Initialize the vertex buffer view.
+    s_vertexBufferView = {
+        .BufferLocation = s_vertexBuffer->GetGPUVirtualAddress(),
+        .SizeInBytes = (uint32_t)sizeof(squareVertices),
+        .StrideInBytes = sizeof(squareVertices[0])
+    };
+    s_vertexCount = (UINT)std::size(squareVertices);
+
+    if (!RecordBasicCommandBundle()) return false;
+
+    // Wait for the command list to execute;
+    // we are reusing the same command list in our main loop but for now,
+    // we just want to wait for setup to complete before continuing.
+    WaitForPreviousFrame();
+
+    return true;
+}
+
+// Runs on the shader watcher thread: recompile the HLSL sources and build new PSOs off the render thread.
+// The new PSO set is published to `s_pendingPipelineStateSet` and will be swapped in at the next frame boundary.
+static auto ReloadBasicPipelineStates(LONGLONG detectedTime) -> void
+{
+    auto const pipelineStateSet = new BasicPipelineStateSet{ };
+    if (!CreateBasicPipelineStateSet(*pipelineStateSet))
+    {
+        delete pipelineStateSet;
+        return;
+    }
+
+    s_shaderChangeDetectedTime.store(detectedTime);
+
+    // PSOs that have not been swapped in yet have never been used by the GPU, so they can be released directly.
+    BasicPipelineStateSet* stalePipelineStateSet = s_pendingPipelineStateSet.exchange(pipelineStateSet);
+    if (stalePipelineStateSet != nullptr)
+    {
+        ReleaseBasicPipelineStateSet(*stalePipelineStateSet);
+        delete stalePipelineStateSet;
+    }
+}
+
+static auto ShaderWatcherProc() -> void
+{
+    HANDLE hDirectory = CreateFileA("shaders", FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (hDirectory == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Open `shaders` directory for watching failed: %lu\n", GetLastError());
+        return;
+    }
+
+    HANDLE hChangeEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (hChangeEvent == nullptr)
+    {
+        fprintf(stderr, "Create shader change event failed: %lu\n", GetLastError());
+        CloseHandle(hDirectory);
+        return;
+    }
+
+    alignas(DWORD) BYTE notifyBuffer[4096]{ };
+    while (true)
+    {
+        OVERLAPPED overlapped{ };
+        overlapped.hEvent = hChangeEvent;
+        ResetEvent(hChangeEvent);
+
+        if (!ReadDirectoryChangesW(hDirectory, notifyBuffer, sizeof(notifyBuffer), FALSE,
+            FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &overlapped, NULL))
+        {
+            fprintf(stderr, "ReadDirectoryChangesW failed: %lu\n", GetLastError());
+            break;
+        }
+
+        const HANDLE waitHandles[] = { s_hShaderWatcherStopEvent, hChangeEvent };
+        DWORD transferredBytes = 0;
+        if (WaitForMultipleObjects((DWORD)std::size(waitHandles), waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+        {
+            CancelIoEx(hDirectory, &overlapped);
+            GetOverlappedResult(hDirectory, &overlapped, &transferredBytes, TRUE);
+            break;
+        }
+        if (!GetOverlappedResult(hDirectory, &overlapped, &transferredBytes, FALSE)) continue;
+
+        LARGE_INTEGER detectedTime{ };
+        QueryPerformanceCounter(&detectedTime);
+
+        // Zero transferred bytes means the notify buffer overflowed, so just assume some HLSL file has been changed.
+        bool hlslChanged = transferredBytes == 0;
+        for (DWORD offset = 0; !hlslChanged && offset < transferredBytes; )
+        {
+            auto const info = (const FILE_NOTIFY_INFORMATION*)&notifyBuffer[offset];
+            const size_t nameLength = info->FileNameLength / sizeof(WCHAR);
+            constexpr WCHAR extName[] = L".hlsl";
+            constexpr size_t extLength = std::size(extName) - 1;
+            if (nameLength >= extLength && _wcsnicmp(&info->FileName[nameLength - extLength], extName, extLength) == 0) {
+                hlslChanged = true;
+            }
+
+            if (info->NextEntryOffset == 0) break;
+            offset += info->NextEntryOffset;
+        }
+        if (!hlslChanged) continue;
+
+        // Editors usually save a file with several writes, so wait for a while to let them settle down.
+        if (WaitForSingleObject(s_hShaderWatcherStopEvent, 100) == WAIT_OBJECT_0) break;
+
+        ReloadBasicPipelineStates(detectedTime.QuadPart);
+    }
+
+    CloseHandle(hChangeEvent);
+    CloseHandle(hDirectory);
+}
+
+static auto StartShaderWatcher() -> bool
+{
+    s_hShaderWatcherStopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (s_hShaderWatcherStopEvent == nullptr)
+    {
+        fprintf(stderr, "Create shader watcher stop event failed: %lu\n", GetLastError());
+        return false;
+    }
+
+    s_shaderWatcherThread = std::thread(ShaderWatcherProc);
+    return true;
+}
+
+static auto StopShaderWatcher() -> void
+{
+    if (s_shaderWatcherThread.joinable())
+    {
+        SetEvent(s_hShaderWatcherStopEvent);
+        s_shaderWatcherThread.join();
+    }
+    if (s_hShaderWatcherStopEvent != nullptr)
+    {
+        CloseHandle(s_hShaderWatcherStopEvent);
+        s_hShaderWatcherStopEvent = nullptr;
+    }
+
+    BasicPipelineStateSet* pendingPipelineStateSet = s_pendingPipelineStateSet.exchange(nullptr);
+    if (pendingPipelineStateSet != nullptr)
+    {
+        ReleaseBasicPipelineStateSet(*pendingPipelineStateSet);
+        delete pendingPipelineStateSet;
+    }
+}
+
+// Swap in the reloaded PSOs or the requested shader permutation if there is any.
+// This must be called at a frame boundary when the GPU is idle, because the bundle is recorded again.
+static auto ApplyPendingPipelineState() -> bool
+{
+    BasicPipelineStateSet* pipelineStateSet = s_pendingPipelineStateSet.exchange(nullptr);
+    if (pipelineStateSet == nullptr && s_requestedShaderPermutation == s_basicShaderPermutation) return true;
+
+    LARGE_INTEGER beginTime{ };
+    QueryPerformanceCounter(&beginTime);
+
+    if (pipelineStateSet != nullptr)
+    {
+        // The old PSOs were last used by the frame that signaled `s_fenceValue`.
+        RetireBasicPipelineStateSet(s_basicPipelineStateSet, s_fenceValue);
+        s_basicPipelineStateSet = *pipelineStateSet;
+        delete pipelineStateSet;
+    }
+
+    s_basicShaderPermutation = s_requestedShaderPermutation;
+    s_basicPipelineState = s_basicPipelineStateSet.pipelineStates[s_basicShaderPermutation];
+
+    // The bundles do not inherit the PSO from the command list, so the cached ones refer to the old PSOs.
+    // A new permutation is simply another cache key.
+    if (pipelineStateSet != nullptr) {
+        s_bundleCache->InvalidateAll();
+    }
+    if (!RecordBasicCommandBundle()) return false;
+
+    LARGE_INTEGER endTime{ };
+    QueryPerformanceCounter(&endTime);
+
+    const double toMilliseconds = 1000.0 / double(s_performanceFrequency.QuadPart);
+    if (pipelineStateSet != nullptr)
+    {
+        printf("Shaders reloaded. Reload latency: %.2f ms, swap cost on the render thread: %.3f ms (average frame time: %.3f ms)\n",
+            double(endTime.QuadPart - s_shaderChangeDetectedTime.load()) * toMilliseconds,
+            double(endTime.QuadPart - beginTime.QuadPart) * toMilliseconds, s_averageFrameTime);
+    }
+    else {
+        printf("Switched to shader permutation 0x%x\n", s_basicShaderPermutation);
+    }
+
+    return true;
+}
+
+// Two timestamps per frame, at the beginning and the end of the GPU work, resolved into a readback buffer
+static auto CreateTimestampQueries(ID3D12Device* device, ID3D12CommandQueue* commandQueue,
+    ID3D12QueryHeap** ppQueryHeap, ID3D12Resource** ppReadbackBuffer, UINT64& frequency) -> bool
+{
+    const D3D12_QUERY_HEAP_DESC queryHeapDesc{
+        .Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP,
+        .Count = 2,
+        .NodeMask = 0
+    };
+    HRESULT hRes = device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(ppQueryHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateQueryHeap for timestamps failed: %ld\n", hRes);
+        return false;
+    }
+
+    const D3D12_HEAP_PROPERTIES readbackHeapProperties{
+        .Type = D3D12_HEAP_TYPE_READBACK,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC readbackDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = sizeof(UINT64) * 2,
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    hRes = device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(ppReadbackBuffer));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for timestamp readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = commandQueue->GetTimestampFrequency(&frequency);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "GetTimestampFrequency failed: %ld\n", hRes);
+        return false;
+    }
+
+    return true;
+}
+
+// GPU time in milliseconds between the two resolved timestamps of the frame just completed
+static auto ReadTimestampDuration(ID3D12Resource* readbackBuffer, UINT64 frequency, double& duration) -> bool
+{
+    const D3D12_RANGE readRange{ 0, sizeof(UINT64) * 2 };
+    UINT64* timestamps = nullptr;
+    if (FAILED(readbackBuffer->Map(0, &readRange, (void**)&timestamps))) return false;
+
+    duration = double(timestamps[1] - timestamps[0]) * 1000.0 / double(frequency);
+
+    const D3D12_RANGE writeRange{ 0, 0 };
+    readbackBuffer->Unmap(0, &writeRange);
+
+    return true;
+}
+
+static auto CreateUpscaleRootSignature() -> bool
+{
+    // The scene is rendered earlier in the same command list, and not written again while the upscale pass samples it.
+    const RootDescriptorRange srvRange{
+        .type = RootDescriptorRangeType::SRV,
+        .descriptorCount = 1,
+        .baseShaderRegister = 0,
+        .registerSpace = 0,
+        .offsetInDescriptorsFromTableStart = 0,
+        .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+        .descriptorsVolatile = false
+    };
+
+    const RootParameterDesc rootParameters[]{
+        // uvScale and uvMax
+        {
+            .kind = RootParameterKind::ROOT_CONSTANTS,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 4,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        },
+        // The scene texture
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::PIXEL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+            .ranges = &srvRange,
+            .rangeCount = 1
+        }
+    };
+
+    const D3D12_STATIC_SAMPLER_DESC linearSampler{
+        .Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+        .AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        .AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        .AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        .MipLODBias = 0.0f,
+        .MaxAnisotropy = 1,
+        .ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER,
+        .BorderColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK,
+        .MinLOD = 0.0f,
+        .MaxLOD = D3D12_FLOAT32_MAX,
+        .ShaderRegister = 0,
+        .RegisterSpace = 0,
+        .ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL
+    };
+
+    return CreateCachedRootSignature("upscale pass", rootParameters, (uint32_t)std::size(rootParameters), &linearSampler, 1,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE, &s_upscaleRootSignature);
+}
+
+static auto CreateUpscalePipelineState() -> bool
+{
+    const D3D_SHADER_MACRO noDefines[] = { { nullptr, nullptr } };
+    ID3DBlob* vertexShaderCode = CompileShaderObjectFromPath(L"shaders/upscale.hlsl", "VSMain", "vs_5_1", noDefines);
+    ID3DBlob* pixelShaderCode = CompileShaderObjectFromPath(L"shaders/upscale.hlsl", "PSMain", "ps_5_1", noDefines);
+
+    HRESULT hRes = E_FAIL;
+    if (vertexShaderCode != nullptr && pixelShaderCode != nullptr)
+    {
+        const D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{
+            .pRootSignature = s_upscaleRootSignature,
+            .VS = { .pShaderBytecode = vertexShaderCode->GetBufferPointer(), .BytecodeLength = vertexShaderCode->GetBufferSize() },
+            .PS = { .pShaderBytecode = pixelShaderCode->GetBufferPointer(), .BytecodeLength = pixelShaderCode->GetBufferSize() },
+            .BlendState {
+                .AlphaToCoverageEnable = FALSE,
+                .IndependentBlendEnable = FALSE,
+                .RenderTarget {
+                    // RenderTarget[0]
+                    {
+                        .BlendEnable = FALSE,
+                        .LogicOpEnable = FALSE,
+                        .SrcBlend = D3D12_BLEND_ONE,
+                        .DestBlend = D3D12_BLEND_ZERO,
+                        .BlendOp = D3D12_BLEND_OP_ADD,
+                        .SrcBlendAlpha = D3D12_BLEND_ONE,
+                        .DestBlendAlpha = D3D12_BLEND_ZERO,
+                        .BlendOpAlpha = D3D12_BLEND_OP_ADD,
+                        .LogicOp = D3D12_LOGIC_OP_NOOP,
+                        .RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL
+                    }
+                }
+            },
+            .SampleMask = UINT32_MAX,
+            .RasterizerState {
+                .FillMode = D3D12_FILL_MODE_SOLID,
+                .CullMode = D3D12_CULL_MODE_NONE,
+                .FrontCounterClockwise = FALSE,
+                .DepthBias = 0,
+                .DepthBiasClamp = 0.0f,
+                .SlopeScaledDepthBias = 0.0f,
+                .DepthClipEnable = TRUE,
+                .MultisampleEnable = FALSE,
+                .AntialiasedLineEnable = FALSE,
+                .ForcedSampleCount = 0,
+                .ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
+            },
+            .DepthStencilState {
+                .DepthEnable = FALSE,
+                .DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO,
+                .DepthFunc = D3D12_COMPARISON_FUNC_NEVER,
+                .StencilEnable = FALSE,
+                .StencilReadMask = 0,
+                .StencilWriteMask = 0,
+                .FrontFace { },
+                .BackFace { }
+            },
+            // The full screen triangle is generated from SV_VertexID.
+            .InputLayout { .pInputElementDescs = nullptr, .NumElements = 0 },
+            .IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED,
+            .PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE,
+            .NumRenderTargets = 1,
+            .RTVFormats {
+                // RTVFormats[0]
+                { DXGI_FORMAT_R8G8B8A8_UNORM }
+            },
+            .DSVFormat = DXGI_FORMAT_UNKNOWN,
+            .SampleDesc { .Count = 1, .Quality = 0 },
+            .NodeMask = 0,
+            .CachedPSO { },
+            .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+        };
+
+        hRes = s_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&s_upscalePipelineState));
+        if (FAILED(hRes)) {
+            fprintf(stderr, "CreateGraphicsPipelineState for upscale pass failed: %ld\n", hRes);
+        }
+    }
+
+    if (vertexShaderCode != nullptr) {
+        vertexShaderCode->Release();
+    }
+    if (pixelShaderCode != nullptr) {
+        pixelShaderCode->Release();
+    }
+
+    return SUCCEEDED(hRes);
+}
+
+// Create the offscreen scene target, the upscale pass and the timestamp queries measuring the GPU frame time.
+static auto CreateDynamicResolutionResources() -> bool
+{
+    if (!s_dynamicResolutionEnabled) return true;
+
+    // The scene target has the full window size. Only the scaled top-left region is rendered each frame.
+    const D3D12_HEAP_PROPERTIES defaultHeapProperties{
+        .Type = D3D12_HEAP_TYPE_DEFAULT,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC sceneTargetDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        .Alignment = 0,
+        .Width = UINT64(WINDOW_WIDTH),
+        .Height = UINT(WINDOW_HEIGHT),
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+        .Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+    };
+    const D3D12_CLEAR_VALUE sceneClearValue{
+        .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+        .Color = { 0.5f, 0.6f, 0.5f, 1.0f }
+    };
+
+    HRESULT hRes = s_device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &sceneTargetDesc,
+        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &sceneClearValue, IID_PPV_ARGS(&s_sceneRenderTarget));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for scene render target failed: %ld\n", hRes);
+        return false;
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = s_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    rtvHandle.ptr += size_t(SCENE_RTV_INDEX * s_rtvDescriptorSize);
+    s_device->CreateRenderTargetView(s_sceneRenderTarget, nullptr, rtvHandle);
+    s_sceneRenderTargetId = s_renderDevice.RegisterResource(s_sceneRenderTarget, rtvHandle);
+    s_sceneRenderTargetResidency = RegisterResidentResource(s_sceneRenderTarget);
+
+    const D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        .NumDescriptors = 1,
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+        .NodeMask = 0
+    };
+    hRes = s_device->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&s_srvDescriptorHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for shader resource view failed: %ld\n", hRes);
+        return false;
+    }
+    s_device->CreateShaderResourceView(s_sceneRenderTarget, nullptr, s_srvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+
+    if (!CreateUpscaleRootSignature()) return false;
+    if (!CreateUpscalePipelineState()) return false;
+
+    if (!CreateTimestampQueries(s_device, s_commandQueue, &s_timestampQueryHeap, &s_timestampReadbackBuffer, s_timestampFrequency)) return false;
+
+    printf("Dynamic resolution is enabled with GPU frame budget: %.3f ms\n", s_dynamicResolutionController.GetSettings().targetFrameTime);
+    return true;
+}
+
+// Size of the scene region rendered at the current scale
+static auto GetSceneRenderSize() -> std::pair<UINT, UINT>
+{
+    if (!s_dynamicResolutionEnabled) return { UINT(WINDOW_WIDTH), UINT(WINDOW_HEIGHT) };
+
+    const UINT width = std::clamp(UINT(std::ceil(double(WINDOW_WIDTH) * s_renderScale)), 1U, UINT(WINDOW_WIDTH));
+    const UINT height = std::clamp(UINT(std::ceil(double(WINDOW_HEIGHT) * s_renderScale)), 1U, UINT(WINDOW_HEIGHT));
+    return { width, height };
+}
+
+// Record the pass that upscales the rendered scene region to the whole back buffer.
+static auto RecordUpscalePass(UINT sceneWidth, UINT sceneHeight, D3D12_CPU_DESCRIPTOR_HANDLE backBufferRtvHandle) -> void
+{
+    const D3D12_RESOURCE_BARRIER barriers[]{
+        {
+            .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+            .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+            .Transition {
+                .pResource = s_sceneRenderTarget,
+                .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+                .StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET,
+                .StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE
+            }
+        },
+        {
+            .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+            .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+            .Transition {
+                .pResource = s_renderTargets[s_currFrameIndex],
+                .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+                .StateBefore = D3D12_RESOURCE_STATE_PRESENT,
+                .StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET
+            }
+        }
+    };
+    s_basicCommandList->ResourceBarrier((UINT)std::size(barriers), barriers);
+
+    const D3D12_VIEWPORT viewPort{
+        .TopLeftX = 0.0f,
+        .TopLeftY = 0.0f,
+        .Width = FLOAT(WINDOW_WIDTH),
+        .Height = FLOAT(WINDOW_HEIGHT),
+        .MinDepth = 0.0f,
+        .MaxDepth = 1.0f
+    };
+    s_basicCommandList->RSSetViewports(1, &viewPort);
+
+    const D3D12_RECT scissorRect{
+        .left = 0,
+        .top = 0,
+        .right = WINDOW_WIDTH,
+        .bottom = WINDOW_HEIGHT
+    };
+    s_basicCommandList->RSSetScissorRects(1, &scissorRect);
+
+    s_basicCommandList->OMSetRenderTargets(1, &backBufferRtvHandle, FALSE, nullptr);
+
+    s_basicCommandList->SetPipelineState(s_upscalePipelineState);
+    s_basicCommandList->SetGraphicsRootSignature(s_upscaleRootSignature);
+
+    ID3D12DescriptorHeap* const descriptorHeaps[] = { s_srvDescriptorHeap };
+    s_basicCommandList->SetDescriptorHeaps((UINT)std::size(descriptorHeaps), descriptorHeaps);
+    s_basicCommandList->SetGraphicsRootDescriptorTable(1, s_srvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+
+    const float uvConstants[] = {
+        float(sceneWidth) / float(WINDOW_WIDTH), float(sceneHeight) / float(WINDOW_HEIGHT),
+        (float(sceneWidth) - 0.5f) / float(WINDOW_WIDTH), (float(sceneHeight) - 0.5f) / float(WINDOW_HEIGHT)
+    };
+    s_basicCommandList->SetGraphicsRoot32BitConstants(0, (UINT)std::size(uvConstants), uvConstants, 0);
+
+    s_basicCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    s_basicCommandList->DrawInstanced(3, 1, 0, 0);
+}
+
+// Read back the GPU time of the frame just completed and pick the render scale of the next frame.
+static auto UpdateDynamicResolution() -> void
+{
+    if (!s_dynamicResolutionEnabled) return;
+
+    double gpuFrameTime = 0.0;
+    if (!ReadTimestampDuration(s_timestampReadbackBuffer, s_timestampFrequency, gpuFrameTime)) return;
+
+    s_renderScale = s_dynamicResolutionController.Update(gpuFrameTime);
+
+    if (s_frameCount % DYNAMIC_RESOLUTION_REPORT_INTERVAL == 0)
+    {
+        auto const [sceneWidth, sceneHeight] = GetSceneRenderSize();
+        printf("Dynamic resolution: scale %.3f (%ux%u), GPU frame time %.3f ms (smoothed %.3f ms), scale changes: %u\n",
+            s_renderScale, sceneWidth, sceneHeight, gpuFrameTime, s_dynamicResolutionController.GetSmoothedFrameTime(),
+            s_dynamicResolutionController.GetChangeCount());
+    }
+}
+
+// Create the device, the pipeline and the render target of a secondary adapter, and share its result buffer
+// and fence with the primary device through cross-adapter heaps.
+// The secondary adapters use the permutation selected at startup; shader hot-reload only affects the primary adapter.
+static auto CreateSecondaryAdapterResources(SecondaryAdapter& adapter) -> bool
+{
+    ID3D12Device* const device = adapter.device;
+
+    const D3D12_COMMAND_QUEUE_DESC queueDesc{
+        .Type = D3D12_COMMAND_LIST_TYPE_DIRECT,
+        .Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL,
+        .Flags = D3D12_COMMAND_QUEUE_FLAG_NONE,
+        .NodeMask = 0
+    };
+    HRESULT hRes = device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&adapter.commandQueue));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandQueue for secondary adapter failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&adapter.commandAllocator));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandAllocator for secondary adapter failed: %ld\n", hRes);
+        return false;
+    }
+
+    // The serialized root signature blob does not depend on the device.
+    hRes = device->CreateRootSignature(0, s_rootSignatureBlob.data(), s_rootSignatureBlob.size(), IID_PPV_ARGS(&adapter.rootSignature));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateRootSignature for secondary adapter failed: %ld\n", hRes);
+        return false;
+    }
+
+    ID3DBlob* vertexShaderObj = CompileBasicShaderPermutation(ShaderStage::VERTEX, GetShaderStageKey(ShaderStage::VERTEX, s_basicShaderPermutation));
+    ID3DBlob* pixelShaderObj = CompileBasicShaderPermutation(ShaderStage::PIXEL, GetShaderStageKey(ShaderStage::PIXEL, s_basicShaderPermutation));
+    hRes = E_FAIL;
+    if (vertexShaderObj != nullptr && pixelShaderObj != nullptr)
+    {
+        hRes = CreateBasicPipelineState(device, adapter.rootSignature,
+            { .pShaderBytecode = vertexShaderObj->GetBufferPointer(), .BytecodeLength = vertexShaderObj->GetBufferSize() },
+            { .pShaderBytecode = pixelShaderObj->GetBufferPointer(), .BytecodeLength = pixelShaderObj->GetBufferSize() },
+            BasicDepthMode::NONE, &adapter.pipelineState);
+    }
+    if (vertexShaderObj != nullptr) {
+        vertexShaderObj->Release();
+    }
+    if (pixelShaderObj != nullptr) {
+        pixelShaderObj->Release();
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateGraphicsPipelineState for secondary adapter failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, adapter.commandAllocator, adapter.pipelineState, IID_PPV_ARGS(&adapter.commandList));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandList for secondary adapter failed: %ld\n", hRes);
+        return false;
+    }
+    adapter.commandList->Close();
+
+    // An upload heap is enough for the four vertices.
+    const D3D12_HEAP_PROPERTIES uploadHeapProperties{
+        .Type = D3D12_HEAP_TYPE_UPLOAD,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC vertexBufferDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = sizeof(BASIC_SQUARE_VERTICES),
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    hRes = device->CreateCommittedResource(&uploadHeapProperties, D3D12_HEAP_FLAG_NONE, &vertexBufferDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&adapter.vertexBuffer));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for secondary adapter vertex buffer failed: %ld\n", hRes);
+        return false;
+    }
+    if (!WriteBufferData(adapter.vertexBuffer, BASIC_SQUARE_VERTICES, sizeof(BASIC_SQUARE_VERTICES))) return false;
+
+    adapter.vertexBufferView = {
+        .BufferLocation = adapter.vertexBuffer->GetGPUVirtualAddress(),
+        .SizeInBytes = (uint32_t)sizeof(BASIC_SQUARE_VERTICES),
+        .StrideInBytes = sizeof(BASIC_SQUARE_VERTICES[0])
+    };
+
+    // Local render target of the window size. It stays in COPY_SOURCE between frames.
+    const D3D12_HEAP_PROPERTIES defaultHeapProperties{
+        .Type = D3D12_HEAP_TYPE_DEFAULT,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC renderTargetDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        .Alignment = 0,
+        .Width = UINT64(WINDOW_WIDTH),
+        .Height = UINT(WINDOW_HEIGHT),
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+        .Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+    };
+    const D3D12_CLEAR_VALUE clearValue{
+        .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+        .Color = { 0.5f, 0.6f, 0.5f, 1.0f }
+    };
+    hRes = device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &renderTargetDesc,
+        D3D12_RESOURCE_STATE_COPY_SOURCE, &clearValue, IID_PPV_ARGS(&adapter.renderTarget));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for secondary adapter render target failed: %ld\n", hRes);
+        return false;
+    }
+
+    const D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
+        .NumDescriptors = 1,
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+        .NodeMask = 0
+    };
+    hRes = device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&adapter.rtvDescriptorHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for secondary adapter failed: %ld\n", hRes);
+        return false;
+    }
+    device->CreateRenderTargetView(adapter.renderTarget, nullptr, adapter.rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+
+    // Row-major textures in cross-adapter heaps are optional, so the result is shared as a buffer
+    // laid out by the copyable footprint of the render target.
+    UINT64 crossAdapterBufferSize = 0;
+    device->GetCopyableFootprints(&renderTargetDesc, 0, 1, 0, &adapter.footprint, nullptr, nullptr, &crossAdapterBufferSize);
+
+    const D3D12_RESOURCE_DESC crossAdapterBufferDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = crossAdapterBufferSize,
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_ALLOW_CROSS_ADAPTER
+    };
+    // Buffers are implicitly promoted from COMMON on both adapters, so no barriers are needed for the shared buffer.
+    hRes = device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_SHARED | D3D12_HEAP_FLAG_SHARED_CROSS_ADAPTER,
+        &crossAdapterBufferDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&adapter.crossAdapterBuffer));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for cross-adapter buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    HANDLE hShared = nullptr;
+    hRes = device->CreateSharedHandle(adapter.crossAdapterBuffer, nullptr, GENERIC_ALL, nullptr, &hShared);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = s_device->OpenSharedHandle(hShared, IID_PPV_ARGS(&adapter.sharedBuffer));
+        CloseHandle(hShared);
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Share cross-adapter buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = device->CreateFence(0, D3D12_FENCE_FLAG_SHARED | D3D12_FENCE_FLAG_SHARED_CROSS_ADAPTER, IID_PPV_ARGS(&adapter.fence));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateFence for secondary adapter failed: %ld\n", hRes);
+        return false;
+    }
+
+    hShared = nullptr;
+    hRes = device->CreateSharedHandle(adapter.fence, nullptr, GENERIC_ALL, nullptr, &hShared);
+    if (SUCCEEDED(hRes))
+    {
+        hRes = s_device->OpenSharedHandle(hShared, IID_PPV_ARGS(&adapter.sharedFence));
+        CloseHandle(hShared);
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Share cross-adapter fence failed: %ld\n", hRes);
+        return false;
+    }
+
+    return CreateTimestampQueries(device, adapter.commandQueue, &adapter.timestampQueryHeap, &adapter.timestampReadbackBuffer, adapter.timestampFrequency);
+}
+
+static auto CreateMultiAdapterResources() -> bool
+{
+    if (!s_multiAdapterEnabled) return true;
+
+    if (s_secondaryAdapterCount == 0)
+    {
+        puts("WARNING: No other hardware adapter is available. Multi-adapter mode will be disabled!");
+        s_multiAdapterEnabled = false;
+        return true;
+    }
+
+    for (UINT i = 0; i < s_secondaryAdapterCount; ++i)
+    {
+        if (!CreateSecondaryAdapterResources(s_secondaryAdapters[i])) return false;
+    }
+
+    // The primary adapter measures its frame time with the same queries as dynamic resolution.
+    if (s_timestampQueryHeap == nullptr &&
+        !CreateTimestampQueries(s_device, s_commandQueue, &s_timestampQueryHeap, &s_timestampReadbackBuffer, s_timestampFrequency)) return false;
+
+    s_multiAdapterLoadBalancer = MultiAdapterLoadBalancer(s_secondaryAdapterCount + 1);
+    printf("Multi-adapter mode (split-frame) is enabled with %u adapters\n", s_secondaryAdapterCount + 1);
+
+    return true;
+}
+
+// Decide the rows each adapter renders in this frame.
+static auto PlanMultiAdapterFrame() -> void
+{
+    s_multiAdapterLoadBalancer.GetSplitRows(uint32_t(WINDOW_HEIGHT), MULTI_ADAPTER_ROW_ALIGNMENT, s_multiAdapterRowBegins);
+}
+
+// Render the band of the secondary adapter and copy it into the cross-adapter buffer.
+static auto RecordSecondaryAdapterFrame(SecondaryAdapter& adapter, UINT rowBegin, UINT rowEnd) -> bool
+{
+    HRESULT hRes = adapter.commandAllocator->Reset();
+    if (SUCCEEDED(hRes)) {
+        hRes = adapter.commandList->Reset(adapter.commandAllocator, adapter.pipelineState);
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Reset secondary adapter command list failed: %ld\n", hRes);
+        return false;
+    }
+
+    ID3D12GraphicsCommandList* const commandList = adapter.commandList;
+    commandList->EndQuery(adapter.timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0);
+
+    D3D12_RESOURCE_BARRIER barrier{
+        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        .Transition {
+            .pResource = adapter.renderTarget,
+            .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+            .StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE,
+            .StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET
+        }
+    };
+    commandList->ResourceBarrier(1, &barrier);
+
+    // The viewport covers the whole window, so the band lines up with the rest of the frame.
+    const D3D12_VIEWPORT viewPort{
+        .TopLeftX = 0.0f,
+        .TopLeftY = 0.0f,
+        .Width = FLOAT(WINDOW_WIDTH),
+        .Height = FLOAT(WINDOW_HEIGHT),
+        .MinDepth = 0.0f,
+        .MaxDepth = 1.0f
+    };
+    commandList->RSSetViewports(1, &viewPort);
+
+    const D3D12_RECT bandRect{
+        .left = 0,
+        .top = LONG(rowBegin),
+        .right = WINDOW_WIDTH,
+        .bottom = LONG(rowEnd)
+    };
+    commandList->RSSetScissorRects(1, &bandRect);
+
+    const D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = adapter.rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    commandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+
+    const float clearColor[] = { 0.5f, 0.6f, 0.5f, 1.0f };
+    commandList->ClearRenderTargetView(rtvHandle, clearColor, 1, &bandRect);
+
+    commandList->SetGraphicsRootSignature(adapter.rootSignature);
+    const union { float f; UINT i; } rotAngleConstant{ .f = s_rotateAngle };
+    commandList->SetGraphicsRoot32BitConstant(0, rotAngleConstant.i, 0);
+
+    commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+    commandList->IASetVertexBuffers(0, 1, &adapter.vertexBufferView);
+
+    // Without a depth target, the objects are drawn back to front so that the band matches those of the primary adapter.
+    for (uint32_t i = BASIC_SCENE_OBJECT_COUNT; i-- > 0;)
+    {
+        commandList->SetGraphicsRoot32BitConstants(0, BASIC_OBJECT_CONSTANT_COUNT, &BASIC_SCENE_OBJECTS[i], BASIC_OBJECT_CONSTANT_OFFSET);
+        commandList->DrawInstanced(s_vertexCount, 1, 0, 0);
+    }
+
+    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
+    commandList->ResourceBarrier(1, &barrier);
+
+    const D3D12_TEXTURE_COPY_LOCATION dstLocation{
+        .pResource = adapter.crossAdapterBuffer,
+        .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+        .PlacedFootprint = adapter.footprint
+    };
+    const D3D12_TEXTURE_COPY_LOCATION srcLocation{
+        .pResource = adapter.renderTarget,
+        .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+        .SubresourceIndex = 0
+    };
+    const D3D12_BOX bandBox{ .left = 0, .top = rowBegin, .front = 0, .right = UINT(WINDOW_WIDTH), .bottom = rowEnd, .back = 1 };
+    commandList->CopyTextureRegion(&dstLocation, 0, rowBegin, 0, &srcLocation, &bandBox);
+
+    commandList->EndQuery(adapter.timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 1);
+    commandList->ResolveQueryData(adapter.timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0, 2, adapter.timestampReadbackBuffer, 0);
+
+    hRes = commandList->Close();
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Close secondary adapter command list failed: %ld\n", hRes);
+        return false;
+    }
+
+    ID3D12CommandList* const commandLists[] = { commandList };
+    adapter.commandQueue->ExecuteCommandLists((UINT)std::size(commandLists), commandLists);
+
+    hRes = adapter.commandQueue->Signal(adapter.fence, ++adapter.fenceValue);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Signal secondary adapter fence failed: %ld\n", hRes);
+        return false;
+    }
+
+    return true;
+}
+
+// Kick off the bands of the secondary adapters, and make the primary queue wait for them.
+static auto SubmitSecondaryAdapterFrames() -> bool
+{
+    for (UINT i = 0; i < s_secondaryAdapterCount; ++i)
+    {
+        const UINT rowBegin = s_multiAdapterRowBegins[i + 1];
+        const UINT rowEnd = s_multiAdapterRowBegins[i + 2];
+        if (rowBegin >= rowEnd) continue;
+
+        auto& adapter = s_secondaryAdapters[i];
+        if (!RecordSecondaryAdapterFrame(adapter, rowBegin, rowEnd)) return false;
+
+        const HRESULT hRes = s_commandQueue->Wait(adapter.sharedFence, adapter.fenceValue);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Wait for secondary adapter fence failed: %ld\n", hRes);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Copy the bands of the secondary adapters from the shared buffers into the current back buffer, which is in RENDER_TARGET.
+static auto RecordSecondaryAdapterBandCopies() -> void
+{
+    D3D12_RESOURCE_BARRIER barrier{
+        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        .Transition {
+            .pResource = s_renderTargets[s_currFrameIndex],
+            .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+            .StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET,
+            .StateAfter = D3D12_RESOURCE_STATE_COPY_DEST
+        }
+    };
+    s_basicCommandList->ResourceBarrier(1, &barrier);
+
+    for (UINT i = 0; i < s_secondaryAdapterCount; ++i)
+    {
+        const UINT rowBegin = s_multiAdapterRowBegins[i + 1];
+        const UINT rowEnd = s_multiAdapterRowBegins[i + 2];
+        if (rowBegin >= rowEnd) continue;
+
+        const D3D12_TEXTURE_COPY_LOCATION dstLocation{
+            .pResource = s_renderTargets[s_currFrameIndex],
+            .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+            .SubresourceIndex = 0
+        };
+        const D3D12_TEXTURE_COPY_LOCATION srcLocation{
+            .pResource = s_secondaryAdapters[i].sharedBuffer,
+            .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+            .PlacedFootprint = s_secondaryAdapters[i].footprint
+        };
+        const D3D12_BOX bandBox{ .left = 0, .top = rowBegin, .front = 0, .right = UINT(WINDOW_WIDTH), .bottom = rowEnd, .back = 1 };
+        s_basicCommandList->CopyTextureRegion(&dstLocation, 0, rowBegin, 0, &srcLocation, &bandBox);
+    }
+
+    barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+    barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    s_basicCommandList->ResourceBarrier(1, &barrier);
+}
+
+// Feed the measured GPU time of every adapter that rendered rows in the frame just completed to the load balancer.
+static auto UpdateMultiAdapterLoadBalance() -> void
+{
+    if (!s_multiAdapterEnabled) return;
+
+    double frameTimes[MULTI_ADAPTER_MAX_COUNT]{ };
+    for (uint32_t i = 0; i <= s_secondaryAdapterCount; ++i)
+    {
+        const uint32_t rowCount = s_multiAdapterRowBegins[i + 1] - s_multiAdapterRowBegins[i];
+        if (rowCount == 0) continue;
+
+        ID3D12Resource* const readbackBuffer = i == 0 ? s_timestampReadbackBuffer : s_secondaryAdapters[i - 1].timestampReadbackBuffer;
+        const UINT64 frequency = i == 0 ? s_timestampFrequency : s_secondaryAdapters[i - 1].timestampFrequency;
+        if (!ReadTimestampDuration(readbackBuffer, frequency, frameTimes[i])) continue;
+
+        s_multiAdapterLoadBalancer.ReportFrameTime(i, double(rowCount) / double(WINDOW_HEIGHT), frameTimes[i]);
+    }
+
+    if (s_frameCount % MULTI_ADAPTER_REPORT_INTERVAL == 0)
+    {
+        for (uint32_t i = 0; i <= s_secondaryAdapterCount; ++i)
+        {
+            printf("Adapter[%u]: rows [%u, %u), GPU time %.3f ms, estimated full frame cost %.3f ms\n", i,
+                s_multiAdapterRowBegins[i], s_multiAdapterRowBegins[i + 1], frameTimes[i], s_multiAdapterLoadBalancer.GetFrameCost(i));
+        }
+    }
+}
+
+static auto ReleaseSecondaryAdapters() -> void
+{
+    for (UINT i = 0; i < s_secondaryAdapterCount; ++i)
+    {
+        auto& adapter = s_secondaryAdapters[i];
+
+        // Wait until the secondary adapter becomes idle.
+        if (adapter.fence != nullptr && adapter.fence->GetCompletedValue() < adapter.fenceValue) {
+            adapter.fence->SetEventOnCompletion(adapter.fenceValue, nullptr);
+        }
+
+        IUnknown* const objects[] = {
+            adapter.timestampReadbackBuffer, adapter.timestampQueryHeap, adapter.sharedFence, adapter.fence,
+            adapter.sharedBuffer, adapter.crossAdapterBuffer, adapter.rtvDescriptorHeap, adapter.renderTarget,
+            adapter.vertexBuffer, adapter.commandList, adapter.pipelineState, adapter.rootSignature,
+            adapter.commandAllocator, adapter.commandQueue, adapter.device
+        };
+        for (auto const object : objects)
+        {
+            if (object != nullptr) {
+                object->Release();
+            }
+        }
+        adapter = { };
+    }
+    s_secondaryAdapterCount = 0;
+}
+
+static auto SaveCommandCapture() -> bool
+{
+    const std::vector<uint8_t> packed = PackCommandCapture(s_commandCaptureWriter.GetCapture());
+
+    FILE* fp = nullptr;
+    if (fopen_s(&fp, s_commandCapturePath, "wb") != 0 || fp == nullptr)
+    {
+        fprintf(stderr, "Failed to create command capture file `%s`\n", s_commandCapturePath);
+        return false;
+    }
+
+    const bool done = fwrite(packed.data(), 1, packed.size(), fp) == packed.size();
+    fclose(fp);
+    if (!done)
+    {
+        fprintf(stderr, "Failed to write command capture file `%s`\n", s_commandCapturePath);
+        return false;
+    }
+
+    printf("Captured %u frames (%zu command words, %zu bytes) to `%s`\n", s_commandCaptureWriter.GetFrameCount(),
+        s_commandCaptureWriter.GetCapture().commandWords.size(), packed.size(), s_commandCapturePath);
+    return true;
+}
+
+// Executes the captured commands on the device. Captured render targets are replaced by offscreen targets,
+// captured buffers are recreated with their contents, and pipeline IDs are those of GetBasicPipelineState.
+struct D3D12CommandReplayBackend
+{
+    const CommandCapture& capture;
+    std::vector<ID3D12Resource*> resources;
+    ID3D12DescriptorHeap* rtvDescriptorHeap;
+    ID3D12DescriptorHeap* dsvDescriptorHeap;
+    ID3D12CommandAllocator* bundleAllocator;
+    std::vector<ID3D12GraphicsCommandList*> bundles;    // indexed by the bundle ID
+    ID3D12GraphicsCommandList* currentList;             // the basic command list, or the bundle being recorded
+    D3D12RenderPass renderPass;
+
+    // Drop the bundles of the previous iteration. The capture defines its bundles again before executing them.
+    auto Reset() -> bool
+    {
+        for (auto& bundle : bundles)
+        {
+            if (bundle != nullptr)
+            {
+                bundle->Release();
+                bundle = nullptr;
+            }
+        }
+
+        const HRESULT hRes = bundleAllocator->Reset();
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Reset replay bundle allocator failed: %ld\n", hRes);
+            return false;
+        }
+        return true;
+    }
+
+    auto GetRtvHandle(uint32_t resourceId) const -> D3D12_CPU_DESCRIPTOR_HANDLE
+    {
+        D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+        rtvHandle.ptr += size_t(resourceId) * s_rtvDescriptorSize;
+        return rtvHandle;
+    }
+
+    auto GetDsvHandle(uint32_t resourceId) const -> D3D12_CPU_DESCRIPTOR_HANDLE
+    {
+        D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+        dsvHandle.ptr += size_t(resourceId) * s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
+        return dsvHandle;
+    }
+
+    auto IsRenderTarget(uint32_t resourceId) const -> bool
+    {
+        return resourceId < resources.size() && capture.resources[resourceId].kind == CaptureResourceKind::RENDER_TARGET;
+    }
+
+    auto IsDepthStencil(uint32_t resourceId) const -> bool
+    {
+        return resourceId < resources.size() && capture.resources[resourceId].kind == CaptureResourceKind::DEPTH_STENCIL;
+    }
+
+    auto Execute(CaptureOpcode opcode, const uint32_t arguments[]) -> bool
+    {
+        HRESULT hRes = S_OK;
+        switch (opcode)
+        {
+        case CaptureOpcode::BEGIN_FRAME:
+            if (!BeginImmediateCommands()) return false;
+            currentList = s_basicCommandList;
+            break;
+
+        case CaptureOpcode::END_FRAME:
+            currentList = nullptr;
+            if (!SubmitImmediateCommands()) return false;
+            break;
+
+        case CaptureOpcode::BEGIN_BUNDLE:
+        {
+            const uint32_t bundleId = arguments[0];
+            if (bundleId >= bundles.size()) {
+                bundles.resize(size_t(bundleId) + 1, nullptr);
+            }
+            // Bundles are only defined between frames, when the GPU is idle.
+            if (bundles[bundleId] != nullptr) {
+                bundles[bundleId]->Release();
+            }
+            hRes = s_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_BUNDLE, bundleAllocator, nullptr, IID_PPV_ARGS(&bundles[bundleId]));
+            currentList = bundles[bundleId];
+            break;
+        }
+
+        case CaptureOpcode::END_BUNDLE:
+            hRes = currentList->Close();
+            currentList = nullptr;
+            break;
+
+        case CaptureOpcode::EXECUTE_BUNDLE:
+            if (arguments[0] >= bundles.size() || bundles[arguments[0]] == nullptr) return false;
+            currentList->ExecuteBundle(bundles[arguments[0]]);
+            break;
+
+        case CaptureOpcode::SET_PIPELINE_STATE:
+        {
+            ID3D12PipelineState* const pipelineState = GetBasicPipelineState(arguments[0]);
+            if (pipelineState == nullptr) return false;
+            currentList->SetPipelineState(pipelineState);
+            break;
+        }
+
+        case CaptureOpcode::SET_GRAPHICS_ROOT_SIGNATURE:
+            if (arguments[0] != BASIC_ROOT_SIGNATURE_ID) return false;
+            currentList->SetGraphicsRootSignature(s_rootSignature);
+            break;
+
+        case CaptureOpcode::SET_GRAPHICS_ROOT_32BIT_CONSTANT:
+            currentList->SetGraphicsRoot32BitConstant(arguments[0], arguments[1], arguments[2]);
+            break;
+
+        case CaptureOpcode::SET_VIEWPORT:
+        {
+            const D3D12_VIEWPORT viewPort{
+                .TopLeftX = CaptureWordToFloat(arguments[0]),
+                .TopLeftY = CaptureWordToFloat(arguments[1]),
+                .Width = CaptureWordToFloat(arguments[2]),
+                .Height = CaptureWordToFloat(arguments[3]),
+                .MinDepth = CaptureWordToFloat(arguments[4]),
+                .MaxDepth = CaptureWordToFloat(arguments[5])
+            };
+            currentList->RSSetViewports(1, &viewPort);
+            break;
+        }
+
+        case CaptureOpcode::SET_SCISSOR_RECT:
+        {
+            const D3D12_RECT scissorRect{ LONG(int32_t(arguments[0])), LONG(int32_t(arguments[1])), LONG(int32_t(arguments[2])), LONG(int32_t(arguments[3])) };
+            currentList->RSSetScissorRects(1, &scissorRect);
+            break;
+        }
+
+        case CaptureOpcode::SET_RENDER_TARGET:
+        {
+            if (!IsRenderTarget(arguments[0])) return false;
+            const D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = GetRtvHandle(arguments[0]);
+            currentList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+            break;
+        }
+
+        case CaptureOpcode::CLEAR_RENDER_TARGET:
+        {
+            if (!IsRenderTarget(arguments[0])) return false;
+            const float clearColor[] = {
+                CaptureWordToFloat(arguments[1]), CaptureWordToFloat(arguments[2]), CaptureWordToFloat(arguments[3]), CaptureWordToFloat(arguments[4])
+            };
+            const D3D12_RECT clearRect{ LONG(int32_t(arguments[6])), LONG(int32_t(arguments[7])), LONG(int32_t(arguments[8])), LONG(int32_t(arguments[9])) };
+            currentList->ClearRenderTargetView(GetRtvHandle(arguments[0]), clearColor, arguments[5] != 0 ? 1 : 0, arguments[5] != 0 ? &clearRect : nullptr);
+            break;
+        }
+
+        case CaptureOpcode::SET_PRIMITIVE_TOPOLOGY:
+            currentList->IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY(arguments[0]));
+            break;
+
+        case CaptureOpcode::SET_VERTEX_BUFFER:
+        {
+            if (arguments[1] >= resources.size()) return false;
+            const D3D12_VERTEX_BUFFER_VIEW vertexBufferView{
+                .BufferLocation = resources[arguments[1]]->GetGPUVirtualAddress() + arguments[2],
+                .SizeInBytes = arguments[3],
+                .StrideInBytes = arguments[4]
+            };
+            currentList->IASetVertexBuffers(arguments[0], 1, &vertexBufferView);
+            break;
+        }
+
+        case CaptureOpcode::DRAW_INSTANCED:
+            currentList->DrawInstanced(arguments[0], arguments[1], arguments[2], arguments[3]);
+            break;
+
+        case CaptureOpcode::RESOURCE_BARRIER:
+        {
+            if (arguments[0] >= resources.size()) return false;
+            if (arguments[1] == arguments[2]) break;
+
+            const D3D12_RESOURCE_BARRIER barrier{
+                .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+                .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+                .Transition {
+                    .pResource = resources[arguments[0]],
+                    .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+                    .StateBefore = D3D12_RESOURCE_STATES(arguments[1]),
+                    .StateAfter = D3D12_RESOURCE_STATES(arguments[2])
+                }
+            };
+            currentList->ResourceBarrier(1, &barrier);
+            break;
+        }
+
+        case CaptureOpcode::SET_INDEX_BUFFER:
+        {
+            if (arguments[0] >= resources.size()) return false;
+            const D3D12_INDEX_BUFFER_VIEW indexBufferView{
+                .BufferLocation = resources[arguments[0]]->GetGPUVirtualAddress() + arguments[1],
+                .SizeInBytes = arguments[2],
+                .Format = DXGI_FORMAT(arguments[3])
+            };
+            currentList->IASetIndexBuffer(&indexBufferView);
+            break;
+        }
+
+        case CaptureOpcode::DRAW_INDEXED_INSTANCED:
+            currentList->DrawIndexedInstanced(arguments[0], arguments[1], arguments[2], INT(int32_t(arguments[3])), arguments[4]);
+            break;
+
+        case CaptureOpcode::BEGIN_RENDER_PASS:
+        {
+            if (!IsRenderTarget(arguments[0])) return false;
+            const bool hasDepth = arguments[12] != CAPTURE_INVALID_ID;
+            if (hasDepth && !IsDepthStencil(arguments[12])) return false;
+            const RenderRect clearRect{ int32_t(arguments[8]), int32_t(arguments[9]), int32_t(arguments[10]), int32_t(arguments[11]) };
+            const RenderPassDesc desc{
+                .renderTarget = arguments[0],
+                .loadOp = arguments[1],
+                .storeOp = arguments[2],
+                .clearColor { CaptureWordToFloat(arguments[3]), CaptureWordToFloat(arguments[4]), CaptureWordToFloat(arguments[5]), CaptureWordToFloat(arguments[6]) },
+                .clearRect = arguments[7] != 0 ? &clearRect : nullptr,
+                .depthTarget = arguments[12],
+                .depthLoadOp = arguments[13],
+                .depthStoreOp = arguments[14],
+                .clearDepth = CaptureWordToFloat(arguments[15])
+            };
+            BeginD3D12RenderPass(currentList, resources[arguments[0]], GetRtvHandle(arguments[0]), hasDepth ? resources[arguments[12]] : nullptr,
+                hasDepth ? GetDsvHandle(arguments[12]) : D3D12_CPU_DESCRIPTOR_HANDLE{ }, desc, renderPass);
+            break;
+        }
+
+        case CaptureOpcode::END_RENDER_PASS:
+            EndD3D12RenderPass(currentList, renderPass);
+            break;
+
+        default:
+            return false;
+        }
+
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Replaying %s failed: %ld\n", CAPTURE_OPCODE_NAMES[size_t(opcode)], hRes);
+            return false;
+        }
+
+        return true;
+    }
+};
+
+static auto CreateCommandReplayResources(D3D12CommandReplayBackend& backend) -> bool
+{
+    const CommandCapture& capture = backend.capture;
+
+    const D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV,
+        .NumDescriptors = UINT(capture.resources.size()),
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+        .NodeMask = 0
+    };
+    HRESULT hRes = s_device->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&backend.rtvDescriptorHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for replay render targets failed: %ld\n", hRes);
+        return false;
+    }
+
+    const D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV,
+        .NumDescriptors = UINT(capture.resources.size()),
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+        .NodeMask = 0
+    };
+    hRes = s_device->CreateDescriptorHeap(&dsvHeapDesc, IID_PPV_ARGS(&backend.dsvDescriptorHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for replay depth targets failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = s_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_BUNDLE, IID_PPV_ARGS(&backend.bundleAllocator));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandAllocator for replay bundles failed: %ld\n", hRes);
+        return false;
+    }
+
+    const D3D12_HEAP_PROPERTIES defaultHeapProperties{
+        .Type = D3D12_HEAP_TYPE_DEFAULT,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+
+    backend.resources.resize(capture.resources.size(), nullptr);
+    for (size_t i = 0; i < capture.resources.size(); ++i)
+    {
+        auto const& desc = capture.resources[i];
+        if (desc.kind == CaptureResourceKind::BUFFER)
+        {
+            // The captured contents are followed by zeros up to the captured size.
+            std::vector<uint8_t> contents(desc.width, 0);
+            if (desc.dataSize > 0) {
+                memcpy(contents.data(), &capture.resourceData[size_t(desc.dataOffset)], size_t(desc.dataSize));
+            }
+            if (!CreateBufferWithData(s_bufferHeapPolicy, contents.data(), contents.size(), D3D12_RESOURCE_STATES(desc.initialState), &backend.resources[i])) {
+                return false;
+            }
+            continue;
+        }
+
+        if (desc.kind == CaptureResourceKind::DEPTH_STENCIL)
+        {
+            const D3D12_RESOURCE_DESC depthTargetDesc{
+                .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+                .Alignment = 0,
+                .Width = UINT64(desc.width),
+                .Height = desc.height,
+                .DepthOrArraySize = 1,
+                .MipLevels = 1,
+                .Format = DXGI_FORMAT(desc.format),
+                .SampleDesc {.Count = 1U, .Quality = 0 },
+                .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+                .Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL
+            };
+            hRes = s_device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &depthTargetDesc,
+                D3D12_RESOURCE_STATES(desc.initialState), nullptr, IID_PPV_ARGS(&backend.resources[i]));
+            if (FAILED(hRes))
+            {
+                fprintf(stderr, "CreateCommittedResource for replay depth target %zu failed: %ld\n", i, hRes);
+                return false;
+            }
+            s_device->CreateDepthStencilView(backend.resources[i], nullptr, backend.GetDsvHandle(uint32_t(i)));
+            continue;
+        }
+
+        const D3D12_RESOURCE_DESC renderTargetDesc{
+            .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+            .Alignment = 0,
+            .Width = UINT64(desc.width),
+            .Height = desc.height,
+            .DepthOrArraySize = 1,
+            .MipLevels = 1,
+            .Format = DXGI_FORMAT(desc.format),
+            .SampleDesc {.Count = 1U, .Quality = 0 },
+            .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+            .Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+        };
+        hRes = s_device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &renderTargetDesc,
+            D3D12_RESOURCE_STATES(desc.initialState), nullptr, IID_PPV_ARGS(&backend.resources[i]));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for replay render target %zu failed: %ld\n", i, hRes);
+            return false;
+        }
+        s_device->CreateRenderTargetView(backend.resources[i], nullptr, backend.GetRtvHandle(uint32_t(i)));
+    }
+
+    return true;
+}
+
+static auto ReleaseCommandReplayResources(D3D12CommandReplayBackend& backend) -> void
+{
+    for (auto const bundle : backend.bundles)
+    {
+        if (bundle != nullptr) {
+            bundle->Release();
+        }
+    }
+    for (auto const resource : backend.resources)
+    {
+        if (resource != nullptr) {
+            resource->Release();
+        }
+    }
+    if (backend.bundleAllocator != nullptr) {
+        backend.bundleAllocator->Release();
+    }
+    if (backend.rtvDescriptorHeap != nullptr) {
+        backend.rtvDescriptorHeap->Release();
+    }
+    if (backend.dsvDescriptorHeap != nullptr) {
+        backend.dsvDescriptorHeap->Release();
+    }
+}
+
+// Re-execute a capture `COMMAND_REPLAY_ITERATION_COUNT` times and report the CPU and wall time per frame.
+static auto RunCommandReplay() -> bool
+{
+    // Like the shader archive, the capture file is read into a 4-byte aligned buffer.
+    const D3D12_SHADER_BYTECODE fileObj = CreateCompiledShaderObjectFromPath(s_commandReplayPath);
+
+    CommandCapture capture{ };
+    const bool parsed = ParseCommandCapture((const uint8_t*)fileObj.pShaderBytecode, fileObj.BytecodeLength, capture);
+    if (fileObj.pShaderBytecode != nullptr) {
+        free((void*)fileObj.pShaderBytecode);
+    }
+    if (!parsed)
+    {
+        fprintf(stderr, "`%s` is not a valid command capture\n", s_commandReplayPath);
+        return false;
+    }
+
+    // Validate with the null backend first, so that an invalid capture never reaches the device.
+    NullCommandReplayBackend nullBackend(capture);
+    if (!ReplayCommandCapture(capture, nullBackend))
+    {
+        fprintf(stderr, "Invalid command capture `%s`: %s\n", s_commandReplayPath, nullBackend.GetErrorMessage());
+        return false;
+    }
+
+    D3D12CommandReplayBackend backend{ .capture = capture };
+    bool done = false;
+    do
+    {
+        if (!CreateCommandReplayResources(backend)) break;
+
+        const double toMilliseconds = 1000.0 / double(s_performanceFrequency.QuadPart);
+        double totalTime = 0.0;
+        double minTime = std::numeric_limits<double>::max();
+        done = true;
+        for (UINT i = 0; i < COMMAND_REPLAY_ITERATION_COUNT && done; ++i)
+        {
+            LARGE_INTEGER beginTime{ };
+            QueryPerformanceCounter(&beginTime);
+
+            done = backend.Reset() && ReplayCommandCapture(capture, backend);
+
+            LARGE_INTEGER endTime{ };
+            QueryPerformanceCounter(&endTime);
+
+            const double iterationTime = double(endTime.QuadPart - beginTime.QuadPart) * toMilliseconds;
+            totalTime += iterationTime;
+            if (iterationTime < minTime) {
+                minTime = iterationTime;
+            }
+        }
+        if (!done)
+        {
+            fprintf(stderr, "Replaying command capture `%s` failed\n", s_commandReplayPath);
+            break;
+        }
+
+        const double frameCount = double(capture.frameCount > 0 ? capture.frameCount : 1);
+        printf("Replayed `%s` (%u frames, %llu commands) %u times: average %.3f ms per frame, best %.3f ms per frame\n",
+            s_commandReplayPath, capture.frameCount, (unsigned long long)nullBackend.GetTotalCommandCount(), COMMAND_REPLAY_ITERATION_COUNT,
+            totalTime / (COMMAND_REPLAY_ITERATION_COUNT * frameCount), minTime / frameCount);
+    } while (false);
+
+    ReleaseCommandReplayResources(backend);
+    return done;
+}
+
+// ==== Depth prepass and Hi-Z occlusion culling (HiZOcclusion.h) ====
+
+// Matches cbHiZ in shaders/hiz.hlsl
+struct HiZConstants
+{
+    UINT sourceWidth;
+    UINT sourceHeight;
+    UINT destinationWidth;
+    UINT destinationHeight;
+};
+
+static auto CreateHiZRootSignature() -> bool
+{
+    // The source is the depth target or the level of the previous dispatch, both written before its table is set.
+    const RootDescriptorRange srvRange{
+        .type = RootDescriptorRangeType::SRV,
+        .descriptorCount = 1,
+        .baseShaderRegister = 0,
+        .registerSpace = 0,
+        .offsetInDescriptorsFromTableStart = 0,
+        .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+        .descriptorsVolatile = false
+    };
+    const RootDescriptorRange uavRange{
+        .type = RootDescriptorRangeType::UAV,
+        .descriptorCount = 1,
+        .baseShaderRegister = 0,
+        .registerSpace = 0,
+        .offsetInDescriptorsFromTableStart = 0,
+        .volatility = RootDataVolatility::VOLATILE,
+        .descriptorsVolatile = false
+    };
+
+    const RootParameterDesc rootParameters[]{
+        // cbHiZ
+        {
+            .kind = RootParameterKind::ROOT_CONSTANTS,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = UINT(sizeof(HiZConstants) / sizeof(UINT)),
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        },
+        // The source level
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+            .ranges = &srvRange,
+            .rangeCount = 1
+        },
+        // The destination level
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = &uavRange,
+            .rangeCount = 1
+        }
+    };
+
+    return CreateCachedRootSignature("Hi-Z build", rootParameters, (uint32_t)std::size(rootParameters), nullptr, 0,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE, &s_hiZRootSignature);
+}
+
+static auto CreateHiZPipelineState() -> bool
+{
+    const D3D_SHADER_MACRO noDefines[] = { { nullptr, nullptr } };
+    ID3DBlob* shaderObject = CompileShaderObjectFromPath(L"shaders/hiz.hlsl", "HiZReduceCS", "cs_5_1", noDefines);
+    if (shaderObject == nullptr) return false;
+
+    const D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc{
+        .pRootSignature = s_hiZRootSignature,
+        .CS = { .pShaderBytecode = shaderObject->GetBufferPointer(), .BytecodeLength = shaderObject->GetBufferSize() },
+        .NodeMask = 0,
+        .CachedPSO { },
+        .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+    };
+    const HRESULT hRes = s_device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&s_hiZPipelineState));
+    shaderObject->Release();
+
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateComputePipelineState for Hi-Z build failed: %ld\n", hRes);
+        return false;
+    }
+    return true;
+}
+
+// Create the Hi-Z texture, whose mip m is the Hi-Z level m + 1 of the window-sized depth target, its views and the readback buffer.
+static auto CreateHiZOcclusionResources() -> bool
+{
+    if (!s_occlusionCullingEnabled) return true;
+
+    s_hiZReadbackLevel = GetHiZReadbackLevel(UINT(WINDOW_WIDTH), UINT(WINDOW_HEIGHT), BASIC_HIZ_READBACK_SIZE);
+
+    const D3D12_HEAP_PROPERTIES defaultHeapProperties{
+        .Type = D3D12_HEAP_TYPE_DEFAULT,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC hiZTextureDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        .Alignment = 0,
+        .Width = UINT64(std::max(GetHiZPaddedSize(UINT(WINDOW_WIDTH)) >> 1, 1U)),
+        .Height = std::max(GetHiZPaddedSize(UINT(WINDOW_HEIGHT)) >> 1, 1U),
+        .DepthOrArraySize = 1,
+        .MipLevels = UINT16(s_hiZReadbackLevel),
+        .Format = DXGI_FORMAT_R32_FLOAT,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+        .Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+    };
+
+    HRESULT hRes = s_device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &hiZTextureDesc,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&s_hiZTexture));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for Hi-Z texture failed: %ld\n", hRes);
+        return false;
+    }
+    s_hiZTextureResidency = RegisterResidentResource(s_hiZTexture);
+
+    const D3D12_DESCRIPTOR_HEAP_DESC hiZHeapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        .NumDescriptors = 1 + 2 * s_hiZReadbackLevel,
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+        .NodeMask = 0
+    };
+    hRes = s_device->CreateDescriptorHeap(&hiZHeapDesc, IID_PPV_ARGS(&s_hiZDescriptorHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for Hi-Z build failed: %ld\n", hRes);
+        return false;
+    }
+
+    const UINT descriptorSize = s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    D3D12_CPU_DESCRIPTOR_HANDLE descriptorHandle = s_hiZDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+
+    // The depth target is typeless, so that it can be read as R32_FLOAT.
+    const D3D12_SHADER_RESOURCE_VIEW_DESC depthSrvDesc{
+        .Format = DXGI_FORMAT_R32_FLOAT,
+        .ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D,
+        .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+        .Texture2D { .MostDetailedMip = 0, .MipLevels = 1, .PlaneSlice = 0, .ResourceMinLODClamp = 0.0f }
+    };
+    s_device->CreateShaderResourceView(s_depthTarget, &depthSrvDesc, descriptorHandle);
+    descriptorHandle.ptr += descriptorSize;
+
+    for (UINT mip = 0; mip < s_hiZReadbackLevel; ++mip)
+    {
+        const D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{
+            .Format = DXGI_FORMAT_R32_FLOAT,
+            .ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D,
+            .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+            .Texture2D { .MostDetailedMip = mip, .MipLevels = 1, .PlaneSlice = 0, .ResourceMinLODClamp = 0.0f }
+        };
+        s_device->CreateShaderResourceView(s_hiZTexture, &srvDesc, descriptorHandle);
+        descriptorHandle.ptr += descriptorSize;
+
+        const D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc{
+            .Format = DXGI_FORMAT_R32_FLOAT,
+            .ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D,
+            .Texture2D { .MipSlice = mip, .PlaneSlice = 0 }
+        };
+        s_device->CreateUnorderedAccessView(s_hiZTexture, nullptr, &uavDesc, descriptorHandle);
+        descriptorHandle.ptr += descriptorSize;
+    }
+
+    // Only the last mip, the coarsest level, is read back.
+    UINT64 readbackSize = 0;
+    s_device->GetCopyableFootprints(&hiZTextureDesc, s_hiZReadbackLevel - 1, 1, 0, &s_hiZReadbackFootprint, nullptr, nullptr, &readbackSize);
+
+    const D3D12_HEAP_PROPERTIES readbackHeapProperties{
+        .Type = D3D12_HEAP_TYPE_READBACK,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC readbackBufferDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = readbackSize,
+        .Height = 1,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    hRes = s_device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackBufferDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&s_hiZReadbackBuffer));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for Hi-Z readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    if (!CreateHiZRootSignature()) return false;
+    if (!CreateHiZPipelineState()) return false;
+
+    printf("Hi-Z occlusion culling is enabled with the %ux%u level %u read back\n", s_hiZReadbackFootprint.Footprint.Width,
+        s_hiZReadbackFootprint.Footprint.Height, s_hiZReadbackLevel);
+    return true;
+}
+
+static auto ReleaseHiZOcclusionResources() -> void
+{
+    if (s_hiZPipelineState != nullptr)
+    {
+        s_hiZPipelineState->Release();
+        s_hiZPipelineState = nullptr;
+    }
+    if (s_hiZRootSignature != nullptr)
+    {
+        s_hiZRootSignature->Release();
+        s_hiZRootSignature = nullptr;
+    }
+    if (s_hiZReadbackBuffer != nullptr)
+    {
+        s_hiZReadbackBuffer->Release();
+        s_hiZReadbackBuffer = nullptr;
+    }
+    if (s_hiZDescriptorHeap != nullptr)
+    {
+        s_hiZDescriptorHeap->Release();
+        s_hiZDescriptorHeap = nullptr;
+    }
+    if (s_hiZTexture != nullptr)
+    {
+        s_hiZTexture->Release();
+        s_hiZTexture = nullptr;
+    }
+}
+
+static auto MakeTransitionBarrier(ID3D12Resource* resource, UINT subresource, D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter)
+    -> D3D12_RESOURCE_BARRIER
+{
+    return D3D12_RESOURCE_BARRIER{
+        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        .Transition {
+            .pResource = resource,
+            .Subresource = subresource,
+            .StateBefore = stateBefore,
+            .StateAfter = stateAfter
+        }
+    };
+}
+
+// Reduce the `sceneWidth` x `sceneHeight` region of the depth target into the Hi-Z levels 1 to `s_hiZReadbackLevel`,
+// one dispatch per level, and copy the last one to `s_hiZReadbackBuffer`. The depth target is in DEPTH_WRITE state.
+static auto RecordHiZBuildPass(UINT sceneWidth, UINT sceneHeight) -> void
+{
+    const D3D12_RESOURCE_BARRIER depthToShaderResource = MakeTransitionBarrier(s_depthTarget, 0,
+        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    s_basicCommandList->ResourceBarrier(1, &depthToShaderResource);
+
+    s_basicCommandList->SetPipelineState(s_hiZPipelineState);
+    s_basicCommandList->SetComputeRootSignature(s_hiZRootSignature);
+    ID3D12DescriptorHeap* const descriptorHeaps[] = { s_hiZDescriptorHeap };
+    s_basicCommandList->SetDescriptorHeaps((UINT)std::size(descriptorHeaps), descriptorHeaps);
+
+    const UINT descriptorSize = s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    const D3D12_GPU_DESCRIPTOR_HANDLE heapStart = s_hiZDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
+    const UINT paddedWidth = GetHiZPaddedSize(UINT(WINDOW_WIDTH));
+    const UINT paddedHeight = GetHiZPaddedSize(UINT(WINDOW_HEIGHT));
+
+    UINT sourceWidth = sceneWidth;
+    UINT sourceHeight = sceneHeight;
+    for (UINT level = 1; level <= s_hiZReadbackLevel; ++level)
+    {
+        const UINT mip = level - 1;
+        if (level > 1)
+        {
+            // The previous level is the source of this one.
+            const D3D12_RESOURCE_BARRIER barrier = MakeTransitionBarrier(s_hiZTexture, mip - 1,
+                D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+            s_basicCommandList->ResourceBarrier(1, &barrier);
+        }
+
+        const HiZConstants constants{
+            .sourceWidth = sourceWidth,
+            .sourceHeight = sourceHeight,
+            .destinationWidth = std::max(paddedWidth >> level, 1U),
+            .destinationHeight = std::max(paddedHeight >> level, 1U)
+        };
+        s_basicCommandList->SetComputeRoot32BitConstants(0, UINT(sizeof(constants) / sizeof(UINT)), &constants, 0);
+
+        const UINT sourceIndex = level == 1 ? 0 : 1 + 2 * (mip - 1);
+        const UINT destinationIndex = 2 + 2 * mip;
+        s_basicCommandList->SetComputeRootDescriptorTable(1, D3D12_GPU_DESCRIPTOR_HANDLE{ heapStart.ptr + UINT64(sourceIndex) * descriptorSize });
+        s_basicCommandList->SetComputeRootDescriptorTable(2, D3D12_GPU_DESCRIPTOR_HANDLE{ heapStart.ptr + UINT64(destinationIndex) * descriptorSize });
+        s_basicCommandList->Dispatch((constants.destinationWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+            (constants.destinationHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+        sourceWidth = constants.destinationWidth;
+        sourceHeight = constants.destinationHeight;
+    }
+
+    const UINT lastMip = s_hiZReadbackLevel - 1;
+    const D3D12_RESOURCE_BARRIER toCopySource = MakeTransitionBarrier(s_hiZTexture, lastMip,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    s_basicCommandList->ResourceBarrier(1, &toCopySource);
+
+    const D3D12_TEXTURE_COPY_LOCATION destination{
+        .pResource = s_hiZReadbackBuffer,
+        .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+        .PlacedFootprint = s_hiZReadbackFootprint
+    };
+    const D3D12_TEXTURE_COPY_LOCATION source{
+        .pResource = s_hiZTexture,
+        .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+        .SubresourceIndex = lastMip
+    };
+    s_basicCommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+
+    // Back to the states the next frame expects
+    std::vector<D3D12_RESOURCE_BARRIER> restoreBarriers;
+    restoreBarriers.reserve(size_t(s_hiZReadbackLevel) + 1);
+    restoreBarriers.push_back(MakeTransitionBarrier(s_depthTarget, 0, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+    for (UINT mip = 0; mip < lastMip; ++mip) {
+        restoreBarriers.push_back(MakeTransitionBarrier(s_hiZTexture, mip, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    }
+    restoreBarriers.push_back(MakeTransitionBarrier(s_hiZTexture, lastMip, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    s_basicCommandList->ResourceBarrier(UINT(restoreBarriers.size()), restoreBarriers.data());
+
+    // The frame being recorded will signal `s_fenceValue + 1`.
+    s_hiZReadbackFenceValue = s_fenceValue + 1;
+    s_hiZPendingSceneWidth = sceneWidth;
+    s_hiZPendingSceneHeight = sceneHeight;
+}
+
+// Build the pyramid the next frames are culled with from the level read back, once the frame that wrote it has completed.
+static auto UpdateHiZPyramid() -> void
+{
+    if (s_hiZReadbackFenceValue == 0 || s_fence->GetCompletedValue() < s_hiZReadbackFenceValue) return;
+
+    const D3D12_RANGE readRange{ 0, SIZE_T(s_hiZReadbackFootprint.Footprint.RowPitch) * s_hiZReadbackFootprint.Footprint.Height };
+    void* pData = nullptr;
+    const HRESULT hRes = s_hiZReadbackBuffer->Map(0, &readRange, &pData);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map Hi-Z readback buffer failed: %ld\n", hRes);
+        return;
+    }
+
+    const auto* const depths = static_cast<const float*>(pData);
+    s_hiZPyramid = BuildHiZPyramid(CreateHiZBaseLevel(depths, s_hiZReadbackFootprint.Footprint.Width, s_hiZReadbackFootprint.Footprint.Height,
+        s_hiZReadbackFootprint.Footprint.RowPitch / UINT(sizeof(float))), s_hiZReadbackLevel);
+    s_hiZSceneWidth = s_hiZPendingSceneWidth;
+    s_hiZSceneHeight = s_hiZPendingSceneHeight;
+
+    const D3D12_RANGE writeRange{ 0, 0 };
+    s_hiZReadbackBuffer->Unmap(0, &writeRange);
+    s_hiZReadbackFenceValue = 0;
+}
+
+// Fill `s_visibleObjects` with the scene objects of the frame being recorded. The objects are tested against the pyramid
+// of the last frame read back, at the scene size of that frame; until there is one, they are all drawn.
+static auto CullBasicSceneObjects() -> void
+{
+    s_visibleObjects.clear();
+    const bool testEnabled = s_occlusionCullingEnabled && !s_hiZPyramid.levels.empty();
+    for (auto const& object : BASIC_SCENE_OBJECTS)
+    {
+        if (testEnabled)
+        {
+            ++s_hiZCullStats.testedCount;
+            if (TestHiZOcclusion(s_hiZPyramid, GetBasicObjectHiZBounds(object, float(s_hiZSceneWidth), float(s_hiZSceneHeight))))
+            {
+                ++s_hiZCullStats.culledCount;
+                continue;
+            }
+        }
+        s_visibleObjects.push_back(object);
+    }
+}
+
+// Print the objects culled per frame, and the overdraw of the scene pass when the GPU profiler is enabled:
+// the pixel shader invocations per pixel of the scene, which the early depth test and the depth prepass bring down to 1.
+static auto ReportDepthStats(UINT64 frameCount) -> void
+{
+    if (s_occlusionCullingEnabled)
+    {
+        printf("Hi-Z occlusion culling: %.2f of %u objects culled per frame\n", double(s_hiZCullStats.culledCount) / double(frameCount),
+            BASIC_SCENE_OBJECT_COUNT);
+        s_hiZCullStats = HiZCullStats{ };
+    }
+
+    if (s_gpuProfiler == nullptr) return;
+
+    auto const [sceneWidth, sceneHeight] = GetSceneRenderSize();
+    const UINT rowCount = s_multiAdapterEnabled ? s_multiAdapterRowBegins[1] - s_multiAdapterRowBegins[0] : sceneHeight;
+    for (auto const& entry : s_gpuProfiler->GetSummary())
+    {
+        if (entry.depth != 0 || strcmp(entry.name, "Scene pass") != 0 || entry.sampleCount == 0 || rowCount == 0) continue;
+
+        const double psInvocations = double(entry.totalStatistics.psInvocations) / double(entry.sampleCount);
+        printf("Scene pass overdraw: %.2f pixel shader invocations per pixel (depth prepass %s)\n", psInvocations / (double(sceneWidth) * double(rowCount)),
+            s_depthPrepassEnabled ? "on" : "off");
+    }
+}
+
+// ==== Particles (ParticleSystem.h) ====
+
+// Matches cbParticles in shaders/particles.hlsl
+struct ParticleConstants
+{
+    ParticleSettings settings;
+    uint32_t frameIndex;
+};
+
+static auto GetParticleAliveCounterOffset(uint32_t parity) -> UINT64
+{
+    return UINT64(1 + parity) * D3D12_UAV_COUNTER_PLACEMENT_ALIGNMENT;
+}
+
+static auto GetParticleDescriptorHandle(UINT index) -> D3D12_GPU_DESCRIPTOR_HANDLE
+{
+    D3D12_GPU_DESCRIPTOR_HANDLE descriptorHandle = s_particleDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
+    descriptorHandle.ptr += UINT64(index) * s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    return descriptorHandle;
+}
+
+// Shared by the update dispatches and the draw
+static auto CreateParticleRootSignature() -> bool
+{
+    const RootDescriptorRange uavRange{
+        .type = RootDescriptorRangeType::UAV,
+        .descriptorCount = PARTICLE_UAV_TABLE_SIZE,
+        .baseShaderRegister = 0,
+        .registerSpace = 0,
+        .offsetInDescriptorsFromTableStart = 0,
+        .volatility = RootDataVolatility::VOLATILE,
+        .descriptorsVolatile = false
+    };
+    // The update of the GPU mode or the CPU step has written them before the draw.
+    const RootDescriptorRange srvRange{
+        .type = RootDescriptorRangeType::SRV,
+        .descriptorCount = PARTICLE_SRV_TABLE_SIZE,
+        .baseShaderRegister = 1,
+        .registerSpace = 0,
+        .offsetInDescriptorsFromTableStart = 0,
+        .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+        .descriptorsVolatile = false
+    };
+
+    const RootParameterDesc rootParameters[]{
+        // cbParticles
+        {
+            .kind = RootParameterKind::ROOT_CONSTANTS,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = UINT(sizeof(ParticleConstants) / sizeof(UINT)),
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        },
+        // particleCounts, into which the counters are copied between the dispatches of the update
+        {
+            .kind = RootParameterKind::ROOT_SRV,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        },
+        // The particle buffer and the lists of the update
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = &uavRange,
+            .rangeCount = 1
+        },
+        // The particle buffer and the alive list of the draw
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::VERTEX,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+            .ranges = &srvRange,
+            .rangeCount = 1
+        }
+    };
+
+    return CreateCachedRootSignature("particles", rootParameters, (uint32_t)std::size(rootParameters), nullptr, 0,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE, &s_particleRootSignature);
+}
+
+static auto CreateParticleComputePipelineState(const char* entryPoint, ID3D12PipelineState** ppPipelineState) -> bool
+{
+    const D3D_SHADER_MACRO noDefines[] = { { nullptr, nullptr } };
+    ID3DBlob* shaderObject = CompileShaderObjectFromPath(L"shaders/particles.hlsl", entryPoint, "cs_5_1", noDefines);
+    if (shaderObject == nullptr) return false;
+
+    const D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc{
+        .pRootSignature = s_particleRootSignature,
+        .CS = { .pShaderBytecode = shaderObject->GetBufferPointer(), .BytecodeLength = shaderObject->GetBufferSize() },
+        .NodeMask = 0,
+        .CachedPSO { },
+        .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+    };
+    const HRESULT hRes = s_device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(ppPipelineState));
+    shaderObject->Release();
+
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateComputePipelineState for %s failed: %ld\n", entryPoint, hRes);
+        return false;
+    }
+    return true;
+}
+
+// Additive blending, and a depth test against the scene without depth writes
+static auto CreateParticleDrawPipelineState() -> bool
+{
+    const D3D_SHADER_MACRO noDefines[] = { { nullptr, nullptr } };
+    ID3DBlob* vertexShaderCode = CompileShaderObjectFromPath(L"shaders/particles.hlsl", "VSMain", "vs_5_1", noDefines);
+    ID3DBlob* pixelShaderCode = CompileShaderObjectFromPath(L"shaders/particles.hlsl", "PSMain", "ps_5_1", noDefines);
+
+    HRESULT hRes = E_FAIL;
+    if (vertexShaderCode != nullptr && pixelShaderCode != nullptr)
+    {
+        const D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{
+            .pRootSignature = s_particleRootSignature,
+            .VS = { .pShaderBytecode = vertexShaderCode->GetBufferPointer(), .BytecodeLength = vertexShaderCode->GetBufferSize() },
+            .PS = { .pShaderBytecode = pixelShaderCode->GetBufferPointer(), .BytecodeLength = pixelShaderCode->GetBufferSize() },
+            .BlendState {
+                .AlphaToCoverageEnable = FALSE,
+                .IndependentBlendEnable = FALSE,
+                .RenderTarget {
+                    // RenderTarget[0]
+                    {
+                        .BlendEnable = TRUE,
+                        .LogicOpEnable = FALSE,
+                        .SrcBlend = D3D12_BLEND_ONE,
+                        .DestBlend = D3D12_BLEND_ONE,
+                        .BlendOp = D3D12_BLEND_OP_ADD,
+                        .SrcBlendAlpha = D3D12_BLEND_ZERO,
+                        .DestBlendAlpha = D3D12_BLEND_ONE,
+                        .BlendOpAlpha = D3D12_BLEND_OP_ADD,
+                        .LogicOp = D3D12_LOGIC_OP_NOOP,
+                        .RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL
+                    }
+                }
+            },
+            .SampleMask = UINT32_MAX,
+            .RasterizerState {
+                .FillMode = D3D12_FILL_MODE_SOLID,
+                .CullMode = D3D12_CULL_MODE_NONE,
+                .FrontCounterClockwise = FALSE,
+                .DepthBias = 0,
+                .DepthBiasClamp = 0.0f,
+                .SlopeScaledDepthBias = 0.0f,
+                .DepthClipEnable = TRUE,
+                .MultisampleEnable = FALSE,
+                .AntialiasedLineEnable = FALSE,
+                .ForcedSampleCount = 0,
+                .ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
+            },
+            .DepthStencilState {
+                .DepthEnable = TRUE,
+                .DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO,
+                .DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL,
+                .StencilEnable = FALSE,
+                .StencilReadMask = 0,
+                .StencilWriteMask = 0,
+                .FrontFace { },
+                .BackFace { }
+            },
+            // The quads are generated from SV_VertexID, and the particles are fetched with SV_InstanceID.
+            .InputLayout { .pInputElementDescs = nullptr, .NumElements = 0 },
+            .IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED,
+            .PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE,
+            .NumRenderTargets = 1,
+            .RTVFormats {
+                // RTVFormats[0]
+                { DXGI_FORMAT_R8G8B8A8_UNORM }
+            },
+            .DSVFormat = DXGI_FORMAT_D32_FLOAT,
+            .SampleDesc { .Count = 1, .Quality = 0 },
+            .NodeMask = 0,
+            .CachedPSO { },
+            .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+        };
+
+        hRes = s_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&s_particleDrawPipelineState));
+        if (FAILED(hRes)) {
+            fprintf(stderr, "CreateGraphicsPipelineState for particles failed: %ld\n", hRes);
+        }
+    }
+
+    if (vertexShaderCode != nullptr) {
+        vertexShaderCode->Release();
+    }
+    if (pixelShaderCode != nullptr) {
+        pixelShaderCode->Release();
+    }
+
+    return SUCCEEDED(hRes);
+}
+
+// The particles as t1 and a list of their indices as t2, at `index` of `s_particleDescriptorHeap`
+static auto CreateParticleBufferSrvs(ID3D12Resource* particleBuffer, ID3D12Resource* listBuffer, UINT index) -> void
+{
+    D3D12_CPU_DESCRIPTOR_HANDLE descriptorHandle = s_particleDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    descriptorHandle.ptr += SIZE_T(index) * s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    ID3D12Resource* const buffers[] = { particleBuffer, listBuffer };
+    const UINT strides[] = { UINT(sizeof(GpuParticle)), UINT(sizeof(uint32_t)) };
+    for (size_t i = 0; i < std::size(buffers); ++i)
+    {
+        const D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .ViewDimension = D3D12_SRV_DIMENSION_BUFFER,
+            .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+            .Buffer { .FirstElement = 0, .NumElements = s_particleSettings.maxParticleCount, .StructureByteStride = strides[i],
+                      .Flags = D3D12_BUFFER_SRV_FLAG_NONE }
+        };
+        s_device->CreateShaderResourceView(buffers[i], &srvDesc, descriptorHandle);
+        descriptorHandle.ptr += s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    }
+}
+
+// Fill the dead list with all the slots, empty the alive lists and zero the instance count of the draw. Waits for completion.
+static auto ResetGpuParticles() -> bool
+{
+    const uint32_t maxCount = s_particleSettings.maxParticleCount;
+    const size_t deadListOffset = size_t(PARTICLE_COUNTER_BUFFER_SIZE) + sizeof(D3D12_DRAW_ARGUMENTS);
+    std::vector<uint8_t> initialData(deadListOffset + size_t(maxCount) * sizeof(uint32_t));
+
+    memcpy(initialData.data() + PARTICLE_DEAD_COUNTER_OFFSET, &maxCount, sizeof(maxCount));
+    const D3D12_DRAW_ARGUMENTS drawArguments{ .VertexCountPerInstance = 4, .InstanceCount = 0, .StartVertexLocation = 0, .StartInstanceLocation = 0 };
+    memcpy(initialData.data() + PARTICLE_COUNTER_BUFFER_SIZE, &drawArguments, sizeof(drawArguments));
+    auto* const deadList = reinterpret_cast<uint32_t*>(initialData.data() + deadListOffset);
+    for (uint32_t i = 0; i < maxCount; ++i) {
+        deadList[i] = i;
+    }
+
+    ComHandle<ID3D12Resource> stagingBuffer;
+    const HRESULT hRes = CreateCpuWrittenBuffer(s_bufferHeapPolicy, UINT64(initialData.size()), D3D12_RESOURCE_STATE_GENERIC_READ,
+        stagingBuffer.ReleaseAndGetAddressOf());
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for particle staging buffer failed: %ld\n", hRes);
+        return false;
+    }
+    if (!WriteBufferData(stagingBuffer.Get(), initialData.data(), initialData.size())) return false;
+
+    if (!BeginImmediateCommands()) return false;
+
+    const D3D12_RESOURCE_BARRIER toCopyDest[]{
+        MakeTransitionBarrier(s_particleCounterBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST),
+        MakeTransitionBarrier(s_particleDeadListBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST),
+        MakeTransitionBarrier(s_particleDrawArgumentBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST)
+    };
+    s_basicCommandList->ResourceBarrier((UINT)std::size(toCopyDest), toCopyDest);
+
+    s_basicCommandList->CopyBufferRegion(s_particleCounterBuffer, 0, stagingBuffer.Get(), 0, PARTICLE_COUNTER_BUFFER_SIZE);
+    s_basicCommandList->CopyBufferRegion(s_particleDrawArgumentBuffer, 0, stagingBuffer.Get(), PARTICLE_COUNTER_BUFFER_SIZE, sizeof(D3D12_DRAW_ARGUMENTS));
+    s_basicCommandList->CopyBufferRegion(s_particleDeadListBuffer, 0, stagingBuffer.Get(), UINT64(deadListOffset), UINT64(maxCount) * sizeof(uint32_t));
+
+    const D3D12_RESOURCE_BARRIER fromCopyDest[]{
+        MakeTransitionBarrier(s_particleCounterBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+        MakeTransitionBarrier(s_particleDeadListBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+        MakeTransitionBarrier(s_particleDrawArgumentBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT)
+    };
+    s_basicCommandList->ResourceBarrier((UINT)std::size(fromCopyDest), fromCopyDest);
+
+    if (!SubmitImmediateCommands()) return false;
+
+    s_particleFrameIndex = 0;
+    return true;
+}
+
+// The particle buffer, the dead list and the two alive lists with their counters, the draw arguments and their views
+static auto CreateGpuParticleResources() -> bool
+{
+    const UINT64 maxCount = UINT64(s_particleSettings.maxParticleCount);
+    HRESULT hRes = CreateGpuLocalBuffer(maxCount * sizeof(GpuParticle), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS, &s_particleBuffer);
+    if (SUCCEEDED(hRes)) {
+        hRes = CreateGpuLocalBuffer(maxCount * sizeof(uint32_t), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, &s_particleDeadListBuffer);
+    }
+    for (auto& aliveListBuffer : s_particleAliveListBuffers)
+    {
+        if (SUCCEEDED(hRes)) {
+            hRes = CreateGpuLocalBuffer(maxCount * sizeof(uint32_t), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, &aliveListBuffer);
+        }
+    }
+    if (SUCCEEDED(hRes)) {
+        hRes = CreateGpuLocalBuffer(PARTICLE_COUNTER_BUFFER_SIZE, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, &s_particleCounterBuffer);
+    }
+    if (SUCCEEDED(hRes)) {
+        hRes = CreateGpuLocalBuffer(D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, &s_particleCountBuffer);
+    }
+    if (SUCCEEDED(hRes)) {
+        hRes = CreateGpuLocalBuffer(sizeof(D3D12_DRAW_ARGUMENTS), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, &s_particleDrawArgumentBuffer);
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for particle buffers failed: %ld\n", hRes);
+        return false;
+    }
+
+    const D3D12_HEAP_PROPERTIES readbackHeapProperties{
+        .Type = D3D12_HEAP_TYPE_READBACK,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC readbackBufferDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = sizeof(uint32_t),
+        .Height = 1,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    hRes = s_device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackBufferDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&s_particleReadbackBuffer));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for particle readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    const D3D12_INDIRECT_ARGUMENT_DESC argumentDesc{ .Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW };
+    const D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc{
+        .ByteStride = UINT(sizeof(D3D12_DRAW_ARGUMENTS)),
+        .NumArgumentDescs = 1,
+        .pArgumentDescs = &argumentDesc,
+        .NodeMask = 0
+    };
+    hRes = s_device->CreateCommandSignature(&commandSignatureDesc, nullptr, IID_PPV_ARGS(&s_particleCommandSignature));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandSignature for particles failed: %ld\n", hRes);
+        return false;
+    }
+
+    const UINT descriptorSize = s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    const D3D12_CPU_DESCRIPTOR_HANDLE heapStart = s_particleDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    auto const createListUav = [&](ID3D12Resource* listBuffer, UINT64 counterOffset, UINT index) {
+        const D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc{
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .ViewDimension = D3D12_UAV_DIMENSION_BUFFER,
+            .Buffer { .FirstElement = 0, .NumElements = UINT(maxCount), .StructureByteStride = UINT(sizeof(uint32_t)),
+                      .CounterOffsetInBytes = counterOffset, .Flags = D3D12_BUFFER_UAV_FLAG_NONE }
+        };
+        s_device->CreateUnorderedAccessView(listBuffer, s_particleCounterBuffer, &uavDesc, D3D12_CPU_DESCRIPTOR_HANDLE{ heapStart.ptr + SIZE_T(index) * descriptorSize });
+    };
+
+    for (uint32_t parity = 0; parity < 2; ++parity)
+    {
+        // u0 to u5 of the update of a frame with this parity
+        const UINT tableIndex = parity * PARTICLE_UAV_TABLE_SIZE;
+        const D3D12_UNORDERED_ACCESS_VIEW_DESC particleUavDesc{
+            .Format = DXGI_FORMAT_UNKNOWN,
+            .ViewDimension = D3D12_UAV_DIMENSION_BUFFER,
+            .Buffer { .FirstElement = 0, .NumElements = UINT(maxCount), .StructureByteStride = UINT(sizeof(GpuParticle)),
+                      .CounterOffsetInBytes = 0, .Flags = D3D12_BUFFER_UAV_FLAG_NONE }
+        };
+        s_device->CreateUnorderedAccessView(s_particleBuffer, nullptr, &particleUavDesc, D3D12_CPU_DESCRIPTOR_HANDLE{ heapStart.ptr + SIZE_T(tableIndex) * descriptorSize });
+        createListUav(s_particleDeadListBuffer, PARTICLE_DEAD_COUNTER_OFFSET, tableIndex + 1);
+        createListUav(s_particleAliveListBuffers[parity], GetParticleAliveCounterOffset(parity), tableIndex + 2);
+        createListUav(s_particleAliveListBuffers[parity], GetParticleAliveCounterOffset(parity), tableIndex + 3);
+        createListUav(s_particleAliveListBuffers[1 - parity], GetParticleAliveCounterOffset(1 - parity), tableIndex + 4);
+        createListUav(s_particleDeadListBuffer, PARTICLE_DEAD_COUNTER_OFFSET, tableIndex + 5);
+
+        // t1 and t2 of the draw after that update: the particles and the alive list of the next frame
+        const UINT drawTableIndex = PARTICLE_GPU_SRV_TABLE_OFFSET + parity * PARTICLE_SRV_TABLE_SIZE;
+        CreateParticleBufferSrvs(s_particleBuffer, s_particleAliveListBuffers[1 - parity], drawTableIndex);
+    }
+
+    if (!ResetGpuParticles()) return false;
+
+    printf("GPU particles are enabled with %u slots and %u particles emitted per frame\n", s_particleSettings.maxParticleCount,
+        s_particleSettings.emitCountPerFrame);
+    return true;
+}
+
+// The upload buffer the alive particles are written to every frame, and the identity index list drawn with it
+static auto CreateCpuParticleResources() -> bool
+{
+    s_particleSimulation = std::make_unique<ParticleSimulation>(s_particleSettings);
+
+    const UINT64 maxCount = UINT64(s_particleSettings.maxParticleCount);
+    const HRESULT hRes = CreateCpuWrittenBuffer(s_bufferHeapPolicy, maxCount * sizeof(GpuParticle), D3D12_RESOURCE_STATE_GENERIC_READ, &s_particleUploadBuffer);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for particle upload buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    std::vector<uint32_t> indices(s_particleSettings.maxParticleCount);
+    for (uint32_t i = 0; i < s_particleSettings.maxParticleCount; ++i) {
+        indices[i] = i;
+    }
+    if (!CreateBufferWithData(s_bufferHeapPolicy, indices.data(), indices.size() * sizeof(uint32_t), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        &s_particleIndexBuffer)) return false;
+
+    CreateParticleBufferSrvs(s_particleUploadBuffer, s_particleIndexBuffer, PARTICLE_CPU_SRV_TABLE_OFFSET);
+
+    printf("CPU particles are enabled with %u slots, %u particles emitted per frame and the %s simulation step\n", s_particleSettings.maxParticleCount,
+        s_particleSettings.emitCountPerFrame, GetParticleSimdName());
+    return true;
+}
+
+// Create the particles of the current mode. The GPU mode falls back to the CPU mode if its compute PSOs cannot be created.
+static auto CreateParticleResources() -> bool
+{
+    if (s_particleMode == ParticleMode::NONE) return true;
+
+    if (!CreateParticleRootSignature()) return false;
+    if (!CreateParticleDrawPipelineState()) return false;
+
+    const D3D12_DESCRIPTOR_HEAP_DESC particleHeapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        .NumDescriptors = PARTICLE_DESCRIPTOR_COUNT,
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+        .NodeMask = 0
+    };
+    const HRESULT hRes = s_device->CreateDescriptorHeap(&particleHeapDesc, IID_PPV_ARGS(&s_particleDescriptorHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for particles failed: %ld\n", hRes);
+        return false;
+    }
+
+    if (s_particleMode == ParticleMode::GPU)
+    {
+        if (!CreateParticleComputePipelineState("EmitCS", &s_particleEmitPipelineState) ||
+            !CreateParticleComputePipelineState("SimulateCS", &s_particleSimulatePipelineState))
+        {
+            puts("WARNING: The particle compute shaders are not available. The particles will be simulated on the CPU!");
+            s_particleMode = ParticleMode::CPU;
+        }
+        else if (!CreateGpuParticleResources()) return false;
+    }
+
+    if (s_particleMode == ParticleMode::CPU) {
+        return CreateCpuParticleResources();
+    }
+    return true;
+}
+
+static auto ReleaseParticleResources() -> void
+{
+    s_particleSimulation.reset();
+
+    ID3D12Resource** const buffers[] = { &s_particleBuffer, &s_particleDeadListBuffer, &s_particleAliveListBuffers[0], &s_particleAliveListBuffers[1],
+        &s_particleCounterBuffer, &s_particleCountBuffer, &s_particleDrawArgumentBuffer, &s_particleReadbackBuffer, &s_particleUploadBuffer,
+        &s_particleIndexBuffer };
+    for (ID3D12Resource** buffer : buffers)
+    {
+        if (*buffer != nullptr)
+        {
+            (*buffer)->Release();
+            *buffer = nullptr;
+        }
+    }
+
+    if (s_particleCommandSignature != nullptr)
+    {
+        s_particleCommandSignature->Release();
+        s_particleCommandSignature = nullptr;
+    }
+    if (s_particleDescriptorHeap != nullptr)
+    {
+        s_particleDescriptorHeap->Release();
+        s_particleDescriptorHeap = nullptr;
+    }
+    ID3D12PipelineState** const pipelineStates[] = { &s_particleEmitPipelineState, &s_particleSimulatePipelineState, &s_particleDrawPipelineState };
+    for (ID3D12PipelineState** pipelineState : pipelineStates)
+    {
+        if (*pipelineState != nullptr)
+        {
+            (*pipelineState)->Release();
+            *pipelineState = nullptr;
+        }
+    }
+    if (s_particleRootSignature != nullptr)
+    {
+        s_particleRootSignature->Release();
+        s_particleRootSignature = nullptr;
+    }
+}
+
+// Copy the list counter at `counterOffset` to `destinationOffset` of `destination`, which is in `destinationState` before and after.
+static auto RecordParticleCounterCopy(ID3D12Resource* destination, UINT64 destinationOffset, D3D12_RESOURCE_STATES destinationState, UINT64 counterOffset) -> void
+{
+    const bool destinationTransition = destinationState != D3D12_RESOURCE_STATE_COPY_DEST;
+    const D3D12_RESOURCE_BARRIER toCopy[]{
+        MakeTransitionBarrier(s_particleCounterBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE),
+        MakeTransitionBarrier(destination, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, destinationState, D3D12_RESOURCE_STATE_COPY_DEST)
+    };
+    s_basicCommandList->ResourceBarrier(destinationTransition ? 2 : 1, toCopy);
+
+    s_basicCommandList->CopyBufferRegion(destination, destinationOffset, s_particleCounterBuffer, counterOffset, sizeof(uint32_t));
+
+    const D3D12_RESOURCE_BARRIER fromCopy[]{
+        MakeTransitionBarrier(s_particleCounterBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+        MakeTransitionBarrier(destination, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COPY_DEST, destinationState)
+    };
+    s_basicCommandList->ResourceBarrier(destinationTransition ? 2 : 1, fromCopy);
+}
+
+// Emit the particles of frame `frameIndex` and simulate them with the particles alive before. Each dispatch reads the count
+// of the list it consumes from a copy of its counter, so no thread consumes an empty list.
+static auto RecordParticleUpdate(uint32_t frameIndex) -> void
+{
+    const uint32_t parity = frameIndex & 1;
+    const ParticleConstants constants{ .settings = s_particleSettings, .frameIndex = frameIndex };
+    const D3D12_RESOURCE_BARRIER uavBarrier{
+        .Type = D3D12_RESOURCE_BARRIER_TYPE_UAV,
+        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+        .UAV { .pResource = nullptr }
+    };
+
+    RecordParticleCounterCopy(s_particleCountBuffer, PARTICLE_DEAD_COUNT_OFFSET, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, PARTICLE_DEAD_COUNTER_OFFSET);
+
+    s_basicCommandList->SetComputeRootSignature(s_particleRootSignature);
+    ID3D12DescriptorHeap* const descriptorHeaps[] = { s_particleDescriptorHeap };
+    s_basicCommandList->SetDescriptorHeaps((UINT)std::size(descriptorHeaps), descriptorHeaps);
+    s_basicCommandList->SetComputeRoot32BitConstants(0, UINT(sizeof(constants) / sizeof(UINT)), &constants, 0);
+    s_basicCommandList->SetComputeRootShaderResourceView(1, s_particleCountBuffer->GetGPUVirtualAddress());
+    s_basicCommandList->SetComputeRootDescriptorTable(2, GetParticleDescriptorHandle(parity * PARTICLE_UAV_TABLE_SIZE));
+
+    s_basicCommandList->SetPipelineState(s_particleEmitPipelineState);
+    s_basicCommandList->Dispatch((s_particleSettings.emitCountPerFrame + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+    s_basicCommandList->ResourceBarrier(1, &uavBarrier);
+
+    RecordParticleCounterCopy(s_particleCountBuffer, PARTICLE_ALIVE_COUNT_OFFSET, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        GetParticleAliveCounterOffset(parity));
+
+    s_basicCommandList->SetPipelineState(s_particleSimulatePipelineState);
+    s_basicCommandList->Dispatch((s_particleSettings.maxParticleCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+    s_basicCommandList->ResourceBarrier(1, &uavBarrier);
+}
+
+// Draw the alive particles over the `sceneWidth` x `sceneHeight` scene as instanced quads. In the GPU mode, the instance count
+// is the counter of the alive list the last update appended to, and it is also copied to `s_particleReadbackBuffer`.
+static auto RecordParticleDraw(UINT sceneWidth, UINT sceneHeight, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle) -> void
+{
+    const bool gpuMode = s_particleMode == ParticleMode::GPU;
+    const uint32_t parity = s_particleFrameIndex & 1;
+    auto const transitionDrawBuffers = [parity](D3D12_RESOURCE_STATES stateBefore, D3D12_RESOURCE_STATES stateAfter) {
+        const D3D12_RESOURCE_BARRIER barriers[]{
+            MakeTransitionBarrier(s_particleBuffer, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, stateBefore, stateAfter),
+            MakeTransitionBarrier(s_particleAliveListBuffers[1 - parity], D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, stateBefore, stateAfter)
+        };
+        s_basicCommandList->ResourceBarrier((UINT)std::size(barriers), barriers);
+    };
+    if (gpuMode)
+    {
+        const UINT64 counterOffset = GetParticleAliveCounterOffset(1 - parity);
+        RecordParticleCounterCopy(s_particleDrawArgumentBuffer, offsetof(D3D12_DRAW_ARGUMENTS, InstanceCount), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, counterOffset);
+        RecordParticleCounterCopy(s_particleReadbackBuffer, 0, D3D12_RESOURCE_STATE_COPY_DEST, counterOffset);
+        transitionDrawBuffers(D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    }
+
+    const D3D12_VIEWPORT viewPort{
+        .TopLeftX = 0.0f,
+        .TopLeftY = 0.0f,
+        .Width = FLOAT(sceneWidth),
+        .Height = FLOAT(sceneHeight),
+        .MinDepth = 0.0f,
+        .MaxDepth = 1.0f
+    };
+    s_basicCommandList->RSSetViewports(1, &viewPort);
+
+    const D3D12_RECT scissorRect{
+        .left = 0,
+        .top = 0,
+        .right = LONG(sceneWidth),
+        .bottom = LONG(sceneHeight)
+    };
+    s_basicCommandList->RSSetScissorRects(1, &scissorRect);
+
+    s_basicCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, &dsvHandle);
+
+    s_basicCommandList->SetPipelineState(s_particleDrawPipelineState);
+    s_basicCommandList->SetGraphicsRootSignature(s_particleRootSignature);
+    ID3D12DescriptorHeap* const descriptorHeaps[] = { s_particleDescriptorHeap };
+    s_basicCommandList->SetDescriptorHeaps((UINT)std::size(descriptorHeaps), descriptorHeaps);
+    s_basicCommandList->SetGraphicsRootDescriptorTable(3, GetParticleDescriptorHandle(gpuMode ?
+        PARTICLE_GPU_SRV_TABLE_OFFSET + parity * PARTICLE_SRV_TABLE_SIZE : PARTICLE_CPU_SRV_TABLE_OFFSET));
+    s_basicCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+    if (!gpuMode)
+    {
+        s_basicCommandList->DrawInstanced(4, s_particleAliveCount, 0, 0);
+        return;
+    }
+
+    s_basicCommandList->ExecuteIndirect(s_particleCommandSignature, 1, s_particleDrawArgumentBuffer, 0, nullptr, 0);
+    transitionDrawBuffers(D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
+
+// Called after the scene pass, where the scene target is the render target of `rtvHandle`
+static auto RecordParticlePasses(UINT sceneWidth, UINT sceneHeight, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle) -> void
+{
+    if (s_particleMode == ParticleMode::GPU)
+    {
+        BeginGpuProfileScope("Particle update");
+        RecordParticleUpdate(s_particleFrameIndex);
+        EndGpuProfileScope();
+    }
+
+    BeginGpuProfileScope("Particle draw");
+    RecordParticleDraw(sceneWidth, sceneHeight, rtvHandle, dsvHandle);
+    EndGpuProfileScope();
+
+    ++s_particleFrameIndex;
+}
+
+// In the CPU mode, step the simulation of the frame being recorded and write its alive particles to the upload buffer.
+// The previous frame has completed, so the GPU no longer reads the buffer.
+static auto StepCpuParticles() -> bool
+{
+    if (s_particleMode != ParticleMode::CPU) return true;
+
+    LARGE_INTEGER beginTime{ }, endTime{ };
+    QueryPerformanceCounter(&beginTime);
+    s_particleSimulation->Step(s_particleFrameIndex, ParticleSimd::VECTOR);
+    QueryPerformanceCounter(&endTime);
+    s_particleStepTime += double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart);
+    s_particleSimulatedCount += s_particleSimulation->GetAliveCount();
+
+    void* pDataBegin = nullptr;
+    const D3D12_RANGE readRange{ 0, 0 };
+    const HRESULT hRes = s_particleUploadBuffer->Map(0, &readRange, &pDataBegin);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map particle upload buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    s_particleAliveCount = s_particleSimulation->CopyAliveParticles(static_cast<GpuParticle*>(pDataBegin));
+
+    const D3D12_RANGE writtenRange{ 0, SIZE_T(s_particleAliveCount) * sizeof(GpuParticle) };
+    s_particleUploadBuffer->Unmap(0, &writtenRange);
+    return true;
+}
+
+// Read the alive count of the GPU mode from the frame just completed
+static auto ReadGpuParticleAliveCount() -> bool
+{
+    void* pData = nullptr;
+    const D3D12_RANGE readRange{ 0, sizeof(uint32_t) };
+    const HRESULT hRes = s_particleReadbackBuffer->Map(0, &readRange, &pData);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map particle readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    memcpy(&s_particleAliveCount, pData, sizeof(uint32_t));
+
+    const D3D12_RANGE writeRange{ 0, 0 };
+    s_particleReadbackBuffer->Unmap(0, &writeRange);
+    return true;
+}
+
+// Print the alive particles and the particles simulated per millisecond: the CPU step time in the CPU mode, and the
+// "Particle update" scope of the GPU profiler in the GPU mode, if it is enabled.
+static auto ReportParticleStats() -> void
+{
+    if (s_particleMode == ParticleMode::CPU)
+    {
+        printf("Particles on the CPU (%s): %u alive, %.0f particles/ms\n", GetParticleSimdName(), s_particleAliveCount,
+            s_particleStepTime > 0.0 ? double(s_particleSimulatedCount) / s_particleStepTime : 0.0);
+        s_particleStepTime = 0.0;
+        s_particleSimulatedCount = 0;
+        return;
+    }
+
+    if (!ReadGpuParticleAliveCount()) return;
+
+    double updateTime = 0.0;
+    if (s_gpuProfiler != nullptr)
+    {
+        for (auto const& entry : s_gpuProfiler->GetSummary())
+        {
+            if (strcmp(entry.name, "Particle update") == 0) {
+                updateTime = entry.GetAverageTime();
+            }
+        }
+    }
+    if (updateTime > 0.0) {
+        printf("Particles on the GPU: %u alive, %.0f particles/ms\n", s_particleAliveCount, double(s_particleAliveCount) / updateTime);
+    }
+    else {
+        printf("Particles on the GPU: %u alive\n", s_particleAliveCount);
+    }
+}
+
+// Run PARTICLE_BENCHMARK_FRAME_COUNT frames of updates from the initial state on the CPU and, in one submission, on the GPU,
+// print the particles simulated per millisecond of both, and check that both end with about the same alive count.
+// The GPU emits the same particles, but its sin, cos and lifetimes may round differently, so a few particles may die a frame apart.
+static auto RunParticleBenchmark() -> bool
+{
+    ParticleSimulation simulation(s_particleSettings);
+    uint64_t simulatedCount = 0;
+    LARGE_INTEGER beginTime{ }, endTime{ };
+    QueryPerformanceCounter(&beginTime);
+    for (uint32_t frame = 0; frame < PARTICLE_BENCHMARK_FRAME_COUNT; ++frame)
+    {
+        simulation.Step(frame, ParticleSimd::VECTOR);
+        simulatedCount += simulation.GetAliveCount();
+    }
+    QueryPerformanceCounter(&endTime);
+    const double cpuTime = double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart);
+    printf("Particle benchmark of %u frames with %u slots: CPU (%s) %.0f particles/ms, %u alive at the end\n", PARTICLE_BENCHMARK_FRAME_COUNT,
+        s_particleSettings.maxParticleCount, GetParticleSimdName(), double(simulatedCount) / cpuTime, simulation.GetAliveCount());
+
+    if (s_particleMode != ParticleMode::GPU)
+    {
+        puts("GPU particles are not available, only the CPU simulation was measured");
+        return true;
+    }
+
+    if (!ResetGpuParticles()) return false;
+
+    QueryPerformanceCounter(&beginTime);
+    if (!BeginImmediateCommands()) return false;
+    for (uint32_t frame = 0; frame < PARTICLE_BENCHMARK_FRAME_COUNT; ++frame) {
+        RecordParticleUpdate(frame);
+    }
+    RecordParticleCounterCopy(s_particleReadbackBuffer, 0, D3D12_RESOURCE_STATE_COPY_DEST, GetParticleAliveCounterOffset(PARTICLE_BENCHMARK_FRAME_COUNT & 1));
+    if (!SubmitImmediateCommands()) return false;
+    QueryPerformanceCounter(&endTime);
+    const double gpuTime = double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart);
+
+    if (!ReadGpuParticleAliveCount()) return false;
+    printf("Particle benchmark of %u frames with %u slots: GPU %.0f particles/ms including the submission, %u alive at the end\n",
+        PARTICLE_BENCHMARK_FRAME_COUNT, s_particleSettings.maxParticleCount, double(simulatedCount) / gpuTime, s_particleAliveCount);
+
+    const uint32_t difference = s_particleAliveCount > simulation.GetAliveCount() ? s_particleAliveCount - simulation.GetAliveCount() :
+        simulation.GetAliveCount() - s_particleAliveCount;
+    if (difference > simulation.GetAliveCount() / PARTICLE_BENCHMARK_TOLERANCE_DIVISOR)
+    {
+        fprintf(stderr, "GPU particles diverge from the CPU simulation: %u alive instead of %u\n", s_particleAliveCount, simulation.GetAliveCount());
+        return false;
+    }
+    return true;
+}
+
+// ==== Meshlets (MeshletBuilder.h) ====
+
+// Root constants of shaders/meshlets.hlsl, in the object space of the torus
+struct MeshletConstants
+{
+    MeshletMatrix objectToClip;
+    float cameraPosition[3];
+    uint32_t meshletCount;
+    float frustumPlanes[6][4];
+};
+static_assert(sizeof(MeshletConstants) == 44 * sizeof(UINT), "MeshletConstants must match cbMeshlets in shaders/meshlets.hlsl");
+
+// Subobject of a pipeline state stream, aligned as the runtime reads them
+template <D3D12_PIPELINE_STATE_SUBOBJECT_TYPE Type, typename Value>
+struct alignas(void*) PipelineStateSubobject
+{
+    D3D12_PIPELINE_STATE_SUBOBJECT_TYPE type = Type;
+    Value value;
+};
+
+// The blend state, the sample desc and the sample mask are left to their defaults.
+struct MeshletPipelineStateStream
+{
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE, ID3D12RootSignature*> rootSignature;
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_AS, D3D12_SHADER_BYTECODE> amplificationShader;
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_MS, D3D12_SHADER_BYTECODE> meshShader;
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS, D3D12_SHADER_BYTECODE> pixelShader;
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RASTERIZER, D3D12_RASTERIZER_DESC> rasterizerState;
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL, D3D12_DEPTH_STENCIL_DESC> depthStencilState;
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS, D3D12_RT_FORMAT_ARRAY> renderTargetFormats;
+    PipelineStateSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT, DXGI_FORMAT> depthStencilFormat;
+};
+
+static auto CreateMeshletRootSignature() -> bool
+{
+    RootParameterDesc rootParameters[1 + MESHLET_BUFFER_COUNT]{ };
+    // cbMeshlets
+    rootParameters[0] = {
+        .kind = RootParameterKind::ROOT_CONSTANTS,
+        .visibility = RootShaderVisibility::ALL,
+        .shaderRegister = 0,
+        .registerSpace = 0,
+        .sizeInDwords = UINT(sizeof(MeshletConstants) / sizeof(UINT)),
+        .volatility = RootDataVolatility::VOLATILE,
+        .ranges = nullptr,
+        .rangeCount = 0
+    };
+    // The meshlet buffers, as root SRVs so that no descriptor heap is needed. They are written once when they are created.
+    for (uint32_t i = 0; i < MESHLET_BUFFER_COUNT; ++i)
+    {
+        rootParameters[1 + i] = {
+            .kind = RootParameterKind::ROOT_SRV,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = i,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::STATIC,
+            .ranges = nullptr,
+            .rangeCount = 0
+        };
+    }
+
+    return CreateCachedRootSignature("meshlets", rootParameters, (uint32_t)std::size(rootParameters), nullptr, 0,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE, &s_meshletRootSignature);
+}
+
+// Mesh shader pipelines are created from a pipeline state stream with ID3D12Device2.
+static auto CreateMeshletPipelineState() -> bool
+{
+    ComHandle<ID3D12Device2> device2;
+    HRESULT hRes = s_device->QueryInterface(IID_PPV_ARGS(device2.ReleaseAndGetAddressOf()));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "QueryInterface for ID3D12Device2 failed: %ld\n", hRes);
+        return false;
+    }
+
+    ID3DBlob* amplificationShaderCode = CompileShaderObjectWithDxc(L"shaders/meshlets.hlsl", L"MeshletAS", L"as_6_5", nullptr, 0);
+    ID3DBlob* meshShaderCode = CompileShaderObjectWithDxc(L"shaders/meshlets.hlsl", L"MeshletMS", L"ms_6_5", nullptr, 0);
+    ID3DBlob* pixelShaderCode = CompileShaderObjectWithDxc(L"shaders/meshlets.hlsl", L"PSMain", L"ps_6_5", nullptr, 0);
+
+    hRes = E_FAIL;
+    if (amplificationShaderCode != nullptr && meshShaderCode != nullptr && pixelShaderCode != nullptr)
+    {
+        MeshletPipelineStateStream stream{
+            .rootSignature { .value = s_meshletRootSignature },
+            .amplificationShader { .value = { .pShaderBytecode = amplificationShaderCode->GetBufferPointer(), .BytecodeLength = amplificationShaderCode->GetBufferSize() } },
+            .meshShader { .value = { .pShaderBytecode = meshShaderCode->GetBufferPointer(), .BytecodeLength = meshShaderCode->GetBufferSize() } },
+            .pixelShader { .value = { .pShaderBytecode = pixelShaderCode->GetBufferPointer(), .BytecodeLength = pixelShaderCode->GetBufferSize() } },
+            .rasterizerState {
+                .value {
+                    .FillMode = D3D12_FILL_MODE_SOLID,
+                    .CullMode = D3D12_CULL_MODE_BACK,
+                    .FrontCounterClockwise = FALSE,
+                    .DepthBias = 0,
+                    .DepthBiasClamp = 0.0f,
+                    .SlopeScaledDepthBias = 0.0f,
+                    .DepthClipEnable = TRUE,
+                    .MultisampleEnable = FALSE,
+                    .AntialiasedLineEnable = FALSE,
+                    .ForcedSampleCount = 0,
+                    .ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
+                }
+            },
+            .depthStencilState {
+                .value {
+                    .DepthEnable = TRUE,
+                    .DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL,
+                    .DepthFunc = D3D12_COMPARISON_FUNC_LESS,
+                    .StencilEnable = FALSE,
+                    .StencilReadMask = 0,
+                    .StencilWriteMask = 0,
+                    .FrontFace { },
+                    .BackFace { }
+                }
+            },
+            .renderTargetFormats { .value = { .RTFormats = { DXGI_FORMAT_R8G8B8A8_UNORM }, .NumRenderTargets = 1 } },
+            .depthStencilFormat { .value = DXGI_FORMAT_D32_FLOAT }
+        };
+        const D3D12_PIPELINE_STATE_STREAM_DESC streamDesc{ .SizeInBytes = sizeof(stream), .pPipelineStateSubobjectStream = &stream };
+
+        hRes = device2->CreatePipelineState(&streamDesc, IID_PPV_ARGS(&s_meshletPipelineState));
+        if (FAILED(hRes)) {
+            fprintf(stderr, "CreatePipelineState for meshlets failed: %ld\n", hRes);
+        }
+    }
+
+    ID3DBlob* const shaderCodes[] = { amplificationShaderCode, meshShaderCode, pixelShaderCode };
+    for (ID3DBlob* shaderCode : shaderCodes)
+    {
+        if (shaderCode != nullptr) {
+            shaderCode->Release();
+        }
+    }
+
+    return SUCCEEDED(hRes);
+}
+
+// Build the meshlets of the torus on all the hardware threads, and upload them. Without mesh shaders, the torus is not drawn.
+static auto CreateMeshletResources() -> bool
+{
+    if (!s_meshletsEnabled) return true;
+
+    if (!s_meshShadersSupported)
+    {
+        puts("WARNING: Mesh shaders are not supported by the current device. Meshlets will be disabled!");
+        s_meshletsEnabled = false;
+        return true;
+    }
+
+    if (!CreateMeshletRootSignature()) return false;
+    if (!CreateMeshletPipelineState())
+    {
+        puts("WARNING: The meshlet shaders are not available. Meshlets will be disabled!");
+        s_meshletsEnabled = false;
+        return true;
+    }
+
+    std::vector<MeshletVertex> vertices;
+    std::vector<uint32_t> indices;
+    BuildTorusMesh(MESHLET_TORUS_RING_SEGMENT_COUNT, MESHLET_TORUS_TUBE_SEGMENT_COUNT, MESHLET_TORUS_RING_RADIUS, MESHLET_TORUS_TUBE_RADIUS,
+        vertices, indices);
+
+    LARGE_INTEGER beginTime{ };
+    QueryPerformanceCounter(&beginTime);
+    s_meshletMesh = BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size(), 0);
+    LARGE_INTEGER endTime{ };
+    QueryPerformanceCounter(&endTime);
+
+    const std::pair<const void*, size_t> bufferData[MESHLET_BUFFER_COUNT] = {
+        { s_meshletMesh.meshlets.data(), s_meshletMesh.meshlets.size() * sizeof(Meshlet) },
+        { s_meshletMesh.bounds.data(), s_meshletMesh.bounds.size() * sizeof(MeshletBounds) },
+        { vertices.data(), vertices.size() * sizeof(MeshletVertex) },
+        { s_meshletMesh.vertexIndices.data(), s_meshletMesh.vertexIndices.size() * sizeof(uint32_t) },
+        { s_meshletMesh.primitives.data(), s_meshletMesh.primitives.size() * sizeof(uint32_t) }
+    };
+    for (UINT i = 0; i < MESHLET_BUFFER_COUNT; ++i)
+    {
+        if (!CreateBufferWithData(s_bufferHeapPolicy, bufferData[i].first, bufferData[i].second, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+            &s_meshletBuffers[i])) return false;
+    }
+
+    printf("Meshlets are enabled with %zu triangles in %zu meshlets, built in %.3f ms on %u threads\n", indices.size() / 3, s_meshletMesh.meshlets.size(),
+        double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart), std::max(std::thread::hardware_concurrency(), 1U));
+    return true;
+}
+
+static auto ReleaseMeshletResources() -> void
+{
+    for (auto& buffer : s_meshletBuffers)
+    {
+        if (buffer != nullptr)
+        {
+            buffer->Release();
+            buffer = nullptr;
+        }
+    }
+    if (s_meshletPipelineState != nullptr)
+    {
+        s_meshletPipelineState->Release();
+        s_meshletPipelineState = nullptr;
+    }
+    if (s_meshletRootSignature != nullptr)
+    {
+        s_meshletRootSignature->Release();
+        s_meshletRootSignature = nullptr;
+    }
+    s_meshletMesh = MeshletMesh{ };
+}
+
+// The view of the torus for a `sceneWidth` x `sceneHeight` scene. The torus turns with the squares, around two axes so that
+// every side of it faces the camera in turn.
+static auto GetMeshletCullView(UINT sceneWidth, UINT sceneHeight, MeshletMatrix& objectToClip) -> MeshletCullView
+{
+    const float angleX = s_rotateAngle * float(M_PI / 180.0);
+    const float angleY = angleX * 0.5f;
+    const MeshletMatrix objectToView = MultiplyMeshletMatrices(MultiplyMeshletMatrices(MakeMeshletRotation(0, angleX), MakeMeshletRotation(1, angleY)),
+        MakeMeshletTranslation(0.0f, 0.0f, MESHLET_CAMERA_DISTANCE));
+    objectToClip = MultiplyMeshletMatrices(objectToView,
+        MakeMeshletPerspective(MESHLET_VERTICAL_FOV, float(sceneWidth) / float(sceneHeight), MESHLET_NEAR_Z, MESHLET_FAR_Z));
+
+    // The camera is at the origin of the view space.
+    const float cameraInView[3] = { 0.0f, 0.0f, -MESHLET_CAMERA_DISTANCE };
+    const auto cameraPosition = TransformMeshletPoint(cameraInView, MultiplyMeshletMatrices(MakeMeshletRotation(1, -angleY), MakeMeshletRotation(0, -angleX)));
+    return MakeMeshletCullView(objectToClip, cameraPosition.data());
+}
+
+// Draw the torus over the `sceneWidth` x `sceneHeight` scene. The amplification shader launches a mesh shader group per visible meshlet.
+static auto RecordMeshletDraw(UINT sceneWidth, UINT sceneHeight, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle, D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle) -> void
+{
+    ComHandle<ID3D12GraphicsCommandList6> commandList6;
+    if (FAILED(s_basicCommandList->QueryInterface(IID_PPV_ARGS(commandList6.ReleaseAndGetAddressOf())))) return;
+
+    MeshletConstants constants{ };
+    const MeshletCullView cullView = GetMeshletCullView(sceneWidth, sceneHeight, constants.objectToClip);
+    std::copy(std::begin(cullView.cameraPosition), std::end(cullView.cameraPosition), constants.cameraPosition);
+    constants.meshletCount = uint32_t(s_meshletMesh.meshlets.size());
+    memcpy(constants.frustumPlanes, cullView.frustumPlanes, sizeof(constants.frustumPlanes));
+
+    const D3D12_VIEWPORT viewPort{
+        .TopLeftX = 0.0f,
+        .TopLeftY = 0.0f,
+        .Width = FLOAT(sceneWidth),
+        .Height = FLOAT(sceneHeight),
+        .MinDepth = 0.0f,
+        .MaxDepth = 1.0f
+    };
+    commandList6->RSSetViewports(1, &viewPort);
+
+    const D3D12_RECT scissorRect{
+        .left = 0,
+        .top = 0,
+        .right = LONG(sceneWidth),
+        .bottom = LONG(sceneHeight)
+    };
+    commandList6->RSSetScissorRects(1, &scissorRect);
+
+    commandList6->OMSetRenderTargets(1, &rtvHandle, FALSE, &dsvHandle);
+
+    commandList6->SetPipelineState(s_meshletPipelineState);
+    commandList6->SetGraphicsRootSignature(s_meshletRootSignature);
+    commandList6->SetGraphicsRoot32BitConstants(0, UINT(sizeof(constants) / sizeof(UINT)), &constants, 0);
+    for (UINT i = 0; i < MESHLET_BUFFER_COUNT; ++i) {
+        commandList6->SetGraphicsRootShaderResourceView(1 + i, s_meshletBuffers[i]->GetGPUVirtualAddress());
+    }
+    commandList6->DispatchMesh((constants.meshletCount + MESHLET_AS_GROUP_SIZE - 1) / MESHLET_AS_GROUP_SIZE, 1, 1);
+}
+
+// The amplification shader culls on the GPU, so the counts are those of the same tests on the CPU, for the current view.
+static auto ReportMeshletStats() -> void
+{
+    auto const [sceneWidth, sceneHeight] = GetSceneRenderSize();
+    MeshletMatrix objectToClip{ };
+    const MeshletCullView cullView = GetMeshletCullView(sceneWidth, sceneHeight, objectToClip);
+
+    std::vector<uint32_t> visibleMeshlets;
+    visibleMeshlets.reserve(s_meshletMesh.meshlets.size());
+    LARGE_INTEGER beginTime{ };
+    QueryPerformanceCounter(&beginTime);
+    const MeshletCullStats stats = CullMeshlets(s_meshletMesh, cullView, visibleMeshlets);
+    LARGE_INTEGER endTime{ };
+    QueryPerformanceCounter(&endTime);
+
+    printf("Meshlets: %zu of %llu visible, %llu outside the frustum, %llu with back-facing cones, tested in %.3f ms on the CPU\n",
+        visibleMeshlets.size(), stats.testedCount, stats.frustumCulledCount, stats.coneCulledCount,
+        double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart));
+}
+
+// ==== Streamed textures (TextureStreaming.h) ====
+
+// Root constants of shaders/textures.hlsl
+struct StreamedTextureQuad
+{
+    float centerX;
+    float centerY;
+    float halfWidth;
+    float halfHeight;
+};
+
+static auto CreateTextureRootSignature() -> bool
+{
+    // `UpdateTextureStreaming()` rewrites the SRV of a texture when its mips are swapped, after the table has been set in
+    // earlier frames. The mips themselves are uploaded before the swap and not written while drawn.
+    const RootDescriptorRange srvRange{
+        .type = RootDescriptorRangeType::SRV,
+        .descriptorCount = 1,
+        .baseShaderRegister = 0,
+        .registerSpace = 0,
+        .offsetInDescriptorsFromTableStart = 0,
+        .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+        .descriptorsVolatile = true
+    };
+
+    const RootParameterDesc rootParameters[]{
+        // cbTextureQuad
+        {
+            .kind = RootParameterKind::ROOT_CONSTANTS,
+            .visibility = RootShaderVisibility::VERTEX,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = UINT(sizeof(StreamedTextureQuad) / sizeof(UINT)),
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        },
+        // The texture of the quad
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::PIXEL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+            .ranges = &srvRange,
+            .rangeCount = 1
+        }
+    };
+
+    // The mips are blended, so that a mip streamed in or dropped does not pop.
+    const D3D12_STATIC_SAMPLER_DESC trilinearSampler{
+        .Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+        .AddressU = D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        .AddressV = D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        .AddressW = D3D12_TEXTURE_ADDRESS_MODE_CLAMP,
+        .MipLODBias = 0.0f,
+        .MaxAnisotropy = 1,
+        .ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER,
+        .BorderColor = D3D12_STATIC_BORDER_COLOR_OPAQUE_BLACK,
+        .MinLOD = 0.0f,
+        .MaxLOD = D3D12_FLOAT32_MAX,
+        .ShaderRegister = 0,
+        .RegisterSpace = 0,
+        .ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL
+    };
+
+    return CreateCachedRootSignature("streamed textures", rootParameters, (uint32_t)std::size(rootParameters), &trilinearSampler, 1,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE, &s_textureRootSignature);
+}
+
+// Opaque quads over the scene, without depth
+static auto CreateTexturePipelineState() -> bool
+{
+    const D3D_SHADER_MACRO noDefines[] = { { nullptr, nullptr } };
+    ID3DBlob* vertexShaderCode = CompileShaderObjectFromPath(L"shaders/textures.hlsl", "VSMain", "vs_5_1", noDefines);
+    ID3DBlob* pixelShaderCode = CompileShaderObjectFromPath(L"shaders/textures.hlsl", "PSMain", "ps_5_1", noDefines);
+
+    HRESULT hRes = E_FAIL;
+    if (vertexShaderCode != nullptr && pixelShaderCode != nullptr)
+    {
+        const D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{
+            .pRootSignature = s_textureRootSignature,
+            .VS = { .pShaderBytecode = vertexShaderCode->GetBufferPointer(), .BytecodeLength = vertexShaderCode->GetBufferSize() },
+            .PS = { .pShaderBytecode = pixelShaderCode->GetBufferPointer(), .BytecodeLength = pixelShaderCode->GetBufferSize() },
+            .BlendState {
+                .AlphaToCoverageEnable = FALSE,
+                .IndependentBlendEnable = FALSE,
+                .RenderTarget {
+                    // RenderTarget[0]
+                    {
+                        .BlendEnable = FALSE,
+                        .LogicOpEnable = FALSE,
+                        .SrcBlend = D3D12_BLEND_ONE,
+                        .DestBlend = D3D12_BLEND_ZERO,
+                        .BlendOp = D3D12_BLEND_OP_ADD,
+                        .SrcBlendAlpha = D3D12_BLEND_ONE,
+                        .DestBlendAlpha = D3D12_BLEND_ZERO,
+                        .BlendOpAlpha = D3D12_BLEND_OP_ADD,
+                        .LogicOp = D3D12_LOGIC_OP_NOOP,
+                        .RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL
+                    }
+                }
+            },
+            .SampleMask = UINT32_MAX,
+            .RasterizerState {
+                .FillMode = D3D12_FILL_MODE_SOLID,
+                .CullMode = D3D12_CULL_MODE_NONE,
+                .FrontCounterClockwise = FALSE,
+                .DepthBias = 0,
+                .DepthBiasClamp = 0.0f,
+                .SlopeScaledDepthBias = 0.0f,
+                .DepthClipEnable = TRUE,
+                .MultisampleEnable = FALSE,
+                .AntialiasedLineEnable = FALSE,
+                .ForcedSampleCount = 0,
+                .ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF
+            },
+            .DepthStencilState {
+                .DepthEnable = FALSE,
+                .DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO,
+                .DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS,
+                .StencilEnable = FALSE,
+                .StencilReadMask = 0,
+                .StencilWriteMask = 0,
+                .FrontFace { },
+                .BackFace { }
+            },
+            // The quads are generated from SV_VertexID.
+            .InputLayout { .pInputElementDescs = nullptr, .NumElements = 0 },
+            .IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED,
+            .PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE,
+            .NumRenderTargets = 1,
+            .RTVFormats {
+                // RTVFormats[0]
+                { DXGI_FORMAT_R8G8B8A8_UNORM }
+            },
+            .DSVFormat = DXGI_FORMAT_UNKNOWN,
+            .SampleDesc { .Count = 1, .Quality = 0 },
+            .NodeMask = 0,
+            .CachedPSO { },
+            .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+        };
+
+        hRes = s_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&s_texturePipelineState));
+        if (FAILED(hRes)) {
+            fprintf(stderr, "CreateGraphicsPipelineState for streamed textures failed: %ld\n", hRes);
+        }
+    }
+
+    if (vertexShaderCode != nullptr) {
+        vertexShaderCode->Release();
+    }
+    if (pixelShaderCode != nullptr) {
+        pixelShaderCode->Release();
+    }
+
+    return SUCCEEDED(hRes);
+}
+
+// Write checkerboards into `directory`, for when it has no DDS file.
+static auto WriteSyntheticTextureFiles(const char* directory) -> bool
+{
+    if (!CreateDirectoryA(directory, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        fprintf(stderr, "CreateDirectory %s for streamed textures failed: %lu\n", directory, GetLastError());
+        return false;
+    }
+
+    for (uint32_t i = 0; i < TEXTURE_STREAMING_SYNTHETIC_COUNT; ++i)
+    {
+        const std::vector<uint8_t> file = BuildCheckerDdsFile(TEXTURE_STREAMING_SYNTHETIC_SIZE, TEXTURE_STREAMING_SYNTHETIC_SIZE,
+            TEXTURE_STREAMING_SYNTHETIC_CELL_SIZE, i);
+
+        char path[MAX_PATH]{ };
+        sprintf_s(path, "%s/checker_%02u.dds", directory, i);
+        FILE* fp = nullptr;
+        const bool written = fopen_s(&fp, path, "wb") == 0 && fp != nullptr && fwrite(file.data(), 1, file.size(), fp) == file.size();
+        if (fp != nullptr) {
+            fclose(fp);
+        }
+        if (!written)
+        {
+            fprintf(stderr, "Write %s failed\n", path);
+            return false;
+        }
+    }
+
+    printf("%u synthetic textures of %ux%u are written to `%s`\n", TEXTURE_STREAMING_SYNTHETIC_COUNT, TEXTURE_STREAMING_SYNTHETIC_SIZE,
+        TEXTURE_STREAMING_SYNTHETIC_SIZE, directory);
+    return true;
+}
+
+static auto UnmapStreamedTextureFile(StreamedTexture& texture) -> void
+{
+    if (texture.fileData != nullptr)
+    {
+        UnmapViewOfFile(texture.fileData);
+        texture.fileData = nullptr;
+    }
+    if (texture.hMapping != nullptr)
+    {
+        CloseHandle(texture.hMapping);
+        texture.hMapping = nullptr;
+    }
+    if (texture.hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(texture.hFile);
+        texture.hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+// Map the DDS file at `path` for as long as the texture lives. The mips are only paged in when they are streamed in.
+static auto MapStreamedTextureFile(const char* path, StreamedTexture& texture) -> bool
+{
+    texture.hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (texture.hFile == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "CreateFile %s failed: %lu\n", path, GetLastError());
+        return false;
+    }
+
+    LARGE_INTEGER fileSize{ };
+    if (!GetFileSizeEx(texture.hFile, &fileSize) || fileSize.QuadPart == 0)
+    {
+        fprintf(stderr, "%s is empty or its size cannot be read\n", path);
+        return false;
+    }
+    texture.fileSize = size_t(fileSize.QuadPart);
+
+    texture.hMapping = CreateFileMappingA(texture.hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (texture.hMapping == nullptr)
+    {
+        fprintf(stderr, "CreateFileMapping %s failed: %lu\n", path, GetLastError());
+        return false;
+    }
+    texture.fileData = static_cast<const uint8_t*>(MapViewOfFile(texture.hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (texture.fileData == nullptr)
+    {
+        fprintf(stderr, "MapViewOfFile %s failed: %lu\n", path, GetLastError());
+        return false;
+    }
+
+    return true;
+}
+
+// Map the DDS files of `s_textureDirectory`, at most TEXTURE_STREAMING_MAX_TEXTURE_COUNT. The files that are not BC1 to BC7 2D textures are skipped.
+static auto MapStreamedTextureFiles() -> bool
+{
+    char pattern[MAX_PATH]{ };
+    sprintf_s(pattern, "%s/*.dds", s_textureDirectory);
+    WIN32_FIND_DATAA findData{ };
+    HANDLE hFind = FindFirstFileA(pattern, &findData);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        if (!WriteSyntheticTextureFiles(s_textureDirectory)) return false;
+        hFind = FindFirstFileA(pattern, &findData);
+        if (hFind == INVALID_HANDLE_VALUE)
+        {
+            fprintf(stderr, "FindFirstFile %s failed: %lu\n", pattern, GetLastError());
+            return false;
+        }
+    }
+
+    do
+    {
+        char path[MAX_PATH]{ };
+        sprintf_s(path, "%s/%s", s_textureDirectory, findData.cFileName);
+        StreamedTexture texture{
+            .hFile = INVALID_HANDLE_VALUE,
+            .hMapping = nullptr,
+            .fileData = nullptr,
+            .fileSize = 0,
+            .dds { },
+            .resource = nullptr,
+            .firstMip = 0
+        };
+        if (!MapStreamedTextureFile(path, texture))
+        {
+            UnmapStreamedTextureFile(texture);
+            continue;
+        }
+
+        const DdsParseResult result = ParseDdsTexture(texture.fileData, texture.fileSize, texture.dds);
+        if (result != DdsParseResult::OK)
+        {
+            printf("WARNING: %s is %s. It will be skipped!\n", path, GetDdsParseResultName(result));
+            UnmapStreamedTextureFile(texture);
+            continue;
+        }
+        s_streamedTextures.push_back(texture);
+    }
+    while (s_streamedTextures.size() < TEXTURE_STREAMING_MAX_TEXTURE_COUNT && FindNextFileA(hFind, &findData));
+    FindClose(hFind);
+
+    return true;
+}
+
+// Create the copy queue of the upload worker, with the command list it records all the uploads into, one after another.
+static auto CreateTextureCopyQueue() -> bool
+{
+    const D3D12_COMMAND_QUEUE_DESC queueDesc{
+        .Type = D3D12_COMMAND_LIST_TYPE_COPY,
+        .Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL,
+        .Flags = D3D12_COMMAND_QUEUE_FLAG_NONE,
+        .NodeMask = 0
+    };
+    HRESULT hRes = s_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&s_textureCopyQueue));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandQueue for texture uploads failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = s_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&s_textureCopyAllocator));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandAllocator for texture uploads failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = s_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, s_textureCopyAllocator, nullptr, IID_PPV_ARGS(&s_textureCopyCommandList));
+    if (SUCCEEDED(hRes)) {
+        hRes = s_textureCopyCommandList->Close();
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommandList for texture uploads failed: %ld\n", hRes);
+        return false;
+    }
+
+    hRes = s_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&s_textureCopyFence));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateFence for texture uploads failed: %ld\n", hRes);
+        return false;
+    }
+
+    return true;
+}
+
+// Map the textures, and start the upload worker. Nothing is resident until the first requests, which load the mip tails.
+static auto CreateTextureStreamingResources() -> bool
+{
+    if (!s_textureStreamingEnabled) return true;
+
+    if (!CreateTextureRootSignature()) return false;
+    if (!CreateTexturePipelineState()) return false;
+    if (!MapStreamedTextureFiles()) return false;
+    if (s_streamedTextures.empty())
+    {
+        printf("WARNING: `%s` has no texture to stream. Texture streaming will be disabled!\n", s_textureDirectory);
+        s_textureStreamingEnabled = false;
+        return true;
+    }
+
+    const D3D12_DESCRIPTOR_HEAP_DESC heapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        .NumDescriptors = TEXTURE_STREAMING_MAX_TEXTURE_COUNT,
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+        .NodeMask = 0
+    };
+    const HRESULT hRes = s_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&s_textureDescriptorHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for streamed textures failed: %ld\n", hRes);
+        return false;
+    }
+
+    if (!CreateTextureCopyQueue()) return false;
+
+    s_textureStreamer = std::make_unique<TextureStreamer>(TextureStreamingSettings{
+        .budget = s_textureStreamingBudget,
+        .maxPendingCount = TEXTURE_STREAMING_MAX_PENDING_COUNT,
+        .dropDelay = TEXTURE_STREAMING_DROP_DELAY
+    });
+    uint64_t fullSize = 0;
+    for (const StreamedTexture& texture : s_streamedTextures)
+    {
+        s_textureStreamer->Register(texture.dds);
+        fullSize += texture.fileSize - texture.dds.mips[0].offset;
+    }
+    s_textureUploadWorker = std::make_unique<TextureUploadWorker<TextureUploadResult>>();
+
+    printf("Texture streaming is enabled with %zu textures of `%s`, %.1f MB of mips in a budget of %.1f MB\n", s_streamedTextures.size(), s_textureDirectory,
+        double(fullSize) / (1024.0 * 1024.0), double(s_textureStreamingBudget) / (1024.0 * 1024.0));
+    return true;
+}
+
+// Run on the upload worker. Create a texture with the mips of `textureIndex` from `firstMip`, and copy them from the mapped file
+// on the copy queue. The texture is created in COMMON state: the copy queue promotes it to COPY_DEST, it decays back once the
+// copy has completed, and the direct queue promotes it to a shader resource state, so it needs no barrier.
+static auto UploadStreamedTextureMips(uint32_t textureIndex, uint32_t firstMip) -> TextureUploadResult
+{
+    LARGE_INTEGER beginTime{ };
+    QueryPerformanceCounter(&beginTime);
+
+    TextureUploadResult result{ .texture = textureIndex, .firstMip = firstMip, .resource = nullptr, .uploadTime = 0.0 };
+    const StreamedTexture& texture = s_streamedTextures[textureIndex];
+    const UINT mipCount = texture.dds.mipCount - firstMip;
+
+    const D3D12_HEAP_PROPERTIES defaultHeapProperties{
+        .Type = D3D12_HEAP_TYPE_DEFAULT,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC textureDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        .Alignment = 0,
+        .Width = texture.dds.mips[firstMip].width,
+        .Height = texture.dds.mips[firstMip].height,
+        .DepthOrArraySize = 1,
+        .MipLevels = UINT16(mipCount),
+        .Format = DXGI_FORMAT(texture.dds.format),
+        .SampleDesc { .Count = 1, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    ComHandle<ID3D12Resource> resource;
+    HRESULT hRes = s_device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COMMON,
+        nullptr, IID_PPV_ARGS(resource.ReleaseAndGetAddressOf()));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for streamed texture %u failed: %ld\n", textureIndex, hRes);
+        return result;
+    }
+
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprints[TEXTURE_MAX_MIP_COUNT]{ };
+    UINT rowCounts[TEXTURE_MAX_MIP_COUNT]{ };
+    UINT64 uploadSize = 0;
+    s_device->GetCopyableFootprints(&textureDesc, 0, mipCount, 0, footprints, rowCounts, nullptr, &uploadSize);
+
+    ComHandle<ID3D12Resource> uploadBuffer;
+    hRes = CreateCpuWrittenBuffer(s_bufferHeapPolicy, uploadSize, D3D12_RESOURCE_STATE_GENERIC_READ, uploadBuffer.ReleaseAndGetAddressOf());
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for texture upload buffer failed: %ld\n", hRes);
+        return result;
+    }
+
+    uint8_t* uploadData = nullptr;
+    const D3D12_RANGE readRange{ 0, 0 };
+    hRes = uploadBuffer->Map(0, &readRange, reinterpret_cast<void**>(&uploadData));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map texture upload buffer failed: %ld\n", hRes);
+        return result;
+    }
+    // The rows of blocks are tightly packed in the file, and 256-byte aligned in the upload buffer.
+    for (UINT i = 0; i < mipCount; ++i)
+    {
+        const DdsMipLevel& level = texture.dds.mips[firstMip + i];
+        for (UINT row = 0; row < rowCounts[i]; ++row)
+        {
+            memcpy(uploadData + footprints[i].Offset + UINT64(row) * footprints[i].Footprint.RowPitch,
+                texture.fileData + level.offset + size_t(row) * level.rowPitch, level.rowPitch);
+        }
+    }
+    const D3D12_RANGE writtenRange{ 0, SIZE_T(uploadSize) };
+    uploadBuffer->Unmap(0, &writtenRange);
+
+    hRes = s_textureCopyAllocator->Reset();
+    if (SUCCEEDED(hRes)) {
+        hRes = s_textureCopyCommandList->Reset(s_textureCopyAllocator, nullptr);
+    }
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Reset texture upload command list failed: %ld\n", hRes);
+        return result;
+    }
+    for (UINT i = 0; i < mipCount; ++i)
+    {
+        const D3D12_TEXTURE_COPY_LOCATION destination{
+            .pResource = resource.Get(),
+            .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+            .SubresourceIndex = i
+        };
+        const D3D12_TEXTURE_COPY_LOCATION source{
+            .pResource = uploadBuffer.Get(),
+            .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+            .PlacedFootprint = footprints[i]
+        };
+        s_textureCopyCommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+    }
+    hRes = s_textureCopyCommandList->Close();
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Close texture upload command list failed: %ld\n", hRes);
+        return result;
+    }
+
+    // Wait here, on the worker, so that the render thread only ever sees completed uploads. The copy fence is waited on by
+    // the reactor thread, together with the frame fence.
+    ID3D12CommandList* const commandLists[] = { s_textureCopyCommandList };
+    s_textureCopyQueue->ExecuteCommandLists((UINT)std::size(commandLists), commandLists);
+    const UINT64 fenceValue = ++s_textureCopyFenceValue;
+    hRes = s_textureCopyQueue->Signal(s_textureCopyFence, fenceValue);
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Signal for texture upload failed: %ld\n", hRes);
+        return result;
+    }
+    // The worker is stopped before the reactor, but should the reactor stop first, the future is broken rather than left pending.
+    try
+    {
+        s_fenceReactor->WhenComplete(FENCE_REACTOR_TEXTURE_COPY_FENCE, fenceValue).get();
+    }
+    catch (const std::future_error&)
+    {
+        fprintf(stderr, "Wait for texture upload failed: the fence reactor stopped\n");
+        return result;
+    }
+
+    LARGE_INTEGER endTime{ };
+    QueryPerformanceCounter(&endTime);
+    result.resource = resource.Detach();
+    result.uploadTime = double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart);
+    return result;
+}
+
+// The quad of texture `index` in frame `frameIndex`: the textures are laid out in a row along the bottom of the scene, and
+// each one grows and shrinks, so that its mips are streamed in and dropped.
+static auto GetStreamedTextureQuad(uint32_t index, UINT sceneWidth, UINT sceneHeight, uint64_t frameIndex) -> StreamedTextureQuad
+{
+    const uint32_t textureCount = uint32_t(s_streamedTextures.size());
+    const DdsTexture& dds = s_streamedTextures[index].dds;
+    const float columnWidth = 2.0f / float(textureCount);
+    const float phase = float(frameIndex % TEXTURE_STREAMING_ANIMATION_PERIOD) / float(TEXTURE_STREAMING_ANIMATION_PERIOD) * 6.28318530717958647692f;
+    const float scale = 0.15f + 0.85f * (0.5f + 0.5f * std::sin(phase + float(index) * 0.7f));
+
+    // Keep the aspect ratio of the texture in pixels, within the column.
+    float halfWidth = 0.5f * columnWidth * scale;
+    float halfHeight = halfWidth * float(sceneWidth) / float(sceneHeight) * float(dds.height) / float(dds.width);
+    if (halfHeight > 0.5f * columnWidth)
+    {
+        halfWidth *= 0.5f * columnWidth / halfHeight;
+        halfHeight = 0.5f * columnWidth;
+    }
+    return StreamedTextureQuad{
+        .centerX = -1.0f + (float(index) + 0.5f) * columnWidth,
+        .centerY = -1.0f + 0.5f * columnWidth,
+        .halfWidth = halfWidth,
+        .halfHeight = halfHeight
+    };
+}
+
+// Swap in the textures whose uploads have completed, feed the on-screen sizes of the next frame to the streamer, and push
+// its requests to the upload worker. The previous frame has completed, so the GPU no longer reads the descriptors rewritten here.
+static auto UpdateTextureStreaming() -> void
+{
+    if (!s_textureStreamingEnabled) return;
+
+    const UINT descriptorSize = s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    s_textureUploadWorker->Collect([descriptorSize](TextureUploadResult& result) {
+        s_textureStreamer->Complete(result.texture, result.resource != nullptr);
+        if (result.resource == nullptr) return;
+
+        StreamedTexture& texture = s_streamedTextures[result.texture];
+        if (texture.resource != nullptr) {
+            ReleaseAfterFrameFence(ComHandle<IUnknown>(texture.resource), s_fenceValue);
+        }
+        texture.resource = result.resource;
+        texture.firstMip = result.firstMip;
+        s_textureUploadTime += result.uploadTime;
+        ++s_textureUploadCount;
+
+        const D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{
+            .Format = DXGI_FORMAT(texture.dds.format),
+            .ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D,
+            .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+            .Texture2D { .MostDetailedMip = 0, .MipLevels = texture.dds.mipCount - texture.firstMip, .PlaneSlice = 0, .ResourceMinLODClamp = 0.0f }
+        };
+        D3D12_CPU_DESCRIPTOR_HANDLE descriptorHandle = s_textureDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+        descriptorHandle.ptr += SIZE_T(result.texture) * descriptorSize;
+        s_device->CreateShaderResourceView(texture.resource, &srvDesc, descriptorHandle);
+    });
+
+    auto const [sceneWidth, sceneHeight] = GetSceneRenderSize();
+    for (uint32_t i = 0; i < uint32_t(s_streamedTextures.size()); ++i)
+    {
+        const StreamedTextureQuad quad = GetStreamedTextureQuad(i, sceneWidth, sceneHeight, s_frameCount);
+        s_textureStreamer->SetScreenSize(i, quad.halfWidth * float(sceneWidth), quad.halfHeight * float(sceneHeight), s_frameCount);
+    }
+
+    s_textureStreamingRequests.clear();
+    s_textureStreamer->Update(s_frameCount, s_textureStreamingRequests);
+    for (const TextureStreamingRequest& request : s_textureStreamingRequests) {
+        s_textureUploadWorker->Push([request] { return UploadStreamedTextureMips(request.texture, request.firstMip); });
+    }
+}
+
+// Draw the textures with resident mips over the `sceneWidth` x `sceneHeight` scene, one quad each.
+static auto RecordStreamedTextureDraws(UINT sceneWidth, UINT sceneHeight, D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle) -> void
+{
+    const D3D12_VIEWPORT viewPort{
+        .TopLeftX = 0.0f,
+        .TopLeftY = 0.0f,
+        .Width = FLOAT(sceneWidth),
+        .Height = FLOAT(sceneHeight),
+        .MinDepth = 0.0f,
+        .MaxDepth = 1.0f
+    };
+    s_basicCommandList->RSSetViewports(1, &viewPort);
+
+    const D3D12_RECT scissorRect{
+        .left = 0,
+        .top = 0,
+        .right = LONG(sceneWidth),
+        .bottom = LONG(sceneHeight)
+    };
+    s_basicCommandList->RSSetScissorRects(1, &scissorRect);
+
+    s_basicCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+
+    s_basicCommandList->SetPipelineState(s_texturePipelineState);
+    s_basicCommandList->SetGraphicsRootSignature(s_textureRootSignature);
+    ID3D12DescriptorHeap* const descriptorHeaps[] = { s_textureDescriptorHeap };
+    s_basicCommandList->SetDescriptorHeaps((UINT)std::size(descriptorHeaps), descriptorHeaps);
+    s_basicCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+    const UINT descriptorSize = s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    for (uint32_t i = 0; i < uint32_t(s_streamedTextures.size()); ++i)
+    {
+        if (s_streamedTextures[i].resource == nullptr) continue;
+
+        const StreamedTextureQuad quad = GetStreamedTextureQuad(i, sceneWidth, sceneHeight, s_frameCount);
+        D3D12_GPU_DESCRIPTOR_HANDLE descriptorHandle = s_textureDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
+        descriptorHandle.ptr += UINT64(i) * descriptorSize;
+        s_basicCommandList->SetGraphicsRoot32BitConstants(0, UINT(sizeof(quad) / sizeof(UINT)), &quad, 0);
+        s_basicCommandList->SetGraphicsRootDescriptorTable(1, descriptorHandle);
+        s_basicCommandList->DrawInstanced(4, 1, 0, 0);
+    }
+}
+
+static auto ReportTextureStreamingStats() -> void
+{
+    const TextureStreamingStats& stats = s_textureStreamer->GetStats();
+    printf("Texture streaming: %.1f of %.1f MB resident, %llu loads, %llu drops, %llu evictions, %llu failed, %.1f MB streamed in, %.3f ms per upload on the worker\n",
+        double(s_textureStreamer->GetResidentSize()) / (1024.0 * 1024.0), double(s_textureStreamer->GetSettings().budget) / (1024.0 * 1024.0),
+        (unsigned long long)stats.loadCount, (unsigned long long)stats.dropCount, (unsigned long long)stats.evictionCount, (unsigned long long)stats.failedCount,
+        double(stats.loadedSize) / (1024.0 * 1024.0), s_textureUploadCount > 0 ? s_textureUploadTime / double(s_textureUploadCount) : 0.0);
+
+    // The first resident mip of each texture, against the one its size on the screen asks for
+    printf("  resident/desired mips:");
+    for (uint32_t i = 0; i < s_textureStreamer->GetTextureCount(); ++i) {
+        printf(" %u/%u", s_textureStreamer->GetResidentMip(i), s_textureStreamer->GetDesiredMip(i));
+    }
+    puts("");
+}
+
+// Stop the upload worker first, so that no upload is in flight, then release the textures it created.
+static auto ReleaseTextureStreamingResources() -> void
+{
+    if (s_textureUploadWorker != nullptr)
+    {
+        s_textureUploadWorker->Stop();
+        s_textureUploadWorker->Collect([](TextureUploadResult& result) {
+            if (result.resource != nullptr) {
+                result.resource->Release();
+            }
+        });
+        s_textureUploadWorker.reset();
+    }
+    s_textureStreamer.reset();
+
+    for (auto& texture : s_streamedTextures)
+    {
+        if (texture.resource != nullptr)
+        {
+            texture.resource->Release();
+            texture.resource = nullptr;
+        }
+        UnmapStreamedTextureFile(texture);
+    }
+    s_streamedTextures.clear();
+
+    if (s_textureCopyFence != nullptr)
+    {
+        s_textureCopyFence->Release();
+        s_textureCopyFence = nullptr;
+    }
+    if (s_textureCopyCommandList != nullptr)
+    {
+        s_textureCopyCommandList->Release();
+        s_textureCopyCommandList = nullptr;
+    }
+    if (s_textureCopyAllocator != nullptr)
+    {
+        s_textureCopyAllocator->Release();
+        s_textureCopyAllocator = nullptr;
+    }
+    if (s_textureCopyQueue != nullptr)
+    {
+        s_textureCopyQueue->Release();
+        s_textureCopyQueue = nullptr;
+    }
+    if (s_textureDescriptorHeap != nullptr)
+    {
+        s_textureDescriptorHeap->Release();
+        s_textureDescriptorHeap = nullptr;
+    }
+    if (s_texturePipelineState != nullptr)
+    {
+        s_texturePipelineState->Release();
+        s_texturePipelineState = nullptr;
+    }
+    if (s_textureRootSignature != nullptr)
+    {
+        s_textureRootSignature->Release();
+        s_textureRootSignature = nullptr;
+    }
+}
+
+// ==== Mip generation (MipGenerator.h) ====
+
+// Root constants of shaders/mips.hlsl
+struct MipConstants
+{
+    UINT sourceWidth;
+    UINT sourceHeight;
+    UINT mipCount;
+    UINT srgb;
+};
+
+static auto CreateMipRootSignature() -> bool
+{
+    const RootDescriptorRange descriptorRanges[2]{
+        // The source mip, made a shader resource by the barriers before its wave
+        {
+            .type = RootDescriptorRangeType::SRV,
+            .descriptorCount = 1,
+            .baseShaderRegister = 0,
+            .registerSpace = 0,
+            .offsetInDescriptorsFromTableStart = 0,
+            .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+            .descriptorsVolatile = false
+        },
+        // The mips written by the dispatch
+        {
+            .type = RootDescriptorRangeType::UAV,
+            .descriptorCount = MIP_MAX_LEVELS_PER_DISPATCH,
+            .baseShaderRegister = 0,
+            .registerSpace = 0,
+            .offsetInDescriptorsFromTableStart = 1,
+            .volatility = RootDataVolatility::VOLATILE,
+            .descriptorsVolatile = false
+        }
+    };
+
+    const RootParameterDesc rootParameters[]{
+        // cbMips
+        {
+            .kind = RootParameterKind::ROOT_CONSTANTS,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = UINT(sizeof(MipConstants) / sizeof(UINT)),
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        },
+        // The views of a dispatch, see CreateMipGenerationDescriptors
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = descriptorRanges,
+            .rangeCount = (uint32_t)std::size(descriptorRanges)
+        }
+    };
+
+    return CreateCachedRootSignature("mip generation", rootParameters, (uint32_t)std::size(rootParameters), nullptr, 0,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE, &s_mipRootSignature);
+}
+
+static auto CreateMipPipelineState() -> bool
+{
+    const D3D_SHADER_MACRO noDefines[] = { { nullptr, nullptr } };
+    ID3DBlob* shaderObject = CompileShaderObjectFromPath(L"shaders/mips.hlsl", "GenerateMipsCS", "cs_5_1", noDefines);
+    if (shaderObject == nullptr) return false;
+
+    const D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc{
+        .pRootSignature = s_mipRootSignature,
+        .CS = { .pShaderBytecode = shaderObject->GetBufferPointer(), .BytecodeLength = shaderObject->GetBufferSize() },
+        .NodeMask = 0,
+        .CachedPSO { },
+        .Flags = D3D12_PIPELINE_STATE_FLAG_NONE
+    };
+    const HRESULT hRes = s_device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&s_mipPipelineState));
+    shaderObject->Release();
+
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateComputePipelineState for mip generation failed: %ld\n", hRes);
+        return false;
+    }
+    return true;
+}
+
+static auto ReleaseMipGenerationPipeline() -> void
+{
+    if (s_mipPipelineState != nullptr)
+    {
+        s_mipPipelineState->Release();
+        s_mipPipelineState = nullptr;
+    }
+    if (s_mipRootSignature != nullptr)
+    {
+        s_mipRootSignature->Release();
+        s_mipRootSignature = nullptr;
+    }
+}
+
+// An RGBA8 texture with the mips of `desc`, in COPY_DEST state. sRGB textures are typeless, so that the mips are written
+// through UNORM views and sampled through sRGB ones.
+static auto CreateMipTexture(const MipTextureDesc& desc, ID3D12Resource** ppTexture) -> bool
+{
+    const D3D12_HEAP_PROPERTIES defaultHeapProperties{
+        .Type = D3D12_HEAP_TYPE_DEFAULT,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC textureDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        .Alignment = 0,
+        .Width = desc.width,
+        .Height = desc.height,
+        .DepthOrArraySize = 1,
+        .MipLevels = UINT16(desc.levelCount),
+        .Format = desc.srgb ? DXGI_FORMAT_R8G8B8A8_TYPELESS : DXGI_FORMAT_R8G8B8A8_UNORM,
+        .SampleDesc { .Count = 1, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+        .Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+    };
+    const HRESULT hRes = s_device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &textureDesc, D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr, IID_PPV_ARGS(ppTexture));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for mip texture failed: %ld\n", hRes);
+        return false;
+    }
+    return true;
+}
+
+// Copy mips [0, levelCount) of `chain` into `texture`, which is in COPY_DEST state and left in `stateAfter`, and wait for the copy.
+static auto UploadMipChain(ID3D12Resource* texture, const MipChain& chain, UINT levelCount, D3D12_RESOURCE_STATES stateAfter) -> bool
+{
+    const D3D12_RESOURCE_DESC textureDesc = texture->GetDesc();
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprints[MIP_MAX_LEVEL_COUNT]{ };
+    UINT rowCounts[MIP_MAX_LEVEL_COUNT]{ };
+    UINT64 uploadSize = 0;
+    s_device->GetCopyableFootprints(&textureDesc, 0, levelCount, 0, footprints, rowCounts, nullptr, &uploadSize);
+
+    ComHandle<ID3D12Resource> uploadBuffer;
+    HRESULT hRes = CreateCpuWrittenBuffer(GetBufferHeapPolicy(s_deviceMemoryCaps, BufferMemoryPath::STAGED), uploadSize,
+        D3D12_RESOURCE_STATE_GENERIC_READ, uploadBuffer.ReleaseAndGetAddressOf());
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for mip upload buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    uint8_t* uploadData = nullptr;
+    const D3D12_RANGE readRange{ 0, 0 };
+    hRes = uploadBuffer->Map(0, &readRange, reinterpret_cast<void**>(&uploadData));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map mip upload buffer failed: %ld\n", hRes);
+        return false;
+    }
+    for (UINT level = 0; level < levelCount; ++level)
+    {
+        const size_t rowSize = size_t(GetMipSize(chain.width, level)) * MIP_TEXEL_SIZE;
+        for (UINT row = 0; row < rowCounts[level]; ++row) {
+            memcpy(uploadData + footprints[level].Offset + UINT64(row) * footprints[level].Footprint.RowPitch, chain.GetLevel(level) + row * rowSize, rowSize);
+        }
+    }
+    const D3D12_RANGE writtenRange{ 0, SIZE_T(uploadSize) };
+    uploadBuffer->Unmap(0, &writtenRange);
+
+    if (!BeginImmediateCommands()) return false;
+    for (UINT level = 0; level < levelCount; ++level)
+    {
+        const D3D12_TEXTURE_COPY_LOCATION destination{
+            .pResource = texture,
+            .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+            .SubresourceIndex = level
+        };
+        const D3D12_TEXTURE_COPY_LOCATION source{
+            .pResource = uploadBuffer.Get(),
+            .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+            .PlacedFootprint = footprints[level]
+        };
+        s_basicCommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+    }
+    const D3D12_RESOURCE_BARRIER barrier = MakeTransitionBarrier(texture, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COPY_DEST, stateAfter);
+    s_basicCommandList->ResourceBarrier(1, &barrier);
+    return SubmitImmediateCommands();
+}
+
+// Copy all the mips of `texture`, which is in `state`, back into `chain` and wait for the copy.
+static auto ReadbackMipChain(ID3D12Resource* texture, D3D12_RESOURCE_STATES state, MipChain& chain) -> bool
+{
+    const D3D12_RESOURCE_DESC textureDesc = texture->GetDesc();
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprints[MIP_MAX_LEVEL_COUNT]{ };
+    UINT rowCounts[MIP_MAX_LEVEL_COUNT]{ };
+    UINT64 readbackSize = 0;
+    s_device->GetCopyableFootprints(&textureDesc, 0, chain.levelCount, 0, footprints, rowCounts, nullptr, &readbackSize);
+
+    const D3D12_HEAP_PROPERTIES readbackHeapProperties{
+        .Type = D3D12_HEAP_TYPE_READBACK,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC readbackDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = readbackSize,
+        .Height = 1U,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc { .Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    ComHandle<ID3D12Resource> readbackBuffer;
+    HRESULT hRes = s_device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackDesc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(readbackBuffer.ReleaseAndGetAddressOf()));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateCommittedResource for mip readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+
+    if (!BeginImmediateCommands()) return false;
+    D3D12_RESOURCE_BARRIER barrier = MakeTransitionBarrier(texture, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, state, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    s_basicCommandList->ResourceBarrier(1, &barrier);
+    for (UINT level = 0; level < chain.levelCount; ++level)
+    {
+        const D3D12_TEXTURE_COPY_LOCATION destination{
+            .pResource = readbackBuffer.Get(),
+            .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+            .PlacedFootprint = footprints[level]
+        };
+        const D3D12_TEXTURE_COPY_LOCATION source{
+            .pResource = texture,
+            .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+            .SubresourceIndex = level
+        };
+        s_basicCommandList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+    }
+    barrier = MakeTransitionBarrier(texture, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_STATE_COPY_SOURCE, state);
+    s_basicCommandList->ResourceBarrier(1, &barrier);
+    if (!SubmitImmediateCommands()) return false;
+
+    uint8_t* readbackData = nullptr;
+    const D3D12_RANGE readRange{ 0, SIZE_T(readbackSize) };
+    hRes = readbackBuffer->Map(0, &readRange, reinterpret_cast<void**>(&readbackData));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "Map mip readback buffer failed: %ld\n", hRes);
+        return false;
+    }
+    for (UINT level = 0; level < chain.levelCount; ++level)
+    {
+        const size_t rowSize = size_t(GetMipSize(chain.width, level)) * MIP_TEXEL_SIZE;
+        for (UINT row = 0; row < rowCounts[level]; ++row) {
+            memcpy(chain.GetLevel(level) + row * rowSize, readbackData + footprints[level].Offset + UINT64(row) * footprints[level].Footprint.RowPitch, rowSize);
+        }
+    }
+    const D3D12_RANGE writtenRange{ 0, 0 };
+    readbackBuffer->Unmap(0, &writtenRange);
+    return true;
+}
+
+// A shader-visible heap with the views of each dispatch of `plan`: the source mip, then the MIP_MAX_LEVELS_PER_DISPATCH mips
+// it may write, with null views past those it does write. All the views are UNORM, sRGB is handled by the shader.
+static auto CreateMipGenerationDescriptors(ID3D12Resource* const textures[], const MipGenerationPlan& plan, ID3D12DescriptorHeap** ppHeap) -> bool
+{
+    const D3D12_DESCRIPTOR_HEAP_DESC heapDesc{
+        .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        .NumDescriptors = UINT(plan.dispatches.size()) * MIP_DESCRIPTOR_COUNT_PER_DISPATCH,
+        .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+        .NodeMask = 0
+    };
+    const HRESULT hRes = s_device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(ppHeap));
+    if (FAILED(hRes))
+    {
+        fprintf(stderr, "CreateDescriptorHeap for mip generation failed: %ld\n", hRes);
+        return false;
+    }
+
+    const UINT descriptorSize = s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    D3D12_CPU_DESCRIPTOR_HANDLE descriptorHandle = (*ppHeap)->GetCPUDescriptorHandleForHeapStart();
+    for (const MipDispatch& dispatch : plan.dispatches)
+    {
+        const D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{
+            .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+            .ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D,
+            .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+            .Texture2D { .MostDetailedMip = dispatch.srcLevel, .MipLevels = 1, .PlaneSlice = 0, .ResourceMinLODClamp = 0.0f }
+        };
+        s_device->CreateShaderResourceView(textures[dispatch.texture], &srvDesc, descriptorHandle);
+        descriptorHandle.ptr += descriptorSize;
+
+        for (UINT i = 0; i < MIP_MAX_LEVELS_PER_DISPATCH; ++i)
+        {
+            const D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc{
+                .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+                .ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D,
+                .Texture2D { .MipSlice = i < dispatch.levelCount ? dispatch.srcLevel + 1 + i : 0, .PlaneSlice = 0 }
+            };
+            s_device->CreateUnorderedAccessView(i < dispatch.levelCount ? textures[dispatch.texture] : nullptr, nullptr, &uavDesc, descriptorHandle);
+            descriptorHandle.ptr += descriptorSize;
+        }
+    }
+    return true;
+}
+
+// Build mips 1 and up of `textures` as `plan` says. The dispatches of a wave are recorded together after a single barrier
+// batch, which makes the mips they read shader resources. The textures are in `state` before and after.
+static auto RecordMipGeneration(ID3D12GraphicsCommandList* commandList, ID3D12Resource* const textures[], const MipTextureDesc descs[], size_t textureCount,
+    const MipGenerationPlan& plan, ID3D12DescriptorHeap* descriptorHeap, D3D12_RESOURCE_STATES state) -> void
+{
+    std::vector<std::vector<D3D12_RESOURCE_STATES>> mipStates(textureCount);
+    std::vector<D3D12_RESOURCE_BARRIER> barriers;
+    auto const transition = [&](size_t texture, UINT mip, D3D12_RESOURCE_STATES stateAfter) {
+        if (mipStates[texture][mip] == stateAfter) return;
+        barriers.push_back(MakeTransitionBarrier(textures[texture], mip, mipStates[texture][mip], stateAfter));
+        mipStates[texture][mip] = stateAfter;
+    };
+    auto const flushBarriers = [&] {
+        if (barriers.empty()) return;
+        commandList->ResourceBarrier(UINT(barriers.size()), barriers.data());
+        barriers.clear();
+    };
+
+    for (size_t i = 0; i < textureCount; ++i)
+    {
+        mipStates[i].assign(descs[i].levelCount, state);
+        for (UINT mip = 1; mip < descs[i].levelCount; ++mip) {
+            transition(i, mip, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        }
+    }
+
+    commandList->SetPipelineState(s_mipPipelineState);
+    commandList->SetComputeRootSignature(s_mipRootSignature);
+    ID3D12DescriptorHeap* const descriptorHeaps[] = { descriptorHeap };
+    commandList->SetDescriptorHeaps((UINT)std::size(descriptorHeaps), descriptorHeaps);
+
+    const UINT descriptorSize = s_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    const D3D12_GPU_DESCRIPTOR_HANDLE heapStart = descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+    size_t waveBegin = 0;
+    for (const size_t waveEnd : plan.waveEnds)
+    {
+        // Also waits for the previous wave to write the mips this one reads
+        for (size_t d = waveBegin; d < waveEnd; ++d) {
+            transition(plan.dispatches[d].texture, plan.dispatches[d].srcLevel, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        }
+        flushBarriers();
+
+        for (size_t d = waveBegin; d < waveEnd; ++d)
+        {
+            const MipDispatch& dispatch = plan.dispatches[d];
+            const MipTextureDesc& desc = descs[dispatch.texture];
+            const MipConstants constants{
+                .sourceWidth = GetMipSize(desc.width, dispatch.srcLevel),
+                .sourceHeight = GetMipSize(desc.height, dispatch.srcLevel),
+                .mipCount = dispatch.levelCount,
+                .srgb = desc.srgb ? 1U : 0U
+            };
+            commandList->SetComputeRoot32BitConstants(0, UINT(sizeof(constants) / sizeof(UINT)), &constants, 0);
+            commandList->SetComputeRootDescriptorTable(1, D3D12_GPU_DESCRIPTOR_HANDLE{ heapStart.ptr + UINT64(d) * MIP_DESCRIPTOR_COUNT_PER_DISPATCH * descriptorSize });
+            commandList->Dispatch(dispatch.groupCountX, dispatch.groupCountY, 1);
+        }
+        waveBegin = waveEnd;
+    }
+
+    for (size_t i = 0; i < textureCount; ++i)
+    {
+        for (UINT mip = 0; mip < descs[i].levelCount; ++mip) {
+            transition(i, mip, state);
+        }
+    }
+    flushBarriers();
+}
+
+// Build the mip chains of textures of odd and even sizes, in linear and sRGB space, on the GPU and with the CPU fallback,
+// check that they agree within MIP_COMPARE_TOLERANCE, and compare their throughput. Without the compute pipeline, only the
+// CPU chains are built and uploaded.
+static auto RunMipGenerationBenchmark() -> bool
+{
+    std::vector<MipTextureDesc> descs;
+    std::vector<MipChain> expectedChains;
+    uint64_t sourceTexelCount = 0;
+    for (auto const& size : MIP_BENCHMARK_SIZES)
+    {
+        descs.push_back(MipTextureDesc{ .width = size.width, .height = size.height, .levelCount = GetFullMipCount(size.width, size.height), .srgb = size.srgb });
+        expectedChains.push_back(CreateMipChain(size.width, size.height, 0, size.srgb));
+        WriteMipTestPattern(expectedChains.back(), uint32_t(expectedChains.size()));
+        sourceTexelCount += uint64_t(size.width) * size.height;
+    }
+    const double totalMegaTexels = double(sourceTexelCount) * double(MIP_BENCHMARK_ITERATION_COUNT) / 1.0e6;
+
+    LARGE_INTEGER beginTime{ }, endTime{ };
+    QueryPerformanceCounter(&beginTime);
+    for (UINT i = 0; i < MIP_BENCHMARK_ITERATION_COUNT; ++i)
+    {
+        for (auto& chain : expectedChains) {
+            GenerateMipChain(chain, MipSimd::VECTOR, 0);
+        }
+    }
+    QueryPerformanceCounter(&endTime);
+    const double cpuSeconds = double(endTime.QuadPart - beginTime.QuadPart) / double(s_performanceFrequency.QuadPart);
+
+    std::vector<ComHandle<ID3D12Resource>> textures(descs.size());
+    std::vector<ID3D12Resource*> texturePointers(descs.size());
+    for (size_t i = 0; i < descs.size(); ++i)
+    {
+        if (!CreateMipTexture(descs[i], textures[i].ReleaseAndGetAddressOf())) return false;
+        texturePointers[i] = textures[i].Get();
+    }
+
+    if (!CreateMipRootSignature() || !CreateMipPipelineState())
+    {
+        puts("WARNING: Compute mip generation is not supported. The mips will be built on the CPU!");
+        for (size_t i = 0; i < descs.size(); ++i)
+        {
+            if (!UploadMipChain(texturePointers[i], expectedChains[i], descs[i].levelCount, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)) return false;
+        }
+        printf("Mip generation of %zu textures: CPU %.1f M texels/s with %s lanes\n", descs.size(), totalMegaTexels / cpuSeconds, GetMipSimdName());
+        return true;
+    }
+
+    for (size_t i = 0; i < descs.size(); ++i)
+    {
+        if (!UploadMipChain(texturePointers[i], expectedChains[i], 1, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)) return false;
+    }
+    const MipGenerationPlan plan = PlanMipGeneration(descs.data(), descs.size());
+    ComHandle<ID3D12DescriptorHeap> descriptorHeap;
+    if (!CreateMipGenerationDescriptors(texturePointers.data(), plan, descriptorHeap.ReleaseAndGetAddressOf())) return false;
+
+    // All the iterations in one submission, so the time is mostly the GPU's
+    QueryPerformanceCounter(&beginTime);
+    if (!BeginImmediateCommands()) return false;
+    for (UINT i = 0; i < MIP_BENCHMARK_ITERATION_COUNT; ++i)
+    {
+        RecordMipGeneration(s_basicCommandList, texturePointers.data(), descs.data(), descs.size(), plan, descriptorHeap.Get(),
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    }
+    if (!SubmitImmediateCommands()) return false;
+    QueryPerformanceCounter(&endTime);
+    const double gpuSeconds = double(endTime.QuadPart - beginTime.QuadPart) / double(s_performanceFrequency.QuadPart);
+
+    uint32_t maxDifference = 0;
+    for (size_t i = 0; i < descs.size(); ++i)
+    {
+        MipChain actual = CreateMipChain(descs[i].width, descs[i].height, descs[i].levelCount, descs[i].srgb);
+        if (!ReadbackMipChain(texturePointers[i], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, actual)) return false;
+
+        for (size_t t = 0; t < actual.texels.size(); ++t)
+        {
+            const uint32_t difference = uint32_t(std::abs(int32_t(actual.texels[t]) - int32_t(expectedChains[i].texels[t])));
+            if (difference > MIP_COMPARE_TOLERANCE)
+            {
+                fprintf(stderr, "Mips of the %ux%u %s texture differ from the CPU reference by %u at byte %zu\n", descs[i].width, descs[i].height,
+                    descs[i].srgb ? "sRGB" : "linear", difference, t);
+                return false;
+            }
+            maxDifference = std::max(maxDifference, difference);
+        }
+    }
+
+    printf("Mip generation of %zu textures in %zu dispatches and %zu waves: CPU %.1f M texels/s with %s lanes, GPU %.1f M texels/s, "
+        "at most %u apart\n", descs.size(), plan.dispatches.size(), plan.waveEnds.size(), totalMegaTexels / cpuSeconds, GetMipSimdName(),
+        totalMegaTexels / gpuSeconds, maxDifference);
+    return true;
+}
+
+// ==== Frame readback (FrameReadback.h) ====
+
+// Create the readback buffers of the frame captures, mapped for as long as they live, and start the workers.
+static auto CreateFrameReadbackResources() -> bool
+{
+    if (!s_frameCaptureEnabled) return true;
+
+    if (s_frameCaptureDirectory != nullptr && !CreateDirectoryA(s_frameCaptureDirectory, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        fprintf(stderr, "CreateDirectory %s for frame captures failed: %lu\n", s_frameCaptureDirectory, GetLastError());
+        return false;
+    }
+
+    const D3D12_RESOURCE_DESC backBufferDesc = s_renderTargets[0]->GetDesc();
+    UINT64 readbackSize = 0;
+    s_device->GetCopyableFootprints(&backBufferDesc, 0, 1, 0, &s_frameReadbackFootprint, nullptr, nullptr, &readbackSize);
+
+    const D3D12_HEAP_PROPERTIES readbackHeapProperties{
+        .Type = D3D12_HEAP_TYPE_READBACK,
+        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+        .CreationNodeMask = 1,
+        .VisibleNodeMask = 1
+    };
+    const D3D12_RESOURCE_DESC readbackBufferDesc{
+        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+        .Alignment = 0,
+        .Width = readbackSize,
+        .Height = 1,
+        .DepthOrArraySize = 1,
+        .MipLevels = 1,
+        .Format = DXGI_FORMAT_UNKNOWN,
+        .SampleDesc {.Count = 1U, .Quality = 0 },
+        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        .Flags = D3D12_RESOURCE_FLAG_NONE
+    };
+    for (size_t slot = 0; slot < FRAME_READBACK_SLOT_COUNT; ++slot)
+    {
+        HRESULT hRes = s_device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackBufferDesc,
+            D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&s_frameReadbackBuffers[slot]));
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "CreateCommittedResource for frame readback buffer failed: %ld\n", hRes);
+            return false;
+        }
+
+        // A slot is only read after the fence of its copy has completed, so the buffer can stay mapped.
+        void* pData = nullptr;
+        hRes = s_frameReadbackBuffers[slot]->Map(0, nullptr, &pData);
+        if (FAILED(hRes))
+        {
+            fprintf(stderr, "Map frame readback buffer failed: %ld\n", hRes);
+            return false;
+        }
+        s_frameReadbackData[slot] = static_cast<const uint8_t*>(pData);
+    }
+
+    const FrameCaptureSettings settings{
+        .captureDirectory = s_frameCaptureDirectory != nullptr ? s_frameCaptureDirectory : "",
+        .compareDirectory = s_frameCompareDirectory != nullptr ? s_frameCompareDirectory : "",
+        .format = s_frameCaptureFormat,
+        .diffThreshold = 0
+    };
+    s_frameReadbackRing = std::make_unique<FrameReadbackRing>(FRAME_READBACK_SLOT_COUNT);
+    s_frameCaptureWorkers = std::make_unique<FrameCaptureWorkers>(settings, FRAME_CAPTURE_THREAD_COUNT);
+
+    printf("Frame capture is enabled for %llu frames with %zu readback slots and %u workers\n", FRAME_CAPTURE_MAX_FRAME_COUNT,
+        FRAME_READBACK_SLOT_COUNT, FRAME_CAPTURE_THREAD_COUNT);
+    return true;
+}
+
+static auto ReportFrameCaptureStats() -> void
+{
+    const FrameReadbackStats& readbackStats = s_frameReadbackRing->GetStats();
+    const FrameCaptureStats captureStats = s_frameCaptureWorkers->GetStats();
+    printf("Frame capture: %llu frames read back, %llu skipped with no free slot, %llu written, %llu compared, %llu mismatched "
+        "(largest channel difference %u), %llu failed, %.3f ms per frame on a worker\n", readbackStats.submittedCount, readbackStats.skippedCount,
+        captureStats.writtenCount, captureStats.comparedCount, captureStats.mismatchedCount, captureStats.maxChannelDifference,
+        captureStats.failedCount, captureStats.processedCount > 0 ? captureStats.processTime / double(captureStats.processedCount) : 0.0);
+}
+
+// Copy `source`, which is in `sourceState`, to a free readback slot for the frame being recorded. The frame is skipped if no slot
+// is free, rather than waiting for one.
+static auto RecordFrameReadbackCopy(ID3D12Resource* source, D3D12_RESOURCE_STATES sourceState) -> void
+{
+    if (s_frameReadbackRing == nullptr || s_frameCount >= FRAME_CAPTURE_MAX_FRAME_COUNT) return;
+
+    const size_t slot = s_frameReadbackRing->Acquire();
+    if (slot == FRAME_READBACK_NO_SLOT) return;
+
+    const D3D12_RESOURCE_BARRIER toCopySource = MakeTransitionBarrier(source, 0, sourceState, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    s_basicCommandList->ResourceBarrier(1, &toCopySource);
+
+    const D3D12_TEXTURE_COPY_LOCATION destination{
+        .pResource = s_frameReadbackBuffers[slot],
+        .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+        .PlacedFootprint = s_frameReadbackFootprint
+    };
+    const D3D12_TEXTURE_COPY_LOCATION sourceLocation{
+        .pResource = source,
+        .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+        .SubresourceIndex = 0
+    };
+    s_basicCommandList->CopyTextureRegion(&destination, 0, 0, 0, &sourceLocation, nullptr);
+
+    const D3D12_RESOURCE_BARRIER fromCopySource = MakeTransitionBarrier(source, 0, D3D12_RESOURCE_STATE_COPY_SOURCE, sourceState);
+    s_basicCommandList->ResourceBarrier(1, &fromCopySource);
+
+    // The frame being recorded will signal `s_fenceValue + 1`. The reactor hands the slot over as soon as it has, so the
+    // render thread never polls for it.
+    const uint64_t frameIndex = s_frameCount;
+    s_frameReadbackRing->SubmitTracked(slot, frameIndex);
+    s_fenceReactor->OnCompletion(FENCE_REACTOR_FRAME_FENCE, s_fenceValue + 1, [slot, frameIndex] {
+        s_frameReadbackRing->Complete(slot);
+        const FrameImage image{
+            .pixels = s_frameReadbackData[slot] + s_frameReadbackFootprint.Offset,
+            .width = s_frameReadbackFootprint.Footprint.Width,
+            .height = s_frameReadbackFootprint.Footprint.Height,
+            .rowPitch = s_frameReadbackFootprint.Footprint.RowPitch,
+            .frameIndex = frameIndex
+        };
+        s_frameCaptureWorkers->Push(image, [slot] { s_frameReadbackRing->Release(slot); });
+    });
+}
+
+// Write the last frames, which have all completed, wait for the workers and release the readback buffers.
+static auto ReleaseFrameReadbackResources() -> void
+{
+    if (s_frameCaptureWorkers != nullptr)
+    {
+        // All the frames have completed, so this hands the last slots over.
+        if (s_fenceReactor != nullptr) {
+            s_fenceReactor->Drain();
+        }
+        s_frameCaptureWorkers->Stop();
+        ReportFrameCaptureStats();
+        s_frameCaptureWorkers.reset();
+    }
+    s_frameReadbackRing.reset();
+
+    for (size_t slot = 0; slot < FRAME_READBACK_SLOT_COUNT; ++slot)
+    {
+        if (s_frameReadbackBuffers[slot] != nullptr)
+        {
+            if (s_frameReadbackData[slot] != nullptr)
+            {
+                const D3D12_RANGE writeRange{ 0, 0 };
+                s_frameReadbackBuffers[slot]->Unmap(0, &writeRange);
+            }
+            s_frameReadbackBuffers[slot]->Release();
+            s_frameReadbackBuffers[slot] = nullptr;
+            s_frameReadbackData[slot] = nullptr;
+        }
+    }
+}
+
+// Passes of the basic frame outside the rendering interface: the GPU timestamps and profile scopes, the meshlets, the particles, the streamed
+// textures, the Hi-Z build, the dynamic resolution upscale, the multi-adapter band copies and the frame readback. They are recorded into `s_basicCommandList`
+// directly and are not captured.
+class BasicFramePasses final : public BasicFrameExtension
+{
+public:
+    BasicFramePasses(RenderResourceId sceneTarget, UINT sceneWidth, UINT sceneHeight) :
+        m_sceneTarget(sceneTarget), m_sceneWidth(sceneWidth), m_sceneHeight(sceneHeight) { }
+
+    auto OnFrameBegin(RenderCommandList& commandList) -> void override
+    {
+        (void)commandList;
+        if (s_timestampQueryHeap != nullptr) {
+            s_basicCommandList->EndQuery(s_timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0);
+        }
+
+        if (s_gpuProfiler != nullptr) {
+            s_gpuProfiler->BeginFrame(s_basicCommandList, s_fenceValue + 1, s_fence->GetCompletedValue());
+        }
+        BeginGpuProfileScope("Scene pass");
+    }
+
+    auto OnScenePassEnd(RenderCommandList& commandList) -> void override
+    {
+        (void)commandList;
+        EndGpuProfileScope();
+
+        // Before the Hi-Z build, which leaves the depth target in DEPTH_WRITE state but rebinds nothing
+        if (s_meshletsEnabled)
+        {
+            BeginGpuProfileScope("Meshlets");
+            RecordMeshletDraw(m_sceneWidth, m_sceneHeight, s_renderDevice.GetRtvHandle(m_sceneTarget), s_renderDevice.GetDsvHandle(s_depthTargetId));
+            EndGpuProfileScope();
+        }
+        if (s_particleMode != ParticleMode::NONE) {
+            RecordParticlePasses(m_sceneWidth, m_sceneHeight, s_renderDevice.GetRtvHandle(m_sceneTarget), s_renderDevice.GetDsvHandle(s_depthTargetId));
+        }
+        if (s_textureStreamingEnabled)
         {
-            fprintf(stderr, "Close basic command list failed: %ld\n", hRes);
-            break;
+            BeginGpuProfileScope("Textures");
+            RecordStreamedTextureDraws(m_sceneWidth, m_sceneHeight, s_renderDevice.GetRtvHandle(m_sceneTarget));
+            EndGpuProfileScope();
         }
 
-        hRes = s_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_BUNDLE, s_commandBundleAllocator, s_basicPipelineState, IID_PPV_ARGS(&s_basicCommandBundle));
-        if (FAILED(hRes))
+        if (s_occlusionCullingEnabled)
         {
-            fprintf(stderr, "CreateCommandList for command bundle failed: %ld\n", hRes);
-            break;
+            BeginGpuProfileScope("Hi-Z build");
+            RecordHiZBuildPass(m_sceneWidth, m_sceneHeight);
+            EndGpuProfileScope();
         }
 
-        done = true;
-    } while (false);
+        BeginGpuProfileScope("Post passes");
+        if (s_dynamicResolutionEnabled)
+        {
+            D3D12_CPU_DESCRIPTOR_HANDLE backBufferRtvHandle = s_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+            backBufferRtvHandle.ptr += size_t(s_currFrameIndex * s_rtvDescriptorSize);
+            BeginGpuProfileScope("Upscale");
+            RecordUpscalePass(m_sceneWidth, m_sceneHeight, backBufferRtvHandle);
+            EndGpuProfileScope();
+        }
 
-    if (vertexShaderObj.pShaderBytecode != nullptr) {
-        free((void*)vertexShaderObj.pShaderBytecode);
-    }
-    if (pixelShaderObj.pShaderBytecode != nullptr) {
-        free((void*)pixelShaderObj.pShaderBytecode);
+        if (s_multiAdapterEnabled)
+        {
+            BeginGpuProfileScope("Band copies");
+            RecordSecondaryAdapterBandCopies();
+            EndGpuProfileScope();
+        }
     }
 
-    return done;
-}
-
-static auto CreateVertexBuffer() -> bool
-{
-    const struct Vertex
+    auto OnFrameEnd(RenderCommandList& commandList) -> void override
     {
-        float position[4];
-        float color[4];
-    } squareVertices[]{
-        // Direct3D是以左手作为前面背面顶点排列的依据
-        {.position { -0.75f, 0.75f, 0.0f, 1.0f }, .color { 0.9f, 0.1f, 0.1f, 1.0f } },     // top left
-        {.position { 0.75f, 0.75f, 0.0f, 1.0f }, .color { 0.9f, 0.9f, 0.1f, 1.0f } },      // top right
-        {.position { -0.75f, -0.75f, 0.0f, 1.0f }, .color { 0.1f, 0.9f, 0.1f, 1.0f } },    // bottom left
-        {.position { 0.75f, -0.75f, 0.0f, 1.0f }, .color { 0.1f, 0.1f, 0.9f, 1.0f } }      // bottom right
-    };
+        (void)commandList;
+        EndGpuProfileScope();
 
-    // Note: using upload heaps to transfer static data like vert buffers is not 
-    // recommended. Every time the GPU needs it, the upload heap will be marshalled 
-    // over. Please read up on Default Heap usage. An upload heap is used here for 
-    // code simplicity and because there are very few verts to actually transfer.
-    const D3D12_HEAP_PROPERTIES vbHeapProperties{
-        .Type = D3D12_HEAP_TYPE_UPLOAD,
-        .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-        .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
-        .CreationNodeMask = 1,
-        .VisibleNodeMask = 1
-    };
-    const D3D12_RESOURCE_DESC vbResourceDesc{
-        .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
-        .Alignment = 0,
-        .Width = sizeof(squareVertices),
-        .Height = 1U,
-        .DepthOrArraySize = 1,
-        .MipLevels = 1,
-        .Format = DXGI_FORMAT_UNKNOWN,
-        .SampleDesc {.Count = 1U, .Quality = 0 },
-        .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
-        .Flags = D3D12_RESOURCE_FLAG_NONE
-    };
+        // The back buffer is complete, and in PRESENT state.
+        if (s_frameReadbackRing != nullptr)
+        {
+            BeginGpuProfileScope("Frame readback");
+            RecordFrameReadbackCopy(s_renderTargets[s_currFrameIndex], D3D12_RESOURCE_STATE_PRESENT);
+            EndGpuProfileScope();
+        }
 
-    HRESULT hRes = s_device->CreateCommittedResource(&vbHeapProperties, D3D12_HEAP_FLAG_NONE, &vbResourceDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&s_vertexBuffer));
-    if (FAILED(hRes))
-    {
-        fprintf(stderr, "CreateCommittedResource for vertex buffer failed: %ld\n", hRes);
-        return false;
+        if (s_gpuProfiler != nullptr) {
+            s_gpuProfiler->EndFrame(s_basicCommandList);
+        }
+
+        if (s_timestampQueryHeap != nullptr)
+        {
+            s_basicCommandList->EndQuery(s_timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 1);
+            s_basicCommandList->ResolveQueryData(s_timestampQueryHeap, D3D12_QUERY_TYPE_TIMESTAMP, 0, 2, s_timestampReadbackBuffer, 0);
+        }
     }
 
-    // Copy the triangle data to the vertex buffer.
-    void* pVertexDataBegin = nullptr;
-    D3D12_RANGE readRange = { 0, 0 };   // We do not intend to read from this resource on the CPU.	
-    hRes = s_vertexBuffer->Map(0, &readRange, &pVertexDataBegin);
-    if (FAILED(hRes))
+private:
+    RenderResourceId m_sceneTarget;
+    UINT m_sceneWidth;
+    UINT m_sceneHeight;
+};
+
+static auto PopulateCommandList() -> bool
+{
+    if (!MakeBasicFrameResident()) return false;
+    if (!AcquireBasicCommandList()) return false;
+    s_basicRenderCommandList->Bind(s_basicCommandListPair->allocator, s_basicCommandList);
+
+    auto const [sceneWidth, sceneHeight] = GetSceneRenderSize();
+    CullBasicSceneObjects();
+    if (!StepCpuParticles())
     {
-        fprintf(stderr, "Map vertex buffer failed: %ld\n", hRes);
+        ReleaseBasicCommandList(0);
         return false;
     }
 
-    memcpy(pVertexDataBegin, squareVertices, sizeof(squareVertices));
-    s_vertexBuffer->Unmap(0, nullptr);
-
-    // Initialize the vertex buffer view.
-    D3D12_VERTEX_BUFFER_VIEW vertexBufferView{
-        .BufferLocation = s_vertexBuffer->GetGPUVirtualAddress(),
-        .SizeInBytes = (uint32_t)sizeof(squareVertices),
-        .StrideInBytes = sizeof(squareVertices[0])
+    // In the multi-adapter mode, the primary adapter only renders its own band.
+
+    // The scene is rendered into the back buffer, or into the scene target in dynamic resolution mode.
+    const BasicFrameDesc frameDesc{
+        .pipelineId = s_basicShaderPermutation,
+        .sceneTarget = s_dynamicResolutionEnabled ? s_sceneRenderTargetId : s_backBufferIds[s_currFrameIndex],
+        .sceneTargetState = s_dynamicResolutionEnabled ? RENDER_RESOURCE_STATE_PIXEL_SHADER_RESOURCE : RENDER_RESOURCE_STATE_PRESENT,
+        .backBuffer = s_backBufferIds[s_currFrameIndex],
+        .viewport {
+            .topLeftX = 0.0f,
+            .topLeftY = 0.0f,
+            .width = float(sceneWidth),
+            .height = float(sceneHeight),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f
+        },
+        .scissorRect {
+            .left = 0,
+            .top = s_multiAdapterEnabled ? int32_t(s_multiAdapterRowBegins[0]) : 0,
+            .right = int32_t(sceneWidth),
+            .bottom = s_multiAdapterEnabled ? int32_t(s_multiAdapterRowBegins[1]) : int32_t(sceneHeight)
+        },
+        .clearScissorRectOnly = s_multiAdapterEnabled,
+        .rotateAngle = s_rotateAngle,
+        .depthTarget = s_depthTargetId,
+        .depthStoreOp = s_occlusionCullingEnabled || s_particleMode != ParticleMode::NONE || s_meshletsEnabled ? RENDER_STORE_OP_PRESERVE : RENDER_STORE_OP_DISCARD,
+        .objects = s_visibleObjects.data(),
+        .objectCount = uint32_t(s_visibleObjects.size()),
+        .drawPackets = s_drawPacketsEnabled ? &s_drawPacketQueue : nullptr,
+        .drawStateFilter = &s_drawStateFilter
     };
 
-    // Record commands to the command list bundle.
-    s_basicCommandBundle->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-    s_basicCommandBundle->IASetVertexBuffers(0, 1, &vertexBufferView);
-    s_basicCommandBundle->DrawInstanced((UINT)std::size(squareVertices), 1, 0, 0);
+    RenderCommandList* bundle = nullptr;
+    RenderCommandList* prepassBundle = nullptr;
+    if (s_drawPacketsEnabled) {
+        BuildBasicDrawPackets(s_drawPacketQueue, GetBasicBundleDesc(), s_visibleObjects.data(), uint32_t(s_visibleObjects.size()), s_depthPrepassEnabled);
+    }
+    else
+    {
+        bundle = GetBasicRenderBundle();
+        prepassBundle = s_depthPrepassEnabled ? GetBasicPrepassBundle() : nullptr;
+    }
 
-    // End of the record
-    hRes = s_basicCommandBundle->Close();
-    if (FAILED(hRes))
+    BasicFramePasses framePasses(frameDesc.sceneTarget, sceneWidth, sceneHeight);
+    const bool bundlesReady = s_drawPacketsEnabled || (bundle != nullptr && (!s_depthPrepassEnabled || prepassBundle != nullptr));
+    if (!bundlesReady || !RecordBasicFrame(GetBasicRenderCommandList(), bundle, prepassBundle, frameDesc, &framePasses))
     {
-        fprintf(stderr, "Close basic command bundle failed: %ld\n", hRes);
+        fprintf(stderr, "Record basic frame failed\n");
+        ReleaseBasicCommandList(0);
         return false;
     }
 
-    // Wait for the command list to execute;
-    // we are reusing the same command list in our main loop but for now,
-    // we just want to wait for setup to complete before continuing.
-    WaitForPreviousFrame();
+    if (++s_rotateAngle >= 360.0f) {
+        s_rotateAngle = 0.0f;
+    }
 
     return true;
 }
 
-static auto PopulateCommandList() -> bool
+static auto Render() -> bool
 {
-    HRESULT hRes = s_commandAllocator->Reset();
-    if (FAILED(hRes))
-    {
-        fprintf(stderr, "Reset command allocator failed: %ld\n", hRes);
-        return false;
-    }
+    LARGE_INTEGER beginTime{ };
+    QueryPerformanceCounter(&beginTime);
 
-    hRes = s_basicCommandList->Reset(s_commandAllocator, s_basicPipelineState);
-    if (FAILED(hRes))
+    // The previous frame has completed here, so it is safe to swap the PSO.
+    if (!ApplyPendingPipelineState()) return false;
+
+    if (s_multiAdapterEnabled)
     {
-        fprintf(stderr, "Reset basic command list failed: %ld\n", hRes);
-        return false;
+        PlanMultiAdapterFrame();
+        if (!SubmitSecondaryAdapterFrames()) return false;
     }
 
-    // Record commands to the command list
-    // Set necessary state.
-    const D3D12_VIEWPORT viewPort{
-        .TopLeftX = 0.0f,
-        .TopLeftY = 0.0f,
-        .Width = FLOAT(WINDOW_WIDTH),
-        .Height = FLOAT(WINDOW_HEIGHT),
-        .MinDepth = 0.0f,
-        .MaxDepth = 3.0f
-    };
-    s_basicCommandList->RSSetViewports(1, &viewPort);
-
-    const D3D12_RECT scissorRect{
-        .left = 0,
-        .top = 0,
-        .right = WINDOW_WIDTH,
-        .bottom = WINDOW_HEIGHT
-    };
-    s_basicCommandList->RSSetScissorRects(1, &scissorRect);
-
-    // Indicate that the back buffer will be used as a render target.
-    const D3D12_RESOURCE_BARRIER renderBarrier = {
-        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
-        .Transition {
-            .pResource = s_renderTargets[s_currFrameIndex],
-            .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-            .StateBefore = D3D12_RESOURCE_STATE_PRESENT,
-            .StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET
-        }
-    };
-    s_basicCommandList->ResourceBarrier(1, &renderBarrier);
-
-    D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = s_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-    rtvHandle.ptr += size_t(s_currFrameIndex * s_rtvDescriptorSize);
-    s_basicCommandList->OMSetRenderTargets(1, &rtvHandle, FALSE, nullptr);
+    LARGE_INTEGER recordBeginTime{ };
+    QueryPerformanceCounter(&recordBeginTime);
 
-    const float clearColor[] = { 0.5f, 0.6f, 0.5f, 1.0f };
-    s_basicCommandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
+    if (!PopulateCommandList()) return false;
 
-    // This can also be set into a command bundle.
-    // Set it to this command list for update per frame
-    s_basicCommandList->SetGraphicsRootSignature(s_rootSignature);
+    LARGE_INTEGER recordEndTime{ };
+    QueryPerformanceCounter(&recordEndTime);
+    s_renderStatsRecordTime += double(recordEndTime.QuadPart - recordBeginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart);
 
-    const union { float f; UINT i; } rotAngleConstant{ .f = s_rotateAngle };
-    s_basicCommandList->SetGraphicsRoot32BitConstant(0, rotAngleConstant.i, 0);
+    // Execute the command list, present the frame and wait for it to complete.
+    // While capturing, the frame is recorded through the capture wrapper, but the wrapped command list is submitted.
+    if (!SubmitBasicFrame(*s_renderCommandQueue, *s_basicRenderCommandList, *s_renderFence, ++s_fenceValue)) return false;
+    ReleaseBasicCommandList(s_fenceValue);
+    s_commandListPool.EndFrame(s_fence->GetCompletedValue());
+    DrainDeferredReleases();
 
-    // Execute the bundle to the command list
-    s_basicCommandList->ExecuteBundle(s_basicCommandBundle);
+    s_currFrameIndex = s_swapChain->GetCurrentBackBufferIndex();
 
-    if (++s_rotateAngle >= 360.0f) {
-        s_rotateAngle = 0.0f;
+    ++s_frameCount;
+    if (s_renderStatsEnabled && s_frameCount % RENDER_STATS_REPORT_INTERVAL == 0) {
+        ReportRenderStats(RENDER_STATS_REPORT_INTERVAL);
+    }
+    UpdateDynamicResolution();
+    UpdateMultiAdapterLoadBalance();
+    UpdateHiZPyramid();
+    UpdateTextureStreaming();
+
+    // Before the GPU profile report, which resets the summary the overdraw is computed from
+    if ((s_depthPrepassEnabled || s_occlusionCullingEnabled) && s_frameCount % DEPTH_STATS_REPORT_INTERVAL == 0) {
+        ReportDepthStats(DEPTH_STATS_REPORT_INTERVAL);
+    }
+    if (s_particleMode != ParticleMode::NONE && s_frameCount % PARTICLE_STATS_REPORT_INTERVAL == 0) {
+        ReportParticleStats();
+    }
+    if (s_meshletsEnabled && s_frameCount % MESHLET_STATS_REPORT_INTERVAL == 0) {
+        ReportMeshletStats();
+    }
+    if (s_textureStreamingEnabled && s_frameCount % TEXTURE_STREAMING_REPORT_INTERVAL == 0) {
+        ReportTextureStreamingStats();
+    }
+    if (s_frameReadbackRing != nullptr && s_frameCount <= FRAME_CAPTURE_MAX_FRAME_COUNT && s_frameCount % FRAME_CAPTURE_REPORT_INTERVAL == 0) {
+        ReportFrameCaptureStats();
     }
 
-    // Indicate that the back buffer will now be used to present.
-    const D3D12_RESOURCE_BARRIER presentBarrier{
-        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
-        .Transition {
-            .pResource = s_renderTargets[s_currFrameIndex],
-            .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-            .StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET,
-            .StateAfter = D3D12_RESOURCE_STATE_PRESENT
+    // Only the frames the GPU has completed are read back, so this never waits.
+    if (s_gpuProfiler != nullptr)
+    {
+        s_gpuProfiler->Collect(s_fence->GetCompletedValue());
+        if (s_frameCount % GPU_PROFILER_REPORT_INTERVAL == 0) {
+            ReportGpuProfile();
         }
-    };
-    s_basicCommandList->ResourceBarrier(1, &presentBarrier);
+    }
 
-    // End of the record
-    hRes = s_basicCommandList->Close();
-    if (FAILED(hRes))
+    if (s_commandCaptureActive && s_commandCaptureWriter.GetFrameCount() >= COMMAND_CAPTURE_FRAME_COUNT)
     {
-        fprintf(stderr, "Close basic command list failed: %ld\n", hRes);
-        return false;
+        s_commandCaptureActive = false;
+        SaveCommandCapture();
     }
 
+    LARGE_INTEGER endTime{ };
+    QueryPerformanceCounter(&endTime);
+
+    // Exponential moving average of the frame time, used to measure the impact of shader hot-reload
+    const double frameTime = double(endTime.QuadPart - beginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart);
+    s_averageFrameTime = s_averageFrameTime == 0.0 ? frameTime : s_averageFrameTime * 0.95 + frameTime * 0.05;
+
     return true;
 }
 
-static auto Render() -> bool
+static auto DestroyAllAssets() -> void
 {
-    if (!PopulateCommandList()) return false;
-
-    // Execute the command list.
-    ID3D12CommandList* const ppCommandLists[] = { (ID3D12CommandList*)s_basicCommandList };
-    s_commandQueue->ExecuteCommandLists((UINT)std::size(ppCommandLists), ppCommandLists);
+    StopShaderWatcher();
+    StopResidencyThread();
+    ReleaseFrameReadbackResources();
 
-    // Present the frame.
-    HRESULT hRes = s_swapChain->Present(1, 0);
-    if (FAILED(hRes))
+    // Keep the frames captured so far if the program quits before the capture completes.
+    if (s_commandCaptureActive && s_commandCaptureWriter.GetFrameCount() > 0)
     {
-        fprintf(stderr, "Present failed: %ld\n", hRes);
-        return false;
+        s_commandCaptureActive = false;
+        SaveCommandCapture();
     }
 
-    if (!WaitForPreviousFrame()) return false;
+    ReleaseRenderBackend();
 
-    return true;
-}
-
-static auto DestroyAllAssets() -> void
-{
     if (s_hFenceEvent != nullptr)
     {
         CloseHandle(s_hFenceEvent);
@@ -964,21 +8817,62 @@ static auto DestroyAllAssets() -> void
         s_vertexBuffer->Release();
         s_vertexBuffer = nullptr;
     }
-    if (s_basicCommandBundle != nullptr)
+    ReleaseSecondaryAdapters();
+    ReleaseComputePrimitivePipelines();
+    ReleaseMipGenerationPipeline();
+    if (s_hDxcModule != nullptr)
     {
-        s_basicCommandBundle->Release();
-        s_basicCommandBundle = nullptr;
+        s_dxcCreateInstance = nullptr;
+        FreeLibrary(s_hDxcModule);
+        s_hDxcModule = nullptr;
     }
-    if (s_basicCommandList != nullptr)
+    ReleaseGpuProfiler();
+    ReleaseHiZOcclusionResources();
+    ReleaseParticleResources();
+    ReleaseMeshletResources();
+    ReleaseTextureStreamingResources();
+    // After the upload worker, which waits on the reactor. All the submitted frames have been waited for at this point.
+    ReleaseFenceReactor();
+    if (s_timestampReadbackBuffer != nullptr)
     {
-        s_basicCommandList->Release();
-        s_basicCommandList = nullptr;
+        s_timestampReadbackBuffer->Release();
+        s_timestampReadbackBuffer = nullptr;
     }
-    if (s_basicPipelineState != nullptr)
+    if (s_timestampQueryHeap != nullptr)
     {
-        s_basicPipelineState->Release();
-        s_basicPipelineState = nullptr;
+        s_timestampQueryHeap->Release();
+        s_timestampQueryHeap = nullptr;
     }
+    if (s_upscalePipelineState != nullptr)
+    {
+        s_upscalePipelineState->Release();
+        s_upscalePipelineState = nullptr;
+    }
+    if (s_upscaleRootSignature != nullptr)
+    {
+        s_upscaleRootSignature->Release();
+        s_upscaleRootSignature = nullptr;
+    }
+    if (s_srvDescriptorHeap != nullptr)
+    {
+        s_srvDescriptorHeap->Release();
+        s_srvDescriptorHeap = nullptr;
+    }
+    if (s_sceneRenderTarget != nullptr)
+    {
+        s_sceneRenderTarget->Release();
+        s_sceneRenderTarget = nullptr;
+    }
+    if (s_basicCommandBundle != nullptr)
+    {
+        s_basicCommandBundle->Release();
+        s_basicCommandBundle = nullptr;
+    }
+    ReleaseBasicCommandList(0);
+    s_commandListPool.Clear();
+    ReleaseBasicPipelineStateSet(s_basicPipelineStateSet);
+    ReleaseBasicShaderLibrary();
+    s_basicPipelineState = nullptr;
     if (s_rootSignature != nullptr)
     {
         s_rootSignature->Release();
@@ -1012,16 +8906,16 @@ static auto DestroyAllAssets() -> void
         s_commandBundleAllocator->Release();
         s_commandBundleAllocator = nullptr;
     }
-    if (s_commandAllocator != nullptr)
-    {
-        s_commandAllocator->Release();
-        s_commandAllocator = nullptr;
-    }
     if (s_device != nullptr)
     {
         s_device->Release();
         s_device = nullptr;
     }
+    if (s_adapter != nullptr)
+    {
+        s_adapter->Release();
+        s_adapter = nullptr;
+    }
     if (s_factory != nullptr)
     {
         s_factory->Release();
@@ -1088,8 +8982,15 @@ static auto CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         case VK_RIGHT:
             break;
         case VK_SPACE:
+        {
+            // Toggle the grayscale permutation. It will be applied at the next frame boundary.
+            const uint32_t permutationKey = s_basicShaderPermutation ^ BASIC_SHADER_FEATURE_GRAYSCALE;
+            if (IsShaderPermutationInUse(permutationKey)) {
+                s_requestedShaderPermutation = permutationKey;
+            }
             break;
         }
+        }
         return 0;
 
     default:
@@ -1154,9 +9055,257 @@ static HWND CreateAndInitializeWindow(HINSTANCE hInstance, LPCSTR appName, int w
     return hWnd;
 }
 
+// The startup steps and their dependencies. `wndHandle` is set by the window task.
+static auto BuildStartupTaskGraph(StartupTaskGraph& graph, HINSTANCE wndInstance, HWND& wndHandle) -> void
+{
+    // The adapter is chosen on the console while the window is created and the shaders are loaded.
+    const StartupTaskId deviceTask = graph.AddTask("CreateD3D12Device", CreateD3D12Device);
+    // A window belongs to the thread that creates it, which also runs the message loop.
+    const StartupTaskId windowTask = graph.AddTask("CreateWindow", [wndInstance, &wndHandle] {
+        wndHandle = CreateAndInitializeWindow(wndInstance, s_appName, WINDOW_WIDTH, WINDOW_HEIGHT);
+        return wndHandle != NULL;
+    }, { }, StartupTaskAffinity::MAIN_THREAD);
+
+    // Each stage permutation in use is compiled by its own task if the shader archive is not available.
+    const StartupTaskId shaderArchiveTask = graph.AddTask("LoadBasicShaderArchive", LoadBasicShaderArchive);
+    StartupTaskId shaderTasks[size_t(ShaderStage::COUNT)][BASIC_SHADER_PERMUTATION_KEY_COUNT];
+    for (auto& stageTasks : shaderTasks)
+    {
+        for (auto& shaderTask : stageTasks) {
+            shaderTask = STARTUP_INVALID_TASK;
+        }
+    }
+    for (auto const permutationKey : BASIC_SHADER_PERMUTATIONS_IN_USE)
+    {
+        for (size_t stage = 0; stage < size_t(ShaderStage::COUNT); ++stage)
+        {
+            const uint32_t stageKey = GetShaderStageKey(ShaderStage(stage), permutationKey);
+            StartupTaskId& shaderTask = shaderTasks[stage][stageKey];
+            if (shaderTask == STARTUP_INVALID_TASK)
+            {
+                shaderTask = graph.AddTask("CompileBasicShaderPermutation",
+                    [stage, stageKey] { return CompileBasicShaderLibraryPermutation(ShaderStage(stage), stageKey); }, { shaderArchiveTask });
+            }
+        }
+    }
+
+    const StartupTaskId commandQueueTask = graph.AddTask("CreateCommandQueue", CreateCommandQueue, { deviceTask });
+    // Creating the swap chain may send messages to the window, which are only processed by the window thread.
+    const StartupTaskId swapChainTask = graph.AddTask("CreateSwapChain", [&wndHandle] { return CreateSwapChain(wndHandle); },
+        { commandQueueTask, windowTask }, StartupTaskAffinity::MAIN_THREAD);
+    const StartupTaskId renderTargetViewTask = graph.AddTask("CreateRenderTargetViews", CreateRenderTargetViews, { swapChainTask });
+    const StartupTaskId rootSignatureTask = graph.AddTask("CreateRootSignature", CreateRootSignature, { deviceTask });
+    const StartupTaskId fenceTask = graph.AddTask("CreateFenceAndEvent", CreateFenceAndEvent, { deviceTask });
+
+    // The bundle of the basic PSO also needs the bundle allocator created with the command queue.
+    std::vector<StartupTaskId> pipelineStateTasks{ commandQueueTask };
+    for (auto const permutationKey : BASIC_SHADER_PERMUTATIONS_IN_USE)
+    {
+        pipelineStateTasks.push_back(graph.AddTask("CreateBasicPipelineStatePermutation",
+            [permutationKey] { return CreateBasicPipelineStatePermutation(permutationKey); },
+            { rootSignatureTask, shaderTasks[size_t(ShaderStage::VERTEX)][GetShaderStageKey(ShaderStage::VERTEX, permutationKey)],
+            shaderTasks[size_t(ShaderStage::PIXEL)][GetShaderStageKey(ShaderStage::PIXEL, permutationKey)] }));
+    }
+    const StartupTaskId pipelineStateTask = graph.AddTask("CreateBasicPipelineStateObject", CreateBasicPipelineStateObject, pipelineStateTasks);
+
+    // These share the render device and the immediate command list, so they run one after another.
+    const StartupTaskId renderBackendTask = graph.AddTask("CreateRenderBackend", CreateRenderBackend, { pipelineStateTask, renderTargetViewTask, fenceTask });
+    const StartupTaskId vertexBufferTask = graph.AddTask("CreateVertexBuffer", CreateVertexBuffer, { renderBackendTask });
+    const StartupTaskId dynamicResolutionTask = graph.AddTask("CreateDynamicResolutionResources", CreateDynamicResolutionResources, { vertexBufferTask });
+    const StartupTaskId multiAdapterTask = graph.AddTask("CreateMultiAdapterResources", CreateMultiAdapterResources, { dynamicResolutionTask });
+    // These upload their buffers with the immediate command list as the tasks above.
+    const StartupTaskId particleTask = graph.AddTask("CreateParticleResources", CreateParticleResources, { multiAdapterTask });
+    graph.AddTask("CreateMeshletResources", CreateMeshletResources, { particleTask });
+    const StartupTaskId textureStreamingTask = graph.AddTask("CreateTextureStreamingResources", CreateTextureStreamingResources, { commandQueueTask });
+    graph.AddTask("CreateHiZOcclusionResources", CreateHiZOcclusionResources, { renderBackendTask });
+    graph.AddTask("CreateFrameReadbackResources", CreateFrameReadbackResources, { renderTargetViewTask });
+
+    graph.AddTask("StartShaderWatcher", StartShaderWatcher, { pipelineStateTask });
+    graph.AddTask("StartResidencyThread", StartResidencyThread, { fenceTask });
+    // Waits on the texture copy fence too, if texture streaming created one
+    graph.AddTask("StartFenceReactor", StartFenceReactor, { fenceTask, textureStreamingTask });
+    graph.AddTask("CreateGpuProfiler", CreateGpuProfiler, { commandQueueTask });
+}
+
+static auto ReportStartupTimes(const StartupTaskGraph& graph) -> void
+{
+    static constexpr const char* stateNames[] = { "pending", "done", "failed", "skipped" };
+
+    puts("Startup tasks (in milliseconds since the start of the task graph):");
+    for (StartupTaskId taskId = 0; taskId < StartupTaskId(graph.GetTaskCount()); ++taskId)
+    {
+        const StartupTaskTiming& timing = graph.GetTaskTiming(taskId);
+        printf("  %-36s %9.2f - %9.2f on thread %u, %s\n", graph.GetTaskName(taskId), timing.beginTime, timing.endTime, timing.threadIndex,
+            stateNames[size_t(graph.GetTaskState(taskId))]);
+    }
+    printf("Startup tasks took %.2f ms on %u threads, %.2f ms one after another, and %.2f ms on the critical path\n", graph.GetTotalTime(),
+        graph.GetWorkerCount() + 1, graph.GetSerialTime(), graph.GetCriticalPathTime());
+}
+
 auto main(int argc, const char* argv[]) -> int
 {
-    if (!CreateD3D12Device()) return 1;
+    QueryPerformanceFrequency(&s_performanceFrequency);
+
+    LARGE_INTEGER startupBeginTime{ };
+    QueryPerformanceCounter(&startupBeginTime);
+
+    if (argc > 1 && strcmp(argv[1], "--build-shader-archive") == 0) {
+        return BuildBasicShaderArchive() ? 0 : 1;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        // --dynamic-resolution[=<GPU frame budget in milliseconds>]
+        constexpr char dynamicResolutionOption[] = "--dynamic-resolution";
+        if (strncmp(argv[i], dynamicResolutionOption, std::size(dynamicResolutionOption) - 1) == 0)
+        {
+            double budget = DEFAULT_GPU_FRAME_BUDGET;
+            const char* valueStr = argv[i] + std::size(dynamicResolutionOption) - 1;
+            if (*valueStr == '=')
+            {
+                budget = std::strtod(valueStr + 1, nullptr);
+                if (budget <= 0.0) {
+                    budget = DEFAULT_GPU_FRAME_BUDGET;
+                }
+            }
+
+            s_dynamicResolutionEnabled = true;
+            s_dynamicResolutionController = DynamicResolutionController(GetDefaultDynamicResolutionSettings(budget));
+        }
+        else if (strcmp(argv[i], "--benchmark-upload") == 0) {
+            s_uploadBenchmarkEnabled = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-compute") == 0) {
+            s_computeBenchmarkEnabled = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-mips") == 0) {
+            s_mipBenchmarkEnabled = true;
+        }
+        else if (strcmp(argv[i], "--multi-adapter") == 0) {
+            s_multiAdapterEnabled = true;
+        }
+        // --capture=<capture file>
+        else if (strncmp(argv[i], "--capture=", std::size("--capture=") - 1) == 0) {
+            s_commandCapturePath = argv[i] + std::size("--capture=") - 1;
+        }
+        // --replay-capture=<capture file>
+        else if (strncmp(argv[i], "--replay-capture=", std::size("--replay-capture=") - 1) == 0) {
+            s_commandReplayPath = argv[i] + std::size("--replay-capture=") - 1;
+        }
+        else if (strcmp(argv[i], "--backend-stats") == 0) {
+            s_renderStatsEnabled = true;
+        }
+        else if (strcmp(argv[i], "--gpu-profile") == 0) {
+            s_gpuProfilerEnabled = true;
+        }
+        else if (strcmp(argv[i], "--depth-prepass") == 0) {
+            s_depthPrepassEnabled = true;
+        }
+        else if (strcmp(argv[i], "--draw-packets") == 0) {
+            s_drawPacketsEnabled = true;
+        }
+        else if (strcmp(argv[i], "--occlusion-culling") == 0) {
+            s_occlusionCullingEnabled = true;
+        }
+        // --particles[=gpu|cpu]
+        else if (strcmp(argv[i], "--particles") == 0 || strcmp(argv[i], "--particles=gpu") == 0) {
+            s_particleMode = ParticleMode::GPU;
+        }
+        else if (strcmp(argv[i], "--particles=cpu") == 0) {
+            s_particleMode = ParticleMode::CPU;
+        }
+        else if (strcmp(argv[i], "--benchmark-particles") == 0) {
+            s_particleBenchmarkEnabled = true;
+        }
+        else if (strcmp(argv[i], "--meshlets") == 0) {
+            s_meshletsEnabled = true;
+        }
+        // --capture-frames=<directory>
+        else if (strncmp(argv[i], "--capture-frames=", std::size("--capture-frames=") - 1) == 0) {
+            s_frameCaptureDirectory = argv[i] + std::size("--capture-frames=") - 1;
+        }
+        // --compare-frames=<directory of raw reference frames>
+        else if (strncmp(argv[i], "--compare-frames=", std::size("--compare-frames=") - 1) == 0) {
+            s_frameCompareDirectory = argv[i] + std::size("--compare-frames=") - 1;
+        }
+        // --capture-format=png|raw
+        else if (strcmp(argv[i], "--capture-format=png") == 0) {
+            s_frameCaptureFormat = FrameImageFormat::PNG;
+        }
+        else if (strcmp(argv[i], "--capture-format=raw") == 0) {
+            s_frameCaptureFormat = FrameImageFormat::RAW;
+        }
+        // --textures[=<directory of DDS files>]
+        else if (strcmp(argv[i], "--textures") == 0) {
+            s_textureStreamingEnabled = true;
+        }
+        else if (strncmp(argv[i], "--textures=", std::size("--textures=") - 1) == 0) {
+            s_textureStreamingEnabled = true;
+            s_textureDirectory = argv[i] + std::size("--textures=") - 1;
+        }
+        // --texture-budget=<texture memory budget in megabytes>
+        else if (strncmp(argv[i], "--texture-budget=", std::size("--texture-budget=") - 1) == 0) {
+            s_textureStreamingBudget = uint64_t(std::strtoull(argv[i] + std::size("--texture-budget=") - 1, nullptr, 10)) * 1024 * 1024;
+        }
+        // --residency-budget=<video memory budget in megabytes>
+        else if (strncmp(argv[i], "--residency-budget=", std::size("--residency-budget=") - 1) == 0) {
+            s_residencyBudgetLimit = UINT64(std::strtoull(argv[i] + std::size("--residency-budget=") - 1, nullptr, 10)) * 1024 * 1024;
+        }
+    }
+
+    s_frameCaptureEnabled = s_frameCaptureDirectory != nullptr || s_frameCompareDirectory != nullptr;
+
+    // The benchmark compares the GPU particles with the CPU simulation.
+    if (s_particleBenchmarkEnabled) {
+        s_particleMode = ParticleMode::GPU;
+    }
+
+    // The secondary adapters render their bands without the particles.
+    if (s_multiAdapterEnabled && s_particleMode != ParticleMode::NONE)
+    {
+        puts("WARNING: Particles are not supported in the multi-adapter mode. They will be disabled!");
+        s_particleMode = ParticleMode::NONE;
+        s_particleBenchmarkEnabled = false;
+    }
+
+    // The secondary adapters render their bands without the meshlets either.
+    if (s_multiAdapterEnabled && s_meshletsEnabled)
+    {
+        puts("WARNING: Meshlets are not supported in the multi-adapter mode. They will be disabled!");
+        s_meshletsEnabled = false;
+    }
+
+    // Nor the streamed textures.
+    if (s_multiAdapterEnabled && s_textureStreamingEnabled)
+    {
+        puts("WARNING: Texture streaming is not supported in the multi-adapter mode. It will be disabled!");
+        s_textureStreamingEnabled = false;
+    }
+
+    // The secondary adapters render at the full resolution.
+    if (s_multiAdapterEnabled && s_dynamicResolutionEnabled)
+    {
+        puts("WARNING: Dynamic resolution is not supported in the multi-adapter mode. It will be disabled!");
+        s_dynamicResolutionEnabled = false;
+    }
+
+    // Only the commands of the basic pass are captured.
+    if (s_commandCapturePath != nullptr && s_commandReplayPath == nullptr)
+    {
+        if (s_dynamicResolutionEnabled || s_multiAdapterEnabled) {
+            puts("WARNING: Command capture is not supported in the dynamic resolution or multi-adapter mode. It will be disabled!");
+        }
+        else {
+            s_commandCaptureActive = true;
+        }
+    }
+
+    // The depth-only bundle is recorded through the bundle cache, which is not captured. Draw packets are captured as any direct draw.
+    if (s_commandCaptureActive && s_depthPrepassEnabled && !s_drawPacketsEnabled)
+    {
+        puts("WARNING: Depth prepass is not supported while capturing commands. It will be disabled!");
+        s_depthPrepassEnabled = false;
+    }
 
     bool done = false;
 
@@ -1164,28 +9313,60 @@ auto main(int argc, const char* argv[]) -> int
     HINSTANCE wndInstance = GetModuleHandleA(NULL);
 
     // window handle
-    HWND wndHandle = CreateAndInitializeWindow(wndInstance, s_appName, WINDOW_WIDTH, WINDOW_HEIGHT);
+    HWND wndHandle = NULL;
 
     do
     {
-        if (!CreateCommandQueue()) break;
-        if (!CreateSwapChain(wndHandle)) break;
-        if (!CreateRenderTargetViews()) break;
-        if (!CreateRootSignature()) break;
-        if (!CreateFenceAndEvent()) break;
-        if (!CreateBasicPipelineStateObject()) break;
-        if (!CreateVertexBuffer()) break;
+        StartupTaskGraph startupTasks;
+        BuildStartupTaskGraph(startupTasks, wndInstance, wndHandle);
+
+        const uint32_t hardwareThreadCount = std::thread::hardware_concurrency();
+        const uint32_t workerCount = hardwareThreadCount > STARTUP_MAX_WORKER_COUNT ? STARTUP_MAX_WORKER_COUNT : hardwareThreadCount > 1 ? hardwareThreadCount - 1 : 1;
+        const bool started = startupTasks.Run(workerCount);
+        ReportStartupTimes(startupTasks);
+        if (!started) break;
+
         if (!Render()) break;
 
+        LARGE_INTEGER firstFrameTime{ };
+        QueryPerformanceCounter(&firstFrameTime);
+        printf("First frame is ready %.2f ms after the start\n", double(firstFrameTime.QuadPart - startupBeginTime.QuadPart) * 1000.0 / double(s_performanceFrequency.QuadPart));
+
         done = true;
     } while (false);
 
     if (!done)
     {
+        if (wndHandle != NULL) {
+            DestroyWindow(wndHandle);
+        }
         DestroyAllAssets();
         return 1;
     }
 
+    if (s_uploadBenchmarkEnabled || s_computeBenchmarkEnabled || s_mipBenchmarkEnabled || s_particleBenchmarkEnabled || s_commandReplayPath != nullptr)
+    {
+        done = true;
+        if (s_uploadBenchmarkEnabled) {
+            done = RunUploadBandwidthBenchmark() && done;
+        }
+        if (s_computeBenchmarkEnabled) {
+            done = RunComputePrimitiveBenchmark() && done;
+        }
+        if (s_mipBenchmarkEnabled) {
+            done = RunMipGenerationBenchmark() && done;
+        }
+        if (s_particleBenchmarkEnabled) {
+            done = RunParticleBenchmark() && done;
+        }
+        if (s_commandReplayPath != nullptr) {
+            done = RunCommandReplay() && done;
+        }
+        DestroyWindow(wndHandle);
+        DestroyAllAssets();
+        return done ? 0 : 1;
+    }
+
     // main message loop
     MSG msg{ };
     done = false;
@@ -0,0 +1,306 @@
+// DrawPacketQueue.h : Draw packets sorted by 64-bit keys, and their submission without the redundant state calls.
+//
+// A key packs, from the most significant bits, the pass, pipeline, material and depth bucket of its packet.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+#include "ComputePrimitives.h"
+#include "RenderBackend.h"
+#include "BundleCache.h"
+
+static constexpr uint32_t DRAW_SORT_KEY_DEPTH_BITS = 24;
+static constexpr uint32_t DRAW_SORT_KEY_MATERIAL_BITS = 16;
+static constexpr uint32_t DRAW_SORT_KEY_PIPELINE_BITS = 20;
+static constexpr uint32_t DRAW_SORT_KEY_PASS_BITS = 4;
+
+static constexpr uint32_t DRAW_SORT_KEY_DEPTH_SHIFT = 0;
+static constexpr uint32_t DRAW_SORT_KEY_MATERIAL_SHIFT = DRAW_SORT_KEY_DEPTH_SHIFT + DRAW_SORT_KEY_DEPTH_BITS;
+static constexpr uint32_t DRAW_SORT_KEY_PIPELINE_SHIFT = DRAW_SORT_KEY_MATERIAL_SHIFT + DRAW_SORT_KEY_MATERIAL_BITS;
+static constexpr uint32_t DRAW_SORT_KEY_PASS_SHIFT = DRAW_SORT_KEY_PIPELINE_SHIFT + DRAW_SORT_KEY_PIPELINE_BITS;
+
+static_assert(DRAW_SORT_KEY_PASS_SHIFT + DRAW_SORT_KEY_PASS_BITS == 64, "The sort key fields must fill 64 bits");
+
+static constexpr uint32_t DRAW_SORT_BITS_PER_PASS = 8;
+static constexpr uint32_t DRAW_SORT_DIGIT_COUNT = 1U << DRAW_SORT_BITS_PER_PASS;
+static constexpr uint32_t DRAW_SORT_PASS_COUNT = 64 / DRAW_SORT_BITS_PER_PASS;
+
+// Below this count, a sort runs on the calling thread only, since starting the threads would cost more than the sort.
+static constexpr size_t DRAW_SORT_MIN_PARALLEL_COUNT = 64 * 1024;
+
+// Each field is truncated to its bit count.
+static constexpr auto MakeDrawSortKey(uint32_t pass, uint32_t pipelineId, uint32_t material, uint32_t depthBucket) -> uint64_t
+{
+    return (uint64_t(pass & ((1U << DRAW_SORT_KEY_PASS_BITS) - 1)) << DRAW_SORT_KEY_PASS_SHIFT) |
+        (uint64_t(pipelineId & ((1U << DRAW_SORT_KEY_PIPELINE_BITS) - 1)) << DRAW_SORT_KEY_PIPELINE_SHIFT) |
+        (uint64_t(material & ((1U << DRAW_SORT_KEY_MATERIAL_BITS) - 1)) << DRAW_SORT_KEY_MATERIAL_SHIFT) |
+        (uint64_t(depthBucket & ((1U << DRAW_SORT_KEY_DEPTH_BITS) - 1)) << DRAW_SORT_KEY_DEPTH_SHIFT);
+}
+
+// Quantize a depth in [0, 1]. Opaque draws go front to back, so that the early depth test rejects the hidden fragments,
+// and blended draws back to front.
+static inline auto GetDrawDepthBucket(float depth, bool backToFront) -> uint32_t
+{
+    constexpr uint32_t maxBucket = (1U << DRAW_SORT_KEY_DEPTH_BITS) - 1;
+    const auto bucket = uint32_t(std::clamp(depth, 0.0f, 1.0f) * float(maxBucket));
+    return backToFront ? maxBucket - bucket : bucket;
+}
+
+struct DrawPacket
+{
+    uint64_t sortKey;
+    BundleDrawKey draw;
+    uint32_t userData;      // e.g. the index of the object whose constants are set before the draw
+};
+
+struct DrawSortEntry
+{
+    uint64_t key;
+    uint32_t index;
+};
+
+// Stable LSD radix sort of `entries` by key, using `temp` of the same count. Returns the array holding the result,
+// which is either of them.
+static inline auto RadixSortDrawKeys(DrawSortEntry entries[], DrawSortEntry temp[], size_t count, uint32_t threadCount) -> DrawSortEntry*
+{
+    if (count < DRAW_SORT_MIN_PARALLEL_COUNT) {
+        threadCount = 1;
+    }
+
+    // The total count of each digit does not depend on the order, so one read finds the passes to skip.
+    std::vector<size_t> digitTotals(size_t(threadCount) * DRAW_SORT_PASS_COUNT * DRAW_SORT_DIGIT_COUNT, 0);
+    ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+        size_t* totals = &digitTotals[size_t(chunk) * DRAW_SORT_PASS_COUNT * DRAW_SORT_DIGIT_COUNT];
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint64_t key = entries[i].key;
+            for (uint32_t pass = 0; pass < DRAW_SORT_PASS_COUNT; ++pass) {
+                ++totals[pass * DRAW_SORT_DIGIT_COUNT + uint32_t((key >> (pass * DRAW_SORT_BITS_PER_PASS)) & (DRAW_SORT_DIGIT_COUNT - 1))];
+            }
+        }
+    });
+
+    std::vector<size_t> histograms(size_t(threadCount) * DRAW_SORT_DIGIT_COUNT);
+    DrawSortEntry* src = entries;
+    DrawSortEntry* dst = temp;
+    for (uint32_t pass = 0; pass < DRAW_SORT_PASS_COUNT; ++pass)
+    {
+        bool sharedDigit = false;
+        for (uint32_t digit = 0; digit < DRAW_SORT_DIGIT_COUNT && !sharedDigit; ++digit)
+        {
+            size_t total = 0;
+            for (uint32_t chunk = 0; chunk < threadCount; ++chunk) {
+                total += digitTotals[(size_t(chunk) * DRAW_SORT_PASS_COUNT + pass) * DRAW_SORT_DIGIT_COUNT + digit];
+            }
+            sharedDigit = total == count;
+        }
+        if (sharedDigit) continue;
+
+        const uint32_t shift = pass * DRAW_SORT_BITS_PER_PASS;
+        std::fill(histograms.begin(), histograms.end(), size_t(0));
+        ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+            size_t* histogram = &histograms[size_t(chunk) * DRAW_SORT_DIGIT_COUNT];
+            for (size_t i = begin; i < end; ++i) {
+                ++histogram[uint32_t((src[i].key >> shift) & (DRAW_SORT_DIGIT_COUNT - 1))];
+            }
+        });
+
+        // Digit-major exclusive scan, so that each chunk scatters after the same digits of the chunks before it.
+        size_t offset = 0;
+        for (uint32_t digit = 0; digit < DRAW_SORT_DIGIT_COUNT; ++digit)
+        {
+            for (uint32_t chunk = 0; chunk < threadCount; ++chunk)
+            {
+                size_t& entry = histograms[size_t(chunk) * DRAW_SORT_DIGIT_COUNT + digit];
+                const size_t digitCount = entry;
+                entry = offset;
+                offset += digitCount;
+            }
+        }
+
+        ParallelForChunks(count, threadCount, [&](uint32_t chunk, size_t begin, size_t end) {
+            size_t* offsets = &histograms[size_t(chunk) * DRAW_SORT_DIGIT_COUNT];
+            for (size_t i = begin; i < end; ++i) {
+                dst[offsets[uint32_t((src[i].key >> shift) & (DRAW_SORT_DIGIT_COUNT - 1))]++] = src[i];
+            }
+        });
+
+        DrawSortEntry* const swapped = src;
+        src = dst;
+        dst = swapped;
+    }
+
+    return src;
+}
+
+// The packets of a frame. They are pushed in any order, then sorted once before the submission.
+class DrawPacketQueue
+{
+public:
+    auto Clear() -> void
+    {
+        m_packets.clear();
+        m_sorted = nullptr;
+    }
+
+    auto Push(const DrawPacket& packet) -> void
+    {
+        m_packets.push_back(packet);
+        m_sorted = nullptr;
+    }
+
+    auto Sort(uint32_t threadCount) -> void
+    {
+        const size_t count = m_packets.size();
+        m_entries.resize(count);
+        m_temp.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            m_entries[i] = DrawSortEntry{ .key = m_packets[i].sortKey, .index = uint32_t(i) };
+        }
+        m_sorted = RadixSortDrawKeys(m_entries.data(), m_temp.data(), count, threadCount);
+    }
+
+    auto GetCount() const -> size_t { return m_packets.size(); }
+
+    // In push order
+    auto GetPacket(size_t index) const -> const DrawPacket& { return m_packets[index]; }
+
+    // Only valid after `Sort`
+    auto GetSorted(size_t index) const -> const DrawPacket& { return m_packets[m_sorted[index].index]; }
+
+private:
+    std::vector<DrawPacket> m_packets;          // in push order
+    std::vector<DrawSortEntry> m_entries;
+    std::vector<DrawSortEntry> m_temp;
+    const DrawSortEntry* m_sorted = nullptr;    // into `m_entries` or `m_temp`
+};
+
+struct DrawStateStats
+{
+    uint64_t drawCount;
+    uint64_t stateCallCount;        // pipeline, topology, vertex and index buffer calls made
+    uint64_t pipelineSkipCount;
+    uint64_t topologySkipCount;
+    uint64_t vertexBufferSkipCount;
+    uint64_t indexBufferSkipCount;
+
+    auto GetSkipCount() const -> uint64_t { return pipelineSkipCount + topologySkipCount + vertexBufferSkipCount + indexBufferSkipCount; }
+};
+
+// Tracks the state the draws of a command list set, and only makes the calls that change it. Anything else that changes
+// that state, such as a bundle, must be followed by `Invalidate`.
+class DrawStateFilter
+{
+public:
+    // After the command list is reset with `pipelineId`
+    auto Reset(uint32_t pipelineId) -> void
+    {
+        Invalidate();
+        m_pipelineId = pipelineId;
+        m_pipelineKnown = true;
+    }
+
+    auto Invalidate() -> void
+    {
+        m_pipelineKnown = false;
+        m_topologyKnown = false;
+        m_vertexBufferKnown = false;
+        m_indexBufferKnown = false;
+    }
+
+    auto Draw(RenderCommandList& commandList, const BundleDrawKey& draw) -> void
+    {
+        if (!m_pipelineKnown || m_pipelineId != draw.pipelineId)
+        {
+            commandList.SetPipelineState(draw.pipelineId);
+            m_pipelineId = draw.pipelineId;
+            m_pipelineKnown = true;
+            ++m_stats.stateCallCount;
+        }
+        else {
+            ++m_stats.pipelineSkipCount;
+        }
+
+        if (!m_topologyKnown || m_topology != draw.topology)
+        {
+            commandList.SetPrimitiveTopology(draw.topology);
+            m_topology = draw.topology;
+            m_topologyKnown = true;
+            ++m_stats.stateCallCount;
+        }
+        else {
+            ++m_stats.topologySkipCount;
+        }
+
+        const VertexBufferView vertexBuffer{ .buffer = draw.vertexBuffer, .offset = draw.vertexBufferOffset, .size = draw.vertexBufferSize, .stride = draw.vertexStride };
+        if (!m_vertexBufferKnown || m_vertexBuffer != vertexBuffer)
+        {
+            commandList.SetVertexBuffer(0, draw.vertexBuffer, draw.vertexBufferOffset, draw.vertexBufferSize, draw.vertexStride);
+            m_vertexBuffer = vertexBuffer;
+            m_vertexBufferKnown = true;
+            ++m_stats.stateCallCount;
+        }
+        else {
+            ++m_stats.vertexBufferSkipCount;
+        }
+
+        if (draw.indexBuffer != RENDER_INVALID_RESOURCE)
+        {
+            const IndexBufferView indexBuffer{ .buffer = draw.indexBuffer, .offset = draw.indexBufferOffset, .size = draw.indexBufferSize, .format = draw.indexFormat };
+            if (!m_indexBufferKnown || m_indexBuffer != indexBuffer)
+            {
+                commandList.SetIndexBuffer(draw.indexBuffer, draw.indexBufferOffset, draw.indexBufferSize, draw.indexFormat);
+                m_indexBuffer = indexBuffer;
+                m_indexBufferKnown = true;
+                ++m_stats.stateCallCount;
+            }
+            else {
+                ++m_stats.indexBufferSkipCount;
+            }
+            commandList.DrawIndexedInstanced(draw.count, draw.instanceCount, draw.start, draw.baseVertex, draw.startInstance);
+        }
+        else {
+            commandList.DrawInstanced(draw.count, draw.instanceCount, draw.start, draw.startInstance);
+        }
+        ++m_stats.drawCount;
+    }
+
+    auto GetStats() const -> const DrawStateStats& { return m_stats; }
+
+    auto ResetStats() -> void { m_stats = DrawStateStats{ }; }
+
+private:
+    struct VertexBufferView
+    {
+        RenderResourceId buffer;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t stride;
+
+        auto operator == (const VertexBufferView& other) const -> bool = default;
+    };
+
+    struct IndexBufferView
+    {
+        RenderResourceId buffer;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t format;
+
+        auto operator == (const IndexBufferView& other) const -> bool = default;
+    };
+
+    uint32_t m_pipelineId = 0;
+    uint32_t m_topology = 0;
+    VertexBufferView m_vertexBuffer{ };
+    IndexBufferView m_indexBuffer{ };
+    bool m_pipelineKnown = false;
+    bool m_topologyKnown = false;
+    bool m_vertexBufferKnown = false;
+    bool m_indexBufferKnown = false;
+    DrawStateStats m_stats{ };
+};
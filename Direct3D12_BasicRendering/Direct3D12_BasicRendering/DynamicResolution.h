@@ -0,0 +1,120 @@
+// DynamicResolution.h : Controller that picks the render resolution scale from the measured GPU frame time.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+struct DynamicResolutionSettings
+{
+    double targetFrameTime;         // GPU frame time budget in milliseconds
+    double minScale;                // lower bound of the per-axis resolution scale
+    double maxScale;                // upper bound of the per-axis resolution scale
+    double headroom;                // aim at `targetFrameTime * headroom` to leave room for spikes
+    double deadband;                // relative error within which the scale is kept unchanged
+    double smoothing;               // factor of the exponential moving average of the measured frame time
+    double scaleStep;               // scales are quantized to multiples of this to avoid jitter
+    uint32_t settleFrameCount;      // frames to wait after a change before the next decision
+};
+
+static constexpr auto GetDefaultDynamicResolutionSettings(double targetFrameTime) -> DynamicResolutionSettings
+{
+    return DynamicResolutionSettings{
+        .targetFrameTime = targetFrameTime,
+        .minScale = 0.5,
+        .maxScale = 1.0,
+        .headroom = 0.9,
+        .deadband = 0.05,
+        .smoothing = 0.2,
+        .scaleStep = 1.0 / 64.0,
+        .settleFrameCount = 4
+    };
+}
+
+class DynamicResolutionController
+{
+public:
+    explicit DynamicResolutionController(const DynamicResolutionSettings& settings) :
+        m_settings(settings), m_scale(settings.maxScale)
+    {
+    }
+
+    // Feed the GPU time of the latest completed frame and get the scale for the next frame.
+    // GPU time is assumed to be roughly proportional to the pixel count, i.e. the square of the scale.
+    // Over budget, the scale drops straight to the estimated one; under budget, it only moves half way up,
+    // so that it approaches the target from below instead of overshooting and bouncing back.
+    // The average takes the median of the last 3 frames, so that a single slow frame does not drop the scale only for it
+    // to climb back over the next frames, while a lasting change of load shows after 2 frames.
+    auto Update(double gpuFrameTime) -> double
+    {
+        m_recentFrameTimes[m_recentFrameCount % 3] = gpuFrameTime;
+        if (++m_recentFrameCount < 3) return m_scale;
+
+        const double frameTime = std::fmax(std::fmin(m_recentFrameTimes[0], m_recentFrameTimes[1]),
+            std::fmin(std::fmax(m_recentFrameTimes[0], m_recentFrameTimes[1]), m_recentFrameTimes[2]));
+
+        if (m_smoothedFrameTime <= 0.0) {
+            m_smoothedFrameTime = frameTime;
+        }
+        else {
+            m_smoothedFrameTime += (frameTime - m_smoothedFrameTime) * m_settings.smoothing;
+        }
+
+        if (m_settleFramesLeft > 0)
+        {
+            --m_settleFramesLeft;
+            return m_scale;
+        }
+        if (m_smoothedFrameTime <= 0.0) return m_scale;
+
+        const double targetFrameTime = m_settings.targetFrameTime * m_settings.headroom;
+        const double ratio = targetFrameTime / m_smoothedFrameTime;
+        if (std::fabs(ratio - 1.0) <= m_settings.deadband) return m_scale;
+
+        double scale = m_scale * std::sqrt(ratio);
+        if (scale > m_scale)
+        {
+            scale = m_scale + (scale - m_scale) * 0.5;
+            scale = std::floor(scale / m_settings.scaleStep) * m_settings.scaleStep;
+        }
+        else {
+            scale = std::floor(scale / m_settings.scaleStep) * m_settings.scaleStep;
+        }
+
+        if (scale < m_settings.minScale) {
+            scale = m_settings.minScale;
+        }
+        if (scale > m_settings.maxScale) {
+            scale = m_settings.maxScale;
+        }
+
+        if (scale != m_scale)
+        {
+            // Predict the frame time at the new scale, so the stale average does not trigger another change.
+            m_smoothedFrameTime *= (scale * scale) / (m_scale * m_scale);
+            m_scale = scale;
+            m_settleFramesLeft = m_settings.settleFrameCount;
+            ++m_changeCount;
+        }
+
+        return m_scale;
+    }
+
+    auto GetScale() const -> double { return m_scale; }
+
+    auto GetSmoothedFrameTime() const -> double { return m_smoothedFrameTime; }
+
+    auto GetChangeCount() const -> uint32_t { return m_changeCount; }
+
+    auto GetSettings() const -> const DynamicResolutionSettings& { return m_settings; }
+
+private:
+    DynamicResolutionSettings m_settings;
+    double m_scale;
+    double m_smoothedFrameTime = 0.0;
+    double m_recentFrameTimes[3]{ };
+    uint32_t m_recentFrameCount = 0;
+    uint32_t m_settleFramesLeft = 0;
+    uint32_t m_changeCount = 0;
+};
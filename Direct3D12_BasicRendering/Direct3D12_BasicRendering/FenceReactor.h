@@ -0,0 +1,246 @@
+// FenceReactor.h : Callbacks and futures that run once a fence reaches a value, without blocking the thread that registers them.
+//
+// One background thread waits on all the fences at once, and hands the completed callbacks to workers in value order.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The fences the reactor waits on, e.g. one per command queue, indexed from 0
+class FenceWaitSet
+{
+public:
+    virtual ~FenceWaitSet() = default;
+
+    virtual auto GetFenceCount() const -> size_t = 0;
+
+    // May be called from any thread.
+    virtual auto GetCompletedValue(size_t fence) const -> uint64_t = 0;
+
+    // Have `Wait` return once `fence` reaches `value`, or right away if it already has.
+    virtual auto Arm(size_t fence, uint64_t value) -> bool = 0;
+
+    // Block until an armed value completes or `Wake` is called. Either is remembered if it happens before the call.
+    virtual auto Wait() -> void = 0;
+
+    // May be called from any thread.
+    virtual auto Wake() -> void = 0;
+};
+
+struct FenceReactorStats
+{
+    uint64_t registeredCount;
+    uint64_t immediateCount;            // registered on a value that had already completed
+    uint64_t completedCount;            // callbacks run
+    uint64_t wakeCount;                 // of the reactor thread
+    uint64_t failedArmCount;
+};
+
+class FenceCompletionReactor
+{
+public:
+    FenceCompletionReactor(FenceWaitSet& waitSet, uint32_t workerCount) :
+        m_waitSet(waitSet), m_pending(waitSet.GetFenceCount()), m_armedValues(waitSet.GetFenceCount(), 0)
+    {
+        for (uint32_t i = 0; i < workerCount; ++i) {
+            m_workers.emplace_back([this] { RunCallbacks(); });
+        }
+        m_thread = std::thread([this] { RunReactor(); });
+    }
+
+    ~FenceCompletionReactor() { Stop(); }
+
+    // Run `callback` on a worker once `fence` reaches `value`. Never waits. Once the reactor stops, nothing would run the
+    // callback, so it is dropped right away, after the lock is released.
+    auto OnCompletion(size_t fence, uint64_t value, std::function<void()> callback) -> void
+    {
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) return;
+
+            ++m_stats.registeredCount;
+            if (m_waitSet.GetCompletedValue(fence) >= value)
+            {
+                ++m_stats.immediateCount;
+                m_callbacks.push_back(std::move(callback));
+                m_callbackReady.notify_one();
+                return;
+            }
+
+            // Only a new lowest value needs the fence to be armed again.
+            auto& pending = m_pending[fence];
+            wake = pending.empty() || value < pending.begin()->first;
+            pending.emplace(value, std::move(callback));
+        }
+        if (wake) {
+            m_waitSet.Wake();
+        }
+    }
+
+    // A future that becomes ready once `fence` reaches `value`. It is left broken if the reactor stops before, or has already.
+    auto WhenComplete(size_t fence, uint64_t value) -> std::future<void>
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        std::future<void> future = promise->get_future();
+        OnCompletion(fence, value, [promise] { promise->set_value(); });
+        return future;
+    }
+
+    // Hand over the callbacks of the values that have completed, and wait for all the callbacks handed over so far, e.g.
+    // once the GPU is idle before the resources the callbacks use are released.
+    auto Drain() -> void
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        CollectCompleted();
+        m_idle.wait(lock, [this] { return m_callbacks.empty() && m_busyCount == 0; });
+    }
+
+    // Stop waiting, run the callbacks handed over so far and join the threads. The callbacks still pending are dropped.
+    auto Stop() -> void
+    {
+        if (!m_thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_waitSet.Wake();
+        m_thread.join();
+
+        m_callbackReady.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+        m_workers.clear();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& pending : m_pending) {
+            pending.clear();
+        }
+    }
+
+    auto GetPendingCount() const -> size_t
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = 0;
+        for (const auto& pending : m_pending) {
+            count += pending.size();
+        }
+        return count;
+    }
+
+    auto GetStats() const -> FenceReactorStats
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    // Move the callbacks of the completed values to the workers. Called with `m_mutex` held.
+    auto CollectCompleted() -> void
+    {
+        bool collected = false;
+        for (size_t fence = 0; fence < m_pending.size(); ++fence)
+        {
+            auto& pending = m_pending[fence];
+            if (pending.empty()) continue;
+
+            const uint64_t completedValue = m_waitSet.GetCompletedValue(fence);
+            auto entry = pending.begin();
+            for (; entry != pending.end() && entry->first <= completedValue; ++entry)
+            {
+                m_callbacks.push_back(std::move(entry->second));
+                collected = true;
+            }
+            pending.erase(pending.begin(), entry);
+        }
+        if (collected) {
+            m_callbackReady.notify_all();
+        }
+    }
+
+    auto RunReactor() -> void
+    {
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_stopping) return;
+
+                CollectCompleted();
+
+                // A fence already armed with its lowest pending value wakes the thread by itself.
+                for (size_t fence = 0; fence < m_pending.size(); ++fence)
+                {
+                    if (m_pending[fence].empty()) continue;
+
+                    const uint64_t value = m_pending[fence].begin()->first;
+                    if (value == m_armedValues[fence]) continue;
+                    if (m_waitSet.Arm(fence, value)) {
+                        m_armedValues[fence] = value;
+                    }
+                    else {
+                        ++m_stats.failedArmCount;
+                    }
+                }
+            }
+
+            m_waitSet.Wait();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.wakeCount;
+        }
+    }
+
+    auto RunCallbacks() -> void
+    {
+        while (true)
+        {
+            std::function<void()> callback;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_callbackReady.wait(lock, [this] { return m_stopping || !m_callbacks.empty(); });
+                if (m_callbacks.empty()) return;
+
+                callback = std::move(m_callbacks.front());
+                m_callbacks.pop_front();
+                ++m_busyCount;
+            }
+
+            callback();
+            // Destroyed outside of the lock, as it may hold the last reference to a resource.
+            callback = nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_stats.completedCount;
+                --m_busyCount;
+            }
+            m_idle.notify_all();
+        }
+    }
+
+    FenceWaitSet& m_waitSet;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_callbackReady;
+    std::condition_variable m_idle;
+    std::vector<std::multimap<uint64_t, std::function<void()>>> m_pending;     // per fence, by value
+    std::vector<uint64_t> m_armedValues;                                        // per fence, 0 if never armed
+    std::deque<std::function<void()>> m_callbacks;                              // ready to run, in hand-over order
+    size_t m_busyCount = 0;
+    bool m_stopping = false;
+    FenceReactorStats m_stats{ };
+    std::vector<std::thread> m_workers;
+    std::thread m_thread;
+};
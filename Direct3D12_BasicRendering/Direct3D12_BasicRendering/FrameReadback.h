@@ -0,0 +1,466 @@
+// FrameReadback.h : Ring of readback slots for frame captures, and the worker pool that compares and encodes the frames.
+//
+// A frame with no free slot is skipped rather than waited for.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr size_t FRAME_READBACK_NO_SLOT = SIZE_MAX;
+static constexpr uint32_t FRAME_IMAGE_PIXEL_SIZE = 4;      // RGBA8
+
+// Rows of `width` RGBA8 pixels, `rowPitch` bytes apart
+struct FrameImage
+{
+    const uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+    uint64_t frameIndex;
+};
+
+enum class FrameImageFormat : uint32_t
+{
+    PNG,
+    RAW             // tightly packed rows, as the reference images of the comparison
+};
+
+// ==== Encoding ====
+
+static constexpr auto MakeCrc32Table() -> std::array<uint32_t, 256>
+{
+    std::array<uint32_t, 256> table{ };
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t crc = i;
+        for (uint32_t bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) != 0 ? 0xEDB88320U ^ (crc >> 1) : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+static constexpr std::array<uint32_t, 256> CRC32_TABLE = MakeCrc32Table();
+
+// Start with `crc` = 0.
+static inline auto UpdateCrc32(uint32_t crc, const uint8_t* data, size_t size) -> uint32_t
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = CRC32_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Start with `adler` = 1.
+static inline auto UpdateAdler32(uint32_t adler, const uint8_t* data, size_t size) -> uint32_t
+{
+    static constexpr uint32_t MODULUS = 65521;
+    static constexpr size_t BLOCK_SIZE = 5552;     // the sums cannot overflow within a block
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0)
+    {
+        const size_t blockSize = std::min(size, BLOCK_SIZE);
+        for (size_t i = 0; i < blockSize; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= MODULUS;
+        b %= MODULUS;
+        data += blockSize;
+        size -= blockSize;
+    }
+    return (b << 16) | a;
+}
+
+static inline auto AppendBigEndian32(std::vector<uint8_t>& output, uint32_t value) -> void
+{
+    const uint8_t bytes[] = { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value) };
+    output.insert(output.end(), std::begin(bytes), std::end(bytes));
+}
+
+static inline auto AppendPngChunk(std::vector<uint8_t>& png, const char type[4], const uint8_t* data, size_t size) -> void
+{
+    AppendBigEndian32(png, uint32_t(size));
+    const size_t typeOffset = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data, data + size);
+    AppendBigEndian32(png, UpdateCrc32(0, png.data() + typeOffset, size + 4));
+}
+
+// 8-bit RGBA without filtering, in one IDAT chunk of stored deflate blocks
+static inline auto EncodePng(const FrameImage& image, std::vector<uint8_t>& png) -> void
+{
+    static constexpr uint8_t SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static constexpr size_t MAX_STORED_BLOCK_SIZE = 65535;
+
+    png.assign(std::begin(SIGNATURE), std::end(SIGNATURE));
+
+    std::vector<uint8_t> header;
+    AppendBigEndian32(header, image.width);
+    AppendBigEndian32(header, image.height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });     // bit depth, RGBA, deflate, no filter method extension, no interlace
+    AppendPngChunk(png, "IHDR", header.data(), header.size());
+
+    // Each row is preceded by its filter type, 0 for none.
+    const size_t rowSize = size_t(image.width) * FRAME_IMAGE_PIXEL_SIZE;
+    std::vector<uint8_t> scanlines((rowSize + 1) * image.height);
+    for (uint32_t y = 0; y < image.height; ++y)
+    {
+        scanlines[y * (rowSize + 1)] = 0;
+        memcpy(&scanlines[y * (rowSize + 1) + 1], image.pixels + size_t(y) * image.rowPitch, rowSize);
+    }
+
+    std::vector<uint8_t> zlib{ 0x78, 0x01 };
+    zlib.reserve(2 + scanlines.size() + (scanlines.size() / MAX_STORED_BLOCK_SIZE + 1) * 5 + 4);
+    size_t offset = 0;
+    do
+    {
+        const size_t blockSize = std::min(scanlines.size() - offset, MAX_STORED_BLOCK_SIZE);
+        const bool finalBlock = offset + blockSize == scanlines.size();
+        zlib.insert(zlib.end(), { uint8_t(finalBlock ? 1 : 0), uint8_t(blockSize), uint8_t(blockSize >> 8),
+            uint8_t(~blockSize), uint8_t(~blockSize >> 8) });
+        zlib.insert(zlib.end(), scanlines.begin() + ptrdiff_t(offset), scanlines.begin() + ptrdiff_t(offset + blockSize));
+        offset += blockSize;
+    }
+    while (offset < scanlines.size());
+    AppendBigEndian32(zlib, UpdateAdler32(1, scanlines.data(), scanlines.size()));
+
+    AppendPngChunk(png, "IDAT", zlib.data(), zlib.size());
+    AppendPngChunk(png, "IEND", nullptr, 0);
+}
+
+static inline auto EncodeRawImage(const FrameImage& image, std::vector<uint8_t>& raw) -> void
+{
+    const size_t rowSize = size_t(image.width) * FRAME_IMAGE_PIXEL_SIZE;
+    raw.resize(rowSize * image.height);
+    for (uint32_t y = 0; y < image.height; ++y) {
+        memcpy(&raw[y * rowSize], image.pixels + size_t(y) * image.rowPitch, rowSize);
+    }
+}
+
+// ==== Comparison ====
+
+struct FrameDiffStats
+{
+    uint64_t differentPixelCount;       // pixels with a channel differing by more than the threshold
+    uint32_t maxChannelDifference;
+};
+
+// `reference` is a raw image of the same size.
+static inline auto CompareFrameImage(const FrameImage& image, const uint8_t* reference, uint32_t threshold) -> FrameDiffStats
+{
+    FrameDiffStats stats{ };
+    const size_t rowSize = size_t(image.width) * FRAME_IMAGE_PIXEL_SIZE;
+    for (uint32_t y = 0; y < image.height; ++y)
+    {
+        const uint8_t* const row = image.pixels + size_t(y) * image.rowPitch;
+        const uint8_t* const referenceRow = reference + size_t(y) * rowSize;
+        for (size_t x = 0; x < rowSize; x += FRAME_IMAGE_PIXEL_SIZE)
+        {
+            uint32_t pixelDifference = 0;
+            for (uint32_t channel = 0; channel < FRAME_IMAGE_PIXEL_SIZE; ++channel)
+            {
+                const int difference = int(row[x + channel]) - int(referenceRow[x + channel]);
+                pixelDifference = std::max(pixelDifference, uint32_t(difference < 0 ? -difference : difference));
+            }
+            stats.maxChannelDifference = std::max(stats.maxChannelDifference, pixelDifference);
+            if (pixelDifference > threshold) {
+                ++stats.differentPixelCount;
+            }
+        }
+    }
+    return stats;
+}
+
+// ==== Readback ring ====
+
+struct FrameReadbackStats
+{
+    uint64_t submittedCount;
+    uint64_t skippedCount;      // frames with no free slot
+};
+
+// The render thread calls `Acquire`, `Submit` and `CollectCompleted`, or `SubmitTracked`; `Complete` and `Release` may be called
+// from any thread.
+class FrameReadbackRing
+{
+public:
+    explicit FrameReadbackRing(size_t slotCount) : m_slots(std::make_unique<Slot[]>(slotCount)), m_slotCount(slotCount) { }
+
+    // A free slot for the frame being recorded, or FRAME_READBACK_NO_SLOT if they are all in use; the frame is then skipped.
+    auto Acquire() -> size_t
+    {
+        for (size_t i = 0; i < m_slotCount; ++i)
+        {
+            const size_t slot = (m_nextSlot + i) % m_slotCount;
+            if (m_slots[slot].state.load(std::memory_order_acquire) == SlotState::FREE)
+            {
+                m_nextSlot = (slot + 1) % m_slotCount;
+                m_slots[slot].state.store(SlotState::COPYING, std::memory_order_relaxed);
+                return slot;
+            }
+        }
+        ++m_stats.skippedCount;
+        return FRAME_READBACK_NO_SLOT;
+    }
+
+    // The copy into `slot` completes with `fenceValue`.
+    auto Submit(size_t slot, uint64_t fenceValue, uint64_t frameIndex) -> void
+    {
+        m_slots[slot].fenceValue = fenceValue;
+        m_slots[slot].frameIndex = frameIndex;
+        m_pendingSlots.push_back(slot);
+        ++m_stats.submittedCount;
+    }
+
+    // As `Submit`, for a caller that is told when the copy completes, e.g. by FenceCompletionReactor, and then calls `Complete`
+    // rather than `CollectCompleted`.
+    auto SubmitTracked(size_t slot, uint64_t frameIndex) -> void
+    {
+        m_slots[slot].frameIndex = frameIndex;
+        ++m_stats.submittedCount;
+    }
+
+    // The copy into a slot submitted with `SubmitTracked` has completed. The slot stays in use until `Release`.
+    auto Complete(size_t slot) -> void { m_slots[slot].state.store(SlotState::PROCESSING, std::memory_order_relaxed); }
+
+    // Call `visit(slot, frameIndex)` for each slot whose copy has completed, in submission order. The slot stays in use until `Release`.
+    template <typename Visitor>
+    auto CollectCompleted(uint64_t completedFenceValue, Visitor&& visit) -> void
+    {
+        while (!m_pendingSlots.empty() && m_slots[m_pendingSlots.front()].fenceValue <= completedFenceValue)
+        {
+            const size_t slot = m_pendingSlots.front();
+            m_pendingSlots.pop_front();
+            m_slots[slot].state.store(SlotState::PROCESSING, std::memory_order_relaxed);
+            visit(slot, m_slots[slot].frameIndex);
+        }
+    }
+
+    auto Release(size_t slot) -> void { m_slots[slot].state.store(SlotState::FREE, std::memory_order_release); }
+
+    auto GetSlotCount() const -> size_t { return m_slotCount; }
+
+    auto GetPendingCount() const -> size_t { return m_pendingSlots.size(); }
+
+    auto GetStats() const -> const FrameReadbackStats& { return m_stats; }
+
+private:
+    enum class SlotState : uint32_t
+    {
+        FREE,
+        COPYING,            // submitted, the GPU copy may not have completed
+        PROCESSING          // handed to a worker
+    };
+
+    struct Slot
+    {
+        std::atomic<SlotState> state{ SlotState::FREE };
+        uint64_t fenceValue = 0;
+        uint64_t frameIndex = 0;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_slotCount;
+    size_t m_nextSlot = 0;
+    std::deque<size_t> m_pendingSlots;
+    FrameReadbackStats m_stats{ };
+};
+
+// ==== Workers ====
+
+struct FrameCaptureSettings
+{
+    std::string captureDirectory;       // empty to write nothing
+    std::string compareDirectory;       // raw reference images, empty to compare nothing
+    FrameImageFormat format;
+    uint32_t diffThreshold;             // largest channel difference that still matches
+};
+
+struct FrameCaptureStats
+{
+    uint64_t processedCount;
+    uint64_t writtenCount;
+    uint64_t comparedCount;             // frames with a reference image
+    uint64_t mismatchedCount;
+    uint64_t failedCount;               // files that could not be read or written
+    uint32_t maxChannelDifference;
+    double processTime;                 // total, in milliseconds
+};
+
+// Compare and write the frames on `threadCount` threads. `Push` never waits; `onDone` is called on the worker thread
+// once the image is no longer needed, e.g. to release the readback slot it points to.
+class FrameCaptureWorkers
+{
+public:
+    FrameCaptureWorkers(const FrameCaptureSettings& settings, uint32_t threadCount) : m_settings(settings)
+    {
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            m_threads.emplace_back([this] { RunJobs(); });
+        }
+    }
+
+    ~FrameCaptureWorkers() { Stop(); }
+
+    auto Push(const FrameImage& image, std::function<void()> onDone) -> void
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(Job{ .image = image, .onDone = std::move(onDone) });
+            ++m_busyCount;
+        }
+        m_jobReady.notify_one();
+    }
+
+    // Wait for the jobs pushed so far.
+    auto Drain() -> void
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_busyCount == 0; });
+    }
+
+    // Finish the jobs pushed so far and join the threads.
+    auto Stop() -> void
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_jobReady.notify_all();
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+        m_threads.clear();
+    }
+
+    auto GetStats() const -> FrameCaptureStats
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    // The path of frame `frameIndex` in `directory`, with the extension of `format`
+    static auto GetFramePath(const std::string& directory, uint64_t frameIndex, FrameImageFormat format) -> std::string
+    {
+        char fileName[32]{ };
+        snprintf(fileName, std::size(fileName), "frame_%05llu.%s", (unsigned long long)frameIndex, format == FrameImageFormat::PNG ? "png" : "raw");
+        return directory + "/" + fileName;
+    }
+
+private:
+    struct Job
+    {
+        FrameImage image;
+        std::function<void()> onDone;
+    };
+
+    auto RunJobs() -> void
+    {
+        std::vector<uint8_t> encoded;
+        std::vector<uint8_t> reference;
+        while (true)
+        {
+            Job job{ };
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobReady.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) return;
+
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            FrameCaptureStats stats{ };
+            const auto beginTime = std::chrono::steady_clock::now();
+            ProcessImage(job.image, encoded, reference, stats);
+            stats.processTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+            job.onDone();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stats.processedCount += 1;
+                m_stats.writtenCount += stats.writtenCount;
+                m_stats.comparedCount += stats.comparedCount;
+                m_stats.mismatchedCount += stats.mismatchedCount;
+                m_stats.failedCount += stats.failedCount;
+                m_stats.maxChannelDifference = std::max(m_stats.maxChannelDifference, stats.maxChannelDifference);
+                m_stats.processTime += stats.processTime;
+                --m_busyCount;
+            }
+            m_idle.notify_all();
+        }
+    }
+
+    auto ProcessImage(const FrameImage& image, std::vector<uint8_t>& encoded, std::vector<uint8_t>& reference, FrameCaptureStats& stats) const -> void
+    {
+        if (!m_settings.compareDirectory.empty())
+        {
+            const size_t imageSize = size_t(image.width) * image.height * FRAME_IMAGE_PIXEL_SIZE;
+            const std::string path = GetFramePath(m_settings.compareDirectory, image.frameIndex, FrameImageFormat::RAW);
+            if (FILE* const file = fopen(path.c_str(), "rb"))
+            {
+                reference.resize(imageSize);
+                const bool read = fread(reference.data(), 1, imageSize, file) == imageSize;
+                fclose(file);
+                if (read)
+                {
+                    const FrameDiffStats diff = CompareFrameImage(image, reference.data(), m_settings.diffThreshold);
+                    stats.comparedCount = 1;
+                    stats.mismatchedCount = diff.differentPixelCount > 0 ? 1 : 0;
+                    stats.maxChannelDifference = diff.maxChannelDifference;
+                }
+                else {
+                    stats.failedCount = 1;
+                }
+            }
+        }
+
+        if (!m_settings.captureDirectory.empty())
+        {
+            if (m_settings.format == FrameImageFormat::PNG) {
+                EncodePng(image, encoded);
+            }
+            else {
+                EncodeRawImage(image, encoded);
+            }
+
+            const std::string path = GetFramePath(m_settings.captureDirectory, image.frameIndex, m_settings.format);
+            FILE* const file = fopen(path.c_str(), "wb");
+            const bool written = file != nullptr && fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+            if (file != nullptr) {
+                fclose(file);
+            }
+            stats.writtenCount = written ? 1 : 0;
+            stats.failedCount += written ? 0 : 1;
+        }
+    }
+
+    FrameCaptureSettings m_settings;
+    std::vector<std::thread> m_threads;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_idle;
+    std::deque<Job> m_jobs;
+    size_t m_busyCount = 0;
+    bool m_stopping = false;
+    FrameCaptureStats m_stats{ };
+};
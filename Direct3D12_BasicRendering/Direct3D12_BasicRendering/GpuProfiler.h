@@ -0,0 +1,360 @@
+// GpuProfiler.h : GPU timestamp and pipeline statistics profiler with hierarchical scopes, read back without stalling.
+//
+// A frame whose readback slot is still in flight is not profiled.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Same layout as D3D12_QUERY_DATA_PIPELINE_STATISTICS
+struct GpuPipelineStatistics
+{
+    uint64_t iaVertices;
+    uint64_t iaPrimitives;
+    uint64_t vsInvocations;
+    uint64_t gsInvocations;
+    uint64_t gsPrimitives;
+    uint64_t cInvocations;
+    uint64_t cPrimitives;
+    uint64_t psInvocations;
+    uint64_t hsInvocations;
+    uint64_t dsInvocations;
+    uint64_t csInvocations;
+};
+
+static constexpr uint32_t GPU_PROFILE_NO_PARENT = UINT32_MAX;
+
+struct GpuProfileScope
+{
+    const char* name;               // must outlive the profiler, e.g. a string literal
+    uint32_t parent;                // index of the enclosing scope in the frame, or GPU_PROFILE_NO_PARENT
+    uint32_t depth;                 // 0 for the scopes directly in the frame
+    double beginTime;               // in milliseconds since the beginning of the frame
+    double duration;                // in milliseconds
+    GpuPipelineStatistics statistics;
+};
+
+struct GpuProfileFrame
+{
+    uint64_t fenceValue;            // 0 until a frame has been read back
+    double frameTime;               // in milliseconds, between the beginning and the end of the frame
+    std::vector<GpuProfileScope> scopes;    // in the order they began, so a parent comes before its children
+};
+
+// Scopes are summarized by their path from the frame, so the same name under different parents is kept apart.
+struct GpuProfileSummaryEntry
+{
+    const char* name;
+    uint32_t parent;                // index of the summary entry of the enclosing scope, or GPU_PROFILE_NO_PARENT
+    uint32_t depth;
+    uint64_t sampleCount;
+    double totalTime;
+    double minTime;
+    double maxTime;
+    GpuPipelineStatistics totalStatistics;
+
+    auto GetAverageTime() const -> double { return sampleCount > 0 ? totalTime / double(sampleCount) : 0.0; }
+};
+
+struct GpuProfilerStats
+{
+    uint64_t profiledFrameCount;    // frames read back
+    uint64_t droppedFrameCount;     // frames not profiled because their slot was still in flight
+    uint64_t overflowScopeCount;    // scopes beyond the capacity of a frame, only marked
+    uint64_t readFailureCount;
+};
+
+// `Device` writes the queries into the command lists and reads them back. The queries of all the slots live in
+// one timestamp heap and one pipeline statistics heap, and each is resolved to the same index of the readback buffer:
+//   using CommandList = ...;   // e.g. ID3D12GraphicsCommandList*
+//   auto WriteTimestamp(CommandList commandList, uint32_t queryIndex) -> void;
+//   auto BeginPipelineStatistics(CommandList commandList, uint32_t queryIndex) -> void;
+//   auto EndPipelineStatistics(CommandList commandList, uint32_t queryIndex) -> void;
+//   auto BeginMarker(CommandList commandList, const char* name) -> void;
+//   auto EndMarker(CommandList commandList) -> void;
+//   auto ResolveQueries(CommandList commandList, uint32_t firstTimestamp, uint32_t timestampCount, uint32_t firstStatistics, uint32_t statisticsCount) -> void;
+//   auto ReadQueries(uint32_t firstTimestamp, uint32_t timestampCount, uint64_t timestamps[],
+//       uint32_t firstStatistics, uint32_t statisticsCount, GpuPipelineStatistics statistics[]) -> bool;
+template <typename Device>
+class GpuProfiler
+{
+public:
+    using CommandList = typename Device::CommandList;
+
+    // Up to `frameSlotCount` frames can be in flight with their queries, each with up to `maxScopeCount` scopes.
+    // The timestamps are converted to milliseconds with `timestampFrequency` ticks per second.
+    GpuProfiler(Device& device, uint32_t frameSlotCount, uint32_t maxScopeCount, uint64_t timestampFrequency) :
+        m_device(device), m_maxScopeCount(maxScopeCount), m_timestampFrequency(timestampFrequency), m_slots(frameSlotCount > 0 ? frameSlotCount : 1)
+    {
+        for (auto& slot : m_slots) {
+            slot.scopes.reserve(maxScopeCount);
+        }
+        m_scopeStack.reserve(maxScopeCount);
+        m_timestamps.resize(GetTimestampsPerFrame());
+        m_statistics.resize(maxScopeCount);
+        m_latestFrame.scopes.reserve(maxScopeCount);
+    }
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    auto operator = (const GpuProfiler&) -> GpuProfiler& = delete;
+
+    // The sizes of the query heaps and the readback buffer the device needs
+    static auto GetTimestampQueryCount(uint32_t frameSlotCount, uint32_t maxScopeCount) -> uint32_t { return frameSlotCount * (2 + 2 * maxScopeCount); }
+
+    static auto GetStatisticsQueryCount(uint32_t frameSlotCount, uint32_t maxScopeCount) -> uint32_t { return frameSlotCount * maxScopeCount; }
+
+    // Begin the frame that will signal `fenceValue`, after reading back the frames completed by `completedValue`.
+    // Returns false if the frame is not profiled; its scopes are still marked.
+    auto BeginFrame(CommandList commandList, uint64_t fenceValue, uint64_t completedValue) -> bool
+    {
+        Collect(completedValue);
+
+        m_scopeStack.clear();
+        Slot& slot = m_slots[m_nextSlot];
+        if (slot.pending)
+        {
+            ++m_stats.droppedFrameCount;
+            m_frameActive = false;
+            return false;
+        }
+
+        slot.fenceValue = fenceValue;
+        slot.scopes.clear();
+        m_frameActive = true;
+        m_device.WriteTimestamp(commandList, GetFirstTimestamp(m_nextSlot));
+        return true;
+    }
+
+    auto BeginScope(CommandList commandList, const char* name) -> void
+    {
+        m_device.BeginMarker(commandList, name);
+
+        // The scopes of a frame that is not profiled are kept on the stack without an index, as overflowed scopes are,
+        // so that `EndFrame` closes their markers too.
+        Slot& slot = m_slots[m_nextSlot];
+        if (!m_frameActive || slot.scopes.size() == m_maxScopeCount)
+        {
+            if (m_frameActive) {
+                ++m_stats.overflowScopeCount;
+            }
+            m_scopeStack.push_back(GPU_PROFILE_NO_PARENT);
+            return;
+        }
+
+        const auto scopeIndex = uint32_t(slot.scopes.size());
+        // An overflowed scope has no index, so its children are attached to the nearest scope that has one.
+        uint32_t parent = GPU_PROFILE_NO_PARENT;
+        for (size_t i = m_scopeStack.size(); i > 0; --i)
+        {
+            if (m_scopeStack[i - 1] != GPU_PROFILE_NO_PARENT)
+            {
+                parent = m_scopeStack[i - 1];
+                break;
+            }
+        }
+        slot.scopes.push_back(PendingScope{ .name = name, .parent = parent, .depth = parent == GPU_PROFILE_NO_PARENT ? 0 : slot.scopes[parent].depth + 1 });
+        m_scopeStack.push_back(scopeIndex);
+
+        m_device.WriteTimestamp(commandList, GetFirstTimestamp(m_nextSlot) + 2 + 2 * scopeIndex);
+        m_device.BeginPipelineStatistics(commandList, GetFirstStatistics(m_nextSlot) + scopeIndex);
+    }
+
+    auto EndScope(CommandList commandList) -> void
+    {
+        if (!m_scopeStack.empty())
+        {
+            const uint32_t scopeIndex = m_scopeStack.back();
+            m_scopeStack.pop_back();
+            if (m_frameActive && scopeIndex != GPU_PROFILE_NO_PARENT)
+            {
+                m_device.EndPipelineStatistics(commandList, GetFirstStatistics(m_nextSlot) + scopeIndex);
+                m_device.WriteTimestamp(commandList, GetFirstTimestamp(m_nextSlot) + 3 + 2 * scopeIndex);
+            }
+        }
+
+        m_device.EndMarker(commandList);
+    }
+
+    // Close the scopes left open, and resolve the queries of the frame into its readback slot.
+    auto EndFrame(CommandList commandList) -> void
+    {
+        while (!m_scopeStack.empty()) {
+            EndScope(commandList);
+        }
+        if (!m_frameActive) return;
+
+        Slot& slot = m_slots[m_nextSlot];
+        const uint32_t firstTimestamp = GetFirstTimestamp(m_nextSlot);
+        m_device.WriteTimestamp(commandList, firstTimestamp + 1);
+        m_device.ResolveQueries(commandList, firstTimestamp, 2 + 2 * uint32_t(slot.scopes.size()),
+            GetFirstStatistics(m_nextSlot), uint32_t(slot.scopes.size()));
+
+        slot.pending = true;
+        m_frameActive = false;
+        m_nextSlot = (m_nextSlot + 1) % uint32_t(m_slots.size());
+    }
+
+    // Read back the profiled frames completed by `completedValue`, oldest first. Returns the number of frames read.
+    auto Collect(uint64_t completedValue) -> uint32_t
+    {
+        uint32_t collectedCount = 0;
+        // The slots are used round-robin, so the oldest pending one follows the slot about to be used.
+        for (uint32_t i = 0; i < uint32_t(m_slots.size()); ++i)
+        {
+            const uint32_t slotIndex = (m_nextSlot + i) % uint32_t(m_slots.size());
+            Slot& slot = m_slots[slotIndex];
+            if (!slot.pending) continue;
+            if (slot.fenceValue > completedValue) break;
+
+            slot.pending = false;
+            const auto scopeCount = uint32_t(slot.scopes.size());
+            if (!m_device.ReadQueries(GetFirstTimestamp(slotIndex), 2 + 2 * scopeCount, m_timestamps.data(),
+                GetFirstStatistics(slotIndex), scopeCount, m_statistics.data()))
+            {
+                ++m_stats.readFailureCount;
+                continue;
+            }
+
+            ReadFrame(slot);
+            ++m_stats.profiledFrameCount;
+            ++collectedCount;
+        }
+        return collectedCount;
+    }
+
+    // The most recent frame read back
+    auto GetLatestFrame() const -> const GpuProfileFrame& { return m_latestFrame; }
+
+    // The scopes of the frames read back since the last reset, in the order they were first seen
+    auto GetSummary() const -> const std::vector<GpuProfileSummaryEntry>& { return m_summary; }
+
+    // The frames summarized since the last reset
+    auto GetSummaryFrameCount() const -> uint64_t { return m_summaryFrameCount; }
+
+    auto GetSummaryFrameTime() const -> double { return m_summaryFrameCount > 0 ? m_summaryFrameTime / double(m_summaryFrameCount) : 0.0; }
+
+    auto ResetSummary() -> void
+    {
+        m_summary.clear();
+        m_summaryFrameCount = 0;
+        m_summaryFrameTime = 0.0;
+    }
+
+    auto GetStats() const -> const GpuProfilerStats& { return m_stats; }
+
+private:
+    struct PendingScope
+    {
+        const char* name;
+        uint32_t parent;
+        uint32_t depth;
+    };
+
+    struct Slot
+    {
+        uint64_t fenceValue = 0;
+        bool pending = false;       // resolved, and not read back yet
+        std::vector<PendingScope> scopes;
+    };
+
+    auto GetTimestampsPerFrame() const -> uint32_t { return 2 + 2 * m_maxScopeCount; }
+
+    auto GetFirstTimestamp(uint32_t slotIndex) const -> uint32_t { return slotIndex * GetTimestampsPerFrame(); }
+
+    auto GetFirstStatistics(uint32_t slotIndex) const -> uint32_t { return slotIndex * m_maxScopeCount; }
+
+    auto ToMilliseconds(uint64_t beginTimestamp, uint64_t endTimestamp) const -> double
+    {
+        // A timestamp may be earlier than the one before it if the GPU clock was disturbed, e.g. by a power state change.
+        if (endTimestamp <= beginTimestamp || m_timestampFrequency == 0) return 0.0;
+        return double(endTimestamp - beginTimestamp) * 1000.0 / double(m_timestampFrequency);
+    }
+
+    auto ReadFrame(const Slot& slot) -> void
+    {
+        const uint64_t frameBegin = m_timestamps[0];
+        m_latestFrame.fenceValue = slot.fenceValue;
+        m_latestFrame.frameTime = ToMilliseconds(frameBegin, m_timestamps[1]);
+        m_latestFrame.scopes.clear();
+
+        m_summaryIndices.clear();
+        for (size_t i = 0; i < slot.scopes.size(); ++i)
+        {
+            const PendingScope& pending = slot.scopes[i];
+            const GpuProfileScope scope{
+                .name = pending.name,
+                .parent = pending.parent,
+                .depth = pending.depth,
+                .beginTime = ToMilliseconds(frameBegin, m_timestamps[2 + 2 * i]),
+                .duration = ToMilliseconds(m_timestamps[2 + 2 * i], m_timestamps[3 + 2 * i]),
+                .statistics = m_statistics[i]
+            };
+            m_latestFrame.scopes.push_back(scope);
+
+            const uint32_t summaryParent = scope.parent == GPU_PROFILE_NO_PARENT ? GPU_PROFILE_NO_PARENT : m_summaryIndices[scope.parent];
+            const uint32_t summaryIndex = FindSummaryEntry(scope.name, summaryParent, scope.depth);
+            m_summaryIndices.push_back(summaryIndex);
+            AddSample(m_summary[summaryIndex], scope);
+        }
+
+        ++m_summaryFrameCount;
+        m_summaryFrameTime += m_latestFrame.frameTime;
+    }
+
+    auto FindSummaryEntry(const char* name, uint32_t parent, uint32_t depth) -> uint32_t
+    {
+        for (size_t i = 0; i < m_summary.size(); ++i)
+        {
+            if (m_summary[i].parent == parent && strcmp(m_summary[i].name, name) == 0) return uint32_t(i);
+        }
+
+        m_summary.push_back(GpuProfileSummaryEntry{ .name = name, .parent = parent, .depth = depth, .sampleCount = 0, .totalTime = 0.0,
+            .minTime = 0.0, .maxTime = 0.0, .totalStatistics { } });
+        return uint32_t(m_summary.size() - 1);
+    }
+
+    static auto AddSample(GpuProfileSummaryEntry& entry, const GpuProfileScope& scope) -> void
+    {
+        if (entry.sampleCount == 0 || scope.duration < entry.minTime) {
+            entry.minTime = scope.duration;
+        }
+        if (entry.sampleCount == 0 || scope.duration > entry.maxTime) {
+            entry.maxTime = scope.duration;
+        }
+        ++entry.sampleCount;
+        entry.totalTime += scope.duration;
+
+        GpuPipelineStatistics& total = entry.totalStatistics;
+        const GpuPipelineStatistics& statistics = scope.statistics;
+        total.iaVertices += statistics.iaVertices;
+        total.iaPrimitives += statistics.iaPrimitives;
+        total.vsInvocations += statistics.vsInvocations;
+        total.gsInvocations += statistics.gsInvocations;
+        total.gsPrimitives += statistics.gsPrimitives;
+        total.cInvocations += statistics.cInvocations;
+        total.cPrimitives += statistics.cPrimitives;
+        total.psInvocations += statistics.psInvocations;
+        total.hsInvocations += statistics.hsInvocations;
+        total.dsInvocations += statistics.dsInvocations;
+        total.csInvocations += statistics.csInvocations;
+    }
+
+    Device& m_device;
+    uint32_t m_maxScopeCount;
+    uint64_t m_timestampFrequency;
+    std::vector<Slot> m_slots;
+    uint32_t m_nextSlot = 0;                    // slot of the frame being recorded
+    bool m_frameActive = false;
+    std::vector<uint32_t> m_scopeStack;         // open scopes of the frame being recorded
+    std::vector<uint64_t> m_timestamps;         // of the frame being read back
+    std::vector<GpuPipelineStatistics> m_statistics;
+    std::vector<uint32_t> m_summaryIndices;     // summary entry of each scope of the frame being read back
+    GpuProfileFrame m_latestFrame{ };
+    std::vector<GpuProfileSummaryEntry> m_summary;
+    uint64_t m_summaryFrameCount = 0;
+    double m_summaryFrameTime = 0.0;
+    GpuProfilerStats m_stats{ };
+};
@@ -0,0 +1,3940 @@
+// HeadlessFrame.cpp : Runs the frame logic of the basic rendering on the null backend, without any GPU or window.
+//
+// It measures the CPU cost of recording and submitting a frame, and counts the rendering calls of each frame.
+// Before that, it rasterizes the depth of the scene on the CPU at each rotation angle, culls the objects with the Hi-Z
+// pyramid of the previous angle as the application does, and fails if a culled object has a visible pixel.
+// With --benchmark-draw-sort, it sorts the draw packets of a synthetic scene instead, and counts the state calls avoided.
+// With --benchmark-particles, it runs the particle simulation with scalar code and with SIMD lanes, and checks they agree.
+// With --benchmark-readback, it captures synthetic frames through the readback ring and the capture workers, as if a GPU
+// completed each copy a few frames later, and checks the written images and the comparison with them.
+// With --benchmark-meshlets, it builds the meshlets of a torus on one thread and on all of them, checks the meshlets and
+// their bounds, and checks that the meshlets culled from random views have no front-facing triangle inside the frustum.
+// With --benchmark-textures, it parses DDS files, then streams the mips of textures whose on-screen sizes change within a
+// budget, and checks the order of the loads, the data uploaded, the budget, and how the detail is shared out and dropped.
+// With --benchmark-mips, it builds the mip chains of textures of odd and even sizes with scalar code, SIMD lanes and threads,
+// checks they agree and that a model of the GPU dispatches matches them within tolerance, and measures the CPU throughput.
+// With --benchmark-fences, it drives the fence completion reactor with fake fences, checks that the callbacks and futures
+// complete in value order and only once their fences have, and measures the wakeup latency and the callback throughput.
+// With --check-root-signature, it checks the root parameter layouts decided within DWORD budgets, their 1.1 flags and the
+// cache keys of fixed layouts.
+// With --check-deferred-release, it retires mock COM objects through the deferred release queue against a fake fence, and
+// checks their reference counts and that they are released in fence order, within the per-frame bound, once completed.
+// With --check-dynamic-resolution, it drives the dynamic resolution controller with a model of the GPU frame time whose
+// load steps up and down, with noise, and checks that the scale settles within budget without ping-ponging.
+// With --check-buffer-policy, it checks the path and the heaps chosen for CPU-written buffers on mocked discrete and UMA devices.
+// With --benchmark-compute-primitives, it checks the CPU references of the compute primitives against the std:: algorithms
+// on edge sizes, and measures their throughput.
+// With --check-multi-adapter, it splits frames between simulated adapters of different speeds, and checks that the shares
+// converge to their speeds, that slow adapters keep the minimum share, and that the bands are aligned.
+// With --check-command-list-pool, it recycles pairs of the command list pool against a mock device and a fake fence, and checks
+// that they are only handed out once completed, that the steady state creates none, and that the idle ones are trimmed.
+// With --check-startup-tasks, it runs random startup task graphs with failing and main thread tasks, and checks the order of
+// the tasks, their threads, the tasks skipped after failures and the critical path.
+// With --check-residency, it runs frames over mock resources while the budget shrinks, and checks that the trims evict in LRU
+// order, only what no frame in flight uses, that the resources used are paged in, and the byte counts of the stats.
+// With --check-gpu-profiler, it profiles frames of random scope trees on fake query heaps whose frames complete late and whose
+// clock goes backwards, and checks the scopes read back, the overflows, the dropped frames and the summary by scope path.
+// It does not depend on Direct3D 12 and builds on any platform, e.g.
+//   g++ -std=c++20 -O2 HeadlessFrame.cpp -o HeadlessFrame
+// Usage: HeadlessFrame [frame count] [--verbose] [--depth-prepass] [--draw-packets] [--benchmark-draw-sort] [--benchmark-particles]
+//   [--benchmark-readback] [--benchmark-meshlets] [--benchmark-textures] [--benchmark-mips] [--benchmark-fences]
+//   [--check-root-signature] [--check-deferred-release] [--check-dynamic-resolution] [--check-buffer-policy]
+//   [--benchmark-compute-primitives] [--check-multi-adapter] [--check-command-list-pool]
+//   [--check-startup-tasks] [--check-residency] [--check-gpu-profiler]
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <filesystem>
+#include <numeric>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ShaderPermutation.h"
+#include "BasicFrame.h"
+#include "ParticleSystem.h"
+#include "FrameReadback.h"
+#include "MeshletBuilder.h"
+#include "TextureStreaming.h"
+#include "MipGenerator.h"
+#include "FenceReactor.h"
+#include "RootSignatureLayout.h"
+#include "DeferredRelease.h"
+#include "DynamicResolution.h"
+#include "BufferMemoryPolicy.h"
+#include "ComputePrimitives.h"
+#include "MultiAdapter.h"
+#include "CommandListPool.h"
+#include "StartupTaskGraph.h"
+#include "ResidencyManager.h"
+#include "GpuProfiler.h"
+
+static constexpr uint32_t DEFAULT_FRAME_COUNT = 10000;
+static constexpr uint32_t BACK_BUFFER_COUNT = 5;
+static constexpr uint32_t WINDOW_WIDTH = 640;
+static constexpr uint32_t WINDOW_HEIGHT = 640;
+static constexpr size_t BUNDLE_CACHE_CAPACITY = 64;
+static constexpr uint32_t ANGLE_COUNT = 360;
+
+static constexpr size_t DRAW_SORT_BENCHMARK_COUNTS[] = { 100 * 1000, 1000 * 1000 };
+static constexpr uint32_t DRAW_SORT_BENCHMARK_ITERATION_COUNT = 8;
+static constexpr uint32_t DRAW_SORT_BENCHMARK_PASS_COUNT = 4;
+static constexpr uint32_t DRAW_SORT_BENCHMARK_PIPELINE_COUNT = 64;
+static constexpr uint32_t DRAW_SORT_BENCHMARK_MATERIAL_COUNT = 256;
+static constexpr uint32_t DRAW_SORT_BENCHMARK_VERTEX_BUFFER_COUNT = 16;      // a material uses one of them
+static constexpr uint32_t PARTICLE_BENCHMARK_FRAME_COUNT = 600;
+static constexpr uint32_t PARTICLE_BENCHMARK_MAX_COUNTS[] = { 65536, 1024 * 1024 };
+static constexpr float PARTICLE_BENCHMARK_TOLERANCE = 1.0e-4f;
+static constexpr uint32_t READBACK_BENCHMARK_FRAME_COUNT = 240;
+static constexpr uint32_t READBACK_BENCHMARK_WIDTH = 600;           // rows are padded to 256 bytes as in a readback buffer
+static constexpr uint32_t READBACK_BENCHMARK_HEIGHT = 400;
+static constexpr uint32_t READBACK_BENCHMARK_ROW_PITCH = 2560;
+static constexpr size_t READBACK_BENCHMARK_SLOT_COUNT = 4;
+static constexpr uint64_t READBACK_BENCHMARK_GPU_LATENCY = 2;       // frames between the submission of a copy and its completion
+static constexpr uint32_t READBACK_BENCHMARK_THREAD_COUNT = 2;
+static constexpr auto READBACK_BENCHMARK_FRAME_TIME = std::chrono::milliseconds(4);
+static constexpr uint32_t READBACK_BENCHMARK_CHANGE_INTERVAL = 10;  // every 10th frame differs from the reference in the compare run
+static constexpr uint32_t MESHLET_BENCHMARK_RING_SEGMENT_COUNT = 2048;     // 1M triangles
+static constexpr uint32_t MESHLET_BENCHMARK_TUBE_SEGMENT_COUNT = 256;
+static constexpr uint32_t MESHLET_BENCHMARK_ITERATION_COUNT = 4;
+static constexpr uint32_t MESHLET_BENCHMARK_MIN_THREAD_COUNT = 4;   // compared with one thread even on fewer cores
+static constexpr uint32_t MESHLET_BENCHMARK_VIEW_COUNT = 64;
+static constexpr float MESHLET_BENCHMARK_CAMERA_DISTANCE = 2.5f;
+static constexpr float MESHLET_BENCHMARK_TOLERANCE = 1.0e-4f;
+static constexpr uint32_t TEXTURE_BENCHMARK_TEXTURE_COUNT = 64;
+static constexpr uint64_t TEXTURE_BENCHMARK_BUDGET_DIVISOR = 4;     // the budget holds a quarter of all the mips
+static constexpr uint32_t TEXTURE_BENCHMARK_MAX_PENDING_COUNT = 8;
+static constexpr uint32_t TEXTURE_BENCHMARK_DROP_DELAY = 30;
+static constexpr uint64_t TEXTURE_BENCHMARK_UPLOAD_LATENCY = 2;     // frames between a request and the completion of its upload
+static constexpr uint64_t TEXTURE_BENCHMARK_PHASE_FRAME_COUNT = 600;
+static constexpr struct
+{
+    uint32_t width;
+    uint32_t height;
+    bool srgb;
+} MIP_BENCHMARK_SIZES[] = {
+    { 1024, 1024, true }, { 1000, 600, false }, { 777, 333, true }, { 1, 513, false }, { 640, 1, true }, { 3, 5, false }, { 257, 129, true }, { 96, 80, false }
+};
+static constexpr uint32_t MIP_BENCHMARK_LARGE_SIZE = 4096;
+static constexpr uint32_t MIP_BENCHMARK_ITERATION_COUNT = 4;
+static constexpr uint32_t MIP_BENCHMARK_MIN_THREAD_COUNT = 4;       // compared with one thread even on fewer cores
+static constexpr double MIP_BENCHMARK_WEIGHT_TOLERANCE = 1.0e-6;
+static constexpr uint64_t FENCE_BENCHMARK_ORDER_VALUE_COUNT = 10000;
+static constexpr uint32_t FENCE_BENCHMARK_LATENCY_SAMPLE_COUNT = 2000;
+static constexpr auto FENCE_BENCHMARK_LATENCY_INTERVAL = std::chrono::microseconds(200);
+static constexpr uint32_t FENCE_BENCHMARK_FENCE_COUNT = 4;
+static constexpr uint64_t FENCE_BENCHMARK_VALUE_COUNT = 50000;     // per fence
+static constexpr uint32_t FENCE_BENCHMARK_WORKER_COUNT = 4;
+static constexpr auto FENCE_BENCHMARK_TIMEOUT = std::chrono::milliseconds(5000);    // fails the check rather than hanging
+static constexpr uint32_t ROOT_SIGNATURE_CHECK_RANDOM_LAYOUT_COUNT = 10000;
+static constexpr uint32_t DEFERRED_RELEASE_CHECK_FRAME_COUNT = 600;
+static constexpr uint32_t DEFERRED_RELEASE_CHECK_OBJECT_COUNT = 2000;
+static constexpr size_t DEFERRED_RELEASE_CHECK_MAX_PER_FRAME = 4;
+static constexpr uint64_t DEFERRED_RELEASE_CHECK_GPU_LATENCY = 3;   // frames between the submission of a frame and its completion
+static constexpr double DYNAMIC_RESOLUTION_CHECK_BUDGET = 1000.0 / 60.0;
+static constexpr double DYNAMIC_RESOLUTION_CHECK_NOISE = 0.06;      // of the frame time, either way
+static constexpr uint32_t DYNAMIC_RESOLUTION_CHECK_SPIKE_INTERVAL = 97;         // frames, with twice the frame time
+static constexpr uint32_t DYNAMIC_RESOLUTION_CHECK_PHASE_FRAME_COUNT = 600;
+static constexpr uint32_t DYNAMIC_RESOLUTION_CHECK_SETTLE_FRAME_COUNT = 120;
+static constexpr uint32_t DYNAMIC_RESOLUTION_CHECK_MAX_STEADY_CHANGES = 2;
+static constexpr uint32_t DYNAMIC_RESOLUTION_CHECK_MAX_REVERSALS = 0;
+static constexpr uint32_t COMPUTE_BENCHMARK_LARGE_COUNT = 16 * 1024 * 1024;
+static constexpr uint32_t COMPUTE_BENCHMARK_ITERATION_COUNT = 4;
+static constexpr uint32_t COMPUTE_BENCHMARK_MIN_THREAD_COUNT = 4;   // compared with one thread even on fewer cores
+static constexpr double MULTI_ADAPTER_CHECK_MIN_SHARE = 0.05;       // the default of MultiAdapterLoadBalancer
+static constexpr uint32_t MULTI_ADAPTER_CHECK_ROW_COUNT = 640;
+static constexpr uint32_t MULTI_ADAPTER_CHECK_ROW_ALIGNMENT = 8;
+static constexpr double MULTI_ADAPTER_CHECK_NOISE = 0.05;           // of the GPU time of a band, either way
+static constexpr uint32_t MULTI_ADAPTER_CHECK_PHASE_FRAME_COUNT = 300;
+static constexpr uint32_t MULTI_ADAPTER_CHECK_MAX_CONVERGENCE_FRAME_COUNT = 60;
+static constexpr double MULTI_ADAPTER_CHECK_SHARE_TOLERANCE = 0.02;
+static constexpr uint32_t MULTI_ADAPTER_CHECK_RANDOM_COUNT = 10000;
+static constexpr uint64_t COMMAND_LIST_POOL_CHECK_IDLE_FRAME_LIMIT = 30;
+static constexpr uint64_t COMMAND_LIST_POOL_CHECK_GPU_LATENCY = 3;  // at most, in frames between the submission of a frame and its completion
+static constexpr uint32_t COMMAND_LIST_POOL_CHECK_WARM_UP_FRAME_COUNT = 10;
+static constexpr uint32_t COMMAND_LIST_POOL_CHECK_PHASE_FRAME_COUNT = 300;
+static constexpr uint32_t COMMAND_LIST_POOL_CHECK_SPIKE_FRAME_COUNT = 20;
+static constexpr uint32_t STARTUP_TASK_CHECK_GRAPH_COUNT = 400;
+static constexpr uint32_t STARTUP_TASK_CHECK_MAX_TASK_COUNT = 40;
+static constexpr uint32_t STARTUP_TASK_CHECK_MAX_WORKER_COUNT = 3;
+static constexpr auto STARTUP_TASK_CHECK_TIME_UNIT = std::chrono::milliseconds(10);
+static constexpr uint32_t RESIDENCY_CHECK_RESOURCE_COUNT = 256;
+static constexpr uint32_t RESIDENCY_CHECK_WINDOW_COUNT = 48;        // resources each frame uses, besides a few at random
+static constexpr uint32_t RESIDENCY_CHECK_FRAME_COUNT = 2000;
+static constexpr uint64_t RESIDENCY_CHECK_GPU_LATENCY = 2;          // frames between the submission of a frame and its completion
+static constexpr double RESIDENCY_CHECK_TARGET_BUDGET_FRACTION = 0.9;
+static constexpr double RESIDENCY_CHECK_MIN_BUDGET_FRACTION = 0.4;  // of the size of the resources at first
+static constexpr double RESIDENCY_CHECK_PRESSURE_BUDGET_FRACTION = 0.1;    // less than the frames in flight use
+static constexpr uint32_t GPU_PROFILER_CHECK_FRAME_COUNT = 2000;
+static constexpr uint32_t GPU_PROFILER_CHECK_FRAME_SLOT_COUNT = 3;
+static constexpr uint32_t GPU_PROFILER_CHECK_MAX_SCOPE_COUNT = 12;
+static constexpr uint64_t GPU_PROFILER_CHECK_MAX_GPU_LATENCY = 4;   // frames between the submission of a frame and its completion
+static constexpr uint64_t GPU_PROFILER_CHECK_TIMESTAMP_FREQUENCY = 1000 * 1000;
+static constexpr const char* GPU_PROFILER_CHECK_TOP_SCOPE_NAMES[] = { "Shadow", "Main", "Post" };
+static constexpr const char* GPU_PROFILER_CHECK_CHILD_SCOPE_NAMES[] = { "Draw", "Dispatch" };     // under any scope, including each other
+
+// Fragments of the scene at one angle, with a LESS_EQUAL depth test
+struct SceneFragmentStats
+{
+    uint64_t rasterizedCount;       // without any depth test, all are shaded
+    uint64_t earlyZCount;           // that pass the test against the objects drawn before, front to back
+    uint64_t backToFrontCount;      // the same in the reverse order
+    uint64_t prepassCount;          // that pass the test against the final depth, as after a depth prepass
+    uint64_t coveredPixelCount;
+};
+
+static auto CoversPixel(const BasicObject& object, float cosAngle, float sinAngle, float ndcX, float ndcY) -> bool
+{
+    // Undo the placement, then the rotation of basic.vert.hlsl.
+    const float x = (ndcX - object.offsetX) / object.scale;
+    const float y = (ndcY - object.offsetY) / object.scale;
+    const float localX = x * cosAngle + y * sinAngle;
+    const float localY = y * cosAngle - x * sinAngle;
+    return std::fabs(localX) <= BASIC_SQUARE_HALF_EXTENT && std::fabs(localY) <= BASIC_SQUARE_HALF_EXTENT;
+}
+
+// Call `visit(index)` for each pixel center of the viewport covered by the object.
+template <typename Visitor>
+static auto ForEachCoveredPixel(const BasicObject& object, float angle, Visitor visit) -> void
+{
+    const float radian = angle * 3.14159265f / 180.0f;
+    const float cosAngle = std::cos(radian);
+    const float sinAngle = std::sin(radian);
+    const HiZBounds bounds = GetBasicObjectHiZBounds(object, float(WINDOW_WIDTH), float(WINDOW_HEIGHT));
+    const auto x0 = uint32_t(std::max(bounds.left, 0.0f));
+    const auto y0 = uint32_t(std::max(bounds.top, 0.0f));
+    const auto x1 = uint32_t(std::clamp(std::ceil(bounds.right), 0.0f, float(WINDOW_WIDTH)));
+    const auto y1 = uint32_t(std::clamp(std::ceil(bounds.bottom), 0.0f, float(WINDOW_HEIGHT)));
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        const float ndcY = 1.0f - (float(y) + 0.5f) * 2.0f / float(WINDOW_HEIGHT);
+        for (uint32_t x = x0; x < x1; ++x)
+        {
+            if (CoversPixel(object, cosAngle, sinAngle, (float(x) + 0.5f) * 2.0f / float(WINDOW_WIDTH) - 1.0f, ndcY)) {
+                visit(size_t(y) * WINDOW_WIDTH + x);
+            }
+        }
+    }
+}
+
+static auto RasterizeSceneDepth(float angle, std::vector<float>& depths) -> SceneFragmentStats
+{
+    SceneFragmentStats stats{ };
+    depths.assign(size_t(WINDOW_WIDTH) * WINDOW_HEIGHT, BASIC_CLEAR_DEPTH);
+    for (const auto& object : BASIC_SCENE_OBJECTS)
+    {
+        ForEachCoveredPixel(object, angle, [&](size_t index) {
+            ++stats.rasterizedCount;
+            if (object.depth <= depths[index])
+            {
+                ++stats.earlyZCount;
+                stats.coveredPixelCount += depths[index] == BASIC_CLEAR_DEPTH ? 1 : 0;
+                depths[index] = object.depth;
+            }
+        });
+    }
+    for (const auto& object : BASIC_SCENE_OBJECTS)
+    {
+        ForEachCoveredPixel(object, angle, [&](size_t index) {
+            stats.prepassCount += object.depth <= depths[index] ? 1 : 0;
+        });
+    }
+
+    std::vector<float> backToFrontDepths(depths.size(), BASIC_CLEAR_DEPTH);
+    for (uint32_t i = BASIC_SCENE_OBJECT_COUNT; i-- > 0;)
+    {
+        const BasicObject& object = BASIC_SCENE_OBJECTS[i];
+        ForEachCoveredPixel(object, angle, [&](size_t index) {
+            if (object.depth <= backToFrontDepths[index])
+            {
+                ++stats.backToFrontCount;
+                backToFrontDepths[index] = object.depth;
+            }
+        });
+    }
+    return stats;
+}
+
+// The coarse pyramid that the application reads back from the GPU
+static auto BuildReadbackPyramid(const std::vector<float>& depths) -> HiZPyramid
+{
+    const uint32_t readbackLevel = GetHiZReadbackLevel(WINDOW_WIDTH, WINDOW_HEIGHT, BASIC_HIZ_READBACK_SIZE);
+    HiZLevel level = CreateHiZBaseLevel(depths.data(), WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_WIDTH);
+    for (uint32_t i = 0; i < readbackLevel; ++i) {
+        level = ReduceHiZLevel(level);
+    }
+    return BuildHiZPyramid(std::move(level), readbackLevel);
+}
+
+// Cull the objects at each angle with the pyramid of the previous angle, one frame late as in the application,
+// and check that every culled object is hidden. Returns false on a wrong cull.
+static auto BuildVisibleObjectLists(std::vector<std::vector<BasicObject>>& visibleObjects, HiZCullStats& cullStats,
+    SceneFragmentStats& fragmentStats) -> bool
+{
+    std::vector<float> depths;
+    RasterizeSceneDepth(float(ANGLE_COUNT - 1), depths);
+    HiZPyramid previousPyramid = BuildReadbackPyramid(depths);
+
+    visibleObjects.assign(ANGLE_COUNT, { });
+    for (uint32_t angle = 0; angle < ANGLE_COUNT; ++angle)
+    {
+        const SceneFragmentStats stats = RasterizeSceneDepth(float(angle), depths);
+        fragmentStats.rasterizedCount += stats.rasterizedCount;
+        fragmentStats.earlyZCount += stats.earlyZCount;
+        fragmentStats.backToFrontCount += stats.backToFrontCount;
+        fragmentStats.prepassCount += stats.prepassCount;
+        fragmentStats.coveredPixelCount += stats.coveredPixelCount;
+
+        for (uint32_t i = 0; i < BASIC_SCENE_OBJECT_COUNT; ++i)
+        {
+            const BasicObject& object = BASIC_SCENE_OBJECTS[i];
+            ++cullStats.testedCount;
+            if (!TestHiZOcclusion(previousPyramid, GetBasicObjectHiZBounds(object, float(WINDOW_WIDTH), float(WINDOW_HEIGHT))))
+            {
+                visibleObjects[angle].push_back(object);
+                continue;
+            }
+
+            ++cullStats.culledCount;
+            bool hidden = true;
+            ForEachCoveredPixel(object, float(angle), [&](size_t index) { hidden = hidden && depths[index] < object.depth; });
+            if (!hidden)
+            {
+                fprintf(stderr, "Object %u is culled at %u degrees, but it is visible\n", i, angle);
+                return false;
+            }
+        }
+
+        previousPyramid = BuildReadbackPyramid(depths);
+    }
+    return true;
+}
+
+// Packets of a synthetic scene with random passes, pipelines, materials and depths. The vertex buffer depends on the material.
+static auto CreateSyntheticDrawPackets(DrawPacketQueue& queue, size_t count, const RenderResourceId vertexBuffers[]) -> void
+{
+    queue.Clear();
+    uint32_t seed = 0x12345678U;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t pass = nextRandom() % DRAW_SORT_BENCHMARK_PASS_COUNT;
+        const uint32_t pipelineId = nextRandom() % DRAW_SORT_BENCHMARK_PIPELINE_COUNT;
+        const uint32_t material = nextRandom() % DRAW_SORT_BENCHMARK_MATERIAL_COUNT;
+        const float depth = float(nextRandom() >> 8) / float(1U << 24);
+        const BundleDrawKey draw{
+            .pipelineId = pipelineId,
+            .topology = RENDER_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP,
+            .vertexBuffer = vertexBuffers[material % DRAW_SORT_BENCHMARK_VERTEX_BUFFER_COUNT],
+            .vertexBufferOffset = 0,
+            .vertexBufferSize = uint32_t(sizeof(BASIC_SQUARE_VERTICES)),
+            .vertexStride = uint32_t(sizeof(BASIC_SQUARE_VERTICES[0])),
+            .indexBuffer = RENDER_INVALID_RESOURCE,
+            .indexBufferOffset = 0,
+            .indexBufferSize = 0,
+            .indexFormat = 0,
+            .count = uint32_t(std::size(BASIC_SQUARE_VERTICES)),
+            .instanceCount = 1,
+            .start = 0,
+            .baseVertex = 0,
+            .startInstance = 0
+        };
+        queue.Push(DrawPacket{ .sortKey = MakeDrawSortKey(pass, pipelineId, material, GetDrawDepthBucket(depth, false)), .draw = draw, .userData = 0 });
+    }
+}
+
+// Record all the packets into one frame, in push order or sorted, through a state filter.
+static auto RecordSyntheticDrawPackets(RenderCommandList& commandList, const DrawPacketQueue& queue, bool sorted, RenderResourceId renderTarget)
+    -> DrawStateStats
+{
+    DrawStateFilter filter;
+    if (!commandList.Reset(RENDER_NO_PIPELINE)) return filter.GetStats();
+    filter.Invalidate();
+
+    commandList.ResourceBarrier(renderTarget, RENDER_RESOURCE_STATE_PRESENT, RENDER_RESOURCE_STATE_RENDER_TARGET);
+    const RenderPassDesc pass{
+        .renderTarget = renderTarget,
+        .loadOp = RENDER_LOAD_OP_DISCARD,
+        .storeOp = RENDER_STORE_OP_PRESERVE,
+        .clearColor { },
+        .clearRect = nullptr,
+        .depthTarget = RENDER_INVALID_RESOURCE,
+        .depthLoadOp = RENDER_LOAD_OP_DISCARD,
+        .depthStoreOp = RENDER_STORE_OP_DISCARD,
+        .clearDepth = 0.0f
+    };
+    commandList.BeginRenderPass(pass);
+    commandList.SetGraphicsRootSignature(BASIC_ROOT_SIGNATURE_ID);
+    for (size_t i = 0; i < queue.GetCount(); ++i) {
+        filter.Draw(commandList, sorted ? queue.GetSorted(i).draw : queue.GetPacket(i).draw);
+    }
+    commandList.EndRenderPass();
+    commandList.ResourceBarrier(renderTarget, RENDER_RESOURCE_STATE_RENDER_TARGET, RENDER_RESOURCE_STATE_PRESENT);
+    commandList.Close();
+    return filter.GetStats();
+}
+
+// Compare the radix sort of the draw keys with std::stable_sort, check that both give the same order, and count the state
+// calls of the synthetic frame submitted unsorted and sorted. Without the filter, each draw makes 3 state calls.
+static auto RunDrawSortBenchmark(NullRenderDevice& device, RenderCommandList& commandList, RenderResourceId renderTarget) -> bool
+{
+    RenderResourceId vertexBuffers[DRAW_SORT_BENCHMARK_VERTEX_BUFFER_COUNT]{ };
+    for (auto& vertexBuffer : vertexBuffers) {
+        vertexBuffer = device.CreateBuffer(BASIC_SQUARE_VERTICES, sizeof(BASIC_SQUARE_VERTICES), RENDER_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto const toMilliseconds = [](Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+    const uint32_t threadCount = GetComputeReferenceThreadCount();
+
+    DrawPacketQueue queue;
+    for (auto const count : DRAW_SORT_BENCHMARK_COUNTS)
+    {
+        CreateSyntheticDrawPackets(queue, count, vertexBuffers);
+
+        std::vector<DrawSortEntry> expected(count);
+        double stableSortTime = 0.0;
+        for (uint32_t iteration = 0; iteration < DRAW_SORT_BENCHMARK_ITERATION_COUNT; ++iteration)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                expected[i] = DrawSortEntry{ .key = queue.GetPacket(i).sortKey, .index = uint32_t(i) };
+            }
+            const auto beginTime = Clock::now();
+            std::stable_sort(expected.begin(), expected.end(), [](const DrawSortEntry& a, const DrawSortEntry& b) { return a.key < b.key; });
+            stableSortTime += toMilliseconds(Clock::now() - beginTime);
+        }
+
+        double radixSortTimes[2]{ };
+        const uint32_t radixThreadCounts[2] = { 1, threadCount };
+        for (uint32_t variant = 0; variant < 2; ++variant)
+        {
+            for (uint32_t iteration = 0; iteration < DRAW_SORT_BENCHMARK_ITERATION_COUNT; ++iteration)
+            {
+                const auto beginTime = Clock::now();
+                queue.Sort(radixThreadCounts[variant]);
+                radixSortTimes[variant] += toMilliseconds(Clock::now() - beginTime);
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (&queue.GetSorted(i) != &queue.GetPacket(expected[i].index))
+                {
+                    fprintf(stderr, "Radix sort of %zu draw keys with %u threads mismatches std::stable_sort at %zu\n", count, radixThreadCounts[variant], i);
+                    return false;
+                }
+            }
+        }
+
+        const DrawStateStats unsortedStats = RecordSyntheticDrawPackets(commandList, queue, false, renderTarget);
+        const DrawStateStats sortedStats = RecordSyntheticDrawPackets(commandList, queue, true, renderTarget);
+        if (device.GetErrorCount() > 0)
+        {
+            fprintf(stderr, "Synthetic draw packets are invalid: %s\n", device.GetErrorMessage());
+            return false;
+        }
+
+        const auto toMegaKeys = [count](double totalTime) { return double(count) * DRAW_SORT_BENCHMARK_ITERATION_COUNT / totalTime / 1000.0; };
+        printf("Draw sort of %zu keys: std::stable_sort %.1f M keys/s, radix sort %.1f M keys/s on 1 thread, %.1f M keys/s on %u threads\n",
+            count, toMegaKeys(stableSortTime), toMegaKeys(radixSortTimes[0]), toMegaKeys(radixSortTimes[1]), threadCount);
+        printf("  state calls per draw: 3.00 without the filter, %.2f unsorted, %.2f sorted (%llu of %llu avoided)\n",
+            double(unsortedStats.stateCallCount) / double(count), double(sortedStats.stateCallCount) / double(count),
+            (unsigned long long)sortedStats.GetSkipCount(), (unsigned long long)(sortedStats.GetSkipCount() + sortedStats.stateCallCount));
+    }
+    return true;
+}
+
+// Step a scalar and a vector simulation through the same frames, check that the same particles are alive at the same
+// positions, and report the particles simulated per millisecond. The emission rate fills about half of the slots.
+static auto RunParticleBenchmark() -> bool
+{
+    using Clock = std::chrono::steady_clock;
+    auto const toMilliseconds = [](Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+
+    for (auto const maxCount : PARTICLE_BENCHMARK_MAX_COUNTS)
+    {
+        ParticleSettings settings = PARTICLE_DEFAULT_SETTINGS;
+        settings.maxParticleCount = maxCount;
+        settings.emitCountPerFrame = maxCount / 256;
+
+        ParticleSimulation simulations[2]{ ParticleSimulation(settings), ParticleSimulation(settings) };
+        const ParticleSimd simds[2] = { ParticleSimd::SCALAR, ParticleSimd::VECTOR };
+        double times[2]{ };
+        uint64_t simulatedCount = 0;
+        for (uint32_t frame = 0; frame < PARTICLE_BENCHMARK_FRAME_COUNT; ++frame)
+        {
+            for (uint32_t variant = 0; variant < 2; ++variant)
+            {
+                const auto beginTime = Clock::now();
+                simulations[variant].Step(frame, simds[variant]);
+                times[variant] += toMilliseconds(Clock::now() - beginTime);
+            }
+            if (simulations[0].GetAliveCount() != simulations[1].GetAliveCount())
+            {
+                fprintf(stderr, "Particle frame %u: %u alive with scalar code, %u with %s\n", frame,
+                    simulations[0].GetAliveCount(), simulations[1].GetAliveCount(), GetParticleSimdName());
+                return false;
+            }
+            simulatedCount += simulations[0].GetAliveCount();
+        }
+
+        const ParticleArrays& expected = simulations[0].GetArrays();
+        const ParticleArrays& actual = simulations[1].GetArrays();
+        for (uint32_t i = 0; i < maxCount; ++i)
+        {
+            if (!(expected.age[i] < expected.lifetime[i])) continue;
+
+            if (std::fabs(expected.positionX[i] - actual.positionX[i]) > PARTICLE_BENCHMARK_TOLERANCE ||
+                std::fabs(expected.positionY[i] - actual.positionY[i]) > PARTICLE_BENCHMARK_TOLERANCE)
+            {
+                fprintf(stderr, "Particle slot %u: (%f, %f) with scalar code, (%f, %f) with %s\n", i, expected.positionX[i], expected.positionY[i],
+                    actual.positionX[i], actual.positionY[i], GetParticleSimdName());
+                return false;
+            }
+        }
+
+        printf("Particle simulation of %u slots over %u frames, %u alive at the end: scalar %.0f particles/ms, %s %.0f particles/ms\n",
+            maxCount, PARTICLE_BENCHMARK_FRAME_COUNT, simulations[0].GetAliveCount(), double(simulatedCount) / times[0],
+            GetParticleSimdName(), double(simulatedCount) / times[1]);
+    }
+    return true;
+}
+
+// Frame `frameIndex` of the synthetic scene, with one pixel changed if `changed`
+static auto WriteSyntheticFrame(uint8_t* pixels, uint64_t frameIndex, bool changed) -> void
+{
+    for (uint32_t y = 0; y < READBACK_BENCHMARK_HEIGHT; ++y)
+    {
+        uint8_t* const row = pixels + size_t(y) * READBACK_BENCHMARK_ROW_PITCH;
+        for (uint32_t x = 0; x < READBACK_BENCHMARK_WIDTH; ++x)
+        {
+            row[x * 4 + 0] = uint8_t(x + frameIndex);
+            row[x * 4 + 1] = uint8_t(y * 2 + frameIndex);
+            row[x * 4 + 2] = uint8_t((x ^ y) + frameIndex);
+            row[x * 4 + 3] = 255;
+        }
+    }
+    if (changed) {
+        pixels[size_t(frameIndex % READBACK_BENCHMARK_HEIGHT) * READBACK_BENCHMARK_ROW_PITCH + (frameIndex % READBACK_BENCHMARK_WIDTH) * 4] ^= 16;
+    }
+}
+
+// Run the render loop side of the capture: a slot is acquired for each frame, filled when the frame is submitted, and its
+// copy completes READBACK_BENCHMARK_GPU_LATENCY frames later. Frames are paced to READBACK_BENCHMARK_FRAME_TIME like a
+// presented frame. Returns the frames submitted, and the time spent in the loop outside of the pacing.
+static auto RunSyntheticCapture(const FrameCaptureSettings& settings, bool changeFrames, std::vector<uint64_t>& submittedFrames,
+    double& loopTime, FrameReadbackStats& readbackStats, FrameCaptureStats& captureStats) -> void
+{
+    std::vector<std::vector<uint8_t>> slotMemory(READBACK_BENCHMARK_SLOT_COUNT, std::vector<uint8_t>(size_t(READBACK_BENCHMARK_ROW_PITCH) * READBACK_BENCHMARK_HEIGHT));
+    FrameReadbackRing ring(READBACK_BENCHMARK_SLOT_COUNT);
+    FrameCaptureWorkers workers(settings, READBACK_BENCHMARK_THREAD_COUNT);
+
+    auto const handOver = [&](size_t slot, uint64_t frameIndex) {
+        const FrameImage image{ .pixels = slotMemory[slot].data(), .width = READBACK_BENCHMARK_WIDTH, .height = READBACK_BENCHMARK_HEIGHT,
+            .rowPitch = READBACK_BENCHMARK_ROW_PITCH, .frameIndex = frameIndex };
+        workers.Push(image, [&ring, slot] { ring.Release(slot); });
+    };
+
+    submittedFrames.clear();
+    loopTime = 0.0;
+    auto frameTime = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < READBACK_BENCHMARK_FRAME_COUNT + READBACK_BENCHMARK_GPU_LATENCY; ++frame)
+    {
+        std::this_thread::sleep_until(frameTime);
+        frameTime += READBACK_BENCHMARK_FRAME_TIME;
+
+        const auto beginTime = std::chrono::steady_clock::now();
+        if (frame < READBACK_BENCHMARK_FRAME_COUNT)
+        {
+            const size_t slot = ring.Acquire();
+            if (slot != FRAME_READBACK_NO_SLOT)
+            {
+                // Stands for the copy on the GPU, so it is not part of the loop time
+                const auto writeTime = std::chrono::steady_clock::now();
+                WriteSyntheticFrame(slotMemory[slot].data(), frame, changeFrames && frame % READBACK_BENCHMARK_CHANGE_INTERVAL == 0);
+                loopTime -= std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeTime).count();
+                ring.Submit(slot, frame + 1, frame);
+                submittedFrames.push_back(frame);
+            }
+        }
+        if (frame + 1 >= READBACK_BENCHMARK_GPU_LATENCY) {
+            ring.CollectCompleted(frame + 1 - READBACK_BENCHMARK_GPU_LATENCY + 1, handOver);
+        }
+        loopTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+    }
+
+    workers.Drain();
+    readbackStats = ring.GetStats();
+    captureStats = workers.GetStats();
+}
+
+// Decode a PNG with stored deflate blocks and no filtering, as EncodePng writes them, checking every CRC and the Adler-32.
+static auto DecodeStoredPng(const std::vector<uint8_t>& png, std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height) -> bool
+{
+    static constexpr uint8_t SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (png.size() < sizeof(SIGNATURE) || memcmp(png.data(), SIGNATURE, sizeof(SIGNATURE)) != 0) return false;
+
+    auto const readBigEndian32 = [&png](size_t offset) {
+        return (uint32_t(png[offset]) << 24) | (uint32_t(png[offset + 1]) << 16) | (uint32_t(png[offset + 2]) << 8) | uint32_t(png[offset + 3]);
+    };
+
+    std::vector<uint8_t> zlib;
+    width = 0;
+    height = 0;
+    size_t offset = sizeof(SIGNATURE);
+    bool ended = false;
+    while (!ended && offset + 12 <= png.size())
+    {
+        const uint32_t size = readBigEndian32(offset);
+        if (offset + 12 + size > png.size()) return false;
+        if (UpdateCrc32(0, &png[offset + 4], size_t(size) + 4) != readBigEndian32(offset + 8 + size)) return false;
+
+        const uint8_t* const data = &png[offset + 8];
+        if (memcmp(&png[offset + 4], "IHDR", 4) == 0)
+        {
+            width = readBigEndian32(offset + 8);
+            height = readBigEndian32(offset + 12);
+            if (data[8] != 8 || data[9] != 6) return false;
+        }
+        else if (memcmp(&png[offset + 4], "IDAT", 4) == 0) {
+            zlib.insert(zlib.end(), data, data + size);
+        }
+        else if (memcmp(&png[offset + 4], "IEND", 4) == 0) {
+            ended = true;
+        }
+        offset += 12 + size;
+    }
+    if (!ended || zlib.size() < 6 || zlib[0] != 0x78) return false;
+
+    std::vector<uint8_t> scanlines;
+    size_t zlibOffset = 2;
+    bool finalBlock = false;
+    while (!finalBlock)
+    {
+        if (zlibOffset + 5 > zlib.size() || (zlib[zlibOffset] & 6) != 0) return false;
+
+        finalBlock = (zlib[zlibOffset] & 1) != 0;
+        const uint32_t blockSize = uint32_t(zlib[zlibOffset + 1]) | (uint32_t(zlib[zlibOffset + 2]) << 8);
+        const uint32_t complement = uint32_t(zlib[zlibOffset + 3]) | (uint32_t(zlib[zlibOffset + 4]) << 8);
+        if ((blockSize ^ complement) != 0xFFFF || zlibOffset + 5 + blockSize > zlib.size()) return false;
+
+        scanlines.insert(scanlines.end(), zlib.begin() + ptrdiff_t(zlibOffset + 5), zlib.begin() + ptrdiff_t(zlibOffset + 5 + blockSize));
+        zlibOffset += 5 + blockSize;
+    }
+    if (zlibOffset + 4 != zlib.size()) return false;
+    const uint32_t adler = (uint32_t(zlib[zlibOffset]) << 24) | (uint32_t(zlib[zlibOffset + 1]) << 16) | (uint32_t(zlib[zlibOffset + 2]) << 8) | zlib[zlibOffset + 3];
+    if (UpdateAdler32(1, scanlines.data(), scanlines.size()) != adler) return false;
+
+    const size_t rowSize = size_t(width) * FRAME_IMAGE_PIXEL_SIZE;
+    if (scanlines.size() != (rowSize + 1) * height) return false;
+    pixels.resize(rowSize * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        if (scanlines[y * (rowSize + 1)] != 0) return false;
+        memcpy(&pixels[y * rowSize], &scanlines[y * (rowSize + 1) + 1], rowSize);
+    }
+    return true;
+}
+
+static auto ReadWholeFile(const std::filesystem::path& path, std::vector<uint8_t>& data) -> bool
+{
+    FILE* const file = fopen(path.string().c_str(), "rb");
+    if (file == nullptr) return false;
+
+    fseek(file, 0, SEEK_END);
+    data.resize(size_t(ftell(file)));
+    fseek(file, 0, SEEK_SET);
+    const bool read = fread(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    return read;
+}
+
+// Capture raw references of the synthetic frames, compare a run with some frames changed against them, then capture PNGs
+// and decode them back. The frames with no free slot are skipped in each run, so the checks only count the frames submitted.
+static auto RunReadbackBenchmark() -> bool
+{
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "HeadlessFrameReadback";
+    const std::filesystem::path referenceDirectory = directory / "reference";
+    const std::filesystem::path pngDirectory = directory / "png";
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+    std::filesystem::create_directories(referenceDirectory, error);
+    std::filesystem::create_directories(pngDirectory, error);
+    if (error)
+    {
+        fprintf(stderr, "Cannot create %s: %s\n", directory.string().c_str(), error.message().c_str());
+        return false;
+    }
+
+    std::vector<uint64_t> referenceFrames;
+    std::vector<uint64_t> submittedFrames;
+    double loopTime = 0.0;
+    FrameReadbackStats readbackStats{ };
+    FrameCaptureStats captureStats{ };
+
+    const FrameCaptureSettings rawSettings{ .captureDirectory = referenceDirectory.string(), .compareDirectory { }, .format = FrameImageFormat::RAW, .diffThreshold = 0 };
+    RunSyntheticCapture(rawSettings, false, referenceFrames, loopTime, readbackStats, captureStats);
+    if (captureStats.writtenCount != referenceFrames.size() || captureStats.failedCount > 0)
+    {
+        fprintf(stderr, "Readback: %llu of %zu raw frames written\n", (unsigned long long)captureStats.writtenCount, referenceFrames.size());
+        return false;
+    }
+    printf("Readback of %u raw frames at %ux%u: %llu captured, %llu skipped, %.3f ms per frame in the render loop, %.3f ms per frame on a worker\n",
+        READBACK_BENCHMARK_FRAME_COUNT, READBACK_BENCHMARK_WIDTH, READBACK_BENCHMARK_HEIGHT, (unsigned long long)readbackStats.submittedCount,
+        (unsigned long long)readbackStats.skippedCount, loopTime / READBACK_BENCHMARK_FRAME_COUNT, captureStats.processTime / double(captureStats.processedCount));
+
+    const FrameCaptureSettings compareSettings{ .captureDirectory { }, .compareDirectory = referenceDirectory.string(), .format = FrameImageFormat::RAW, .diffThreshold = 0 };
+    RunSyntheticCapture(compareSettings, true, submittedFrames, loopTime, readbackStats, captureStats);
+    uint64_t expectedComparedCount = 0;
+    uint64_t expectedMismatchedCount = 0;
+    for (auto const frame : submittedFrames)
+    {
+        if (!std::binary_search(referenceFrames.begin(), referenceFrames.end(), frame)) continue;
+
+        ++expectedComparedCount;
+        if (frame % READBACK_BENCHMARK_CHANGE_INTERVAL == 0) {
+            ++expectedMismatchedCount;
+        }
+    }
+    if (captureStats.comparedCount != expectedComparedCount || captureStats.mismatchedCount != expectedMismatchedCount ||
+        (expectedMismatchedCount > 0 && captureStats.maxChannelDifference != 16))
+    {
+        fprintf(stderr, "Readback: %llu frames compared and %llu mismatched, instead of %llu and %llu\n", (unsigned long long)captureStats.comparedCount,
+            (unsigned long long)captureStats.mismatchedCount, (unsigned long long)expectedComparedCount, (unsigned long long)expectedMismatchedCount);
+        return false;
+    }
+    printf("Readback comparison: %llu frames compared with their references, %llu mismatched as expected\n", (unsigned long long)captureStats.comparedCount,
+        (unsigned long long)captureStats.mismatchedCount);
+
+    const FrameCaptureSettings pngSettings{ .captureDirectory = pngDirectory.string(), .compareDirectory { }, .format = FrameImageFormat::PNG, .diffThreshold = 0 };
+    RunSyntheticCapture(pngSettings, false, submittedFrames, loopTime, readbackStats, captureStats);
+    std::vector<uint8_t> png;
+    std::vector<uint8_t> decoded;
+    std::vector<uint8_t> expected(size_t(READBACK_BENCHMARK_ROW_PITCH) * READBACK_BENCHMARK_HEIGHT);
+    for (auto const frame : submittedFrames)
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        const std::string path = FrameCaptureWorkers::GetFramePath(pngDirectory.string(), frame, FrameImageFormat::PNG);
+        if (!ReadWholeFile(path, png) || !DecodeStoredPng(png, decoded, width, height) ||
+            width != READBACK_BENCHMARK_WIDTH || height != READBACK_BENCHMARK_HEIGHT)
+        {
+            fprintf(stderr, "Readback: %s is not a valid PNG of the frame size\n", path.c_str());
+            return false;
+        }
+
+        WriteSyntheticFrame(expected.data(), frame, false);
+        const FrameImage image{ .pixels = expected.data(), .width = width, .height = height, .rowPitch = READBACK_BENCHMARK_ROW_PITCH, .frameIndex = frame };
+        if (CompareFrameImage(image, decoded.data(), 0).maxChannelDifference != 0)
+        {
+            fprintf(stderr, "Readback: %s does not decode to frame %llu\n", path.c_str(), (unsigned long long)frame);
+            return false;
+        }
+    }
+    printf("Readback of %u PNG frames: %llu captured, %llu skipped, %.3f ms per frame in the render loop, %.3f ms per frame on a worker, all decoded back\n",
+        READBACK_BENCHMARK_FRAME_COUNT, (unsigned long long)readbackStats.submittedCount, (unsigned long long)readbackStats.skippedCount,
+        loopTime / READBACK_BENCHMARK_FRAME_COUNT, captureStats.processTime / double(captureStats.processedCount));
+
+    std::filesystem::remove_all(directory, error);
+    return true;
+}
+
+// Check the limits of each meshlet, that the meshlets give back the triangles of the mesh in order, that each sphere
+// contains the vertices of its meshlet, and that each cone contains the normals of its triangles.
+static auto ValidateMeshlets(const MeshletMesh& mesh, const std::vector<MeshletVertex>& vertices, const std::vector<uint32_t>& indices) -> bool
+{
+    size_t triangle = 0;
+    for (size_t i = 0; i < mesh.meshlets.size(); ++i)
+    {
+        const Meshlet& meshlet = mesh.meshlets[i];
+        const MeshletBounds& bounds = mesh.bounds[i];
+        if (meshlet.vertexCount == 0 || meshlet.vertexCount > MESHLET_MAX_VERTEX_COUNT || meshlet.primitiveCount == 0 ||
+            meshlet.primitiveCount > MESHLET_MAX_PRIMITIVE_COUNT || meshlet.primitiveOffset != triangle)
+        {
+            fprintf(stderr, "Meshlet %zu: %u vertices and %u triangles from triangle %u\n", i, meshlet.vertexCount, meshlet.primitiveCount, meshlet.primitiveOffset);
+            return false;
+        }
+
+        for (uint32_t j = 0; j < meshlet.vertexCount; ++j)
+        {
+            const float* const position = vertices[mesh.vertexIndices[meshlet.vertexOffset + j]].position;
+            const float offset[3] = { position[0] - bounds.center[0], position[1] - bounds.center[1], position[2] - bounds.center[2] };
+            if (std::sqrt(GetMeshletDot(offset, offset)) > bounds.radius * (1.0f + MESHLET_BENCHMARK_TOLERANCE))
+            {
+                fprintf(stderr, "Meshlet %zu: vertex %u is outside the bounding sphere\n", i, j);
+                return false;
+            }
+        }
+
+        const float minDot = std::sqrt(std::max(1.0f - bounds.coneCutoff * bounds.coneCutoff, 0.0f));
+        for (uint32_t j = 0; j < meshlet.primitiveCount; ++j, ++triangle)
+        {
+            const uint32_t primitive = mesh.primitives[meshlet.primitiveOffset + j];
+            const float* corners[3]{ };
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                const uint32_t local = UnpackMeshletPrimitive(primitive, corner);
+                if (local >= meshlet.vertexCount || mesh.vertexIndices[meshlet.vertexOffset + local] != indices[triangle * 3 + corner])
+                {
+                    fprintf(stderr, "Meshlet %zu: triangle %u does not match triangle %zu of the mesh\n", i, j, triangle);
+                    return false;
+                }
+                corners[corner] = vertices[indices[triangle * 3 + corner]].position;
+            }
+
+            const auto normal = GetMeshletTriangleNormal(corners[0], corners[1], corners[2]);
+            const float length = std::sqrt(GetMeshletDot(normal.data(), normal.data()));
+            if (bounds.coneCutoff < 1.0f && length > 0.0f && GetMeshletDot(normal.data(), bounds.coneAxis) < (minDot - MESHLET_BENCHMARK_TOLERANCE) * length)
+            {
+                fprintf(stderr, "Meshlet %zu: the normal of triangle %u is outside the cone\n", i, j);
+                return false;
+            }
+        }
+    }
+    if (triangle * 3 != indices.size())
+    {
+        fprintf(stderr, "Meshlets have %zu triangles instead of %zu\n", triangle, indices.size() / 3);
+        return false;
+    }
+    return true;
+}
+
+static auto IsSameMeshletMesh(const MeshletMesh& a, const MeshletMesh& b) -> bool
+{
+    return a.meshlets.size() == b.meshlets.size() && a.vertexIndices == b.vertexIndices && a.primitives == b.primitives &&
+        memcmp(a.meshlets.data(), b.meshlets.data(), a.meshlets.size() * sizeof(Meshlet)) == 0 &&
+        memcmp(a.bounds.data(), b.bounds.data(), a.bounds.size() * sizeof(MeshletBounds)) == 0;
+}
+
+// Cull the meshlets from views looking at the torus from random directions. A meshlet outside the frustum must have all
+// its vertices outside one of the planes, and a meshlet culled by its cone must have no triangle facing the camera.
+static auto RunMeshletCullBenchmark(const MeshletMesh& mesh, const std::vector<MeshletVertex>& vertices) -> bool
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t seed = 0x2468ACE1U;
+    auto const nextAngle = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return float(seed >> 8) / float(1U << 24) * 6.28318530717958647692f;
+    };
+
+    const MeshletMatrix projection = MakeMeshletPerspective(0.9f, 1.0f, 0.1f, 10.0f);
+    MeshletCullStats totalStats{ };
+    uint64_t culledTriangleCount = 0;
+    double cullTime = 0.0;
+    std::vector<uint32_t> visibleMeshlets;
+    for (uint32_t view = 0; view < MESHLET_BENCHMARK_VIEW_COUNT; ++view)
+    {
+        // The camera is at the origin of the view space, and the object is rotated, then moved in front of it.
+        const float angleX = nextAngle();
+        const float angleY = nextAngle();
+        const MeshletMatrix objectToView = MultiplyMeshletMatrices(MultiplyMeshletMatrices(MakeMeshletRotation(0, angleX), MakeMeshletRotation(1, angleY)),
+            MakeMeshletTranslation(0.0f, 0.0f, MESHLET_BENCHMARK_CAMERA_DISTANCE));
+        const float cameraInView[3] = { 0.0f, 0.0f, -MESHLET_BENCHMARK_CAMERA_DISTANCE };
+        const auto cameraPosition = TransformMeshletPoint(cameraInView, MultiplyMeshletMatrices(MakeMeshletRotation(1, -angleY), MakeMeshletRotation(0, -angleX)));
+        const MeshletCullView cullView = MakeMeshletCullView(MultiplyMeshletMatrices(objectToView, projection), cameraPosition.data());
+
+        visibleMeshlets.clear();
+        const auto beginTime = Clock::now();
+        const MeshletCullStats stats = CullMeshlets(mesh, cullView, visibleMeshlets);
+        cullTime += std::chrono::duration<double, std::milli>(Clock::now() - beginTime).count();
+        totalStats.testedCount += stats.testedCount;
+        totalStats.frustumCulledCount += stats.frustumCulledCount;
+        totalStats.coneCulledCount += stats.coneCulledCount;
+
+        for (uint32_t i = 0; i < uint32_t(mesh.meshlets.size()); ++i)
+        {
+            const Meshlet& meshlet = mesh.meshlets[i];
+            if (IsMeshletOutsideFrustum(mesh.bounds[i], cullView))
+            {
+                bool outside = false;
+                for (auto const& plane : cullView.frustumPlanes)
+                {
+                    bool allOutside = true;
+                    for (uint32_t j = 0; j < meshlet.vertexCount && allOutside; ++j) {
+                        allOutside = GetMeshletDot(plane, vertices[mesh.vertexIndices[meshlet.vertexOffset + j]].position) + plane[3] < 0.0f;
+                    }
+                    outside = outside || allOutside;
+                }
+                if (!outside)
+                {
+                    fprintf(stderr, "Meshlet view %u: meshlet %u is culled by the frustum but has vertices inside it\n", view, i);
+                    return false;
+                }
+                culledTriangleCount += meshlet.primitiveCount;
+            }
+            else if (IsMeshletConeCulled(mesh.bounds[i], cullView))
+            {
+                for (uint32_t j = 0; j < meshlet.primitiveCount; ++j)
+                {
+                    const uint32_t primitive = mesh.primitives[meshlet.primitiveOffset + j];
+                    const float* corners[3]{ };
+                    for (uint32_t corner = 0; corner < 3; ++corner) {
+                        corners[corner] = vertices[mesh.vertexIndices[meshlet.vertexOffset + UnpackMeshletPrimitive(primitive, corner)]].position;
+                    }
+                    const auto normal = GetMeshletTriangleNormal(corners[0], corners[1], corners[2]);
+                    const float toCorner[3] = { corners[0][0] - cameraPosition[0], corners[0][1] - cameraPosition[1], corners[0][2] - cameraPosition[2] };
+                    if (GetMeshletDot(normal.data(), toCorner) < 0.0f)
+                    {
+                        fprintf(stderr, "Meshlet view %u: meshlet %u is culled by its cone but triangle %u faces the camera\n", view, i, j);
+                        return false;
+                    }
+                }
+                culledTriangleCount += meshlet.primitiveCount;
+            }
+        }
+    }
+
+    const double testedCount = double(totalStats.testedCount);
+    printf("Meshlet culling of %u views: %.1f%% outside the frustum, %.1f%% back-facing cones, %.1f%% of the triangles culled, %.1f ns per meshlet\n",
+        MESHLET_BENCHMARK_VIEW_COUNT, 100.0 * double(totalStats.frustumCulledCount) / testedCount, 100.0 * double(totalStats.coneCulledCount) / testedCount,
+        100.0 * double(culledTriangleCount) / double(mesh.primitives.size() * MESHLET_BENCHMARK_VIEW_COUNT), cullTime * 1.0e6 / testedCount);
+    return true;
+}
+
+static auto RunMeshletBenchmark() -> bool
+{
+    std::vector<MeshletVertex> vertices;
+    std::vector<uint32_t> indices;
+    BuildTorusMesh(MESHLET_BENCHMARK_RING_SEGMENT_COUNT, MESHLET_BENCHMARK_TUBE_SEGMENT_COUNT, 1.0f, 0.3f, vertices, indices);
+
+    const uint32_t threadCounts[] = { 1, std::max(std::thread::hardware_concurrency(), MESHLET_BENCHMARK_MIN_THREAD_COUNT) };
+    MeshletMesh meshes[2];
+    for (size_t variant = 0; variant < std::size(threadCounts); ++variant)
+    {
+        double bestTime = INFINITY;
+        for (uint32_t iteration = 0; iteration < MESHLET_BENCHMARK_ITERATION_COUNT; ++iteration)
+        {
+            const auto beginTime = std::chrono::steady_clock::now();
+            meshes[variant] = BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size(), threadCounts[variant]);
+            bestTime = std::min(bestTime, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count());
+        }
+        printf("Meshlet build of %zu triangles on %u thread%s: %zu meshlets, %.2f vertices per triangle, %.3f ms\n", indices.size() / 3,
+            threadCounts[variant], threadCounts[variant] > 1 ? "s" : "", meshes[variant].meshlets.size(),
+            double(meshes[variant].vertexIndices.size()) / double(meshes[variant].primitives.size()), bestTime);
+    }
+
+    if (!IsSameMeshletMesh(meshes[0], meshes[1]))
+    {
+        fprintf(stderr, "Meshlets built on %u threads differ from those built on one\n", threadCounts[1]);
+        return false;
+    }
+    if (!ValidateMeshlets(meshes[0], vertices, indices)) return false;
+
+    return RunMeshletCullBenchmark(meshes[0], vertices);
+}
+
+// Build DDS files of several sizes and parse them back, then check that the malformed ones are rejected and that a
+// legacy DXT5 header is read as BC3.
+static auto ValidateDdsParsing() -> bool
+{
+    const uint32_t sizes[][2] = { { 1024, 1024 }, { 1000, 600 }, { 256, 64 }, { 4, 4 }, { 1, 1 } };
+    for (auto const [width, height] : sizes)
+    {
+        const std::vector<uint8_t> file = BuildCheckerDdsFile(width, height, 16, width);
+        DdsTexture texture{ };
+        const DdsParseResult result = ParseDdsTexture(file.data(), file.size(), texture);
+        const DdsMipLevel& lastMip = texture.mips[texture.mipCount - 1];
+        if (result != DdsParseResult::OK || texture.format != TextureFormat::BC1_UNORM || texture.width != width || texture.height != height ||
+            texture.mipCount != uint32_t(std::bit_width(std::max(width, height))) || lastMip.offset + lastMip.size != file.size() ||
+            lastMip.width != 1 || lastMip.height != 1 || lastMip.size != 8)
+        {
+            fprintf(stderr, "DDS: the %ux%u texture is parsed as %s, %ux%u with %u mips\n", width, height, GetDdsParseResultName(result),
+                texture.width, texture.height, texture.mipCount);
+            return false;
+        }
+    }
+
+    const std::vector<uint8_t> file = BuildCheckerDdsFile(256, 64, 16, 0);
+    auto const expect = [](std::vector<uint8_t> data, size_t offset, uint32_t value, DdsParseResult expected, const char* name) {
+        if (offset != SIZE_MAX) {
+            memcpy(data.data() + offset, &value, sizeof(value));
+        }
+        DdsTexture texture{ };
+        const DdsParseResult result = ParseDdsTexture(data.data(), data.size(), texture);
+        if (result != expected) {
+            fprintf(stderr, "DDS: %s is parsed as %s instead of %s\n", name, GetDdsParseResultName(result), GetDdsParseResultName(expected));
+        }
+        return result == expected;
+    };
+    if (!expect(std::vector<uint8_t>(file.begin(), file.end() - 1), SIZE_MAX, 0, DdsParseResult::TRUNCATED, "a truncated file") ||
+        !expect(file, 0, MakeDdsFourCC('D', 'D', 'S', '!'), DdsParseResult::BAD_MAGIC, "a bad magic") ||
+        !expect(file, 28, 10, DdsParseResult::BAD_HEADER, "too many mips") ||
+        !expect(file, 112, 0x200, DdsParseResult::UNSUPPORTED_DIMENSION, "a cube map") ||
+        !expect(file, DDS_HEADER_SIZE + 12, 6, DdsParseResult::UNSUPPORTED_DIMENSION, "an array") ||
+        !expect(file, DDS_HEADER_SIZE, 28, DdsParseResult::UNSUPPORTED_FORMAT, "R8G8B8A8_UNORM")) return false;
+
+    // The same layout without the DX10 header
+    DdsTexture bc3Texture{ .format = TextureFormat::BC3_UNORM, .width = 256, .height = 64, .mipCount = 9, .blockSize = 0, .mips { } };
+    std::vector<uint8_t> legacyFile = BuildDdsFile(bc3Texture, [](uint32_t mip, const DdsMipLevel& level, uint8_t* data) { memset(data, int(mip), level.size); });
+    legacyFile.erase(legacyFile.begin() + DDS_HEADER_SIZE, legacyFile.begin() + DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE);
+    const uint32_t fourCC = MakeDdsFourCC('D', 'X', 'T', '5');
+    memcpy(legacyFile.data() + 84, &fourCC, sizeof(fourCC));
+    DdsTexture legacyTexture{ };
+    if (ParseDdsTexture(legacyFile.data(), legacyFile.size(), legacyTexture) != DdsParseResult::OK || legacyTexture.format != TextureFormat::BC3_UNORM ||
+        legacyTexture.blockSize != 16 || legacyTexture.mips[8].offset != bc3Texture.mips[8].offset - DDS_DX10_HEADER_SIZE ||
+        legacyFile[legacyTexture.mips[8].offset] != 8)
+    {
+        fprintf(stderr, "DDS: the DXT5 file is not parsed as BC3\n");
+        return false;
+    }
+
+    printf("DDS parsing: %zu sizes read back, 6 malformed files rejected, a legacy DXT5 header read as BC3\n", std::size(sizes));
+    return true;
+}
+
+// The mips from `firstMip` copied out of the file, as a texture resource would hold them
+struct TextureBenchmarkUpload
+{
+    uint32_t texture;
+    uint32_t firstMip;
+    std::vector<uint8_t> data;
+};
+
+// Stream the textures through TextureStreamer and the upload worker while their on-screen sizes change, then hold the sizes
+// and check the detail is shared out evenly within the budget, then shrink them and check the mips no longer wanted are dropped.
+// Each upload must hold the mips of the file, and each load must add the next mip the resource can start with, lowest first.
+static auto RunTextureStreamingBenchmark() -> bool
+{
+    if (!ValidateDdsParsing()) return false;
+
+    std::vector<std::vector<uint8_t>> files;
+    std::vector<DdsTexture> textures(TEXTURE_BENCHMARK_TEXTURE_COUNT);
+    uint64_t fullSize = 0;
+    for (uint32_t i = 0; i < TEXTURE_BENCHMARK_TEXTURE_COUNT; ++i)
+    {
+        // Mostly squares, some non-square textures, and some whose mips stop being whole blocks early
+        const uint32_t width = i % 8 == 7 ? 1000 : i % 2 == 0 ? 1024 : 512;
+        const uint32_t height = i % 8 == 7 ? 600 : i % 4 == 1 ? 256 : width;
+        files.push_back(BuildCheckerDdsFile(width, height, 64, i));
+        if (ParseDdsTexture(files[i].data(), files[i].size(), textures[i]) != DdsParseResult::OK) return false;
+        fullSize += files[i].size() - textures[i].mips[0].offset;
+    }
+
+    const TextureStreamingSettings settings{
+        .budget = fullSize / TEXTURE_BENCHMARK_BUDGET_DIVISOR,
+        .maxPendingCount = TEXTURE_BENCHMARK_MAX_PENDING_COUNT,
+        .dropDelay = TEXTURE_BENCHMARK_DROP_DELAY
+    };
+    TextureStreamer streamer(settings);
+    for (const DdsTexture& texture : textures) {
+        streamer.Register(texture);
+    }
+
+    TextureUploadWorker<TextureBenchmarkUpload> worker;
+    std::deque<uint64_t> uploadFrames;      // the frame of each upload in flight, in order
+    std::vector<TextureStreamingRequest> requests;
+    std::vector<float> scales(TEXTURE_BENCHMARK_TEXTURE_COUNT, 1.0f);
+    bool valid = true;
+    auto const collect = [&]() {
+        worker.Collect([&](TextureBenchmarkUpload& upload) {
+            const DdsTexture& texture = textures[upload.texture];
+            const uint32_t oldMip = streamer.GetResidentMip(upload.texture);
+            const size_t offset = texture.mips[upload.firstMip].offset;
+            bool lowestFirst = upload.firstMip >= oldMip || (oldMip == texture.mipCount && upload.firstMip == streamer.GetTailMip(upload.texture));
+            for (uint32_t mip = upload.firstMip + 1; !lowestFirst && mip <= oldMip; ++mip)
+            {
+                // The mips skipped cannot start a resource.
+                lowestFirst = mip == oldMip;
+                if (texture.mips[mip].width % TEXTURE_BC_BLOCK_DIMENSION == 0 && texture.mips[mip].height % TEXTURE_BC_BLOCK_DIMENSION == 0 && mip < oldMip) break;
+            }
+            if (!lowestFirst || upload.data.size() != files[upload.texture].size() - offset ||
+                memcmp(upload.data.data(), files[upload.texture].data() + offset, upload.data.size()) != 0)
+            {
+                fprintf(stderr, "Texture streaming: texture %u went from mip %u to mip %u out of order, or with the wrong data\n", upload.texture, oldMip, upload.firstMip);
+                valid = false;
+            }
+            streamer.Complete(upload.texture, true);
+            uploadFrames.pop_front();
+        });
+    };
+
+    double updateTime = 0.0;
+    uint64_t lastRequestFrame = 0;
+    uint64_t maxCommittedSize = 0;
+    const uint64_t phaseEnds[] = { TEXTURE_BENCHMARK_PHASE_FRAME_COUNT, TEXTURE_BENCHMARK_PHASE_FRAME_COUNT * 2, TEXTURE_BENCHMARK_PHASE_FRAME_COUNT * 3 };
+    for (uint64_t frame = 0; frame < phaseEnds[2] && valid; ++frame)
+    {
+        // The uploads complete within a few frames, however the worker thread is scheduled.
+        if (!uploadFrames.empty() && uploadFrames.front() + TEXTURE_BENCHMARK_UPLOAD_LATENCY <= frame) {
+            worker.Drain();
+        }
+        collect();
+
+        // Each texture scales between 1/32 and 1 of its size, then holds the scale of the end of the first phase, then shrinks to 1/64.
+        for (uint32_t i = 0; i < TEXTURE_BENCHMARK_TEXTURE_COUNT; ++i)
+        {
+            if (frame < phaseEnds[0]) {
+                scales[i] = std::exp2(-5.0f * (0.5f + 0.5f * std::sin(float(frame) * 0.03f + float(i))));
+            }
+            else if (frame >= phaseEnds[1]) {
+                scales[i] = 1.0f / 64.0f;
+            }
+            streamer.SetScreenSize(i, float(textures[i].width) * scales[i], float(textures[i].height) * scales[i], frame);
+        }
+
+        requests.clear();
+        const auto beginTime = std::chrono::steady_clock::now();
+        streamer.Update(frame, requests);
+        updateTime += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - beginTime).count();
+
+        for (const TextureStreamingRequest& request : requests)
+        {
+            const uint8_t* const fileData = files[request.texture].data();
+            const size_t fileSize = files[request.texture].size();
+            const size_t offset = textures[request.texture].mips[request.firstMip].offset;
+            uploadFrames.push_back(frame);
+            worker.Push([request, fileData, fileSize, offset]() {
+                return TextureBenchmarkUpload{ .texture = request.texture, .firstMip = request.firstMip, .data { fileData + offset, fileData + fileSize } };
+            });
+        }
+        if (!requests.empty()) {
+            lastRequestFrame = frame;
+        }
+
+        maxCommittedSize = std::max(maxCommittedSize, streamer.GetCommittedSize());
+        if (streamer.GetCommittedSize() > settings.budget || streamer.GetResidentSize() > streamer.GetCommittedSize())
+        {
+            fprintf(stderr, "Texture streaming: %llu bytes committed and %llu resident in frame %llu, over the budget of %llu\n",
+                (unsigned long long)streamer.GetCommittedSize(), (unsigned long long)streamer.GetResidentSize(), (unsigned long long)frame,
+                (unsigned long long)settings.budget);
+            return false;
+        }
+
+        if (frame + 1 == phaseEnds[1])
+        {
+            // Settled: no request for the last part of the phase, and no texture misses two mips more than another that has detail to spare.
+            int32_t maxMissingCount = 0;
+            int32_t minSparingMissingCount = INT32_MAX;
+            for (uint32_t i = 0; i < TEXTURE_BENCHMARK_TEXTURE_COUNT; ++i)
+            {
+                const uint32_t residentMip = streamer.GetResidentMip(i);
+                const int32_t missingCount = int32_t(residentMip) - int32_t(std::min(streamer.GetDesiredMip(i), streamer.GetTailMip(i)));
+                maxMissingCount = std::max(maxMissingCount, missingCount);
+                if (residentMip < streamer.GetTailMip(i)) {
+                    minSparingMissingCount = std::min(minSparingMissingCount, missingCount);
+                }
+            }
+            if (frame - lastRequestFrame < TEXTURE_BENCHMARK_PHASE_FRAME_COUNT / 2 || (minSparingMissingCount != INT32_MAX && maxMissingCount > minSparingMissingCount + 1))
+            {
+                fprintf(stderr, "Texture streaming: not settled within the budget, last request in frame %llu, %d to %d mips missing\n",
+                    (unsigned long long)lastRequestFrame, minSparingMissingCount, maxMissingCount);
+                return false;
+            }
+            printf("Texture streaming settled in the budget: at most %d mips missing, %d for the textures with detail beyond their tail\n", maxMissingCount,
+                minSparingMissingCount == INT32_MAX ? 0 : minSparingMissingCount);
+        }
+    }
+    worker.Drain();
+    collect();
+    if (!valid) return false;
+
+    for (uint32_t i = 0; i < TEXTURE_BENCHMARK_TEXTURE_COUNT; ++i)
+    {
+        if (streamer.GetResidentMip(i) != std::min(streamer.GetDesiredMip(i), streamer.GetTailMip(i)))
+        {
+            fprintf(stderr, "Texture streaming: texture %u keeps mip %u, but only wants mip %u\n", i, streamer.GetResidentMip(i), streamer.GetDesiredMip(i));
+            return false;
+        }
+    }
+
+    const TextureStreamingStats& stats = streamer.GetStats();
+    printf("Texture streaming of %u textures over %llu frames in a budget of %.1f MB (%llu%% of their mips): %llu loads, %llu drops, %llu evictions, "
+        "%llu loads deferred, %.1f MB streamed in, at most %.1f MB committed, %.2f us per update\n", TEXTURE_BENCHMARK_TEXTURE_COUNT,
+        (unsigned long long)phaseEnds[2], double(settings.budget) / (1024.0 * 1024.0), (unsigned long long)(100 / TEXTURE_BENCHMARK_BUDGET_DIVISOR),
+        (unsigned long long)stats.loadCount, (unsigned long long)stats.dropCount, (unsigned long long)stats.evictionCount, (unsigned long long)stats.deferredCount,
+        double(stats.loadedSize) / (1024.0 * 1024.0), double(maxCommittedSize) / (1024.0 * 1024.0), updateTime / double(phaseEnds[2]));
+    return true;
+}
+
+// Check that the filter taps along an axis of each size up to 64 stay in the mip, and weigh every texel of it as much:
+// the next mip covers each of them once in total.
+static auto ValidateMipFilterTaps() -> bool
+{
+    for (uint32_t size = 1; size <= 64; ++size)
+    {
+        const uint32_t nextSize = GetNextMipSize(size);
+        std::vector<double> coverage(size, 0.0);
+        for (uint32_t index = 0; index < nextSize; ++index)
+        {
+            const MipFilterTaps taps = GetMipFilterTaps(index, size);
+            double weightSum = 0.0;
+            for (uint32_t i = 0; i < taps.count; ++i)
+            {
+                if (taps.first + i >= size)
+                {
+                    fprintf(stderr, "Mip filter of size %u: texel %u reads texel %u\n", size, index, taps.first + i);
+                    return false;
+                }
+                coverage[taps.first + i] += taps.weights[i];
+                weightSum += taps.weights[i];
+            }
+            if (std::fabs(weightSum - 1.0) > MIP_BENCHMARK_WEIGHT_TOLERANCE)
+            {
+                fprintf(stderr, "Mip filter of size %u: the weights of texel %u add up to %f\n", size, index, weightSum);
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            if (std::fabs(coverage[i] - double(nextSize) / double(size)) > MIP_BENCHMARK_WEIGHT_TOLERANCE)
+            {
+                fprintf(stderr, "Mip filter of size %u: texel %u weighs %f in total instead of %f\n", size, i, coverage[i], double(nextSize) / double(size));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Check that the plan writes every mip once, after the mip it reads, with at most one dispatch per texture in a wave, and
+// that the mips a dispatch builds from group shared memory have sources of even sizes.
+static auto ValidateMipPlan(const std::vector<MipTextureDesc>& textures, const MipGenerationPlan& plan) -> bool
+{
+    std::vector<std::vector<size_t>> writtenWaves(textures.size());
+    for (size_t i = 0; i < textures.size(); ++i) {
+        writtenWaves[i].assign(textures[i].levelCount, SIZE_MAX);
+    }
+
+    size_t waveBegin = 0;
+    for (size_t wave = 0; wave < plan.waveEnds.size(); ++wave)
+    {
+        std::vector<bool> dispatched(textures.size(), false);
+        for (size_t d = waveBegin; d < plan.waveEnds[wave]; ++d)
+        {
+            const MipDispatch& dispatch = plan.dispatches[d];
+            const MipTextureDesc& texture = textures[dispatch.texture];
+            if (dispatched[dispatch.texture] || dispatch.levelCount == 0 || dispatch.levelCount > MIP_MAX_LEVELS_PER_DISPATCH ||
+                dispatch.srcLevel + dispatch.levelCount >= texture.levelCount)
+            {
+                fprintf(stderr, "Mip plan: dispatch %zu of wave %zu is invalid\n", d, wave);
+                return false;
+            }
+            dispatched[dispatch.texture] = true;
+            if (dispatch.srcLevel > 0 && writtenWaves[dispatch.texture][dispatch.srcLevel] >= wave)
+            {
+                fprintf(stderr, "Mip plan: dispatch %zu of wave %zu reads mip %u before it is written\n", d, wave, dispatch.srcLevel);
+                return false;
+            }
+
+            for (uint32_t level = dispatch.srcLevel + 1; level <= dispatch.srcLevel + dispatch.levelCount; ++level)
+            {
+                const uint32_t srcWidth = GetMipSize(texture.width, level - 1);
+                const uint32_t srcHeight = GetMipSize(texture.height, level - 1);
+                if (level > dispatch.srcLevel + 1 && ((srcWidth > 1 && srcWidth % 2 != 0) || (srcHeight > 1 && srcHeight % 2 != 0)))
+                {
+                    fprintf(stderr, "Mip plan: dispatch %zu builds mip %u from a %ux%u mip in group shared memory\n", d, level, srcWidth, srcHeight);
+                    return false;
+                }
+                if (writtenWaves[dispatch.texture][level] != SIZE_MAX)
+                {
+                    fprintf(stderr, "Mip plan: mip %u of texture %u is written twice\n", level, dispatch.texture);
+                    return false;
+                }
+                writtenWaves[dispatch.texture][level] = wave;
+            }
+        }
+        waveBegin = plan.waveEnds[wave];
+    }
+
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        for (uint32_t level = 1; level < textures[i].levelCount; ++level)
+        {
+            if (writtenWaves[i][level] == SIZE_MAX)
+            {
+                fprintf(stderr, "Mip plan: mip %u of texture %zu is never written\n", level, i);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Run the dispatches of `plan` as shaders/mips.hlsl does, group by group: the first mip of a dispatch from its 8-bit source,
+// and the next ones from the float texels in group shared memory.
+static auto ModelMipDispatches(const MipGenerationPlan& plan, std::vector<MipChain>& chains) -> void
+{
+    auto const encode = [](const float color[4], bool srgb, uint8_t* texel) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            texel[i] = EncodeUnormChannel(srgb ? LinearToSrgb(color[i]) : color[i]);
+        }
+        texel[3] = EncodeUnormChannel(color[3]);
+    };
+
+    for (const MipDispatch& dispatch : plan.dispatches)
+    {
+        MipChain& chain = chains[dispatch.texture];
+        const uint32_t srcWidth = GetMipSize(chain.width, dispatch.srcLevel);
+        const uint32_t srcHeight = GetMipSize(chain.height, dispatch.srcLevel);
+        const uint8_t* const src = chain.GetLevel(dispatch.srcLevel);
+
+        // Out of the mip, a load returns 0.
+        auto const load = [&](uint32_t x, uint32_t y, float color[4]) {
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                const float value = x < srcWidth && y < srcHeight ? float(src[(size_t(y) * srcWidth + x) * MIP_TEXEL_SIZE + i]) / 255.0f : 0.0f;
+                color[i] = chain.srgb && i < 3 ? SrgbToLinear(value) : value;
+            }
+        };
+
+        for (uint32_t groupY = 0; groupY < dispatch.groupCountY; ++groupY)
+        {
+            for (uint32_t groupX = 0; groupX < dispatch.groupCountX; ++groupX)
+            {
+                float texels[MIP_GROUP_SIZE * MIP_GROUP_SIZE][4]{ };
+                uint32_t width = GetNextMipSize(srcWidth);
+                uint32_t height = GetNextMipSize(srcHeight);
+                for (uint32_t threadY = 0; threadY < MIP_GROUP_SIZE; ++threadY)
+                {
+                    for (uint32_t threadX = 0; threadX < MIP_GROUP_SIZE; ++threadX)
+                    {
+                        const uint32_t x = groupX * MIP_GROUP_SIZE + threadX;
+                        const uint32_t y = groupY * MIP_GROUP_SIZE + threadY;
+                        const MipFilterTaps tapsX = GetMipFilterTaps(x, srcWidth);
+                        const MipFilterTaps tapsY = GetMipFilterTaps(y, srcHeight);
+                        float* const color = texels[threadY * MIP_GROUP_SIZE + threadX];
+                        for (uint32_t ty = 0; ty < tapsY.count; ++ty)
+                        {
+                            for (uint32_t tx = 0; tx < tapsX.count; ++tx)
+                            {
+                                float texel[4];
+                                load(tapsX.first + tx, tapsY.first + ty, texel);
+                                for (uint32_t i = 0; i < 4; ++i) {
+                                    color[i] += tapsY.weights[ty] * tapsX.weights[tx] * texel[i];
+                                }
+                            }
+                        }
+                        if (x < width && y < height) {
+                            encode(color, chain.srgb, chain.GetLevel(dispatch.srcLevel + 1) + (size_t(y) * width + x) * MIP_TEXEL_SIZE);
+                        }
+                    }
+                }
+
+                for (uint32_t level = 1; level < dispatch.levelCount; ++level)
+                {
+                    const uint32_t stride = 1U << (level - 1);
+                    const uint32_t stepX = width == 1 ? 0 : stride;
+                    const uint32_t stepY = height == 1 ? 0 : stride * MIP_GROUP_SIZE;
+                    width = GetNextMipSize(width);
+                    height = GetNextMipSize(height);
+                    for (uint32_t threadY = 0; threadY < MIP_GROUP_SIZE; threadY += 2 * stride)
+                    {
+                        for (uint32_t threadX = 0; threadX < MIP_GROUP_SIZE; threadX += 2 * stride)
+                        {
+                            const uint32_t index = threadY * MIP_GROUP_SIZE + threadX;
+                            for (uint32_t i = 0; i < 4; ++i)
+                            {
+                                texels[index][i] = (texels[index][i] + texels[index + stepX][i] + texels[index + stepY][i] +
+                                    texels[index + stepX + stepY][i]) * 0.25f;
+                            }
+                            const uint32_t x = groupX * (MIP_GROUP_SIZE >> level) + (threadX >> level);
+                            const uint32_t y = groupY * (MIP_GROUP_SIZE >> level) + (threadY >> level);
+                            if (x < width && y < height) {
+                                encode(texels[index], chain.srgb, chain.GetLevel(dispatch.srcLevel + 1 + level) + (size_t(y) * width + x) * MIP_TEXEL_SIZE);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The largest difference of a channel between the mips of `a` and `b`
+static auto GetMipChainDifference(const MipChain& a, const MipChain& b) -> uint32_t
+{
+    uint32_t maxDifference = 0;
+    for (size_t i = 0; i < a.texels.size(); ++i) {
+        maxDifference = std::max(maxDifference, uint32_t(std::abs(int32_t(a.texels[i]) - int32_t(b.texels[i]))));
+    }
+    return maxDifference;
+}
+
+// Build the mips of textures of odd and even sizes, in linear and sRGB space, with scalar code, with SIMD lanes, and on several
+// threads, and check they all agree exactly. Then check a model of the GPU dispatches against them within MIP_COMPARE_TOLERANCE,
+// and measure the CPU paths on a large texture.
+static auto RunMipBenchmark() -> bool
+{
+    if (!ValidateMipFilterTaps()) return false;
+
+    std::vector<MipTextureDesc> textures;
+    for (auto const& size : MIP_BENCHMARK_SIZES) {
+        textures.push_back(MipTextureDesc{ .width = size.width, .height = size.height, .levelCount = GetFullMipCount(size.width, size.height), .srgb = size.srgb });
+    }
+    const MipGenerationPlan plan = PlanMipGeneration(textures.data(), textures.size());
+    if (!ValidateMipPlan(textures, plan)) return false;
+
+    const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), MIP_BENCHMARK_MIN_THREAD_COUNT);
+    uint32_t maxModelDifference = 0;
+    std::vector<MipChain> modelChains;
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        const MipTextureDesc& texture = textures[i];
+        MipChain chains[3]{
+            CreateMipChain(texture.width, texture.height, texture.levelCount, texture.srgb),
+            CreateMipChain(texture.width, texture.height, texture.levelCount, texture.srgb),
+            CreateMipChain(texture.width, texture.height, texture.levelCount, texture.srgb)
+        };
+        WriteMipTestPattern(chains[0], uint32_t(i));
+        chains[1].texels = chains[2].texels = chains[0].texels;
+        modelChains.push_back(chains[0]);
+
+        GenerateMipChain(chains[0], MipSimd::SCALAR, 1);
+        GenerateMipChain(chains[1], MipSimd::VECTOR, 1);
+        GenerateMipChain(chains[2], MipSimd::VECTOR, threadCount);
+        if (chains[1].texels != chains[0].texels || chains[2].texels != chains[0].texels)
+        {
+            fprintf(stderr, "Mips of the %ux%u %s texture: %s on %u threads differ from scalar code by %u, %s on one thread by %u\n", texture.width,
+                texture.height, texture.srgb ? "sRGB" : "linear", GetMipSimdName(), threadCount, GetMipChainDifference(chains[0], chains[2]),
+                GetMipSimdName(), GetMipChainDifference(chains[0], chains[1]));
+            return false;
+        }
+        modelChains[i].texels = chains[0].texels;
+    }
+
+    // The model only reads the mips it wrote itself, so start it from level 0 alone.
+    std::vector<MipChain> expectedChains = modelChains;
+    for (auto& chain : modelChains) {
+        std::fill(chain.texels.begin() + ptrdiff_t(chain.offsets[1]), chain.texels.end(), uint8_t(0));
+    }
+    ModelMipDispatches(plan, modelChains);
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        const uint32_t difference = GetMipChainDifference(expectedChains[i], modelChains[i]);
+        if (difference > MIP_COMPARE_TOLERANCE)
+        {
+            fprintf(stderr, "Mips of the %ux%u %s texture: the GPU model differs from the CPU by %u\n", textures[i].width, textures[i].height,
+                textures[i].srgb ? "sRGB" : "linear", difference);
+            return false;
+        }
+        maxModelDifference = std::max(maxModelDifference, difference);
+    }
+    printf("Mip generation of %zu textures in %zu dispatches and %zu waves: the GPU model is within %u of the CPU chains, at most %u apart\n",
+        textures.size(), plan.dispatches.size(), plan.waveEnds.size(), MIP_COMPARE_TOLERANCE, maxModelDifference);
+
+    // Throughput on the large texture, in source texels per second. sRGB textures always take the scalar code.
+    for (const bool srgb : { false, true })
+    {
+        MipChain chain = CreateMipChain(MIP_BENCHMARK_LARGE_SIZE, MIP_BENCHMARK_LARGE_SIZE, 0, srgb);
+        WriteMipTestPattern(chain, 0);
+        const struct
+        {
+            MipSimd simd;
+            uint32_t threadCount;
+        } variants[] = { { MipSimd::SCALAR, 1 }, { MipSimd::VECTOR, 1 }, { MipSimd::VECTOR, threadCount } };
+        double rates[std::size(variants)]{ };
+        for (size_t v = 0; v < std::size(variants); ++v)
+        {
+            double bestTime = INFINITY;
+            for (uint32_t iteration = 0; iteration < MIP_BENCHMARK_ITERATION_COUNT; ++iteration)
+            {
+                const auto beginTime = std::chrono::steady_clock::now();
+                GenerateMipChain(chain, variants[v].simd, variants[v].threadCount);
+                bestTime = std::min(bestTime, std::chrono::duration<double>(std::chrono::steady_clock::now() - beginTime).count());
+            }
+            rates[v] = double(MIP_BENCHMARK_LARGE_SIZE) * double(MIP_BENCHMARK_LARGE_SIZE) / bestTime / 1.0e6;
+        }
+        if (srgb)
+        {
+            printf("Mip chain of a %ux%u sRGB texture: scalar %.0f M texels/s, scalar on %u threads %.0f M texels/s\n", MIP_BENCHMARK_LARGE_SIZE,
+                MIP_BENCHMARK_LARGE_SIZE, rates[0], threadCount, rates[2]);
+            continue;
+        }
+        printf("Mip chain of a %ux%u linear texture: scalar %.0f M texels/s, %s %.0f M texels/s, %s on %u threads %.0f M texels/s\n", MIP_BENCHMARK_LARGE_SIZE,
+            MIP_BENCHMARK_LARGE_SIZE, rates[0], GetMipSimdName(), rates[1], GetMipSimdName(), threadCount, rates[2]);
+    }
+    return true;
+}
+
+// Fences completed by the benchmark, standing for the GPU queues. An armed value fires once, as with SetEventOnCompletion.
+class FakeFenceWaitSet final : public FenceWaitSet
+{
+public:
+    explicit FakeFenceWaitSet(size_t fenceCount) : m_completedValues(fenceCount), m_armedValues(fenceCount) { }
+
+    auto GetFenceCount() const -> size_t override { return m_completedValues.size(); }
+
+    auto GetCompletedValue(size_t fence) const -> uint64_t override { return m_completedValues[fence].load(std::memory_order_acquire); }
+
+    auto Arm(size_t fence, uint64_t value) -> bool override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_armCount;
+        if (m_completedValues[fence].load(std::memory_order_relaxed) >= value) {
+            m_signaled = true;
+        }
+        else {
+            m_armedValues[fence].push_back(value);
+        }
+        return true;
+    }
+
+    auto Wait() -> void override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_signal.wait(lock, [this] { return m_signaled; });
+        m_signaled = false;
+    }
+
+    auto Wake() -> void override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_signaled = true;
+        }
+        m_signal.notify_one();
+    }
+
+    // Stands for the GPU signaling `fence` with `value` on its queue.
+    auto Signal(size_t fence, uint64_t value) -> void
+    {
+        bool fired = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_completedValues[fence].store(value, std::memory_order_release);
+            auto& armedValues = m_armedValues[fence];
+            const auto firstFired = std::remove_if(armedValues.begin(), armedValues.end(), [value](uint64_t armedValue) { return armedValue <= value; });
+            fired = firstFired != armedValues.end();
+            armedValues.erase(firstFired, armedValues.end());
+            m_signaled = m_signaled || fired;
+        }
+        if (fired) {
+            m_signal.notify_one();
+        }
+    }
+
+    auto GetArmCount() const -> uint64_t
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_armCount;
+    }
+
+private:
+    std::vector<std::atomic<uint64_t>> m_completedValues;
+    std::vector<std::vector<uint64_t>> m_armedValues;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_signal;
+    bool m_signaled = false;
+    uint64_t m_armCount = 0;
+};
+
+static auto IsFutureReady(std::future<void>& future, std::chrono::milliseconds timeout) -> bool
+{
+    return future.wait_for(timeout) == std::future_status::ready;
+}
+
+// Callbacks registered out of order on two fences run once their own fence reaches their values, in value order, whether they
+// were registered before or after the fence completed; a lower value registered while a higher one is armed is not held back;
+// and a future left pending when the reactor stops is broken.
+static auto CheckFenceReactorOrder() -> bool
+{
+    FakeFenceWaitSet waitSet(2);
+    std::vector<uint64_t> completedValues[2];
+    {
+        // One worker, so that the callbacks run in the order they are handed over
+        FenceCompletionReactor reactor(waitSet, 1);
+        for (uint64_t i = 0; i < FENCE_BENCHMARK_ORDER_VALUE_COUNT; ++i)
+        {
+            // A permutation of [1, FENCE_BENCHMARK_ORDER_VALUE_COUNT]
+            const uint64_t value = (i * 7919) % FENCE_BENCHMARK_ORDER_VALUE_COUNT + 1;
+            for (size_t fence = 0; fence < 2; ++fence) {
+                reactor.OnCompletion(fence, value, [&completedValues, fence, value] { completedValues[fence].push_back(value); });
+            }
+        }
+
+        waitSet.Signal(1, FENCE_BENCHMARK_ORDER_VALUE_COUNT);
+        std::future<void> lastOfFence1 = reactor.WhenComplete(1, FENCE_BENCHMARK_ORDER_VALUE_COUNT);
+        if (!IsFutureReady(lastOfFence1, FENCE_BENCHMARK_TIMEOUT))
+        {
+            fputs("Fence reactor: a future on a completed value is not ready\n", stderr);
+            return false;
+        }
+        reactor.Drain();
+        if (!completedValues[0].empty() || completedValues[1].size() != FENCE_BENCHMARK_ORDER_VALUE_COUNT)
+        {
+            fprintf(stderr, "Fence reactor: %zu callbacks of the pending fence and %zu of %llu of the completed one have run\n", completedValues[0].size(),
+                completedValues[1].size(), (unsigned long long)FENCE_BENCHMARK_ORDER_VALUE_COUNT);
+            return false;
+        }
+
+        // Steps of several values, as a queue signals a value per submission
+        for (uint64_t value = 0; value < FENCE_BENCHMARK_ORDER_VALUE_COUNT; )
+        {
+            value = std::min(value + 7, FENCE_BENCHMARK_ORDER_VALUE_COUNT);
+            std::future<void> step = reactor.WhenComplete(0, value);
+            waitSet.Signal(0, value);
+            if (!IsFutureReady(step, FENCE_BENCHMARK_TIMEOUT))
+            {
+                fprintf(stderr, "Fence reactor: the future on value %llu is not ready once the fence reached it\n", (unsigned long long)value);
+                return false;
+            }
+        }
+        reactor.Drain();
+        for (size_t fence = 0; fence < 2; ++fence)
+        {
+            if (completedValues[fence].size() != FENCE_BENCHMARK_ORDER_VALUE_COUNT || !std::is_sorted(completedValues[fence].begin(), completedValues[fence].end()))
+            {
+                fprintf(stderr, "Fence reactor: the callbacks of fence %zu have not all run in value order\n", fence);
+                return false;
+            }
+        }
+
+        // A lower value than the one armed
+        std::future<void> higher = reactor.WhenComplete(0, FENCE_BENCHMARK_ORDER_VALUE_COUNT + 100);
+        std::future<void> lower = reactor.WhenComplete(0, FENCE_BENCHMARK_ORDER_VALUE_COUNT + 50);
+        if (IsFutureReady(lower, std::chrono::milliseconds(0)))
+        {
+            fputs("Fence reactor: a future is ready before its fence value\n", stderr);
+            return false;
+        }
+        waitSet.Signal(0, FENCE_BENCHMARK_ORDER_VALUE_COUNT + 50);
+        if (!IsFutureReady(lower, FENCE_BENCHMARK_TIMEOUT) || IsFutureReady(higher, std::chrono::milliseconds(0)))
+        {
+            fputs("Fence reactor: a value registered below the armed one did not complete on its own\n", stderr);
+            return false;
+        }
+
+        reactor.Stop();
+        try
+        {
+            higher.get();
+            fputs("Fence reactor: a future pending at the stop was completed\n", stderr);
+            return false;
+        }
+        catch (const std::future_error&) { }
+
+        // Nothing services the futures asked for after the stop, on a pending or a completed value, so they are broken at once.
+        std::future<void> afterStopFutures[] = { reactor.WhenComplete(0, FENCE_BENCHMARK_ORDER_VALUE_COUNT + 200), reactor.WhenComplete(1, 1) };
+        for (std::future<void>& afterStop : afterStopFutures)
+        {
+            if (!IsFutureReady(afterStop, std::chrono::milliseconds(0)))
+            {
+                fputs("Fence reactor: a future asked for after the stop is left pending\n", stderr);
+                return false;
+            }
+            try
+            {
+                afterStop.get();
+                fputs("Fence reactor: a future asked for after the stop was completed\n", stderr);
+                return false;
+            }
+            catch (const std::future_error&) { }
+        }
+
+        const FenceReactorStats stats = reactor.GetStats();
+        printf("Fence reactor: %llu callbacks on 2 fences ran in value order, %llu registered on completed values, %llu wakeups, %llu fences armed\n",
+            (unsigned long long)stats.completedCount, (unsigned long long)stats.immediateCount, (unsigned long long)stats.wakeCount,
+            (unsigned long long)waitSet.GetArmCount());
+    }
+    return true;
+}
+
+// The time from a fence signal to the start of its callback, one value at a time, as a queue that completes a frame every so often.
+static auto MeasureFenceReactorLatency() -> bool
+{
+    FakeFenceWaitSet waitSet(1);
+    FenceCompletionReactor reactor(waitSet, 1);
+    std::vector<double> latencies(FENCE_BENCHMARK_LATENCY_SAMPLE_COUNT);
+    std::chrono::steady_clock::time_point signalTime{ };
+    for (uint64_t i = 0; i < FENCE_BENCHMARK_LATENCY_SAMPLE_COUNT; ++i)
+    {
+        reactor.OnCompletion(0, i + 1, [&latencies, &signalTime, i] {
+            latencies[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - signalTime).count();
+        });
+        // Let the reactor thread arm the fence and block, as it would between two frames.
+        std::this_thread::sleep_for(FENCE_BENCHMARK_LATENCY_INTERVAL);
+
+        std::future<void> done = reactor.WhenComplete(0, i + 1);
+        signalTime = std::chrono::steady_clock::now();
+        waitSet.Signal(0, i + 1);
+        if (!IsFutureReady(done, FENCE_BENCHMARK_TIMEOUT))
+        {
+            fprintf(stderr, "Fence reactor: value %llu did not complete\n", (unsigned long long)(i + 1));
+            return false;
+        }
+    }
+    reactor.Drain();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("Fence reactor wakeup latency over %u signals: median %.1f us, 99th percentile %.1f us, max %.1f us\n", FENCE_BENCHMARK_LATENCY_SAMPLE_COUNT,
+        latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+    return true;
+}
+
+// Callbacks on several fences that a thread completes one value at a time, round robin, while the workers run them.
+static auto MeasureFenceReactorThroughput() -> bool
+{
+    FakeFenceWaitSet waitSet(FENCE_BENCHMARK_FENCE_COUNT);
+    FenceCompletionReactor reactor(waitSet, FENCE_BENCHMARK_WORKER_COUNT);
+    std::atomic<uint64_t> completedCount{ 0 };
+
+    const uint64_t callbackCount = uint64_t(FENCE_BENCHMARK_FENCE_COUNT) * FENCE_BENCHMARK_VALUE_COUNT;
+    const auto registerBeginTime = std::chrono::steady_clock::now();
+    for (uint64_t value = 1; value <= FENCE_BENCHMARK_VALUE_COUNT; ++value)
+    {
+        for (size_t fence = 0; fence < FENCE_BENCHMARK_FENCE_COUNT; ++fence) {
+            reactor.OnCompletion(fence, value, [&completedCount] { completedCount.fetch_add(1, std::memory_order_relaxed); });
+        }
+    }
+    const double registerTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - registerBeginTime).count();
+
+    const auto beginTime = std::chrono::steady_clock::now();
+    std::thread gpu([&waitSet] {
+        for (uint64_t value = 1; value <= FENCE_BENCHMARK_VALUE_COUNT; ++value)
+        {
+            for (size_t fence = 0; fence < FENCE_BENCHMARK_FENCE_COUNT; ++fence) {
+                waitSet.Signal(fence, value);
+            }
+        }
+    });
+    std::future<void> last = reactor.WhenComplete(FENCE_BENCHMARK_FENCE_COUNT - 1, FENCE_BENCHMARK_VALUE_COUNT);
+    const bool completed = IsFutureReady(last, FENCE_BENCHMARK_TIMEOUT * 10);
+    gpu.join();
+    reactor.Drain();
+    const double runTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - beginTime).count();
+
+    if (!completed || completedCount.load() != callbackCount || reactor.GetPendingCount() != 0)
+    {
+        fprintf(stderr, "Fence reactor: %llu of %llu callbacks ran\n", (unsigned long long)completedCount.load(), (unsigned long long)callbackCount);
+        return false;
+    }
+
+    const FenceReactorStats stats = reactor.GetStats();
+    printf("Fence reactor throughput with %u fences and %u workers: %.2f M registrations/s, %.2f M callbacks/s, %.1f callbacks per wakeup\n",
+        FENCE_BENCHMARK_FENCE_COUNT, FENCE_BENCHMARK_WORKER_COUNT, double(callbackCount) / registerTime / 1.0e6, double(callbackCount) / runTime / 1.0e6,
+        double(callbackCount) / double(std::max<uint64_t>(stats.wakeCount, 1)));
+    return true;
+}
+
+static auto RunFenceReactorBenchmark() -> bool
+{
+    return CheckFenceReactorOrder() && MeasureFenceReactorLatency() && MeasureFenceReactorThroughput();
+}
+
+// The layout of a few fixed bindings, then of random bindings within random budgets: the layout fits the budget and costs
+// what its kinds cost, and no binding left as a table or a root CBV could have been promoted with the DWORDs left. Then the
+// flags of each volatility and kind, which never pair `DESCRIPTORS_VOLATILE` with `DATA_STATIC`.
+static auto RunRootSignatureCheck() -> bool
+{
+    auto const checkLayout = [](const RootConstantBufferBinding bindings[], uint32_t bindingCount, uint32_t budget, const RootParameterLayout& layout) {
+        uint32_t dwordCount = 0;
+        for (uint32_t i = 0; i < bindingCount; ++i) {
+            dwordCount += GetRootParameterDwordCost(layout.kinds[i], bindings[i].sizeInDwords);
+        }
+        if (layout.parameterCount != bindingCount || dwordCount != layout.totalDwordCount || dwordCount > std::min(budget, ROOT_SIGNATURE_MAX_DWORD_COUNT))
+        {
+            fprintf(stderr, "Root signature: %u parameters cost %u DWORDs but the layout counts %u within a budget of %u\n", layout.parameterCount,
+                dwordCount, layout.totalDwordCount, budget);
+            return false;
+        }
+        for (uint32_t i = 0; i < bindingCount; ++i)
+        {
+            const uint32_t baseDwordCount = dwordCount - GetRootParameterDwordCost(layout.kinds[i], bindings[i].sizeInDwords);
+            const bool constantsFit = bindings[i].sizeInDwords <= ROOT_CONSTANTS_MAX_INLINE_DWORD_COUNT &&
+                baseDwordCount + bindings[i].sizeInDwords <= budget;
+            const bool descriptorFits = baseDwordCount + ROOT_DESCRIPTOR_DWORD_COST <= budget;
+            if ((layout.kinds[i] == RootParameterKind::DESCRIPTOR_TABLE && (constantsFit || descriptorFits)) ||
+                (layout.kinds[i] == RootParameterKind::ROOT_CBV && constantsFit))
+            {
+                fprintf(stderr, "Root signature: binding %u of %u DWORDs is left as kind %u with %u of %u DWORDs used\n", i, bindings[i].sizeInDwords,
+                    uint32_t(layout.kinds[i]), dwordCount, budget);
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const RootConstantBufferBinding bindings[]{
+        {
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 4,
+            .visibility = RootShaderVisibility::ALL,
+            .volatility = RootDataVolatility::STATIC,
+            .descriptorsVolatile = false
+        },
+        {
+            .shaderRegister = 1,
+            .registerSpace = 0,
+            .sizeInDwords = 12,
+            .visibility = RootShaderVisibility::VERTEX,
+            .volatility = RootDataVolatility::VOLATILE,
+            .descriptorsVolatile = false
+        },
+        {
+            .shaderRegister = 2,
+            .registerSpace = 0,
+            .sizeInDwords = 2,
+            .visibility = RootShaderVisibility::VERTEX,
+            .volatility = RootDataVolatility::VOLATILE,
+            .descriptorsVolatile = false
+        },
+        {
+            .shaderRegister = 3,
+            .registerSpace = 0,
+            .sizeInDwords = 8,
+            .visibility = RootShaderVisibility::PIXEL,
+            .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+            .descriptorsVolatile = false
+        },
+        {
+            .shaderRegister = 4,
+            .registerSpace = 0,
+            .sizeInDwords = 64,
+            .visibility = RootShaderVisibility::PIXEL,
+            .volatility = RootDataVolatility::VOLATILE,
+            .descriptorsVolatile = false
+        }
+    };
+    constexpr auto T = RootParameterKind::DESCRIPTOR_TABLE;
+    constexpr auto C = RootParameterKind::ROOT_CONSTANTS;
+    constexpr auto D = RootParameterKind::ROOT_CBV;
+    // The most volatile bindings are promoted first, the smallest of them first.
+    static constexpr struct
+    {
+        uint32_t budget;
+        RootParameterKind kinds[5];
+        uint32_t totalDwordCount;
+    } EXPECTED_LAYOUTS[] = {
+        { 4, { T, T, T, T, T }, 5 },
+        { 5, { T, T, T, T, T }, 5 },
+        { 6, { T, T, C, T, T }, 6 },
+        { 8, { T, D, C, T, D }, 8 },
+        { 18, { T, C, C, T, D }, 18 },
+        { 25, { T, C, C, C, D }, 25 },
+        { 28, { C, C, C, C, D }, 28 },
+        { 100, { C, C, C, C, D }, 28 }
+    };
+    for (auto const& expected : EXPECTED_LAYOUTS)
+    {
+        RootParameterLayout layout{ };
+        const bool decided = DecideRootParameterLayout(bindings, uint32_t(std::size(bindings)), expected.budget, layout);
+        if (decided != (expected.budget >= std::size(bindings)))
+        {
+            fprintf(stderr, "Root signature: the layout within %u DWORDs is %s\n", expected.budget, decided ? "decided" : "rejected");
+            return false;
+        }
+        if (!decided) continue;
+
+        if (!std::equal(std::begin(expected.kinds), std::end(expected.kinds), layout.kinds) || layout.totalDwordCount != expected.totalDwordCount)
+        {
+            fprintf(stderr, "Root signature: the layout within %u DWORDs is not the expected one\n", expected.budget);
+            return false;
+        }
+        if (!checkLayout(bindings, uint32_t(std::size(bindings)), std::min(expected.budget, ROOT_SIGNATURE_MAX_DWORD_COUNT), layout)) return false;
+    }
+
+    uint32_t seed = 0x2468aceU;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+    uint32_t kindCounts[3]{ };
+    for (uint32_t iteration = 0; iteration < ROOT_SIGNATURE_CHECK_RANDOM_LAYOUT_COUNT; ++iteration)
+    {
+        RootConstantBufferBinding randomBindings[ROOT_SIGNATURE_MAX_DWORD_COUNT]{ };
+        const uint32_t bindingCount = 1 + nextRandom() % 24;
+        for (uint32_t i = 0; i < bindingCount; ++i)
+        {
+            randomBindings[i] = {
+                .shaderRegister = i,
+                .registerSpace = 0,
+                .sizeInDwords = 1 + nextRandom() % 24,
+                .visibility = RootShaderVisibility(nextRandom() % 3),
+                .volatility = RootDataVolatility(nextRandom() % 3),
+                .descriptorsVolatile = nextRandom() % 2 == 0
+            };
+        }
+        const uint32_t budget = nextRandom() % (ROOT_SIGNATURE_MAX_DWORD_COUNT + 8);
+
+        RootParameterLayout layout{ };
+        const bool decided = DecideRootParameterLayout(randomBindings, bindingCount, budget, layout);
+        if (decided != (bindingCount * ROOT_DESCRIPTOR_TABLE_DWORD_COST <= std::min(budget, ROOT_SIGNATURE_MAX_DWORD_COUNT)))
+        {
+            fprintf(stderr, "Root signature: %u bindings within %u DWORDs are %s\n", bindingCount, budget, decided ? "decided" : "rejected");
+            return false;
+        }
+        if (!decided) continue;
+
+        if (!checkLayout(randomBindings, bindingCount, std::min(budget, ROOT_SIGNATURE_MAX_DWORD_COUNT), layout)) return false;
+        for (uint32_t i = 0; i < bindingCount; ++i) {
+            ++kindCounts[uint32_t(layout.kinds[i])];
+        }
+    }
+
+    static constexpr struct
+    {
+        RootDataVolatility volatility;
+        bool descriptorsVolatile;
+        uint32_t rootDescriptorFlags;
+        uint32_t descriptorRangeFlags;
+    } EXPECTED_FLAGS[] = {
+        { RootDataVolatility::STATIC, false, ROOT_FLAG_DATA_STATIC, ROOT_FLAG_DATA_STATIC },
+        { RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE, false, ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE },
+        { RootDataVolatility::VOLATILE, false, ROOT_FLAG_DATA_VOLATILE, ROOT_FLAG_DATA_VOLATILE },
+        { RootDataVolatility::STATIC, true, ROOT_FLAG_DATA_STATIC, ROOT_FLAG_DESCRIPTORS_VOLATILE | ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE },
+        { RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE, true, ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE,
+            ROOT_FLAG_DESCRIPTORS_VOLATILE | ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE },
+        { RootDataVolatility::VOLATILE, true, ROOT_FLAG_DATA_VOLATILE, ROOT_FLAG_DESCRIPTORS_VOLATILE | ROOT_FLAG_DATA_VOLATILE }
+    };
+    for (auto const& expected : EXPECTED_FLAGS)
+    {
+        RootConstantBufferBinding binding = bindings[0];
+        binding.volatility = expected.volatility;
+        binding.descriptorsVolatile = expected.descriptorsVolatile;
+        const uint32_t rangeFlags = GetRootParameterFlags(binding, RootParameterKind::DESCRIPTOR_TABLE);
+        if (GetRootParameterFlags(binding, RootParameterKind::ROOT_CONSTANTS) != ROOT_FLAG_NONE ||
+            GetRootParameterFlags(binding, RootParameterKind::ROOT_CBV) != expected.rootDescriptorFlags || rangeFlags != expected.descriptorRangeFlags ||
+            ((rangeFlags & ROOT_FLAG_DESCRIPTORS_VOLATILE) != 0 && (rangeFlags & ROOT_FLAG_DATA_STATIC) != 0))
+        {
+            fprintf(stderr, "Root signature: wrong flags for volatility %u with%s volatile descriptors\n", uint32_t(expected.volatility),
+                expected.descriptorsVolatile ? "" : "out");
+            return false;
+        }
+    }
+
+    // Cached blobs of tables with other flags are not reused.
+    RootConstantBufferBinding tableBinding = bindings[4];
+    RootParameterLayout tableLayout{ };
+    if (!DecideRootParameterLayout(&tableBinding, 1, 1, tableLayout) || tableLayout.kinds[0] != RootParameterKind::DESCRIPTOR_TABLE)
+    {
+        fputs("Root signature: a binding within one DWORD is not a table\n", stderr);
+        return false;
+    }
+    RootParameterDesc tableParameter{ };
+    RootDescriptorRange tableRange{ };
+    GetRootParameterDescs(&tableBinding, tableLayout, &tableParameter, &tableRange);
+    const uint64_t hash = HashRootParameterDescs(2, 0, &tableParameter, 1);
+    tableBinding.descriptorsVolatile = true;
+    GetRootParameterDescs(&tableBinding, tableLayout, &tableParameter, &tableRange);
+    if (tableParameter.rangeCount != 1 || tableParameter.ranges != &tableRange ||
+        GetDescriptorRangeFlags(tableRange.volatility, tableRange.descriptorsVolatile) !=
+            GetRootParameterFlags(tableBinding, RootParameterKind::DESCRIPTOR_TABLE))
+    {
+        fputs("Root signature: the table of a binding does not keep its flags\n", stderr);
+        return false;
+    }
+    if (HashRootParameterDescs(2, 0, &tableParameter, 1) == hash)
+    {
+        fputs("Root signature: the cache key ignores the descriptor volatility\n", stderr);
+        return false;
+    }
+
+    // A fixed layout like that of the mip generation: root constants and a table of a source SRV and the written UAVs
+    const RootDescriptorRange mipRanges[]{
+        {
+            .type = RootDescriptorRangeType::SRV,
+            .descriptorCount = 1,
+            .baseShaderRegister = 0,
+            .registerSpace = 0,
+            .offsetInDescriptorsFromTableStart = 0,
+            .volatility = RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE,
+            .descriptorsVolatile = false
+        },
+        {
+            .type = RootDescriptorRangeType::UAV,
+            .descriptorCount = 4,
+            .baseShaderRegister = 0,
+            .registerSpace = 0,
+            .offsetInDescriptorsFromTableStart = 1,
+            .volatility = RootDataVolatility::VOLATILE,
+            .descriptorsVolatile = false
+        }
+    };
+    RootParameterDesc fixedParameters[]{
+        {
+            .kind = RootParameterKind::ROOT_CONSTANTS,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 8,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        },
+        {
+            .kind = RootParameterKind::DESCRIPTOR_TABLE,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 0,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = mipRanges,
+            .rangeCount = (uint32_t)std::size(mipRanges)
+        },
+        {
+            .kind = RootParameterKind::ROOT_UAV,
+            .visibility = RootShaderVisibility::ALL,
+            .shaderRegister = 4,
+            .registerSpace = 0,
+            .sizeInDwords = 0,
+            .volatility = RootDataVolatility::VOLATILE,
+            .ranges = nullptr,
+            .rangeCount = 0
+        }
+    };
+    if (GetRootParameterDescDwordCount(fixedParameters, (uint32_t)std::size(fixedParameters)) != 8 + ROOT_DESCRIPTOR_TABLE_DWORD_COST + ROOT_DESCRIPTOR_DWORD_COST ||
+        GetRootParameterDescFlags(fixedParameters[0]) != ROOT_FLAG_NONE || GetRootParameterDescFlags(fixedParameters[1]) != ROOT_FLAG_NONE ||
+        GetRootParameterDescFlags(fixedParameters[2]) != ROOT_FLAG_DATA_VOLATILE)
+    {
+        fputs("Root signature: wrong size or flags of a fixed layout\n", stderr);
+        return false;
+    }
+
+    // Every field of a fixed layout is part of the cache key, down to the flags of a single range.
+    const uint64_t fixedHash = HashRootParameterDescs(2, 0, fixedParameters, (uint32_t)std::size(fixedParameters));
+    RootDescriptorRange changedRanges[std::size(mipRanges)]{ };
+    std::copy(std::begin(mipRanges), std::end(mipRanges), changedRanges);
+    changedRanges[0].descriptorsVolatile = true;
+    fixedParameters[1].ranges = changedRanges;
+    const uint64_t changedHash = HashRootParameterDescs(2, 0, fixedParameters, (uint32_t)std::size(fixedParameters));
+    fixedParameters[1].ranges = mipRanges;
+    fixedParameters[2].kind = RootParameterKind::ROOT_SRV;
+    if (changedHash == fixedHash || HashRootParameterDescs(2, 0, fixedParameters, (uint32_t)std::size(fixedParameters)) == fixedHash ||
+        HashRootParameterDescs(1, 0, fixedParameters, (uint32_t)std::size(fixedParameters)) == HashRootParameterDescs(2, 0, fixedParameters, (uint32_t)std::size(fixedParameters)))
+    {
+        fputs("Root signature: the cache key of a fixed layout ignores a range flag, a root parameter kind or the version\n", stderr);
+        return false;
+    }
+
+    printf("Root signature: %zu fixed and %u random layouts fit their budgets, with %u root constants, %u root CBVs and %u tables, and %zu flag combinations; "
+        "fixed layout cache keys cover their range flags\n",
+        std::size(EXPECTED_LAYOUTS), ROOT_SIGNATURE_CHECK_RANDOM_LAYOUT_COUNT, kindCounts[uint32_t(RootParameterKind::ROOT_CONSTANTS)],
+        kindCounts[uint32_t(RootParameterKind::ROOT_CBV)], kindCounts[uint32_t(RootParameterKind::DESCRIPTOR_TABLE)], std::size(EXPECTED_FLAGS));
+    return true;
+}
+
+// A reference-counted object standing for a COM interface. It records the order in which objects are destroyed.
+struct MockComObject
+{
+    uint32_t id;
+    uint64_t fenceValue;                    // of the last frame that uses it
+    uint32_t refCount;
+    uint32_t releaseCount;
+    std::vector<uint32_t>* destroyedIds;
+
+    auto AddRef() -> uint32_t { return ++refCount; }
+
+    auto Release() -> uint32_t
+    {
+        ++releaseCount;
+        if (--refCount == 0) {
+            destroyedIds->push_back(id);
+        }
+        return refCount;
+    }
+};
+
+struct MockComDerived : MockComObject { };
+
+struct FakeFence
+{
+    uint64_t completedValue;
+
+    auto GetCompletedValue() const -> uint64_t { return completedValue; }
+};
+
+// Copies, moves and resets of ComHandle keep the reference count right, and each object is destroyed exactly once.
+static auto CheckComHandle() -> bool
+{
+    std::vector<uint32_t> destroyedIds;
+    MockComDerived a{ { .id = 0, .fenceValue = 0, .refCount = 1, .releaseCount = 0, .destroyedIds = &destroyedIds } };
+    MockComDerived b{ { .id = 1, .fenceValue = 0, .refCount = 1, .releaseCount = 0, .destroyedIds = &destroyedIds } };
+    {
+        ComHandle<MockComDerived> first(&a);
+        ComHandle<MockComDerived> copy(first);
+        ComHandle<MockComDerived> other(&b);
+        if (a.refCount != 2 || copy.Get() != &a)
+        {
+            fprintf(stderr, "ComHandle: a copy holds %u references\n", a.refCount);
+            return false;
+        }
+
+        ComHandle<MockComDerived>& self = copy;
+        copy = self;
+        other = copy;                       // releases b
+        ComHandle<MockComDerived> moved(std::move(other));
+        ComHandle<MockComObject> base(std::move(moved));
+        if (a.refCount != 3 || b.refCount != 0 || other || moved || base.Get() != &a)
+        {
+            fprintf(stderr, "ComHandle: %u references after an assignment and moves, %u left on the replaced object\n", a.refCount, b.refCount);
+            return false;
+        }
+
+        MockComDerived* const detached = first.Detach();
+        ComHandle<MockComDerived> attached(detached);
+        *copy.ReleaseAndGetAddressOf() = nullptr;
+        if (a.refCount != 2 || first)
+        {
+            fprintf(stderr, "ComHandle: %u references after a detach and a release\n", a.refCount);
+            return false;
+        }
+    }
+    if (a.refCount != 0 || a.releaseCount != 3 || b.releaseCount != 1 || destroyedIds != std::vector<uint32_t>{ 1, 0 })
+    {
+        fprintf(stderr, "ComHandle: %u references and %u releases left at the end\n", a.refCount, a.releaseCount);
+        return false;
+    }
+    return true;
+}
+
+// Objects retired each frame, some of them late with the value of an earlier frame, are released in fence value order, at
+// most DEFERRED_RELEASE_CHECK_MAX_PER_FRAME a frame, and never before the fake fence reaches their value. A burst of
+// retirements is spread over the next frames, and `Flush` releases the rest.
+static auto CheckDeferredReleaseQueue() -> bool
+{
+    std::vector<uint32_t> destroyedIds;
+    std::vector<MockComObject> objects(DEFERRED_RELEASE_CHECK_OBJECT_COUNT);
+    DeferredReleaseQueue<ComHandle<MockComObject>> queue;
+    FakeFence fence{ 0 };
+    uint64_t fenceValue = 0;
+    uint32_t retiredCount = 0;
+    auto const retire = [&](uint64_t value) {
+        MockComObject& object = objects[retiredCount];
+        object = { .id = retiredCount, .fenceValue = value, .refCount = 1, .releaseCount = 0, .destroyedIds = &destroyedIds };
+        queue.Enqueue(ComHandle<MockComObject>(&object), value);
+        ++retiredCount;
+    };
+
+    size_t maxReleasedCount = 0;
+    for (uint32_t frame = 0; frame < DEFERRED_RELEASE_CHECK_FRAME_COUNT; ++frame)
+    {
+        ++fenceValue;
+        // One object a frame, a burst every 50 frames, and every 7th frame one retired late with an older value
+        const uint32_t count = frame % 50 == 0 ? 40 : 1;
+        for (uint32_t i = 0; i < count && retiredCount < objects.size(); ++i) {
+            retire(fenceValue);
+        }
+        if (frame % 7 == 0 && retiredCount < objects.size()) {
+            retire(fenceValue > 2 ? fenceValue - 2 : 1);
+        }
+
+        // The GPU completes the frame submitted DEFERRED_RELEASE_CHECK_GPU_LATENCY frames ago.
+        fence.completedValue = fenceValue > DEFERRED_RELEASE_CHECK_GPU_LATENCY ? fenceValue - DEFERRED_RELEASE_CHECK_GPU_LATENCY : 0;
+        const size_t destroyedCountBefore = destroyedIds.size();
+        const size_t releasedCount = queue.DrainCompleted(&fence, DEFERRED_RELEASE_CHECK_MAX_PER_FRAME);
+        maxReleasedCount = std::max(maxReleasedCount, releasedCount);
+        if (releasedCount > DEFERRED_RELEASE_CHECK_MAX_PER_FRAME || destroyedIds.size() - destroyedCountBefore != releasedCount)
+        {
+            fprintf(stderr, "Deferred release: %zu handles released in frame %u, %zu objects destroyed\n", releasedCount, frame,
+                destroyedIds.size() - destroyedCountBefore);
+            return false;
+        }
+        for (size_t i = destroyedCountBefore; i < destroyedIds.size(); ++i)
+        {
+            const MockComObject& object = objects[destroyedIds[i]];
+            if (object.fenceValue > fence.completedValue || (i > 0 && object.fenceValue < objects[destroyedIds[i - 1]].fenceValue))
+            {
+                fprintf(stderr, "Deferred release: object %u of fence value %llu released at completed value %llu\n", object.id,
+                    (unsigned long long)object.fenceValue, (unsigned long long)fence.completedValue);
+                return false;
+            }
+        }
+        // Anything completed is released unless the bound stopped it.
+        const bool completedLeft = std::any_of(objects.begin(), objects.begin() + retiredCount,
+            [&fence](const MockComObject& object) { return object.refCount > 0 && object.fenceValue <= fence.completedValue; });
+        if (completedLeft && releasedCount < DEFERRED_RELEASE_CHECK_MAX_PER_FRAME)
+        {
+            fprintf(stderr, "Deferred release: frame %u released %zu handles and left completed ones\n", frame, releasedCount);
+            return false;
+        }
+        if (queue.GetPendingCount() + destroyedIds.size() != retiredCount)
+        {
+            fprintf(stderr, "Deferred release: %zu pending and %zu released of %u retired\n", queue.GetPendingCount(), destroyedIds.size(), retiredCount);
+            return false;
+        }
+    }
+
+    const size_t pendingCount = queue.GetPendingCount();
+    if (queue.Drain(0) != 0 || queue.Flush() != pendingCount || queue.GetPendingCount() != 0 || queue.GetTotalReleasedCount() != retiredCount ||
+        destroyedIds.size() != retiredCount)
+    {
+        fprintf(stderr, "Deferred release: the flush left %zu pending, %zu released in total of %u\n", queue.GetPendingCount(),
+            queue.GetTotalReleasedCount(), retiredCount);
+        return false;
+    }
+    for (uint32_t i = 0; i < retiredCount; ++i)
+    {
+        if (objects[i].refCount != 0 || objects[i].releaseCount != 1)
+        {
+            fprintf(stderr, "Deferred release: object %u has %u references after %u releases\n", i, objects[i].refCount, objects[i].releaseCount);
+            return false;
+        }
+    }
+
+    printf("Deferred release: %u objects retired over %u frames released in fence order at most %zu a frame, %zu of them by the flush\n",
+        retiredCount, DEFERRED_RELEASE_CHECK_FRAME_COUNT, maxReleasedCount, pendingCount);
+    return true;
+}
+
+static auto RunDeferredReleaseCheck() -> bool
+{
+    return CheckComHandle() && CheckDeferredReleaseQueue();
+}
+
+// Drive the dynamic resolution controller with a model of the GPU frame time: a fixed cost plus a cost proportional to the
+// pixel count, with noise and a spike now and then. The scene load steps up and down between phases. In each phase, once
+// settled, the scale must hold without ping-ponging, keep the frame within budget unless it is at its lower bound, and not
+// give away more than the deadband and the step allow.
+static auto RunDynamicResolutionCheck() -> bool
+{
+    static constexpr struct
+    {
+        double fixedTime;           // in milliseconds, whatever the scale
+        double pixelTime;           // in milliseconds at scale 1
+    } PHASES[] = {
+        { 2.0, 8.0 }, { 2.0, 30.0 }, { 2.0, 18.0 }, { 3.0, 80.0 }, { 2.0, 12.0 }, { 1.0, 24.0 }
+    };
+    const DynamicResolutionSettings settings = GetDefaultDynamicResolutionSettings(DYNAMIC_RESOLUTION_CHECK_BUDGET);
+    DynamicResolutionController controller(settings);
+
+    uint32_t seed = 0x13579bdU;
+    auto const nextNoise = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (double(seed >> 8) / double(1U << 24) * 2.0 - 1.0) * DYNAMIC_RESOLUTION_CHECK_NOISE;
+    };
+
+    uint32_t frame = 0;
+    for (size_t phaseIndex = 0; phaseIndex < std::size(PHASES); ++phaseIndex)
+    {
+        auto const& phase = PHASES[phaseIndex];
+        auto const modelFrameTime = [&phase](double scale) { return phase.fixedTime + phase.pixelTime * scale * scale; };
+
+        uint32_t lastChangeFrame = 0;
+        uint32_t steadyChangeCount = 0;
+        uint32_t reversalCount = 0;
+        int lastDirection = 0;
+        double steadyFrameTime = 0.0;
+        for (uint32_t phaseFrame = 0; phaseFrame < DYNAMIC_RESOLUTION_CHECK_PHASE_FRAME_COUNT; ++phaseFrame, ++frame)
+        {
+            const double scale = controller.GetScale();
+            double frameTime = modelFrameTime(scale) * (1.0 + nextNoise());
+            if (frame % DYNAMIC_RESOLUTION_CHECK_SPIKE_INTERVAL == 0) {
+                frameTime *= 2.0;
+            }
+
+            const double newScale = controller.Update(frameTime);
+            if (newScale < settings.minScale || newScale > settings.maxScale)
+            {
+                fprintf(stderr, "Dynamic resolution: scale %.3f out of [%.3f, %.3f]\n", newScale, settings.minScale, settings.maxScale);
+                return false;
+            }
+            if (newScale != scale)
+            {
+                // A reversal is a change against the direction of the previous one.
+                const int direction = newScale > scale ? 1 : -1;
+                if (lastDirection != 0 && direction != lastDirection) {
+                    ++reversalCount;
+                }
+                lastDirection = direction;
+                lastChangeFrame = phaseFrame;
+                if (phaseFrame >= DYNAMIC_RESOLUTION_CHECK_SETTLE_FRAME_COUNT) {
+                    ++steadyChangeCount;
+                }
+            }
+            if (phaseFrame >= DYNAMIC_RESOLUTION_CHECK_SETTLE_FRAME_COUNT) {
+                steadyFrameTime += modelFrameTime(newScale);
+            }
+        }
+        steadyFrameTime /= double(DYNAMIC_RESOLUTION_CHECK_PHASE_FRAME_COUNT - DYNAMIC_RESOLUTION_CHECK_SETTLE_FRAME_COUNT);
+
+        const double scale = controller.GetScale();
+        const bool atMinScale = scale == settings.minScale;
+        const bool atMaxScale = scale == settings.maxScale;
+        // The frame time one step up, which the controller should have taken if it still fit the aim with the deadband
+        const double stepUpFrameTime = modelFrameTime(scale + settings.scaleStep);
+        const double aimFrameTime = settings.targetFrameTime * settings.headroom;
+        if (steadyChangeCount > DYNAMIC_RESOLUTION_CHECK_MAX_STEADY_CHANGES || reversalCount > DYNAMIC_RESOLUTION_CHECK_MAX_REVERSALS)
+        {
+            fprintf(stderr, "Dynamic resolution: phase %zu changed the scale %u times once settled, with %u reversals\n", phaseIndex,
+                steadyChangeCount, reversalCount);
+            return false;
+        }
+        if (steadyFrameTime > settings.targetFrameTime && !atMinScale)
+        {
+            fprintf(stderr, "Dynamic resolution: phase %zu settled at scale %.3f over budget, %.3f ms\n", phaseIndex, scale, steadyFrameTime);
+            return false;
+        }
+        if (!atMaxScale && stepUpFrameTime < aimFrameTime * (1.0 - settings.deadband) * (1.0 - settings.deadband))
+        {
+            fprintf(stderr, "Dynamic resolution: phase %zu settled at scale %.3f, %.3f ms, though one step up would take %.3f ms\n", phaseIndex,
+                scale, steadyFrameTime, stepUpFrameTime);
+            return false;
+        }
+        printf("Dynamic resolution phase %zu: settled at scale %.3f, %.2f ms of %.2f, last change in frame %u, %u once settled\n", phaseIndex, scale,
+            steadyFrameTime, settings.targetFrameTime, lastChangeFrame, steadyChangeCount);
+    }
+    printf("Dynamic resolution: %u scale changes over %u frames\n", controller.GetChangeCount(), frame);
+    return true;
+}
+
+// The buffer heap policy of discrete, UMA and cache-coherent UMA devices, with the heap of each path they support, and the
+// CUSTOM heap properties a device accepts.
+static auto RunBufferPolicyCheck() -> bool
+{
+    static constexpr struct
+    {
+        const char* name;
+        DeviceMemoryCaps caps;
+    } DEVICES[] = {
+        { "discrete", { .uma = false, .cacheCoherentUMA = false } },
+        { "discrete (with the cache-coherent flag)", { .uma = false, .cacheCoherentUMA = true } },
+        { "UMA", { .uma = true, .cacheCoherentUMA = false } },
+        { "cache-coherent UMA", { .uma = true, .cacheCoherentUMA = true } }
+    };
+    static constexpr const char* PAGE_PROPERTY_NAMES[] = { "not available", "write-combine", "write-back" };
+
+    for (auto const& device : DEVICES)
+    {
+        auto const& caps = device.caps;
+        const BufferHeapPolicy chosen = ChooseBufferHeapPolicy(caps);
+        if (chosen.path != (caps.uma ? BufferMemoryPath::ZERO_COPY : BufferMemoryPath::STAGED) ||
+            !IsBufferMemoryPathSupported(caps, BufferMemoryPath::STAGED) || IsBufferMemoryPathSupported(caps, BufferMemoryPath::ZERO_COPY) != caps.uma)
+        {
+            fprintf(stderr, "Buffer policy: a %s device chose the %s path\n", device.name, GetBufferMemoryPathName(chosen.path));
+            return false;
+        }
+
+        for (uint32_t pathIndex = 0; pathIndex < uint32_t(BufferMemoryPath::COUNT); ++pathIndex)
+        {
+            const auto path = BufferMemoryPath(pathIndex);
+            if (!IsBufferMemoryPathSupported(caps, path)) continue;
+
+            const BufferHeapPolicy policy = GetBufferHeapPolicy(caps, path);
+            const BufferHeapDesc heap = GetCpuWrittenHeapDesc(policy);
+            bool expected = policy.path == path && IsCustomBufferHeapValid(caps, heap);
+            if (path == BufferMemoryPath::STAGED)
+            {
+                // The staging buffer is an UPLOAD heap, copied into video memory on a discrete GPU.
+                expected = expected && heap.type == BufferHeapType::UPLOAD && heap.genericReadOnly &&
+                    policy.memoryPool == (caps.uma ? BufferMemoryPool::L0 : BufferMemoryPool::L1);
+            }
+            else
+            {
+                // Consumed in place from a CPU-visible CUSTOM heap in system memory, with write-back pages only if snooped
+                expected = expected && heap.type == BufferHeapType::CUSTOM && !heap.genericReadOnly && heap.memoryPool == BufferMemoryPool::L0 &&
+                    heap.cpuPageProperty == (caps.cacheCoherentUMA ? BufferCpuPageProperty::WRITE_BACK : BufferCpuPageProperty::WRITE_COMBINE);
+            }
+            if (!expected)
+            {
+                fprintf(stderr, "Buffer policy: wrong heap for the %s path of a %s device: type %u, %s pages in L%u\n", GetBufferMemoryPathName(path),
+                    device.name, uint32_t(heap.type), PAGE_PROPERTY_NAMES[uint32_t(heap.cpuPageProperty)], uint32_t(heap.memoryPool));
+                return false;
+            }
+        }
+
+        auto const customHeap = [](BufferCpuPageProperty cpuPageProperty, BufferMemoryPool memoryPool) {
+            return BufferHeapDesc{ .type = BufferHeapType::CUSTOM, .cpuPageProperty = cpuPageProperty, .memoryPool = memoryPool, .genericReadOnly = false };
+        };
+        const bool customHeapsValid =
+            IsCustomBufferHeapValid(caps, customHeap(BufferCpuPageProperty::WRITE_COMBINE, BufferMemoryPool::L0)) &&
+            IsCustomBufferHeapValid(caps, customHeap(BufferCpuPageProperty::WRITE_BACK, BufferMemoryPool::L0)) == (caps.uma && caps.cacheCoherentUMA) &&
+            IsCustomBufferHeapValid(caps, customHeap(BufferCpuPageProperty::NOT_AVAILABLE, BufferMemoryPool::L1)) == !caps.uma &&
+            !IsCustomBufferHeapValid(caps, customHeap(BufferCpuPageProperty::WRITE_COMBINE, BufferMemoryPool::L1));
+        if (!customHeapsValid)
+        {
+            fprintf(stderr, "Buffer policy: wrong CUSTOM heap validity on a %s device\n", device.name);
+            return false;
+        }
+
+        const BufferHeapDesc chosenHeap = GetCpuWrittenHeapDesc(chosen);
+        if (chosenHeap.type == BufferHeapType::CUSTOM)
+        {
+            printf("Buffer policy of a %s device: %s path, the CPU writes %s pages of a CUSTOM heap in L%u\n", device.name,
+                GetBufferMemoryPathName(chosen.path), PAGE_PROPERTY_NAMES[uint32_t(chosenHeap.cpuPageProperty)], uint32_t(chosenHeap.memoryPool));
+        }
+        else {
+            printf("Buffer policy of a %s device: %s path, the CPU writes an UPLOAD heap copied into L%u\n", device.name,
+                GetBufferMemoryPathName(chosen.path), uint32_t(chosen.memoryPool));
+        }
+    }
+    return true;
+}
+
+// The kernel variants chosen for each wave lane count keep their groups within the limits the shaders assume.
+static auto ValidateComputePrimitiveConfigs() -> bool
+{
+    for (uint32_t waveLaneCount = 1; waveLaneCount <= 256; waveLaneCount *= 2)
+    {
+        for (const bool waveOpsSupported : { false, true })
+        {
+            const ComputePrimitiveConfig config = ChooseComputePrimitiveConfig(waveLaneCount, waveOpsSupported);
+            const bool valid = config.groupSize % config.waveSize == 0 && config.groupSize <= COMPUTE_PRIMITIVE_MAX_GROUP_SIZE &&
+                config.groupSize >= RADIX_SORT_DIGIT_COUNT && config.useWaveIntrinsics == (waveOpsSupported && waveLaneCount >= 4) &&
+                (!config.useWaveIntrinsics || (config.waveSize <= waveLaneCount && config.groupSize <= config.waveSize * config.waveSize));
+            if (!valid)
+            {
+                fprintf(stderr, "Compute primitives: a group of %u threads in waves of %u for %u lanes%s\n", config.groupSize, config.waveSize,
+                    waveLaneCount, waveOpsSupported ? " with wave intrinsics" : "");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Check the CPU references against the std:: algorithms on `input`, with each thread count.
+static auto CheckComputePrimitiveReferences(const std::vector<uint32_t>& input, const uint32_t threadCounts[], size_t threadCountCount) -> bool
+{
+    const size_t count = input.size();
+    std::vector<uint32_t> expected(count);
+    std::vector<uint32_t> output(count);
+
+    const uint32_t expectedSum = std::accumulate(input.begin(), input.end(), 0U);
+    std::vector<uint32_t> expectedInclusive(count);
+    std::vector<uint32_t> expectedExclusive(count);
+    std::inclusive_scan(input.begin(), input.end(), expectedInclusive.begin());
+    std::exclusive_scan(input.begin(), input.end(), expectedExclusive.begin(), 0U);
+    std::vector<uint32_t> expectedCompacted;
+    std::copy_if(input.begin(), input.end(), std::back_inserter(expectedCompacted), IsCompactedElement);
+    std::vector<uint32_t> expectedSorted = input;
+    std::stable_sort(expectedSorted.begin(), expectedSorted.end());
+
+    for (size_t t = 0; t < threadCountCount; ++t)
+    {
+        const uint32_t threadCount = threadCounts[t];
+        const char* failure = nullptr;
+        if (ReduceSumReference(input.data(), count, threadCount) != expectedSum) {
+            failure = "reduction";
+        }
+        else if (PrefixSumReference(input.data(), output.data(), count, false, threadCount) != expectedSum || output != expectedInclusive) {
+            failure = "inclusive prefix sum";
+        }
+        else if (PrefixSumReference(input.data(), output.data(), count, true, threadCount) != expectedSum || output != expectedExclusive) {
+            failure = "exclusive prefix sum";
+        }
+        else if (CompactReference(input.data(), output.data(), count, threadCount) != expectedCompacted.size() ||
+            !std::equal(expectedCompacted.begin(), expectedCompacted.end(), output.begin()))
+        {
+            failure = "stream compaction";
+        }
+        else
+        {
+            output = input;
+            RadixSortReference(output.data(), count, threadCount);
+            if (output != expectedSorted) {
+                failure = "radix sort";
+            }
+        }
+
+        if (failure != nullptr)
+        {
+            fprintf(stderr, "Compute primitives: the %s of %zu elements on %u threads differs from the std:: one\n", failure, count, threadCount);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check the CPU references of the compute primitives against the std:: algorithms, on empty and single element inputs and
+// on sizes around multiples of the group sizes, with wrapping sums and about a third of zeros to compact. Then measure their
+// throughput on one thread and on all of them, against the std:: algorithms.
+static auto RunComputePrimitiveBenchmark() -> bool
+{
+    if (!ValidateComputePrimitiveConfigs()) return false;
+
+    uint32_t seed = 0x9e3779b9U;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+    auto const makeInput = [&nextRandom](size_t count) {
+        std::vector<uint32_t> input(count);
+        for (auto& value : input) {
+            value = nextRandom() % 3 == 0 ? 0 : nextRandom();
+        }
+        return input;
+    };
+
+    const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), COMPUTE_BENCHMARK_MIN_THREAD_COUNT);
+    const uint32_t threadCounts[] = { 1, 3, threadCount, 64 };
+    std::vector<size_t> sizes{ 0, 1, 2, 3, 5, 17, 1000, 1000003 };
+    for (const uint32_t groupSize : { 16U, 64U, COMPUTE_PRIMITIVE_TARGET_GROUP_SIZE, COMPUTE_PRIMITIVE_MAX_GROUP_SIZE })
+    {
+        for (const size_t size : { size_t(groupSize) - 1, size_t(groupSize), size_t(groupSize) + 1, size_t(groupSize) * groupSize + 7 }) {
+            sizes.push_back(size);
+        }
+    }
+    for (const size_t size : sizes)
+    {
+        if (!CheckComputePrimitiveReferences(makeInput(size), threadCounts, std::size(threadCounts))) return false;
+    }
+    printf("Compute primitives: the CPU references match the std:: algorithms on %zu sizes from 0 to %zu, on up to %u threads\n", sizes.size(),
+        *std::max_element(sizes.begin(), sizes.end()), threadCounts[std::size(threadCounts) - 1]);
+
+    const std::vector<uint32_t> input = makeInput(COMPUTE_BENCHMARK_LARGE_COUNT);
+    std::vector<uint32_t> output(input.size());
+    auto const measure = [](auto&& run) {
+        double bestTime = INFINITY;
+        for (uint32_t iteration = 0; iteration < COMPUTE_BENCHMARK_ITERATION_COUNT; ++iteration)
+        {
+            const auto beginTime = std::chrono::steady_clock::now();
+            run();
+            bestTime = std::min(bestTime, std::chrono::duration<double>(std::chrono::steady_clock::now() - beginTime).count());
+        }
+        return double(COMPUTE_BENCHMARK_LARGE_COUNT) / bestTime / 1.0e6;
+    };
+
+    volatile uint32_t sink = 0;
+    const double rates[][3] = {
+        {
+            measure([&] { sink = std::accumulate(input.begin(), input.end(), 0U); }),
+            measure([&] { sink = ReduceSumReference(input.data(), input.size(), 1); }),
+            measure([&] { sink = ReduceSumReference(input.data(), input.size(), threadCount); })
+        },
+        {
+            measure([&] { std::exclusive_scan(input.begin(), input.end(), output.begin(), 0U); }),
+            measure([&] { sink = PrefixSumReference(input.data(), output.data(), input.size(), true, 1); }),
+            measure([&] { sink = PrefixSumReference(input.data(), output.data(), input.size(), true, threadCount); })
+        },
+        {
+            measure([&] { sink = uint32_t(std::copy_if(input.begin(), input.end(), output.begin(), IsCompactedElement) - output.begin()); }),
+            measure([&] { sink = uint32_t(CompactReference(input.data(), output.data(), input.size(), 1)); }),
+            measure([&] { sink = uint32_t(CompactReference(input.data(), output.data(), input.size(), threadCount)); })
+        },
+        {
+            measure([&] { output = input; std::stable_sort(output.begin(), output.end()); }),
+            measure([&] { output = input; RadixSortReference(output.data(), output.size(), 1); }),
+            measure([&] { output = input; RadixSortReference(output.data(), output.size(), threadCount); })
+        }
+    };
+    static constexpr const char* PRIMITIVE_NAMES[] = { "reduction", "exclusive prefix sum", "stream compaction", "radix sort" };
+    for (size_t primitive = 0; primitive < std::size(rates); ++primitive)
+    {
+        printf("Compute primitive %s of %u M elements: std:: %.0f M/s, reference on 1 thread %.0f M/s, on %u threads %.0f M/s\n",
+            PRIMITIVE_NAMES[primitive], COMPUTE_BENCHMARK_LARGE_COUNT >> 20, rates[primitive][0], rates[primitive][1], threadCount, rates[primitive][2]);
+    }
+    return true;
+}
+
+// The shares and bands of adapters of the given full frame costs, once they have all been measured
+static auto MeasureMultiAdapterShares(const double frameCosts[], uint32_t adapterCount, double shares[]) -> MultiAdapterLoadBalancer
+{
+    MultiAdapterLoadBalancer balancer(adapterCount);
+    for (uint32_t i = 0; i < adapterCount; ++i) {
+        balancer.ReportFrameTime(i, 1.0, frameCosts[i]);
+    }
+    balancer.GetShares(shares);
+    return balancer;
+}
+
+// Adapters of the given costs get shares in proportion to their speeds, except those raised to the minimum share, and the
+// shares add up to 1.
+static auto CheckMultiAdapterShares(const double frameCosts[], uint32_t adapterCount) -> bool
+{
+    double shares[MULTI_ADAPTER_MAX_COUNT]{ };
+    MeasureMultiAdapterShares(frameCosts, adapterCount, shares);
+
+    double shareSum = 0.0;
+    double speedSum = 0.0;
+    double unraisedShareSum = 0.0;
+    double unraisedSpeedSum = 0.0;
+    for (uint32_t i = 0; i < adapterCount; ++i)
+    {
+        shareSum += shares[i];
+        speedSum += 1.0 / frameCosts[i];
+        if (shares[i] < MULTI_ADAPTER_CHECK_MIN_SHARE - 1.0e-12)
+        {
+            fprintf(stderr, "Multi-adapter: adapter %u of %u has a share of %.4f, under the minimum\n", i, adapterCount, shares[i]);
+            return false;
+        }
+        if (shares[i] > MULTI_ADAPTER_CHECK_MIN_SHARE + 1.0e-12)
+        {
+            unraisedShareSum += shares[i];
+            unraisedSpeedSum += 1.0 / frameCosts[i];
+        }
+    }
+    if (std::fabs(shareSum - 1.0) > 1.0e-9)
+    {
+        fprintf(stderr, "Multi-adapter: the shares of %u adapters add up to %.6f\n", adapterCount, shareSum);
+        return false;
+    }
+    for (uint32_t i = 0; i < adapterCount; ++i)
+    {
+        // The others keep the proportions of their speeds, and an adapter at the minimum would be under it in that proportion.
+        const double speedShare = 1.0 / frameCosts[i] / speedSum;
+        const double proportionalShare = 1.0 / frameCosts[i] / unraisedSpeedSum * unraisedShareSum;
+        const bool raised = shares[i] <= MULTI_ADAPTER_CHECK_MIN_SHARE + 1.0e-12;
+        if ((raised && proportionalShare > MULTI_ADAPTER_CHECK_MIN_SHARE + 1.0e-12) || (!raised && std::fabs(shares[i] - proportionalShare) > 1.0e-9))
+        {
+            fprintf(stderr, "Multi-adapter: adapter %u of %u has a share of %.4f for a speed share of %.4f\n", i, adapterCount, shares[i], speedShare);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The bands of `rowCount` rows follow each other, their boundaries are aligned, and each is within half an alignment of its share.
+static auto CheckMultiAdapterSplitRows(const MultiAdapterLoadBalancer& balancer, uint32_t rowCount) -> bool
+{
+    const uint32_t adapterCount = balancer.GetAdapterCount();
+    double shares[MULTI_ADAPTER_MAX_COUNT]{ };
+    uint32_t rowBegins[MULTI_ADAPTER_MAX_COUNT + 1]{ };
+    balancer.GetShares(shares);
+    balancer.GetSplitRows(rowCount, MULTI_ADAPTER_CHECK_ROW_ALIGNMENT, rowBegins);
+
+    double accumulatedShare = 0.0;
+    for (uint32_t i = 0; i <= adapterCount; ++i)
+    {
+        const uint32_t row = rowBegins[i];
+        const double idealRow = accumulatedShare * double(rowCount);
+        const bool aligned = row % MULTI_ADAPTER_CHECK_ROW_ALIGNMENT == 0 || row == rowCount;
+        const bool ordered = i == 0 ? row == 0 : row >= rowBegins[i - 1];
+        const bool close = std::fabs(double(row) - idealRow) <= double(MULTI_ADAPTER_CHECK_ROW_ALIGNMENT) / 2.0 + 1.0 || row == rowCount;
+        if (!aligned || !ordered || !close || (i == adapterCount && row != rowCount))
+        {
+            fprintf(stderr, "Multi-adapter: band %u of %u of %u rows begins at row %u, for %.1f\n", i, adapterCount, rowCount, row, idealRow);
+            return false;
+        }
+        if (i < adapterCount) {
+            accumulatedShare += shares[i];
+        }
+    }
+    return true;
+}
+
+// Simulated adapters of different speeds render their bands of each frame, with noise, and report their times to the load
+// balancer. Their shares must converge to their speeds, and converge again after one of them slows down.
+static auto CheckMultiAdapterConvergence() -> bool
+{
+    double frameCosts[] = { 8.0, 12.0, 24.0 };     // milliseconds for a full frame
+    const auto adapterCount = uint32_t(std::size(frameCosts));
+    MultiAdapterLoadBalancer balancer(adapterCount);
+
+    uint32_t seed = 0xfeedbeefU;
+    auto const nextNoise = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (double(seed >> 8) / double(1U << 24) * 2.0 - 1.0) * MULTI_ADAPTER_CHECK_NOISE;
+    };
+
+    for (uint32_t phase = 0; phase < 2; ++phase)
+    {
+        if (phase == 1) {
+            frameCosts[0] = 30.0;       // the fastest adapter throttles
+        }
+        double speedSum = 0.0;
+        for (auto const frameCost : frameCosts) {
+            speedSum += 1.0 / frameCost;
+        }
+
+        uint32_t convergedFrame = 0;
+        double frameTime = 0.0;
+        for (uint32_t frame = 0; frame < MULTI_ADAPTER_CHECK_PHASE_FRAME_COUNT; ++frame)
+        {
+            uint32_t rowBegins[MULTI_ADAPTER_MAX_COUNT + 1]{ };
+            balancer.GetSplitRows(MULTI_ADAPTER_CHECK_ROW_COUNT, MULTI_ADAPTER_CHECK_ROW_ALIGNMENT, rowBegins);
+
+            double shares[MULTI_ADAPTER_MAX_COUNT]{ };
+            balancer.GetShares(shares);
+            bool converged = true;
+            frameTime = 0.0;
+            for (uint32_t i = 0; i < adapterCount; ++i)
+            {
+                converged = converged && std::fabs(shares[i] - 1.0 / frameCosts[i] / speedSum) <= MULTI_ADAPTER_CHECK_SHARE_TOLERANCE;
+
+                const uint32_t rowCount = rowBegins[i + 1] - rowBegins[i];
+                const double share = double(rowCount) / double(MULTI_ADAPTER_CHECK_ROW_COUNT);
+                const double time = frameCosts[i] * share * (1.0 + nextNoise());
+                frameTime = std::max(frameTime, time);
+                balancer.ReportFrameTime(i, share, time);
+            }
+            if (!converged) {
+                convergedFrame = frame + 1;
+            }
+        }
+
+        // The frame takes as long as the slowest band; with all the work on perfectly balanced adapters, it would take this.
+        const double balancedFrameTime = 1.0 / speedSum;
+        if (convergedFrame > MULTI_ADAPTER_CHECK_MAX_CONVERGENCE_FRAME_COUNT)
+        {
+            fprintf(stderr, "Multi-adapter: the shares of phase %u were still off by more than %.2f in frame %u\n", phase,
+                MULTI_ADAPTER_CHECK_SHARE_TOLERANCE, convergedFrame - 1);
+            return false;
+        }
+        printf("Multi-adapter phase %u: the shares of adapters of %.0f, %.0f and %.0f ms converged in %u frames, frame time %.2f ms for %.2f ms balanced\n",
+            phase, frameCosts[0], frameCosts[1], frameCosts[2], convergedFrame, frameTime, balancedFrameTime);
+    }
+    return true;
+}
+
+static auto RunMultiAdapterCheck() -> bool
+{
+    if (!CheckMultiAdapterConvergence()) return false;
+
+    // Fixed cases: a very slow adapter raised to the minimum share, and one whose share only falls under the minimum once
+    // another has been raised.
+    static constexpr double FIXED_COSTS[][MULTI_ADAPTER_MAX_COUNT] = {
+        { 1.0, 1000.0 }, { 1.0 / 0.052, 100.0, 1.0 / 0.938 }, { 1.0, 1.0, 1.0, 1.0 }, { 5.0, 50.0, 500.0, 5000.0 }
+    };
+    static constexpr uint32_t FIXED_COUNTS[] = { 2, 3, 4, 4 };
+    uint32_t raisedCount = 0;
+    for (size_t i = 0; i < std::size(FIXED_COSTS); ++i)
+    {
+        if (!CheckMultiAdapterShares(FIXED_COSTS[i], FIXED_COUNTS[i])) return false;
+
+        double shares[MULTI_ADAPTER_MAX_COUNT]{ };
+        MeasureMultiAdapterShares(FIXED_COSTS[i], FIXED_COUNTS[i], shares);
+        raisedCount += uint32_t(std::count_if(shares, shares + FIXED_COUNTS[i], [](double share) { return share <= MULTI_ADAPTER_CHECK_MIN_SHARE + 1.0e-12; }));
+    }
+
+    // Random adapters, with the bands of a few heights
+    uint32_t seed = 0x31415926U;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+    static constexpr uint32_t ROW_COUNTS[] = { 640, 639, 1080, 7, 1 };
+    for (uint32_t iteration = 0; iteration < MULTI_ADAPTER_CHECK_RANDOM_COUNT; ++iteration)
+    {
+        const uint32_t adapterCount = 1 + nextRandom() % MULTI_ADAPTER_MAX_COUNT;
+        double frameCosts[MULTI_ADAPTER_MAX_COUNT]{ };
+        for (uint32_t i = 0; i < adapterCount; ++i) {
+            frameCosts[i] = 0.5 * std::pow(1000.0, double(nextRandom() >> 8) / double(1U << 24));     // 0.5 to 500 ms
+        }
+        if (!CheckMultiAdapterShares(frameCosts, adapterCount)) return false;
+
+        double shares[MULTI_ADAPTER_MAX_COUNT]{ };
+        const MultiAdapterLoadBalancer balancer = MeasureMultiAdapterShares(frameCosts, adapterCount, shares);
+        for (const uint32_t rowCount : ROW_COUNTS)
+        {
+            if (!CheckMultiAdapterSplitRows(balancer, rowCount)) return false;
+        }
+    }
+    printf("Multi-adapter: %zu fixed and %u random sets of adapters share frames in proportion to their speeds, %u raised to the minimum share, "
+        "in bands aligned to %u rows\n", std::size(FIXED_COSTS), MULTI_ADAPTER_CHECK_RANDOM_COUNT, raisedCount, MULTI_ADAPTER_CHECK_ROW_ALIGNMENT);
+    return true;
+}
+
+// Creates and destroys the pairs of the command list pool as numbered objects, and tracks which of them are live.
+struct MockCommandListDevice
+{
+    using Allocator = uint32_t;
+    using CommandList = uint32_t;
+
+    std::vector<bool> live;                 // indexed by the number of the pair
+    uint64_t destroyedCount;
+    bool destroyedTwice;
+
+    auto CreatePair(CommandQueueKind, Allocator& allocator, CommandList& commandList) -> bool
+    {
+        allocator = uint32_t(live.size());
+        commandList = allocator;
+        live.push_back(true);
+        return true;
+    }
+
+    auto DestroyPair(Allocator allocator, CommandList) -> void
+    {
+        destroyedTwice = destroyedTwice || !live[allocator];
+        live[allocator] = false;
+        ++destroyedCount;
+    }
+};
+
+// Frames acquire, submit and release command lists of each queue kind while a fake fence completes them up to
+// COMMAND_LIST_POOL_CHECK_GPU_LATENCY frames later. The warm-up runs at the full latency, so the steady load after it, which
+// keeps coming back to it, must not create any pair, and no pair may be handed out again before the fence reaches the value it was released with. After a spike
+// of direct command lists, the pairs it created are destroyed once idle for the limit, and only then.
+static auto RunCommandListPoolCheck() -> bool
+{
+    static constexpr uint32_t STEADY_LIST_COUNTS[] = { 2, 1, 1 };       // per frame, by queue kind
+    static constexpr uint32_t SPIKE_LIST_COUNTS[] = { 8, 1, 1 };
+    static_assert(std::size(STEADY_LIST_COUNTS) == size_t(CommandQueueKind::COUNT));
+
+    MockCommandListDevice device{ .live { }, .destroyedCount = 0, .destroyedTwice = false };
+    CommandListPool<MockCommandListDevice> pool(device, COMMAND_LIST_POOL_CHECK_IDLE_FRAME_LIMIT);
+    FakeFence fence{ 0 };
+    std::vector<uint64_t> releasedValues;   // by the number of the pair
+    std::vector<uint64_t> lastAcquiredFrames;
+    std::vector<CommandListPool<MockCommandListDevice>::Pair*> acquiredPairs;
+    uint64_t fenceValue = 0;
+    uint64_t frameIndex = 0;
+    uint32_t seed = 0x13579BDFU;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    // Run a frame and return false if the pool misbehaved. `latency` is the number of frames the fence lags behind.
+    auto const runFrame = [&](const uint32_t (&listCounts)[size_t(CommandQueueKind::COUNT)], uint64_t latency) -> bool {
+        acquiredPairs.clear();
+        for (size_t kind = 0; kind < size_t(CommandQueueKind::COUNT); ++kind)
+        {
+            for (uint32_t i = 0; i < listCounts[kind]; ++i)
+            {
+                auto* const pair = pool.AcquireCompleted(CommandQueueKind(kind), &fence);
+                if (pair == nullptr || pair->kind != CommandQueueKind(kind) || !device.live[pair->allocator])
+                {
+                    fprintf(stderr, "Command list pool: frame %llu got no live pair of kind %zu\n", (unsigned long long)frameIndex, kind);
+                    return false;
+                }
+                releasedValues.resize(device.live.size(), 0);
+                lastAcquiredFrames.resize(device.live.size(), 0);
+                if (releasedValues[pair->allocator] > fence.completedValue)
+                {
+                    fprintf(stderr, "Command list pool: pair %u released at fence value %llu handed out at completed value %llu\n", pair->allocator,
+                        (unsigned long long)releasedValues[pair->allocator], (unsigned long long)fence.completedValue);
+                    return false;
+                }
+                lastAcquiredFrames[pair->allocator] = frameIndex;
+                acquiredPairs.push_back(pair);
+            }
+        }
+
+        // Every 5th frame, the last command list is not submitted and goes back with a zero fence value.
+        ++fenceValue;
+        for (size_t i = 0; i < acquiredPairs.size(); ++i)
+        {
+            const uint64_t value = frameIndex % 5 == 0 && i + 1 == acquiredPairs.size() ? 0 : fenceValue;
+            releasedValues[acquiredPairs[i]->allocator] = value;
+            pool.Release(acquiredPairs[i], value);
+        }
+
+        fence.completedValue = std::max(fence.completedValue, fenceValue > latency ? fenceValue - latency : 0);
+        const uint64_t destroyedCountBefore = device.destroyedCount;
+        std::vector<bool> liveBefore = device.live;
+        pool.EndFrame(fence.completedValue);
+        ++frameIndex;
+        if (device.destroyedTwice)
+        {
+            fprintf(stderr, "Command list pool: a pair was destroyed twice\n");
+            return false;
+        }
+        for (uint32_t id = 0; id < liveBefore.size() && device.destroyedCount != destroyedCountBefore; ++id)
+        {
+            if (!liveBefore[id] || device.live[id]) continue;
+            if (releasedValues[id] > fence.completedValue || frameIndex - lastAcquiredFrames[id] <= COMMAND_LIST_POOL_CHECK_IDLE_FRAME_LIMIT)
+            {
+                fprintf(stderr, "Command list pool: pair %u destroyed %llu frames after its last use, released at fence value %llu, completed %llu\n",
+                    id, (unsigned long long)(frameIndex - lastAcquiredFrames[id]), (unsigned long long)releasedValues[id],
+                    (unsigned long long)fence.completedValue);
+                return false;
+            }
+        }
+        return true;
+    };
+    // Half of the frames complete a frame early, but the full latency keeps coming back well within the idle limit.
+    auto const randomLatency = [&nextRandom]() { return COMMAND_LIST_POOL_CHECK_GPU_LATENCY - nextRandom() % 2; };
+
+    for (uint32_t frame = 0; frame < COMMAND_LIST_POOL_CHECK_WARM_UP_FRAME_COUNT; ++frame)
+    {
+        if (!runFrame(STEADY_LIST_COUNTS, COMMAND_LIST_POOL_CHECK_GPU_LATENCY)) return false;
+    }
+    const size_t steadyPairCount = pool.GetPairCount();
+    const uint64_t warmUpCreatedCount = pool.GetCreatedCount();
+    for (uint32_t frame = 0; frame < COMMAND_LIST_POOL_CHECK_PHASE_FRAME_COUNT; ++frame)
+    {
+        if (!runFrame(STEADY_LIST_COUNTS, randomLatency())) return false;
+    }
+    if (pool.GetCreatedCount() != warmUpCreatedCount || pool.GetPairCount() != steadyPairCount)
+    {
+        fprintf(stderr, "Command list pool: %llu pairs created in the steady state after %llu in the warm-up, %zu pairs held\n",
+            (unsigned long long)(pool.GetCreatedCount() - warmUpCreatedCount), (unsigned long long)warmUpCreatedCount, pool.GetPairCount());
+        return false;
+    }
+
+    for (uint32_t frame = 0; frame < COMMAND_LIST_POOL_CHECK_SPIKE_FRAME_COUNT; ++frame)
+    {
+        if (!runFrame(SPIKE_LIST_COUNTS, COMMAND_LIST_POOL_CHECK_GPU_LATENCY)) return false;
+    }
+    const size_t spikePairCount = pool.GetPairCount();
+    const uint64_t spikeCreatedCount = pool.GetCreatedCount();
+    if (spikePairCount <= steadyPairCount)
+    {
+        fprintf(stderr, "Command list pool: the spike did not create any pair\n");
+        return false;
+    }
+
+    // The spike pairs are idle from the first frame after it, and must all be gone once the limit and the latency have passed.
+    uint32_t trimFrameCount = 0;
+    for (uint32_t frame = 0; frame < COMMAND_LIST_POOL_CHECK_PHASE_FRAME_COUNT; ++frame)
+    {
+        if (!runFrame(STEADY_LIST_COUNTS, randomLatency())) return false;
+        if (pool.GetPairCount() > steadyPairCount) {
+            trimFrameCount = frame + 1;
+        }
+    }
+    if (pool.GetCreatedCount() != spikeCreatedCount || pool.GetPairCount() != steadyPairCount ||
+        trimFrameCount > COMMAND_LIST_POOL_CHECK_IDLE_FRAME_LIMIT + COMMAND_LIST_POOL_CHECK_GPU_LATENCY + 1)
+    {
+        fprintf(stderr, "Command list pool: %zu pairs held %u frames after the spike, %zu before it, %llu created since\n", pool.GetPairCount(),
+            trimFrameCount, steadyPairCount, (unsigned long long)(pool.GetCreatedCount() - spikeCreatedCount));
+        return false;
+    }
+
+    pool.Clear();
+    if (pool.GetPairCount() != 0 || device.destroyedCount != device.live.size() || device.destroyedTwice ||
+        std::any_of(device.live.begin(), device.live.end(), [](bool live) { return live; }))
+    {
+        fprintf(stderr, "Command list pool: %llu of %zu pairs destroyed by the clear\n", (unsigned long long)device.destroyedCount, device.live.size());
+        return false;
+    }
+
+    printf("Command list pool: %zu pairs created in the warm-up, none after it, %zu after a spike held for %u frames past it, "
+        "%llu acquired in all\n", steadyPairCount, spikePairCount, trimFrameCount, (unsigned long long)pool.GetAcquiredCount());
+    return true;
+}
+
+// What a task of a random startup graph did when it ran
+struct StartupCheckTaskRecord
+{
+    std::vector<StartupTaskId> dependencies;
+    StartupTaskAffinity affinity;
+    bool fails;
+    uint32_t spinCount;
+    std::atomic<uint32_t> runCount;
+    uint64_t beginSequence;
+    uint64_t endSequence;
+    std::thread::id threadId;
+};
+
+// Random graphs of tasks, a few of them pinned to the main thread and a few failing, run with 0 to
+// STARTUP_TASK_CHECK_MAX_WORKER_COUNT workers. Each task must start after all of its dependencies have ended and run exactly
+// once, or never if one of them failed or was skipped; the pinned tasks must run on the thread calling `Run`; and the critical
+// path must match one computed from the dependencies and the measured times.
+static auto CheckStartupTaskGraphs() -> bool
+{
+    uint32_t seed = 0x0F1E2D3CU;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    uint64_t taskCount = 0;
+    uint64_t mainThreadTaskCount = 0;
+    uint64_t skippedCount = 0;
+    for (uint32_t graphIndex = 0; graphIndex < STARTUP_TASK_CHECK_GRAPH_COUNT; ++graphIndex)
+    {
+        const uint32_t graphTaskCount = 1 + nextRandom() % STARTUP_TASK_CHECK_MAX_TASK_COUNT;
+        const uint32_t workerCount = graphIndex % (STARTUP_TASK_CHECK_MAX_WORKER_COUNT + 1);
+        std::vector<StartupCheckTaskRecord> records(graphTaskCount);
+        std::atomic<uint64_t> sequence{ 0 };
+        StartupTaskGraph graph;
+        for (uint32_t i = 0; i < graphTaskCount; ++i)
+        {
+            StartupCheckTaskRecord& record = records[i];
+            for (uint32_t j = 0; j < i; ++j)
+            {
+                if (nextRandom() % 4 == 0) {
+                    record.dependencies.push_back(j);
+                }
+            }
+            record.affinity = nextRandom() % 5 == 0 ? StartupTaskAffinity::MAIN_THREAD : StartupTaskAffinity::ANY_THREAD;
+            record.fails = nextRandom() % 16 == 0;
+            record.spinCount = nextRandom() % 20000;
+            auto const run = [&record, &sequence] {
+                record.beginSequence = ++sequence;
+                record.threadId = std::this_thread::get_id();
+                ++record.runCount;
+                volatile uint32_t spin = 0;
+                for (uint32_t k = 0; k < record.spinCount; ++k) {
+                    spin = spin + k;
+                }
+                record.endSequence = ++sequence;
+                return !record.fails;
+            };
+            if (graph.AddTask("Task", run, record.dependencies, record.affinity) != i)
+            {
+                fprintf(stderr, "Startup tasks: task %u of graph %u was not added\n", i, graphIndex);
+                return false;
+            }
+        }
+        if (graph.AddTask("Invalid", [] { return true; }, { graphTaskCount + 1 }) != STARTUP_INVALID_TASK)
+        {
+            fprintf(stderr, "Startup tasks: a task depending on a later one was added\n");
+            return false;
+        }
+
+        const bool succeeded = graph.Run(workerCount);
+
+        // The tasks are in a topological order, so the expected states and the path times follow in one pass.
+        std::vector<StartupTaskState> expectedStates(graphTaskCount);
+        std::vector<double> pathTimes(graphTaskCount, 0.0);
+        double criticalPathTime = 0.0;
+        bool expectedSucceeded = true;
+        for (uint32_t i = 0; i < graphTaskCount; ++i)
+        {
+            const StartupCheckTaskRecord& record = records[i];
+            const bool blocked = std::any_of(record.dependencies.begin(), record.dependencies.end(),
+                [&expectedStates](StartupTaskId dependency) { return expectedStates[dependency] != StartupTaskState::SUCCEEDED; });
+            expectedStates[i] = blocked ? StartupTaskState::SKIPPED : record.fails ? StartupTaskState::FAILED : StartupTaskState::SUCCEEDED;
+            expectedSucceeded = expectedSucceeded && expectedStates[i] == StartupTaskState::SUCCEEDED;
+
+            const StartupTaskState state = graph.GetTaskState(i);
+            if (state != expectedStates[i] || record.runCount != (blocked ? 0U : 1U))
+            {
+                fprintf(stderr, "Startup tasks: task %u of graph %u ended in state %u instead of %u after %u runs\n", i, graphIndex,
+                    uint32_t(state), uint32_t(expectedStates[i]), record.runCount.load());
+                return false;
+            }
+            if (blocked)
+            {
+                ++skippedCount;
+                continue;
+            }
+
+            for (auto const dependency : record.dependencies)
+            {
+                if (records[dependency].endSequence >= record.beginSequence)
+                {
+                    fprintf(stderr, "Startup tasks: task %u of graph %u started before its dependency %u ended\n", i, graphIndex, dependency);
+                    return false;
+                }
+                pathTimes[i] = std::max(pathTimes[i], pathTimes[dependency]);
+            }
+            const StartupTaskTiming& timing = graph.GetTaskTiming(i);
+            pathTimes[i] += timing.endTime - timing.beginTime;
+            criticalPathTime = std::max(criticalPathTime, pathTimes[i]);
+
+            if (record.affinity == StartupTaskAffinity::MAIN_THREAD)
+            {
+                ++mainThreadTaskCount;
+                if (record.threadId != std::this_thread::get_id() || timing.threadIndex != 0)
+                {
+                    fprintf(stderr, "Startup tasks: main thread task %u of graph %u ran on thread %u\n", i, graphIndex, timing.threadIndex);
+                    return false;
+                }
+            }
+            if (timing.threadIndex > workerCount)
+            {
+                fprintf(stderr, "Startup tasks: task %u of graph %u ran on thread %u of %u workers\n", i, graphIndex, timing.threadIndex, workerCount);
+                return false;
+            }
+        }
+        taskCount += graphTaskCount;
+
+        if (succeeded != expectedSucceeded || std::abs(graph.GetCriticalPathTime() - criticalPathTime) > 1.0e-9 ||
+            graph.GetCriticalPathTime() > graph.GetSerialTime() + 1.0e-9 || graph.GetCriticalPathTime() > graph.GetTotalTime())
+        {
+            fprintf(stderr, "Startup tasks: graph %u %s, critical path %.6f ms instead of %.6f ms, serial %.6f ms, total %.6f ms\n", graphIndex,
+                succeeded ? "succeeded" : "failed", graph.GetCriticalPathTime(), criticalPathTime, graph.GetSerialTime(), graph.GetTotalTime());
+            return false;
+        }
+    }
+
+    printf("Startup tasks: %llu tasks in %u graphs ran after their dependencies, %llu of them on the main thread, %llu skipped after failures\n",
+        (unsigned long long)taskCount, STARTUP_TASK_CHECK_GRAPH_COUNT, (unsigned long long)mainThreadTaskCount, (unsigned long long)skippedCount);
+    return true;
+}
+
+// A graph whose critical path is known: two chains of sleeping tasks joined at the end, run with two workers. The critical path
+// is the longer chain, and the wall time lies between it and the serial time.
+static auto CheckStartupCriticalPath() -> bool
+{
+    static constexpr uint32_t LONG_CHAIN_TIME_COUNT = 4;    // in units of STARTUP_TASK_CHECK_TIME_UNIT, one task each
+    static constexpr uint32_t SHORT_CHAIN_TIME_COUNT = 2;
+
+    auto const sleepFor = [](uint32_t unitCount) {
+        return [unitCount] {
+            std::this_thread::sleep_for(STARTUP_TASK_CHECK_TIME_UNIT * unitCount);
+            return true;
+        };
+    };
+
+    StartupTaskGraph graph;
+    const StartupTaskId longTask = graph.AddTask("Long", sleepFor(1));
+    const StartupTaskId shortTask = graph.AddTask("Short", sleepFor(SHORT_CHAIN_TIME_COUNT));
+    StartupTaskId lastLongTask = longTask;
+    for (uint32_t i = 1; i < LONG_CHAIN_TIME_COUNT; ++i) {
+        lastLongTask = graph.AddTask("Long", sleepFor(1), { lastLongTask });
+    }
+    graph.AddTask("Join", sleepFor(1), { lastLongTask, shortTask }, StartupTaskAffinity::MAIN_THREAD);
+    if (!graph.Run(2)) return false;
+
+    const double unitTime = std::chrono::duration<double, std::milli>(STARTUP_TASK_CHECK_TIME_UNIT).count();
+    const double expectedTime = (LONG_CHAIN_TIME_COUNT + 1) * unitTime;
+    const double criticalPathTime = graph.GetCriticalPathTime();
+    // Sleeps only overshoot, but the long chain must stay the critical one.
+    if (criticalPathTime < expectedTime || criticalPathTime > expectedTime + SHORT_CHAIN_TIME_COUNT * unitTime ||
+        graph.GetTotalTime() < criticalPathTime || graph.GetSerialTime() < criticalPathTime + SHORT_CHAIN_TIME_COUNT * unitTime)
+    {
+        fprintf(stderr, "Startup tasks: critical path %.2f ms instead of %.2f ms, total %.2f ms, serial %.2f ms\n", criticalPathTime, expectedTime,
+            graph.GetTotalTime(), graph.GetSerialTime());
+        return false;
+    }
+
+    printf("Startup tasks: critical path %.2f ms for %.2f ms of sleeps on it, %.2f ms in all, %.2f ms serial\n", criticalPathTime, expectedTime,
+        graph.GetTotalTime(), graph.GetSerialTime());
+    return true;
+}
+
+static auto RunStartupTaskCheck() -> bool
+{
+    return CheckStartupTaskGraphs() && CheckStartupCriticalPath();
+}
+
+// Pages numbered resources in and out, and keeps its own count of the resident bytes.
+struct MockResidencyDevice
+{
+    using Resource = uint32_t;
+
+    std::vector<uint64_t> sizes;            // indexed by resource
+    std::vector<bool> resident;
+    std::vector<Resource> lastEvicted;
+    uint64_t residentBytes;
+    uint64_t evictedBytes;
+    uint64_t pagedInBytes;
+    uint64_t pageInCount;
+    bool pagedTwice;                        // a resident resource paged in, or an evicted one evicted
+
+    auto MakeResident(const Resource resources[], uint32_t count) -> bool
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            pagedTwice = pagedTwice || resident[resources[i]];
+            resident[resources[i]] = true;
+            residentBytes += sizes[resources[i]];
+            pagedInBytes += sizes[resources[i]];
+        }
+        pageInCount += count;
+        return true;
+    }
+
+    auto Evict(const Resource resources[], uint32_t count) -> bool
+    {
+        lastEvicted.assign(resources, resources + count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            pagedTwice = pagedTwice || !resident[resources[i]];
+            resident[resources[i]] = false;
+            residentBytes -= sizes[resources[i]];
+            evictedBytes += sizes[resources[i]];
+        }
+        return true;
+    }
+};
+
+// Frames use a window of resources that slides over all of them, plus a few at random, while the budget shrinks to less
+// than half of their size, then drops below what the frames in flight use, and resources are replaced now and then. Each trim must only evict resources no frame in flight
+// uses, the least recently used first and no more than needed to reach the target; the resources a frame uses must be resident
+// once it has paged them in; and the byte counts of ResidencyStats must match those of the mock device.
+static auto RunResidencyCheck() -> bool
+{
+    MockResidencyDevice device{ .sizes { }, .resident { }, .lastEvicted { }, .residentBytes = 0, .evictedBytes = 0, .pagedInBytes = 0,
+        .pageInCount = 0, .pagedTwice = false };
+    ResidencyManager<MockResidencyDevice> manager(device, RESIDENCY_CHECK_TARGET_BUDGET_FRACTION);
+    std::vector<ResidencyHandle> handles(RESIDENCY_CHECK_RESOURCE_COUNT);
+    std::vector<uint32_t> resourcesByHandle;
+    std::vector<uint64_t> lastUsedValues;   // indexed by resource
+    uint32_t seed = 0x7E57AB1EU;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+    auto const registerResource = [&](uint32_t slot) {
+        const auto resource = uint32_t(device.sizes.size());
+        device.sizes.push_back(uint64_t(64 + nextRandom() % 8128) * 1024);     // 64 KB to 8 MB
+        device.resident.push_back(true);
+        device.residentBytes += device.sizes.back();
+        lastUsedValues.push_back(0);
+        handles[slot] = manager.Register(resource, device.sizes.back());
+        resourcesByHandle.resize(std::max(resourcesByHandle.size(), size_t(handles[slot]) + 1));
+        resourcesByHandle[handles[slot]] = resource;
+    };
+    for (uint32_t slot = 0; slot < RESIDENCY_CHECK_RESOURCE_COUNT; ++slot) {
+        registerResource(slot);
+    }
+    const uint64_t initialBytes = device.residentBytes;
+
+    FakeFence fence{ 0 };
+    uint64_t fenceValue = 0;
+    uint64_t managedBytes = initialBytes;
+    uint32_t evictingTrimCount = 0;
+    uint32_t shortTrimCount = 0;            // that could not reach the target
+    uint64_t heldBudget = 0;
+    uint64_t heldResidentBytes = 0;
+    for (uint32_t frame = 0; frame < RESIDENCY_CHECK_FRAME_COUNT; ++frame)
+    {
+        // Every 25th frame, a resource of the window is replaced by a new one, evicted or not.
+        const uint32_t windowBegin = frame / 4 % RESIDENCY_CHECK_RESOURCE_COUNT;
+        if (frame % 25 == 0)
+        {
+            const uint32_t slot = (windowBegin + nextRandom() % RESIDENCY_CHECK_WINDOW_COUNT) % RESIDENCY_CHECK_RESOURCE_COUNT;
+            const uint32_t resource = resourcesByHandle[handles[slot]];
+            // Wait for the GPU as the application does before releasing a resource.
+            fence.completedValue = fenceValue;
+            manager.Unregister(handles[slot]);
+            managedBytes -= device.sizes[resource];
+            if (device.resident[resource])
+            {
+                device.resident[resource] = false;
+                device.residentBytes -= device.sizes[resource];
+            }
+            registerResource(slot);
+            managedBytes += device.sizes.back();
+        }
+
+        ++fenceValue;
+        std::vector<uint32_t> usedSlots;
+        for (uint32_t i = 0; i < RESIDENCY_CHECK_WINDOW_COUNT; ++i) {
+            usedSlots.push_back((windowBegin + i) % RESIDENCY_CHECK_RESOURCE_COUNT);
+        }
+        for (uint32_t i = 0; i < 4; ++i) {
+            usedSlots.push_back(nextRandom() % RESIDENCY_CHECK_RESOURCE_COUNT);
+        }
+        for (auto const slot : usedSlots)
+        {
+            const uint32_t resource = resourcesByHandle[handles[slot]];
+            manager.MarkUsed(handles[slot], fenceValue);
+            lastUsedValues[resource] = fenceValue;
+        }
+        if (!manager.MakeUsedResident()) return false;
+        for (auto const slot : usedSlots)
+        {
+            if (!device.resident[resourcesByHandle[handles[slot]]] || !manager.IsResident(handles[slot]))
+            {
+                fprintf(stderr, "Residency: frame %u uses slot %u that was not paged in\n", frame, slot);
+                return false;
+            }
+        }
+
+        // The budget shrinks over the first half of the check and holds, then drops below what the frames in flight use for
+        // the last quarter, where the trims can only evict part of the excess.
+        fence.completedValue = fenceValue > RESIDENCY_CHECK_GPU_LATENCY ? fenceValue - RESIDENCY_CHECK_GPU_LATENCY : 0;
+        const uint32_t pressureFrame = RESIDENCY_CHECK_FRAME_COUNT / 4 * 3;
+        const double progress = std::min(1.0, 2.0 * frame / RESIDENCY_CHECK_FRAME_COUNT);
+        const double budgetFraction = frame >= pressureFrame ? RESIDENCY_CHECK_PRESSURE_BUDGET_FRACTION :
+            1.2 - progress * (1.2 - RESIDENCY_CHECK_MIN_BUDGET_FRACTION);
+        const auto budget = uint64_t(double(initialBytes) * budgetFraction);
+        const ResidencyBudget residencyBudget{ .budget = budget, .currentUsage = device.residentBytes };
+        const auto targetUsage = uint64_t(double(budget) * RESIDENCY_CHECK_TARGET_BUDGET_FRACTION);
+
+        std::vector<uint32_t> candidates;
+        for (auto const handle : handles)
+        {
+            const uint32_t resource = resourcesByHandle[handle];
+            if (device.resident[resource] && lastUsedValues[resource] <= fence.completedValue) {
+                candidates.push_back(resource);
+            }
+        }
+
+        device.lastEvicted.clear();
+        const uint32_t evictedCount = manager.Trim(residencyBudget, fence.completedValue);
+        if (evictedCount != device.lastEvicted.size() || device.pagedTwice)
+        {
+            fprintf(stderr, "Residency: frame %u reported %u evictions for %zu\n", frame, evictedCount, device.lastEvicted.size());
+            return false;
+        }
+        if (evictedCount != 0) {
+            ++evictingTrimCount;
+        }
+        if (frame + 1 == pressureFrame)
+        {
+            heldBudget = budget;
+            heldResidentBytes = device.residentBytes;
+        }
+
+        uint64_t evictedBytes = 0;
+        uint64_t maxEvictedValue = 0;
+        for (auto const resource : device.lastEvicted)
+        {
+            if (lastUsedValues[resource] > fence.completedValue)
+            {
+                fprintf(stderr, "Residency: frame %u evicted a resource used at fence value %llu, completed %llu\n", frame,
+                    (unsigned long long)lastUsedValues[resource], (unsigned long long)fence.completedValue);
+                return false;
+            }
+            evictedBytes += device.sizes[resource];
+            maxEvictedValue = std::max(maxEvictedValue, lastUsedValues[resource]);
+        }
+        const uint64_t excessBytes = residencyBudget.currentUsage > targetUsage ? residencyBudget.currentUsage - targetUsage : 0;
+        const bool leastRecentlyUsed = std::all_of(candidates.begin(), candidates.end(),
+            [&](uint32_t resource) { return !device.resident[resource] || lastUsedValues[resource] >= maxEvictedValue; });
+        const bool enough = evictedBytes >= excessBytes || evictedCount == candidates.size();
+        const bool tooMany = evictedCount != 0 && evictedBytes - device.sizes[device.lastEvicted.back()] >= excessBytes;
+        if (evictedBytes < excessBytes) {
+            ++shortTrimCount;
+        }
+        if (!leastRecentlyUsed || !enough || tooMany)
+        {
+            fprintf(stderr, "Residency: frame %u evicted %u resources, %llu bytes for %llu over the target, %s\n", frame, evictedCount,
+                (unsigned long long)evictedBytes, (unsigned long long)excessBytes, leastRecentlyUsed ? "in LRU order" : "not in LRU order");
+            return false;
+        }
+
+        const ResidencyStats stats = manager.GetStats();
+        if (stats.residentBytes != device.residentBytes || stats.managedBytes != managedBytes || stats.evictedBytes != device.evictedBytes ||
+            stats.pagedInBytes != device.pagedInBytes || stats.pageInCount != device.pageInCount || stats.lastBudget.budget != budget)
+        {
+            fprintf(stderr, "Residency: frame %u stats count %llu resident, %llu managed, %llu evicted and %llu paged in bytes, "
+                "the device %llu, %llu, %llu and %llu\n", frame, (unsigned long long)stats.residentBytes, (unsigned long long)stats.managedBytes,
+                (unsigned long long)stats.evictedBytes, (unsigned long long)stats.pagedInBytes, (unsigned long long)device.residentBytes,
+                (unsigned long long)managedBytes, (unsigned long long)device.evictedBytes, (unsigned long long)device.pagedInBytes);
+            return false;
+        }
+    }
+
+    const ResidencyStats stats = manager.GetStats();
+    if (evictingTrimCount == 0 || shortTrimCount == 0 || device.pageInCount == 0 || heldResidentBytes > heldBudget)
+    {
+        fprintf(stderr, "Residency: %u trims evicted, %u of them short, %llu page-ins, %llu bytes resident for a budget of %llu\n",
+            evictingTrimCount, shortTrimCount, (unsigned long long)device.pageInCount, (unsigned long long)heldResidentBytes,
+            (unsigned long long)heldBudget);
+        return false;
+    }
+
+    printf("Residency: %u frames within a budget shrinking to %.0f%% then %.0f%% of the resources, %u trims evicted %llu resources in LRU "
+        "order, %u trims short of the target, %llu resources paged in again\n", RESIDENCY_CHECK_FRAME_COUNT,
+        RESIDENCY_CHECK_MIN_BUDGET_FRACTION * 100.0, RESIDENCY_CHECK_PRESSURE_BUDGET_FRACTION * 100.0, evictingTrimCount,
+        (unsigned long long)stats.evictionCount, shortTrimCount, (unsigned long long)stats.pageInCount);
+    return true;
+}
+
+// Query heaps and a readback buffer in memory. Timestamps take the value of `clock`, and each query is tagged with the fence
+// value of the frame that wrote it, so that reading a frame the GPU has not completed, or a slot mixing frames, is caught.
+struct FakeGpuProfilerDevice
+{
+    using CommandList = uint32_t;
+
+    uint64_t clock;
+    uint64_t fenceValue;                    // of the frame being recorded
+    const FakeFence* fence;
+    std::vector<uint64_t> timestamps;
+    std::vector<uint64_t> timestampFenceValues;
+    std::vector<GpuPipelineStatistics> statistics;
+    std::vector<uint64_t> statisticsFenceValues;
+    std::vector<bool> statisticsOpen;
+    std::vector<uint64_t> readbackTimestamps;
+    std::vector<uint64_t> readbackTimestampFenceValues;
+    std::vector<GpuPipelineStatistics> readbackStatistics;
+    std::vector<uint64_t> readbackStatisticsFenceValues;
+    int32_t markerDepth;
+    uint64_t markerCount;
+    bool misused;                           // unbalanced markers or statistics, or a read before the GPU was done
+
+    auto WriteTimestamp(CommandList, uint32_t queryIndex) -> void
+    {
+        timestamps[queryIndex] = clock;
+        timestampFenceValues[queryIndex] = fenceValue;
+    }
+
+    auto BeginPipelineStatistics(CommandList, uint32_t queryIndex) -> void
+    {
+        misused = misused || statisticsOpen[queryIndex];
+        statisticsOpen[queryIndex] = true;
+    }
+
+    // The statistics of a scope are derived from the clock when it ends.
+    auto EndPipelineStatistics(CommandList, uint32_t queryIndex) -> void
+    {
+        misused = misused || !statisticsOpen[queryIndex];
+        statisticsOpen[queryIndex] = false;
+        statistics[queryIndex] = GpuPipelineStatistics{ };
+        statistics[queryIndex].iaVertices = clock;
+        statistics[queryIndex].psInvocations = clock * 3;
+        statisticsFenceValues[queryIndex] = fenceValue;
+    }
+
+    auto BeginMarker(CommandList, const char*) -> void
+    {
+        ++markerDepth;
+        ++markerCount;
+    }
+
+    auto EndMarker(CommandList) -> void
+    {
+        misused = misused || markerDepth == 0;
+        --markerDepth;
+    }
+
+    auto ResolveQueries(CommandList, uint32_t firstTimestamp, uint32_t timestampCount, uint32_t firstStatistics, uint32_t statisticsCount) -> void
+    {
+        for (uint32_t i = firstTimestamp; i < firstTimestamp + timestampCount; ++i)
+        {
+            readbackTimestamps[i] = timestamps[i];
+            readbackTimestampFenceValues[i] = timestampFenceValues[i];
+        }
+        for (uint32_t i = firstStatistics; i < firstStatistics + statisticsCount; ++i)
+        {
+            readbackStatistics[i] = statistics[i];
+            readbackStatisticsFenceValues[i] = statisticsFenceValues[i];
+        }
+    }
+
+    auto ReadQueries(uint32_t firstTimestamp, uint32_t timestampCount, uint64_t timestampData[],
+        uint32_t firstStatistics, uint32_t statisticsCount, GpuPipelineStatistics statisticsData[]) -> bool
+    {
+        const uint64_t frameFenceValue = readbackTimestampFenceValues[firstTimestamp];
+        misused = misused || frameFenceValue > fence->completedValue;
+        for (uint32_t i = 0; i < timestampCount; ++i)
+        {
+            misused = misused || readbackTimestampFenceValues[firstTimestamp + i] != frameFenceValue;
+            timestampData[i] = readbackTimestamps[firstTimestamp + i];
+        }
+        for (uint32_t i = 0; i < statisticsCount; ++i)
+        {
+            misused = misused || readbackStatisticsFenceValues[firstStatistics + i] != frameFenceValue;
+            statisticsData[i] = readbackStatistics[firstStatistics + i];
+        }
+        return true;
+    }
+};
+
+struct ExpectedProfileScope
+{
+    const char* name;
+    uint32_t parent;
+    uint32_t depth;
+    uint64_t beginTick;
+    uint64_t endTick;
+};
+
+struct ExpectedProfileFrame
+{
+    uint64_t fenceValue;
+    uint64_t beginTick;
+    uint64_t endTick;
+    std::vector<ExpectedProfileScope> scopes;
+};
+
+// As the profiler converts the ticks, with zero for a clock that went backwards
+static auto GetExpectedProfileTime(uint64_t beginTick, uint64_t endTick) -> double
+{
+    return endTick > beginTick ? double(endTick - beginTick) * 1000.0 / double(GPU_PROFILER_CHECK_TIMESTAMP_FREQUENCY) : 0.0;
+}
+
+static auto IsSameProfileFrame(const GpuProfileFrame& frame, const ExpectedProfileFrame& expected) -> bool
+{
+    if (frame.fenceValue != expected.fenceValue || frame.frameTime != GetExpectedProfileTime(expected.beginTick, expected.endTick) ||
+        frame.scopes.size() != expected.scopes.size()) return false;
+
+    for (size_t i = 0; i < frame.scopes.size(); ++i)
+    {
+        const GpuProfileScope& scope = frame.scopes[i];
+        const ExpectedProfileScope& expectedScope = expected.scopes[i];
+        if (strcmp(scope.name, expectedScope.name) != 0 || scope.parent != expectedScope.parent || scope.depth != expectedScope.depth ||
+            scope.beginTime != GetExpectedProfileTime(expected.beginTick, expectedScope.beginTick) ||
+            scope.duration != GetExpectedProfileTime(expectedScope.beginTick, expectedScope.endTick) ||
+            scope.statistics.iaVertices != expectedScope.endTick || scope.statistics.psInvocations != expectedScope.endTick * 3) return false;
+    }
+    return true;
+}
+
+// Frames of random scope trees, often deeper than the capacity of a frame and sometimes left open, are profiled while a fake
+// fence completes them up to GPU_PROFILER_CHECK_MAX_GPU_LATENCY frames later, more than the slots in flight, and the GPU clock
+// goes backwards now and then. A frame must be dropped exactly when its slot is still pending, each frame read back must
+// match the scopes recorded, with the scopes beyond the capacity left out and the durations of the scopes the clock went
+// backwards in at zero, the markers of every scope must be closed at the end of the frame, profiled or not, and the summary
+// must hold the samples of every scope path read back.
+static auto RunGpuProfilerCheck() -> bool
+{
+    const uint32_t timestampCount = GpuProfiler<FakeGpuProfilerDevice>::GetTimestampQueryCount(GPU_PROFILER_CHECK_FRAME_SLOT_COUNT,
+        GPU_PROFILER_CHECK_MAX_SCOPE_COUNT);
+    const uint32_t statisticsCount = GpuProfiler<FakeGpuProfilerDevice>::GetStatisticsQueryCount(GPU_PROFILER_CHECK_FRAME_SLOT_COUNT,
+        GPU_PROFILER_CHECK_MAX_SCOPE_COUNT);
+    FakeFence fence{ 0 };
+    FakeGpuProfilerDevice device{ .clock = 1000 * 1000, .fenceValue = 0, .fence = &fence,
+        .timestamps = std::vector<uint64_t>(timestampCount), .timestampFenceValues = std::vector<uint64_t>(timestampCount),
+        .statistics = std::vector<GpuPipelineStatistics>(statisticsCount), .statisticsFenceValues = std::vector<uint64_t>(statisticsCount),
+        .statisticsOpen = std::vector<bool>(statisticsCount), .readbackTimestamps = std::vector<uint64_t>(timestampCount),
+        .readbackTimestampFenceValues = std::vector<uint64_t>(timestampCount), .readbackStatistics = std::vector<GpuPipelineStatistics>(statisticsCount),
+        .readbackStatisticsFenceValues = std::vector<uint64_t>(statisticsCount), .markerDepth = 0, .markerCount = 0, .misused = false };
+    GpuProfiler<FakeGpuProfilerDevice> profiler(device, GPU_PROFILER_CHECK_FRAME_SLOT_COUNT, GPU_PROFILER_CHECK_MAX_SCOPE_COUNT,
+        GPU_PROFILER_CHECK_TIMESTAMP_FREQUENCY);
+    uint32_t seed = 0x9E3779B9U;
+    auto const nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    // The GPU clock moves forwards, but jumps backwards once in a while.
+    uint64_t backwardTickCount = 0;
+    auto const advanceClock = [&]() {
+        if (nextRandom() % 64 == 0)
+        {
+            device.clock -= 5000;
+            ++backwardTickCount;
+        }
+        else {
+            device.clock += 1 + nextRandom() % 2000;
+        }
+    };
+
+    // The scopes of a frame as a list of names to begin, and null to end the innermost open scope
+    std::vector<const char*> operations;
+    auto const appendScope = [&](auto&& self, const char* name, uint32_t depth) -> void {
+        operations.push_back(name);
+        const uint32_t childCount = depth < 3 ? nextRandom() % 3 : 0;
+        for (uint32_t i = 0; i < childCount; ++i) {
+            self(self, GPU_PROFILER_CHECK_CHILD_SCOPE_NAMES[nextRandom() % std::size(GPU_PROFILER_CHECK_CHILD_SCOPE_NAMES)], depth + 1);
+        }
+        operations.push_back(nullptr);
+    };
+
+    // The summary expected from the frames read back, by scope path
+    struct ExpectedSummaryEntry
+    {
+        std::string path;
+        uint64_t sampleCount;
+        double totalTime;
+        double minTime;
+        double maxTime;
+        uint64_t iaVertices;
+        uint64_t psInvocations;
+    };
+    std::vector<ExpectedSummaryEntry> expectedSummary;
+    std::vector<ExpectedProfileFrame> profiledFrames;       // in submission order
+    size_t readFrameCount = 0;
+    auto const readExpectedFrames = [&](uint64_t completedValue) {
+        for (; readFrameCount < profiledFrames.size() && profiledFrames[readFrameCount].fenceValue <= completedValue; ++readFrameCount)
+        {
+            const ExpectedProfileFrame& frame = profiledFrames[readFrameCount];
+            std::vector<std::string> paths;
+            for (const ExpectedProfileScope& scope : frame.scopes)
+            {
+                paths.push_back(scope.parent == GPU_PROFILE_NO_PARENT ? std::string(scope.name) : paths[scope.parent] + "/" + scope.name);
+                auto entry = std::find_if(expectedSummary.begin(), expectedSummary.end(),
+                    [&paths](const ExpectedSummaryEntry& entry) { return entry.path == paths.back(); });
+                if (entry == expectedSummary.end()) {
+                    entry = expectedSummary.insert(expectedSummary.end(), ExpectedSummaryEntry{ .path = paths.back(), .sampleCount = 0,
+                        .totalTime = 0.0, .minTime = 0.0, .maxTime = 0.0, .iaVertices = 0, .psInvocations = 0 });
+                }
+                const double duration = GetExpectedProfileTime(scope.beginTick, scope.endTick);
+                entry->minTime = entry->sampleCount == 0 ? duration : std::min(entry->minTime, duration);
+                entry->maxTime = entry->sampleCount == 0 ? duration : std::max(entry->maxTime, duration);
+                ++entry->sampleCount;
+                entry->totalTime += duration;
+                entry->iaVertices += scope.endTick;
+                entry->psInvocations += scope.endTick * 3;
+            }
+        }
+    };
+
+    uint64_t fenceValue = 0;
+    uint64_t droppedCount = 0;
+    uint64_t overflowCount = 0;
+    uint64_t openFrameCount = 0;
+    for (uint32_t frame = 0; frame < GPU_PROFILER_CHECK_FRAME_COUNT; ++frame)
+    {
+        operations.clear();
+        const uint32_t topCount = 1 + nextRandom() % 4;
+        for (uint32_t i = 0; i < topCount; ++i) {
+            appendScope(appendScope, GPU_PROFILER_CHECK_TOP_SCOPE_NAMES[nextRandom() % std::size(GPU_PROFILER_CHECK_TOP_SCOPE_NAMES)], 0);
+        }
+        // Every 8th frame leaves its innermost scopes for EndFrame to close.
+        if (frame % 8 == 0)
+        {
+            ++openFrameCount;
+            for (uint32_t i = nextRandom() % 3; i > 0 && operations.back() == nullptr; --i) {
+                operations.pop_back();
+            }
+        }
+
+        ++fenceValue;
+        device.fenceValue = fenceValue;
+        advanceClock();
+        ExpectedProfileFrame expected{ .fenceValue = fenceValue, .beginTick = device.clock, .endTick = 0, .scopes { } };
+        const bool slotPending = profiledFrames.size() >= GPU_PROFILER_CHECK_FRAME_SLOT_COUNT &&
+            profiledFrames[profiledFrames.size() - GPU_PROFILER_CHECK_FRAME_SLOT_COUNT].fenceValue > fence.completedValue;
+        const bool profiled = profiler.BeginFrame(0, fenceValue, fence.completedValue);
+        readExpectedFrames(fence.completedValue);
+        droppedCount += profiled ? 0 : 1;
+        if (profiled == slotPending)
+        {
+            fprintf(stderr, "GPU profiler: frame %llu %s with the slot of frame %llu %s\n", (unsigned long long)fenceValue,
+                profiled ? "profiled" : "dropped", (unsigned long long)(profiledFrames.size() >= GPU_PROFILER_CHECK_FRAME_SLOT_COUNT ?
+                profiledFrames[profiledFrames.size() - GPU_PROFILER_CHECK_FRAME_SLOT_COUNT].fenceValue : 0), slotPending ? "pending" : "read back");
+            return false;
+        }
+
+        std::vector<uint32_t> scopeStack;
+        for (const char* name : operations)
+        {
+            advanceClock();
+            if (name != nullptr)
+            {
+                profiler.BeginScope(0, name);
+                if (!profiled) continue;
+                if (expected.scopes.size() == GPU_PROFILER_CHECK_MAX_SCOPE_COUNT)
+                {
+                    ++overflowCount;
+                    scopeStack.push_back(GPU_PROFILE_NO_PARENT);
+                    continue;
+                }
+                uint32_t parent = GPU_PROFILE_NO_PARENT;
+                for (auto open = scopeStack.rbegin(); open != scopeStack.rend() && parent == GPU_PROFILE_NO_PARENT; ++open) {
+                    parent = *open;
+                }
+                scopeStack.push_back(uint32_t(expected.scopes.size()));
+                expected.scopes.push_back(ExpectedProfileScope{ .name = name, .parent = parent,
+                    .depth = parent == GPU_PROFILE_NO_PARENT ? 0 : expected.scopes[parent].depth + 1, .beginTick = device.clock, .endTick = 0 });
+            }
+            else
+            {
+                profiler.EndScope(0);
+                if (!profiled) continue;
+                if (scopeStack.back() != GPU_PROFILE_NO_PARENT) {
+                    expected.scopes[scopeStack.back()].endTick = device.clock;
+                }
+                scopeStack.pop_back();
+            }
+        }
+
+        advanceClock();
+        for (auto const open : scopeStack)
+        {
+            if (open != GPU_PROFILE_NO_PARENT) {
+                expected.scopes[open].endTick = device.clock;
+            }
+        }
+        expected.endTick = device.clock;
+        profiler.EndFrame(0);
+        if (device.markerDepth != 0 || device.misused)
+        {
+            fprintf(stderr, "GPU profiler: frame %llu left %d markers open, or misused the queries\n", (unsigned long long)fenceValue, device.markerDepth);
+            return false;
+        }
+        if (profiled) {
+            profiledFrames.push_back(std::move(expected));
+        }
+
+        const GpuProfilerStats& stats = profiler.GetStats();
+        if (stats.profiledFrameCount != readFrameCount || stats.droppedFrameCount != droppedCount || stats.overflowScopeCount != overflowCount ||
+            stats.readFailureCount != 0 || (readFrameCount > 0 && !IsSameProfileFrame(profiler.GetLatestFrame(), profiledFrames[readFrameCount - 1])))
+        {
+            fprintf(stderr, "GPU profiler: after frame %llu, %llu frames read back instead of %zu, %llu dropped instead of %llu, %llu scopes overflowed "
+                "instead of %llu, or the latest frame read back differs\n", (unsigned long long)fenceValue, (unsigned long long)stats.profiledFrameCount,
+                readFrameCount, (unsigned long long)stats.droppedFrameCount, (unsigned long long)droppedCount,
+                (unsigned long long)stats.overflowScopeCount, (unsigned long long)overflowCount);
+            return false;
+        }
+
+        // The GPU completes the frames with a latency that sometimes exceeds the slots.
+        const uint64_t latency = nextRandom() % (GPU_PROFILER_CHECK_MAX_GPU_LATENCY + 1);
+        fence.completedValue = std::max(fence.completedValue, fenceValue > latency ? fenceValue - latency : 0);
+    }
+
+    fence.completedValue = fenceValue;
+    profiler.Collect(fence.completedValue);
+    readExpectedFrames(fence.completedValue);
+    if (readFrameCount != profiledFrames.size() || profiler.GetStats().profiledFrameCount != readFrameCount || device.misused ||
+        profiler.GetSummaryFrameCount() != readFrameCount)
+    {
+        fprintf(stderr, "GPU profiler: %llu frames read back of %zu profiled\n", (unsigned long long)profiler.GetStats().profiledFrameCount,
+            profiledFrames.size());
+        return false;
+    }
+
+    const std::vector<GpuProfileSummaryEntry>& summary = profiler.GetSummary();
+    std::vector<std::string> summaryPaths;
+    for (const GpuProfileSummaryEntry& entry : summary)
+    {
+        summaryPaths.push_back(entry.parent == GPU_PROFILE_NO_PARENT ? std::string(entry.name) : summaryPaths[entry.parent] + "/" + entry.name);
+        const std::string& path = summaryPaths.back();
+        auto const expectedEntry = std::find_if(expectedSummary.begin(), expectedSummary.end(),
+            [&path](const ExpectedSummaryEntry& expectedEntry) { return expectedEntry.path == path; });
+        if (expectedEntry == expectedSummary.end() || std::count(summaryPaths.begin(), summaryPaths.end(), path) != 1 ||
+            entry.depth != uint32_t(std::count(path.begin(), path.end(), '/')) || entry.sampleCount != expectedEntry->sampleCount ||
+            std::abs(entry.totalTime - expectedEntry->totalTime) > 1.0e-9 * expectedEntry->totalTime || entry.minTime != expectedEntry->minTime ||
+            entry.maxTime != expectedEntry->maxTime || entry.totalStatistics.iaVertices != expectedEntry->iaVertices ||
+            entry.totalStatistics.psInvocations != expectedEntry->psInvocations)
+        {
+            fprintf(stderr, "GPU profiler: summary entry %s with %llu samples does not match the frames read back\n", path.c_str(),
+                (unsigned long long)entry.sampleCount);
+            return false;
+        }
+    }
+    if (summary.size() != expectedSummary.size() || droppedCount == 0 || overflowCount == 0 || backwardTickCount == 0)
+    {
+        fprintf(stderr, "GPU profiler: %zu summary entries instead of %zu, %llu frames dropped, %llu scopes overflowed, %llu clock jumps\n",
+            summary.size(), expectedSummary.size(), (unsigned long long)droppedCount, (unsigned long long)overflowCount,
+            (unsigned long long)backwardTickCount);
+        return false;
+    }
+
+    printf("GPU profiler: %zu frames read back and %llu dropped with their slots pending, %llu scopes overflowed, %llu frames left scopes open, "
+        "the clock went back %llu times, %zu scope paths summarized\n", readFrameCount, (unsigned long long)droppedCount,
+        (unsigned long long)overflowCount, (unsigned long long)openFrameCount, (unsigned long long)backwardTickCount, summary.size());
+    return true;
+}
+
+auto main(int argc, const char* argv[]) -> int
+{
+    uint32_t frameCount = DEFAULT_FRAME_COUNT;
+    bool verbose = false;
+    bool depthPrepass = false;
+    bool drawPackets = false;
+    bool drawSortBenchmark = false;
+    bool particleBenchmark = false;
+    bool readbackBenchmark = false;
+    bool meshletBenchmark = false;
+    bool textureBenchmark = false;
+    bool mipBenchmark = false;
+    bool fenceBenchmark = false;
+    bool rootSignatureCheck = false;
+    bool deferredReleaseCheck = false;
+    bool dynamicResolutionCheck = false;
+    bool bufferPolicyCheck = false;
+    bool computePrimitiveBenchmark = false;
+    bool multiAdapterCheck = false;
+    bool commandListPoolCheck = false;
+    bool startupTaskCheck = false;
+    bool residencyCheck = false;
+    bool gpuProfilerCheck = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        }
+        else if (strcmp(argv[i], "--depth-prepass") == 0) {
+            depthPrepass = true;
+        }
+        else if (strcmp(argv[i], "--draw-packets") == 0) {
+            drawPackets = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-draw-sort") == 0) {
+            drawSortBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-particles") == 0) {
+            particleBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-readback") == 0) {
+            readbackBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-meshlets") == 0) {
+            meshletBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-textures") == 0) {
+            textureBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-mips") == 0) {
+            mipBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-fences") == 0) {
+            fenceBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--check-root-signature") == 0) {
+            rootSignatureCheck = true;
+        }
+        else if (strcmp(argv[i], "--check-deferred-release") == 0) {
+            deferredReleaseCheck = true;
+        }
+        else if (strcmp(argv[i], "--check-dynamic-resolution") == 0) {
+            dynamicResolutionCheck = true;
+        }
+        else if (strcmp(argv[i], "--check-buffer-policy") == 0) {
+            bufferPolicyCheck = true;
+        }
+        else if (strcmp(argv[i], "--benchmark-compute-primitives") == 0) {
+            computePrimitiveBenchmark = true;
+        }
+        else if (strcmp(argv[i], "--check-multi-adapter") == 0) {
+            multiAdapterCheck = true;
+        }
+        else if (strcmp(argv[i], "--check-command-list-pool") == 0) {
+            commandListPoolCheck = true;
+        }
+        else if (strcmp(argv[i], "--check-startup-tasks") == 0) {
+            startupTaskCheck = true;
+        }
+        else if (strcmp(argv[i], "--check-residency") == 0) {
+            residencyCheck = true;
+        }
+        else if (strcmp(argv[i], "--check-gpu-profiler") == 0) {
+            gpuProfilerCheck = true;
+        }
+        else
+        {
+            frameCount = uint32_t(std::strtoul(argv[i], nullptr, 10));
+            if (frameCount == 0) {
+                frameCount = DEFAULT_FRAME_COUNT;
+            }
+        }
+    }
+
+    if (particleBenchmark) return RunParticleBenchmark() ? 0 : 1;
+    if (readbackBenchmark) return RunReadbackBenchmark() ? 0 : 1;
+    if (meshletBenchmark) return RunMeshletBenchmark() ? 0 : 1;
+    if (textureBenchmark) return RunTextureStreamingBenchmark() ? 0 : 1;
+    if (mipBenchmark) return RunMipBenchmark() ? 0 : 1;
+    if (fenceBenchmark) return RunFenceReactorBenchmark() ? 0 : 1;
+    if (rootSignatureCheck) return RunRootSignatureCheck() ? 0 : 1;
+    if (deferredReleaseCheck) return RunDeferredReleaseCheck() ? 0 : 1;
+    if (dynamicResolutionCheck) return RunDynamicResolutionCheck() ? 0 : 1;
+    if (bufferPolicyCheck) return RunBufferPolicyCheck() ? 0 : 1;
+    if (computePrimitiveBenchmark) return RunComputePrimitiveBenchmark() ? 0 : 1;
+    if (multiAdapterCheck) return RunMultiAdapterCheck() ? 0 : 1;
+    if (commandListPoolCheck) return RunCommandListPoolCheck() ? 0 : 1;
+    if (startupTaskCheck) return RunStartupTaskCheck() ? 0 : 1;
+    if (residencyCheck) return RunResidencyCheck() ? 0 : 1;
+    if (gpuProfilerCheck) return RunGpuProfilerCheck() ? 0 : 1;
+
+    NullRenderDevice device;
+    RenderCommandQueue* const commandQueue = device.CreateCommandQueue();
+    RenderCommandList* const commandList = device.CreateCommandList(RenderCommandListType::DIRECT);
+    RenderFence* const fence = device.CreateFence(0);
+
+    RenderResourceId backBuffers[BACK_BUFFER_COUNT]{ };
+    for (auto& backBuffer : backBuffers) {
+        backBuffer = device.CreateRenderTarget(WINDOW_WIDTH, WINDOW_HEIGHT, RENDER_FORMAT_R8G8B8A8_UNORM, RENDER_RESOURCE_STATE_PRESENT);
+    }
+    const RenderResourceId depthTarget = device.CreateDepthTarget(WINDOW_WIDTH, WINDOW_HEIGHT, RENDER_FORMAT_D32_FLOAT, RENDER_RESOURCE_STATE_DEPTH_WRITE);
+    const RenderResourceId vertexBuffer = device.CreateBuffer(BASIC_SQUARE_VERTICES, sizeof(BASIC_SQUARE_VERTICES), RENDER_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+
+    if (drawSortBenchmark) return RunDrawSortBenchmark(device, *commandList, backBuffers[0]) ? 0 : 1;
+
+    const BasicBundleDesc bundleDesc{
+        .pipelineId = BASIC_SHADER_PERMUTATION_DEFAULT,
+        .vertexBuffer = vertexBuffer,
+        .vertexBufferSize = uint32_t(sizeof(BASIC_SQUARE_VERTICES)),
+        .vertexStride = uint32_t(sizeof(BASIC_SQUARE_VERTICES[0])),
+        .vertexCount = uint32_t(std::size(BASIC_SQUARE_VERTICES))
+    };
+    BasicBundleDesc prepassBundleDesc = bundleDesc;
+    prepassBundleDesc.pipelineId |= BASIC_DEPTH_ONLY_PIPELINE_FLAG;
+    BundleCache bundleCache(device, BUNDLE_CACHE_CAPACITY);
+    DrawPacketQueue drawPacketQueue;
+    DrawStateFilter drawStateFilter;
+
+    std::vector<std::vector<BasicObject>> visibleObjects;
+    HiZCullStats cullStats{ };
+    SceneFragmentStats fragmentStats{ };
+    if (!BuildVisibleObjectLists(visibleObjects, cullStats, fragmentStats)) return 1;
+
+    using Clock = std::chrono::steady_clock;
+    auto const toMicroseconds = [](Clock::duration duration) { return std::chrono::duration<double, std::micro>(duration).count(); };
+
+    const RenderCallStats setupStats = device.GetStats();
+    double totalRecordTime = 0.0;
+    double totalSubmitTime = 0.0;
+    double maxFrameTime = 0.0;
+    float rotateAngle = 0.0f;
+    uint64_t fenceValue = 0;
+
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        const RenderResourceId backBuffer = backBuffers[frame % BACK_BUFFER_COUNT];
+        const std::vector<BasicObject>& objects = visibleObjects[uint32_t(rotateAngle)];
+        const BasicFrameDesc frameDesc{
+            .pipelineId = BASIC_SHADER_PERMUTATION_DEFAULT,
+            .sceneTarget = backBuffer,
+            .sceneTargetState = RENDER_RESOURCE_STATE_PRESENT,
+            .backBuffer = backBuffer,
+            .viewport { 0.0f, 0.0f, float(WINDOW_WIDTH), float(WINDOW_HEIGHT), 0.0f, 1.0f },
+            .scissorRect { 0, 0, int32_t(WINDOW_WIDTH), int32_t(WINDOW_HEIGHT) },
+            .clearScissorRectOnly = false,
+            .rotateAngle = rotateAngle,
+            .depthTarget = depthTarget,
+            .depthStoreOp = RENDER_STORE_OP_PRESERVE,
+            .objects = objects.data(),
+            .objectCount = uint32_t(objects.size()),
+            .drawPackets = drawPackets ? &drawPacketQueue : nullptr,
+            .drawStateFilter = &drawStateFilter
+        };
+
+        const uint64_t callCountBefore = device.GetStats().GetTotal();
+        const auto beginTime = Clock::now();
+        bool recorded = false;
+        if (drawPackets)
+        {
+            BuildBasicDrawPackets(drawPacketQueue, bundleDesc, objects.data(), uint32_t(objects.size()), depthPrepass);
+            recorded = RecordBasicFrame(*commandList, nullptr, nullptr, frameDesc, nullptr);
+        }
+        else
+        {
+            RenderCommandList* const bundle = bundleCache.GetBundle(GetBasicBundleDrawKey(bundleDesc), fence->GetCompletedValue(), fenceValue + 1);
+            RenderCommandList* const prepassBundle = depthPrepass ?
+                bundleCache.GetBundle(GetBasicBundleDrawKey(prepassBundleDesc), fence->GetCompletedValue(), fenceValue + 1) : nullptr;
+            recorded = bundle != nullptr && (!depthPrepass || prepassBundle != nullptr) &&
+                RecordBasicFrame(*commandList, bundle, prepassBundle, frameDesc, nullptr);
+        }
+        const auto recordedTime = Clock::now();
+        const bool submitted = recorded && SubmitBasicFrame(*commandQueue, *commandList, *fence, ++fenceValue);
+        const auto endTime = Clock::now();
+
+        if (!submitted || device.GetErrorCount() > 0)
+        {
+            fprintf(stderr, "Frame %u is invalid: %s\n", frame, device.GetErrorMessage());
+            return 1;
+        }
+
+        const double recordTime = toMicroseconds(recordedTime - beginTime);
+        const double submitTime = toMicroseconds(endTime - recordedTime);
+        totalRecordTime += recordTime;
+        totalSubmitTime += submitTime;
+        if (recordTime + submitTime > maxFrameTime) {
+            maxFrameTime = recordTime + submitTime;
+        }
+
+        if (verbose)
+        {
+            printf("Frame %u: record %.3f us, submit %.3f us, %llu calls\n", frame, recordTime, submitTime,
+                (unsigned long long)(device.GetStats().GetTotal() - callCountBefore));
+        }
+
+        if (++rotateAngle >= 360.0f) {
+            rotateAngle = 0.0f;
+        }
+    }
+
+    printf("%u headless frames: %.3f us to record and %.3f us to submit per frame on average, %.3f us at most\n", frameCount,
+        totalRecordTime / frameCount, totalSubmitTime / frameCount, maxFrameTime);
+
+    const RenderCallStats& stats = device.GetStats();
+    printf("Calls per frame: %.1f\n", double(stats.GetTotal() - setupStats.GetTotal()) / frameCount);
+    for (uint32_t call = 0; call < uint32_t(RenderCall::COUNT); ++call)
+    {
+        const uint64_t count = stats.counts[call] - setupStats.counts[call];
+        if (count > 0) {
+            printf("  %-30s %.1f\n", RENDER_CALL_NAMES[call], double(count) / frameCount);
+        }
+    }
+    printf("Render passes: about %.1f KB of attachment traffic avoided per frame on a tile-based GPU\n",
+        double(stats.renderPassAvoidedBytes - setupStats.renderPassAvoidedBytes) / 1024.0 / frameCount);
+
+    // Overdraw is the number of shaded fragments per covered pixel, over all the angles.
+    const auto coveredPixelCount = double(fragmentStats.coveredPixelCount);
+    printf("Hi-Z occlusion: %.2f of %u objects culled per frame, none of them visible\n",
+        double(cullStats.culledCount) / ANGLE_COUNT, BASIC_SCENE_OBJECT_COUNT);
+    printf("Overdraw: %.2f without depth test, with early-Z %.2f back to front and %.2f front to back, %.2f after a depth prepass\n",
+        double(fragmentStats.rasterizedCount) / coveredPixelCount, double(fragmentStats.backToFrontCount) / coveredPixelCount,
+        double(fragmentStats.earlyZCount) / coveredPixelCount, double(fragmentStats.prepassCount) / coveredPixelCount);
+
+    if (drawPackets)
+    {
+        const DrawStateStats& drawStats = drawStateFilter.GetStats();
+        printf("Draw packets: %.1f draws and %.1f state calls per frame, %.1f redundant ones avoided\n", double(drawStats.drawCount) / frameCount,
+            double(drawStats.stateCallCount) / frameCount, double(drawStats.GetSkipCount()) / frameCount);
+    }
+    else
+    {
+        const BundleCacheStats& cacheStats = bundleCache.GetStats();
+        printf("Bundle cache: %.1f%% hits, %llu misses, %.3f us recording, about %.3f us of recording saved\n", cacheStats.GetHitRate() * 100.0,
+            (unsigned long long)cacheStats.misses, cacheStats.recordTime * 1000.0, cacheStats.GetSavedRecordTime() * 1000.0);
+    }
+
+    return 0;
+}
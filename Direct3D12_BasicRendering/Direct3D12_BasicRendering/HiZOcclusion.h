@@ -0,0 +1,143 @@
+// HiZOcclusion.h : Hierarchical-Z pyramid of a depth buffer, and the occlusion test of screen bounds against it.
+//
+// CPU reference of the reduction in shaders/hiz.hlsl. Depths are in [0, 1], with 1 at the far plane.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static constexpr float HIZ_FAR_DEPTH = 1.0f;
+
+struct HiZLevel
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<float> depths;      // row-major, `width` per row
+
+    auto GetDepth(uint32_t x, uint32_t y) const -> float { return depths[size_t(y) * width + x]; }
+};
+
+// `levels[i]` is level `baseLevel + i`, up to the 1x1 level. Only the levels from `baseLevel` up are kept,
+// e.g. those of a coarse level read back from the GPU.
+struct HiZPyramid
+{
+    uint32_t baseLevel;
+    std::vector<HiZLevel> levels;
+};
+
+// Screen rect in pixels, with `right` and `bottom` excluded, and the nearest depth of an object
+struct HiZBounds
+{
+    float left;
+    float top;
+    float right;
+    float bottom;
+    float minDepth;
+};
+
+struct HiZCullStats
+{
+    uint64_t testedCount;
+    uint64_t culledCount;
+};
+
+static inline auto GetHiZPaddedSize(uint32_t size) -> uint32_t
+{
+    uint32_t paddedSize = 1;
+    while (paddedSize < size) {
+        paddedSize <<= 1;
+    }
+    return paddedSize;
+}
+
+// The first level whose sizes are at most `maxSize`, that the application reads back from the GPU. Level 0 is never read back.
+static inline auto GetHiZReadbackLevel(uint32_t width, uint32_t height, uint32_t maxSize) -> uint32_t
+{
+    const uint32_t paddedSize = std::max(GetHiZPaddedSize(width), GetHiZPaddedSize(height));
+    uint32_t level = 1;
+    while ((paddedSize >> level) > maxSize) {
+        ++level;
+    }
+    return level;
+}
+
+// Level 0 from a depth buffer of `width` x `height` with rows of `rowPitch` depths
+static inline auto CreateHiZBaseLevel(const float* depths, uint32_t width, uint32_t height, uint32_t rowPitch) -> HiZLevel
+{
+    HiZLevel level{ .width = GetHiZPaddedSize(width), .height = GetHiZPaddedSize(height), .depths { } };
+    level.depths.assign(size_t(level.width) * level.height, HIZ_FAR_DEPTH);
+    for (uint32_t y = 0; y < height; ++y) {
+        std::copy(depths + size_t(y) * rowPitch, depths + size_t(y) * rowPitch + width, level.depths.begin() + ptrdiff_t(size_t(y) * level.width));
+    }
+    return level;
+}
+
+// The next level, as `HiZReduceCS` computes it. A level of size 1 keeps its size.
+static inline auto ReduceHiZLevel(const HiZLevel& source) -> HiZLevel
+{
+    HiZLevel level{ .width = std::max(source.width / 2, 1U), .height = std::max(source.height / 2, 1U), .depths { } };
+    level.depths.resize(size_t(level.width) * level.height);
+    for (uint32_t y = 0; y < level.height; ++y)
+    {
+        const uint32_t y0 = std::min(y * 2, source.height - 1);
+        const uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+        for (uint32_t x = 0; x < level.width; ++x)
+        {
+            const uint32_t x0 = std::min(x * 2, source.width - 1);
+            const uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+            level.depths[size_t(y) * level.width + x] = std::max(std::max(source.GetDepth(x0, y0), source.GetDepth(x1, y0)),
+                std::max(source.GetDepth(x0, y1), source.GetDepth(x1, y1)));
+        }
+    }
+    return level;
+}
+
+// Reduce `base`, which is level `baseLevel`, down to 1x1.
+static inline auto BuildHiZPyramid(HiZLevel base, uint32_t baseLevel) -> HiZPyramid
+{
+    HiZPyramid pyramid{ .baseLevel = baseLevel, .levels { } };
+    pyramid.levels.push_back(std::move(base));
+    while (pyramid.levels.back().width > 1 || pyramid.levels.back().height > 1) {
+        pyramid.levels.push_back(ReduceHiZLevel(pyramid.levels.back()));
+    }
+    return pyramid;
+}
+
+// Return true if the object is hidden. The test uses the finest level at which the rect spans at most 3 texels
+// on each side, and never culls an object with no part on the screen, which is left to frustum culling.
+static inline auto TestHiZOcclusion(const HiZPyramid& pyramid, const HiZBounds& bounds) -> bool
+{
+    if (pyramid.levels.empty()) return false;
+
+    const HiZLevel& base = pyramid.levels.front();
+    const float screenWidth = float(uint64_t(base.width) << pyramid.baseLevel);
+    const float screenHeight = float(uint64_t(base.height) << pyramid.baseLevel);
+    const float left = std::max(bounds.left, 0.0f);
+    const float top = std::max(bounds.top, 0.0f);
+    const float right = std::min(bounds.right, screenWidth);
+    const float bottom = std::min(bounds.bottom, screenHeight);
+    if (left >= right || top >= bottom) return false;
+
+    const float extent = std::max(right - left, bottom - top);
+    const int32_t fitLevel = int32_t(std::ceil(std::log2(std::max(extent, 1.0f)))) - 1;
+    const uint32_t levelIndex = uint32_t(std::clamp(fitLevel - int32_t(pyramid.baseLevel), 0, int32_t(pyramid.levels.size()) - 1));
+    const HiZLevel& level = pyramid.levels[levelIndex];
+    const uint32_t shift = pyramid.baseLevel + levelIndex;
+
+    const uint32_t x0 = uint32_t(left) >> shift;
+    const uint32_t y0 = uint32_t(top) >> shift;
+    const uint32_t x1 = std::min((uint32_t(std::ceil(right)) - 1) >> shift, level.width - 1);
+    const uint32_t y1 = std::min((uint32_t(std::ceil(bottom)) - 1) >> shift, level.height - 1);
+    for (uint32_t y = y0; y <= y1; ++y)
+    {
+        for (uint32_t x = x0; x <= x1; ++x)
+        {
+            if (bounds.minDepth <= level.GetDepth(x, y)) return false;
+        }
+    }
+    return true;
+}
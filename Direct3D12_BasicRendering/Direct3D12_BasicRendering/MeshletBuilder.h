@@ -0,0 +1,447 @@
+// MeshletBuilder.h : Partition of indexed triangle meshes into meshlets, with the bounds each meshlet is culled with.
+//
+// shaders/meshlets.hlsl runs the same culling tests. Matrices are row-major for row vectors, as in HLSL.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t MESHLET_MAX_VERTEX_COUNT = 64;
+static constexpr uint32_t MESHLET_MAX_PRIMITIVE_COUNT = 124;
+static constexpr uint32_t MESHLET_BUILD_CHUNK_TRIANGLE_COUNT = 4096;
+static constexpr uint32_t MESHLET_LOCAL_INDEX_BITS = 10;           // of each of the 3 local vertex indices packed in a primitive
+static constexpr float MESHLET_MIN_CONE_DOT = 0.1f;                 // wider cones never cull, and are disabled
+static constexpr uint32_t MESHLET_TORUS_TILE_SIZE = 7;              // 7x7 quads have 64 vertices, a full meshlet
+
+struct MeshletVertex
+{
+    float position[3];
+    float normal[3];
+};
+
+// Ranges of `MeshletMesh::vertexIndices` and `MeshletMesh::primitives`
+struct Meshlet
+{
+    uint32_t vertexOffset;
+    uint32_t primitiveOffset;
+    uint32_t vertexCount;
+    uint32_t primitiveCount;
+};
+
+// The cone is disabled with a zero axis and a cutoff of 1, which no camera position passes.
+struct MeshletBounds
+{
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;           // sine of the angle between the axis and the normal farthest from it
+};
+
+struct MeshletMesh
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds;
+    std::vector<uint32_t> vertexIndices;    // mesh vertices of each meshlet, in the order of their first use
+    std::vector<uint32_t> primitives;       // local vertex indices of each triangle, 10 bits each, see PackMeshletPrimitive
+};
+
+// The clip space planes of the frustum, as (a, b, c, d) with a * x + b * y + c * z + d >= 0 inside and (a, b, c) of unit length
+struct MeshletCullView
+{
+    float cameraPosition[3];
+    float frustumPlanes[6][4];
+};
+
+struct MeshletCullStats
+{
+    uint64_t testedCount;
+    uint64_t frustumCulledCount;
+    uint64_t coneCulledCount;
+};
+
+using MeshletMatrix = std::array<std::array<float, 4>, 4>;
+
+static inline auto PackMeshletPrimitive(uint32_t index0, uint32_t index1, uint32_t index2) -> uint32_t
+{
+    return index0 | (index1 << MESHLET_LOCAL_INDEX_BITS) | (index2 << (2 * MESHLET_LOCAL_INDEX_BITS));
+}
+
+static inline auto UnpackMeshletPrimitive(uint32_t primitive, uint32_t corner) -> uint32_t
+{
+    return (primitive >> (corner * MESHLET_LOCAL_INDEX_BITS)) & ((1U << MESHLET_LOCAL_INDEX_BITS) - 1);
+}
+
+// ==== Vector and matrix helpers ====
+
+static inline auto GetMeshletDot(const float a[3], const float b[3]) -> float
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Unnormalized normal of the triangle (a, b, c), facing the side from which it is clockwise with a left-handed view
+static inline auto GetMeshletTriangleNormal(const float a[3], const float b[3], const float c[3]) -> std::array<float, 3>
+{
+    const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    return { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+}
+
+static inline auto MultiplyMeshletMatrices(const MeshletMatrix& a, const MeshletMatrix& b) -> MeshletMatrix
+{
+    MeshletMatrix result{ };
+    for (size_t row = 0; row < 4; ++row)
+    {
+        for (size_t column = 0; column < 4; ++column) {
+            result[row][column] = a[row][0] * b[0][column] + a[row][1] * b[1][column] + a[row][2] * b[2][column] + a[row][3] * b[3][column];
+        }
+    }
+    return result;
+}
+
+// Rotation by `angle` radians around the X axis (`axis` 0) or the Y axis (`axis` 1), from +Y to +Z or from +Z to +X
+static inline auto MakeMeshletRotation(uint32_t axis, float angle) -> MeshletMatrix
+{
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    if (axis == 0) {
+        return { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, c, s, 0.0f }, { 0.0f, -s, c, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+    }
+    return { { { c, 0.0f, -s, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { s, 0.0f, c, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+}
+
+static inline auto MakeMeshletTranslation(float x, float y, float z) -> MeshletMatrix
+{
+    return { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { x, y, z, 1.0f } } };
+}
+
+// Left-handed perspective projection, looking down +Z with +Y up
+static inline auto MakeMeshletPerspective(float verticalFov, float aspectRatio, float nearZ, float farZ) -> MeshletMatrix
+{
+    const float yScale = 1.0f / std::tan(verticalFov * 0.5f);
+    const float zScale = farZ / (farZ - nearZ);
+    return { { { yScale / aspectRatio, 0.0f, 0.0f, 0.0f }, { 0.0f, yScale, 0.0f, 0.0f }, { 0.0f, 0.0f, zScale, 1.0f },
+        { 0.0f, 0.0f, -nearZ * zScale, 0.0f } } };
+}
+
+// `point` transformed by `matrix` with w = 1, where `matrix` is a rotation followed by a translation
+static inline auto TransformMeshletPoint(const float point[3], const MeshletMatrix& matrix) -> std::array<float, 3>
+{
+    std::array<float, 3> result{ };
+    for (size_t column = 0; column < 3; ++column) {
+        result[column] = point[0] * matrix[0][column] + point[1] * matrix[1][column] + point[2] * matrix[2][column] + matrix[3][column];
+    }
+    return result;
+}
+
+// The cull view in object space, from the object-to-clip matrix and the camera position in object space
+static inline auto MakeMeshletCullView(const MeshletMatrix& objectToClip, const float cameraPosition[3]) -> MeshletCullView
+{
+    MeshletCullView view{ .cameraPosition = { cameraPosition[0], cameraPosition[1], cameraPosition[2] }, .frustumPlanes { } };
+
+    // Left, right, bottom, top from w +- x and w +- y, near from z >= 0 and far from w - z
+    static constexpr float signs[6][3] = {
+        { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+    };
+    for (size_t plane = 0; plane < 6; ++plane)
+    {
+        const float wWeight = plane == 4 ? 0.0f : 1.0f;
+        float length = 0.0f;
+        for (size_t row = 0; row < 4; ++row)
+        {
+            view.frustumPlanes[plane][row] = objectToClip[row][3] * wWeight + objectToClip[row][0] * signs[plane][0] +
+                objectToClip[row][1] * signs[plane][1] + objectToClip[row][2] * signs[plane][2];
+            if (row < 3) {
+                length += view.frustumPlanes[plane][row] * view.frustumPlanes[plane][row];
+            }
+        }
+        length = std::sqrt(length);
+        for (auto& value : view.frustumPlanes[plane]) {
+            value /= length;
+        }
+    }
+    return view;
+}
+
+// ==== Builder ====
+
+static inline auto ComputeMeshletBounds(const MeshletVertex* vertices, const uint32_t* vertexIndices, const uint32_t* primitives,
+    const Meshlet& meshlet) -> MeshletBounds
+{
+    MeshletBounds bounds{ };
+
+    float minimum[3] = { INFINITY, INFINITY, INFINITY };
+    float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        const float* const position = vertices[vertexIndices[meshlet.vertexOffset + i]].position;
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+            minimum[axis] = std::min(minimum[axis], position[axis]);
+            maximum[axis] = std::max(maximum[axis], position[axis]);
+        }
+    }
+    float radiusSquared = 0.0f;
+    for (size_t axis = 0; axis < 3; ++axis) {
+        bounds.center[axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+    }
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        const float* const position = vertices[vertexIndices[meshlet.vertexOffset + i]].position;
+        const float offset[3] = { position[0] - bounds.center[0], position[1] - bounds.center[1], position[2] - bounds.center[2] };
+        radiusSquared = std::max(radiusSquared, GetMeshletDot(offset, offset));
+    }
+    bounds.radius = std::sqrt(radiusSquared);
+
+    // The axis is the average of the unit normals, and the cutoff comes from the normal farthest from it.
+    std::array<std::array<float, 3>, MESHLET_MAX_PRIMITIVE_COUNT> normals;
+    uint32_t normalCount = 0;
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t i = 0; i < meshlet.primitiveCount; ++i)
+    {
+        const uint32_t primitive = primitives[meshlet.primitiveOffset + i];
+        const float* corners[3]{ };
+        for (uint32_t corner = 0; corner < 3; ++corner) {
+            corners[corner] = vertices[vertexIndices[meshlet.vertexOffset + UnpackMeshletPrimitive(primitive, corner)]].position;
+        }
+
+        auto normal = GetMeshletTriangleNormal(corners[0], corners[1], corners[2]);
+        const float length = std::sqrt(GetMeshletDot(normal.data(), normal.data()));
+        if (length == 0.0f) continue;       // degenerate, it is never rasterized
+
+        for (size_t component = 0; component < 3; ++component)
+        {
+            normal[component] /= length;
+            axis[component] += normal[component];
+        }
+        normals[normalCount++] = normal;
+    }
+
+    const float axisLength = std::sqrt(GetMeshletDot(axis, axis));
+    float minDot = 1.0f;
+    if (axisLength > 0.0f)
+    {
+        for (auto& component : axis) {
+            component /= axisLength;
+        }
+        for (uint32_t i = 0; i < normalCount; ++i) {
+            minDot = std::min(minDot, GetMeshletDot(axis, normals[i].data()));
+        }
+    }
+
+    if (normalCount == 0 || axisLength == 0.0f || minDot <= MESHLET_MIN_CONE_DOT) {
+        bounds.coneCutoff = 1.0f;
+    }
+    else
+    {
+        std::copy(std::begin(axis), std::end(axis), bounds.coneAxis);
+        bounds.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+    return bounds;
+}
+
+// Build the meshlets of the triangles [firstTriangle, endTriangle) into `result`. `localIndices` has an entry per mesh
+// vertex set to UINT8_MAX, and is left that way.
+static inline auto BuildMeshletChunk(const MeshletVertex* vertices, const uint32_t* indices, size_t firstTriangle, size_t endTriangle,
+    std::vector<uint8_t>& localIndices, MeshletMesh& result) -> void
+{
+    Meshlet meshlet{ .vertexOffset = 0, .primitiveOffset = 0, .vertexCount = 0, .primitiveCount = 0 };
+
+    auto const finishMeshlet = [&] {
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+            localIndices[result.vertexIndices[meshlet.vertexOffset + i]] = UINT8_MAX;
+        }
+        result.meshlets.push_back(meshlet);
+        result.bounds.push_back(ComputeMeshletBounds(vertices, result.vertexIndices.data(), result.primitives.data(), meshlet));
+        meshlet = Meshlet{ .vertexOffset = uint32_t(result.vertexIndices.size()), .primitiveOffset = uint32_t(result.primitives.size()),
+            .vertexCount = 0, .primitiveCount = 0 };
+    };
+
+    for (size_t triangle = firstTriangle; triangle < endTriangle; ++triangle)
+    {
+        const uint32_t* const corners = &indices[triangle * 3];
+        uint32_t newVertexCount = 0;
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const bool repeated = (corner > 0 && corners[corner] == corners[0]) || (corner > 1 && corners[corner] == corners[1]);
+            if (localIndices[corners[corner]] == UINT8_MAX && !repeated) {
+                ++newVertexCount;
+            }
+        }
+        if (meshlet.vertexCount + newVertexCount > MESHLET_MAX_VERTEX_COUNT || meshlet.primitiveCount == MESHLET_MAX_PRIMITIVE_COUNT) {
+            finishMeshlet();
+        }
+
+        uint32_t local[3]{ };
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            uint8_t& localIndex = localIndices[corners[corner]];
+            if (localIndex == UINT8_MAX)
+            {
+                localIndex = uint8_t(meshlet.vertexCount++);
+                result.vertexIndices.push_back(corners[corner]);
+            }
+            local[corner] = localIndex;
+        }
+        result.primitives.push_back(PackMeshletPrimitive(local[0], local[1], local[2]));
+        ++meshlet.primitiveCount;
+    }
+    if (meshlet.primitiveCount > 0) {
+        finishMeshlet();
+    }
+}
+
+// Build the meshlets of a triangle list on `threadCount` threads, or on one per hardware thread if 0.
+static inline auto BuildMeshlets(const MeshletVertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+    uint32_t threadCount) -> MeshletMesh
+{
+    const size_t triangleCount = indexCount / 3;
+    const size_t chunkCount = (triangleCount + MESHLET_BUILD_CHUNK_TRIANGLE_COUNT - 1) / MESHLET_BUILD_CHUNK_TRIANGLE_COUNT;
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    threadCount = uint32_t(std::min(size_t(threadCount), std::max(chunkCount, size_t(1))));
+
+    std::vector<MeshletMesh> chunks(chunkCount);
+    std::atomic<size_t> nextChunk{ 0 };
+    auto const buildChunks = [&] {
+        std::vector<uint8_t> localIndices(vertexCount, UINT8_MAX);
+        for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+        {
+            const size_t firstTriangle = chunk * MESHLET_BUILD_CHUNK_TRIANGLE_COUNT;
+            BuildMeshletChunk(vertices, indices, firstTriangle, std::min(firstTriangle + MESHLET_BUILD_CHUNK_TRIANGLE_COUNT, triangleCount),
+                localIndices, chunks[chunk]);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(buildChunks);
+    }
+    buildChunks();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Concatenate the chunks, offsetting their ranges
+    MeshletMesh result;
+    size_t meshletCount = 0;
+    size_t vertexIndexCount = 0;
+    for (auto const& chunk : chunks)
+    {
+        meshletCount += chunk.meshlets.size();
+        vertexIndexCount += chunk.vertexIndices.size();
+    }
+    result.meshlets.reserve(meshletCount);
+    result.bounds.reserve(meshletCount);
+    result.vertexIndices.reserve(vertexIndexCount);
+    result.primitives.reserve(triangleCount);
+    for (auto const& chunk : chunks)
+    {
+        const uint32_t vertexOffset = uint32_t(result.vertexIndices.size());
+        const uint32_t primitiveOffset = uint32_t(result.primitives.size());
+        for (auto meshlet : chunk.meshlets)
+        {
+            meshlet.vertexOffset += vertexOffset;
+            meshlet.primitiveOffset += primitiveOffset;
+            result.meshlets.push_back(meshlet);
+        }
+        result.bounds.insert(result.bounds.end(), chunk.bounds.begin(), chunk.bounds.end());
+        result.vertexIndices.insert(result.vertexIndices.end(), chunk.vertexIndices.begin(), chunk.vertexIndices.end());
+        result.primitives.insert(result.primitives.end(), chunk.primitives.begin(), chunk.primitives.end());
+    }
+    return result;
+}
+
+// Torus around the Y axis, as the procedural mesh of the meshlet path. The quads are ordered in tiles of
+// MESHLET_TORUS_TILE_SIZE x MESHLET_TORUS_TILE_SIZE, so the builder makes a meshlet of each tile.
+static inline auto BuildTorusMesh(uint32_t ringSegmentCount, uint32_t tubeSegmentCount, float ringRadius, float tubeRadius,
+    std::vector<MeshletVertex>& vertices, std::vector<uint32_t>& indices) -> void
+{
+    static constexpr float TWO_PI = 6.28318530717958647692f;
+
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(size_t(ringSegmentCount) * tubeSegmentCount);
+    indices.reserve(size_t(ringSegmentCount) * tubeSegmentCount * 6);
+    for (uint32_t ring = 0; ring < ringSegmentCount; ++ring)
+    {
+        const float theta = TWO_PI * float(ring) / float(ringSegmentCount);
+        for (uint32_t tube = 0; tube < tubeSegmentCount; ++tube)
+        {
+            const float phi = TWO_PI * float(tube) / float(tubeSegmentCount);
+            const float normal[3] = { std::cos(phi) * std::cos(theta), std::sin(phi), std::cos(phi) * std::sin(theta) };
+            const float distance = ringRadius + tubeRadius * std::cos(phi);
+            vertices.push_back(MeshletVertex{
+                .position = { distance * std::cos(theta), tubeRadius * normal[1], distance * std::sin(theta) },
+                .normal = { normal[0], normal[1], normal[2] }
+            });
+        }
+    }
+
+    // Stepping around the tube, then around the ring, is clockwise seen from outside.
+    for (uint32_t ringTile = 0; ringTile < ringSegmentCount; ringTile += MESHLET_TORUS_TILE_SIZE)
+    {
+        for (uint32_t tubeTile = 0; tubeTile < tubeSegmentCount; tubeTile += MESHLET_TORUS_TILE_SIZE)
+        {
+            for (uint32_t ring = ringTile; ring < std::min(ringTile + MESHLET_TORUS_TILE_SIZE, ringSegmentCount); ++ring)
+            {
+                const uint32_t nextRing = (ring + 1) % ringSegmentCount;
+                for (uint32_t tube = tubeTile; tube < std::min(tubeTile + MESHLET_TORUS_TILE_SIZE, tubeSegmentCount); ++tube)
+                {
+                    const uint32_t nextTube = (tube + 1) % tubeSegmentCount;
+                    const uint32_t v00 = ring * tubeSegmentCount + tube;
+                    const uint32_t v01 = ring * tubeSegmentCount + nextTube;
+                    const uint32_t v10 = nextRing * tubeSegmentCount + tube;
+                    const uint32_t v11 = nextRing * tubeSegmentCount + nextTube;
+                    indices.insert(indices.end(), { v00, v01, v10, v10, v01, v11 });
+                }
+            }
+        }
+    }
+}
+
+// ==== Culling ====
+
+static inline auto IsMeshletOutsideFrustum(const MeshletBounds& bounds, const MeshletCullView& view) -> bool
+{
+    for (auto const& plane : view.frustumPlanes)
+    {
+        if (GetMeshletDot(plane, bounds.center) + plane[3] < -bounds.radius) return true;
+    }
+    return false;
+}
+
+// The camera is in the back-facing region of the cone when the direction to the sphere is inside the cone widened by the
+// angle the sphere subtends, so every triangle of the meshlet faces away from it.
+static inline auto IsMeshletConeCulled(const MeshletBounds& bounds, const MeshletCullView& view) -> bool
+{
+    const float direction[3] = { bounds.center[0] - view.cameraPosition[0], bounds.center[1] - view.cameraPosition[1],
+        bounds.center[2] - view.cameraPosition[2] };
+    return GetMeshletDot(direction, bounds.coneAxis) >= bounds.coneCutoff * std::sqrt(GetMeshletDot(direction, direction)) + bounds.radius;
+}
+
+// Append the indices of the meshlets that pass both tests to `visibleMeshlets`.
+static inline auto CullMeshlets(const MeshletMesh& mesh, const MeshletCullView& view, std::vector<uint32_t>& visibleMeshlets) -> MeshletCullStats
+{
+    MeshletCullStats stats{ .testedCount = mesh.bounds.size(), .frustumCulledCount = 0, .coneCulledCount = 0 };
+    for (uint32_t i = 0; i < uint32_t(mesh.bounds.size()); ++i)
+    {
+        if (IsMeshletOutsideFrustum(mesh.bounds[i], view)) {
+            ++stats.frustumCulledCount;
+        }
+        else if (IsMeshletConeCulled(mesh.bounds[i], view)) {
+            ++stats.coneCulledCount;
+        }
+        else {
+            visibleMeshlets.push_back(i);
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,437 @@
+// MipGenerator.h : Mip chains of RGBA8 textures of any size, with a box filter in linear space for the sRGB ones.
+//
+// CPU reference and fallback of shaders/mips.hlsl; both agree within MIP_COMPARE_TOLERANCE.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MIP_SIMD_NEON
+#endif
+
+static constexpr uint32_t MIP_GROUP_SIZE = 8;                   // matches MIP_GROUP_SIZE in shaders/mips.hlsl
+static constexpr uint32_t MIP_MAX_LEVELS_PER_DISPATCH = 4;      // the first mip, and 3 more from group shared memory
+static constexpr uint32_t MIP_MAX_LEVEL_COUNT = 15;             // 16384 x 16384
+static constexpr uint32_t MIP_TEXEL_SIZE = 4;                   // RGBA8
+static constexpr uint32_t MIP_COMPARE_TOLERANCE = 3;            // per channel, between the GPU and the CPU chains
+static constexpr uint32_t MIP_MIN_ROWS_PER_THREAD = 32;         // smaller mips are filtered on fewer threads
+static constexpr uint32_t MIP_SRGB_ENCODE_TABLE_SIZE = 4096;    // linear values to the first sRGB code to search from
+
+enum class MipSimd
+{
+    SCALAR,
+    VECTOR          // the lanes the compiler targets for linear textures, or scalar code if there are none
+};
+
+static inline auto GetMipSimdName() -> const char*
+{
+#if defined(MIP_SIMD_SSE2)
+    return "SSE2";
+#elif defined(MIP_SIMD_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+// ==== Filter ====
+
+static constexpr auto GetNextMipSize(uint32_t size) -> uint32_t
+{
+    return std::max(size >> 1, 1U);
+}
+
+static constexpr auto GetMipSize(uint32_t size, uint32_t level) -> uint32_t
+{
+    return std::max(size >> level, 1U);
+}
+
+// Down to 1x1
+static constexpr auto GetFullMipCount(uint32_t width, uint32_t height) -> uint32_t
+{
+    return uint32_t(std::bit_width(std::max(width, height)));
+}
+
+// The texels of a mip of `size` texels along an axis that texel `index` of the next mip covers
+struct MipFilterTaps
+{
+    uint32_t first;
+    uint32_t count;
+    float weights[3];
+};
+
+static inline auto GetMipFilterTaps(uint32_t index, uint32_t size) -> MipFilterTaps
+{
+    if (size == 1) return MipFilterTaps{ .first = 0, .count = 1, .weights { 1.0f, 0.0f, 0.0f } };
+    if (size % 2 == 0) return MipFilterTaps{ .first = 2 * index, .count = 2, .weights { 0.5f, 0.5f, 0.0f } };
+
+    const uint32_t half = size / 2;
+    const float scale = 1.0f / float(size);
+    return MipFilterTaps{
+        .first = 2 * index,
+        .count = 3,
+        .weights { float(half - index) * scale, float(half) * scale, float(index + 1) * scale }
+    };
+}
+
+static inline auto SrgbToLinear(float value) -> float
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline auto LinearToSrgb(float value) -> float
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// 8-bit channels to floats and back. An sRGB code is found among the linear values halfway between codes, which rounds as
+// LinearToSrgb followed by the UNORM conversion would, without a pow per channel. `srgbEncodeStart` gives the code to search
+// from, at most 2 below the result.
+struct MipColorTables
+{
+    float unormToFloat[256];
+    float srgbToLinear[256];
+    float srgbMidpoints[255];       // the linear value halfway between code i and code i + 1
+    uint8_t srgbEncodeStart[MIP_SRGB_ENCODE_TABLE_SIZE];
+
+    MipColorTables()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            unormToFloat[i] = float(i) * (1.0f / 255.0f);
+            srgbToLinear[i] = SrgbToLinear(float(i) / 255.0f);
+        }
+        for (uint32_t i = 0; i < 255; ++i) {
+            srgbMidpoints[i] = SrgbToLinear((float(i) + 0.5f) / 255.0f);
+        }
+        // Half an entry lower, so that the start is never past the code of a value rounded into the entry
+        for (uint32_t i = 0; i < MIP_SRGB_ENCODE_TABLE_SIZE; ++i)
+        {
+            const float value = (float(i) - 0.5f) / float(MIP_SRGB_ENCODE_TABLE_SIZE - 1);
+            srgbEncodeStart[i] = uint8_t(std::upper_bound(std::begin(srgbMidpoints), std::end(srgbMidpoints), value) - std::begin(srgbMidpoints));
+        }
+    }
+};
+
+static inline auto GetMipColorTables() -> const MipColorTables&
+{
+    static const MipColorTables tables;
+    return tables;
+}
+
+static inline auto EncodeUnormChannel(float value) -> uint8_t
+{
+    return uint8_t(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static inline auto EncodeSrgbChannel(const MipColorTables& tables, float value) -> uint8_t
+{
+    value = std::clamp(value, 0.0f, 1.0f);
+    uint32_t code = tables.srgbEncodeStart[uint32_t(value * float(MIP_SRGB_ENCODE_TABLE_SIZE - 1))];
+    while (code < 255 && tables.srgbMidpoints[code] <= value) {
+        ++code;
+    }
+    return uint8_t(code);
+}
+
+// ==== Mip chains on the CPU ====
+
+// Tightly packed mips, `GetMipSize(width, level) * MIP_TEXEL_SIZE` bytes per row
+struct MipChain
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    bool srgb;
+    size_t offsets[MIP_MAX_LEVEL_COUNT];
+    std::vector<uint8_t> texels;
+
+    auto GetLevel(uint32_t level) -> uint8_t* { return texels.data() + offsets[level]; }
+    auto GetLevel(uint32_t level) const -> const uint8_t* { return texels.data() + offsets[level]; }
+};
+
+// `levelCount` 0 is the full chain. Level 0 is left for the caller to fill.
+static inline auto CreateMipChain(uint32_t width, uint32_t height, uint32_t levelCount, bool srgb) -> MipChain
+{
+    MipChain chain{ .width = width, .height = height, .levelCount = 0, .srgb = srgb, .offsets { }, .texels { } };
+    chain.levelCount = levelCount == 0 ? GetFullMipCount(width, height) : std::min(levelCount, GetFullMipCount(width, height));
+
+    size_t size = 0;
+    for (uint32_t level = 0; level < chain.levelCount; ++level)
+    {
+        chain.offsets[level] = size;
+        size += size_t(GetMipSize(width, level)) * GetMipSize(height, level) * MIP_TEXEL_SIZE;
+    }
+    chain.texels.resize(size);
+    return chain;
+}
+
+// Level 0 of `chain`: gradients, one-texel stripes and noise, so that each tap of the filter shows in the mips
+static inline auto WriteMipTestPattern(MipChain& chain, uint32_t seed) -> void
+{
+    uint8_t* texel = chain.GetLevel(0);
+    for (uint32_t y = 0; y < chain.height; ++y)
+    {
+        for (uint32_t x = 0; x < chain.width; ++x, texel += MIP_TEXEL_SIZE)
+        {
+            // PCG hash of the texel
+            const uint32_t state = (y * chain.width + x) * 747796405U + 2891336453U + seed * 2654435761U;
+            const uint32_t hash = ((state >> ((state >> 28) + 4)) ^ state) * 277803737U;
+            texel[0] = uint8_t(x * 255 / std::max(chain.width - 1, 1U));
+            texel[1] = uint8_t((x + y) % 2 == 0 ? 255 : 0);
+            texel[2] = uint8_t(hash >> 24);
+            texel[3] = uint8_t(y * 255 / std::max(chain.height - 1, 1U));
+        }
+    }
+}
+
+// Decode a row of `width` texels to linear floats, 4 per texel. The vector path only decodes linear texels.
+static inline auto DecodeMipRow(const MipColorTables& tables, const uint8_t* texels, uint32_t width, bool srgb, MipSimd simd, float* row) -> void
+{
+#if defined(MIP_SIMD_SSE2)
+    if (simd == MipSimd::VECTOR && !srgb)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            int32_t texel;
+            memcpy(&texel, texels + size_t(x) * MIP_TEXEL_SIZE, sizeof(texel));
+            const __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero);
+            _mm_storeu_ps(row + size_t(x) * 4, _mm_mul_ps(_mm_cvtepi32_ps(channels), scale));
+        }
+        return;
+    }
+#elif defined(MIP_SIMD_NEON)
+    if (simd == MipSimd::VECTOR && !srgb)
+    {
+        const float32x4_t scale = vdupq_n_f32(1.0f / 255.0f);
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint32_t texel;
+            memcpy(&texel, texels + size_t(x) * MIP_TEXEL_SIZE, sizeof(texel));
+            const uint32x4_t channels = vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(texel))));
+            vst1q_f32(row + size_t(x) * 4, vmulq_f32(vcvtq_f32_u32(channels), scale));
+        }
+        return;
+    }
+#endif
+    (void)simd;
+    const float* const toLinear = srgb ? tables.srgbToLinear : tables.unormToFloat;
+    for (size_t i = 0; i < size_t(width) * MIP_TEXEL_SIZE; i += MIP_TEXEL_SIZE)
+    {
+        row[i] = toLinear[texels[i]];
+        row[i + 1] = toLinear[texels[i + 1]];
+        row[i + 2] = toLinear[texels[i + 2]];
+        row[i + 3] = tables.unormToFloat[texels[i + 3]];
+    }
+}
+
+// Filter rows [rowBegin, rowEnd) of the mip after the `srcWidth` x `srcHeight` mip `src` into `dst`.
+static inline auto FilterMipRows(const MipColorTables& tables, const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst,
+    uint32_t rowBegin, uint32_t rowEnd, bool srgb, MipSimd simd) -> void
+{
+    // The lanes do not pay off for the table lookups of sRGB texels.
+    if (srgb) {
+        simd = MipSimd::SCALAR;
+    }
+
+    const uint32_t dstWidth = GetNextMipSize(srcWidth);
+    std::vector<MipFilterTaps> columnTaps(dstWidth);
+    for (uint32_t x = 0; x < dstWidth; ++x) {
+        columnTaps[x] = GetMipFilterTaps(x, srcWidth);
+    }
+    std::vector<float> rows(size_t(srcWidth) * 4 * 3);
+
+    for (uint32_t y = rowBegin; y < rowEnd; ++y)
+    {
+        const MipFilterTaps rowTaps = GetMipFilterTaps(y, srcHeight);
+        for (uint32_t r = 0; r < rowTaps.count; ++r) {
+            DecodeMipRow(tables, src + size_t(rowTaps.first + r) * srcWidth * MIP_TEXEL_SIZE, srcWidth, srgb, simd, &rows[size_t(r) * srcWidth * 4]);
+        }
+
+        uint8_t* const dstRow = dst + size_t(y) * dstWidth * MIP_TEXEL_SIZE;
+        for (uint32_t x = 0; x < dstWidth; ++x)
+        {
+            const MipFilterTaps& taps = columnTaps[x];
+            float color[4];
+#if defined(MIP_SIMD_SSE2) || defined(MIP_SIMD_NEON)
+            if (simd == MipSimd::VECTOR)
+            {
+#if defined(MIP_SIMD_SSE2)
+                __m128 sum = _mm_setzero_ps();
+                for (uint32_t r = 0; r < rowTaps.count; ++r)
+                {
+                    const float* const texels = &rows[(size_t(r) * srcWidth + taps.first) * 4];
+                    for (uint32_t c = 0; c < taps.count; ++c) {
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(rowTaps.weights[r] * taps.weights[c]), _mm_loadu_ps(texels + size_t(c) * 4)));
+                    }
+                }
+                // Clamp, scale and round as EncodeUnormChannel does, and pack the 4 channels.
+                const __m128 scaled = _mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(1.0f)), _mm_set1_ps(255.0f)),
+                    _mm_set1_ps(0.5f));
+                const __m128i words = _mm_packs_epi32(_mm_cvttps_epi32(scaled), _mm_setzero_si128());
+                const int32_t texel = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+                memcpy(dstRow + size_t(x) * MIP_TEXEL_SIZE, &texel, sizeof(texel));
+#else
+                float32x4_t sum = vdupq_n_f32(0.0f);
+                for (uint32_t r = 0; r < rowTaps.count; ++r)
+                {
+                    const float* const texels = &rows[(size_t(r) * srcWidth + taps.first) * 4];
+                    for (uint32_t c = 0; c < taps.count; ++c) {
+                        sum = vaddq_f32(sum, vmulq_f32(vdupq_n_f32(rowTaps.weights[r] * taps.weights[c]), vld1q_f32(texels + size_t(c) * 4)));
+                    }
+                }
+                const float32x4_t scaled = vaddq_f32(vmulq_f32(vminq_f32(vmaxq_f32(sum, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f)), vdupq_n_f32(255.0f)),
+                    vdupq_n_f32(0.5f));
+                const uint16x4_t words = vmovn_u32(vcvtq_u32_f32(scaled));
+                const uint32_t texel = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(words, words))), 0);
+                memcpy(dstRow + size_t(x) * MIP_TEXEL_SIZE, &texel, sizeof(texel));
+#endif
+                continue;
+            }
+#endif
+            {
+                color[0] = color[1] = color[2] = color[3] = 0.0f;
+                for (uint32_t r = 0; r < rowTaps.count; ++r)
+                {
+                    const float* const texels = &rows[(size_t(r) * srcWidth + taps.first) * 4];
+                    for (uint32_t c = 0; c < taps.count; ++c)
+                    {
+                        const float weight = rowTaps.weights[r] * taps.weights[c];
+                        for (uint32_t i = 0; i < 4; ++i) {
+                            color[i] += weight * texels[size_t(c) * 4 + i];
+                        }
+                    }
+                }
+            }
+
+            uint8_t* const texel = dstRow + size_t(x) * MIP_TEXEL_SIZE;
+            for (uint32_t i = 0; i < 3; ++i) {
+                texel[i] = srgb ? EncodeSrgbChannel(tables, color[i]) : EncodeUnormChannel(color[i]);
+            }
+            texel[3] = EncodeUnormChannel(color[3]);
+        }
+    }
+}
+
+// Fill levels 1 and up of `chain` from level 0, each mip from the one before it, on `threadCount` threads, or on one per
+// hardware thread if 0.
+static inline auto GenerateMipChain(MipChain& chain, MipSimd simd, uint32_t threadCount) -> void
+{
+    const MipColorTables& tables = GetMipColorTables();
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t level = 1; level < chain.levelCount; ++level)
+    {
+        const uint32_t srcWidth = GetMipSize(chain.width, level - 1);
+        const uint32_t srcHeight = GetMipSize(chain.height, level - 1);
+        const uint32_t rowCount = GetMipSize(chain.height, level);
+        const uint8_t* const src = chain.GetLevel(level - 1);
+        uint8_t* const dst = chain.GetLevel(level);
+
+        // Contiguous bands of rows, the first one on this thread
+        const uint32_t bandCount = std::clamp(rowCount / MIP_MIN_ROWS_PER_THREAD, 1U, threadCount);
+        threads.clear();
+        for (uint32_t band = 1; band < bandCount; ++band)
+        {
+            threads.emplace_back(FilterMipRows, std::cref(tables), src, srcWidth, srcHeight, dst, rowCount * band / bandCount,
+                rowCount * (band + 1) / bandCount, chain.srgb, simd);
+        }
+        FilterMipRows(tables, src, srcWidth, srcHeight, dst, 0, rowCount / bandCount, chain.srgb, simd);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+// ==== Dispatch plan ====
+
+struct MipTextureDesc
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    bool srgb;
+};
+
+// Mips [srcLevel + 1, srcLevel + 1 + levelCount) of `texture`, from mip `srcLevel`
+struct MipDispatch
+{
+    uint32_t texture;
+    uint32_t srcLevel;
+    uint32_t levelCount;
+    uint32_t groupCountX;
+    uint32_t groupCountY;
+};
+
+// The dispatches of wave i are [waveEnds[i - 1], waveEnds[i]), with waveEnds[-1] = 0. Each reads the last mip a dispatch of
+// the previous wave wrote, if any.
+struct MipGenerationPlan
+{
+    std::vector<MipDispatch> dispatches;
+    std::vector<size_t> waveEnds;
+};
+
+// The mips a dispatch can build from a `srcWidth` x `srcHeight` source, out of the `remainingCount` left. After the first mip,
+// each needs a source whose sizes are even or 1.
+static inline auto GetMipDispatchLevelCount(uint32_t srcWidth, uint32_t srcHeight, uint32_t remainingCount) -> uint32_t
+{
+    uint32_t width = GetNextMipSize(srcWidth);
+    uint32_t height = GetNextMipSize(srcHeight);
+    uint32_t count = 1;
+    while (count < std::min(remainingCount, MIP_MAX_LEVELS_PER_DISPATCH) && (width == 1 || width % 2 == 0) && (height == 1 || height % 2 == 0))
+    {
+        width = GetNextMipSize(width);
+        height = GetNextMipSize(height);
+        ++count;
+    }
+    return count;
+}
+
+static inline auto PlanMipGeneration(const MipTextureDesc* textures, size_t textureCount) -> MipGenerationPlan
+{
+    // The next mip to build of each texture
+    std::vector<uint32_t> nextLevels(textureCount, 1);
+    MipGenerationPlan plan;
+    while (true)
+    {
+        const size_t waveBegin = plan.dispatches.size();
+        for (size_t i = 0; i < textureCount; ++i)
+        {
+            const MipTextureDesc& texture = textures[i];
+            const uint32_t srcLevel = nextLevels[i] - 1;
+            if (nextLevels[i] >= texture.levelCount) continue;
+
+            const uint32_t levelCount = GetMipDispatchLevelCount(GetMipSize(texture.width, srcLevel), GetMipSize(texture.height, srcLevel),
+                texture.levelCount - nextLevels[i]);
+            plan.dispatches.push_back(MipDispatch{
+                .texture = uint32_t(i),
+                .srcLevel = srcLevel,
+                .levelCount = levelCount,
+                .groupCountX = (GetMipSize(texture.width, nextLevels[i]) + MIP_GROUP_SIZE - 1) / MIP_GROUP_SIZE,
+                .groupCountY = (GetMipSize(texture.height, nextLevels[i]) + MIP_GROUP_SIZE - 1) / MIP_GROUP_SIZE
+            });
+            nextLevels[i] += levelCount;
+        }
+        if (plan.dispatches.size() == waveBegin) break;
+        plan.waveEnds.push_back(plan.dispatches.size());
+    }
+    return plan;
+}
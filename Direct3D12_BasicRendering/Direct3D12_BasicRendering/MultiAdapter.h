@@ -0,0 +1,146 @@
+// MultiAdapter.h : Work distribution between adapters in the multi-adapter mode.
+//
+// Adapter 0 presents; the others render a band of each frame and hand it over through cross-adapter heaps.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+static constexpr uint32_t MULTI_ADAPTER_MAX_COUNT = 4;
+
+class MultiAdapterLoadBalancer
+{
+public:
+    // `smoothing` is the factor of the moving average of the measured frame costs.
+    // `minShare` keeps every adapter busy enough to keep measuring its cost.
+    explicit MultiAdapterLoadBalancer(uint32_t adapterCount, double smoothing = 0.2, double minShare = 0.05) :
+        m_adapterCount(adapterCount > MULTI_ADAPTER_MAX_COUNT ? MULTI_ADAPTER_MAX_COUNT : (adapterCount == 0 ? 1 : adapterCount)),
+        m_smoothing(smoothing), m_minShare(minShare)
+    {
+    }
+
+    // Report that `adapterIndex` took `frameTime` milliseconds for `share` (0, 1] of a frame.
+    // The cost of a full frame on that adapter is estimated as `frameTime / share`.
+    auto ReportFrameTime(uint32_t adapterIndex, double share, double frameTime) -> void
+    {
+        if (adapterIndex >= m_adapterCount || share <= 0.0 || frameTime <= 0.0) return;
+
+        const double frameCost = frameTime / share;
+        double& smoothedCost = m_frameCosts[adapterIndex];
+        smoothedCost = smoothedCost <= 0.0 ? frameCost : smoothedCost + (frameCost - smoothedCost) * m_smoothing;
+    }
+
+    // Shares of a frame in proportion to the speed of each adapter, so that all the adapters are predicted to finish
+    // at the same time. Adapters not measured yet are assumed to be as fast as the average of the measured ones.
+    auto GetShares(double shares[]) const -> void
+    {
+        double measuredCostSum = 0.0;
+        uint32_t measuredCount = 0;
+        for (uint32_t i = 0; i < m_adapterCount; ++i)
+        {
+            if (m_frameCosts[i] > 0.0)
+            {
+                measuredCostSum += m_frameCosts[i];
+                ++measuredCount;
+            }
+        }
+        const double defaultCost = measuredCount > 0 ? measuredCostSum / double(measuredCount) : 1.0;
+
+        double speedSum = 0.0;
+        for (uint32_t i = 0; i < m_adapterCount; ++i)
+        {
+            shares[i] = 1.0 / (m_frameCosts[i] > 0.0 ? m_frameCosts[i] : defaultCost);
+            speedSum += shares[i];
+        }
+
+        for (uint32_t i = 0; i < m_adapterCount; ++i) {
+            shares[i] /= speedSum;
+        }
+
+        // Raise the shares below the minimum and take the difference from the others in proportion. Taking it may bring
+        // another share below the minimum, so repeat until none is; each round raises at least one more share.
+        if (m_minShare * double(m_adapterCount) >= 1.0)
+        {
+            for (uint32_t i = 0; i < m_adapterCount; ++i) {
+                shares[i] = 1.0 / double(m_adapterCount);
+            }
+            return;
+        }
+        bool raised[MULTI_ADAPTER_MAX_COUNT]{ };
+        for (uint32_t round = 0; round <= m_adapterCount; ++round)
+        {
+            double raisedSum = 0.0;
+            double restSum = 0.0;
+            bool raisedMore = false;
+            for (uint32_t i = 0; i < m_adapterCount; ++i)
+            {
+                if (!raised[i] && shares[i] < m_minShare)
+                {
+                    raised[i] = true;
+                    raisedMore = true;
+                }
+                if (raised[i]) {
+                    raisedSum += m_minShare;
+                }
+                else {
+                    restSum += shares[i];
+                }
+            }
+            if (!raisedMore) break;
+
+            for (uint32_t i = 0; i < m_adapterCount; ++i)
+            {
+                if (raised[i]) {
+                    shares[i] = m_minShare;
+                }
+                else {
+                    shares[i] *= (1.0 - raisedSum) / restSum;
+                }
+            }
+        }
+    }
+
+    // Split `rowCount` rows into one band per adapter. Band i is [rowBegins[i], rowBegins[i + 1]).
+    // Band boundaries are aligned to `rowAlignment` so that they do not move by a row or two every frame.
+    auto GetSplitRows(uint32_t rowCount, uint32_t rowAlignment, uint32_t rowBegins[]) const -> void
+    {
+        double shares[MULTI_ADAPTER_MAX_COUNT]{ };
+        GetShares(shares);
+
+        if (rowAlignment == 0) {
+            rowAlignment = 1;
+        }
+
+        double accumulatedShare = 0.0;
+        rowBegins[0] = 0;
+        for (uint32_t i = 1; i < m_adapterCount; ++i)
+        {
+            accumulatedShare += shares[i - 1];
+            uint32_t row = uint32_t(accumulatedShare * double(rowCount) + 0.5);
+            row = (row + rowAlignment / 2) / rowAlignment * rowAlignment;
+            if (row < rowBegins[i - 1]) {
+                row = rowBegins[i - 1];
+            }
+            if (row > rowCount) {
+                row = rowCount;
+            }
+            rowBegins[i] = row;
+        }
+        rowBegins[m_adapterCount] = rowCount;
+    }
+
+    auto GetAdapterCount() const -> uint32_t { return m_adapterCount; }
+
+    // Smoothed cost of a full frame on the adapter in milliseconds, 0 if not measured yet
+    auto GetFrameCost(uint32_t adapterIndex) const -> double
+    {
+        return adapterIndex < m_adapterCount ? m_frameCosts[adapterIndex] : 0.0;
+    }
+
+private:
+    uint32_t m_adapterCount;
+    double m_smoothing;
+    double m_minShare;
+    double m_frameCosts[MULTI_ADAPTER_MAX_COUNT]{ };
+};
@@ -0,0 +1,387 @@
+// ParticleSystem.h : Fountain of particles simulated with a fixed time step, and recycled through a dead list.
+//
+// CPU implementation of the frame step of shaders/particles.hlsl, used as the fallback path.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PARTICLE_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLE_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PARTICLE_SIMD_NEON
+#endif
+
+static constexpr uint32_t PARTICLE_GROUP_SIZE = 64;     // numthreads of EmitCS and SimulateCS
+
+// Passed to the shaders as root constants, in the order of `cbParticles`. Positions are in normalized device coordinates.
+struct ParticleSettings
+{
+    uint32_t maxParticleCount;
+    uint32_t emitCountPerFrame;
+    float timeStep;             // seconds per frame
+    float gravity;
+    float damping;              // velocity factor per frame
+    float floorY;
+    float restitution;          // vertical velocity factor of a bounce on the floor
+    float emitterX;
+    float emitterY;
+    float emitSpread;           // angle in radians around the vertical
+    float minSpeed;
+    float maxSpeed;
+    float minLifetime;
+    float maxLifetime;
+    float minSize;
+    float maxSize;
+};
+
+static constexpr ParticleSettings PARTICLE_DEFAULT_SETTINGS{
+    .maxParticleCount = 65536,
+    .emitCountPerFrame = 256,
+    .timeStep = 1.0f / 60.0f,
+    .gravity = -1.5f,
+    .damping = 0.995f,
+    .floorY = -0.95f,
+    .restitution = 0.5f,
+    .emitterX = 0.0f,
+    .emitterY = -0.9f,
+    .emitSpread = 0.6f,
+    .minSpeed = 1.2f,
+    .maxSpeed = 1.8f,
+    .minLifetime = 1.5f,
+    .maxLifetime = 3.0f,
+    .minSize = 0.008f,
+    .maxSize = 0.016f
+};
+
+// Particle of the GPU buffers, the same as `Particle` in shaders/particles.hlsl. A slot is dead when `age` >= `lifetime`.
+struct GpuParticle
+{
+    float positionX;
+    float positionY;
+    float velocityX;
+    float velocityY;
+    float age;
+    float lifetime;
+    float size;
+    float padding;
+};
+
+// PCG hash, the same as `HashParticleIndex` in shaders/particles.hlsl
+static inline auto HashParticleIndex(uint32_t value) -> uint32_t
+{
+    const uint32_t state = value * 747796405U + 2891336453U;
+    const uint32_t word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737U;
+    return (word >> 22) ^ word;
+}
+
+// Uniform in [0, 1). Each particle takes 4 random values.
+static inline auto GetParticleRandom(uint32_t emissionIndex, uint32_t stream) -> float
+{
+    return float(HashParticleIndex(emissionIndex * 4 + stream) >> 8) * (1.0f / 16777216.0f);
+}
+
+// The particle that thread `threadIndex` of EmitCS emits in frame `frameIndex`
+static inline auto EmitParticle(const ParticleSettings& settings, uint32_t frameIndex, uint32_t threadIndex) -> GpuParticle
+{
+    const uint32_t emissionIndex = frameIndex * settings.emitCountPerFrame + threadIndex;
+    const float angle = (GetParticleRandom(emissionIndex, 0) - 0.5f) * settings.emitSpread;
+    const float speed = settings.minSpeed + (settings.maxSpeed - settings.minSpeed) * GetParticleRandom(emissionIndex, 1);
+    return GpuParticle{
+        .positionX = settings.emitterX,
+        .positionY = settings.emitterY,
+        .velocityX = std::sin(angle) * speed,
+        .velocityY = std::cos(angle) * speed,
+        .age = 0.0f,
+        .lifetime = settings.minLifetime + (settings.maxLifetime - settings.minLifetime) * GetParticleRandom(emissionIndex, 2),
+        .size = settings.minSize + (settings.maxSize - settings.minSize) * GetParticleRandom(emissionIndex, 3),
+        .padding = 0.0f
+    };
+}
+
+enum class ParticleSimd : uint32_t
+{
+    SCALAR,
+    VECTOR          // the widest lanes the compiler targets, or scalar code if there are none
+};
+
+static inline auto GetParticleSimdName() -> const char*
+{
+#if defined(PARTICLE_SIMD_AVX2)
+    return "AVX2";
+#elif defined(PARTICLE_SIMD_SSE2)
+    return "SSE2";
+#elif defined(PARTICLE_SIMD_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+// The slot arrays, padded to a multiple of 8 with dead slots so that the vector step needs no tail
+struct ParticleArrays
+{
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> velocityX;
+    std::vector<float> velocityY;
+    std::vector<float> age;
+    std::vector<float> lifetime;
+    std::vector<float> size;
+};
+
+// Constants of the simulation step, derived once from the settings the same way SimulateCS derives them
+struct ParticleStepConstants
+{
+    float timeStep;
+    float gravityStep;
+    float damping;
+    float floorY;
+    float floorY2;
+    float bounce;
+};
+
+static inline auto GetParticleStepConstants(const ParticleSettings& settings) -> ParticleStepConstants
+{
+    return ParticleStepConstants{
+        .timeStep = settings.timeStep,
+        .gravityStep = settings.gravity * settings.timeStep,
+        .damping = settings.damping,
+        .floorY = settings.floorY,
+        .floorY2 = settings.floorY + settings.floorY,
+        .bounce = -settings.restitution
+    };
+}
+
+// One slot of the step. The vector lanes below do the same operations in the same order.
+static inline auto SimulateParticleSlot(ParticleArrays& arrays, size_t index, const ParticleStepConstants& constants) -> bool
+{
+    float velocityX = arrays.velocityX[index];
+    float velocityY = arrays.velocityY[index] + constants.gravityStep;
+    velocityX = velocityX * constants.damping;
+    velocityY = velocityY * constants.damping;
+    const float positionX = arrays.positionX[index] + velocityX * constants.timeStep;
+    float positionY = arrays.positionY[index] + velocityY * constants.timeStep;
+    if (positionY < constants.floorY)
+    {
+        positionY = constants.floorY2 - positionY;
+        velocityY = velocityY * constants.bounce;
+    }
+    const float age = arrays.age[index];
+    const bool wasAlive = age < arrays.lifetime[index];
+    arrays.positionX[index] = positionX;
+    arrays.positionY[index] = positionY;
+    arrays.velocityX[index] = velocityX;
+    arrays.velocityY[index] = velocityY;
+    arrays.age[index] = age + constants.timeStep;
+    return wasAlive && !(age + constants.timeStep < arrays.lifetime[index]);
+}
+
+#if defined(PARTICLE_SIMD_AVX2)
+struct ParticleLanes
+{
+    using Float = __m256;
+    using Mask = __m256;
+    static constexpr uint32_t WIDTH = 8;
+
+    static auto Load(const float* p) -> Float { return _mm256_loadu_ps(p); }
+    static auto Store(float* p, Float a) -> void { _mm256_storeu_ps(p, a); }
+    static auto Set(float a) -> Float { return _mm256_set1_ps(a); }
+    static auto Add(Float a, Float b) -> Float { return _mm256_add_ps(a, b); }
+    static auto Sub(Float a, Float b) -> Float { return _mm256_sub_ps(a, b); }
+    static auto Mul(Float a, Float b) -> Float { return _mm256_mul_ps(a, b); }
+    static auto Less(Float a, Float b) -> Mask { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static auto Select(Mask m, Float a, Float b) -> Float { return _mm256_blendv_ps(b, a, m); }
+    static auto GetBits(Mask m) -> uint32_t { return uint32_t(_mm256_movemask_ps(m)); }
+};
+#elif defined(PARTICLE_SIMD_SSE2)
+struct ParticleLanes
+{
+    using Float = __m128;
+    using Mask = __m128;
+    static constexpr uint32_t WIDTH = 4;
+
+    static auto Load(const float* p) -> Float { return _mm_loadu_ps(p); }
+    static auto Store(float* p, Float a) -> void { _mm_storeu_ps(p, a); }
+    static auto Set(float a) -> Float { return _mm_set1_ps(a); }
+    static auto Add(Float a, Float b) -> Float { return _mm_add_ps(a, b); }
+    static auto Sub(Float a, Float b) -> Float { return _mm_sub_ps(a, b); }
+    static auto Mul(Float a, Float b) -> Float { return _mm_mul_ps(a, b); }
+    static auto Less(Float a, Float b) -> Mask { return _mm_cmplt_ps(a, b); }
+    static auto Select(Mask m, Float a, Float b) -> Float { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static auto GetBits(Mask m) -> uint32_t { return uint32_t(_mm_movemask_ps(m)); }
+};
+#elif defined(PARTICLE_SIMD_NEON)
+struct ParticleLanes
+{
+    using Float = float32x4_t;
+    using Mask = uint32x4_t;
+    static constexpr uint32_t WIDTH = 4;
+
+    static auto Load(const float* p) -> Float { return vld1q_f32(p); }
+    static auto Store(float* p, Float a) -> void { vst1q_f32(p, a); }
+    static auto Set(float a) -> Float { return vdupq_n_f32(a); }
+    static auto Add(Float a, Float b) -> Float { return vaddq_f32(a, b); }
+    static auto Sub(Float a, Float b) -> Float { return vsubq_f32(a, b); }
+    static auto Mul(Float a, Float b) -> Float { return vmulq_f32(a, b); }
+    static auto Less(Float a, Float b) -> Mask { return vcltq_f32(a, b); }
+    static auto Select(Mask m, Float a, Float b) -> Float { return vbslq_f32(m, a, b); }
+    static auto GetBits(Mask m) -> uint32_t
+    {
+        static const uint32_t laneBits[4]{ 1, 2, 4, 8 };
+        const uint32x4_t bits = vandq_u32(m, vld1q_u32(laneBits));
+        return vgetq_lane_u32(bits, 0) | vgetq_lane_u32(bits, 1) | vgetq_lane_u32(bits, 2) | vgetq_lane_u32(bits, 3);
+    }
+};
+#endif
+
+class ParticleSimulation
+{
+public:
+
+    explicit ParticleSimulation(const ParticleSettings& settings) :
+        m_settings(settings), m_constants(GetParticleStepConstants(settings))
+    {
+        const size_t slotCount = (size_t(settings.maxParticleCount) + 7) & ~size_t(7);
+        for (std::vector<float>* values : { &m_arrays.positionX, &m_arrays.positionY, &m_arrays.velocityX, &m_arrays.velocityY,
+                                            &m_arrays.age, &m_arrays.lifetime, &m_arrays.size }) {
+            values->assign(slotCount, 0.0f);
+        }
+
+        // Popped from the back, so slot 0 is emitted first like on the GPU
+        m_deadList.resize(settings.maxParticleCount);
+        for (uint32_t i = 0; i < settings.maxParticleCount; ++i) {
+            m_deadList[i] = settings.maxParticleCount - 1 - i;
+        }
+        m_diedList.reserve(settings.maxParticleCount);
+    }
+
+    // Emit the particles of frame `frameIndex`, then advance every slot by one time step and recycle the particles that die.
+    // Dead slots are advanced as well, which keeps the vector loop free of gathers, and never come back to life.
+    auto Step(uint32_t frameIndex, ParticleSimd simd) -> void
+    {
+        const uint32_t emitCount = std::min(m_settings.emitCountPerFrame, uint32_t(m_deadList.size()));
+        for (uint32_t i = 0; i < emitCount; ++i)
+        {
+            const uint32_t slot = m_deadList.back();
+            m_deadList.pop_back();
+            const GpuParticle particle = EmitParticle(m_settings, frameIndex, i);
+            m_arrays.positionX[slot] = particle.positionX;
+            m_arrays.positionY[slot] = particle.positionY;
+            m_arrays.velocityX[slot] = particle.velocityX;
+            m_arrays.velocityY[slot] = particle.velocityY;
+            m_arrays.age[slot] = particle.age;
+            m_arrays.lifetime[slot] = particle.lifetime;
+            m_arrays.size[slot] = particle.size;
+        }
+
+        m_diedList.clear();
+#if defined(PARTICLE_SIMD_AVX2) || defined(PARTICLE_SIMD_SSE2) || defined(PARTICLE_SIMD_NEON)
+        if (simd == ParticleSimd::VECTOR) {
+            SimulateLanes();
+        }
+        else
+#endif
+        {
+            (void)simd;
+            const size_t slotCount = m_arrays.age.size();
+            for (size_t i = 0; i < slotCount; ++i)
+            {
+                if (SimulateParticleSlot(m_arrays, i, m_constants)) {
+                    m_diedList.push_back(uint32_t(i));
+                }
+            }
+        }
+
+        m_deadList.insert(m_deadList.end(), m_diedList.begin(), m_diedList.end());
+        m_aliveCount = m_settings.maxParticleCount - uint32_t(m_deadList.size());
+    }
+
+    auto GetAliveCount() const -> uint32_t { return m_aliveCount; }
+
+    auto GetArrays() const -> const ParticleArrays& { return m_arrays; }
+
+    // Write the alive particles in slot order, and return their count. `particles` has room for `maxParticleCount`.
+    auto CopyAliveParticles(GpuParticle* particles) const -> uint32_t
+    {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < m_settings.maxParticleCount; ++i)
+        {
+            if (!(m_arrays.age[i] < m_arrays.lifetime[i])) continue;
+
+            particles[count++] = GpuParticle{
+                .positionX = m_arrays.positionX[i],
+                .positionY = m_arrays.positionY[i],
+                .velocityX = m_arrays.velocityX[i],
+                .velocityY = m_arrays.velocityY[i],
+                .age = m_arrays.age[i],
+                .lifetime = m_arrays.lifetime[i],
+                .size = m_arrays.size[i],
+                .padding = 0.0f
+            };
+        }
+        return count;
+    }
+
+private:
+
+#if defined(PARTICLE_SIMD_AVX2) || defined(PARTICLE_SIMD_SSE2) || defined(PARTICLE_SIMD_NEON)
+    auto SimulateLanes() -> void
+    {
+        using L = ParticleLanes;
+        const L::Float timeStep = L::Set(m_constants.timeStep);
+        const L::Float gravityStep = L::Set(m_constants.gravityStep);
+        const L::Float damping = L::Set(m_constants.damping);
+        const L::Float floorY = L::Set(m_constants.floorY);
+        const L::Float floorY2 = L::Set(m_constants.floorY2);
+        const L::Float bounce = L::Set(m_constants.bounce);
+
+        const size_t slotCount = m_arrays.age.size();
+        for (size_t i = 0; i < slotCount; i += L::WIDTH)
+        {
+            L::Float velocityX = L::Load(&m_arrays.velocityX[i]);
+            L::Float velocityY = L::Add(L::Load(&m_arrays.velocityY[i]), gravityStep);
+            velocityX = L::Mul(velocityX, damping);
+            velocityY = L::Mul(velocityY, damping);
+            const L::Float positionX = L::Add(L::Load(&m_arrays.positionX[i]), L::Mul(velocityX, timeStep));
+            L::Float positionY = L::Add(L::Load(&m_arrays.positionY[i]), L::Mul(velocityY, timeStep));
+            const L::Mask belowFloor = L::Less(positionY, floorY);
+            positionY = L::Select(belowFloor, L::Sub(floorY2, positionY), positionY);
+            velocityY = L::Select(belowFloor, L::Mul(velocityY, bounce), velocityY);
+
+            const L::Float age = L::Load(&m_arrays.age[i]);
+            const L::Float lifetime = L::Load(&m_arrays.lifetime[i]);
+            const L::Float nextAge = L::Add(age, timeStep);
+            L::Store(&m_arrays.positionX[i], positionX);
+            L::Store(&m_arrays.positionY[i], positionY);
+            L::Store(&m_arrays.velocityX[i], velocityX);
+            L::Store(&m_arrays.velocityY[i], velocityY);
+            L::Store(&m_arrays.age[i], nextAge);
+
+            uint32_t diedBits = L::GetBits(L::Less(age, lifetime)) & ~L::GetBits(L::Less(nextAge, lifetime));
+            while (diedBits != 0)
+            {
+                m_diedList.push_back(uint32_t(i) + uint32_t(std::countr_zero(diedBits)));
+                diedBits &= diedBits - 1;
+            }
+        }
+    }
+#endif
+
+    ParticleSettings m_settings;
+    ParticleStepConstants m_constants;
+    ParticleArrays m_arrays;
+    std::vector<uint32_t> m_deadList;       // stack of free slots
+    std::vector<uint32_t> m_diedList;       // slots that died in the current step, in slot order
+    uint32_t m_aliveCount = 0;
+};
@@ -0,0 +1,818 @@
+// RenderBackend.h : Thin rendering interface over the device, command queues, command lists, fences and resources.
+//
+// Direct3D 12 implements it in Direct3D12_BasicRendering.cpp; the null implementation here validates and counts the calls.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "CommandCapture.h"
+
+using RenderResourceId = uint32_t;
+
+static constexpr RenderResourceId RENDER_INVALID_RESOURCE = CAPTURE_INVALID_ID;
+static constexpr uint32_t RENDER_NO_PIPELINE = UINT32_MAX;
+
+// Values of D3D12_RESOURCE_STATES, D3D_PRIMITIVE_TOPOLOGY and DXGI_FORMAT used by the frame logic
+static constexpr uint32_t RENDER_RESOURCE_STATE_PRESENT = CAPTURE_RESOURCE_STATE_COMMON;
+static constexpr uint32_t RENDER_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER = 0x1;
+static constexpr uint32_t RENDER_RESOURCE_STATE_RENDER_TARGET = CAPTURE_RESOURCE_STATE_RENDER_TARGET;
+static constexpr uint32_t RENDER_RESOURCE_STATE_DEPTH_WRITE = CAPTURE_RESOURCE_STATE_DEPTH_WRITE;
+static constexpr uint32_t RENDER_RESOURCE_STATE_PIXEL_SHADER_RESOURCE = 0x80;
+static constexpr uint32_t RENDER_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5;
+static constexpr uint32_t RENDER_FORMAT_R8G8B8A8_UNORM = 28;
+static constexpr uint32_t RENDER_FORMAT_D32_FLOAT = CAPTURE_FORMAT_D32_FLOAT;
+static constexpr uint32_t RENDER_FORMAT_R32_UINT = CAPTURE_FORMAT_R32_UINT;
+static constexpr uint32_t RENDER_FORMAT_R16_UINT = CAPTURE_FORMAT_R16_UINT;
+static constexpr uint32_t RENDER_LOAD_OP_DISCARD = CAPTURE_LOAD_OP_DISCARD;
+static constexpr uint32_t RENDER_LOAD_OP_PRESERVE = CAPTURE_LOAD_OP_PRESERVE;
+static constexpr uint32_t RENDER_LOAD_OP_CLEAR = CAPTURE_LOAD_OP_CLEAR;
+static constexpr uint32_t RENDER_STORE_OP_DISCARD = CAPTURE_STORE_OP_DISCARD;
+static constexpr uint32_t RENDER_STORE_OP_PRESERVE = CAPTURE_STORE_OP_PRESERVE;
+
+enum class RenderCommandListType : uint32_t
+{
+    DIRECT,
+    BUNDLE
+};
+
+enum class RenderCall : uint32_t
+{
+    CREATE_BUFFER,
+    CREATE_RENDER_TARGET,
+    CREATE_COMMAND_QUEUE,
+    CREATE_COMMAND_LIST,
+    CREATE_FENCE,
+    RESET,
+    CLOSE,
+    SET_PIPELINE_STATE,
+    SET_GRAPHICS_ROOT_SIGNATURE,
+    SET_GRAPHICS_ROOT_32BIT_CONSTANT,
+    SET_VIEWPORT,
+    SET_SCISSOR_RECT,
+    SET_RENDER_TARGET,
+    CLEAR_RENDER_TARGET,
+    SET_PRIMITIVE_TOPOLOGY,
+    SET_VERTEX_BUFFER,
+    DRAW_INSTANCED,
+    RESOURCE_BARRIER,
+    EXECUTE_BUNDLE,
+    EXECUTE_COMMAND_LIST,
+    SIGNAL,
+    PRESENT,
+    WAIT_FOR_FENCE,
+    SET_INDEX_BUFFER,
+    DRAW_INDEXED_INSTANCED,
+    BEGIN_RENDER_PASS,
+    END_RENDER_PASS,
+    CREATE_DEPTH_TARGET,
+    COUNT
+};
+
+static constexpr const char* RENDER_CALL_NAMES[] = {
+    "CreateBuffer",
+    "CreateRenderTarget",
+    "CreateCommandQueue",
+    "CreateCommandList",
+    "CreateFence",
+    "Reset",
+    "Close",
+    "SetPipelineState",
+    "SetGraphicsRootSignature",
+    "SetGraphicsRoot32BitConstant",
+    "SetViewport",
+    "SetScissorRect",
+    "SetRenderTarget",
+    "ClearRenderTarget",
+    "SetPrimitiveTopology",
+    "SetVertexBuffer",
+    "DrawInstanced",
+    "ResourceBarrier",
+    "ExecuteBundle",
+    "ExecuteCommandList",
+    "Signal",
+    "Present",
+    "WaitForFence",
+    "SetIndexBuffer",
+    "DrawIndexedInstanced",
+    "BeginRenderPass",
+    "EndRenderPass",
+    "CreateDepthTarget"
+};
+
+static_assert(sizeof(RENDER_CALL_NAMES) / sizeof(RENDER_CALL_NAMES[0]) == size_t(RenderCall::COUNT), "Missing name of a render call");
+
+struct RenderCallStats
+{
+    uint64_t counts[size_t(RenderCall::COUNT)];
+    uint64_t renderPassAvoidedBytes;    // estimated by GetRenderPassAvoidedBytes, for the passes that use native load and store ops
+
+    auto Add(RenderCall call) -> void { ++counts[size_t(call)]; }
+
+    auto GetTotal() const -> uint64_t
+    {
+        uint64_t total = 0;
+        for (auto const count : counts) {
+            total += count;
+        }
+        return total;
+    }
+};
+
+struct RenderViewport
+{
+    float topLeftX;
+    float topLeftY;
+    float width;
+    float height;
+    float minDepth;
+    float maxDepth;
+};
+
+struct RenderRect
+{
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+};
+
+// One render target and an optional depth target, bound for the duration of the pass. Their contents at the beginning
+// of the pass come from the load ops, and are only written back to memory at the end with RENDER_STORE_OP_PRESERVE.
+struct RenderPassDesc
+{
+    RenderResourceId renderTarget;
+    uint32_t loadOp;                    // RENDER_LOAD_OP_*
+    uint32_t storeOp;                   // RENDER_STORE_OP_*
+    float clearColor[4];                // for RENDER_LOAD_OP_CLEAR
+    const RenderRect* clearRect;        // clear only this area and preserve the rest, or null to clear the whole target
+    RenderResourceId depthTarget;       // RENDER_INVALID_RESOURCE for a pass without depth
+    uint32_t depthLoadOp;               // the depth is always cleared as a whole
+    uint32_t depthStoreOp;
+    float clearDepth;
+};
+
+// Attachment traffic in bytes that a tile-based GPU avoids thanks to the load and store ops of one attachment, compared with
+// binding and clearing it: that path writes the clear to memory, loads the attachment into the tiles and stores it back.
+// A partial clear keeps the rest of the attachment, so it is still loaded.
+static inline auto GetAttachmentAvoidedBytes(uint32_t loadOp, uint32_t storeOp, bool partialClear, uint64_t size) -> uint64_t
+{
+    uint64_t avoidedBytes = 0;
+    if (loadOp == RENDER_LOAD_OP_CLEAR && !partialClear) {
+        avoidedBytes += 2 * size;
+    }
+    else if (loadOp == RENDER_LOAD_OP_DISCARD) {
+        avoidedBytes += size;
+    }
+    if (storeOp == RENDER_STORE_OP_DISCARD) {
+        avoidedBytes += size;
+    }
+    return avoidedBytes;
+}
+
+// `depthSize` is ignored for a pass without depth.
+static inline auto GetRenderPassAvoidedBytes(const RenderPassDesc& desc, uint64_t targetSize, uint64_t depthSize) -> uint64_t
+{
+    uint64_t avoidedBytes = GetAttachmentAvoidedBytes(desc.loadOp, desc.storeOp, desc.clearRect != nullptr, targetSize);
+    if (desc.depthTarget != RENDER_INVALID_RESOURCE) {
+        avoidedBytes += GetAttachmentAvoidedBytes(desc.depthLoadOp, desc.depthStoreOp, false, depthSize);
+    }
+    return avoidedBytes;
+}
+
+class RenderCommandList
+{
+public:
+    virtual ~RenderCommandList() = default;
+
+    virtual auto GetType() const -> RenderCommandListType = 0;
+
+    // Start recording with the pipeline `pipelineId`, or RENDER_NO_PIPELINE. The command list is reused after
+    // the GPU has finished with it.
+    virtual auto Reset(uint32_t pipelineId) -> bool = 0;
+    virtual auto Close() -> bool = 0;
+
+    virtual auto SetPipelineState(uint32_t pipelineId) -> void = 0;
+    virtual auto SetGraphicsRootSignature(uint32_t rootSignatureId) -> void = 0;
+    virtual auto SetGraphicsRoot32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t destOffset) -> void = 0;
+    virtual auto SetViewport(const RenderViewport& viewport) -> void = 0;
+    virtual auto SetScissorRect(const RenderRect& rect) -> void = 0;
+    virtual auto SetRenderTarget(RenderResourceId renderTarget) -> void = 0;
+    // Clear the whole target if `rect` is null.
+    virtual auto ClearRenderTarget(RenderResourceId renderTarget, const float color[4], const RenderRect* rect) -> void = 0;
+    virtual auto SetPrimitiveTopology(uint32_t topology) -> void = 0;
+    virtual auto SetVertexBuffer(uint32_t slot, RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t stride) -> void = 0;
+    virtual auto DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance) -> void = 0;
+    virtual auto ResourceBarrier(RenderResourceId resource, uint32_t stateBefore, uint32_t stateAfter) -> void = 0;
+    // `format` is RENDER_FORMAT_R16_UINT or RENDER_FORMAT_R32_UINT.
+    virtual auto SetIndexBuffer(RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t format) -> void = 0;
+    virtual auto DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) -> void = 0;
+    // `bundle` must come from the same backend.
+    virtual auto ExecuteBundle(RenderCommandList& bundle) -> void = 0;
+    // The render target must be in RENDER_TARGET state, and the depth target in DEPTH_WRITE state. Within the pass, they are
+    // the only targets, and barriers, SetRenderTarget and ClearRenderTarget are not allowed. Backends without native render
+    // passes bind and clear the targets.
+    virtual auto BeginRenderPass(const RenderPassDesc& desc) -> void = 0;
+    virtual auto EndRenderPass() -> void = 0;
+};
+
+class RenderFence
+{
+public:
+    virtual ~RenderFence() = default;
+
+    virtual auto GetCompletedValue() const -> uint64_t = 0;
+    // Block the CPU until the fence reaches `value`.
+    virtual auto Wait(uint64_t value) -> bool = 0;
+};
+
+class RenderCommandQueue
+{
+public:
+    virtual ~RenderCommandQueue() = default;
+
+    virtual auto ExecuteCommandList(RenderCommandList& commandList) -> bool = 0;
+    virtual auto Signal(RenderFence& fence, uint64_t value) -> bool = 0;
+    // Present the current back buffer of the swap chain attached to this queue.
+    virtual auto Present() -> bool = 0;
+};
+
+// The objects created by a device are owned by the device. Command lists are created closed.
+class RenderDevice
+{
+public:
+    virtual ~RenderDevice() = default;
+
+    // Return RENDER_INVALID_RESOURCE on failure.
+    virtual auto CreateBuffer(const void* data, size_t size, uint32_t initialState) -> RenderResourceId = 0;
+    virtual auto CreateRenderTarget(uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> RenderResourceId = 0;
+    // `format` is RENDER_FORMAT_D32_FLOAT.
+    virtual auto CreateDepthTarget(uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> RenderResourceId = 0;
+    // Return null on failure.
+    virtual auto CreateCommandQueue() -> RenderCommandQueue* = 0;
+    virtual auto CreateCommandList(RenderCommandListType type) -> RenderCommandList* = 0;
+    virtual auto CreateFence(uint64_t initialValue) -> RenderFence* = 0;
+
+    // Calls made through the device and all of its objects
+    auto GetStats() const -> const RenderCallStats& { return m_stats; }
+
+protected:
+    RenderCallStats m_stats{ };
+};
+
+// ==== Capture of a command list ====
+
+// Forwards every call to `inner` and writes it to a command capture. Resource IDs are translated through
+// `captureResourceIds`, which maps each render resource ID to its capture resource ID.
+class CaptureRenderCommandList final : public RenderCommandList
+{
+public:
+    CaptureRenderCommandList(RenderCommandList& inner, CommandCaptureWriter& writer, const std::vector<uint32_t>& captureResourceIds, uint32_t bundleId) :
+        m_inner(inner), m_writer(writer), m_captureResourceIds(captureResourceIds), m_bundleId(bundleId)
+    {
+    }
+
+    auto GetInner() -> RenderCommandList& { return m_inner; }
+
+    auto GetType() const -> RenderCommandListType override { return m_inner.GetType(); }
+
+    auto Reset(uint32_t pipelineId) -> bool override
+    {
+        if (!m_inner.Reset(pipelineId)) return false;
+
+        if (GetType() == RenderCommandListType::BUNDLE) {
+            m_writer.BeginBundle(m_bundleId);
+        }
+        else {
+            m_writer.BeginFrame();
+        }
+        if (pipelineId != RENDER_NO_PIPELINE) {
+            m_writer.SetPipelineState(pipelineId);
+        }
+        return true;
+    }
+
+    auto Close() -> bool override
+    {
+        if (!m_inner.Close()) return false;
+
+        if (GetType() == RenderCommandListType::BUNDLE) {
+            m_writer.EndBundle();
+        }
+        else {
+            m_writer.EndFrame();
+        }
+        return true;
+    }
+
+    auto SetPipelineState(uint32_t pipelineId) -> void override
+    {
+        m_inner.SetPipelineState(pipelineId);
+        m_writer.SetPipelineState(pipelineId);
+    }
+
+    auto SetGraphicsRootSignature(uint32_t rootSignatureId) -> void override
+    {
+        m_inner.SetGraphicsRootSignature(rootSignatureId);
+        m_writer.SetGraphicsRootSignature(rootSignatureId);
+    }
+
+    auto SetGraphicsRoot32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t destOffset) -> void override
+    {
+        m_inner.SetGraphicsRoot32BitConstant(rootParameterIndex, value, destOffset);
+        m_writer.SetGraphicsRoot32BitConstant(rootParameterIndex, value, destOffset);
+    }
+
+    auto SetViewport(const RenderViewport& viewport) -> void override
+    {
+        m_inner.SetViewport(viewport);
+        m_writer.SetViewport(viewport.topLeftX, viewport.topLeftY, viewport.width, viewport.height, viewport.minDepth, viewport.maxDepth);
+    }
+
+    auto SetScissorRect(const RenderRect& rect) -> void override
+    {
+        m_inner.SetScissorRect(rect);
+        m_writer.SetScissorRect(rect.left, rect.top, rect.right, rect.bottom);
+    }
+
+    auto SetRenderTarget(RenderResourceId renderTarget) -> void override
+    {
+        m_inner.SetRenderTarget(renderTarget);
+        m_writer.SetRenderTarget(ToCaptureId(renderTarget));
+    }
+
+    auto ClearRenderTarget(RenderResourceId renderTarget, const float color[4], const RenderRect* rect) -> void override
+    {
+        m_inner.ClearRenderTarget(renderTarget, color, rect);
+
+        const int32_t captureRect[] = { rect != nullptr ? rect->left : 0, rect != nullptr ? rect->top : 0,
+            rect != nullptr ? rect->right : 0, rect != nullptr ? rect->bottom : 0 };
+        m_writer.ClearRenderTarget(ToCaptureId(renderTarget), color, rect != nullptr ? captureRect : nullptr);
+    }
+
+    auto SetPrimitiveTopology(uint32_t topology) -> void override
+    {
+        m_inner.SetPrimitiveTopology(topology);
+        m_writer.SetPrimitiveTopology(topology);
+    }
+
+    auto SetVertexBuffer(uint32_t slot, RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t stride) -> void override
+    {
+        m_inner.SetVertexBuffer(slot, buffer, offset, size, stride);
+        m_writer.SetVertexBuffer(slot, ToCaptureId(buffer), offset, size, stride);
+    }
+
+    auto DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance) -> void override
+    {
+        m_inner.DrawInstanced(vertexCountPerInstance, instanceCount, startVertex, startInstance);
+        m_writer.DrawInstanced(vertexCountPerInstance, instanceCount, startVertex, startInstance);
+    }
+
+    auto ResourceBarrier(RenderResourceId resource, uint32_t stateBefore, uint32_t stateAfter) -> void override
+    {
+        m_inner.ResourceBarrier(resource, stateBefore, stateAfter);
+        m_writer.ResourceBarrier(ToCaptureId(resource), stateBefore, stateAfter);
+    }
+
+    auto SetIndexBuffer(RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t format) -> void override
+    {
+        m_inner.SetIndexBuffer(buffer, offset, size, format);
+        m_writer.SetIndexBuffer(ToCaptureId(buffer), offset, size, format);
+    }
+
+    auto DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) -> void override
+    {
+        m_inner.DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+        m_writer.DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+    }
+
+    // `bundle` must be a CaptureRenderCommandList as well.
+    auto ExecuteBundle(RenderCommandList& bundle) -> void override
+    {
+        auto& captureBundle = static_cast<CaptureRenderCommandList&>(bundle);
+        m_inner.ExecuteBundle(captureBundle.m_inner);
+        m_writer.ExecuteBundle(captureBundle.m_bundleId);
+    }
+
+    auto BeginRenderPass(const RenderPassDesc& desc) -> void override
+    {
+        m_inner.BeginRenderPass(desc);
+
+        const RenderRect* rect = desc.clearRect;
+        const int32_t captureRect[] = { rect != nullptr ? rect->left : 0, rect != nullptr ? rect->top : 0,
+            rect != nullptr ? rect->right : 0, rect != nullptr ? rect->bottom : 0 };
+        m_writer.BeginRenderPass(ToCaptureId(desc.renderTarget), desc.loadOp, desc.storeOp, desc.clearColor, rect != nullptr ? captureRect : nullptr,
+            ToCaptureId(desc.depthTarget), desc.depthLoadOp, desc.depthStoreOp, desc.clearDepth);
+    }
+
+    auto EndRenderPass() -> void override
+    {
+        m_inner.EndRenderPass();
+        m_writer.EndRenderPass();
+    }
+
+private:
+    auto ToCaptureId(RenderResourceId resource) const -> uint32_t
+    {
+        return resource < m_captureResourceIds.size() ? m_captureResourceIds[resource] : CAPTURE_INVALID_ID;
+    }
+
+    RenderCommandList& m_inner;
+    CommandCaptureWriter& m_writer;
+    const std::vector<uint32_t>& m_captureResourceIds;
+    uint32_t m_bundleId;
+};
+
+// ==== Null implementation ====
+// The calls are checked by the same rules as the replay of a capture (`NullCommandReplayBackend`), which see one
+// direct command list at a time. Resource IDs are the capture resource IDs of the device's resource table.
+
+class NullRenderDevice;
+
+class NullRenderCommandList final : public RenderCommandList
+{
+public:
+    NullRenderCommandList(NullRenderDevice& device, RenderCommandListType type, uint32_t bundleId) :
+        m_device(device), m_type(type), m_bundleId(bundleId)
+    {
+    }
+
+    auto GetType() const -> RenderCommandListType override { return m_type; }
+    auto IsClosed() const -> bool { return m_closed; }
+    auto GetBundleId() const -> uint32_t { return m_bundleId; }
+
+    auto Reset(uint32_t pipelineId) -> bool override;
+    auto Close() -> bool override;
+    auto SetPipelineState(uint32_t pipelineId) -> void override;
+    auto SetGraphicsRootSignature(uint32_t rootSignatureId) -> void override;
+    auto SetGraphicsRoot32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t destOffset) -> void override;
+    auto SetViewport(const RenderViewport& viewport) -> void override;
+    auto SetScissorRect(const RenderRect& rect) -> void override;
+    auto SetRenderTarget(RenderResourceId renderTarget) -> void override;
+    auto ClearRenderTarget(RenderResourceId renderTarget, const float color[4], const RenderRect* rect) -> void override;
+    auto SetPrimitiveTopology(uint32_t topology) -> void override;
+    auto SetVertexBuffer(uint32_t slot, RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t stride) -> void override;
+    auto DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance) -> void override;
+    auto ResourceBarrier(RenderResourceId resource, uint32_t stateBefore, uint32_t stateAfter) -> void override;
+    auto SetIndexBuffer(RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t format) -> void override;
+    auto DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) -> void override;
+    auto ExecuteBundle(RenderCommandList& bundle) -> void override;
+    auto BeginRenderPass(const RenderPassDesc& desc) -> void override;
+    auto EndRenderPass() -> void override;
+
+private:
+    // Commands to a closed list are reported by the device.
+    auto Validate(RenderCall call, CaptureOpcode opcode, std::initializer_list<uint32_t> arguments) -> void;
+
+    NullRenderDevice& m_device;
+    RenderCommandListType m_type;
+    uint32_t m_bundleId;
+    bool m_closed = true;
+};
+
+class NullRenderFence final : public RenderFence
+{
+public:
+    NullRenderFence(NullRenderDevice& device, uint64_t initialValue) : m_device(device), m_value(initialValue) { }
+
+    auto GetCompletedValue() const -> uint64_t override { return m_value; }
+    auto Wait(uint64_t value) -> bool override;
+    auto SetCompletedValue(uint64_t value) -> void { m_value = value; }
+
+private:
+    NullRenderDevice& m_device;
+    uint64_t m_value;
+};
+
+// Work completes as soon as it is submitted, so signals take effect immediately.
+class NullRenderCommandQueue final : public RenderCommandQueue
+{
+public:
+    explicit NullRenderCommandQueue(NullRenderDevice& device) : m_device(device) { }
+
+    auto ExecuteCommandList(RenderCommandList& commandList) -> bool override;
+    auto Signal(RenderFence& fence, uint64_t value) -> bool override;
+    auto Present() -> bool override;
+
+private:
+    NullRenderDevice& m_device;
+};
+
+class NullRenderDevice final : public RenderDevice
+{
+public:
+    NullRenderDevice() : m_validator(m_resources) { }
+
+    auto CreateBuffer(const void* data, size_t size, uint32_t initialState) -> RenderResourceId override
+    {
+        m_stats.Add(RenderCall::CREATE_BUFFER);
+
+        // Only the size is kept. The contents are never read.
+        (void)data;
+        m_resources.resources.push_back(CaptureResourceDesc{
+            .kind = CaptureResourceKind::BUFFER,
+            .format = 0,
+            .width = uint32_t(size),
+            .height = 1,
+            .initialState = initialState,
+            .reserved = 0,
+            .dataOffset = 0,
+            .dataSize = 0
+        });
+        m_validator.SyncResources();
+        return RenderResourceId(m_resources.resources.size() - 1);
+    }
+
+    auto CreateRenderTarget(uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> RenderResourceId override
+    {
+        m_stats.Add(RenderCall::CREATE_RENDER_TARGET);
+
+        m_resources.resources.push_back(CaptureResourceDesc{
+            .kind = CaptureResourceKind::RENDER_TARGET,
+            .format = format,
+            .width = width,
+            .height = height,
+            .initialState = initialState,
+            .reserved = 0,
+            .dataOffset = 0,
+            .dataSize = 0
+        });
+        m_validator.SyncResources();
+        return RenderResourceId(m_resources.resources.size() - 1);
+    }
+
+    auto CreateDepthTarget(uint32_t width, uint32_t height, uint32_t format, uint32_t initialState) -> RenderResourceId override
+    {
+        m_stats.Add(RenderCall::CREATE_DEPTH_TARGET);
+
+        m_resources.resources.push_back(CaptureResourceDesc{
+            .kind = CaptureResourceKind::DEPTH_STENCIL,
+            .format = format,
+            .width = width,
+            .height = height,
+            .initialState = initialState,
+            .reserved = 0,
+            .dataOffset = 0,
+            .dataSize = 0
+        });
+        m_validator.SyncResources();
+        return RenderResourceId(m_resources.resources.size() - 1);
+    }
+
+    auto CreateCommandQueue() -> RenderCommandQueue* override
+    {
+        m_stats.Add(RenderCall::CREATE_COMMAND_QUEUE);
+        m_commandQueues.push_back(std::make_unique<NullRenderCommandQueue>(*this));
+        return m_commandQueues.back().get();
+    }
+
+    auto CreateCommandList(RenderCommandListType type) -> RenderCommandList* override
+    {
+        m_stats.Add(RenderCall::CREATE_COMMAND_LIST);
+        const uint32_t bundleId = type == RenderCommandListType::BUNDLE ? m_bundleCount++ : CAPTURE_INVALID_ID;
+        m_commandLists.push_back(std::make_unique<NullRenderCommandList>(*this, type, bundleId));
+        return m_commandLists.back().get();
+    }
+
+    auto CreateFence(uint64_t initialValue) -> RenderFence* override
+    {
+        m_stats.Add(RenderCall::CREATE_FENCE);
+        m_fences.push_back(std::make_unique<NullRenderFence>(*this, initialValue));
+        return m_fences.back().get();
+    }
+
+    auto GetErrorCount() const -> uint64_t { return m_errorCount; }
+    // The first error
+    auto GetErrorMessage() const -> const char* { return m_errorMessage; }
+
+    auto Record(RenderCall call) -> void { m_stats.Add(call); }
+
+    // As if the device were a tile-based GPU with native render passes. The render and depth targets have 32 bits per pixel.
+    auto CountRenderPass(const RenderPassDesc& desc) -> void
+    {
+        if (desc.renderTarget >= m_resources.resources.size()) return;
+        if (desc.depthTarget != RENDER_INVALID_RESOURCE && desc.depthTarget >= m_resources.resources.size()) return;
+
+        const CaptureResourceDesc& target = m_resources.resources[desc.renderTarget];
+        const uint64_t depthSize = desc.depthTarget != RENDER_INVALID_RESOURCE ?
+            uint64_t(m_resources.resources[desc.depthTarget].width) * m_resources.resources[desc.depthTarget].height * 4 : 0;
+        m_stats.renderPassAvoidedBytes += GetRenderPassAvoidedBytes(desc, uint64_t(target.width) * target.height * 4, depthSize);
+    }
+
+    auto Validate(CaptureOpcode opcode, const uint32_t arguments[]) -> void
+    {
+        if (!m_validator.Execute(opcode, arguments)) {
+            ReportError(m_validator.GetErrorMessage());
+        }
+    }
+
+    auto ReportError(const char* message) -> void
+    {
+        if (m_errorCount++ == 0) {
+            snprintf(m_errorMessage, sizeof(m_errorMessage), "%s", message);
+        }
+    }
+
+private:
+    CommandCapture m_resources{ };
+    NullCommandReplayBackend m_validator;
+    std::vector<std::unique_ptr<NullRenderCommandQueue>> m_commandQueues;
+    std::vector<std::unique_ptr<NullRenderCommandList>> m_commandLists;
+    std::vector<std::unique_ptr<NullRenderFence>> m_fences;
+    uint32_t m_bundleCount = 0;
+    uint64_t m_errorCount = 0;
+    char m_errorMessage[160]{ };
+};
+
+inline auto NullRenderCommandList::Validate(RenderCall call, CaptureOpcode opcode, std::initializer_list<uint32_t> arguments) -> void
+{
+    m_device.Record(call);
+    if (m_closed)
+    {
+        m_device.ReportError("Recording into a closed command list");
+        return;
+    }
+    m_device.Validate(opcode, arguments.begin());
+}
+
+inline auto NullRenderCommandList::Reset(uint32_t pipelineId) -> bool
+{
+    m_device.Record(RenderCall::RESET);
+    if (!m_closed)
+    {
+        m_device.ReportError("Reset: the command list is still open");
+        return false;
+    }
+
+    m_closed = false;
+    if (m_type == RenderCommandListType::BUNDLE)
+    {
+        const uint32_t arguments[] = { m_bundleId };
+        m_device.Validate(CaptureOpcode::BEGIN_BUNDLE, arguments);
+    }
+    else {
+        m_device.Validate(CaptureOpcode::BEGIN_FRAME, nullptr);
+    }
+
+    if (pipelineId != RENDER_NO_PIPELINE)
+    {
+        const uint32_t arguments[] = { pipelineId };
+        m_device.Validate(CaptureOpcode::SET_PIPELINE_STATE, arguments);
+    }
+    return true;
+}
+
+inline auto NullRenderCommandList::Close() -> bool
+{
+    m_device.Record(RenderCall::CLOSE);
+    if (m_closed)
+    {
+        m_device.ReportError("Close: the command list is not open");
+        return false;
+    }
+
+    m_device.Validate(m_type == RenderCommandListType::BUNDLE ? CaptureOpcode::END_BUNDLE : CaptureOpcode::END_FRAME, nullptr);
+    m_closed = true;
+    return true;
+}
+
+inline auto NullRenderCommandList::SetPipelineState(uint32_t pipelineId) -> void
+{
+    Validate(RenderCall::SET_PIPELINE_STATE, CaptureOpcode::SET_PIPELINE_STATE, { pipelineId });
+}
+
+inline auto NullRenderCommandList::SetGraphicsRootSignature(uint32_t rootSignatureId) -> void
+{
+    Validate(RenderCall::SET_GRAPHICS_ROOT_SIGNATURE, CaptureOpcode::SET_GRAPHICS_ROOT_SIGNATURE, { rootSignatureId });
+}
+
+inline auto NullRenderCommandList::SetGraphicsRoot32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t destOffset) -> void
+{
+    Validate(RenderCall::SET_GRAPHICS_ROOT_32BIT_CONSTANT, CaptureOpcode::SET_GRAPHICS_ROOT_32BIT_CONSTANT, { rootParameterIndex, value, destOffset });
+}
+
+inline auto NullRenderCommandList::SetViewport(const RenderViewport& viewport) -> void
+{
+    Validate(RenderCall::SET_VIEWPORT, CaptureOpcode::SET_VIEWPORT, { CaptureFloatToWord(viewport.topLeftX), CaptureFloatToWord(viewport.topLeftY),
+        CaptureFloatToWord(viewport.width), CaptureFloatToWord(viewport.height), CaptureFloatToWord(viewport.minDepth), CaptureFloatToWord(viewport.maxDepth) });
+}
+
+inline auto NullRenderCommandList::SetScissorRect(const RenderRect& rect) -> void
+{
+    Validate(RenderCall::SET_SCISSOR_RECT, CaptureOpcode::SET_SCISSOR_RECT, { uint32_t(rect.left), uint32_t(rect.top), uint32_t(rect.right), uint32_t(rect.bottom) });
+}
+
+inline auto NullRenderCommandList::SetRenderTarget(RenderResourceId renderTarget) -> void
+{
+    Validate(RenderCall::SET_RENDER_TARGET, CaptureOpcode::SET_RENDER_TARGET, { renderTarget });
+}
+
+inline auto NullRenderCommandList::ClearRenderTarget(RenderResourceId renderTarget, const float color[4], const RenderRect* rect) -> void
+{
+    Validate(RenderCall::CLEAR_RENDER_TARGET, CaptureOpcode::CLEAR_RENDER_TARGET, { renderTarget,
+        CaptureFloatToWord(color[0]), CaptureFloatToWord(color[1]), CaptureFloatToWord(color[2]), CaptureFloatToWord(color[3]),
+        rect != nullptr ? 1U : 0U,
+        rect != nullptr ? uint32_t(rect->left) : 0U, rect != nullptr ? uint32_t(rect->top) : 0U,
+        rect != nullptr ? uint32_t(rect->right) : 0U, rect != nullptr ? uint32_t(rect->bottom) : 0U });
+}
+
+inline auto NullRenderCommandList::SetPrimitiveTopology(uint32_t topology) -> void
+{
+    Validate(RenderCall::SET_PRIMITIVE_TOPOLOGY, CaptureOpcode::SET_PRIMITIVE_TOPOLOGY, { topology });
+}
+
+inline auto NullRenderCommandList::SetVertexBuffer(uint32_t slot, RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t stride) -> void
+{
+    Validate(RenderCall::SET_VERTEX_BUFFER, CaptureOpcode::SET_VERTEX_BUFFER, { slot, buffer, offset, size, stride });
+}
+
+inline auto NullRenderCommandList::DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertex, uint32_t startInstance) -> void
+{
+    Validate(RenderCall::DRAW_INSTANCED, CaptureOpcode::DRAW_INSTANCED, { vertexCountPerInstance, instanceCount, startVertex, startInstance });
+}
+
+inline auto NullRenderCommandList::ResourceBarrier(RenderResourceId resource, uint32_t stateBefore, uint32_t stateAfter) -> void
+{
+    Validate(RenderCall::RESOURCE_BARRIER, CaptureOpcode::RESOURCE_BARRIER, { resource, stateBefore, stateAfter });
+}
+
+inline auto NullRenderCommandList::SetIndexBuffer(RenderResourceId buffer, uint32_t offset, uint32_t size, uint32_t format) -> void
+{
+    Validate(RenderCall::SET_INDEX_BUFFER, CaptureOpcode::SET_INDEX_BUFFER, { buffer, offset, size, format });
+}
+
+inline auto NullRenderCommandList::DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndex, int32_t baseVertex, uint32_t startInstance) -> void
+{
+    Validate(RenderCall::DRAW_INDEXED_INSTANCED, CaptureOpcode::DRAW_INDEXED_INSTANCED, { indexCountPerInstance, instanceCount, startIndex, uint32_t(baseVertex), startInstance });
+}
+
+inline auto NullRenderCommandList::ExecuteBundle(RenderCommandList& bundle) -> void
+{
+    auto& nullBundle = static_cast<NullRenderCommandList&>(bundle);
+    if (nullBundle.GetType() != RenderCommandListType::BUNDLE || !nullBundle.IsClosed())
+    {
+        m_device.Record(RenderCall::EXECUTE_BUNDLE);
+        m_device.ReportError("ExecuteBundle: not a closed bundle");
+        return;
+    }
+    Validate(RenderCall::EXECUTE_BUNDLE, CaptureOpcode::EXECUTE_BUNDLE, { nullBundle.GetBundleId() });
+}
+
+inline auto NullRenderCommandList::BeginRenderPass(const RenderPassDesc& desc) -> void
+{
+    const RenderRect* rect = desc.clearRect;
+    Validate(RenderCall::BEGIN_RENDER_PASS, CaptureOpcode::BEGIN_RENDER_PASS, { desc.renderTarget, desc.loadOp, desc.storeOp,
+        CaptureFloatToWord(desc.clearColor[0]), CaptureFloatToWord(desc.clearColor[1]), CaptureFloatToWord(desc.clearColor[2]), CaptureFloatToWord(desc.clearColor[3]),
+        rect != nullptr ? 1U : 0U,
+        rect != nullptr ? uint32_t(rect->left) : 0U, rect != nullptr ? uint32_t(rect->top) : 0U,
+        rect != nullptr ? uint32_t(rect->right) : 0U, rect != nullptr ? uint32_t(rect->bottom) : 0U,
+        desc.depthTarget, desc.depthLoadOp, desc.depthStoreOp, CaptureFloatToWord(desc.clearDepth) });
+    m_device.CountRenderPass(desc);
+}
+
+inline auto NullRenderCommandList::EndRenderPass() -> void
+{
+    Validate(RenderCall::END_RENDER_PASS, CaptureOpcode::END_RENDER_PASS, { });
+}
+
+inline auto NullRenderFence::Wait(uint64_t value) -> bool
+{
+    m_device.Record(RenderCall::WAIT_FOR_FENCE);
+    if (m_value < value)
+    {
+        // Nothing is in flight, so the wait would never return on a real device.
+        m_device.ReportError("Wait: the fence value is never signaled");
+        return false;
+    }
+    return true;
+}
+
+inline auto NullRenderCommandQueue::ExecuteCommandList(RenderCommandList& commandList) -> bool
+{
+    m_device.Record(RenderCall::EXECUTE_COMMAND_LIST);
+
+    auto& nullCommandList = static_cast<NullRenderCommandList&>(commandList);
+    if (nullCommandList.GetType() != RenderCommandListType::DIRECT || !nullCommandList.IsClosed())
+    {
+        m_device.ReportError("ExecuteCommandList: not a closed direct command list");
+        return false;
+    }
+    return true;
+}
+
+inline auto NullRenderCommandQueue::Signal(RenderFence& fence, uint64_t value) -> bool
+{
+    m_device.Record(RenderCall::SIGNAL);
+    static_cast<NullRenderFence&>(fence).SetCompletedValue(value);
+    return true;
+}
+
+inline auto NullRenderCommandQueue::Present() -> bool
+{
+    m_device.Record(RenderCall::PRESENT);
+    return true;
+}
@@ -0,0 +1,219 @@
+// ResidencyManager.h : Keeps the video memory in use within the budget the OS grants, by evicting resources in LRU order.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using ResidencyHandle = uint32_t;
+
+static constexpr ResidencyHandle RESIDENCY_INVALID_HANDLE = UINT32_MAX;
+
+// As reported by IDXGIAdapter3::QueryVideoMemoryInfo
+struct ResidencyBudget
+{
+    uint64_t budget;
+    uint64_t currentUsage;
+};
+
+struct ResidencyStats
+{
+    uint64_t trimCount;             // trims that had to evict something
+    uint64_t evictionCount;
+    uint64_t evictedBytes;
+    uint64_t pageInCount;
+    uint64_t pagedInBytes;
+    uint64_t pageInStallCount;      // frames that waited for page-ins
+    double pageInStallTime;         // in milliseconds
+    uint64_t residentBytes;         // of the registered resources, now
+    uint64_t managedBytes;
+    ResidencyBudget lastBudget;
+};
+
+// `Device` pages the native objects in and out, in batches:
+//   using Resource = ...;     // e.g. ID3D12Pageable*
+//   auto MakeResident(const Resource resources[], uint32_t count) -> bool;
+//   auto Evict(const Resource resources[], uint32_t count) -> bool;
+// All the methods are thread safe. The device is only called with the internal lock held.
+template <typename Device>
+class ResidencyManager
+{
+public:
+    using Resource = typename Device::Resource;
+
+    // Trimming brings the usage down to `targetBudgetFraction` of the budget, leaving some room for new allocations.
+    ResidencyManager(Device& device, double targetBudgetFraction) : m_device(device), m_targetBudgetFraction(targetBudgetFraction) { }
+
+    ResidencyManager(const ResidencyManager&) = delete;
+    auto operator = (const ResidencyManager&) -> ResidencyManager& = delete;
+
+    // The resource is resident when it is registered.
+    auto Register(Resource resource, uint64_t size) -> ResidencyHandle
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const Entry entry{ .resource = resource, .size = size, .lastUsedValue = 0, .registered = true, .resident = true, .pageInQueued = false };
+        ResidencyHandle handle = RESIDENCY_INVALID_HANDLE;
+        if (!m_freeHandles.empty())
+        {
+            handle = m_freeHandles.back();
+            m_freeHandles.pop_back();
+            m_entries[handle] = entry;
+        }
+        else
+        {
+            handle = ResidencyHandle(m_entries.size());
+            m_entries.push_back(entry);
+        }
+
+        m_stats.residentBytes += size;
+        m_stats.managedBytes += size;
+        return handle;
+    }
+
+    // The GPU must have finished with the resource. An evicted resource can be released as is.
+    auto Unregister(ResidencyHandle handle) -> void
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Entry& entry = m_entries[handle];
+        if (entry.resident) {
+            m_stats.residentBytes -= entry.size;
+        }
+        m_stats.managedBytes -= entry.size;
+        std::erase(m_pageInBatch, handle);
+        entry = Entry{ };
+        m_freeHandles.push_back(handle);
+    }
+
+    // The frame signaling `fenceValue` uses the resource. Evicted resources are queued to be paged in.
+    auto MarkUsed(ResidencyHandle handle, uint64_t fenceValue) -> void
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Entry& entry = m_entries[handle];
+        if (entry.lastUsedValue < fenceValue) {
+            entry.lastUsedValue = fenceValue;
+        }
+        if (!entry.resident && !entry.pageInQueued)
+        {
+            entry.pageInQueued = true;
+            m_pageInBatch.push_back(handle);
+        }
+    }
+
+    // Page in the evicted resources marked since the last call, before the frame is submitted.
+    auto MakeUsedResident() -> bool
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pageInBatch.empty()) return true;
+
+        m_resourceBatch.clear();
+        uint64_t pagedInBytes = 0;
+        for (auto const handle : m_pageInBatch)
+        {
+            m_resourceBatch.push_back(m_entries[handle].resource);
+            pagedInBytes += m_entries[handle].size;
+        }
+
+        const auto beginTime = std::chrono::steady_clock::now();
+        const bool done = m_device.MakeResident(m_resourceBatch.data(), uint32_t(m_resourceBatch.size()));
+        m_stats.pageInStallTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+        ++m_stats.pageInStallCount;
+        if (!done) return false;
+
+        for (auto const handle : m_pageInBatch)
+        {
+            m_entries[handle].resident = true;
+            m_entries[handle].pageInQueued = false;
+        }
+        m_stats.pageInCount += m_pageInBatch.size();
+        m_stats.pagedInBytes += pagedInBytes;
+        m_stats.residentBytes += pagedInBytes;
+        m_pageInBatch.clear();
+        return true;
+    }
+
+    // Evict the least recently used resources, not used by any frame after `completedValue`, until the usage fits
+    // the target fraction of the budget. Returns the number of evicted resources.
+    auto Trim(const ResidencyBudget& budget, uint64_t completedValue) -> uint32_t
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.lastBudget = budget;
+
+        const auto targetUsage = uint64_t(double(budget.budget) * m_targetBudgetFraction);
+        if (budget.currentUsage <= targetUsage) return 0;
+        const uint64_t excessBytes = budget.currentUsage - targetUsage;
+
+        m_trimCandidates.clear();
+        for (ResidencyHandle handle = 0; handle < ResidencyHandle(m_entries.size()); ++handle)
+        {
+            const Entry& entry = m_entries[handle];
+            if (entry.registered && entry.resident && entry.lastUsedValue <= completedValue) {
+                m_trimCandidates.push_back(handle);
+            }
+        }
+        std::sort(m_trimCandidates.begin(), m_trimCandidates.end(),
+            [this](ResidencyHandle a, ResidencyHandle b) { return m_entries[a].lastUsedValue < m_entries[b].lastUsedValue; });
+
+        m_resourceBatch.clear();
+        uint64_t evictedBytes = 0;
+        size_t evictedCount = 0;
+        while (evictedCount < m_trimCandidates.size() && evictedBytes < excessBytes)
+        {
+            const Entry& entry = m_entries[m_trimCandidates[evictedCount++]];
+            m_resourceBatch.push_back(entry.resource);
+            evictedBytes += entry.size;
+        }
+        if (evictedCount == 0) return 0;
+
+        if (!m_device.Evict(m_resourceBatch.data(), uint32_t(m_resourceBatch.size()))) return 0;
+
+        for (size_t i = 0; i < evictedCount; ++i) {
+            m_entries[m_trimCandidates[i]].resident = false;
+        }
+        ++m_stats.trimCount;
+        m_stats.evictionCount += evictedCount;
+        m_stats.evictedBytes += evictedBytes;
+        m_stats.residentBytes -= evictedBytes;
+        return uint32_t(evictedCount);
+    }
+
+    auto IsResident(ResidencyHandle handle) const -> bool
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_entries[handle].resident;
+    }
+
+    auto GetStats() const -> ResidencyStats
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    struct Entry
+    {
+        Resource resource;
+        uint64_t size;
+        uint64_t lastUsedValue;     // fence value of the last frame that used the resource
+        bool registered;
+        bool resident;
+        bool pageInQueued;
+    };
+
+    Device& m_device;
+    double m_targetBudgetFraction;
+    mutable std::mutex m_mutex;
+    std::vector<Entry> m_entries;               // indexed by handle
+    std::vector<ResidencyHandle> m_freeHandles;
+    std::vector<ResidencyHandle> m_pageInBatch;
+    std::vector<ResidencyHandle> m_trimCandidates;
+    std::vector<Resource> m_resourceBatch;
+    ResidencyStats m_stats{ };
+};
@@ -0,0 +1,326 @@
+// RootSignatureLayout.h : Root parameter layout decision and the hash used to cache serialized root signature blobs.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// A root signature can hold at most 64 DWORDs.
+static constexpr uint32_t ROOT_SIGNATURE_MAX_DWORD_COUNT = 64;
+
+// Root parameter costs in DWORDs
+static constexpr uint32_t ROOT_DESCRIPTOR_TABLE_DWORD_COST = 1;
+static constexpr uint32_t ROOT_DESCRIPTOR_DWORD_COST = 2;
+
+// Constant buffers larger than this will not be inlined into the root signature as root constants.
+static constexpr uint32_t ROOT_CONSTANTS_MAX_INLINE_DWORD_COUNT = 16;
+
+// Descriptor ranges of all the tables of a root signature
+static constexpr uint32_t ROOT_SIGNATURE_MAX_DESCRIPTOR_RANGE_COUNT = 64;
+
+// `DecideRootParameterLayout()` only chooses among the first three; root SRVs and UAVs are declared by fixed layouts.
+enum class RootParameterKind : uint32_t
+{
+    ROOT_CONSTANTS,
+    ROOT_CBV,
+    DESCRIPTOR_TABLE,
+    ROOT_SRV,
+    ROOT_UAV
+};
+
+enum class RootShaderVisibility : uint32_t
+{
+    ALL,
+    VERTEX,
+    PIXEL
+};
+
+// How often the data of a binding changes. Maps to the root signature 1.1 `DATA_*` flags.
+enum class RootDataVolatility : uint32_t
+{
+    STATIC,                         // set once and never changes afterward
+    STATIC_WHILE_SET_AT_EXECUTE,    // does not change while the command list that sets it is executing
+    VOLATILE                        // may change at any time, e.g. updated every frame
+};
+
+struct RootConstantBufferBinding
+{
+    uint32_t shaderRegister;
+    uint32_t registerSpace;
+    uint32_t sizeInDwords;
+    RootShaderVisibility visibility;
+    RootDataVolatility volatility;
+    bool descriptorsVolatile;       // the descriptor of its table may be rewritten after the table is set, until the command list executes
+};
+
+struct RootParameterLayout
+{
+    RootParameterKind kinds[ROOT_SIGNATURE_MAX_DWORD_COUNT];
+    uint32_t parameterCount;
+    uint32_t totalDwordCount;
+};
+
+static constexpr auto GetRootParameterDwordCost(RootParameterKind kind, uint32_t sizeInDwords) -> uint32_t
+{
+    switch (kind)
+    {
+    case RootParameterKind::ROOT_CONSTANTS:
+        return sizeInDwords;
+
+    case RootParameterKind::ROOT_CBV:
+    case RootParameterKind::ROOT_SRV:
+    case RootParameterKind::ROOT_UAV:
+        return ROOT_DESCRIPTOR_DWORD_COST;
+
+    case RootParameterKind::DESCRIPTOR_TABLE:
+    default:
+        return ROOT_DESCRIPTOR_TABLE_DWORD_COST;
+    }
+}
+
+// Decide the root parameter kind of each binding within `dwordBudget`.
+// Every binding starts as a descriptor table, the cheapest in root signature space but the most indirect.
+// Then bindings are promoted in the order of their volatility (most volatile first) and then size (smallest first):
+// to root constants if it is small enough, otherwise to a root CBV, as long as the budget allows.
+// Returns false if even descriptor tables for all the bindings do not fit in the budget.
+static constexpr auto DecideRootParameterLayout(const RootConstantBufferBinding bindings[], uint32_t bindingCount,
+    uint32_t dwordBudget, RootParameterLayout& layout) -> bool
+{
+    layout = { };
+    if (dwordBudget > ROOT_SIGNATURE_MAX_DWORD_COUNT) {
+        dwordBudget = ROOT_SIGNATURE_MAX_DWORD_COUNT;
+    }
+
+    if (bindingCount > ROOT_SIGNATURE_MAX_DWORD_COUNT || bindingCount * ROOT_DESCRIPTOR_TABLE_DWORD_COST > dwordBudget) return false;
+
+    layout.parameterCount = bindingCount;
+    layout.totalDwordCount = bindingCount * ROOT_DESCRIPTOR_TABLE_DWORD_COST;
+
+    uint32_t order[ROOT_SIGNATURE_MAX_DWORD_COUNT]{ };
+    for (uint32_t i = 0; i < bindingCount; ++i)
+    {
+        layout.kinds[i] = RootParameterKind::DESCRIPTOR_TABLE;
+        order[i] = i;
+    }
+
+    // Stable insertion sort keeps the declaration order for equal priorities, so the layout is deterministic.
+    for (uint32_t i = 1; i < bindingCount; ++i)
+    {
+        const uint32_t current = order[i];
+        uint32_t j = i;
+        for (; j > 0; --j)
+        {
+            auto const& lhs = bindings[order[j - 1]];
+            auto const& rhs = bindings[current];
+            const bool higherPriority = uint32_t(rhs.volatility) > uint32_t(lhs.volatility) ||
+                (rhs.volatility == lhs.volatility && rhs.sizeInDwords < lhs.sizeInDwords);
+            if (!higherPriority) break;
+
+            order[j] = order[j - 1];
+        }
+        order[j] = current;
+    }
+
+    for (uint32_t i = 0; i < bindingCount; ++i)
+    {
+        const uint32_t index = order[i];
+        auto const& binding = bindings[index];
+        const uint32_t baseDwordCount = layout.totalDwordCount - ROOT_DESCRIPTOR_TABLE_DWORD_COST;
+
+        if (binding.sizeInDwords <= ROOT_CONSTANTS_MAX_INLINE_DWORD_COUNT &&
+            baseDwordCount + GetRootParameterDwordCost(RootParameterKind::ROOT_CONSTANTS, binding.sizeInDwords) <= dwordBudget)
+        {
+            layout.kinds[index] = RootParameterKind::ROOT_CONSTANTS;
+        }
+        else if (baseDwordCount + ROOT_DESCRIPTOR_DWORD_COST <= dwordBudget) {
+            layout.kinds[index] = RootParameterKind::ROOT_CBV;
+        }
+
+        layout.totalDwordCount = baseDwordCount + GetRootParameterDwordCost(layout.kinds[index], binding.sizeInDwords);
+    }
+
+    return true;
+}
+
+// Root signature 1.1 flags of root descriptors and descriptor ranges, with the values of `D3D12_ROOT_DESCRIPTOR_FLAGS`
+// and `D3D12_DESCRIPTOR_RANGE_FLAGS`
+static constexpr uint32_t ROOT_FLAG_NONE = 0;
+static constexpr uint32_t ROOT_FLAG_DESCRIPTORS_VOLATILE = 0x1;     // descriptor ranges only
+static constexpr uint32_t ROOT_FLAG_DATA_VOLATILE = 0x2;
+static constexpr uint32_t ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE = 0x4;
+static constexpr uint32_t ROOT_FLAG_DATA_STATIC = 0x8;
+
+static constexpr auto GetRootDataFlags(RootDataVolatility volatility) -> uint32_t
+{
+    switch (volatility)
+    {
+    case RootDataVolatility::STATIC:
+        return ROOT_FLAG_DATA_STATIC;
+
+    case RootDataVolatility::STATIC_WHILE_SET_AT_EXECUTE:
+        return ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE;
+
+    case RootDataVolatility::VOLATILE:
+    default:
+        return ROOT_FLAG_DATA_VOLATILE;
+    }
+}
+
+// `DESCRIPTORS_VOLATILE` is only set for ranges whose descriptors really change after the table is set. Root signature 1.1
+// does not allow it with `DATA_STATIC`, so static data is then only promised to be static while set at execute.
+static constexpr auto GetDescriptorRangeFlags(RootDataVolatility volatility, bool descriptorsVolatile) -> uint32_t
+{
+    if (!descriptorsVolatile) {
+        return GetRootDataFlags(volatility);
+    }
+    return ROOT_FLAG_DESCRIPTORS_VOLATILE | (volatility == RootDataVolatility::VOLATILE ?
+        ROOT_FLAG_DATA_VOLATILE : ROOT_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+}
+
+// The flags of the root parameter or descriptor range of `binding` once it is laid out as `kind`; root constants have none.
+static constexpr auto GetRootParameterFlags(const RootConstantBufferBinding& binding, RootParameterKind kind) -> uint32_t
+{
+    switch (kind)
+    {
+    case RootParameterKind::ROOT_CONSTANTS:
+        return ROOT_FLAG_NONE;
+
+    case RootParameterKind::ROOT_CBV:
+    case RootParameterKind::ROOT_SRV:
+    case RootParameterKind::ROOT_UAV:
+        return GetRootDataFlags(binding.volatility);
+
+    case RootParameterKind::DESCRIPTOR_TABLE:
+    default:
+        return GetDescriptorRangeFlags(binding.volatility, binding.descriptorsVolatile);
+    }
+}
+
+enum class RootDescriptorRangeType : uint32_t
+{
+    SRV,
+    UAV,
+    CBV
+};
+
+struct RootDescriptorRange
+{
+    RootDescriptorRangeType type;
+    uint32_t descriptorCount;
+    uint32_t baseShaderRegister;
+    uint32_t registerSpace;
+    uint32_t offsetInDescriptorsFromTableStart;
+    RootDataVolatility volatility;
+    bool descriptorsVolatile;
+};
+
+// A root parameter of a fixed layout. The root parameters of the passes are bound by index, so their layout is not decided.
+struct RootParameterDesc
+{
+    RootParameterKind kind;
+    RootShaderVisibility visibility;
+    uint32_t shaderRegister;                // root constants and root descriptors
+    uint32_t registerSpace;
+    uint32_t sizeInDwords;                  // root constants
+    RootDataVolatility volatility;          // root descriptors
+    const RootDescriptorRange* ranges;      // descriptor tables
+    uint32_t rangeCount;
+};
+
+// Root descriptors only; the flags of a table are those of its ranges.
+static constexpr auto GetRootParameterDescFlags(const RootParameterDesc& parameter) -> uint32_t
+{
+    switch (parameter.kind)
+    {
+    case RootParameterKind::ROOT_CBV:
+    case RootParameterKind::ROOT_SRV:
+    case RootParameterKind::ROOT_UAV:
+        return GetRootDataFlags(parameter.volatility);
+
+    default:
+        return ROOT_FLAG_NONE;
+    }
+}
+
+static constexpr auto GetRootParameterDescDwordCount(const RootParameterDesc parameters[], uint32_t parameterCount) -> uint32_t
+{
+    uint32_t dwordCount = 0;
+    for (uint32_t i = 0; i < parameterCount; ++i) {
+        dwordCount += GetRootParameterDwordCost(parameters[i].kind, parameters[i].sizeInDwords);
+    }
+    return dwordCount;
+}
+
+// The fixed layout of `bindings` once laid out by `DecideRootParameterLayout()`. A table gets the single CBV range `ranges[i]`.
+static constexpr auto GetRootParameterDescs(const RootConstantBufferBinding bindings[], const RootParameterLayout& layout,
+    RootParameterDesc parameters[], RootDescriptorRange ranges[]) -> void
+{
+    for (uint32_t i = 0; i < layout.parameterCount; ++i)
+    {
+        auto const& binding = bindings[i];
+        ranges[i] = {
+            .type = RootDescriptorRangeType::CBV,
+            .descriptorCount = 1,
+            .baseShaderRegister = binding.shaderRegister,
+            .registerSpace = binding.registerSpace,
+            .offsetInDescriptorsFromTableStart = 0,
+            .volatility = binding.volatility,
+            .descriptorsVolatile = binding.descriptorsVolatile
+        };
+        const bool isTable = layout.kinds[i] == RootParameterKind::DESCRIPTOR_TABLE;
+        parameters[i] = {
+            .kind = layout.kinds[i],
+            .visibility = binding.visibility,
+            .shaderRegister = binding.shaderRegister,
+            .registerSpace = binding.registerSpace,
+            .sizeInDwords = binding.sizeInDwords,
+            .volatility = binding.volatility,
+            .ranges = isTable ? &ranges[i] : nullptr,
+            .rangeCount = isTable ? 1U : 0U
+        };
+    }
+}
+
+// FNV-1a 64-bit hash, used as the key of the serialized root signature blob cache
+static constexpr uint64_t FNV1A_64_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FNV1A_64_PRIME = 0x100000001b3ULL;
+
+static inline auto HashFNV1a64(const void* data, size_t size, uint64_t hash = FNV1A_64_OFFSET_BASIS) -> uint64_t
+{
+    auto const bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A_64_PRIME;
+    }
+    return hash;
+}
+
+// Static samplers are hashed by the caller, as they have no portable description.
+static inline auto HashRootParameterDescs(uint32_t rootSignatureVersion, uint32_t flags, const RootParameterDesc parameters[],
+    uint32_t parameterCount) -> uint64_t
+{
+    uint64_t hash = HashFNV1a64(&rootSignatureVersion, sizeof(rootSignatureVersion));
+    hash = HashFNV1a64(&flags, sizeof(flags), hash);
+    for (uint32_t i = 0; i < parameterCount; ++i)
+    {
+        auto const& parameter = parameters[i];
+        const uint32_t fields[] = {
+            uint32_t(parameter.kind), uint32_t(parameter.visibility), parameter.shaderRegister, parameter.registerSpace,
+            parameter.sizeInDwords, GetRootParameterDescFlags(parameter), parameter.rangeCount
+        };
+        hash = HashFNV1a64(fields, sizeof(fields), hash);
+
+        for (uint32_t j = 0; j < parameter.rangeCount; ++j)
+        {
+            auto const& range = parameter.ranges[j];
+            const uint32_t rangeFields[] = {
+                uint32_t(range.type), range.descriptorCount, range.baseShaderRegister, range.registerSpace,
+                range.offsetInDescriptorsFromTableStart, GetDescriptorRangeFlags(range.volatility, range.descriptorsVolatile)
+            };
+            hash = HashFNV1a64(rangeFields, sizeof(rangeFields), hash);
+        }
+    }
+    return hash;
+}
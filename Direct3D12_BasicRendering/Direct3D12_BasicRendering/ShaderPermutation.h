@@ -0,0 +1,192 @@
+// ShaderPermutation.h : Compile-time shader permutation keys and the packed shader bytecode archive.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+enum class ShaderStage : uint32_t
+{
+    VERTEX,
+    PIXEL,
+    COUNT
+};
+
+// Feature bits of the basic shaders
+enum BasicShaderFeature : uint32_t
+{
+    BASIC_SHADER_FEATURE_NONE = 0,
+    BASIC_SHADER_FEATURE_ROTATION = 1U << 0,            // rotate around the Z axis by the root constant angle
+    BASIC_SHADER_FEATURE_ORTHO_PROJECTION = 1U << 1,    // model-view translation plus orthographic projection
+    BASIC_SHADER_FEATURE_GRAYSCALE = 1U << 2            // output the luminance of the vertex color
+};
+
+static constexpr uint32_t BASIC_SHADER_FEATURE_BIT_COUNT = 3;
+static constexpr uint32_t BASIC_SHADER_PERMUTATION_KEY_COUNT = 1U << BASIC_SHADER_FEATURE_BIT_COUNT;
+
+struct ShaderFeatureDefine
+{
+    uint32_t featureBit;
+    ShaderStage stage;
+    const char* defineName;
+};
+
+static constexpr ShaderFeatureDefine BASIC_SHADER_FEATURE_DEFINES[] = {
+    { BASIC_SHADER_FEATURE_ROTATION, ShaderStage::VERTEX, "ENABLE_ROTATION" },
+    { BASIC_SHADER_FEATURE_ORTHO_PROJECTION, ShaderStage::VERTEX, "ENABLE_ORTHO_PROJECTION" },
+    { BASIC_SHADER_FEATURE_GRAYSCALE, ShaderStage::PIXEL, "ENABLE_GRAYSCALE" }
+};
+
+static constexpr uint32_t BASIC_SHADER_PERMUTATION_DEFAULT = BASIC_SHADER_FEATURE_ROTATION | BASIC_SHADER_FEATURE_ORTHO_PROJECTION;
+
+// The permutations the renderer actually uses. Only these will be compiled and have PSOs created.
+static constexpr uint32_t BASIC_SHADER_PERMUTATIONS_IN_USE[] = {
+    BASIC_SHADER_PERMUTATION_DEFAULT,
+    BASIC_SHADER_PERMUTATION_DEFAULT | BASIC_SHADER_FEATURE_GRAYSCALE
+};
+
+// Mask of the feature bits that affect the specified shader stage
+static constexpr auto GetShaderStageFeatureMask(ShaderStage stage) -> uint32_t
+{
+    uint32_t mask = 0;
+    for (auto const& define : BASIC_SHADER_FEATURE_DEFINES)
+    {
+        if (define.stage == stage) {
+            mask |= define.featureBit;
+        }
+    }
+    return mask;
+}
+
+// Permutations that differ only in bits of other stages share the same bytecode of this stage.
+static constexpr auto GetShaderStageKey(ShaderStage stage, uint32_t permutationKey) -> uint32_t
+{
+    return permutationKey & GetShaderStageFeatureMask(stage);
+}
+
+static constexpr auto IsShaderPermutationInUse(uint32_t permutationKey) -> bool
+{
+    for (auto const key : BASIC_SHADER_PERMUTATIONS_IN_USE)
+    {
+        if (key == permutationKey) return true;
+    }
+    return false;
+}
+
+static_assert(BASIC_SHADER_PERMUTATION_KEY_COUNT <= 32, "Too many feature bits for the flat permutation tables");
+static_assert(IsShaderPermutationInUse(BASIC_SHADER_PERMUTATION_DEFAULT), "The default permutation must be in use");
+
+// ==== Packed shader bytecode archive ====
+// [ShaderArchiveHeader][ShaderArchiveEntry * entryCount][bytecode blobs, each aligned to 4 bytes]
+
+static constexpr uint32_t SHADER_ARCHIVE_MAGIC = 0x4B415053U;     // 'SPAK'
+static constexpr uint32_t SHADER_ARCHIVE_VERSION = 1;
+
+struct ShaderArchiveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+struct ShaderArchiveEntry
+{
+    uint32_t stage;
+    uint32_t stageKey;
+    uint32_t offset;        // from the beginning of the archive
+    uint32_t size;
+};
+
+struct ShaderArchiveBlob
+{
+    ShaderStage stage;
+    uint32_t stageKey;
+    const void* bytecode;
+    size_t size;
+};
+
+// Parsed view of an archive. It does not own the archive data.
+struct ShaderArchive
+{
+    const uint8_t* data;
+    // Direct index of [stage][stageKey], -1 for absent
+    int32_t entryIndices[size_t(ShaderStage::COUNT)][BASIC_SHADER_PERMUTATION_KEY_COUNT];
+    const ShaderArchiveEntry* entries;
+};
+
+static inline auto PackShaderArchive(const ShaderArchiveBlob blobs[], uint32_t blobCount) -> std::vector<uint8_t>
+{
+    size_t totalSize = sizeof(ShaderArchiveHeader) + sizeof(ShaderArchiveEntry) * blobCount;
+    for (uint32_t i = 0; i < blobCount; ++i) {
+        totalSize += (blobs[i].size + 3) & ~size_t(3);
+    }
+
+    std::vector<uint8_t> archive(totalSize, 0);
+
+    const ShaderArchiveHeader header{
+        .magic = SHADER_ARCHIVE_MAGIC,
+        .version = SHADER_ARCHIVE_VERSION,
+        .entryCount = blobCount,
+        .reserved = 0
+    };
+    memcpy(archive.data(), &header, sizeof(header));
+
+    size_t offset = sizeof(ShaderArchiveHeader) + sizeof(ShaderArchiveEntry) * blobCount;
+    for (uint32_t i = 0; i < blobCount; ++i)
+    {
+        const ShaderArchiveEntry entry{
+            .stage = uint32_t(blobs[i].stage),
+            .stageKey = blobs[i].stageKey,
+            .offset = uint32_t(offset),
+            .size = uint32_t(blobs[i].size)
+        };
+        memcpy(&archive[sizeof(ShaderArchiveHeader) + sizeof(ShaderArchiveEntry) * i], &entry, sizeof(entry));
+        memcpy(&archive[offset], blobs[i].bytecode, blobs[i].size);
+        offset += (blobs[i].size + 3) & ~size_t(3);
+    }
+
+    return archive;
+}
+
+// Validate the archive and build the lookup table. `data` must be 4-byte aligned and outlive `archive`.
+static inline auto ParseShaderArchive(const uint8_t* data, size_t size, ShaderArchive& archive) -> bool
+{
+    memset(&archive, 0, sizeof(archive));
+    memset(archive.entryIndices, 0xff, sizeof(archive.entryIndices));
+
+    if (data == nullptr || size < sizeof(ShaderArchiveHeader)) return false;
+
+    auto const header = (const ShaderArchiveHeader*)data;
+    if (header->magic != SHADER_ARCHIVE_MAGIC || header->version != SHADER_ARCHIVE_VERSION) return false;
+    if (size < sizeof(ShaderArchiveHeader) + sizeof(ShaderArchiveEntry) * size_t(header->entryCount)) return false;
+
+    auto const entries = (const ShaderArchiveEntry*)(data + sizeof(ShaderArchiveHeader));
+    for (uint32_t i = 0; i < header->entryCount; ++i)
+    {
+        auto const& entry = entries[i];
+        if (entry.stage >= uint32_t(ShaderStage::COUNT) || entry.stageKey >= BASIC_SHADER_PERMUTATION_KEY_COUNT) return false;
+        if (size_t(entry.offset) + size_t(entry.size) > size) return false;
+
+        archive.entryIndices[entry.stage][entry.stageKey] = int32_t(i);
+    }
+
+    archive.data = data;
+    archive.entries = entries;
+    return true;
+}
+
+static inline auto FindShaderInArchive(const ShaderArchive& archive, ShaderStage stage, uint32_t stageKey, size_t& size) -> const void*
+{
+    size = 0;
+    if (archive.data == nullptr || stageKey >= BASIC_SHADER_PERMUTATION_KEY_COUNT) return nullptr;
+
+    const int32_t index = archive.entryIndices[size_t(stage)][stageKey];
+    if (index < 0) return nullptr;
+
+    size = archive.entries[index].size;
+    return archive.data + archive.entries[index].offset;
+}
@@ -0,0 +1,253 @@
+// StartupTaskGraph.h : Dependency-aware task graph that runs the startup steps of the application on a thread pool.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using StartupTaskId = uint32_t;
+
+static constexpr StartupTaskId STARTUP_INVALID_TASK = UINT32_MAX;
+
+enum class StartupTaskAffinity : uint32_t
+{
+    ANY_THREAD,
+    MAIN_THREAD         // the thread calling `Run`
+};
+
+enum class StartupTaskState : uint32_t
+{
+    PENDING,
+    SUCCEEDED,
+    FAILED,
+    SKIPPED             // a dependency failed or was skipped
+};
+
+struct StartupTaskTiming
+{
+    double beginTime;   // in milliseconds since `Run` was called
+    double endTime;
+    uint32_t threadIndex;   // 0 for the main thread, and 1 to the worker count for the workers
+};
+
+class StartupTaskGraph
+{
+public:
+    // A task can only depend on the tasks added before it, so the graph never has a cycle.
+    // Returns STARTUP_INVALID_TASK if a dependency is not a task of the graph.
+    auto AddTask(const char* name, std::function<bool()> function, const std::vector<StartupTaskId>& dependencies = { },
+        StartupTaskAffinity affinity = StartupTaskAffinity::ANY_THREAD) -> StartupTaskId
+    {
+        const auto taskId = StartupTaskId(m_tasks.size());
+        for (auto const dependency : dependencies)
+        {
+            if (dependency >= taskId) return STARTUP_INVALID_TASK;
+        }
+
+        m_tasks.push_back(Task{ .name = name, .function = std::move(function), .dependents { }, .dependencyCount = uint32_t(dependencies.size()),
+            .affinity = affinity, .state = StartupTaskState::PENDING, .timing { } });
+        for (auto const dependency : dependencies) {
+            m_tasks[dependency].dependents.push_back(taskId);
+        }
+        return taskId;
+    }
+
+    // Run all the tasks with `workerCount` threads besides the calling one, which may be zero. It can only be called once.
+    // Returns true if every task succeeded.
+    auto Run(uint32_t workerCount) -> bool
+    {
+        m_beginTime = Clock::now();
+        m_workerCount = workerCount;
+
+        std::vector<uint32_t> remainingDependencyCounts(m_tasks.size());
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < m_tasks.size(); ++i)
+            {
+                remainingDependencyCounts[i] = m_tasks[i].dependencyCount;
+                if (m_tasks[i].dependencyCount == 0) {
+                    PushReady(StartupTaskId(i));
+                }
+            }
+            m_remainingDependencyCounts = std::move(remainingDependencyCounts);
+        }
+
+        std::vector<std::thread> workers;
+        workers.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; ++i) {
+            workers.emplace_back([this, i] { RunTasks(i + 1); });
+        }
+        RunTasks(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        m_endTime = Clock::now();
+
+        for (auto const& task : m_tasks)
+        {
+            if (task.state != StartupTaskState::SUCCEEDED) return false;
+        }
+        return true;
+    }
+
+    auto GetTaskCount() const -> size_t { return m_tasks.size(); }
+
+    auto GetWorkerCount() const -> uint32_t { return m_workerCount; }
+
+    auto GetTaskName(StartupTaskId taskId) const -> const char* { return m_tasks[taskId].name; }
+
+    auto GetTaskState(StartupTaskId taskId) const -> StartupTaskState { return m_tasks[taskId].state; }
+
+    auto GetTaskTiming(StartupTaskId taskId) const -> const StartupTaskTiming& { return m_tasks[taskId].timing; }
+
+    // Wall time of `Run` in milliseconds
+    auto GetTotalTime() const -> double { return ToMilliseconds(m_endTime - m_beginTime); }
+
+    // Sum of the task times, i.e. the time the tasks would take one after another
+    auto GetSerialTime() const -> double
+    {
+        double serialTime = 0.0;
+        for (auto const& task : m_tasks) {
+            serialTime += task.timing.endTime - task.timing.beginTime;
+        }
+        return serialTime;
+    }
+
+    // Longest chain of dependent task times, which bounds the wall time however many threads there are
+    auto GetCriticalPathTime() const -> double
+    {
+        // Dependencies always come before their dependents, so the tasks are in a topological order.
+        std::vector<double> pathTimes(m_tasks.size(), 0.0);
+        double criticalPathTime = 0.0;
+        for (size_t i = 0; i < m_tasks.size(); ++i)
+        {
+            pathTimes[i] += m_tasks[i].timing.endTime - m_tasks[i].timing.beginTime;
+            for (auto const dependent : m_tasks[i].dependents)
+            {
+                if (pathTimes[dependent] < pathTimes[i]) {
+                    pathTimes[dependent] = pathTimes[i];
+                }
+            }
+            if (criticalPathTime < pathTimes[i]) {
+                criticalPathTime = pathTimes[i];
+            }
+        }
+        return criticalPathTime;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task
+    {
+        const char* name;
+        std::function<bool()> function;
+        std::vector<StartupTaskId> dependents;
+        uint32_t dependencyCount;
+        StartupTaskAffinity affinity;
+        StartupTaskState state;
+        StartupTaskTiming timing;
+    };
+
+    static auto ToMilliseconds(Clock::duration duration) -> double { return std::chrono::duration<double, std::milli>(duration).count(); }
+
+    // The mutex must be locked.
+    auto PushReady(StartupTaskId taskId) -> void
+    {
+        if (m_tasks[taskId].affinity == StartupTaskAffinity::MAIN_THREAD) {
+            m_readyMainTasks.push_back(taskId);
+        }
+        else {
+            m_readyTasks.push_back(taskId);
+        }
+    }
+
+    // The mutex must be locked.
+    auto Skip(StartupTaskId taskId) -> void
+    {
+        for (auto const dependent : m_tasks[taskId].dependents)
+        {
+            if (m_tasks[dependent].state == StartupTaskState::PENDING)
+            {
+                m_tasks[dependent].state = StartupTaskState::SKIPPED;
+                ++m_finishedCount;
+                Skip(dependent);
+            }
+        }
+    }
+
+    auto RunTasks(uint32_t threadIndex) -> void
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            StartupTaskId taskId = STARTUP_INVALID_TASK;
+            // The main thread runs its own tasks first, since no other thread can.
+            if (threadIndex == 0 && !m_readyMainTasks.empty())
+            {
+                taskId = m_readyMainTasks.front();
+                m_readyMainTasks.erase(m_readyMainTasks.begin());
+            }
+            else if (!m_readyTasks.empty())
+            {
+                taskId = m_readyTasks.front();
+                m_readyTasks.erase(m_readyTasks.begin());
+            }
+            else if (m_finishedCount == m_tasks.size()) {
+                break;
+            }
+            else
+            {
+                m_condition.wait(lock);
+                continue;
+            }
+
+            // A task may have been skipped after it became ready.
+            Task& task = m_tasks[taskId];
+            if (task.state != StartupTaskState::PENDING) continue;
+
+            lock.unlock();
+            const auto beginTime = Clock::now();
+            const bool succeeded = task.function();
+            const auto endTime = Clock::now();
+            lock.lock();
+
+            task.timing = StartupTaskTiming{ .beginTime = ToMilliseconds(beginTime - m_beginTime), .endTime = ToMilliseconds(endTime - m_beginTime), .threadIndex = threadIndex };
+            task.state = succeeded ? StartupTaskState::SUCCEEDED : StartupTaskState::FAILED;
+            ++m_finishedCount;
+
+            if (succeeded)
+            {
+                for (auto const dependent : task.dependents)
+                {
+                    if (--m_remainingDependencyCounts[dependent] == 0 && m_tasks[dependent].state == StartupTaskState::PENDING) {
+                        PushReady(dependent);
+                    }
+                }
+            }
+            else {
+                Skip(taskId);
+            }
+            m_condition.notify_all();
+        }
+    }
+
+    std::vector<Task> m_tasks;
+    std::vector<uint32_t> m_remainingDependencyCounts;
+    std::vector<StartupTaskId> m_readyTasks;        // in the order they became ready
+    std::vector<StartupTaskId> m_readyMainTasks;
+    size_t m_finishedCount = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    Clock::time_point m_beginTime{ };
+    Clock::time_point m_endTime{ };
+    uint32_t m_workerCount = 0;
+};
@@ -0,0 +1,740 @@
+// TextureStreaming.h : Block-compressed DDS textures whose mip levels are streamed in lowest resolution first, within a memory budget.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t DDS_MAGIC = 0x20534444;              // "DDS "
+static constexpr size_t DDS_HEADER_SIZE = 4 + 124;              // the magic and DDS_HEADER
+static constexpr size_t DDS_DX10_HEADER_SIZE = 20;              // DDS_HEADER_DXT10
+static constexpr uint32_t TEXTURE_MAX_MIP_COUNT = 15;           // 16384 x 16384
+static constexpr uint32_t TEXTURE_MAX_DIMENSION = 1U << (TEXTURE_MAX_MIP_COUNT - 1);
+static constexpr uint32_t TEXTURE_BC_BLOCK_DIMENSION = 4;
+static constexpr uint32_t TEXTURE_STREAMING_TAIL_DIMENSION = 64;   // mips up to this size are loaded with the first request, and never dropped
+static constexpr uint32_t TEXTURE_STREAMING_INVALID_TEXTURE = UINT32_MAX;
+
+// The values of DXGI_FORMAT
+enum class TextureFormat : uint32_t
+{
+    UNKNOWN = 0,
+    BC1_UNORM = 71,
+    BC1_UNORM_SRGB = 72,
+    BC2_UNORM = 74,
+    BC2_UNORM_SRGB = 75,
+    BC3_UNORM = 77,
+    BC3_UNORM_SRGB = 78,
+    BC4_UNORM = 80,
+    BC4_SNORM = 81,
+    BC5_UNORM = 83,
+    BC5_SNORM = 84,
+    BC6H_UF16 = 95,
+    BC6H_SF16 = 96,
+    BC7_UNORM = 98,
+    BC7_UNORM_SRGB = 99
+};
+
+// ==== DDS files ====
+
+struct DdsMipLevel
+{
+    size_t offset;              // from the beginning of the file
+    size_t size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;          // bytes per row of blocks
+    uint32_t rowCount;          // rows of blocks
+};
+
+struct DdsTexture
+{
+    TextureFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t blockSize;         // 8 bytes for BC1 and BC4, 16 for the others
+    DdsMipLevel mips[TEXTURE_MAX_MIP_COUNT];
+};
+
+enum class DdsParseResult : uint32_t
+{
+    OK,
+    BAD_MAGIC,
+    BAD_HEADER,
+    UNSUPPORTED_FORMAT,         // not BC1 to BC7
+    UNSUPPORTED_DIMENSION,      // cube maps, volumes and arrays
+    TRUNCATED
+};
+
+static inline auto GetDdsParseResultName(DdsParseResult result) -> const char*
+{
+    switch (result)
+    {
+    case DdsParseResult::OK:
+        return "OK";
+    case DdsParseResult::BAD_MAGIC:
+        return "not a DDS file";
+    case DdsParseResult::BAD_HEADER:
+        return "bad header";
+    case DdsParseResult::UNSUPPORTED_FORMAT:
+        return "not block-compressed with BC1 to BC7";
+    case DdsParseResult::UNSUPPORTED_DIMENSION:
+        return "not a single 2D texture";
+    case DdsParseResult::TRUNCATED:
+        return "truncated";
+    }
+    return "unknown";
+}
+
+static inline auto LoadDdsUInt32(const uint8_t* data, size_t offset) -> uint32_t
+{
+    uint32_t value = 0;
+    memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+static constexpr auto MakeDdsFourCC(char a, char b, char c, char d) -> uint32_t
+{
+    return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+// The format of a legacy FourCC, or UNKNOWN
+static inline auto GetDdsFourCCFormat(uint32_t fourCC) -> TextureFormat
+{
+    switch (fourCC)
+    {
+    case MakeDdsFourCC('D', 'X', 'T', '1'):
+        return TextureFormat::BC1_UNORM;
+    case MakeDdsFourCC('D', 'X', 'T', '2'):
+    case MakeDdsFourCC('D', 'X', 'T', '3'):
+        return TextureFormat::BC2_UNORM;
+    case MakeDdsFourCC('D', 'X', 'T', '4'):
+    case MakeDdsFourCC('D', 'X', 'T', '5'):
+        return TextureFormat::BC3_UNORM;
+    case MakeDdsFourCC('A', 'T', 'I', '1'):
+    case MakeDdsFourCC('B', 'C', '4', 'U'):
+        return TextureFormat::BC4_UNORM;
+    case MakeDdsFourCC('B', 'C', '4', 'S'):
+        return TextureFormat::BC4_SNORM;
+    case MakeDdsFourCC('A', 'T', 'I', '2'):
+    case MakeDdsFourCC('B', 'C', '5', 'U'):
+        return TextureFormat::BC5_UNORM;
+    case MakeDdsFourCC('B', 'C', '5', 'S'):
+        return TextureFormat::BC5_SNORM;
+    default:
+        return TextureFormat::UNKNOWN;
+    }
+}
+
+// The format of a DX10 header, or UNKNOWN. The typeless formats are read as UNORM.
+static inline auto GetDdsDxgiFormat(uint32_t dxgiFormat) -> TextureFormat
+{
+    switch (dxgiFormat)
+    {
+    case 70:
+        return TextureFormat::BC1_UNORM;
+    case 73:
+        return TextureFormat::BC2_UNORM;
+    case 76:
+        return TextureFormat::BC3_UNORM;
+    case 79:
+        return TextureFormat::BC4_UNORM;
+    case 82:
+        return TextureFormat::BC5_UNORM;
+    case 94:
+        return TextureFormat::BC6H_UF16;
+    case 97:
+        return TextureFormat::BC7_UNORM;
+    case uint32_t(TextureFormat::BC1_UNORM):
+    case uint32_t(TextureFormat::BC1_UNORM_SRGB):
+    case uint32_t(TextureFormat::BC2_UNORM):
+    case uint32_t(TextureFormat::BC2_UNORM_SRGB):
+    case uint32_t(TextureFormat::BC3_UNORM):
+    case uint32_t(TextureFormat::BC3_UNORM_SRGB):
+    case uint32_t(TextureFormat::BC4_UNORM):
+    case uint32_t(TextureFormat::BC4_SNORM):
+    case uint32_t(TextureFormat::BC5_UNORM):
+    case uint32_t(TextureFormat::BC5_SNORM):
+    case uint32_t(TextureFormat::BC6H_UF16):
+    case uint32_t(TextureFormat::BC6H_SF16):
+    case uint32_t(TextureFormat::BC7_UNORM):
+    case uint32_t(TextureFormat::BC7_UNORM_SRGB):
+        return TextureFormat(dxgiFormat);
+    default:
+        return TextureFormat::UNKNOWN;
+    }
+}
+
+static constexpr auto GetTextureBlockSize(TextureFormat format) -> uint32_t
+{
+    switch (format)
+    {
+    case TextureFormat::BC1_UNORM:
+    case TextureFormat::BC1_UNORM_SRGB:
+    case TextureFormat::BC4_UNORM:
+    case TextureFormat::BC4_SNORM:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+// Lay out `mipCount` mips of `width` x `height` texels one after the other, from `dataOffset`. Returns the end of the last mip.
+static inline auto LayoutDdsMips(DdsTexture& texture, size_t dataOffset) -> size_t
+{
+    size_t offset = dataOffset;
+    for (uint32_t mip = 0; mip < texture.mipCount; ++mip)
+    {
+        DdsMipLevel& level = texture.mips[mip];
+        level.width = std::max(texture.width >> mip, 1U);
+        level.height = std::max(texture.height >> mip, 1U);
+        level.rowPitch = (level.width + TEXTURE_BC_BLOCK_DIMENSION - 1) / TEXTURE_BC_BLOCK_DIMENSION * texture.blockSize;
+        level.rowCount = (level.height + TEXTURE_BC_BLOCK_DIMENSION - 1) / TEXTURE_BC_BLOCK_DIMENSION;
+        level.offset = offset;
+        level.size = size_t(level.rowPitch) * level.rowCount;
+        offset += level.size;
+    }
+    return offset;
+}
+
+// Read the header of the DDS file of `size` bytes at `data`, which must hold a single 2D texture with BC1 to BC7 data.
+// The mips are not read, only checked to be within the file.
+static inline auto ParseDdsTexture(const uint8_t* data, size_t size, DdsTexture& texture) -> DdsParseResult
+{
+    if (size < DDS_HEADER_SIZE || LoadDdsUInt32(data, 0) != DDS_MAGIC) return DdsParseResult::BAD_MAGIC;
+
+    // DDS_HEADER, after the magic
+    constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    constexpr uint32_t DDPF_FOURCC = 0x4;
+    constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+    constexpr uint32_t DDSCAPS2_VOLUME = 0x200000;
+    constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+    constexpr uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+    const uint32_t headerSize = LoadDdsUInt32(data, 4);
+    const uint32_t flags = LoadDdsUInt32(data, 8);
+    const uint32_t height = LoadDdsUInt32(data, 12);
+    const uint32_t width = LoadDdsUInt32(data, 16);
+    const uint32_t mipCount = LoadDdsUInt32(data, 28);
+    const uint32_t pixelFormatSize = LoadDdsUInt32(data, 76);
+    const uint32_t pixelFormatFlags = LoadDdsUInt32(data, 80);
+    const uint32_t fourCC = LoadDdsUInt32(data, 84);
+    const uint32_t caps2 = LoadDdsUInt32(data, 112);
+    if (headerSize != 124 || pixelFormatSize != 32) return DdsParseResult::BAD_HEADER;
+    if ((caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) != 0) return DdsParseResult::UNSUPPORTED_DIMENSION;
+    if ((pixelFormatFlags & DDPF_FOURCC) == 0) return DdsParseResult::UNSUPPORTED_FORMAT;
+
+    texture = DdsTexture{ };
+    size_t dataOffset = DDS_HEADER_SIZE;
+    if (fourCC == MakeDdsFourCC('D', 'X', '1', '0'))
+    {
+        if (size < DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE) return DdsParseResult::TRUNCATED;
+
+        const uint32_t resourceDimension = LoadDdsUInt32(data, DDS_HEADER_SIZE + 4);
+        const uint32_t miscFlags = LoadDdsUInt32(data, DDS_HEADER_SIZE + 8);
+        const uint32_t arraySize = LoadDdsUInt32(data, DDS_HEADER_SIZE + 12);
+        if (resourceDimension != DDS_DIMENSION_TEXTURE2D || (miscFlags & DDS_RESOURCE_MISC_TEXTURECUBE) != 0 || arraySize != 1) {
+            return DdsParseResult::UNSUPPORTED_DIMENSION;
+        }
+        texture.format = GetDdsDxgiFormat(LoadDdsUInt32(data, DDS_HEADER_SIZE));
+        dataOffset += DDS_DX10_HEADER_SIZE;
+    }
+    else {
+        texture.format = GetDdsFourCCFormat(fourCC);
+    }
+    if (texture.format == TextureFormat::UNKNOWN) return DdsParseResult::UNSUPPORTED_FORMAT;
+
+    if (width == 0 || height == 0 || width > TEXTURE_MAX_DIMENSION || height > TEXTURE_MAX_DIMENSION) return DdsParseResult::BAD_HEADER;
+    texture.width = width;
+    texture.height = height;
+    texture.blockSize = GetTextureBlockSize(texture.format);
+
+    // A file without DDSD_MIPMAPCOUNT only has the top mip.
+    const uint32_t fullMipCount = uint32_t(std::bit_width(std::max(width, height)));
+    texture.mipCount = (flags & DDSD_MIPMAPCOUNT) != 0 && mipCount != 0 ? mipCount : 1;
+    if (texture.mipCount > fullMipCount) return DdsParseResult::BAD_HEADER;
+
+    if (LayoutDdsMips(texture, dataOffset) > size) return DdsParseResult::TRUNCATED;
+    return DdsParseResult::OK;
+}
+
+// A DDS file with a DX10 header for `texture`, whose mips are laid out with LayoutDdsMips. `writeMip(mip, level, data)` fills each mip.
+template <typename MipWriter>
+static inline auto BuildDdsFile(DdsTexture& texture, MipWriter&& writeMip) -> std::vector<uint8_t>
+{
+    texture.blockSize = GetTextureBlockSize(texture.format);
+    const size_t fileSize = LayoutDdsMips(texture, DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE);
+
+    std::vector<uint8_t> file(fileSize, 0);
+    auto const store = [&file](size_t offset, uint32_t value) { memcpy(file.data() + offset, &value, sizeof(value)); };
+    store(0, DDS_MAGIC);
+    store(4, 124);
+    store(8, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);    // CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT and LINEARSIZE
+    store(12, texture.height);
+    store(16, texture.width);
+    store(20, uint32_t(texture.mips[0].size));
+    store(28, texture.mipCount);
+    store(76, 32);
+    store(80, 0x4);                                             // DDPF_FOURCC
+    store(84, MakeDdsFourCC('D', 'X', '1', '0'));
+    store(108, 0x1000 | 0x400000 | 0x8);                        // TEXTURE, MIPMAP and COMPLEX
+    store(DDS_HEADER_SIZE, uint32_t(texture.format));
+    store(DDS_HEADER_SIZE + 4, 3);                              // DDS_DIMENSION_TEXTURE2D
+    store(DDS_HEADER_SIZE + 12, 1);                             // array size
+
+    for (uint32_t mip = 0; mip < texture.mipCount; ++mip) {
+        writeMip(mip, texture.mips[mip], file.data() + texture.mips[mip].offset);
+    }
+    return file;
+}
+
+// A BC1 block of a single color, given as 5:6:5 bits
+static constexpr auto EncodeBc1SolidBlock(uint16_t color565) -> uint64_t
+{
+    // Both endpoints are the color, and all the texels use the first one.
+    return uint64_t(color565) | (uint64_t(color565) << 16);
+}
+
+static constexpr auto PackColor565(uint32_t r, uint32_t g, uint32_t b) -> uint16_t
+{
+    return uint16_t(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+// A BC1 checkerboard of `width` x `height` texels with cells of `cellSize` texels, a multiple of 4. Each mip has its own tint,
+// so the mip being sampled can be seen, and `seed` changes the colors.
+static inline auto BuildCheckerDdsFile(uint32_t width, uint32_t height, uint32_t cellSize, uint32_t seed) -> std::vector<uint8_t>
+{
+    static constexpr uint8_t mipTints[][3]{
+        { 255, 255, 255 }, { 255, 128, 128 }, { 128, 255, 128 }, { 128, 128, 255 }, { 255, 255, 128 }, { 255, 128, 255 }, { 128, 255, 255 }
+    };
+
+    DdsTexture texture{
+        .format = TextureFormat::BC1_UNORM,
+        .width = width,
+        .height = height,
+        .mipCount = uint32_t(std::bit_width(std::max(width, height))),
+        .blockSize = 0,
+        .mips { }
+    };
+    return BuildDdsFile(texture, [cellSize, seed](uint32_t mip, const DdsMipLevel& level, uint8_t* data) {
+        const uint8_t* const tint = mipTints[mip % std::size(mipTints)];
+        const uint32_t base = 64 + (seed * 37) % 96;
+        const uint16_t colors[2]{
+            PackColor565(tint[0] * base / 255, tint[1] * (255 - base) / 255, tint[2] * 200 / 255),
+            PackColor565(tint[0] * 48 / 255, tint[1] * 48 / 255, tint[2] * 48 / 255)
+        };
+        // The cells shrink with the mip, down to a block.
+        const uint32_t blockCellSize = std::max((cellSize >> mip) / TEXTURE_BC_BLOCK_DIMENSION, 1U);
+        for (uint32_t row = 0; row < level.rowCount; ++row)
+        {
+            for (uint32_t column = 0; column < level.rowPitch / 8; ++column)
+            {
+                const uint64_t block = EncodeBc1SolidBlock(colors[(row / blockCellSize + column / blockCellSize) & 1]);
+                memcpy(data + size_t(row) * level.rowPitch + size_t(column) * 8, &block, sizeof(block));
+            }
+        }
+    });
+}
+
+// ==== Streaming ====
+
+// The most detailed mip worth sampling for a texture of `width` x `height` texels drawn over `screenWidth` x `screenHeight`
+// pixels: the mip whose texels are not smaller than half a pixel. Textures that are not on the screen only need their last mip.
+static inline auto GetTextureMipForScreenSize(uint32_t width, uint32_t height, uint32_t mipCount, float screenWidth, float screenHeight) -> uint32_t
+{
+    if (!(screenWidth > 0.0f) || !(screenHeight > 0.0f)) return mipCount - 1;
+
+    const float texelsPerPixel = std::max(float(width) / screenWidth, float(height) / screenHeight);
+    if (texelsPerPixel < 2.0f) return 0;
+    return std::min(uint32_t(std::log2(texelsPerPixel)), mipCount - 1);
+}
+
+struct TextureStreamingSettings
+{
+    uint64_t budget;                    // bytes of resident mips, across all the textures
+    uint32_t maxPendingCount;           // requests in flight at once
+    uint32_t dropDelay;                 // frames a mip stays resident after it is no longer wanted
+};
+
+// Make the mips from `firstMip` to the last resident. It streams in one more mip, or drops mips.
+struct TextureStreamingRequest
+{
+    uint32_t texture;
+    uint32_t firstMip;
+};
+
+struct TextureStreamingStats
+{
+    uint64_t loadCount;                 // requests that stream in a mip
+    uint64_t dropCount;                 // requests that drop mips no longer wanted
+    uint64_t evictionCount;             // requests that drop wanted mips for a texture that misses more
+    uint64_t deferredCount;             // loads that did not fit in the budget
+    uint64_t failedCount;
+    uint64_t loadedSize;                // bytes of the mips streamed in
+};
+
+// The render thread calls all the methods. A request is in flight from `Update` until `Complete`, and a texture has at most
+// one in flight, so its mips are streamed in one by one, lowest resolution first.
+class TextureStreamer
+{
+public:
+    explicit TextureStreamer(const TextureStreamingSettings& settings) : m_settings(settings) { }
+
+    // Nothing is resident until the first request, which loads the mip tail.
+    auto Register(const DdsTexture& texture) -> uint32_t
+    {
+        Texture entry{
+            .width = texture.width,
+            .height = texture.height,
+            .mipCount = texture.mipCount,
+            .tailMip = texture.mipCount - 1,
+            .residentMip = texture.mipCount,
+            .pendingMip = texture.mipCount,
+            .desiredMip = texture.mipCount - 1,
+            .screenArea = 0.0f,
+            .lastWantedFrame = 0,
+            .mipSizes { },
+            .baseMips { }
+        };
+        for (uint32_t mip = 0; mip < texture.mipCount; ++mip)
+        {
+            entry.mipSizes[mip] = texture.mips[mip].size;
+            // BC resources need the size of their first mip in whole blocks.
+            entry.baseMips[mip] = texture.mips[mip].width % TEXTURE_BC_BLOCK_DIMENSION == 0 && texture.mips[mip].height % TEXTURE_BC_BLOCK_DIMENSION == 0;
+        }
+
+        // The tail starts at the most detailed mip within the tail dimension that can start a resource, or else at the
+        // coarsest mip that can. When no mip can, the texture is only loaded whole.
+        uint32_t tailMip = texture.mipCount;
+        for (uint32_t mip = 0; mip < texture.mipCount && tailMip == texture.mipCount; ++mip)
+        {
+            if (entry.baseMips[mip] && std::max(texture.mips[mip].width, texture.mips[mip].height) <= TEXTURE_STREAMING_TAIL_DIMENSION) {
+                tailMip = mip;
+            }
+        }
+        for (uint32_t mip = texture.mipCount; mip-- > 0 && tailMip == texture.mipCount;)
+        {
+            if (entry.baseMips[mip]) {
+                tailMip = mip;
+            }
+        }
+        entry.tailMip = tailMip < texture.mipCount ? tailMip : 0;
+        entry.baseMips[entry.tailMip] = true;
+        entry.desiredMip = entry.tailMip;
+
+        m_textures.push_back(entry);
+        return uint32_t(m_textures.size() - 1);
+    }
+
+    // The size of the texture on the screen in frame `frameIndex`, in pixels; 0 when it is not visible.
+    auto SetScreenSize(uint32_t texture, float screenWidth, float screenHeight, uint64_t frameIndex) -> void
+    {
+        Texture& entry = m_textures[texture];
+        entry.desiredMip = GetTextureMipForScreenSize(entry.width, entry.height, entry.mipCount, screenWidth, screenHeight);
+        entry.screenArea = std::max(screenWidth, 0.0f) * std::max(screenHeight, 0.0f);
+        if (entry.desiredMip <= entry.residentMip) {
+            entry.lastWantedFrame = frameIndex;
+        }
+    }
+
+    // Append the requests of frame `frameIndex`: the drops first, then the loads that fit in the budget, the texture that misses
+    // the most mips first.
+    auto Update(uint64_t frameIndex, std::vector<TextureStreamingRequest>& requests) -> void
+    {
+        for (uint32_t i = 0; i < m_textures.size() && m_pendingCount < m_settings.maxPendingCount; ++i)
+        {
+            const Texture& entry = m_textures[i];
+            if (IsPending(entry) || entry.residentMip >= GetWantedMip(entry)) continue;
+            if (frameIndex - entry.lastWantedFrame < m_settings.dropDelay) continue;
+
+            const uint32_t dropMip = GetDropMip(entry, GetWantedMip(entry));
+            if (dropMip == entry.residentMip) continue;
+
+            Request(i, dropMip, requests);
+            ++m_stats.dropCount;
+        }
+
+        m_candidates.clear();
+        for (uint32_t i = 0; i < m_textures.size(); ++i)
+        {
+            if (!IsPending(m_textures[i]) && GetWantedMip(m_textures[i]) < m_textures[i].residentMip) {
+                m_candidates.push_back(i);
+            }
+        }
+        std::sort(m_candidates.begin(), m_candidates.end(), [this](uint32_t a, uint32_t b) {
+            const int32_t missingA = GetMissingMipCount(m_textures[a]);
+            const int32_t missingB = GetMissingMipCount(m_textures[b]);
+            return missingA != missingB ? missingA > missingB : m_textures[a].screenArea > m_textures[b].screenArea;
+        });
+
+        for (const uint32_t i : m_candidates)
+        {
+            if (m_pendingCount >= m_settings.maxPendingCount) break;
+
+            const Texture& entry = m_textures[i];
+            const uint32_t firstMip = GetLoadMip(entry);
+            const uint64_t loadSize = GetMipRangeSize(entry, firstMip, entry.residentMip);
+            if (m_committedSize + loadSize > m_settings.budget)
+            {
+                // Take the room from the textures that would still miss fewer mips than this one, and load once the drops complete.
+                EvictFor(i, m_committedSize + loadSize - m_settings.budget, requests);
+                ++m_stats.deferredCount;
+                continue;
+            }
+
+            m_committedSize += loadSize;
+            Request(i, firstMip, requests);
+            ++m_stats.loadCount;
+            m_stats.loadedSize += loadSize;
+        }
+    }
+
+    // The request of `texture` has completed. Until then, both its old and its new mips count in the budget.
+    auto Complete(uint32_t texture, bool succeeded) -> void
+    {
+        Texture& entry = m_textures[texture];
+        if (!IsPending(entry)) return;
+
+        const uint32_t oldMip = std::min(entry.residentMip, entry.pendingMip);
+        const uint32_t newMip = succeeded ? entry.pendingMip : entry.residentMip;
+        m_committedSize -= GetMipRangeSize(entry, oldMip, newMip);
+        entry.residentMip = newMip;
+        entry.pendingMip = newMip;
+        --m_pendingCount;
+        m_stats.failedCount += succeeded ? 0 : 1;
+    }
+
+    auto GetTextureCount() const -> uint32_t { return uint32_t(m_textures.size()); }
+
+    // The first resident mip of `texture`, or its mip count when nothing is resident
+    auto GetResidentMip(uint32_t texture) const -> uint32_t { return m_textures[texture].residentMip; }
+
+    auto GetDesiredMip(uint32_t texture) const -> uint32_t { return m_textures[texture].desiredMip; }
+
+    auto GetMipCount(uint32_t texture) const -> uint32_t { return m_textures[texture].mipCount; }
+
+    // The first mip of the tail, which is never dropped
+    auto GetTailMip(uint32_t texture) const -> uint32_t { return m_textures[texture].tailMip; }
+
+    auto GetPendingCount() const -> uint32_t { return m_pendingCount; }
+
+    // Bytes of the resident mips and of the mips being streamed in
+    auto GetCommittedSize() const -> uint64_t { return m_committedSize; }
+
+    auto GetResidentSize() const -> uint64_t
+    {
+        uint64_t size = 0;
+        for (const Texture& entry : m_textures) {
+            size += GetMipRangeSize(entry, entry.residentMip, entry.mipCount);
+        }
+        return size;
+    }
+
+    auto GetSettings() const -> const TextureStreamingSettings& { return m_settings; }
+
+    auto GetStats() const -> const TextureStreamingStats& { return m_stats; }
+
+private:
+    struct Texture
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipCount;
+        uint32_t tailMip;
+        uint32_t residentMip;           // mipCount when nothing is resident
+        uint32_t pendingMip;            // the first mip of the request in flight, residentMip when there is none
+        uint32_t desiredMip;
+        float screenArea;
+        uint64_t lastWantedFrame;       // the last frame that wanted the most detailed resident mip
+        uint64_t mipSizes[TEXTURE_MAX_MIP_COUNT];
+        bool baseMips[TEXTURE_MAX_MIP_COUNT];   // the mips a resource can start with
+    };
+
+    static auto IsPending(const Texture& entry) -> bool { return entry.pendingMip != entry.residentMip; }
+
+    // The tail is always wanted.
+    static auto GetWantedMip(const Texture& entry) -> uint32_t { return std::min(entry.desiredMip, entry.tailMip); }
+
+    static auto GetMissingMipCount(const Texture& entry) -> int32_t { return int32_t(entry.residentMip) - int32_t(GetWantedMip(entry)); }
+
+    static auto GetMipRangeSize(const Texture& entry, uint32_t firstMip, uint32_t endMip) -> uint64_t
+    {
+        uint64_t size = 0;
+        for (uint32_t mip = firstMip; mip < endMip; ++mip) {
+            size += entry.mipSizes[mip];
+        }
+        return size;
+    }
+
+    // The tail, then the next more detailed mip that can start a resource
+    static auto GetLoadMip(const Texture& entry) -> uint32_t
+    {
+        if (entry.residentMip == entry.mipCount) return entry.tailMip;
+
+        uint32_t mip = entry.residentMip - 1;
+        while (mip > 0 && !entry.baseMips[mip]) {
+            --mip;
+        }
+        return mip;
+    }
+
+    // The coarsest mip that can start a resource, keeping at least the mips from `wantedMip`
+    static auto GetDropMip(const Texture& entry, uint32_t wantedMip) -> uint32_t
+    {
+        uint32_t mip = std::min(wantedMip, entry.tailMip);
+        while (mip > entry.residentMip && !entry.baseMips[mip]) {
+            --mip;
+        }
+        return mip;
+    }
+
+    auto Request(uint32_t texture, uint32_t firstMip, std::vector<TextureStreamingRequest>& requests) -> void
+    {
+        m_textures[texture].pendingMip = firstMip;
+        ++m_pendingCount;
+        requests.push_back(TextureStreamingRequest{ .texture = texture, .firstMip = firstMip });
+    }
+
+    // Drop the most detailed mips of the other textures, the one that misses the fewest mips after the drop first, as long as
+    // it still misses fewer than `texture`. So the detail is shared out evenly, and two textures never take turns.
+    auto EvictFor(uint32_t texture, uint64_t size, std::vector<TextureStreamingRequest>& requests) -> void
+    {
+        const int32_t missingMipCount = GetMissingMipCount(m_textures[texture]);
+        uint64_t freedSize = 0;
+        while (freedSize < size && m_pendingCount < m_settings.maxPendingCount)
+        {
+            uint32_t victim = TEXTURE_STREAMING_INVALID_TEXTURE;
+            int32_t victimMissingMipCount = missingMipCount;
+            for (uint32_t i = 0; i < m_textures.size(); ++i)
+            {
+                const Texture& entry = m_textures[i];
+                if (i == texture || IsPending(entry) || entry.residentMip >= entry.tailMip) continue;
+
+                const uint32_t dropMip = GetDropMip(entry, entry.residentMip + 1);
+                if (dropMip == entry.residentMip) continue;
+
+                const int32_t missingAfterDrop = int32_t(dropMip) - int32_t(GetWantedMip(entry));
+                if (missingAfterDrop < victimMissingMipCount)
+                {
+                    victim = i;
+                    victimMissingMipCount = missingAfterDrop;
+                }
+            }
+            if (victim == TEXTURE_STREAMING_INVALID_TEXTURE) return;
+
+            const Texture& entry = m_textures[victim];
+            const uint32_t dropMip = GetDropMip(entry, entry.residentMip + 1);
+            freedSize += GetMipRangeSize(entry, entry.residentMip, dropMip);
+            Request(victim, dropMip, requests);
+            ++m_stats.evictionCount;
+        }
+    }
+
+    TextureStreamingSettings m_settings;
+    std::vector<Texture> m_textures;
+    std::vector<uint32_t> m_candidates;
+    uint64_t m_committedSize = 0;
+    uint32_t m_pendingCount = 0;
+    TextureStreamingStats m_stats{ };
+};
+
+// ==== Upload worker ====
+
+// Runs the jobs in order on a background thread. `Push` never waits; the render thread collects the results with `Collect`.
+template <typename Result>
+class TextureUploadWorker
+{
+public:
+    TextureUploadWorker() : m_thread([this] { RunJobs(); }) { }
+
+    ~TextureUploadWorker() { Stop(); }
+
+    auto Push(std::function<Result()> job) -> void
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_jobReady.notify_one();
+    }
+
+    // Call `visit(result)` for each job that has completed, in order.
+    template <typename Visitor>
+    auto Collect(Visitor&& visit) -> void
+    {
+        std::deque<Result> results;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            results.swap(m_results);
+        }
+        for (Result& result : results) {
+            visit(result);
+        }
+    }
+
+    // Wait for the jobs pushed so far. Their results are left to `Collect`.
+    auto Drain() -> void
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+    }
+
+    // Finish the jobs pushed so far and join the thread.
+    auto Stop() -> void
+    {
+        if (!m_thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_jobReady.notify_all();
+        m_thread.join();
+    }
+
+private:
+    auto RunJobs() -> void
+    {
+        while (true)
+        {
+            std::function<Result()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobReady.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) return;
+
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                m_busy = true;
+            }
+
+            Result result = job();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_results.push_back(std::move(result));
+                m_busy = false;
+            }
+            m_idle.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_idle;
+    std::deque<std::function<Result()>> m_jobs;
+    std::deque<Result> m_results;
+    bool m_busy = false;
+    bool m_stopping = false;
+    std::thread m_thread;               // last, so that it starts after the members it uses
+};
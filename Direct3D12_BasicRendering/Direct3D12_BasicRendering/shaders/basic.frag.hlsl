@@ -4,8 +4,16 @@ struct PSInput
     float4 color : COLOR;
 };
 
+// Permutation defines (see ShaderPermutation.h):
+// ENABLE_GRAYSCALE: output the luminance of the interpolated color
+
 float4 PSMain(PSInput input) : SV_TARGET
 {
+#if ENABLE_GRAYSCALE
+    const float luminance = dot(input.color.rgb, float3(0.299f, 0.587f, 0.114f));
+    return float4(luminance, luminance, luminance, input.color.a);
+#else
     return input.color;
+#endif
 }
 
@@ -29,21 +29,23 @@ struct PSInput
     float4 color : COLOR;
 };
 
+// Root constants, see BasicObject in BasicFrame.h
 cbuffer cbRotationAngle : register(b0)
 {
     float rotAngle;
+    float3 objectOffset;    // x and y in NDC, depth in [0, 1]
+    float objectScale;
 };
 
+// Permutation defines (see ShaderPermutation.h):
+// ENABLE_ROTATION: rotate around the Z axis by `rotAngle`
+// ENABLE_ORTHO_PROJECTION: apply the model view translation and the ortho projection
+
 PSInput VSMain(float4 position : POSITION, float4 color : COLOR)
 {
-    // glTranslate(offset, offset, -2.3, 1.0)
-    const float4x4 translateMatrix = {
-        1.0f, 0.0f, 0.0f, 0.0f,     // row 0
-        0.0f, 1.0f, 0.0f, 0.0f,     // row 1
-        0.0f, 0.0f, 1.0f, 0.0f,     // row 2
-        0.0f, 0.0f, -2.3f, 1.0f     // row 3
-    };
+    float4 resultPosition = position;
 
+#if ENABLE_ROTATION
     const float rotRadian = radians(rotAngle);
 
     // glRotate(u_angle, 0.0, 0.0, 1.0)
@@ -54,6 +56,18 @@ PSInput VSMain(float4 position : POSITION, float4 color : COLOR)
         0.0f, 0.0f, 0.0f, 1.0f                          // row 3
     };
 
+    resultPosition = mul(resultPosition, rotateMatrix);
+#endif
+
+#if ENABLE_ORTHO_PROJECTION
+    // glTranslate(offset, offset, -2.3, 1.0)
+    const float4x4 translateMatrix = {
+        1.0f, 0.0f, 0.0f, 0.0f,     // row 0
+        0.0f, 1.0f, 0.0f, 0.0f,     // row 1
+        0.0f, 0.0f, 1.0f, 0.0f,     // row 2
+        0.0f, 0.0f, -2.3f, 1.0f     // row 3
+    };
+
     // glOrtho(-1.0, 1.0, -1.0, 1.0, 1.0, 3.0)
     const float4x4 projectionMatrix = {
         1.0f, 0.0f, 0.0f, 0.0f,     // row 0
@@ -62,8 +76,15 @@ PSInput VSMain(float4 position : POSITION, float4 color : COLOR)
         0.0f, 0.0f, -2.0f, 1.0f     // row 3
     };
 
+    resultPosition = mul(resultPosition, mul(translateMatrix, projectionMatrix));
+#endif
+
+    // Place the copy of the square, at a fixed depth
+    resultPosition.xy = resultPosition.xy * objectScale + objectOffset.xy * resultPosition.w;
+    resultPosition.z = objectOffset.z * resultPosition.w;
+
     PSInput result;
-    result.position = mul(position, mul(rotateMatrix, mul(translateMatrix, projectionMatrix)));
+    result.position = resultPosition;
     result.color = color;
 
     return result;
@@ -0,0 +1,322 @@
+// GPU compute primitives on 32-bit unsigned integers: reduction, prefix sum, stream compaction and radix sort.
+// Specialized at PSO creation time by:
+//   GROUP_SIZE              threads per group, a power of two
+//   WAVE_SIZE               minimum wave lane count of the device
+//   USE_WAVE_INTRINSICS     1 to do the in-group steps with Shader Model 6.0 wave intrinsics, 0 with group shared memory
+
+#ifndef GROUP_SIZE
+#define GROUP_SIZE 256
+#endif
+
+#ifndef WAVE_SIZE
+#define WAVE_SIZE 1
+#endif
+
+#ifndef USE_WAVE_INTRINSICS
+#define USE_WAVE_INTRINSICS 0
+#endif
+
+#define RADIX_SORT_BITS_PER_PASS    4
+#define RADIX_SORT_DIGIT_COUNT      16
+
+cbuffer cbPrimitive : register(b0)
+{
+    uint elementCount;
+    uint groupCount;        // groups of the pass producing `bufferGroup`, or the dispatched groups of a grid-stride pass
+    uint radixShift;
+    uint exclusiveScan;
+};
+
+// The meaning of each buffer depends on the kernel, see ComputePrimitiveKernel in ComputePrimitives.h.
+RWStructuredBuffer<uint> bufferIn : register(u0);
+RWStructuredBuffer<uint> bufferOut : register(u1);
+RWStructuredBuffer<uint> bufferGroup : register(u2);    // per-group partials, totals or histograms
+RWStructuredBuffer<uint> bufferAux : register(u3);
+
+#if USE_WAVE_INTRINSICS
+// The actual lane count is never less than WAVE_SIZE, so this holds all the waves of a group.
+#define MAX_WAVE_COUNT  (GROUP_SIZE / WAVE_SIZE)
+groupshared uint gs_waveTotals[MAX_WAVE_COUNT];
+groupshared uint gs_waveDigitCounts[MAX_WAVE_COUNT][RADIX_SORT_DIGIT_COUNT];
+#else
+groupshared uint gs_scratch[2][GROUP_SIZE];
+#endif
+
+groupshared uint gs_histogram[RADIX_SORT_DIGIT_COUNT];
+
+// Sum of `value` over the group, returned to all the threads
+uint GroupSum(uint value, uint threadIndex)
+{
+#if USE_WAVE_INTRINSICS
+    const uint laneCount = WaveGetLaneCount();
+    const uint waveIndex = threadIndex / laneCount;
+    const uint waveCount = (GROUP_SIZE + laneCount - 1) / laneCount;
+
+    const uint waveSum = WaveActiveSum(value);
+    if (WaveIsFirstLane()) {
+        gs_waveTotals[waveIndex] = waveSum;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Every wave sums the wave totals by itself, so no further synchronization is needed.
+    uint waveTotal = 0;
+    if (WaveGetLaneIndex() < waveCount) {
+        waveTotal = gs_waveTotals[WaveGetLaneIndex()];
+    }
+    const uint total = WaveActiveSum(waveTotal);
+    GroupMemoryBarrierWithGroupSync();
+
+    return total;
+#else
+    gs_scratch[0][threadIndex] = value;
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint stride = GROUP_SIZE / 2; stride > 0; stride >>= 1)
+    {
+        if (threadIndex < stride) {
+            gs_scratch[0][threadIndex] += gs_scratch[0][threadIndex + stride];
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    const uint total = gs_scratch[0][0];
+    GroupMemoryBarrierWithGroupSync();
+
+    return total;
+#endif
+}
+
+// Inclusive prefix sum of `value` over the group, in thread order
+uint GroupInclusiveScan(uint value, uint threadIndex)
+{
+#if USE_WAVE_INTRINSICS
+    const uint laneCount = WaveGetLaneCount();
+    const uint waveIndex = threadIndex / laneCount;
+    const uint waveCount = (GROUP_SIZE + laneCount - 1) / laneCount;
+
+    const uint waveInclusive = WavePrefixSum(value) + value;
+    const uint waveSum = WaveActiveSum(value);
+    if (WaveIsFirstLane()) {
+        gs_waveTotals[waveIndex] = waveSum;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // Every wave scans the wave totals by itself and picks the offset of its own.
+    uint waveTotal = 0;
+    if (WaveGetLaneIndex() < waveCount) {
+        waveTotal = gs_waveTotals[WaveGetLaneIndex()];
+    }
+    const uint waveOffset = WaveReadLaneAt(WavePrefixSum(waveTotal), waveIndex);
+    GroupMemoryBarrierWithGroupSync();
+
+    return waveOffset + waveInclusive;
+#else
+    // Hillis-Steele scan with double buffering
+    uint src = 0;
+    gs_scratch[0][threadIndex] = value;
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint offset = 1; offset < GROUP_SIZE; offset <<= 1)
+    {
+        uint sum = gs_scratch[src][threadIndex];
+        if (threadIndex >= offset) {
+            sum += gs_scratch[src][threadIndex - offset];
+        }
+        gs_scratch[1 - src][threadIndex] = sum;
+        src = 1 - src;
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    const uint result = gs_scratch[src][threadIndex];
+    GroupMemoryBarrierWithGroupSync();
+
+    return result;
+#endif
+}
+
+// u0: input, u2: partial sums. Dispatched with `groupCount` groups striding over the input.
+[numthreads(GROUP_SIZE, 1, 1)]
+void ReducePartialCS(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+    uint sum = 0;
+    for (uint i = groupID.x * GROUP_SIZE + threadID.x; i < elementCount; i += groupCount * GROUP_SIZE) {
+        sum += bufferIn[i];
+    }
+
+    sum = GroupSum(sum, threadID.x);
+    if (threadID.x == 0) {
+        bufferGroup[groupID.x] = sum;
+    }
+}
+
+// u1: the sum, u2: `groupCount` partial sums. Dispatched with one group.
+[numthreads(GROUP_SIZE, 1, 1)]
+void ReduceFinalCS(uint3 threadID : SV_GroupThreadID)
+{
+    uint value = 0;
+    if (threadID.x < groupCount) {
+        value = bufferGroup[threadID.x];
+    }
+
+    const uint sum = GroupSum(value, threadID.x);
+    if (threadID.x == 0) {
+        bufferOut[0] = sum;
+    }
+}
+
+// u0: input, u1: output (may be the same buffer as the input), u2: group totals
+[numthreads(GROUP_SIZE, 1, 1)]
+void ScanGroupCS(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+    const uint index = groupID.x * GROUP_SIZE + threadID.x;
+    uint value = 0;
+    if (index < elementCount) {
+        value = bufferIn[index];
+    }
+
+    const uint inclusive = GroupInclusiveScan(value, threadID.x);
+    if (index < elementCount) {
+        bufferOut[index] = exclusiveScan != 0 ? inclusive - value : inclusive;
+    }
+    if (threadID.x == GROUP_SIZE - 1) {
+        bufferGroup[groupID.x] = inclusive;
+    }
+}
+
+// u2: `groupCount` group totals, scanned in place (exclusive). Dispatched with one group.
+[numthreads(GROUP_SIZE, 1, 1)]
+void ScanGroupTotalsCS(uint3 threadID : SV_GroupThreadID)
+{
+    uint carry = 0;
+    for (uint base = 0; base < groupCount; base += GROUP_SIZE)
+    {
+        const uint index = base + threadID.x;
+        uint value = 0;
+        if (index < groupCount) {
+            value = bufferGroup[index];
+        }
+
+        const uint inclusive = GroupInclusiveScan(value, threadID.x);
+        if (index < groupCount) {
+            bufferGroup[index] = carry + inclusive - value;
+        }
+        carry += GroupSum(value, threadID.x);
+    }
+}
+
+// u1: output of ScanGroupCS, u2: scanned group totals
+[numthreads(GROUP_SIZE, 1, 1)]
+void ScanAddCS(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+    const uint index = groupID.x * GROUP_SIZE + threadID.x;
+    if (index < elementCount) {
+        bufferOut[index] += bufferGroup[groupID.x];
+    }
+}
+
+bool IsCompactedElement(uint value)
+{
+    return value != 0;
+}
+
+// u0: input, u1: flags
+[numthreads(GROUP_SIZE, 1, 1)]
+void CompactFlagsCS(uint3 dispatchID : SV_DispatchThreadID)
+{
+    if (dispatchID.x < elementCount) {
+        bufferOut[dispatchID.x] = IsCompactedElement(bufferIn[dispatchID.x]) ? 1 : 0;
+    }
+}
+
+// u0: input, u1: output, u2: exclusive scan of the flags, u3: the number of kept elements
+[numthreads(GROUP_SIZE, 1, 1)]
+void CompactScatterCS(uint3 dispatchID : SV_DispatchThreadID)
+{
+    const uint index = dispatchID.x;
+    if (index >= elementCount) return;
+
+    const uint value = bufferIn[index];
+    const bool kept = IsCompactedElement(value);
+    if (kept) {
+        bufferOut[bufferGroup[index]] = value;
+    }
+    if (index == elementCount - 1) {
+        bufferAux[0] = bufferGroup[index] + (kept ? 1 : 0);
+    }
+}
+
+// u0: keys, u2: digit histograms of all the groups, digit-major, i.e. [digit * groupCount + group]
+[numthreads(GROUP_SIZE, 1, 1)]
+void RadixHistogramCS(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+    if (threadID.x < RADIX_SORT_DIGIT_COUNT) {
+        gs_histogram[threadID.x] = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    const uint index = groupID.x * GROUP_SIZE + threadID.x;
+    if (index < elementCount)
+    {
+        const uint digit = (bufferIn[index] >> radixShift) & (RADIX_SORT_DIGIT_COUNT - 1);
+        InterlockedAdd(gs_histogram[digit], 1);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (threadID.x < RADIX_SORT_DIGIT_COUNT) {
+        bufferGroup[threadID.x * groupCount + groupID.x] = gs_histogram[threadID.x];
+    }
+}
+
+// u0: source keys, u1: destination keys, u2: exclusive scan of the digit histograms
+[numthreads(GROUP_SIZE, 1, 1)]
+void RadixScatterCS(uint3 groupID : SV_GroupID, uint3 threadID : SV_GroupThreadID)
+{
+    const uint index = groupID.x * GROUP_SIZE + threadID.x;
+    const bool valid = index < elementCount;
+
+    uint key = 0;
+    uint digit = RADIX_SORT_DIGIT_COUNT;    // matches no digit
+    if (valid)
+    {
+        key = bufferIn[index];
+        digit = (key >> radixShift) & (RADIX_SORT_DIGIT_COUNT - 1);
+    }
+
+    // Rank of this key among the keys of the same digit before it in the group, which keeps the sort stable
+    uint rank = 0;
+
+#if USE_WAVE_INTRINSICS
+    const uint waveIndex = threadID.x / WaveGetLaneCount();
+    for (uint d = 0; d < RADIX_SORT_DIGIT_COUNT; ++d)
+    {
+        const bool match = digit == d;
+        const uint prefixCount = WavePrefixCountBits(match);
+        const uint waveCount = WaveActiveCountBits(match);
+        if (match) {
+            rank = prefixCount;
+        }
+        if (WaveIsFirstLane()) {
+            gs_waveDigitCounts[waveIndex][d] = waveCount;
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (valid)
+    {
+        for (uint w = 0; w < waveIndex; ++w) {
+            rank += gs_waveDigitCounts[w][digit];
+        }
+    }
+#else
+    gs_scratch[0][threadID.x] = digit;
+    GroupMemoryBarrierWithGroupSync();
+
+    for (uint t = 0; t < threadID.x; ++t) {
+        rank += gs_scratch[0][t] == digit ? 1 : 0;
+    }
+#endif
+
+    if (valid) {
+        bufferOut[bufferGroup[digit * groupCount + groupID.x] + rank] = key;
+    }
+}
@@ -0,0 +1,40 @@
+// Build one level of the hierarchical-Z pyramid: each texel keeps the farthest of the 2x2 source texels below it.
+// Level 0 is the depth buffer, as if padded with the far depth to power-of-two sizes. See ReduceHiZLevel in HiZOcclusion.h.
+
+#define HIZ_GROUP_SIZE      8
+#define HIZ_FAR_DEPTH       1.0f
+
+cbuffer cbHiZ : register(b0)
+{
+    uint2 sourceSize;           // texels of the source that hold depths, the rest is padding
+    uint2 destinationSize;
+};
+
+Texture2D<float> sourceDepth : register(t0);
+RWTexture2D<float> destinationDepth : register(u0);
+
+float LoadSourceDepth(uint2 coord)
+{
+    // A level of size 1 is reduced to size 1 on that axis.
+    if (sourceSize.x == 1) {
+        coord.x = 0;
+    }
+    if (sourceSize.y == 1) {
+        coord.y = 0;
+    }
+    if (coord.x >= sourceSize.x || coord.y >= sourceSize.y) {
+        return HIZ_FAR_DEPTH;
+    }
+    return sourceDepth.Load(int3(coord, 0));
+}
+
+[numthreads(HIZ_GROUP_SIZE, HIZ_GROUP_SIZE, 1)]
+void HiZReduceCS(uint3 threadID : SV_DispatchThreadID)
+{
+    if (threadID.x >= destinationSize.x || threadID.y >= destinationSize.y) return;
+
+    const uint2 coord = threadID.xy * 2;
+    const float depth = max(max(LoadSourceDepth(coord), LoadSourceDepth(coord + uint2(1, 0))),
+        max(LoadSourceDepth(coord + uint2(0, 1)), LoadSourceDepth(coord + uint2(1, 1))));
+    destinationDepth[threadID.xy] = depth;
+}
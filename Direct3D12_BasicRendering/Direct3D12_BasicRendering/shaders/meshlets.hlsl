@@ -0,0 +1,137 @@
+// Draw the meshlets built by BuildMeshlets in MeshletBuilder.h. Compiled with DXC for Shader Model 6.5.
+// Each thread of MeshletAS tests one meshlet against the frustum and its normal cone, as IsMeshletOutsideFrustum and
+// IsMeshletConeCulled do, and the group launches one MeshletMS group per meshlet left. MeshletMS writes the vertices
+// and the triangles of its meshlet, with one thread per vertex and per triangle.
+
+#define MESHLET_AS_GROUP_SIZE           32
+#define MESHLET_MS_GROUP_SIZE           128
+#define MESHLET_MAX_VERTEX_COUNT        64
+#define MESHLET_MAX_PRIMITIVE_COUNT     124
+#define MESHLET_LOCAL_INDEX_MASK        0x3FF   // 10 bits per local vertex index, see PackMeshletPrimitive
+
+struct Meshlet
+{
+    uint vertexOffset;
+    uint primitiveOffset;
+    uint vertexCount;
+    uint primitiveCount;
+};
+
+struct MeshletBounds
+{
+    float3 center;
+    float radius;
+    float3 coneAxis;
+    float coneCutoff;
+};
+
+struct MeshletVertex
+{
+    float3 position;
+    float3 normal;
+};
+
+// Root constants, see MeshletConstants in Direct3D12_BasicRendering.cpp. All in object space.
+cbuffer cbMeshlets : register(b0)
+{
+    row_major float4x4 objectToClip;
+    float3 cameraPosition;
+    uint meshletCount;
+    float4 frustumPlanes[6];
+};
+
+StructuredBuffer<Meshlet> meshlets : register(t0);
+StructuredBuffer<MeshletBounds> meshletBounds : register(t1);
+StructuredBuffer<MeshletVertex> meshVertices : register(t2);
+StructuredBuffer<uint> vertexIndices : register(t3);
+StructuredBuffer<uint> meshletPrimitives : register(t4);
+
+struct MeshletPayload
+{
+    uint meshletIndices[MESHLET_AS_GROUP_SIZE];
+};
+
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float3 color : COLOR;
+};
+
+groupshared MeshletPayload gs_payload;
+groupshared uint gs_visibleCount;
+
+bool IsMeshletVisible(MeshletBounds bounds)
+{
+    [unroll]
+    for (uint i = 0; i < 6; ++i)
+    {
+        if (dot(frustumPlanes[i].xyz, bounds.center) + frustumPlanes[i].w < -bounds.radius) return false;
+    }
+
+    const float3 direction = bounds.center - cameraPosition;
+    return dot(direction, bounds.coneAxis) < bounds.coneCutoff * length(direction) + bounds.radius;
+}
+
+// The group counts its visible meshlets in group shared memory rather than with wave intrinsics, so it does not depend
+// on the wave size.
+[numthreads(MESHLET_AS_GROUP_SIZE, 1, 1)]
+void MeshletAS(uint threadID : SV_DispatchThreadID, uint groupThreadID : SV_GroupThreadID)
+{
+    if (groupThreadID == 0) {
+        gs_visibleCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (threadID < meshletCount && IsMeshletVisible(meshletBounds[threadID]))
+    {
+        uint index;
+        InterlockedAdd(gs_visibleCount, 1, index);
+        gs_payload.meshletIndices[index] = threadID;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    DispatchMesh(gs_visibleCount, 1, 1, gs_payload);
+}
+
+// PCG hash, for a color per meshlet
+uint HashMeshletIndex(uint value)
+{
+    const uint state = value * 747796405U + 2891336453U;
+    const uint word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737U;
+    return (word >> 22) ^ word;
+}
+
+[numthreads(MESHLET_MS_GROUP_SIZE, 1, 1)]
+[outputtopology("triangle")]
+void MeshletMS(uint groupThreadID : SV_GroupThreadID, uint groupID : SV_GroupID, in payload MeshletPayload payload,
+    out vertices PSInput outVertices[MESHLET_MAX_VERTEX_COUNT], out indices uint3 outTriangles[MESHLET_MAX_PRIMITIVE_COUNT])
+{
+    const uint meshletIndex = payload.meshletIndices[groupID];
+    const Meshlet meshlet = meshlets[meshletIndex];
+    SetMeshOutputCounts(meshlet.vertexCount, meshlet.primitiveCount);
+
+    if (groupThreadID < meshlet.vertexCount)
+    {
+        const MeshletVertex vertex = meshVertices[vertexIndices[meshlet.vertexOffset + groupThreadID]];
+        const uint hash = HashMeshletIndex(meshletIndex);
+        const float3 tint = float3(hash & 0xFF, (hash >> 8) & 0xFF, (hash >> 16) & 0xFF) * (0.5f / 255.0f) + 0.5f;
+
+        // Lit from the camera
+        const float lighting = saturate(dot(vertex.normal, normalize(cameraPosition - vertex.position)));
+
+        outVertices[groupThreadID].position = mul(float4(vertex.position, 1.0f), objectToClip);
+        outVertices[groupThreadID].color = tint * (0.2f + 0.8f * lighting);
+    }
+
+    if (groupThreadID < meshlet.primitiveCount)
+    {
+        const uint primitive = meshletPrimitives[meshlet.primitiveOffset + groupThreadID];
+        outTriangles[groupThreadID] = uint3(primitive & MESHLET_LOCAL_INDEX_MASK, (primitive >> 10) & MESHLET_LOCAL_INDEX_MASK,
+            (primitive >> 20) & MESHLET_LOCAL_INDEX_MASK);
+    }
+}
+
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    return float4(input.color, 1.0f);
+}
@@ -0,0 +1,136 @@
+// Build up to 4 mips of an RGBA8 texture per dispatch, see PlanMipGeneration in MipGenerator.h. Each thread filters one texel
+// of the first mip from the source mip with the box filter of GetMipFilterTaps, and the group builds the next mips from group
+// shared memory, each texel from the 2x2 texels below it. sRGB texels are filtered in linear space.
+
+#define MIP_GROUP_SIZE      8
+
+cbuffer cbMips : register(b0)
+{
+    uint2 sourceSize;
+    uint mipCount;              // written by this dispatch, 1 to 4
+    uint srgb;                  // the texels are sRGB encoded, through UNORM views
+};
+
+Texture2D<float4> sourceMip : register(t0);
+RWTexture2D<unorm float4> destinationMip0 : register(u0);
+RWTexture2D<unorm float4> destinationMip1 : register(u1);
+RWTexture2D<unorm float4> destinationMip2 : register(u2);
+RWTexture2D<unorm float4> destinationMip3 : register(u3);
+
+// Texel (x, y) of the group in the i-th mip after the first one is kept at (x, y) << i. The thread there reads its 2x2 sources,
+// then overwrites the first of them, which no other thread reads.
+groupshared float4 gs_texels[MIP_GROUP_SIZE * MIP_GROUP_SIZE];
+
+float3 SrgbToLinear(float3 color)
+{
+    return color <= 0.04045f ? color / 12.92f : pow((color + 0.055f) / 1.055f, 2.4f);
+}
+
+float3 LinearToSrgb(float3 color)
+{
+    return color <= 0.0031308f ? color * 12.92f : 1.055f * pow(color, 1.0f / 2.4f) - 0.055f;
+}
+
+float4 LoadSource(uint2 coord)
+{
+    const float4 texel = sourceMip.Load(int3(coord, 0));
+    return srgb != 0 ? float4(SrgbToLinear(texel.rgb), texel.a) : texel;
+}
+
+void StoreMip(uint mip, uint2 coord, float4 color)
+{
+    if (srgb != 0) {
+        color.rgb = LinearToSrgb(color.rgb);
+    }
+
+    if (mip == 0) {
+        destinationMip0[coord] = color;
+    }
+    else if (mip == 1) {
+        destinationMip1[coord] = color;
+    }
+    else if (mip == 2) {
+        destinationMip2[coord] = color;
+    }
+    else {
+        destinationMip3[coord] = color;
+    }
+}
+
+// The texels of a mip of `size` along an axis that texel `index` of the next mip covers, as GetMipFilterTaps
+void GetFilterTaps(uint index, uint size, out uint first, out uint count, out float3 weights)
+{
+    first = 2 * index;
+    if (size == 1)
+    {
+        first = 0;
+        count = 1;
+        weights = float3(1.0f, 0.0f, 0.0f);
+    }
+    else if ((size & 1) == 0)
+    {
+        count = 2;
+        weights = float3(0.5f, 0.5f, 0.0f);
+    }
+    else
+    {
+        const uint halfSize = size >> 1;
+        count = 3;
+        weights = float3(halfSize - index, halfSize, index + 1) * (1.0f / size);
+    }
+}
+
+uint2 GetNextMipSize(uint2 size)
+{
+    return max(size >> 1, 1);
+}
+
+[numthreads(MIP_GROUP_SIZE, MIP_GROUP_SIZE, 1)]
+void GenerateMipsCS(uint3 threadID : SV_DispatchThreadID, uint3 groupThreadID : SV_GroupThreadID, uint3 groupID : SV_GroupID)
+{
+    // The first mip. Out of the source mip, the loads return 0, and the texels are not stored.
+    uint2 size = GetNextMipSize(sourceSize);
+    uint firstX, countX, firstY, countY;
+    float3 weightsX, weightsY;
+    GetFilterTaps(threadID.x, sourceSize.x, firstX, countX, weightsX);
+    GetFilterTaps(threadID.y, sourceSize.y, firstY, countY, weightsY);
+
+    float4 color = 0.0f;
+    for (uint y = 0; y < countY; ++y)
+    {
+        for (uint x = 0; x < countX; ++x) {
+            color += weightsY[y] * weightsX[x] * LoadSource(uint2(firstX + x, firstY + y));
+        }
+    }
+    if (all(threadID.xy < size)) {
+        StoreMip(0, threadID.xy, color);
+    }
+
+    const uint index = groupThreadID.y * MIP_GROUP_SIZE + groupThreadID.x;
+    gs_texels[index] = color;
+
+    // The next mips. Their sources have even sizes, or 1, so the 2x2 texels below a texel are in the group.
+    [unroll]
+    for (uint mip = 1; mip < 4; ++mip)
+    {
+        if (mip < mipCount)
+        {
+            GroupMemoryBarrierWithGroupSync();
+
+            const uint stride = 1u << (mip - 1);
+            const uint stepX = size.x == 1 ? 0 : stride;
+            const uint stepY = size.y == 1 ? 0 : stride * MIP_GROUP_SIZE;
+            size = GetNextMipSize(size);
+            if (((groupThreadID.x | groupThreadID.y) & (2 * stride - 1)) == 0)
+            {
+                color = (gs_texels[index] + gs_texels[index + stepX] + gs_texels[index + stepY] + gs_texels[index + stepX + stepY]) * 0.25f;
+                gs_texels[index] = color;
+
+                const uint2 coord = groupID.xy * (MIP_GROUP_SIZE >> mip) + (groupThreadID.xy >> mip);
+                if (all(coord < size)) {
+                    StoreMip(mip, coord, color);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,148 @@
+// Emit, simulate and draw the particles. See ParticleSimulation in ParticleSystem.h for the CPU implementation of the same step.
+// The slots of the particle buffer are recycled through a dead list: EmitCS consumes it, and SimulateCS appends the
+// particles that die back to it. The alive list of a frame is consumed by SimulateCS, which appends the survivors to
+// the alive list of the next frame, and the draw takes its instance count from the counter of that list.
+
+#define PARTICLE_GROUP_SIZE             64
+#define PARTICLE_DEAD_COUNT_OFFSET      0       // byte offsets in particleCounts
+#define PARTICLE_ALIVE_COUNT_OFFSET     4
+#define PARTICLE_DEPTH                  0.5f    // behind the big square of the scene, in front of the small ones in the corners
+
+struct Particle
+{
+    float2 position;
+    float2 velocity;
+    float age;
+    float lifetime;
+    float size;
+    float padding;
+};
+
+// Root constants, see ParticleSettings in ParticleSystem.h
+cbuffer cbParticles : register(b0)
+{
+    uint maxParticleCount;
+    uint emitCountPerFrame;
+    float timeStep;
+    float gravity;
+    float damping;
+    float floorY;
+    float restitution;
+    float emitterX;             // separate scalars, a float2 here would start a new register
+    float emitterY;
+    float emitSpread;
+    float minSpeed;
+    float maxSpeed;
+    float minLifetime;
+    float maxLifetime;
+    float minSize;
+    float maxSize;
+    uint frameIndex;
+};
+
+// Copies of the list counters, made before each dispatch
+ByteAddressBuffer particleCounts : register(t0);
+
+RWStructuredBuffer<Particle> particles : register(u0);
+ConsumeStructuredBuffer<uint> deadListConsume : register(u1);
+AppendStructuredBuffer<uint> aliveListAppend : register(u2);
+ConsumeStructuredBuffer<uint> aliveListConsume : register(u3);
+AppendStructuredBuffer<uint> nextAliveListAppend : register(u4);
+AppendStructuredBuffer<uint> deadListAppend : register(u5);
+
+StructuredBuffer<Particle> drawParticles : register(t1);
+StructuredBuffer<uint> drawList : register(t2);
+
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float4 color : COLOR;
+    float2 corner : TEXCOORD;
+};
+
+// PCG hash, the same as HashParticleIndex in ParticleSystem.h
+uint HashParticleIndex(uint value)
+{
+    const uint state = value * 747796405U + 2891336453U;
+    const uint word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737U;
+    return (word >> 22) ^ word;
+}
+
+float GetParticleRandom(uint emissionIndex, uint stream)
+{
+    return float(HashParticleIndex(emissionIndex * 4 + stream) >> 8) * (1.0f / 16777216.0f);
+}
+
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void EmitCS(uint3 threadID : SV_DispatchThreadID)
+{
+    const uint emitCount = min(emitCountPerFrame, particleCounts.Load(PARTICLE_DEAD_COUNT_OFFSET));
+    if (threadID.x >= emitCount) return;
+
+    const uint emissionIndex = frameIndex * emitCountPerFrame + threadID.x;
+    const float angle = (GetParticleRandom(emissionIndex, 0) - 0.5f) * emitSpread;
+    const float speed = minSpeed + (maxSpeed - minSpeed) * GetParticleRandom(emissionIndex, 1);
+
+    Particle particle;
+    particle.position = float2(emitterX, emitterY);
+    particle.velocity = float2(sin(angle), cos(angle)) * speed;
+    particle.age = 0.0f;
+    particle.lifetime = minLifetime + (maxLifetime - minLifetime) * GetParticleRandom(emissionIndex, 2);
+    particle.size = minSize + (maxSize - minSize) * GetParticleRandom(emissionIndex, 3);
+    particle.padding = 0.0f;
+
+    const uint index = deadListConsume.Consume();
+    particles[index] = particle;
+    aliveListAppend.Append(index);
+}
+
+[numthreads(PARTICLE_GROUP_SIZE, 1, 1)]
+void SimulateCS(uint3 threadID : SV_DispatchThreadID)
+{
+    if (threadID.x >= particleCounts.Load(PARTICLE_ALIVE_COUNT_OFFSET)) return;
+
+    const uint index = aliveListConsume.Consume();
+    Particle particle = particles[index];
+
+    // Same operations in the same order as SimulateParticleSlot, without fused multiply-adds
+    precise float2 velocity = float2(particle.velocity.x, particle.velocity.y + gravity * timeStep) * damping;
+    precise float2 position = particle.position + velocity * timeStep;
+    if (position.y < floorY)
+    {
+        position.y = (floorY + floorY) - position.y;
+        velocity.y *= -restitution;
+    }
+    particle.position = position;
+    particle.velocity = velocity;
+    particle.age += timeStep;
+    particles[index] = particle;
+
+    if (particle.age < particle.lifetime) {
+        nextAliveListAppend.Append(index);
+    }
+    else {
+        deadListAppend.Append(index);
+    }
+}
+
+PSInput VSMain(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+    const Particle particle = drawParticles[drawList[instanceID]];
+
+    // Triangle strip of (-1, -1), (1, -1), (-1, 1), (1, 1)
+    const float2 corner = float2(vertexID & 1, vertexID >> 1) * 2.0f - 1.0f;
+    const float fade = 1.0f - particle.age / particle.lifetime;
+
+    PSInput result;
+    result.position = float4(particle.position + corner * particle.size, PARTICLE_DEPTH, 1.0f);
+    result.color = float4(1.0f, 0.6f, 0.2f, 1.0f) * fade;
+    result.corner = corner;
+
+    return result;
+}
+
+// Additive blending, so the particles need no sorting
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    return input.color * saturate(1.0f - dot(input.corner, input.corner));
+}
@@ -0,0 +1,35 @@
+// Draw each streamed texture on a quad, see RecordStreamedTextureDraws in Direct3D12_BasicRendering.cpp. The texture only holds
+// its resident mips, so the sampler picks the mip from the size of the quad against the most detailed resident one.
+
+// Root constants, see StreamedTextureQuad in Direct3D12_BasicRendering.cpp. In normalized device coordinates.
+cbuffer cbTextureQuad : register(b0)
+{
+    float2 quadCenter;
+    float2 quadHalfSize;
+};
+
+Texture2D streamedTexture : register(t0);
+SamplerState trilinearSampler : register(s0);
+
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float2 texCoord : TEXCOORD;
+};
+
+PSInput VSMain(uint vertexID : SV_VertexID)
+{
+    // Triangle strip of (-1, -1), (1, -1), (-1, 1), (1, 1)
+    const float2 corner = float2(vertexID & 1, vertexID >> 1) * 2.0f - 1.0f;
+
+    PSInput result;
+    result.position = float4(quadCenter + corner * quadHalfSize, 0.0f, 1.0f);
+    result.texCoord = float2(corner.x, -corner.y) * 0.5f + 0.5f;
+
+    return result;
+}
+
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    return float4(streamedTexture.Sample(trilinearSampler, input.texCoord).rgb, 1.0f);
+}
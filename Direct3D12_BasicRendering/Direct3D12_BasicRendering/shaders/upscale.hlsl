@@ -0,0 +1,34 @@
+// Upscale the dynamic resolution scene target to the back buffer with a full screen triangle.
+
+struct PSInput
+{
+    float4 position : SV_POSITION;
+    float2 texCoord : TEXCOORD;
+};
+
+cbuffer cbUpscale : register(b0)
+{
+    float2 uvScale;     // fraction of the scene target covered by the rendered region
+    float2 uvMax;       // clamp to half a texel inside the rendered region to avoid bleeding
+};
+
+Texture2D sceneTexture : register(t0);
+SamplerState linearSampler : register(s0);
+
+PSInput VSMain(uint vertexID : SV_VertexID)
+{
+    // (0, 0), (2, 0), (0, 2) in texture space cover the whole viewport.
+    const float2 texCoord = float2((vertexID << 1) & 2, vertexID & 2);
+
+    PSInput result;
+    result.position = float4(texCoord * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+    result.texCoord = texCoord * uvScale;
+
+    return result;
+}
+
+float4 PSMain(PSInput input) : SV_TARGET
+{
+    return sceneTexture.Sample(linearSampler, min(input.texCoord, uvMax));
+}
+